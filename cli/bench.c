@@ -0,0 +1,406 @@
+/*
+ * bench.c
+ * Author agent <agent@local>
+ *
+ * Implementation of the NETCONF client load generator.
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <libnetconf.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "bench.h"
+#include "commands.h"
+
+extern void clb_error_print(const char* tag,
+		const char* type,
+		const char* severity,
+		const char* apptag,
+		const char* path,
+		const char* message,
+		const char* attribute,
+		const char* element,
+		const char* ns,
+		const char* sid);
+
+/* latencies of a single operation in a single session */
+struct bench_samples {
+	uint64_t* nsec;
+	unsigned long count;
+	unsigned long size;
+	unsigned long errors;
+};
+
+struct bench_worker {
+	pthread_t thread;
+	struct nc_session* session;
+	unsigned int idx;
+	nc_rpc** rpcs;					/* get and get-config requests, created once */
+	struct bench_samples* samples;	/* for every operation */
+};
+
+static struct {
+	struct np_bench_op* ops;
+	unsigned int op_count;
+	struct timespec start;
+	uint64_t duration;		/* nsec */
+	uint64_t interval;		/* nsec between the requests of a session, 0 for no pause */
+} bench;
+
+void np_bench_op_free(struct np_bench_op* op) {
+	struct np_bench_op* to_free;
+
+	while (op != NULL) {
+		to_free = op;
+		op = op->next;
+
+		if (to_free->filter != NULL) {
+			nc_filter_free(to_free->filter);
+		}
+		free(to_free->config);
+		free(to_free);
+	}
+}
+
+static const char* bench_op_name(enum np_bench_op_type type) {
+	switch (type) {
+	case BENCH_GET:
+		return "get";
+	case BENCH_GETCONFIG:
+		return "get-config";
+	default:
+		return "edit-config";
+	}
+}
+
+static uint64_t timespec_nsec(struct timespec ts) {
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_nsec(ts);
+}
+
+static void bench_sleep_until(uint64_t nsec) {
+	struct timespec ts;
+
+	ts.tv_sec = nsec / 1000000000ULL;
+	ts.tv_nsec = nsec % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void bench_samples_add(struct bench_samples* samples, uint64_t nsec) {
+	uint64_t* new_nsec;
+
+	if (samples->count == samples->size) {
+		samples->size = (samples->size ? samples->size * 2 : 1024);
+		new_nsec = realloc(samples->nsec, samples->size * sizeof(uint64_t));
+		if (new_nsec == NULL) {
+			++samples->errors;
+			return;
+		}
+		samples->nsec = new_nsec;
+	}
+	samples->nsec[samples->count++] = nsec;
+}
+
+/* replace the __SESSION__ and __SEQ__ variables of the edit-config template */
+static char* bench_config_subst(const char* template, unsigned int session_idx, unsigned long seq) {
+	const char* vars[] = {"__SESSION__", "__SEQ__"};
+	char values[2][24], *config, *ptr, *config_tmp;
+	unsigned int i;
+
+	snprintf(values[0], sizeof(values[0]), "%u", session_idx);
+	snprintf(values[1], sizeof(values[1]), "%lu", seq);
+
+	config = strdup(template);
+	for (i = 0; i < 2 && config != NULL; ++i) {
+		while ((ptr = strstr(config, vars[i])) != NULL) {
+			/* the part before the variable, the value and the rest */
+			if (asprintf(&config_tmp, "%.*s%s%s", (int)(ptr - config), config, values[i], ptr + strlen(vars[i])) == -1) {
+				config_tmp = NULL;
+			}
+			free(config);
+			if ((config = config_tmp) == NULL) {
+				break;
+			}
+		}
+	}
+
+	return config;
+}
+
+static void clb_bench_error(const char* UNUSED(tag),
+		const char* UNUSED(type),
+		const char* UNUSED(severity),
+		const char* UNUSED(apptag),
+		const char* UNUSED(path),
+		const char* UNUSED(message),
+		const char* UNUSED(attribute),
+		const char* UNUSED(element),
+		const char* UNUSED(ns),
+		const char* UNUSED(sid)) {
+	/* only counted */
+}
+
+static void* bench_thread(void* arg) {
+	struct bench_worker* worker = (struct bench_worker*)arg;
+	struct np_bench_op* op;
+	unsigned int op_idx;
+	unsigned long seq;
+	uint64_t deadline, next, sent;
+	nc_rpc* rpc;
+	nc_reply* reply;
+	NC_MSG_TYPE msg_type;
+	char* config;
+
+	next = timespec_nsec(bench.start);
+	deadline = next + bench.duration;
+	op = bench.ops;
+	op_idx = 0;
+
+	for (seq = 0; (sent = bench_now()) < deadline; ++seq) {
+		if (bench.interval) {
+			if (next > sent) {
+				bench_sleep_until(next);
+			}
+			/* a late request waited for the previous ones, count it in the latency */
+			sent = next;
+			next += bench.interval;
+		}
+
+		if (op->type == BENCH_EDITCONFIG) {
+			config = bench_config_subst(op->config, worker->idx, seq);
+			rpc = (config != NULL ? nc_rpc_editconfig(op->datastore, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_NOTSET, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET, config) : NULL);
+			free(config);
+		} else {
+			rpc = worker->rpcs[op_idx];
+		}
+
+		reply = NULL;
+		msg_type = (rpc != NULL ? nc_session_send_recv(worker->session, rpc, &reply) : NC_MSG_UNKNOWN);
+		if (msg_type == NC_MSG_REPLY && nc_reply_get_type(reply) != NC_REPLY_ERROR) {
+			bench_samples_add(&worker->samples[op_idx], bench_now() - sent);
+		} else {
+			++worker->samples[op_idx].errors;
+		}
+		nc_reply_free(reply);
+		if (op->type == BENCH_EDITCONFIG) {
+			nc_rpc_free(rpc);
+		}
+
+		if (nc_session_get_status(worker->session) != NC_SESSION_STATUS_WORKING) {
+			break;
+		}
+
+		if ((op = op->next) == NULL) {
+			op = bench.ops;
+			op_idx = 0;
+		} else {
+			++op_idx;
+		}
+	}
+
+	return NULL;
+}
+
+static int nsec_cmp(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench_print(FILE* output, const char* name, struct bench_samples* samples, double elapsed) {
+	qsort(samples->nsec, samples->count, sizeof(uint64_t), nsec_cmp);
+
+	fprintf(output, "  %-12s %10lu %8lu %10.1f", name, samples->count, samples->errors, samples->count / elapsed);
+	if (samples->count == 0) {
+		fprintf(output, " %10s %10s %10s %10s\n", "-", "-", "-", "-");
+		return;
+	}
+	fprintf(output, " %10.3f %10.3f %10.3f %10.3f\n",
+			samples->nsec[samples->count / 2] / 1e6,
+			samples->nsec[(samples->count * 9) / 10] / 1e6,
+			samples->nsec[(samples->count * 99) / 100] / 1e6,
+			samples->nsec[samples->count - 1] / 1e6);
+}
+
+/* append the samples of src into dst */
+static int bench_samples_merge(struct bench_samples* dst, const struct bench_samples* src) {
+	uint64_t* new_nsec;
+
+	if (src->count) {
+		new_nsec = realloc(dst->nsec, (dst->count + src->count) * sizeof(uint64_t));
+		if (new_nsec == NULL) {
+			return EXIT_FAILURE;
+		}
+		dst->nsec = new_nsec;
+		memcpy(dst->nsec + dst->count, src->nsec, src->count * sizeof(uint64_t));
+		dst->count += src->count;
+		dst->size = dst->count;
+	}
+	dst->errors += src->errors;
+	return EXIT_SUCCESS;
+}
+
+int perform_bench(struct nc_session** sessions, unsigned int session_count, struct np_bench_op* ops, unsigned int duration, unsigned int rate, FILE* output) {
+	struct bench_worker* workers;
+	struct bench_samples* per_op, total;
+	struct np_bench_op* op;
+	unsigned int i, j, started = 0;
+	double elapsed;
+	int ret = EXIT_SUCCESS;
+
+	bench.ops = ops;
+	for (bench.op_count = 0, op = ops; op != NULL; op = op->next) {
+		++bench.op_count;
+	}
+	bench.duration = duration * 1000000000ULL;
+	bench.interval = (rate ? (session_count * 1000000000ULL) / rate : 0);
+
+	workers = calloc(session_count, sizeof(struct bench_worker));
+	per_op = calloc(bench.op_count, sizeof(struct bench_samples));
+	memset(&total, 0, sizeof(total));
+	if (workers == NULL || per_op == NULL) {
+		ERROR("bench", "memory allocation error (%s).", strerror(errno));
+		free(workers);
+		free(per_op);
+		return EXIT_FAILURE;
+	}
+
+	/* everything shared by the threads is created beforehand */
+	for (i = 0; i < session_count; ++i) {
+		workers[i].session = sessions[i];
+		workers[i].idx = i;
+		workers[i].rpcs = calloc(bench.op_count, sizeof(nc_rpc*));
+		workers[i].samples = calloc(bench.op_count, sizeof(struct bench_samples));
+		if (workers[i].rpcs == NULL || workers[i].samples == NULL) {
+			ERROR("bench", "memory allocation error (%s).", strerror(errno));
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+		for (j = 0, op = ops; op != NULL; ++j, op = op->next) {
+			if (op->type == BENCH_GET) {
+				workers[i].rpcs[j] = nc_rpc_get(op->filter);
+			} else if (op->type == BENCH_GETCONFIG) {
+				workers[i].rpcs[j] = nc_rpc_getconfig(op->datastore, op->filter);
+			} else {
+				continue;
+			}
+			if (workers[i].rpcs[j] == NULL) {
+				ERROR("bench", "creating an rpc request failed.");
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+		}
+	}
+
+	/* the rpc-errors are only counted */
+	nc_callback_error_reply(clb_bench_error);
+
+	clock_gettime(CLOCK_MONOTONIC, &bench.start);
+	for (started = 0; started < session_count; ++started) {
+		if ((errno = pthread_create(&workers[started].thread, NULL, bench_thread, &workers[started])) != 0) {
+			ERROR("bench", "creating a thread failed (%s).", strerror(errno));
+			ret = EXIT_FAILURE;
+			break;
+		}
+	}
+	for (i = 0; i < started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	elapsed = (bench_now() - timespec_nsec(bench.start)) / 1e9;
+
+	nc_callback_error_reply(clb_error_print);
+
+	if (started == session_count) {
+		for (i = 0; i < session_count; ++i) {
+			for (j = 0; j < bench.op_count; ++j) {
+				if (bench_samples_merge(&per_op[j], &workers[i].samples[j]) || bench_samples_merge(&total, &workers[i].samples[j])) {
+					ERROR("bench", "memory allocation error (%s).", strerror(errno));
+					ret = EXIT_FAILURE;
+					goto cleanup;
+				}
+			}
+		}
+
+		fprintf(output, "Sessions: %u, duration: %.2fs, target rate: ", session_count, elapsed);
+		if (rate) {
+			fprintf(output, "%u RPCs/s\n", rate);
+		} else {
+			fprintf(output, "max\n");
+		}
+		fprintf(output, "  %-12s %10s %8s %10s %10s %10s %10s %10s\n", "Operation", "Replies", "Errors", "Rate/s", "p50 ms", "p90 ms", "p99 ms", "max ms");
+		for (j = 0, op = ops; op != NULL; ++j, op = op->next) {
+			bench_print(output, bench_op_name(op->type), &per_op[j], elapsed);
+		}
+		if (bench.op_count > 1) {
+			bench_print(output, "total", &total, elapsed);
+		}
+	}
+
+cleanup:
+	for (i = 0; i < session_count; ++i) {
+		for (j = 0; workers[i].rpcs != NULL && j < bench.op_count; ++j) {
+			if (workers[i].rpcs[j] != NULL) {
+				nc_rpc_free(workers[i].rpcs[j]);
+			}
+		}
+		for (j = 0; workers[i].samples != NULL && j < bench.op_count; ++j) {
+			free(workers[i].samples[j].nsec);
+		}
+		free(workers[i].rpcs);
+		free(workers[i].samples);
+	}
+	for (j = 0; j < bench.op_count; ++j) {
+		free(per_op[j].nsec);
+	}
+	free(per_op);
+	free(total.nsec);
+	free(workers);
+
+	return ret;
+}
@@ -0,0 +1,27 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdio.h>
+#include <libnetconf.h>
+
+struct np_bench_op {
+	enum np_bench_op_type {
+		BENCH_GET,
+		BENCH_GETCONFIG,
+		BENCH_EDITCONFIG
+	} type;
+	NC_DATASTORE datastore;		/* get-config source or edit-config target */
+	struct nc_filter* filter;
+	char* config;				/* edit-config template with __SESSION__ and __SEQ__ variables */
+	struct np_bench_op* next;
+};
+
+void np_bench_op_free(struct np_bench_op* op);
+
+/*
+ * Send the operations round-robin from every session in its own thread for duration seconds,
+ * all together at rate RPCs per second (0 as fast as possible), and print the results.
+ */
+int perform_bench(struct nc_session** sessions, unsigned int session_count, struct np_bench_op* ops, unsigned int duration, unsigned int rate, FILE* output);
+
+#endif /* _BENCH_H_ */
@@ -73,6 +73,10 @@
 #include "configuration.h"
 #include "readinput.h"
 #include "test.h"
+#include "bench.h"
+#include "output.h"
+#include "recorder.h"
+#include "fleet.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
@@ -91,7 +95,24 @@ volatile int time_commands = 0;
 
 void print_version();
 
-struct nc_session* session = NULL;
+/* thread-local for the tests running in parallel, see perform_test() */
+__thread struct nc_session* session = NULL;
+
+/* an RPC sent in the batch mode waiting for its reply */
+struct batch_rpc {
+	char* msgid;
+	const char* operation;
+	char* output_file;
+	int split;
+	struct timespec sent;
+	struct batch_result* result;
+	struct batch_rpc* next;
+};
+
+unsigned int batch_window = 0;
+struct batch_result* batch_current = NULL;
+static struct batch_rpc* batch_rpcs = NULL;
+static unsigned int batch_outstanding = 0;
 
 #define BUFFER_SIZE 1024
 
@@ -115,6 +136,8 @@ COMMAND commands[] = {
 	{"unlock", cmd_unlock, "NETCONF <unlock> operation"},
 	{"validate", cmd_validate, "NETCONF <validate> operation"},
 	{"test", cmd_test, "Run a specified test case"},
+	{"bench", cmd_bench, "Measure the server RPC throughput and latency with concurrent sessions"},
+	{"fleet", cmd_fleet, "Execute commands on many NETCONF servers concurrently"},
 #ifndef DISABLE_NOTIFICATIONS
 	{"subscribe", cmd_subscribe, "NETCONF Event Notifications <create-subscription> operation"},
 #endif
@@ -179,6 +202,7 @@ typedef enum GENERIC_OPS {
 } GENERIC_OPS;
 
 int cmd_generic_op(GENERIC_OPS op, const char* arg, FILE* output);
+static unsigned int open_sessions(const char* connect_arg, struct nc_session** sessions, unsigned int count, FILE* output, FILE* input);
 
 struct arglist {
 	char** list;
@@ -533,14 +557,221 @@ static double timespec_subtract(struct timespec larger, struct timespec smaller)
 }
 
 /* rpc parameter is freed after the function call */
-static int send_recv_process(const char* operation, nc_rpc* rpc, const char* output_file, FILE* output) {
-	nc_reply *reply = NULL;
+static int reply_process(const char* operation, nc_reply** reply, const char* output_file, int split, FILE* output) {
 	char *data = NULL;
-	FILE* out_stream;
+	const char* errmsg;
+	int ret = EXIT_SUCCESS;
+
+	switch (nc_reply_get_type(*reply)) {
+	case NC_REPLY_OK:
+		if (batch_window == 0) {
+			INSTRUCTION(output, "Result OK\n");
+		}
+		break;
+	case NC_REPLY_DATA:
+		/* only the copy of the data is kept while written */
+		data = nc_reply_get_data(*reply);
+		nc_reply_free(*reply);
+		*reply = NULL;
+		if (data == NULL) {
+			ERROR(operation, "Unable to get the reply data.");
+			ret = EXIT_FAILURE;
+			break;
+		}
+
+		if (output_file != NULL) {
+			ret = np_out_data(operation, data, output_file, split);
+		} else {
+			INSTRUCTION(output, "Result:\n");
+			fprintf(output, "%s\n", data);
+		}
+		free(data);
+		break;
+	case NC_REPLY_ERROR:
+		if (batch_window != 0) {
+			/* the batch mode processes rpc-errors itself to know their RPC */
+			errmsg = nc_reply_get_errormsg(*reply);
+			ERROR(operation, "%s", (errmsg != NULL) ? errmsg : "rpc-error received.");
+		} else {
+			/* wtf, you shouldn't be here !?!? */
+			ERROR(operation, "operation failed, but rpc-error was not processed.");
+		}
+		ret = EXIT_FAILURE;
+		break;
+	default:
+		ERROR(operation, "unexpected operation result.");
+		ret = EXIT_FAILURE;
+		break;
+	}
+
+	return ret;
+}
+
+static void batch_rpc_finish(struct batch_rpc* brpc, int status, const char* errmsg) {
+	if (brpc->result != NULL) {
+		brpc->result->status = status;
+		if (errmsg != NULL && brpc->result->errmsg == NULL) {
+			brpc->result->errmsg = strdup(errmsg);
+		}
+	}
+
+	free(brpc->msgid);
+	free(brpc->output_file);
+	free(brpc);
+	--batch_outstanding;
+}
+
+/* fail all the outstanding RPCs, their replies will never be matched */
+static void batch_abort(const char* errmsg) {
+	struct batch_rpc* brpc;
+
+	while (batch_rpcs != NULL) {
+		brpc = batch_rpcs;
+		batch_rpcs = brpc->next;
+		batch_rpc_finish(brpc, EXIT_FAILURE, errmsg);
+	}
+}
+
+/* receive a reply and process it as the reply of the RPC with its message-id */
+static int batch_recv(FILE* output) {
+	nc_reply* reply = NULL;
+	struct batch_rpc* brpc, *prev;
+	const char* msgid, *errmsg;
+	struct timespec tsnew;
+	int ret;
+
+	switch (nc_session_recv_reply(session, -1, &reply)) {
+	case NC_MSG_REPLY:
+		break;
+	case NC_MSG_WOULDBLOCK:
+	case NC_MSG_NONE:
+		return EXIT_SUCCESS;
+	default:
+		if (nc_session_get_status(session) != NC_SESSION_STATUS_WORKING) {
+			ERROR("batch", "receiving rpc-reply failed.");
+			batch_abort("session broken");
+			INSTRUCTION(output, "Closing the session.\n");
+			cmd_disconnect(NULL, NULL, output, NULL);
+		} else {
+			ERROR("batch", "Unknown error occurred.");
+			batch_abort("reply not received");
+		}
+		return EXIT_FAILURE;
+	}
+
+	if (time_commands) {
+		clock_gettime(CLOCK_MONOTONIC, &tsnew);
+	}
+
+	msgid = nc_reply_get_msgid(reply);
+	for (prev = NULL, brpc = batch_rpcs; brpc != NULL; prev = brpc, brpc = brpc->next) {
+		if (msgid != NULL && !strcmp(brpc->msgid, msgid)) {
+			break;
+		}
+	}
+	if (brpc == NULL) {
+		ERROR("batch", "received a reply with an unknown message-id \"%s\".", (msgid != NULL) ? msgid : "");
+		nc_reply_free(reply);
+		return EXIT_SUCCESS;
+	}
+	if (prev == NULL) {
+		batch_rpcs = brpc->next;
+	} else {
+		prev->next = brpc->next;
+	}
+
+	errmsg = NULL;
+	if (nc_reply_get_type(reply) == NC_REPLY_ERROR) {
+		errmsg = nc_reply_get_errormsg(reply);
+		if (errmsg == NULL) {
+			errmsg = "rpc-error received";
+		}
+	}
+	ret = reply_process(brpc->operation, &reply, brpc->output_file, brpc->split, output);
+	if (time_commands) {
+		fprintf(output, "Timed: %.6fs\n", timespec_subtract(tsnew, brpc->sent));
+	}
+	batch_rpc_finish(brpc, ret, errmsg);
+	nc_reply_free(reply);
+
+	return EXIT_SUCCESS;
+}
+
+void batch_flush(FILE* output) {
+	while (batch_rpcs != NULL && batch_recv(output) == EXIT_SUCCESS);
+}
+
+/* send the RPC without waiting for its reply, unless there are batch_window RPCs outstanding */
+static int send_pipelined(const char* operation, nc_rpc* rpc, const char* output_file, int split, FILE* output) {
+	struct batch_rpc* brpc, *last;
+	const char* msgid;
+
+	if (nc_session_get_status(session) != NC_SESSION_STATUS_WORKING) {
+		INSTRUCTION(output, "Session is broken, cleaning out.\n");
+		cmd_disconnect(NULL, NULL, output, NULL);
+		nc_rpc_free(rpc);
+		return EXIT_FAILURE;
+	}
+
+	brpc = calloc(1, sizeof *brpc);
+	if (brpc == NULL) {
+		ERROR(operation, "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		nc_rpc_free(rpc);
+		return EXIT_FAILURE;
+	}
+	/* the operation names are literals */
+	brpc->operation = operation;
+	if (output_file != NULL) {
+		brpc->output_file = strdup(output_file);
+	}
+	brpc->split = split;
+	if (time_commands) {
+		clock_gettime(CLOCK_MONOTONIC, &brpc->sent);
+	}
+
+	msgid = nc_session_send_rpc(session, rpc);
+	if (msgid == NULL) {
+		ERROR(operation, "sending the rpc failed.");
+		free(brpc->output_file);
+		free(brpc);
+		nc_rpc_free(rpc);
+		return EXIT_FAILURE;
+	}
+	brpc->msgid = strdup(msgid);
+	nc_rpc_free(rpc);
+
+	brpc->result = batch_current;
+	if (batch_current != NULL) {
+		batch_current->rpc = 1;
+		batch_current->status = BATCH_PENDING;
+	}
+	if (batch_rpcs == NULL) {
+		batch_rpcs = brpc;
+	} else {
+		for (last = batch_rpcs; last->next != NULL; last = last->next);
+		last->next = brpc;
+	}
+	++batch_outstanding;
+
+	while (batch_outstanding >= batch_window && batch_recv(output) == EXIT_SUCCESS);
+
+	return EXIT_SUCCESS;
+}
+
+static int send_recv_process(const char* operation, nc_rpc* rpc, const char* output_file, int split, FILE* output) {
+	nc_reply *reply = NULL;
 	NC_MSG_TYPE msg_type;
 	struct timespec tsold, tsnew;
 	int ret = EXIT_SUCCESS;
 
+	if (batch_window != 0) {
+		if (strcmp(operation, "subscribe")) {
+			return send_pipelined(operation, rpc, output_file, split, output);
+		}
+		/* the notifications are received only after the subscription is known to succeed */
+		batch_flush(output);
+	}
+
 	if (time_commands) {
 		clock_gettime(CLOCK_MONOTONIC, &tsold);
 	}
@@ -552,8 +783,14 @@ static int send_recv_process(const char* operation, nc_rpc* rpc, const char* out
 		goto cleanup;
 	}
 
-	/* send the request and get the reply */
+	/* send the request and get the reply, the other test threads can execute their commands meanwhile */
+	if (test_lock != NULL) {
+		pthread_mutex_unlock(test_lock);
+	}
 	msg_type = nc_session_send_recv(session, rpc, &reply);
+	if (test_lock != NULL) {
+		pthread_mutex_lock(test_lock);
+	}
 
 	if (time_commands) {
 		clock_gettime(CLOCK_MONOTONIC, &tsnew);
@@ -575,42 +812,7 @@ static int send_recv_process(const char* operation, nc_rpc* rpc, const char* out
 		/* error occurred, but processed by callback */
 		break;
 	case NC_MSG_REPLY:
-		switch (nc_reply_get_type(reply)) {
-		case NC_REPLY_OK:
-			INSTRUCTION(output, "Result OK\n");
-			break;
-		case NC_REPLY_DATA:
-			if (output_file != NULL) {
-				out_stream = fopen(output_file, "w");
-				if (out_stream == NULL) {
-					ERROR(operation, "Could not open the output file \"%s\" (%s).", output_file, strerror(errno));
-					ret = EXIT_FAILURE;
-					break;
-				}
-				if (!strcmp(operation, "get-config")) {
-                    fprintf(out_stream, "<config xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\">\n");
-                }
-				fprintf(out_stream, "%s\n", data = nc_reply_get_data(reply));
-                if (!strcmp(operation, "get-config")) {
-                    fprintf(out_stream, "</config>\n");
-                }
-				fclose(out_stream);
-			} else {
-				INSTRUCTION(output, "Result:\n");
-				fprintf(output, "%s\n", data = nc_reply_get_data(reply));
-			}
-			free(data);
-			break;
-		case NC_REPLY_ERROR:
-			/* wtf, you shouldn't be here !?!? */
-			ERROR(operation, "operation failed, but rpc-error was not processed.");
-			ret = EXIT_FAILURE;
-			break;
-		default:
-			ERROR(operation, "unexpected operation result.");
-			ret = EXIT_FAILURE;
-			break;
-		}
+		ret = reply_process(operation, &reply, output_file, split, output);
 		break;
 	default:
 		ERROR(operation, "Unknown error occurred.");
@@ -843,7 +1045,7 @@ int cmd_editconfig(const char* arg, const char* old_input_file, FILE* output, FI
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("edit-config", rpc, NULL, output);
+	return send_recv_process("edit-config", rpc, NULL, 0, output);
 }
 
 void cmd_validate_help(FILE* output) {
@@ -981,7 +1183,7 @@ int cmd_validate(const char* arg, const char* old_input_file, FILE* output, FILE
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("validate", rpc, NULL, output);
+	return send_recv_process("validate", rpc, NULL, 0, output);
 }
 
 void cmd_copyconfig_help(FILE* output) {
@@ -1182,7 +1384,7 @@ int cmd_copyconfig(const char* arg, const char* old_input_file, FILE* output, FI
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("copy-config", rpc, NULL, output);
+	return send_recv_process("copy-config", rpc, NULL, 0, output);
 }
 
 void cmd_get_help(FILE* output) {
@@ -1193,11 +1395,11 @@ void cmd_get_help(FILE* output) {
 	} else {
 		defaults = "";
 	}
-	fprintf(stdout, "get [--help] %s[--filter [file]] [--out file]\n", defaults);
+	fprintf(stdout, "get [--help] %s[--filter [file]] [--out file [--split]]\n", defaults);
 }
 
 int cmd_get(const char* arg, const char* old_input_file, FILE* output, FILE* input) {
-	int c;
+	int c, split = 0;
 	char* out = NULL;
 	struct nc_filter *filter = NULL;
 	nc_rpc *rpc = NULL;
@@ -1208,6 +1410,7 @@ int cmd_get(const char* arg, const char* old_input_file, FILE* output, FILE* inp
 			{"filter", 2, 0, 'f'},
 			{"help", 0, 0, 'h'},
 			{"out", 1, 0, 'o'},
+			{"split", 0, 0, 's'},
 			{0, 0, 0, 0}
 	};
 	int option_index = 0;
@@ -1218,7 +1421,7 @@ int cmd_get(const char* arg, const char* old_input_file, FILE* output, FILE* inp
 	init_arglist(&cmd);
 	addargs(&cmd, "%s", arg);
 
-	while ((c = getopt_long(cmd.count, cmd.list, "d:f::ho:", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(cmd.count, cmd.list, "d:f::ho:s", long_options, &option_index)) != -1) {
 		switch (c) {
 		case 'd':
 			wd = get_withdefaults("get-config", optarg, output, input);
@@ -1242,6 +1445,9 @@ int cmd_get(const char* arg, const char* old_input_file, FILE* output, FILE* inp
 		case 'o':
 			out = strdupa(optarg);
 			break;
+		case 's':
+			split = 1;
+			break;
 		default:
 			ERROR("get", "unknown option -%c.", c);
 			cmd_get_help(output);
@@ -1255,6 +1461,12 @@ int cmd_get(const char* arg, const char* old_input_file, FILE* output, FILE* inp
 		clear_arglist(&cmd);
 		return EXIT_FAILURE;
 	}
+	if (split && out == NULL) {
+		ERROR("get", "--split requires --out.");
+		nc_filter_free(filter);
+		clear_arglist(&cmd);
+		return EXIT_FAILURE;
+	}
 
 	/* arglist is no more needed */
 	clear_arglist(&cmd);
@@ -1279,7 +1491,7 @@ int cmd_get(const char* arg, const char* old_input_file, FILE* output, FILE* inp
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("get", rpc, out, output);
+	return send_recv_process("get", rpc, out, split, output);
 }
 
 void cmd_deleteconfig_help(FILE* output) {
@@ -1384,7 +1596,7 @@ int cmd_deleteconfig(const char* arg, const char* UNUSED(old_input_file), FILE*
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("delete-config", rpc, NULL, output);
+	return send_recv_process("delete-config", rpc, NULL, 0, output);
 }
 
 void cmd_killsession_help(FILE* output) {
@@ -1462,7 +1674,7 @@ int cmd_killsession(const char* arg, const char* UNUSED(old_input_file), FILE* o
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("kill-session", rpc, NULL, output);
+	return send_recv_process("kill-session", rpc, NULL, 0, output);
 }
 
 #define CAP_ADD 'a'
@@ -1576,7 +1788,7 @@ void cmd_getconfig_help(FILE* output) {
 	} else {
 		defaults = "";
 	}
-	fprintf(output, "get-config [--help] %s[--filter [file]] [--out file] running", defaults);
+	fprintf(output, "get-config [--help] %s[--filter [file]] [--out file [--split]] running", defaults);
 	if (session == NULL || nc_cpblts_enabled(session, NC_CAP_STARTUP_ID)) {
 		fprintf(output, "|startup");
 	}
@@ -1587,7 +1799,7 @@ void cmd_getconfig_help(FILE* output) {
 }
 
 int cmd_getconfig(const char* arg, const char* old_input_file, FILE* output, FILE* input) {
-	int c;
+	int c, split = 0;
 	char* out = NULL;
 	NC_DATASTORE target;
 	NCWD_MODE wd = NCWD_MODE_NOTSET;
@@ -1599,6 +1811,7 @@ int cmd_getconfig(const char* arg, const char* old_input_file, FILE* output, FIL
 			{"filter", 2, 0, 'f'},
 			{"help", 0, 0, 'h'},
 			{"out", 1, 0, 'o'},
+			{"split", 0, 0, 's'},
 			{0, 0, 0, 0}
 	};
 	int option_index = 0;
@@ -1609,7 +1822,7 @@ int cmd_getconfig(const char* arg, const char* old_input_file, FILE* output, FIL
 	init_arglist(&cmd);
 	addargs(&cmd, "%s", arg);
 
-	while ((c = getopt_long(cmd.count, cmd.list, "d:f::ho:", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(cmd.count, cmd.list, "d:f::ho:s", long_options, &option_index)) != -1) {
 		switch (c) {
 		case 'd':
 			wd = get_withdefaults("get-config", optarg, output, input);
@@ -1633,6 +1846,9 @@ int cmd_getconfig(const char* arg, const char* old_input_file, FILE* output, FIL
 		case 'o':
 			out = strdupa(optarg);
 			break;
+		case 's':
+			split = 1;
+			break;
 		default:
 			ERROR("get-config", "unknown option -%c.", c);
 			cmd_getconfig_help(output);
@@ -1641,6 +1857,13 @@ int cmd_getconfig(const char* arg, const char* old_input_file, FILE* output, FIL
 		}
 	}
 
+	if (split && out == NULL) {
+		ERROR("get-config", "--split requires --out.");
+		nc_filter_free(filter);
+		clear_arglist(&cmd);
+		return EXIT_FAILURE;
+	}
+
 	if (session == NULL) {
 		ERROR("get-config", "NETCONF session not established, use the \'connect\' command.");
 		clear_arglist(&cmd);
@@ -1671,17 +1894,101 @@ int cmd_getconfig(const char* arg, const char* old_input_file, FILE* output, FIL
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("get-config", rpc, out, output);
+	return send_recv_process("get-config", rpc, out, split, output);
 }
 
 void cmd_getschema_help(FILE* output) {
 	/* if session not established, print complete help for all capabilities */
-	fprintf(output, "get-schema [--help] [--version <version>] [--format <format>] [--out <file>] <identifier>\n");
+	fprintf(output, "get-schema [--help] [--version <version>] [--format <format>] [--out <file>] [--refresh] <identifier>\n");
+	fprintf(output, "\tThe schemas of a known version, given or from the server hello, are cached, --refresh downloads it anyway.\n");
+}
+
+/* the revision of the module in the capabilities of the server, NULL if not advertised */
+static char* getschema_hello_revision(const char* identifier) {
+	struct nc_cpblts* cpblts;
+	const char* uri, *params;
+	char* dup, *param, *ptr, *revision = NULL, *param_revision;
+	int match;
+
+	if ((cpblts = nc_session_get_cpblts(session)) == NULL) {
+		return NULL;
+	}
+
+	nc_cpblts_iter_start(cpblts);
+	while (revision == NULL && (uri = nc_cpblts_iter_next(cpblts)) != NULL) {
+		if ((params = strchr(uri, '?')) == NULL || (dup = strdup(params + 1)) == NULL) {
+			continue;
+		}
+
+		match = 0;
+		param_revision = NULL;
+		for (param = strtok_r(dup, "&", &ptr); param != NULL; param = strtok_r(NULL, "&", &ptr)) {
+			if (strncmp(param, "amp;", 4) == 0) {
+				param += 4;
+			}
+			if (strncmp(param, "module=", 7) == 0) {
+				match = (strcmp(param + 7, identifier) == 0);
+			} else if (strncmp(param, "revision=", 9) == 0) {
+				param_revision = param + 9;
+			}
+		}
+		if (match && param_revision != NULL) {
+			revision = strdup(param_revision);
+		}
+		free(dup);
+	}
+
+	return revision;
+}
+
+/* print or write the cached schema the same way as the reply data */
+static int getschema_cached(const char* path, const char* out, FILE* output) {
+	struct stat st;
+	struct np_out* file;
+	char* schema;
+	int fd, ret = EXIT_SUCCESS;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		ERROR("get-schema", "unable to open the cached schema \"%s\" (%s).", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (fstat(fd, &st) != 0) {
+		ERROR("get-schema", "fstat failed (%s).", strerror(errno));
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	schema = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (schema == MAP_FAILED) {
+		ERROR("get-schema", "mmapping of the cached schema failed (%s).", strerror(errno));
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* written with the trailing newline */
+	if (out != NULL) {
+		if ((file = np_out_open(out)) == NULL) {
+			ret = EXIT_FAILURE;
+		} else {
+			ret = np_out_write(file, schema, st.st_size);
+			if (np_out_close(file) != EXIT_SUCCESS) {
+				ret = EXIT_FAILURE;
+			}
+		}
+	} else {
+		INSTRUCTION(output, "Result:\n");
+		fwrite(schema, 1, st.st_size, output);
+	}
+
+	munmap(schema, st.st_size);
+	close(fd);
+	return ret;
 }
 
 int cmd_getschema(const char* arg, const char* UNUSED(old_input_file), FILE* output, FILE* UNUSED(input)) {
-	int c;
-	char *format = NULL, *version = NULL, *identifier = NULL, *out = NULL;
+	int c, refresh = 0, ret;
+	unsigned int window;
+	char *format = NULL, *version = NULL, *identifier = NULL, *out = NULL, *hello_version = NULL;
+	char *cache_path = NULL, *cache_tmp;
 	nc_rpc *rpc = NULL;
 	struct arglist cmd;
 	struct option long_options[] ={
@@ -1689,6 +1996,7 @@ int cmd_getschema(const char* arg, const char* UNUSED(old_input_file), FILE* out
 			{"version", 1, 0, 'v'},
 			{"help", 0, 0, 'h'},
 			{"out", 1, 0, 'o'},
+			{"refresh", 0, 0, 'r'},
 			{0, 0, 0, 0}
 	};
 	int option_index = 0;
@@ -1699,7 +2007,7 @@ int cmd_getschema(const char* arg, const char* UNUSED(old_input_file), FILE* out
 	init_arglist(&cmd);
 	addargs(&cmd, "%s", arg);
 
-	while ((c = getopt_long(cmd.count, cmd.list, "f:hv:", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(cmd.count, cmd.list, "f:hv:o:r", long_options, &option_index)) != -1) {
 		switch (c) {
 		case 'f':
 			format = optarg;
@@ -1715,6 +2023,9 @@ int cmd_getschema(const char* arg, const char* UNUSED(old_input_file), FILE* out
 		case 'o':
 			out = strdupa(optarg);
 			break;
+		case 'r':
+			refresh = 1;
+			break;
 		default:
 			ERROR("get-schema", "unknown option -%c.", c);
 			cmd_getschema_help(output);
@@ -1752,20 +2063,67 @@ int cmd_getschema(const char* arg, const char* UNUSED(old_input_file), FILE* out
 		return EXIT_FAILURE;
 	}
 
+	/* the same module revision is the same schema on any server */
+	if (version == NULL) {
+		version = hello_version = getschema_hello_revision(identifier);
+	}
+	if (version != NULL) {
+		cache_path = get_schema_cache_path(identifier, version, (format != NULL) ? format : "yang");
+	}
+	if (cache_path != NULL && !refresh && eaccess(cache_path, R_OK) == 0) {
+		ret = getschema_cached(cache_path, out, output);
+		clear_arglist(&cmd);
+		free(identifier);
+		free(hello_version);
+		free(cache_path);
+		return ret;
+	}
+
 	/* create requests */
 	rpc = nc_rpc_getschema(identifier, version, format);
 
 	/* arglist is no more needed */
 	clear_arglist(&cmd);
 	free(identifier);
+	free(hello_version);
 
 	if (rpc == NULL) {
 		ERROR("get-schema", "creating an rpc request failed.");
+		free(cache_path);
 		return EXIT_FAILURE;
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("get-schema", rpc, out, output);
+	if (cache_path == NULL) {
+		return send_recv_process("get-schema", rpc, out, 0, output);
+	}
+	if (asprintf(&cache_tmp, "%s.%d", cache_path, getpid()) == -1) {
+		ERROR("get-schema", "memory allocation error (%s).", strerror(errno));
+		nc_rpc_free(rpc);
+		free(cache_path);
+		return EXIT_FAILURE;
+	}
+
+	/* the schema is cached first and then printed, so its reply is waited for even in the batch mode */
+	batch_flush(output);
+	window = batch_window;
+	batch_window = 0;
+	ret = send_recv_process("get-schema", rpc, cache_tmp, 0, output);
+	batch_window = window;
+
+	if (ret == EXIT_SUCCESS && rename(cache_tmp, cache_path) == -1) {
+		ERROR("get-schema", "caching the schema as \"%s\" failed (%s).", cache_path, strerror(errno));
+		ret = EXIT_FAILURE;
+	}
+	if (ret == EXIT_SUCCESS) {
+		ret = getschema_cached(cache_path, out, output);
+	} else {
+		unlink(cache_tmp);
+	}
+
+	free(cache_tmp);
+	free(cache_path);
+	return ret;
 }
 
 void cmd_un_lock_help(char* operation, FILE* output) {
@@ -1857,7 +2215,7 @@ int cmd_un_lock(int op, const char* arg, FILE* output, FILE* input) {
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process(operation, rpc, NULL, output);
+	return send_recv_process(operation, rpc, NULL, 0, output);
 }
 
 int cmd_lock(const char* arg, const char* UNUSED(old_input_file), FILE* output, FILE* input) {
@@ -1869,7 +2227,9 @@ int cmd_unlock(const char* arg, const char* UNUSED(old_input_file), FILE* output
 }
 
 void cmd_test_help(FILE* output) {
-	fprintf(output, "test <test_case.xml> [<other_test_cases.xml> ...]\n");
+	fprintf(output, "test [--jobs <num>] <test_case.xml> [<other_test_cases.xml> ...] [-- <connect arguments>]\n");
+	fprintf(output, "With more jobs the tests of a file run in parallel, one job on the current session and the others\n"
+			"on the sessions opened with the connect arguments.\n");
 }
 
 static struct np_test_capab* test_parse_capabs(xmlNodePtr node_list) {
@@ -2263,73 +2623,152 @@ static struct np_test* test_parse_tests(xmlNodePtr node_list) {
 	return ret;
 }
 
-int cmd_test(const char* arg, const char* UNUSED(old_input_file), FILE* output, FILE* UNUSED(input)) {
-	char* args = strdupa(arg);
-	char* cmd = NULL, *ptr = NULL;
+int cmd_test(const char* arg, const char* UNUSED(old_input_file), FILE* output, FILE* input) {
+	int i, ret = EXIT_SUCCESS;
+	unsigned int jobs = 1, connected = 0;
+	char* connect_arg = NULL, *aux;
+	struct nc_session** sessions = NULL;
 	struct np_test* tests;
 	struct np_test_capab* test_capabs;
 	struct np_test_var* vars;
 	const struct nc_cpblts* capabs;
+	struct arglist cmd, files;
 	xmlDocPtr doc;
 	xmlNodePtr root, node;
 
-	cmd = strtok_r(args, " ", &ptr);
-	cmd = strtok_r(NULL, " ", &ptr);
-	if (cmd == NULL || strcmp(cmd, "--help") == 0 || strcmp(cmd, "-h") == 0) {
-		cmd_test_help(output);
+	init_arglist(&cmd);
+	init_arglist(&files);
+	addargs(&cmd, "%s", arg);
 
-	} else {
-		if (session == NULL) {
-			ERROR("test", "NETCONF session not established, use the \'connect\' command.");
-			return EXIT_FAILURE;
+	for (i = 1; i < cmd.count; ++i) {
+		if (strcmp(cmd.list[i], "--help") == 0 || strcmp(cmd.list[i], "-h") == 0) {
+			break;
+		} else if (strcmp(cmd.list[i], "--jobs") == 0) {
+			if (i + 1 == cmd.count || (jobs = (unsigned int)atoi(cmd.list[i + 1])) == 0) {
+				ERROR("test", "invalid number of jobs.");
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+			++i;
+		} else if (strcmp(cmd.list[i], "--") == 0) {
+			/* the rest is for connect */
+			if (asprintf(&connect_arg, "connect") == -1) {
+				connect_arg = NULL;
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+			for (++i; i < cmd.count; ++i) {
+				aux = connect_arg;
+				if (asprintf(&connect_arg, "%s %s", aux, cmd.list[i]) == -1) {
+					connect_arg = aux;
+					ret = EXIT_FAILURE;
+					goto cleanup;
+				}
+				free(aux);
+			}
+		} else {
+			addargs(&files, "%s", cmd.list[i]);
 		}
+	}
+	if (i < cmd.count || files.count == 0) {
+		cmd_test_help(output);
+		goto cleanup;
+	}
 
-		capabs = nc_session_get_cpblts(session);
-		if (capabs == NULL) {
-			ERROR("test", "Failed to get the current session capabilities.");
-			return EXIT_FAILURE;
-		}
+	if (session == NULL) {
+		ERROR("test", "NETCONF session not established, use the \'connect\' command.");
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
 
-		for (; cmd != NULL; cmd = strtok_r(NULL, " ", &ptr)) {
-			tests = NULL;
-			test_capabs = NULL;
-			vars = NULL;
+	capabs = nc_session_get_cpblts(session);
+	if (capabs == NULL) {
+		ERROR("test", "Failed to get the current session capabilities.");
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
 
-			doc = xmlReadFile(cmd, NULL, XML_PARSE_NOBLANKS | XML_PARSE_NSCLEAN);
-			if (doc == NULL) {
-				ERROR("test", "Failed to parse \'%s\'.", cmd);
-				return EXIT_FAILURE;
-			}
+	/* the first job uses the current session */
+	if ((sessions = calloc(jobs, sizeof(struct nc_session*))) == NULL) {
+		ERROR("test", "memory allocation error (%s).", strerror(errno));
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+	sessions[0] = session;
+	connected = 1;
+	if (jobs > 1) {
+		if (connect_arg == NULL) {
+			ERROR("test", "the connect arguments are needed for more jobs, see \'test --help\'.");
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+		connected += open_sessions(connect_arg, sessions + 1, jobs - 1, output, input);
+		if (connected < jobs) {
+			ERROR("test", "only %u of %u sessions established.", connected, jobs);
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
 
-			root = xmlDocGetRootElement(doc);
-			for (node = root->children; node != NULL; node = node->next) {
-				if (xmlStrEqual(node->name, BAD_CAST "requirements")) {
-					test_capabs = test_parse_capabs(node->children);
-				}
+	for (i = 0; i < files.count; ++i) {
+		tests = NULL;
+		test_capabs = NULL;
+		vars = NULL;
 
-				if (xmlStrEqual(node->name, BAD_CAST "variables")) {
-					vars = test_parse_vars(node->children);
-				}
+		doc = xmlReadFile(files.list[i], NULL, XML_PARSE_NOBLANKS | XML_PARSE_NSCLEAN);
+		if (doc == NULL) {
+			ERROR("test", "Failed to parse \'%s\'.", files.list[i]);
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		root = xmlDocGetRootElement(doc);
+		for (node = root->children; node != NULL; node = node->next) {
+			if (xmlStrEqual(node->name, BAD_CAST "requirements")) {
+				test_capabs = test_parse_capabs(node->children);
 			}
 
-			tests = test_parse_tests(root->children);
-			if (tests == NULL) {
-				ERROR("test", "Failed to parse tests (%s).", cmd);
-				xmlFreeDoc(doc);
-				np_test_capab_free(test_capabs);
-				np_test_var_free(vars);
-				return EXIT_FAILURE;
+			if (xmlStrEqual(node->name, BAD_CAST "variables")) {
+				vars = test_parse_vars(node->children);
 			}
+		}
 
-			perform_test(tests, test_capabs, vars, capabs, output);
+		tests = test_parse_tests(root->children);
+		if (tests == NULL) {
+			ERROR("test", "Failed to parse tests (%s).", files.list[i]);
 			xmlFreeDoc(doc);
-			np_test_free(tests);
 			np_test_capab_free(test_capabs);
 			np_test_var_free(vars);
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		if (perform_test(tests, test_capabs, vars, capabs, sessions, jobs, output) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+		}
+		xmlFreeDoc(doc);
+		np_test_free(tests);
+		np_test_capab_free(test_capabs);
+		np_test_var_free(vars);
+
+		/* a broken session was closed by a command */
+		session = sessions[0];
+		if (session == NULL) {
+			break;
 		}
 	}
 
-	return EXIT_SUCCESS;
+cleanup:
+	for (i = 1; sessions != NULL && i < (int)connected; ++i) {
+		if (sessions[i] != NULL) {
+			nc_session_free(sessions[i]);
+		}
+	}
+	free(sessions);
+	free(connect_arg);
+	clear_arglist(&files);
+	clear_arglist(&cmd);
+	return ret;
 }
 
 void cmd_auth_help(FILE* output) {
@@ -3298,8 +3737,14 @@ static int cmd_connect_listen(const char* arg, int is_connect, FILE* output, FIL
 			host = cmd.list[optind];
 		}
 
-		/* create the session */
+		/* create the session, the other fleet threads can execute their commands meanwhile */
+		if (test_lock != NULL) {
+			pthread_mutex_unlock(test_lock);
+		}
 		session = nc_session_connect(host, port, user, opts->cpblts);
+		if (test_lock != NULL) {
+			pthread_mutex_lock(test_lock);
+		}
 		if (session == NULL) {
 			ERROR(func_name, "connecting to the %s:%d as user \"%s\" failed.", host, port, user);
 			if (hostfree) {
@@ -3382,12 +3827,297 @@ int cmd_listen(const char* arg, const char* UNUSED(old_input_file), FILE* output
 }
 #endif
 
+void cmd_bench_help(FILE* output) {
+	fprintf(output, "bench [--help] [--sessions <num>] [--duration <secs>] [--rate <rpcs_per_sec>] [--datastore running|startup|candidate] "
+			"[--get[=<filter_file>]] [--get-config[=<filter_file>]] [--edit-config <template_file>] -- <connect arguments>\n");
+	fprintf(output, "The operations are sent in the given order, repeated, from every session. The __SESSION__ and __SEQ__\n"
+			"variables in the edit-config template are replaced by the session number and the request number.\n");
+}
+
+/* the SSH password is asked for only once for all the sessions */
+static char* sessions_password = NULL;
+
+static pthread_mutex_t sessions_password_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char* clb_sessions_password(const char* username, const char* hostname) {
+	char* prompt, *pass, *ret = NULL;
+
+	/* PASSWORD LOCK */
+	pthread_mutex_lock(&sessions_password_lock);
+	if (sessions_password == NULL) {
+		if (asprintf(&prompt, "%s@%s password: ", username, hostname) == -1) {
+			goto unlock;
+		}
+		pass = getpass(prompt);
+		free(prompt);
+		if (pass == NULL) {
+			goto unlock;
+		}
+		sessions_password = strdup(pass);
+		memset(pass, 0, strlen(pass));
+	}
+	ret = (sessions_password == NULL ? NULL : strdup(sessions_password));
+
+unlock:
+	/* PASSWORD UNLOCK */
+	pthread_mutex_unlock(&sessions_password_lock);
+	return ret;
+}
+
+static void sessions_password_clear(void) {
+	if (sessions_password != NULL) {
+		memset(sessions_password, 0, strlen(sessions_password));
+		free(sessions_password);
+		sessions_password = NULL;
+	}
+}
+
+/* open the sessions the same way connect does, keeping the current one, returns the number opened */
+static unsigned int open_sessions(const char* connect_arg, struct nc_session** sessions, unsigned int count, FILE* output, FILE* input) {
+	struct nc_session* saved_session;
+	unsigned int connected;
+
+	saved_session = session;
+	session = NULL;
+	nc_callback_sshauth_password(clb_sessions_password);
+	for (connected = 0; connected < count; ++connected) {
+		if (cmd_connect_listen(connect_arg, 1, output, input) != EXIT_SUCCESS || session == NULL) {
+			break;
+		}
+		sessions[connected] = session;
+		session = NULL;
+	}
+	nc_callback_sshauth_password(NULL);
+	session = saved_session;
+	sessions_password_clear();
+
+	return connected;
+}
+
+/* read the edit-config template without the <config> root */
+static char* bench_read_template(const char* path) {
+	xmlDocPtr doc;
+	xmlNodePtr root;
+	char* config = NULL;
+
+	doc = xmlReadFile(path, NULL, XML_PARSE_NOBLANKS|XML_PARSE_NSCLEAN|XML_PARSE_NOERROR|XML_PARSE_NOWARNING);
+	if (doc == NULL) {
+		ERROR("bench", "failed to parse the edit-config template \"%s\".", path);
+		return NULL;
+	}
+
+	root = xmlDocGetRootElement(doc);
+	if (root != NULL && xmlStrEqual(root->name, BAD_CAST "config") && root->ns != NULL
+			&& xmlStrEqual(root->ns->href, BAD_CAST "urn:ietf:params:xml:ns:netconf:base:1.0")) {
+		xmlDocSetRootElement(doc, root->children);
+		xmlUnlinkNode(root);
+		xmlFree(root);
+	}
+
+	xmlDocDumpMemory(doc, (xmlChar**)&config, NULL);
+	xmlFreeDoc(doc);
+	return config;
+}
+
+int cmd_bench(const char* arg, const char* UNUSED(old_input_file), FILE* output, FILE* input) {
+	int c, i;
+	unsigned int session_count = 1, duration = 10, rate = 0, connected = 0;
+	NC_DATASTORE datastore = NC_DATASTORE_RUNNING;
+	struct np_bench_op* ops = NULL, **last_op = &ops, *op;
+	struct nc_session** sessions = NULL;
+	char* connect_arg = NULL, *aux;
+	int ret = EXIT_FAILURE;
+	struct arglist cmd;
+	struct option long_options[] = {
+			{"help", 0, 0, 'h'},
+			{"sessions", 1, 0, 'n'},
+			{"duration", 1, 0, 'd'},
+			{"rate", 1, 0, 'r'},
+			{"datastore", 1, 0, 's'},
+			{"get", 2, 0, 'g'},
+			{"get-config", 2, 0, 'c'},
+			{"edit-config", 1, 0, 'e'},
+			{0, 0, 0, 0}
+	};
+	int option_index = 0;
+
+	/* set back to start to be able to use getopt() repeatedly */
+	optind = 0;
+
+	init_arglist(&cmd);
+	addargs(&cmd, "%s", arg);
+
+	while ((c = getopt_long(cmd.count, cmd.list, "hn:d:r:s:g::c::e:", long_options, &option_index)) != -1) {
+		switch (c) {
+		case 'h':
+			cmd_bench_help(output);
+			np_bench_op_free(ops);
+			clear_arglist(&cmd);
+			return EXIT_SUCCESS;
+		case 'n':
+			session_count = (unsigned int)atoi(optarg);
+			break;
+		case 'd':
+			duration = (unsigned int)atoi(optarg);
+			break;
+		case 'r':
+			rate = (unsigned int)atoi(optarg);
+			break;
+		case 's':
+			if (strcmp(optarg, "running") == 0) {
+				datastore = NC_DATASTORE_RUNNING;
+			} else if (strcmp(optarg, "startup") == 0) {
+				datastore = NC_DATASTORE_STARTUP;
+			} else if (strcmp(optarg, "candidate") == 0) {
+				datastore = NC_DATASTORE_CANDIDATE;
+			} else {
+				ERROR("bench", "invalid datastore %s.", optarg);
+				goto cleanup;
+			}
+			break;
+		case 'g':
+		case 'c':
+		case 'e':
+			if ((op = calloc(1, sizeof(struct np_bench_op))) == NULL) {
+				ERROR("bench", "memory allocation error (%s).", strerror(errno));
+				goto cleanup;
+			}
+			*last_op = op;
+			last_op = &op->next;
+
+			op->type = (c == 'g' ? BENCH_GET : (c == 'c' ? BENCH_GETCONFIG : BENCH_EDITCONFIG));
+			if (c == 'e') {
+				if ((op->config = bench_read_template(optarg)) == NULL) {
+					goto cleanup;
+				}
+			} else if (optarg != NULL && (op->filter = set_filter("bench", optarg, 0, output)) == NULL) {
+				goto cleanup;
+			}
+			break;
+		default:
+			ERROR("bench", "unknown option -%c.", c);
+			cmd_bench_help(output);
+			goto cleanup;
+		}
+	}
+
+	if (ops == NULL || session_count == 0 || duration == 0) {
+		ERROR("bench", "missing operations, sessions or duration, see \'bench --help\'.");
+		goto cleanup;
+	}
+	for (op = ops; op != NULL; op = op->next) {
+		op->datastore = datastore;
+	}
+
+	/* the rest is for connect */
+	if (asprintf(&connect_arg, "connect") == -1) {
+		connect_arg = NULL;
+		goto cleanup;
+	}
+	for (i = optind; i < cmd.count; ++i) {
+		aux = connect_arg;
+		if (asprintf(&connect_arg, "%s %s", aux, cmd.list[i]) == -1) {
+			connect_arg = aux;
+			goto cleanup;
+		}
+		free(aux);
+	}
+
+	if ((sessions = calloc(session_count, sizeof(struct nc_session*))) == NULL) {
+		ERROR("bench", "memory allocation error (%s).", strerror(errno));
+		goto cleanup;
+	}
+
+	connected = open_sessions(connect_arg, sessions, session_count, output, input);
+	if (connected < session_count) {
+		ERROR("bench", "only %u of %u sessions established.", connected, session_count);
+		goto cleanup;
+	}
+
+	ret = perform_bench(sessions, session_count, ops, duration, rate, output);
+
+cleanup:
+	for (i = 0; sessions != NULL && i < (int)connected; ++i) {
+		nc_session_free(sessions[i]);
+	}
+	free(sessions);
+	free(connect_arg);
+	np_bench_op_free(ops);
+	clear_arglist(&cmd);
+	return ret;
+}
+
+void cmd_fleet_help(FILE* output) {
+	fprintf(output, "fleet [--help] open [--jobs <num>] <inventory> | exec [--jobs <num>] <command> [<arguments>] | status | close\n");
+	fprintf(output, "Every <inventory> line is \"<name> [<connect arguments>]\", the name is the host without the arguments.\n"
+			"The command is executed on all the devices, __DEVICE__ in it replaced by the device name, at most\n"
+			"<num> (%d) at once, the devices with a broken session are reconnected first.\n", FLEET_JOBS);
+}
+
+int cmd_fleet(const char* arg, const char* UNUSED(old_input_file), FILE* output, FILE* UNUSED(input)) {
+	char* args = strdupa(arg), *ptr = NULL, *op, *param, *fleet_cmd;
+	unsigned int jobs = FLEET_JOBS;
+	int ret;
+
+	strtok_r(args, " ", &ptr);
+	op = strtok_r(NULL, " ", &ptr);
+	if (op == NULL || strcmp(op, "--help") == 0 || strcmp(op, "-h") == 0) {
+		cmd_fleet_help(output);
+		return (op == NULL) ? EXIT_FAILURE : EXIT_SUCCESS;
+	} else if (strcmp(op, "status") == 0) {
+		np_fleet_status(output);
+		return EXIT_SUCCESS;
+	} else if (strcmp(op, "close") == 0) {
+		np_fleet_close();
+		return EXIT_SUCCESS;
+	} else if (strcmp(op, "open") != 0 && strcmp(op, "exec") != 0) {
+		ERROR("fleet", "unknown operation \"%s\", see \'fleet --help\'.", op);
+		return EXIT_FAILURE;
+	}
+
+	param = strtok_r(NULL, " ", &ptr);
+	if (param != NULL && strcmp(param, "--jobs") == 0) {
+		param = strtok_r(NULL, " ", &ptr);
+		if (param == NULL || (jobs = (unsigned int)atoi(param)) == 0) {
+			ERROR("fleet", "invalid number of jobs.");
+			return EXIT_FAILURE;
+		}
+		param = strtok_r(NULL, " ", &ptr);
+	}
+	if (param == NULL) {
+		cmd_fleet_help(output);
+		return EXIT_FAILURE;
+	}
+
+	nc_callback_sshauth_password(clb_sessions_password);
+	if (strcmp(op, "open") == 0) {
+		ret = np_fleet_open(param, jobs, output);
+	} else {
+		/* the rest of the line is the command */
+		if (asprintf(&fleet_cmd, "%s%s%s", param, (ptr != NULL && ptr[0] != '\0') ? " " : "", (ptr != NULL) ? ptr : "") == -1) {
+			ERROR("fleet", "memory allocation error (%s).", strerror(errno));
+			ret = EXIT_FAILURE;
+		} else {
+			ret = np_fleet_exec(fleet_cmd, jobs, output);
+			free(fleet_cmd);
+		}
+	}
+	nc_callback_sshauth_password(NULL);
+	sessions_password_clear();
+
+	return ret;
+}
+
 int cmd_disconnect(const char* UNUSED(arg), const char* UNUSED(old_input_file), FILE* output, FILE* UNUSED(input)) {
 	if (session == NULL) {
 		ERROR("disconnect", "not connected to any NETCONF server.");
 	} else {
-		nc_session_free(session);
-		session = NULL;
+		/* the replies of the batch RPCs are still processed, it may close a broken session */
+		batch_flush(output);
+		if (session != NULL) {
+			nc_session_free(session);
+			session = NULL;
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -3398,6 +4128,7 @@ int cmd_quit(const char* UNUSED(arg), const char* UNUSED(old_input_file), FILE*
 	if (session != NULL) {
 		cmd_disconnect(NULL, NULL, output, input);
 	}
+	np_fleet_close();
 	return EXIT_SUCCESS;
 }
 
@@ -3476,6 +4207,7 @@ generic_help:
 struct ntf_thread_config {
 	struct nc_session *session;
 	FILE* output;
+	struct np_recorder* recorder;
 };
 
 #ifndef DISABLE_NOTIFICATIONS
@@ -3498,6 +4230,13 @@ static void notification_fileprint(time_t eventtime, const char* content) {
 void* notification_thread(void* arg) {
 	struct ntf_thread_config *config = (struct ntf_thread_config*)arg;
 
+	if (config->recorder != NULL) {
+		np_recorder_dispatch(config->recorder, config->session);
+		np_recorder_close(config->recorder, config->output);
+		free(config);
+		return NULL;
+	}
+
 	pthread_setspecific(ntf_file, (void*)config->output);
 	ncntf_dispatch_receive(config->session, notification_fileprint);
 	if (config->output != stdout) {
@@ -3709,20 +4448,22 @@ int cmd_knownhosts(const char* arg, const char* UNUSED(old_input_file), FILE* ou
 }
 
 void cmd_subscribe_help(FILE* output) {
-	fprintf(output, "subscribe [--help] [--filter [file]] [--begin <time>] [--end <time>] [--output <file>] [<stream>]\n");
+	fprintf(output, "subscribe [--help] [--filter [file]] [--begin <time>] [--end <time>] [--output <file> | --record <file>] [<stream>]\n");
 	fprintf(output, "\t<time> has following format:\n");
 	fprintf(output, "\t\t+<num>  - current time plus the given number of seconds.\n");
 	fprintf(output, "\t\t<num>   - absolute time as number of seconds since 1970-01-01.\n");
 	fprintf(output, "\t\t-<num>  - current time minus the given number of seconds.\n");
+	fprintf(output, "\t--record appends the notifications to <file> as JSON lines indexed in <file>.idx.\n");
 }
 
 int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FILE* UNUSED(input)) {
 	int c;
 	struct nc_filter *filter = NULL;
-	char *stream;
+	char *stream, *record = NULL;
 	time_t t, start = -1, stop = -1;
 	nc_rpc *rpc = NULL;
 	FILE *out = NULL;
+	struct np_recorder* recorder = NULL;
 	struct arglist cmd;
 	struct option long_options[] ={
 			{"filter", 2, 0, 'f'},
@@ -3730,6 +4471,7 @@ int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FIL
 			{"begin", 1, 0, 'b'},
 			{"end", 1, 0, 'e'},
 			{"out", 1, 0, 'o'},
+			{"record", 1, 0, 'r'},
 			{0, 0, 0, 0}
 	};
 	int option_index = 0;
@@ -3742,7 +4484,7 @@ int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FIL
 	init_arglist(&cmd);
 	addargs(&cmd, "%s", arg);
 
-	while ((c = getopt_long(cmd.count, cmd.list, "bef::ho:", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(cmd.count, cmd.list, "bef::ho:r:", long_options, &option_index)) != -1) {
 		switch (c) {
 		case 'b':
 		case 'e':
@@ -3805,6 +4547,9 @@ int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FIL
 				return EXIT_FAILURE;
 			}
 			break;
+		case 'r':
+			record = optarg;
+			break;
 		default:
 			ERROR("create-subscription", "unknown option -%c.", c);
 			cmd_subscribe_help(output);
@@ -3859,6 +4604,18 @@ int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FIL
 		stream = NULL;
 	}
 
+	if (record != NULL) {
+		if (out) {
+			ERROR("subscribe", "The --out and --record options are mutually exclusive.");
+			fclose(out);
+			clear_arglist(&cmd);
+			return EXIT_FAILURE;
+		}
+		if ((recorder = np_recorder_open(record)) == NULL) {
+			clear_arglist(&cmd);
+			return EXIT_FAILURE;
+		}
+	}
 
 	/* create requests */
 	rpc = nc_rpc_subscribe(stream, filter, (start == -1)?NULL:&start, (stop == -1)?NULL:&stop);
@@ -3869,13 +4626,19 @@ int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FIL
 		if (out) {
 			fclose(out);
 		}
+		if (recorder) {
+			np_recorder_close(recorder, NULL);
+		}
 		return EXIT_FAILURE;
 	}
 
-	if (send_recv_process("subscribe", rpc, NULL, output) != 0) {
+	if (send_recv_process("subscribe", rpc, NULL, 0, output) != 0) {
 		if (out) {
 			fclose(out);
 		}
+		if (recorder) {
+			np_recorder_close(recorder, NULL);
+		}
 		return EXIT_FAILURE;
 	}
 	rpc = NULL; /* just note that rpc is already freed by send_recv_process() */
@@ -3892,11 +4655,16 @@ int cmd_subscribe(const char* arg, const char* old_input_file, FILE* output, FIL
 	tconfig = malloc(sizeof(struct ntf_thread_config));
 	tconfig->session = session;
 	tconfig->output = (out == NULL) ? output : out;
+	tconfig->recorder = recorder;
 	if (pthread_create(&thread, NULL, notification_thread, tconfig) != 0) {
 		ERROR("create-subscription", "creating a thread for receiving notifications failed");
 		if (out) {
 			fclose(out);
 		}
+		if (recorder) {
+			np_recorder_close(recorder, NULL);
+		}
+		free(tconfig);
 		return EXIT_FAILURE;
 	}
 	pthread_detach(thread);
@@ -4035,7 +4803,7 @@ int cmd_userrpc(const char* arg, const char* old_input_file, FILE* output, FILE*
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process("user-rpc", rpc, NULL, output);
+	return send_recv_process("user-rpc", rpc, NULL, 0, output);
 }
 
 void cmd_discardchanges_help(FILE* output) {
@@ -4096,6 +4864,6 @@ int cmd_generic_op(GENERIC_OPS op, const char* arg, FILE* output) {
 	}
 
 	/* send the request and get the reply */
-	return send_recv_process(op_string, rpc, NULL, output);
+	return send_recv_process(op_string, rpc, NULL, 0, output);
 }
 
@@ -30,6 +30,8 @@ int cmd_unlock(const char *arg, const char* old_input_file, FILE* output, FILE*
 int cmd_validate(const char *arg, const char* old_input_file, FILE* output, FILE* input);
 int cmd_status(const char* arg, const char* old_input_file, FILE* output, FILE* input);
 int cmd_test(const char* arg, const char* old_input_file, FILE* output, FILE* input);
+int cmd_bench(const char* arg, const char* old_input_file, FILE* output, FILE* input);
+int cmd_fleet(const char* arg, const char* old_input_file, FILE* output, FILE* input);
 int cmd_auth(const char* arg, const char* old_input_file, FILE* output, FILE* input);
 #ifdef ENABLE_TLS
 int cmd_cert(const char* arg, const char* old_input_file, FILE* output, FILE* input);
@@ -54,4 +56,25 @@ typedef struct
 	char *helpstring; /* Documentation for this function.  */
 } COMMAND;
 
+/* the result of a command in the batch mode, see main.c */
+struct batch_result {
+	unsigned int line;
+	char* cmd;
+	int rpc;	/* an RPC was sent, the status is set by its reply */
+	int status;	/* EXIT_SUCCESS or EXIT_FAILURE, BATCH_PENDING until the reply is received */
+	char* errmsg;
+	struct batch_result* next;
+};
+
+#define BATCH_PENDING -1
+
+/* maximum number of RPCs sent without waiting for their replies, 0 outside the batch mode */
+extern unsigned int batch_window;
+
+/* the result of the command being executed, NULL if not tracked */
+extern struct batch_result* batch_current;
+
+/* wait for the replies of all the RPCs sent in the batch mode */
+void batch_flush(FILE* output);
+
 #endif /* COMMANDS_H_ */
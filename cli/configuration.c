@@ -42,6 +42,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -72,6 +73,7 @@ extern int done;
 /* all these appended to NCC_DIR */
 #define CA_DIR "certs"
 #define CRL_DIR "crl"
+#define SCHEMA_DIR "schemas"
 #define CERT_CRT "client.crt"
 #define CERT_PEM "client.pem"
 #define CERT_KEY "client.key"
@@ -251,6 +253,39 @@ char* get_default_CRL_dir(DIR** ret_dir) {
 	return crl_dir;
 }
 
+char* get_schema_cache_path(const char* identifier, const char* version, const char* format) {
+	char* netconf_dir, *schema_dir, *path;
+
+	if (strchr(identifier, '/') != NULL || strchr(version, '/') != NULL || strchr(format, '/') != NULL) {
+		return NULL;
+	}
+
+	if ((netconf_dir = get_netconf_dir()) == NULL) {
+		return NULL;
+	}
+
+	if (asprintf(&schema_dir, "%s/%s", netconf_dir, SCHEMA_DIR) == -1) {
+		ERROR("get_schema_cache_path", "asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(netconf_dir);
+		return NULL;
+	}
+	free(netconf_dir);
+
+	if (mkdir(schema_dir, 0700) != 0 && errno != EEXIST) {
+		ERROR("get_schema_cache_path", "Schema cache directory \"%s\" cannot be created: %s", schema_dir, strerror(errno));
+		free(schema_dir);
+		return NULL;
+	}
+
+	if (asprintf(&path, "%s/%s@%s.%s", schema_dir, identifier, version, format) == -1) {
+		ERROR("get_schema_cache_path", "asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		path = NULL;
+	}
+	free(schema_dir);
+
+	return path;
+}
+
 void load_config(void) {
 	char* netconf_dir, *history_file, *config_file;
 #ifdef ENABLE_TLS
@@ -85,6 +85,15 @@ char* get_default_trustedCA_dir(DIR** ret_dir);
  */
 char* get_default_CRL_dir(DIR** ret_dir);
 
+/**
+ * @brief Finds the cached schema file, creating the cache directory if
+ * missing, the file itself may not exist
+ * @return NULL on failure or if any of the parameters contains '/',
+ * dynamically allocated "<schema dir>/<identifier>@<version>.<format>"
+ * path otherwise
+ */
+char* get_schema_cache_path(const char* identifier, const char* version, const char* format);
+
 /**
  * @brief Checks all the relevant files and directories creating any
  * that are missing, sets the saved configuration
@@ -0,0 +1,486 @@
+/*
+ * fleet.c
+ * Author agent <agent@local>
+ *
+ * Implementation of executing commands on many NETCONF servers concurrently.
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <libnetconf.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fleet.h"
+#include "test.h"
+#include "commands.h"
+
+extern COMMAND commands[];
+extern __thread struct nc_session* session;
+extern void clb_error_print(const char* tag,
+		const char* type,
+		const char* severity,
+		const char* apptag,
+		const char* path,
+		const char* message,
+		const char* attribute,
+		const char* element,
+		const char* ns,
+		const char* sid);
+
+struct fleet_device {
+	char* name;
+	char* connect_arg;			/* the connect command */
+	struct nc_session* session;
+	unsigned int connects;
+
+	/* the last command */
+	int ret;
+	double time;
+	char* output;
+	size_t output_len;
+	char* errmsg;
+};
+
+static struct {
+	struct fleet_device* devices;
+	unsigned int count;
+} fleet = {NULL, 0};
+
+/* the devices a command is being executed on */
+struct fleet_run {
+	pthread_mutex_t lock;		/* for next */
+	unsigned int next;
+	const char* cmd;			/* NULL to only connect */
+};
+
+/* the first rpc-error of the command the thread executes */
+static __thread char* fleet_error;
+
+static void clb_fleet_error(const char* tag,
+		const char* UNUSED(type),
+		const char* UNUSED(severity),
+		const char* UNUSED(apptag),
+		const char* UNUSED(path),
+		const char* message,
+		const char* UNUSED(attribute),
+		const char* UNUSED(element),
+		const char* UNUSED(ns),
+		const char* UNUSED(sid)) {
+
+	if (fleet_error == NULL) {
+		if (asprintf(&fleet_error, "%s (%s)", tag, (message != NULL) ? message : "no message") == -1) {
+			fleet_error = NULL;
+		}
+	}
+}
+
+static COMMAND* fleet_find_cmd(const char* cmd) {
+	int i;
+	size_t len;
+
+	for (i = 0; commands[i].name != NULL; ++i) {
+		len = strlen(commands[i].name);
+		if (strncmp(cmd, commands[i].name, len) == 0 && (cmd[len] == ' ' || cmd[len] == '\0')) {
+			return &commands[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* cmd with every __DEVICE__ replaced by the name */
+static char* fleet_cmd_subst(const char* cmd, const char* name) {
+	const char* var;
+	char* ret, *aux;
+
+	if ((ret = strdup("")) == NULL) {
+		return NULL;
+	}
+	while ((var = strstr(cmd, "__DEVICE__")) != NULL) {
+		aux = ret;
+		if (asprintf(&ret, "%s%.*s%s", aux, (int)(var - cmd), cmd, name) == -1) {
+			ret = NULL;
+		}
+		free(aux);
+		if (ret == NULL) {
+			return NULL;
+		}
+		cmd = var + strlen("__DEVICE__");
+	}
+	aux = ret;
+	if (asprintf(&ret, "%s%s", aux, cmd) == -1) {
+		ret = NULL;
+	}
+	free(aux);
+
+	return ret;
+}
+
+static double fleet_elapsed(struct timespec start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void fleet_device_exec(struct fleet_device* dev, const char* cmd_template, FILE* input) {
+	struct timespec start;
+	COMMAND* command;
+	FILE* out;
+	char* cmd;
+
+	free(dev->output);
+	dev->output = NULL;
+	free(dev->errmsg);
+	dev->errmsg = NULL;
+	dev->ret = EXIT_FAILURE;
+	free(fleet_error);
+	fleet_error = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if ((out = open_memstream(&dev->output, &dev->output_len)) == NULL) {
+		dev->errmsg = strdup(strerror(errno));
+		return;
+	}
+
+	/* COMMAND LOCK */
+	pthread_mutex_lock(test_lock);
+	session = dev->session;
+	if (session != NULL && nc_session_get_status(session) != NC_SESSION_STATUS_WORKING) {
+		nc_session_free(session);
+		session = NULL;
+	}
+	if (session == NULL) {
+		/* connect does not hold the lock while establishing the session */
+		++dev->connects;
+		if (fleet_find_cmd("connect")->func(dev->connect_arg, NULL, out, input) != EXIT_SUCCESS || session == NULL) {
+			dev->errmsg = strdup("connecting failed");
+			goto finish;
+		}
+	}
+
+	if (cmd_template == NULL) {
+		dev->ret = EXIT_SUCCESS;
+		goto finish;
+	}
+	if ((cmd = fleet_cmd_subst(cmd_template, dev->name)) == NULL) {
+		dev->errmsg = strdup("memory allocation failed");
+		goto finish;
+	}
+	command = fleet_find_cmd(cmd);
+	dev->ret = command->func(cmd, NULL, out, input);
+	free(cmd);
+
+	if (fleet_error != NULL) {
+		/* the command may succeed even with an rpc-error reply */
+		dev->ret = EXIT_FAILURE;
+		dev->errmsg = fleet_error;
+		fleet_error = NULL;
+	} else if (dev->ret != EXIT_SUCCESS) {
+		dev->errmsg = strdup((session == NULL) ? "session broken" : "command failed");
+	}
+
+finish:
+	/* a command could have closed a broken session, it is reconnected next time */
+	dev->session = session;
+	session = NULL;
+	/* COMMAND UNLOCK */
+	pthread_mutex_unlock(test_lock);
+
+	fclose(out);
+	dev->time = fleet_elapsed(start);
+}
+
+static void* fleet_thread(void* arg) {
+	struct fleet_run* run = (struct fleet_run*)arg;
+	cookie_io_functions_t input_funcs = {.read = NULL, .write = NULL, .seek = NULL, .close = NULL};
+	FILE* input;
+	unsigned int idx;
+
+	/* no interactive input on the devices, reading it gets EOF */
+	input = fopencookie(NULL, "r", input_funcs);
+
+	while (1) {
+		/* RUN LOCK */
+		pthread_mutex_lock(&run->lock);
+		idx = run->next++;
+		/* RUN UNLOCK */
+		pthread_mutex_unlock(&run->lock);
+		if (idx >= fleet.count) {
+			break;
+		}
+
+		fleet_device_exec(&fleet.devices[idx], run->cmd, (input != NULL) ? input : stdin);
+	}
+
+	if (input != NULL) {
+		fclose(input);
+	}
+	return NULL;
+}
+
+/* run the command on all the devices from at most jobs threads */
+static void fleet_run(const char* cmd, unsigned int jobs) {
+	static pthread_mutex_t cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+	struct fleet_run run;
+	pthread_t* threads;
+	unsigned int i, started;
+
+	if (jobs > fleet.count) {
+		jobs = fleet.count;
+	}
+	if ((threads = calloc(jobs, sizeof *threads)) == NULL) {
+		ERROR("fleet", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return;
+	}
+
+	pthread_mutex_init(&run.lock, NULL);
+	run.next = 0;
+	run.cmd = cmd;
+
+	nc_callback_error_reply(clb_fleet_error);
+	test_lock = &cmd_lock;
+
+	for (started = 0; started < jobs; ++started) {
+		if ((errno = pthread_create(&threads[started], NULL, fleet_thread, &run)) != 0) {
+			ERROR("fleet", "Creating a thread failed (%s).", strerror(errno));
+			break;
+		}
+	}
+	if (started == 0) {
+		/* at least in this thread */
+		fleet_thread(&run);
+	}
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	test_lock = NULL;
+	nc_callback_error_reply(clb_error_print);
+
+	pthread_mutex_destroy(&run.lock);
+	free(threads);
+}
+
+static int fleet_print_results(FILE* output, int print_output, double total) {
+	struct fleet_device* dev;
+	unsigned int i, failed = 0;
+
+	if (print_output) {
+		for (i = 0; i < fleet.count; ++i) {
+			dev = &fleet.devices[i];
+			if (dev->output != NULL && dev->output_len > 0) {
+				fprintf(output, "--- %s ---\n%s", dev->name, dev->output);
+				if (dev->output[dev->output_len - 1] != '\n') {
+					fprintf(output, "\n");
+				}
+			}
+		}
+	}
+
+	fprintf(output, "Fleet results:\n");
+	for (i = 0; i < fleet.count; ++i) {
+		dev = &fleet.devices[i];
+		fprintf(output, " %10.6fs %-4s %s", dev->time, (dev->ret == EXIT_SUCCESS) ? "OK" : "FAIL", dev->name);
+		if (dev->errmsg != NULL) {
+			fprintf(output, ": %s", dev->errmsg);
+		}
+		fprintf(output, "\n");
+		if (dev->ret != EXIT_SUCCESS) {
+			++failed;
+		}
+	}
+	fprintf(output, "%u devices, %u failed, %.6fs total.\n", fleet.count, failed, total);
+
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void fleet_device_clean(struct fleet_device* dev) {
+	if (dev->session != NULL) {
+		nc_session_free(dev->session);
+	}
+	free(dev->name);
+	free(dev->connect_arg);
+	free(dev->output);
+	free(dev->errmsg);
+}
+
+void np_fleet_close(void) {
+	unsigned int i;
+
+	for (i = 0; i < fleet.count; ++i) {
+		fleet_device_clean(&fleet.devices[i]);
+	}
+	free(fleet.devices);
+	fleet.devices = NULL;
+	fleet.count = 0;
+}
+
+static int fleet_read_inventory(const char* inventory, struct fleet_device** devices, unsigned int* count) {
+	FILE* file;
+	char* line = NULL, *name, *args, *ptr;
+	size_t line_len = 0;
+	unsigned int line_no = 0, size = 0;
+	struct fleet_device* aux;
+
+	if ((file = fopen(inventory, "r")) == NULL) {
+		ERROR("fleet", "Unable to open the inventory \"%s\" (%s).", inventory, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	*devices = NULL;
+	*count = 0;
+	while (getline(&line, &line_len, file) != -1) {
+		++line_no;
+		if ((ptr = strchr(line, '\n')) != NULL) {
+			*ptr = '\0';
+		}
+		name = line + strspn(line, " \t");
+		if (name[0] == '\0' || name[0] == '#') {
+			continue;
+		}
+		args = name + strcspn(name, " \t");
+		if (args[0] != '\0') {
+			*(args++) = '\0';
+			args += strspn(args, " \t");
+		}
+
+		if (*count == size) {
+			size = (size == 0) ? 16 : size * 2;
+			if ((aux = realloc(*devices, size * sizeof **devices)) == NULL) {
+				ERROR("fleet", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				goto error;
+			}
+			*devices = aux;
+		}
+		memset(&(*devices)[*count], 0, sizeof **devices);
+		(*devices)[*count].name = strdup(name);
+		if (asprintf(&(*devices)[*count].connect_arg, "connect %s", (args[0] != '\0') ? args : name) == -1) {
+			(*devices)[*count].connect_arg = NULL;
+		}
+		++(*count);
+		if ((*devices)[*count - 1].name == NULL || (*devices)[*count - 1].connect_arg == NULL) {
+			ERROR("fleet", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			goto error;
+		}
+	}
+	free(line);
+	fclose(file);
+
+	if (*count == 0) {
+		ERROR("fleet", "No devices in the inventory \"%s\".", inventory);
+		free(*devices);
+		*devices = NULL;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+
+error:
+	while (*count > 0) {
+		fleet_device_clean(&(*devices)[--(*count)]);
+	}
+	free(*devices);
+	*devices = NULL;
+	free(line);
+	fclose(file);
+	return EXIT_FAILURE;
+}
+
+int np_fleet_open(const char* inventory, unsigned int jobs, FILE* output) {
+	struct fleet_device* devices;
+	struct timespec start;
+	unsigned int count;
+
+	if (fleet_read_inventory(inventory, &devices, &count) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	np_fleet_close();
+	fleet.devices = devices;
+	fleet.count = count;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fleet_run(NULL, jobs);
+	return fleet_print_results(output, 0, fleet_elapsed(start));
+}
+
+int np_fleet_exec(const char* cmd, unsigned int jobs, FILE* output) {
+	struct timespec start;
+	COMMAND* command;
+
+	if (fleet.count == 0) {
+		ERROR("fleet", "No fleet, use \'fleet open\' first.");
+		return EXIT_FAILURE;
+	}
+
+	command = fleet_find_cmd(cmd);
+	if (command == NULL) {
+		ERROR("fleet", "%s: no such command.", cmd);
+		return EXIT_FAILURE;
+	}
+	/* the commands managing the sessions or running their own threads */
+	if (!strcmp(command->name, "connect") || !strcmp(command->name, "listen") || !strcmp(command->name, "disconnect")
+			|| !strcmp(command->name, "subscribe") || !strcmp(command->name, "test") || !strcmp(command->name, "bench")
+			|| !strcmp(command->name, "fleet") || !strcmp(command->name, "quit") || !strcmp(command->name, "exit")) {
+		ERROR("fleet", "\'%s\' cannot be executed on the fleet.", command->name);
+		return EXIT_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fleet_run(cmd, jobs);
+	return fleet_print_results(output, 1, fleet_elapsed(start));
+}
+
+void np_fleet_status(FILE* output) {
+	struct fleet_device* dev;
+	unsigned int i, working = 0;
+	int ok;
+
+	for (i = 0; i < fleet.count; ++i) {
+		dev = &fleet.devices[i];
+		ok = (dev->session != NULL && nc_session_get_status(dev->session) == NC_SESSION_STATUS_WORKING);
+		fprintf(output, " %-12s %s (%u connects)\n", ok ? "connected" : "disconnected", dev->name, dev->connects);
+		if (ok) {
+			++working;
+		}
+	}
+	fprintf(output, "%u devices, %u connected.\n", fleet.count, working);
+}
@@ -0,0 +1,28 @@
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <stdio.h>
+
+/* default number of the devices connected to and executing a command at once */
+#define FLEET_JOBS 16
+
+/*
+ * Read the inventory and connect to all its devices, replacing the previous fleet.
+ * Every line is "<name> [<connect arguments>]", the name is also the host without
+ * the arguments, empty lines and lines starting with '#' are skipped.
+ */
+int np_fleet_open(const char* inventory, unsigned int jobs, FILE* output);
+
+/*
+ * Execute the command on every device of the fleet, with __DEVICE__ replaced by the
+ * device name, reconnecting the devices with a broken session first, and print the
+ * output of every device and the results in the inventory order.
+ */
+int np_fleet_exec(const char* cmd, unsigned int jobs, FILE* output);
+
+void np_fleet_status(FILE* output);
+
+/* disconnect and forget all the devices */
+void np_fleet_close(void);
+
+#endif /* _FLEET_H_ */
@@ -40,6 +40,9 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
 #include <signal.h>
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -55,10 +58,14 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
 #define PROMPT "netconf> "
 
+/* number of RPCs outstanding in the batch mode by default */
+#define BATCH_WINDOW 1
+
 volatile int done;
 extern int multiline;
 extern char* last_tmpfile;
 extern COMMAND commands[];
+extern __thread struct nc_session* session;
 
 void clb_print(NC_VERB_LEVEL level, const char* msg) {
 	switch (level) {
@@ -128,12 +135,167 @@ void signal_handler(int sig) {
 	}
 }
 
-int main(int UNUSED(argc), char** UNUSED(argv)) {
+static void print_usage(const char* progname) {
+	fprintf(stdout, "Usage: %s [-h] [-b <file|->] [-w <num>]\n", progname);
+	fprintf(stdout, " -h,--help            Show this help\n");
+	fprintf(stdout, " -b,--batch <file|->  Execute the commands from the file or stdin, one per line,\n");
+	fprintf(stdout, "                      and print the result of every one at the end\n");
+	fprintf(stdout, " -w,--window <num>    Send up to num RPCs in the batch mode before waiting for\n");
+	fprintf(stdout, "                      their replies (default %d)\n", BATCH_WINDOW);
+}
+
+/* execute the commands of the file, the replies of their RPCs are matched by message-id */
+static int batch_run(const char* path) {
+	FILE* file;
+	struct batch_result* results = NULL, **last = &results, *result;
+	char* line = NULL, *cmd, *cmdstart;
+	size_t line_size = 0, len;
+	unsigned int line_no = 0, window, count = 0, failed = 0;
+	int i, j, ret;
+
+	if (strcmp(path, "-") == 0) {
+		file = stdin;
+	} else if ((file = fopen(path, "r")) == NULL) {
+		ERROR("batch", "Unable to open \"%s\" (%s).", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* the rpc-errors are processed with the replies to know their RPC */
+	nc_callback_error_reply(NULL);
+
+	while (!done && getline(&line, &line_size, file) != -1) {
+		++line_no;
+		for (len = strlen(line); len > 0 && (line[len - 1] == '\n' || whitespace(line[len - 1])); --len) {
+			line[len - 1] = '\0';
+		}
+
+		/* Isolate the command word, skip empty lines and comments. */
+		for (i = 0; line[i] && whitespace (line[i]); i++);
+		cmdstart = line + i;
+		if (*cmdstart == '\0' || *cmdstart == '#') {
+			continue;
+		}
+		for (j = 0; cmdstart[j] && !whitespace (cmdstart[j]); j++);
+		cmd = strndup(cmdstart, j);
+
+		for (i = 0; commands[i].name; i++) {
+			if (strcmp(cmd, commands[i].name) == 0) {
+				break;
+			}
+		}
+
+		result = calloc(1, sizeof *result);
+		if (result == NULL) {
+			ERROR("batch", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			free(cmd);
+			break;
+		}
+		result->line = line_no;
+		result->cmd = strdup(cmdstart);
+		*last = result;
+		last = &result->next;
+
+		if (commands[i].name == NULL) {
+			ERROR("batch", "%s: no such command (line %u).", cmd, line_no);
+			result->status = EXIT_FAILURE;
+			result->errmsg = strdup("no such command");
+		} else if (strcmp(cmd, "test") == 0 || strcmp(cmd, "bench") == 0 || strcmp(cmd, "fleet") == 0) {
+			/* they wait for their own replies and count the rpc-errors by the callback */
+			batch_flush(stdout);
+			window = batch_window;
+			batch_window = 0;
+			nc_callback_error_reply(clb_error_print);
+			result->status = commands[i].func((const char*)cmdstart, NULL, stdout, stdin);
+			nc_callback_error_reply(NULL);
+			batch_window = window;
+		} else {
+			batch_current = result;
+			ret = commands[i].func((const char*)cmdstart, NULL, stdout, stdin);
+			batch_current = NULL;
+			if (!result->rpc) {
+				result->status = ret;
+			}
+		}
+
+		free(last_tmpfile);
+		last_tmpfile = NULL;
+		free(cmd);
+	}
+	free(line);
+	if (file != stdin) {
+		fclose(file);
+	}
+
+	/* waits for the outstanding replies */
+	if (session != NULL) {
+		cmd_disconnect(NULL, NULL, stdout, NULL);
+	}
+
+	fprintf(stdout, "\nBatch results:\n");
+	while (results != NULL) {
+		result = results;
+		results = result->next;
+
+		++count;
+		if (result->status != EXIT_SUCCESS) {
+			++failed;
+		}
+		fprintf(stdout, "  %5u  %-6s  %s", result->line, (result->status == EXIT_SUCCESS) ? "OK" : "FAILED", result->cmd);
+		if (result->status == BATCH_PENDING) {
+			fprintf(stdout, " (no reply)");
+		} else if (result->errmsg != NULL) {
+			fprintf(stdout, " (%s)", result->errmsg);
+		}
+		fprintf(stdout, "\n");
+
+		free(result->cmd);
+		free(result->errmsg);
+		free(result);
+	}
+	fprintf(stdout, "%u commands, %u failed\n", count, failed);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
 	struct sigaction action;
 	sigset_t block_mask;
 	HIST_ENTRY* hent;
-	char* cmd, *cmdline, *cmdstart;
-	int i, j;
+	char* cmd, *cmdline, *cmdstart, *batch = NULL, *ptr;
+	int i, j, c, ret;
+	long window = BATCH_WINDOW;
+	struct option long_options[] = {
+			{"help", 0, 0, 'h'},
+			{"batch", 1, 0, 'b'},
+			{"window", 1, 0, 'w'},
+			{0, 0, 0, 0}
+	};
+	int option_index = 0;
+
+	while ((c = getopt_long(argc, argv, "hb:w:", long_options, &option_index)) != -1) {
+		switch (c) {
+		case 'h':
+			print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		case 'b':
+			batch = optarg;
+			break;
+		case 'w':
+			window = strtol(optarg, &ptr, 10);
+			if (*ptr != '\0' || window < 1) {
+				ERROR("main", "Invalid window \"%s\".", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind < argc) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
 
 	/* signal handling */
 	sigfillset(&block_mask);
@@ -155,6 +317,13 @@ int main(int UNUSED(argc), char** UNUSED(argv)) {
 
 	load_config();
 
+	if (batch != NULL) {
+		batch_window = window;
+		ret = batch_run(batch);
+		nc_close();
+		return ret;
+	}
+
 	while (!done) {
 		/* get the command from user */
 		cmdline = readline(PROMPT);
@@ -0,0 +1,403 @@
+/*
+ * output.c
+ * Author agent <agent@local>
+ *
+ * Implementation of writing the replies to large data in pieces.
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libxml/xmlreader.h>
+#include <libxml/entities.h>
+
+#ifdef ENABLE_ZLIB
+#	include <zlib.h>
+#endif
+#ifdef ENABLE_ZSTD
+#	include <zstd.h>
+#endif
+
+#include "output.h"
+#include "commands.h"
+
+#define CONFIG_START "<config xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\">\n"
+#define CONFIG_END "</config>\n"
+
+struct np_out {
+	enum {
+		OUT_PLAIN,
+		OUT_GZIP,
+		OUT_ZSTD
+	} type;
+	FILE* file;
+#ifdef ENABLE_ZLIB
+	gzFile gz;
+#endif
+#ifdef ENABLE_ZSTD
+	ZSTD_CCtx* cctx;
+	char* buf;					/* compressed data before written to file */
+	size_t buf_size;
+#endif
+};
+
+static int ends_with(const char* str, const char* suffix) {
+	size_t len = strlen(str), suffix_len = strlen(suffix);
+
+	return (len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0);
+}
+
+struct np_out* np_out_open(const char* path) {
+	struct np_out* out;
+
+	if ((out = calloc(1, sizeof *out)) == NULL) {
+		ERROR("output", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	if (ends_with(path, ".gz")) {
+#ifdef ENABLE_ZLIB
+		out->type = OUT_GZIP;
+		if ((out->gz = gzopen(path, "wb")) == NULL) {
+			ERROR("output", "Could not open the output file \"%s\" (%s).", path, strerror(errno));
+			free(out);
+			return NULL;
+		}
+		return out;
+#else
+		ERROR("output", "Unable to write \"%s\", gzip compression not supported.", path);
+		free(out);
+		return NULL;
+#endif
+	}
+
+	if (ends_with(path, ".zst")) {
+#ifdef ENABLE_ZSTD
+		out->type = OUT_ZSTD;
+		out->buf_size = ZSTD_CStreamOutSize();
+		if ((out->cctx = ZSTD_createCCtx()) == NULL || (out->buf = malloc(out->buf_size)) == NULL) {
+			ERROR("output", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			ZSTD_freeCCtx(out->cctx);
+			free(out);
+			return NULL;
+		}
+#else
+		ERROR("output", "Unable to write \"%s\", zstd compression not supported.", path);
+		free(out);
+		return NULL;
+#endif
+	}
+
+	if ((out->file = fopen(path, "w")) == NULL) {
+		ERROR("output", "Could not open the output file \"%s\" (%s).", path, strerror(errno));
+#ifdef ENABLE_ZSTD
+		ZSTD_freeCCtx(out->cctx);
+		free(out->buf);
+#endif
+		free(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+#ifdef ENABLE_ZSTD
+static int out_zstd_write(struct np_out* out, const char* data, size_t len, ZSTD_EndDirective mode) {
+	ZSTD_inBuffer in = {data, len, 0};
+	ZSTD_outBuffer buf;
+	size_t remaining;
+
+	do {
+		buf.dst = out->buf;
+		buf.size = out->buf_size;
+		buf.pos = 0;
+		remaining = ZSTD_compressStream2(out->cctx, &buf, &in, mode);
+		if (ZSTD_isError(remaining)) {
+			ERROR("output", "zstd compression failed (%s).", ZSTD_getErrorName(remaining));
+			return EXIT_FAILURE;
+		}
+		if (fwrite(out->buf, 1, buf.pos, out->file) < buf.pos) {
+			ERROR("output", "Writing the output file failed (%s).", strerror(errno));
+			return EXIT_FAILURE;
+		}
+	} while ((mode == ZSTD_e_end) ? (remaining != 0) : (in.pos < in.size));
+
+	return EXIT_SUCCESS;
+}
+#endif
+
+int np_out_write(struct np_out* out, const char* data, size_t len) {
+	size_t chunk;
+
+	for (; len > 0; data += chunk, len -= chunk) {
+		chunk = (len > OUT_CHUNK_SIZE) ? OUT_CHUNK_SIZE : len;
+
+		switch (out->type) {
+#ifdef ENABLE_ZLIB
+		case OUT_GZIP:
+			if (gzwrite(out->gz, data, chunk) <= 0) {
+				ERROR("output", "gzip compression failed.");
+				return EXIT_FAILURE;
+			}
+			break;
+#endif
+#ifdef ENABLE_ZSTD
+		case OUT_ZSTD:
+			if (out_zstd_write(out, data, chunk, ZSTD_e_continue) != EXIT_SUCCESS) {
+				return EXIT_FAILURE;
+			}
+			break;
+#endif
+		default:
+			if (fwrite(data, 1, chunk, out->file) < chunk) {
+				ERROR("output", "Writing the output file failed (%s).", strerror(errno));
+				return EXIT_FAILURE;
+			}
+			break;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int np_out_close(struct np_out* out) {
+	int ret = EXIT_SUCCESS;
+
+	switch (out->type) {
+#ifdef ENABLE_ZLIB
+	case OUT_GZIP:
+		if (gzclose(out->gz) != Z_OK) {
+			ERROR("output", "gzip compression failed.");
+			ret = EXIT_FAILURE;
+		}
+		break;
+#endif
+#ifdef ENABLE_ZSTD
+	case OUT_ZSTD:
+		ret = out_zstd_write(out, NULL, 0, ZSTD_e_end);
+		ZSTD_freeCCtx(out->cctx);
+		free(out->buf);
+		/* fallthrough */
+#endif
+	default:
+		if (fclose(out->file) != 0) {
+			ERROR("output", "Writing the output file failed (%s).", strerror(errno));
+			ret = EXIT_FAILURE;
+		}
+		break;
+	}
+	free(out);
+
+	return ret;
+}
+
+static int out_file(const char* operation, const char* path, const char* start, const char* data, const char* end) {
+	struct np_out* out;
+	int wrap, ret;
+
+	if ((out = np_out_open(path)) == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	wrap = !strcmp(operation, "get-config");
+	ret = (wrap && np_out_write(out, CONFIG_START, strlen(CONFIG_START)))
+			|| np_out_write(out, start, strlen(start))
+			|| np_out_write(out, data, strlen(data))
+			|| np_out_write(out, end, strlen(end))
+			|| (wrap && np_out_write(out, CONFIG_END, strlen(CONFIG_END)));
+
+	if (np_out_close(out) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+	}
+	return (ret ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* the reply data in a single root element for the reader, without copying them */
+struct split_input {
+	const char* parts[3];
+	size_t lens[3];
+	unsigned int part;
+	size_t pos;
+};
+
+static int split_read(void* context, char* buffer, int len) {
+	struct split_input* in = (struct split_input*)context;
+	size_t chunk;
+	int read = 0;
+
+	while (read < len && in->part < 3) {
+		chunk = in->lens[in->part] - in->pos;
+		if (chunk > (size_t)(len - read)) {
+			chunk = len - read;
+		}
+		memcpy(buffer + read, in->parts[in->part] + in->pos, chunk);
+		read += chunk;
+		in->pos += chunk;
+		if (in->pos == in->lens[in->part]) {
+			++in->part;
+			in->pos = 0;
+		}
+	}
+
+	return read;
+}
+
+/* the start tag of the current element with all its attributes and namespace declarations */
+static char* split_start_tag(xmlTextReaderPtr reader) {
+	char* tag, *aux;
+	xmlChar* value;
+
+	if (asprintf(&tag, "<%s", (char*)xmlTextReaderConstName(reader)) == -1) {
+		return NULL;
+	}
+	while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+		aux = tag;
+		value = xmlEncodeSpecialChars(NULL, xmlTextReaderConstValue(reader));
+		if (asprintf(&tag, "%s %s=\"%s\"", aux, (char*)xmlTextReaderConstName(reader), (char*)value) == -1) {
+			tag = NULL;
+		}
+		xmlFree(value);
+		free(aux);
+		if (tag == NULL) {
+			return NULL;
+		}
+	}
+	xmlTextReaderMoveToElement(reader);
+
+	aux = tag;
+	if (asprintf(&tag, "%s>", aux) == -1) {
+		tag = NULL;
+	}
+	free(aux);
+	return tag;
+}
+
+/* split_path("dir/snap.xml.gz", 3) is "dir/snap-3.xml.gz" */
+static char* split_path(const char* path, unsigned int idx) {
+	const char* base, *ext;
+	char* ret;
+
+	base = strrchr(path, '/');
+	base = (base == NULL) ? path : base + 1;
+	if ((ext = strchr(base, '.')) == NULL) {
+		ext = base + strlen(base);
+	}
+
+	if (asprintf(&ret, "%.*s-%u%s", (int)(ext - path), path, idx, ext) == -1) {
+		return NULL;
+	}
+	return ret;
+}
+
+static int out_split(const char* operation, const char* data, const char* path) {
+	struct split_input in = {{"<data>", data, "</data>"}, {6, strlen(data), 7}, 0, 0};
+	xmlTextReaderPtr reader;
+	xmlChar* entry;
+	char* start = NULL, *end = NULL, *file;
+	unsigned int idx = 0;
+	int read, ret = EXIT_SUCCESS;
+
+	reader = xmlReaderForIO(split_read, NULL, &in, NULL, NULL, XML_PARSE_NOBLANKS | XML_PARSE_HUGE);
+	if (reader == NULL) {
+		ERROR(operation, "Unable to parse the reply data.");
+		return EXIT_FAILURE;
+	}
+
+	read = xmlTextReaderRead(reader);
+	while (read == 1 && ret == EXIT_SUCCESS) {
+		if (xmlTextReaderDepth(reader) == 1 && xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT) {
+			/* a top-level element, put around each of its children */
+			free(start);
+			free(end);
+			start = split_start_tag(reader);
+			if (asprintf(&end, "</%s>\n", (char*)xmlTextReaderConstName(reader)) == -1) {
+				end = NULL;
+			}
+			if (start == NULL || end == NULL) {
+				ERROR(operation, "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				ret = EXIT_FAILURE;
+				break;
+			}
+
+			if (xmlTextReaderIsEmptyElement(reader)) {
+				if ((file = split_path(path, ++idx)) == NULL) {
+					ret = EXIT_FAILURE;
+					break;
+				}
+				ret = out_file(operation, file, start, "", end);
+				free(file);
+			}
+		} else if (xmlTextReaderDepth(reader) == 2) {
+			/* an entry, written on its own and skipped */
+			entry = xmlTextReaderReadOuterXml(reader);
+			if (entry == NULL || (file = split_path(path, ++idx)) == NULL) {
+				ERROR(operation, "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				xmlFree(entry);
+				ret = EXIT_FAILURE;
+				break;
+			}
+			ret = out_file(operation, file, start, (char*)entry, end);
+			free(file);
+			xmlFree(entry);
+
+			read = xmlTextReaderNext(reader);
+			continue;
+		}
+
+		read = xmlTextReaderRead(reader);
+	}
+	if (read == -1) {
+		ERROR(operation, "Unable to parse the reply data.");
+		ret = EXIT_FAILURE;
+	}
+
+	xmlFreeTextReader(reader);
+	free(start);
+	free(end);
+	return ret;
+}
+
+int np_out_data(const char* operation, const char* data, const char* path, int split) {
+	if (split) {
+		return out_split(operation, data, path);
+	}
+
+	return out_file(operation, path, "", data, "\n");
+}
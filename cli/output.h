@@ -0,0 +1,25 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stddef.h>
+
+/* size of the pieces the data are written and compressed in */
+#define OUT_CHUNK_SIZE 65536
+
+/* a file written plain, or compressed if its name ends with .gz or .zst */
+struct np_out;
+
+struct np_out* np_out_open(const char* path);
+
+int np_out_write(struct np_out* out, const char* data, size_t len);
+
+int np_out_close(struct np_out* out);
+
+/*
+ * Write the data of a reply of the operation into the file, get-config data wrapped in <config>.
+ * With split, every child of the top-level elements is written into its own file, with the
+ * top-level element around it, named as path with -<number> before the extension.
+ */
+int np_out_data(const char* operation, const char* data, const char* path, int split);
+
+#endif /* _OUTPUT_H_ */
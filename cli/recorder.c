@@ -0,0 +1,387 @@
+/*
+ * recorder.c
+ * Author agent <agent@local>
+ *
+ * Implementation of the buffered and indexed notification recorder.
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <libnetconf.h>
+
+#include "recorder.h"
+#include "commands.h"
+
+#ifndef DISABLE_NOTIFICATIONS
+
+/* "{"eventTime":-9223372036854775808,"received":-9223372036854775808,"content":""}\n" */
+#define REC_LINE_OVERHEAD 96
+
+struct rec_buffer {
+	char* data;
+	size_t len;
+	struct np_rec_index* idx;
+	size_t idx_count;
+	size_t idx_size;
+};
+
+struct np_recorder {
+	char* path;
+	int fd;
+	int idx_fd;
+	uint64_t offset;			/* of the next line in the data file */
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t writer;
+	struct rec_buffer bufs[2];
+	struct rec_buffer* active;	/* filled by the receiving thread, the other one is written */
+	int done;
+
+	/* statistics */
+	unsigned long events;
+	unsigned long dropped;
+	unsigned long writes;
+	unsigned long write_errors;
+	uint64_t bytes;
+	double lag_sum;				/* seconds between the eventTime and the reception */
+	long lag_max;
+};
+
+static pthread_key_t rec_current;
+static pthread_once_t rec_current_once = PTHREAD_ONCE_INIT;
+
+static void rec_current_create(void) {
+	pthread_key_create(&rec_current, NULL);
+}
+
+/* length of the JSON string of the text, written into dst if not NULL */
+static size_t rec_escape(char* dst, const char* src) {
+	const unsigned char* c;
+	size_t len = 0;
+
+	for (c = (const unsigned char*)src; *c != '\0'; ++c) {
+		switch (*c) {
+		case '"':
+		case '\\':
+			if (dst != NULL) {
+				dst[len] = '\\';
+				dst[len + 1] = *c;
+			}
+			len += 2;
+			break;
+		case '\n':
+		case '\r':
+		case '\t':
+			if (dst != NULL) {
+				dst[len] = '\\';
+				dst[len + 1] = (*c == '\n') ? 'n' : ((*c == '\r') ? 'r' : 't');
+			}
+			len += 2;
+			break;
+		default:
+			if (*c < 0x20) {
+				if (dst != NULL) {
+					sprintf(dst + len, "\\u%04x", *c);
+				}
+				len += 6;
+			} else {
+				if (dst != NULL) {
+					dst[len] = *c;
+				}
+				++len;
+			}
+			break;
+		}
+	}
+
+	return len;
+}
+
+static int rec_write(int fd, const char* data, size_t len) {
+	ssize_t ret;
+
+	while (len > 0) {
+		if ((ret = write(fd, data, len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return EXIT_FAILURE;
+		}
+		data += ret;
+		len -= ret;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static void rec_notification(time_t eventtime, const char* content) {
+	struct np_recorder* rec = pthread_getspecific(rec_current);
+	struct rec_buffer* buf;
+	struct np_rec_index* idx;
+	struct timespec now;
+	size_t content_len;
+	long long received;
+	long lag;
+	int len;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	received = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	lag = (long)(now.tv_sec - eventtime);
+	content_len = rec_escape(NULL, content);
+
+	/* RECORDER LOCK */
+	pthread_mutex_lock(&rec->lock);
+	++rec->events;
+	if (lag > 0) {
+		rec->lag_sum += lag;
+		if (lag > rec->lag_max) {
+			rec->lag_max = lag;
+		}
+	}
+
+	buf = rec->active;
+	if (buf->len + content_len + REC_LINE_OVERHEAD > REC_BUFFER_SIZE) {
+		/* the writes fall behind, or the notification would never fit */
+		++rec->dropped;
+		pthread_cond_signal(&rec->cond);
+		pthread_mutex_unlock(&rec->lock);
+		/* RECORDER UNLOCK */
+		return;
+	}
+	if (buf->idx_count == buf->idx_size) {
+		idx = realloc(buf->idx, (buf->idx_size * 2) * sizeof *idx);
+		if (idx == NULL) {
+			++rec->dropped;
+			pthread_mutex_unlock(&rec->lock);
+			/* RECORDER UNLOCK */
+			return;
+		}
+		buf->idx = idx;
+		buf->idx_size *= 2;
+	}
+
+	buf->idx[buf->idx_count].event_time = eventtime;
+	buf->idx[buf->idx_count].offset = rec->offset;
+	++buf->idx_count;
+
+	len = sprintf(buf->data + buf->len, "{\"eventTime\":%lld,\"received\":%lld,\"content\":\"", (long long)eventtime, received);
+	len += rec_escape(buf->data + buf->len + len, content);
+	len += sprintf(buf->data + buf->len + len, "\"}\n");
+	buf->len += len;
+	rec->offset += len;
+
+	if (buf->len >= REC_FLUSH_SIZE) {
+		pthread_cond_signal(&rec->cond);
+	}
+	pthread_mutex_unlock(&rec->lock);
+	/* RECORDER UNLOCK */
+}
+
+static void* rec_writer(void* arg) {
+	struct np_recorder* rec = (struct np_recorder*)arg;
+	struct rec_buffer* buf;
+	struct timespec deadline;
+	int failed;
+
+	/* RECORDER LOCK */
+	pthread_mutex_lock(&rec->lock);
+	while (1) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += REC_FLUSH_INTERVAL / 1000;
+		deadline.tv_nsec += (REC_FLUSH_INTERVAL % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			++deadline.tv_sec;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (!rec->done && rec->active->len < REC_FLUSH_SIZE) {
+			if (pthread_cond_timedwait(&rec->cond, &rec->lock, &deadline) == ETIMEDOUT) {
+				break;
+			}
+		}
+
+		if (rec->active->len == 0) {
+			if (rec->done) {
+				break;
+			}
+			continue;
+		}
+
+		/* the receiving thread goes on with the other buffer */
+		buf = rec->active;
+		rec->active = (buf == &rec->bufs[0]) ? &rec->bufs[1] : &rec->bufs[0];
+		pthread_mutex_unlock(&rec->lock);
+		/* RECORDER UNLOCK */
+
+		failed = rec_write(rec->fd, buf->data, buf->len)
+				|| rec_write(rec->idx_fd, (char*)buf->idx, buf->idx_count * sizeof *buf->idx);
+
+		/* RECORDER LOCK */
+		pthread_mutex_lock(&rec->lock);
+		++rec->writes;
+		if (failed) {
+			++rec->write_errors;
+		} else {
+			rec->bytes += buf->len;
+		}
+		buf->len = 0;
+		buf->idx_count = 0;
+	}
+	pthread_mutex_unlock(&rec->lock);
+	/* RECORDER UNLOCK */
+
+	return NULL;
+}
+
+static void rec_free(struct np_recorder* rec) {
+	int i;
+
+	for (i = 0; i < 2; ++i) {
+		free(rec->bufs[i].data);
+		free(rec->bufs[i].idx);
+	}
+	if (rec->fd != -1) {
+		close(rec->fd);
+	}
+	if (rec->idx_fd != -1) {
+		close(rec->idx_fd);
+	}
+	free(rec->path);
+	free(rec);
+}
+
+struct np_recorder* np_recorder_open(const char* path) {
+	struct np_recorder* rec;
+	pthread_condattr_t attr;
+	struct stat st;
+	char* idx_path;
+	int i, failed;
+
+	if ((rec = calloc(1, sizeof *rec)) == NULL) {
+		ERROR("subscribe", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return NULL;
+	}
+	rec->fd = -1;
+	rec->idx_fd = -1;
+
+	failed = ((rec->path = strdup(path)) == NULL);
+	for (i = 0; i < 2; ++i) {
+		rec->bufs[i].data = malloc(REC_BUFFER_SIZE);
+		rec->bufs[i].idx_size = 64;
+		rec->bufs[i].idx = malloc(rec->bufs[i].idx_size * sizeof *rec->bufs[i].idx);
+		failed = failed || rec->bufs[i].data == NULL || rec->bufs[i].idx == NULL;
+	}
+	if (failed || asprintf(&idx_path, "%s.idx", path) == -1) {
+		ERROR("subscribe", "Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		rec_free(rec);
+		return NULL;
+	}
+	rec->active = &rec->bufs[0];
+
+	/* the file is appended to, new lines continue after the previous recordings */
+	if ((rec->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1 || fstat(rec->fd, &st) == -1) {
+		ERROR("subscribe", "Could not open the record file \"%s\" (%s).", path, strerror(errno));
+		free(idx_path);
+		rec_free(rec);
+		return NULL;
+	}
+	rec->offset = st.st_size;
+	if ((rec->idx_fd = open(idx_path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1) {
+		ERROR("subscribe", "Could not open the record index file \"%s\" (%s).", idx_path, strerror(errno));
+		free(idx_path);
+		rec_free(rec);
+		return NULL;
+	}
+	free(idx_path);
+
+	pthread_mutex_init(&rec->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&rec->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if ((errno = pthread_create(&rec->writer, NULL, rec_writer, rec)) != 0) {
+		ERROR("subscribe", "Creating the record writer thread failed (%s).", strerror(errno));
+		pthread_cond_destroy(&rec->cond);
+		pthread_mutex_destroy(&rec->lock);
+		rec_free(rec);
+		return NULL;
+	}
+
+	return rec;
+}
+
+void np_recorder_dispatch(struct np_recorder* rec, struct nc_session* session) {
+	pthread_once(&rec_current_once, rec_current_create);
+	pthread_setspecific(rec_current, rec);
+
+	ncntf_dispatch_receive(session, rec_notification);
+}
+
+void np_recorder_close(struct np_recorder* rec, FILE* output) {
+	/* RECORDER LOCK */
+	pthread_mutex_lock(&rec->lock);
+	rec->done = 1;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->lock);
+	/* RECORDER UNLOCK */
+	pthread_join(rec->writer, NULL);
+
+	if (output != NULL) {
+		fprintf(output, "Recorded %lu notifications into \"%s\", %llu bytes in %lu writes.\n",
+				rec->events - rec->dropped, rec->path, (unsigned long long)rec->bytes, rec->writes);
+		fprintf(output, "Dropped %lu notifications, %lu writes failed.\n", rec->dropped, rec->write_errors);
+		if (rec->events > 0) {
+			fprintf(output, "Notification lag average %.3f s, maximum %ld s.\n", rec->lag_sum / rec->events, rec->lag_max);
+		}
+	}
+
+	pthread_cond_destroy(&rec->cond);
+	pthread_mutex_destroy(&rec->lock);
+	rec_free(rec);
+}
+
+#endif /* not DISABLE_NOTIFICATIONS */
@@ -0,0 +1,40 @@
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libnetconf.h>
+
+/* bytes of the recorded notifications buffered before they are written, twice as much is allocated */
+#define REC_BUFFER_SIZE (1024 * 1024)
+
+/* the buffered notifications are written when there are at least this many bytes of them ... */
+#define REC_FLUSH_SIZE (256 * 1024)
+
+/* ... or number-of-msecs after the last write */
+#define REC_FLUSH_INTERVAL 500
+
+/*
+ * Records the notifications of a subscription into a file as JSON lines
+ * {"eventTime":<secs>,"received":<msecs>,"content":"<escaped XML>"}, appended
+ * to, and an index file <file>.idx with a struct np_rec_index for every line.
+ * The notifications are received and written by different threads, they
+ * are dropped instead of blocking the receiving if the writes fall behind.
+ */
+struct np_recorder;
+
+/* index of the recorded notifications, sorted by the line offsets, in the host byte order */
+struct np_rec_index {
+	int64_t event_time;			/* seconds since the epoch */
+	uint64_t offset;			/* of the line in the data file */
+};
+
+struct np_recorder* np_recorder_open(const char* path);
+
+/* receive the notifications of the session until the subscription ends */
+void np_recorder_dispatch(struct np_recorder* rec, struct nc_session* session);
+
+/* write the rest, print the statistics and free the recorder */
+void np_recorder_close(struct np_recorder* rec, FILE* output);
+
+#endif /* _RECORDER_H_ */
@@ -10,6 +10,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include <libxml/tree.h>
 
@@ -17,6 +20,7 @@
 #include "commands.h"
 
 extern COMMAND commands[];
+extern __thread struct nc_session* session;
 extern void clb_error_print(const char* tag,
 		const char* type,
 		const char* severity,
@@ -28,9 +32,33 @@ extern void clb_error_print(const char* tag,
 		const char* ns,
 		const char* sid);
 
-char* error_tag;
-char* error_message;
-char* error_info;
+/* the rpc-error of the command the thread executes */
+static __thread char* error_tag;
+static __thread char* error_message;
+static __thread char* error_info;
+
+pthread_mutex_t* test_lock = NULL;
+
+/* the tests of a file being run */
+struct test_run {
+	pthread_mutex_t lock;		/* for next and output */
+	struct np_test* next;
+	struct np_test_var* global_vars;
+	const struct nc_cpblts* capabs;
+	FILE* output;
+};
+
+/* a thread running the tests on its own session */
+struct test_worker {
+	pthread_t thread;
+	struct nc_session* session;
+	struct test_run* run;
+	int cmd_fd;					/* memory file with the command content */
+	int out_fd;					/* memory file the command output is written to */
+	char cmd_path[32];
+	char out_path[32];
+	FILE* cookie;
+};
 
 void np_test_capab_free(struct np_test_capab* capab) {
 	int i;
@@ -92,6 +120,7 @@ void np_test_cmd_free(struct np_test_cmd* cmd) {
 		free(to_free->result_err_tag);
 		free(to_free->result_err_msg);
 		free(to_free->result_file);
+		free(to_free->result_norm);
 		free(to_free);
 	}
 }
@@ -324,7 +353,35 @@ static void test_cmd_subst_file(char** cmd, const char* file_name) {
 	}
 }
 
-static int test_xmlfile_cmp(const char* cmd_output, const char* expected_output, char** msg) {
+/* reformat an XML fragment, the whitespace between the elements does not matter then */
+static char* test_xml_normalize(const char* xml) {
+	char* wrapped, *ret;
+	xmlDocPtr doc;
+	xmlNodePtr node;
+	xmlBufferPtr buf;
+
+	/* the data of a reply can have several top-level elements */
+	if (asprintf(&wrapped, "<np-test>%s</np-test>", xml) == -1) {
+		return NULL;
+	}
+	doc = xmlReadMemory(wrapped, strlen(wrapped), NULL, NULL, XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_NOBLANKS | XML_PARSE_NSCLEAN);
+	free(wrapped);
+	if (doc == NULL) {
+		return NULL;
+	}
+
+	buf = xmlBufferCreate();
+	for (node = xmlDocGetRootElement(doc)->children; node != NULL; node = node->next) {
+		xmlNodeDump(buf, doc, node, 0, 1);
+	}
+	ret = strdup((char*)xmlBufferContent(buf));
+	xmlBufferFree(buf);
+	xmlFreeDoc(doc);
+
+	return ret;
+}
+
+static int test_xmlfile_cmp(const char* cmd_output, const struct np_test_cmd* cmd_struct, char** msg) {
 	/*
 	 * TODO come up with something better
 	 *
@@ -342,305 +399,365 @@ static int test_xmlfile_cmp(const char* cmd_output, const char* expected_output,
 	 */
 
 	int ret;
-	/*xmlDocPtr doc1, doc2;
-	xmlBufferPtr buf1, buf2;
+	char* output_norm;
+
+	/* compare the same formatting, the exact strings if any of them is not a well-formed XML */
+	if (cmd_struct->result_norm != NULL && (output_norm = test_xml_normalize(cmd_output)) != NULL) {
+		ret = strcmp(cmd_struct->result_norm, output_norm);
+		free(output_norm);
+	} else {
+		ret = strcmp(cmd_struct->result_file, cmd_output);
+	}
 
-	doc1 = xmlReadMemory(cmd_output, strlen(cmd_output), NULL, NULL, XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_NOBLANKS | XML_PARSE_NSCLEAN);
-	doc2 = xmlReadMemory(expected_output, strlen(expected_output), NULL, NULL, XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_NOBLANKS | XML_PARSE_NSCLEAN);
-	if (doc1 == NULL || doc2 == NULL) {
-		asprintf(msg, "Internal error (%s:%d)\n", __FILE__, __LINE__);
+	if (ret != 0) {
+		asprintf(msg, "Expected output:\n%s\nActual output:\n%s\n", cmd_struct->result_file, cmd_output);
 		return EXIT_FAILURE;
 	}
 
-	buf1 = xmlBufferCreate();
-	buf2 = xmlBufferCreate();
+	return EXIT_SUCCESS;
+}
+
+static void test_error_clear(void) {
+	free(error_tag);
+	error_tag = NULL;
+	free(error_message);
+	error_message = NULL;
+	free(error_info);
+	error_info = NULL;
+}
+
+static void test_cmd_print(FILE* output, const char* result, struct np_test* test, int test_no, struct np_test_cmd* cmd_struct) {
+	fprintf(output, "%s: Test \"%s\" ", result, test->name);
+	if (test->count > 1) {
+		fprintf(output, "#%d ", test_no+1);
+	}
+	fprintf(output, "cmd \"%s\"", cmd_struct->cmd);
+}
+
+static int test_cmd_exec(struct test_worker* worker, struct np_test* test, int test_no, struct np_test_cmd* cmd_struct, FILE* output) {
+	int i, ret;
+	off_t size;
+	char* cmd_file_content, *msg, *cmd, *result_file;
 
-	xmlNodeDump(buf1, doc1, doc1->children, 1, 1);
-	xmlNodeDump(buf2, doc2, doc2->children, 1, 1);
+	if (cmd_struct->file != NULL) {
+		/*
+		 * command with file
+		 */
 
-	xmlFreeDoc(doc1);
-	xmlFreeDoc(doc2);
+		cmd_file_content = strdup(cmd_struct->file);
 
-	ret = strcmp((char*)xmlBufferContent(buf1), (char*)xmlBufferContent(buf2));
-	xmlBufferFree(buf1);
-	xmlBufferFree(buf2);*/
+		/* file test var substitution */
+		test_file_var_subst(&cmd_file_content, test->vars, test_no);
 
-	ret = strcmp(expected_output, cmd_output);
+		/* file global var substitution */
+		test_file_var_subst(&cmd_file_content, worker->run->global_vars, test_no);
 
-	if (ret != 0) {
-		asprintf(msg, "Expected output:\n%s\nActual output:\n%s\n", expected_output, cmd_output);
+		/* the command reads it from the memory file of the thread */
+		if (ftruncate(worker->cmd_fd, 0) == -1 || pwrite(worker->cmd_fd, cmd_file_content, strlen(cmd_file_content), 0) < (ssize_t)strlen(cmd_file_content)) {
+			fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": write: %s\n", test->name, test_no+1, cmd_struct->cmd, strerror(errno));
+			free(cmd_file_content);
+			return EXIT_FAILURE;
+		}
+		free(cmd_file_content);
+	}
+
+	cmd = strdup(cmd_struct->cmd);
+	test_cmd_subst_file(&cmd, (cmd_struct->file != NULL) ? worker->cmd_path : NULL);
+
+	/* find the command */
+	for (i = 0; commands[i].name != NULL; ++i) {
+		if (strncmp(cmd, commands[i].name, strlen(commands[i].name)) == 0 && cmd[strlen(commands[i].name)] == ' ') {
+			break;
+		}
+	}
+	if (commands[i].name == NULL) {
+		test_cmd_print(output, "FAIL", test, test_no, cmd_struct);
+		fprintf(output, ": command not found\n");
+		free(cmd);
 		return EXIT_FAILURE;
 	}
 
+	/* make the command output into the output memory file */
+	if (cmd_struct->result_file != NULL) {
+		ftruncate(worker->out_fd, 0);
+		cmd = realloc(cmd, strlen(cmd)+strlen(" --out ")+strlen(worker->out_path)+1);
+		strcat(cmd, " --out ");
+		strcat(cmd, worker->out_path);
+	}
+
+	/* finally execute the command */
+	/* COMMAND LOCK */
+	pthread_mutex_lock(test_lock);
+	ret = commands[i].func(cmd, NULL, worker->cookie, worker->cookie);
+	/* COMMAND UNLOCK */
+	pthread_mutex_unlock(test_lock);
+	free(cmd);
+
+	if (ret != EXIT_SUCCESS) {
+		test_cmd_print(output, "COMMAND FAIL", test, test_no, cmd_struct);
+		fprintf(output, "\n");
+		test_error_clear();
+		return EXIT_FAILURE;
+	}
+
+	/* check result */
+	if (cmd_struct->result_err_tag != NULL) {
+		/* error result */
+		if (error_tag == NULL) {
+			test_cmd_print(output, "FAIL", test, test_no, cmd_struct);
+			fprintf(output, ": no error\n");
+			return EXIT_FAILURE;
+		} else if (strcmp(cmd_struct->result_err_tag, "any") == 0) {
+			test_cmd_print(output, "INFO", test, test_no, cmd_struct);
+			fprintf(output, ": error %s", error_tag);
+			if (error_info != NULL) {
+				fprintf(output, " - %s\n", error_info);
+			}
+			fprintf(output, " (%s)\n", error_message);
+		} else if (strcmp(cmd_struct->result_err_tag, error_tag) != 0) {
+			test_cmd_print(output, "FAIL", test, test_no, cmd_struct);
+			fprintf(output, ": wrong error (%s instead %s)\n", error_tag, cmd_struct->result_err_tag);
+			test_error_clear();
+			return EXIT_FAILURE;
+		}
+
+		if (cmd_struct->result_err_msg != NULL && strcmp(cmd_struct->result_err_msg, error_message) != 0) {
+			test_cmd_print(output, "FAIL", test, test_no, cmd_struct);
+			fprintf(output, ": wrong error message (%s instead %s)\n", error_message, cmd_struct->result_err_msg);
+			test_error_clear();
+			return EXIT_FAILURE;
+		}
+
+		test_error_clear();
+	} else {
+		/* success result */
+		if (error_tag != NULL) {
+			test_cmd_print(output, "FAIL", test, test_no, cmd_struct);
+			fprintf(output, ": error %s (%s)\n", error_tag, error_message);
+			test_error_clear();
+			return EXIT_FAILURE;
+		}
+
+		if (cmd_struct->result_file != NULL) {
+			/* file result */
+			if ((size = lseek(worker->out_fd, 0, SEEK_END)) == -1) {
+				fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": cmd output file error (%s)\n", test->name, test_no+1, cmd_struct->cmd, strerror(errno));
+				return EXIT_FAILURE;
+			}
+			result_file = malloc(size+1);
+			result_file[size] = '\0';
+
+			if (pread(worker->out_fd, result_file, size, 0) < size) {
+				fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": cmd output file read error\n", test->name, test_no+1, cmd_struct->cmd);
+				free(result_file);
+				return EXIT_FAILURE;
+			}
+
+			if (test_xmlfile_cmp(result_file, cmd_struct, &msg) != EXIT_SUCCESS) {
+				test_cmd_print(output, "FAIL", test, test_no, cmd_struct);
+				fprintf(output, ": output file differs from the expected result (%s)\n", msg);
+				free(msg);
+				free(result_file);
+				return EXIT_FAILURE;
+			}
+
+			free(result_file);
+		}
+	}
+
 	return EXIT_SUCCESS;
 }
 
-int perform_test(struct np_test* tests, struct np_test_capab* global_capabs, struct np_test_var* global_vars, const struct nc_cpblts* capabs, FILE* output) {
-	int test_no, cmd_filefd, i, test_fail, fd, size;
-	char* cmd_file_content, *cmd_file = NULL, *msg, *cmd, *cmd_output_file = NULL, *result_file;
-	FILE* file_cookie;
+static void test_exec(struct test_worker* worker, struct np_test* test, FILE* output) {
+	int test_no;
+	char* msg;
 	struct np_test_cmd* cmd_struct;
-	cookie_io_functions_t file_cookie_funcs = {.read = NULL, .write = NULL, .seek = NULL, .close = NULL};
+	struct timespec start, end;
 
-	if (test_capab_check(capabs, global_capabs, &msg) != EXIT_SUCCESS) {
-		fprintf(output, "FAIL: Test global capabilities (%s)\n", msg);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (test_capab_check(worker->run->capabs, test->required_capabs, &msg) != EXIT_SUCCESS) {
+		fprintf(output, "FAIL: Test \"%s\" capabs (%s)\n", test->name, msg);
 		free(msg);
-		return EXIT_FAILURE;
+		test->fail = 1;
 	}
-	fprintf(output, " OK : Test global capabilities\n");
 
-	nc_callback_error_reply(clb_test_error);
-	file_cookie = fopencookie(NULL, "r+", file_cookie_funcs);
-
-	for (; tests != NULL; tests = tests->next) {
+	for (test_no = 0; test_no < test->count && !test->fail; ++test_no) {
 		/*
-		 * test
+		 * one test execution
 		 */
 
-		if (test_capab_check(capabs, tests->required_capabs, &msg) != EXIT_SUCCESS) {
-			fprintf(output, "FAIL: Test \"%s\" capabs (%s)\n", tests->name, msg);
-			free(msg);
-			continue;
+		for (cmd_struct = test->cmds; cmd_struct != NULL; cmd_struct = cmd_struct->next) {
+			if (test_cmd_exec(worker, test, test_no, cmd_struct, output) != EXIT_SUCCESS) {
+				test->fail = 1;
+				break;
+			}
 		}
+	}
 
-		test_fail = 0;
-
-		for (test_no = 0; test_no < tests->count && !test_fail; ++test_no) {
-			/*
-			 * one test execution
-			 */
-
-			for (cmd_struct = tests->cmds; cmd_struct != NULL; cmd_struct = cmd_struct->next) {
-				/*
-				 * test execution single command
-				 */
-
-				if (cmd_struct->file != NULL) {
-					/*
-					 * command with file
-					 */
+	if (!test->fail) {
+		if (test->count == 1) {
+			fprintf(output, " OK : Test \"%s\"\n", test->name);
+		} else {
+			fprintf(output, " OK : Test \"%s\" #1-%d\n", test->name, test->count);
+		}
+	}
 
-					cmd_file_content = strdup(cmd_struct->file);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	test->time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
 
-					/* file test var substitution */
-					test_file_var_subst(&cmd_file_content, tests->vars, test_no);
+static void* test_thread(void* arg) {
+	struct test_worker* worker = (struct test_worker*)arg;
+	struct test_run* run = worker->run;
+	struct np_test* test;
+	FILE* output;
+	char* buf;
+	size_t size;
+
+	/* the commands use the session of the executing thread */
+	session = worker->session;
+
+	for (;;) {
+		/* RUN LOCK */
+		pthread_mutex_lock(&run->lock);
+		test = run->next;
+		if (test != NULL) {
+			run->next = test->next;
+		}
+		/* RUN UNLOCK */
+		pthread_mutex_unlock(&run->lock);
 
-					/* file global var substitution */
-					test_file_var_subst(&cmd_file_content, global_vars, test_no);
+		if (test == NULL) {
+			break;
+		}
 
-					asprintf(&cmd_file, "/tmp/tmpXXXXXX.xml");
-					cmd_filefd = mkstemps(cmd_file, 4);
-					if (cmd_filefd == -1) {
-						fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": mkstemps: %s\n", tests->name, test_no+1, cmd_struct->cmd, strerror(errno));
-						free(cmd_file_content);
-						free(cmd_file);
-						cmd_file = NULL;
-						test_fail = 1;
-						break;
-					}
-					if (write(cmd_filefd, cmd_file_content, strlen(cmd_file_content)) < strlen(cmd_file_content)) {
-						fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": write: %s\n", tests->name, test_no+1, cmd_struct->cmd, strerror(errno));
-						free(cmd_file_content);
-						free(cmd_file);
-						cmd_file = NULL;
-						test_fail = 1;
-						break;
-					}
-					close(cmd_filefd);
-					free(cmd_file_content);
-				}
+		/* the output of a test is printed at once, not mixed with the others */
+		buf = NULL;
+		size = 0;
+		if ((output = open_memstream(&buf, &size)) == NULL) {
+			test->fail = 1;
+			continue;
+		}
+		test_exec(worker, test, output);
+		fclose(output);
+
+		/* RUN LOCK */
+		pthread_mutex_lock(&run->lock);
+		fwrite(buf, 1, size, run->output);
+		/* RUN UNLOCK */
+		pthread_mutex_unlock(&run->lock);
+		free(buf);
+	}
 
-				cmd = strdup(cmd_struct->cmd);
-				test_cmd_subst_file(&cmd, cmd_file);
-				free(cmd_file);
-				cmd_file = NULL;
+	/* a command could have closed a broken session */
+	worker->session = session;
+	return NULL;
+}
 
-				/* find the command */
-				for (i = 0; commands[i].name != NULL; ++i) {
-					if (strncmp(cmd, commands[i].name, strlen(commands[i].name)) == 0 && cmd[strlen(commands[i].name)] == ' ') {
-						break;
-					}
-				}
-				if (commands[i].name == NULL) {
-					fprintf(output, "FAIL: Test \"%s\" ", tests->name);
-					if (tests->count > 1) {
-						fprintf(output, "#%d ", test_no+1);
-					}
-					fprintf(output, "cmd \"%s\": command not found\n", cmd_struct->cmd);
-					free(cmd);
-					test_fail = 1;
-					break;
-				}
+int perform_test(struct np_test* tests, struct np_test_capab* global_capabs, struct np_test_var* global_vars, const struct nc_cpblts* capabs, struct nc_session** sessions, unsigned int session_count, FILE* output) {
+	static pthread_mutex_t cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+	unsigned int i, started;
+	int ret = EXIT_SUCCESS;
+	char* msg;
+	struct np_test* test;
+	struct np_test_cmd* cmd_struct;
+	struct test_run run;
+	struct test_worker* workers, *worker;
+	cookie_io_functions_t file_cookie_funcs = {.read = NULL, .write = NULL, .seek = NULL, .close = NULL};
 
-				/* make the command output into a file */
-				if (cmd_struct->result_file != NULL) {
-					asprintf(&cmd_output_file, "/tmp/tmpXXXXXX.xml");
-					close(mkstemps(cmd_output_file, 4));
+	if (test_capab_check(capabs, global_capabs, &msg) != EXIT_SUCCESS) {
+		fprintf(output, "FAIL: Test global capabilities (%s)\n", msg);
+		free(msg);
+		return EXIT_FAILURE;
+	}
+	fprintf(output, " OK : Test global capabilities\n");
 
-					cmd = realloc(cmd, strlen(cmd)+strlen(" --out ")+strlen(cmd_output_file)+1);
-					strcat(cmd, " --out ");
-					strcat(cmd, cmd_output_file);
-				}
+	/* the expected results are parsed once, not in every repetition */
+	for (test = tests; test != NULL; test = test->next) {
+		for (cmd_struct = test->cmds; cmd_struct != NULL; cmd_struct = cmd_struct->next) {
+			if (cmd_struct->result_file != NULL && cmd_struct->result_norm == NULL) {
+				cmd_struct->result_norm = test_xml_normalize(cmd_struct->result_file);
+			}
+		}
+	}
 
-				/* finally execute the command */
-				if (commands[i].func(cmd, NULL, file_cookie, file_cookie) != EXIT_SUCCESS) {
-					fprintf(output, "COMMAND FAIL: Test \"%s\" ", tests->name);
-					if (tests->count > 1) {
-						fprintf(output, "#%d ", test_no+1);
-					}
-					fprintf(output, "cmd \"%s\"\n", cmd_struct->cmd);
-					free(cmd);
-					free(cmd_output_file);
-					cmd_output_file = NULL;
-					test_fail = 1;
-					break;
-				}
+	if ((workers = calloc(session_count, sizeof *workers)) == NULL) {
+		fprintf(output, "INTERNAL ERROR: calloc: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < session_count; ++i) {
+		workers[i].cmd_fd = -1;
+		workers[i].out_fd = -1;
+	}
 
-				/* check result */
-				if (cmd_struct->result_err_tag != NULL) {
-					/* error result */
-					if (error_tag == NULL) {
-						fprintf(output, "FAIL: Test \"%s\" ", tests->name);
-						if (tests->count > 1) {
-							fprintf(output, "#%d ", test_no+1);
-						}
-						fprintf(output, "cmd \"%s\": no error\n", cmd_struct->cmd);
-						free(cmd);
-						test_fail = 1;
-						break;
-					} else if (strcmp(cmd_struct->result_err_tag, "any") == 0) {
-						fprintf(output, "INFO: Test \"%s\" ", tests->name);
-						if (tests->count > 1) {
-							fprintf(output, "#%d ", test_no+1);
-						}
-						fprintf(output, "cmd \"%s\": error %s", cmd_struct->cmd, error_tag);
-						if (error_info != NULL) {
-							fprintf(output, " - %s\n", error_info);
-						}
-						fprintf(output, " (%s)\n", error_message);
-					} else if (strcmp(cmd_struct->result_err_tag, error_tag) != 0) {
-						fprintf(output, "FAIL: Test \"%s\" ", tests->name);
-						if (tests->count > 1) {
-							fprintf(output, "#%d ", test_no+1);
-						}
-						fprintf(output, "cmd \"%s\": wrong error (%s instead %s)\n", cmd_struct->cmd, error_tag, cmd_struct->result_err_tag);
-						free(error_tag);
-						error_tag = NULL;
-						free(error_message);
-						error_message = NULL;
-						free(error_info);
-						error_info = NULL;
-						free(cmd);
-						test_fail = 1;
-						break;
-					}
+	pthread_mutex_init(&run.lock, NULL);
+	run.next = tests;
+	run.global_vars = global_vars;
+	run.capabs = capabs;
+	run.output = output;
 
-					if (cmd_struct->result_err_msg != NULL && strcmp(cmd_struct->result_err_msg, error_message) != 0) {
-						fprintf(output, "FAIL: Test \"%s\" ", tests->name);
-						if (tests->count > 1) {
-							fprintf(output, "#%d ", test_no+1);
-						}
-						fprintf(output, "cmd \"%s\": wrong error message (%s instead %s)\n", cmd_struct->cmd, error_message, cmd_struct->result_err_msg);
-						free(error_tag);
-						error_tag = NULL;
-						free(error_message);
-						error_message = NULL;
-						free(error_info);
-						error_info = NULL;
-						free(cmd);
-						test_fail = 1;
-						break;
-					}
+	nc_callback_error_reply(clb_test_error);
+	test_lock = &cmd_lock;
+
+	/* every thread takes the next test not run yet, on its own session */
+	for (started = 0; started < session_count; ++started) {
+		worker = &workers[started];
+		worker->session = sessions[started];
+		worker->run = &run;
+
+		/* in-memory files instead of temporary ones */
+		if ((worker->cmd_fd = memfd_create("netopeer-cli-test", 0)) == -1 || (worker->out_fd = memfd_create("netopeer-cli-test-out", 0)) == -1) {
+			fprintf(output, "INTERNAL ERROR: memfd_create: %s\n", strerror(errno));
+			break;
+		}
+		snprintf(worker->cmd_path, sizeof worker->cmd_path, "/proc/self/fd/%d", worker->cmd_fd);
+		snprintf(worker->out_path, sizeof worker->out_path, "/proc/self/fd/%d", worker->out_fd);
 
-					free(error_tag);
-					error_tag = NULL;
-					free(error_message);
-					error_message = NULL;
-					free(error_info);
-					error_info = NULL;
-				} else {
-					/* success result */
-					if (error_tag != NULL) {
-						fprintf(output, "FAIL: Test \"%s\" ", tests->name);
-						if (tests->count > 1) {
-							fprintf(output, "#%d ", test_no+1);
-						}
-						fprintf(output, "cmd \"%s\": error %s (%s)\n", cmd_struct->cmd, error_tag, error_message);
-						free(error_tag);
-						error_tag = NULL;
-						free(error_message);
-						error_message = NULL;
-						free(error_info);
-						error_info = NULL;
-						free(cmd);
-						test_fail = 1;
-						break;
-					}
+		if ((worker->cookie = fopencookie(NULL, "r+", file_cookie_funcs)) == NULL) {
+			fprintf(output, "INTERNAL ERROR: fopencookie: %s\n", strerror(errno));
+			break;
+		}
 
-					if (cmd_struct->result_file != NULL) {
-						/* file result */
-						if (cmd_output_file == NULL) {
-							fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": cmd_output_file is NULL\n", tests->name, test_no+1, cmd_struct->cmd);
-							free(cmd);
-							test_fail = 1;
-							break;
-						}
+		if ((errno = pthread_create(&worker->thread, NULL, test_thread, worker)) != 0) {
+			fprintf(output, "INTERNAL ERROR: pthread_create: %s\n", strerror(errno));
+			break;
+		}
+	}
 
-						if ((fd = open(cmd_output_file, O_RDONLY)) == -1 || (size = lseek(fd, 0, SEEK_END)) == -1) {
-							fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": cmd output file error (%s)\n", tests->name, test_no+1, cmd_struct->cmd, strerror(errno));
-							free(cmd);
-							free(cmd_output_file);
-							cmd_output_file = NULL;
-							test_fail = 1;
-							break;
-						}
-						unlink(cmd_output_file);
-						free(cmd_output_file);
-						cmd_output_file = NULL;
-						lseek(fd, 0, SEEK_SET);
-						result_file = malloc(size+1);
-						result_file[size] = '\0';
-
-						if (read(fd, result_file, size) < size) {
-							fprintf(output, "INTERNAL ERROR: Test \"%s\" #%d cmd \"%s\": cmd output file read error\n", tests->name, test_no+1, cmd_struct->cmd);
-							free(cmd);
-							free(result_file);
-							test_fail = 1;
-							break;
-						}
-						close(fd);
-
-						if (test_xmlfile_cmp(result_file, cmd_struct->result_file, &msg) != EXIT_SUCCESS) {
-							fprintf(output, "FAIL: Test \"%s\" ", tests->name);
-							if (tests->count > 1) {
-								fprintf(output, "#%d ", test_no+1);
-							}
-							fprintf(output, "cmd \"%s\": output file differs from the expected result (%s)\n", cmd_struct->cmd, msg);
-							free(msg);
-							free(result_file);
-							free(cmd);
-							test_fail = 1;
-							break;
-						}
+	for (i = 0; i < started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		sessions[i] = workers[i].session;
+	}
 
-						free(result_file);
-					}
-				}
+	test_lock = NULL;
+	nc_callback_error_reply(clb_error_print);
 
-				free(cmd);
+	if (started == 0) {
+		ret = EXIT_FAILURE;
+	} else {
+		fprintf(output, "Test timings:\n");
+		for (test = tests; test != NULL; test = test->next) {
+			fprintf(output, " %10.6fs %-4s \"%s\"\n", test->time, test->fail ? "FAIL" : "OK", test->name);
+			if (test->fail) {
+				ret = EXIT_FAILURE;
 			}
 		}
+	}
 
-		if (!test_fail) {
-			if (tests->count == 1) {
-				fprintf(output, " OK : Test \"%s\"\n", tests->name);
-			} else {
-				fprintf(output, " OK : Test \"%s\" #1-%d\n", tests->name, tests->count);
-			}
+	for (i = 0; i < session_count; ++i) {
+		if (workers[i].cmd_fd != -1) {
+			close(workers[i].cmd_fd);
+		}
+		if (workers[i].out_fd != -1) {
+			close(workers[i].out_fd);
+		}
+		if (workers[i].cookie != NULL) {
+			fclose(workers[i].cookie);
 		}
 	}
+	pthread_mutex_destroy(&run.lock);
+	free(workers);
 
-	fclose(file_cookie);
-	nc_callback_error_reply(clb_error_print);
-	return EXIT_SUCCESS;
+	return ret;
 }
@@ -1,6 +1,8 @@
 #ifndef _TEST_H_
 #define _TEST_H_
 
+#include <pthread.h>
+
 struct np_test_capab {
 	char* capab;
 	char** attributes;
@@ -38,6 +40,7 @@ struct np_test_cmd {
 	char* result_err_tag;
 	char* result_err_msg;
 	char* result_file;
+	char* result_norm;		/* result_file reformatted for the comparison, parsed only once */
 	struct np_test_cmd* next;
 };
 
@@ -47,6 +50,8 @@ struct np_test {
 	struct np_test_capab* required_capabs;
 	struct np_test_var* vars;
 	struct np_test_cmd* cmds;
+	int fail;
+	double time;			/* seconds all the repetitions took */
 	struct np_test* next;
 };
 
@@ -58,6 +63,9 @@ void np_test_cmd_free(struct np_test_cmd* cmd);
 
 void np_test_free(struct np_test* test);
 
-int perform_test(struct np_test* tests, struct np_test_capab* global_capabs, struct np_test_var* global_vars, const struct nc_cpblts* capabs, FILE* output);
+/* held by the threads running the tests or the fleet commands while executing a command, except when waiting for the server */
+extern pthread_mutex_t* test_lock;
+
+int perform_test(struct np_test* tests, struct np_test_capab* global_capabs, struct np_test_var* global_vars, const struct nc_cpblts* capabs, struct nc_session** sessions, unsigned int session_count, FILE* output);
 
 #endif /* _TEST_H_ */
\ No newline at end of file
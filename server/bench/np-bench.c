@@ -0,0 +1,773 @@
+/**
+ * @file np-bench.c
+ * @author agent <agent@local>
+ * @brief Netopeer server benchmark load generator
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <libnetconf.h>
+#ifdef NP_SSH
+#	include <libnetconf_ssh.h>
+#endif
+#ifdef NP_TLS
+#	include <libnetconf_tls.h>
+#endif
+
+/* changes only the option itself, toggled between two values so that every edit is a real change */
+#define EDIT_CONFIG "<netopeer xmlns=\"urn:cesnet:tmc:netopeer:1.0\"><hello-timeout>%u</hello-timeout></netopeer>"
+
+/* number-of-secs the idle sessions are left connected before the server memory is read */
+#define IDLE_SETTLE 2
+
+/* number-of-secs the subscribers wait for the notifications still in flight after the last edit */
+#define NOTIF_GRACE 5
+
+enum bench_transport {
+	BENCH_SSH_PASSWORD,
+	BENCH_SSH_PUBKEY,
+	BENCH_TLS
+};
+
+static struct {
+	const char* host;
+	unsigned short ssh_port;
+	unsigned short tls_port;
+	const char* user;
+	const char* password;
+	const char* privkey;
+	const char* pubkey;
+	const char* cert;
+	const char* key;
+	const char* ca;
+	pid_t server_pid;			// for reading the server memory, 0 skips idle-memory
+	unsigned int threads;
+	unsigned int duration;		// number-of-secs every scenario runs
+	unsigned int sessions;		// idle sessions opened by idle-memory
+	unsigned int subscribers;	// sessions receiving the notifications in notif-fanout
+	unsigned int wait;			// number-of-secs to wait for the server to start listening
+} opts = {
+	.host = "localhost",
+	.ssh_port = 830,
+	.tls_port = 6513,
+	.threads = 4,
+	.duration = 10,
+	.sessions = 100,
+	.subscribers = 16
+};
+
+static struct nc_cpblts* cpblts;
+
+/* latencies of the operations of a single thread */
+struct samples {
+	uint64_t* usec;
+	size_t count;
+	size_t size;
+	uint64_t errors;
+};
+
+struct worker {
+	pthread_t tid;
+	enum bench_transport transport;
+	enum {
+		WORK_CONNECT,
+		WORK_GET_CONFIG,
+		WORK_EDIT_CONFIG
+	} work;
+	uint64_t deadline;
+	struct samples samples;
+};
+
+/* the state shared by the notif-fanout subscribers */
+static struct {
+	volatile int stop;
+	volatile unsigned int ready;
+	volatile unsigned int failed;
+	volatile uint64_t delivered;
+	volatile uint64_t last_usec;
+} fanout;
+
+static uint64_t now_usec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void samples_add(struct samples* samples, uint64_t usec) {
+	uint64_t* new_usec;
+
+	if (samples->count == samples->size) {
+		samples->size = (samples->size ? samples->size * 2 : 1024);
+		if ((new_usec = realloc(samples->usec, samples->size * sizeof(uint64_t))) == NULL) {
+			fprintf(stderr, "Memory allocation failed (%s:%d).\n", __FILE__, __LINE__);
+			exit(EXIT_FAILURE);
+		}
+		samples->usec = new_usec;
+	}
+	samples->usec[samples->count++] = usec;
+}
+
+static int usec_cmp(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static void clb_print(NC_VERB_LEVEL level, const char* msg) {
+	if (level == NC_VERB_ERROR) {
+		fprintf(stderr, "libnetconf ERROR: %s\n", msg);
+	}
+}
+
+#ifdef NP_SSH
+static char* clb_password(const char* username, const char* hostname) {
+	(void)username;
+	(void)hostname;
+	return strdup(opts.password);
+}
+
+/* the server keys are generated for every run */
+static int clb_hostkey(const char* hostname, ssh_session session) {
+	(void)hostname;
+	(void)session;
+	return EXIT_SUCCESS;
+}
+#endif
+
+static const char* transport_name(enum bench_transport transport) {
+	switch (transport) {
+	case BENCH_SSH_PASSWORD:
+		return "ssh-password";
+	case BENCH_SSH_PUBKEY:
+		return "ssh-pubkey";
+	default:
+		return "tls";
+	}
+}
+
+/* NULL if the transport can be used, the reason otherwise */
+static const char* transport_unusable(enum bench_transport transport) {
+	switch (transport) {
+	case BENCH_SSH_PASSWORD:
+#ifdef NP_SSH
+		return (opts.password == NULL ? "no password" : NULL);
+#else
+		return "no SSH support";
+#endif
+	case BENCH_SSH_PUBKEY:
+#ifdef NP_SSH
+		return (opts.privkey == NULL ? "no client key" : NULL);
+#else
+		return "no SSH support";
+#endif
+	default:
+#ifdef NP_TLS
+		return (opts.cert == NULL || opts.ca == NULL ? "no client certificate" : NULL);
+#else
+		return "no TLS support";
+#endif
+	}
+}
+
+/* the transport used by the RPC scenarios, the first usable one */
+static int rpc_transport(enum bench_transport* transport) {
+	enum bench_transport candidates[] = {BENCH_SSH_PUBKEY, BENCH_SSH_PASSWORD, BENCH_TLS};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+		if (transport_unusable(candidates[i]) == NULL) {
+			*transport = candidates[i];
+			return EXIT_SUCCESS;
+		}
+	}
+	return EXIT_FAILURE;
+}
+
+/* libnetconf keeps some of these per thread, so every thread calls it */
+static int transport_init(enum bench_transport transport) {
+	switch (transport) {
+#ifdef NP_SSH
+	case BENCH_SSH_PASSWORD:
+		nc_session_transport(NC_TRANSPORT_SSH);
+		nc_ssh_pref(NC_SSH_AUTH_PUBLIC_KEYS, -1);
+		nc_ssh_pref(NC_SSH_AUTH_INTERACTIVE, -1);
+		nc_ssh_pref(NC_SSH_AUTH_PASSWORD, 3);
+		return EXIT_SUCCESS;
+	case BENCH_SSH_PUBKEY:
+		nc_session_transport(NC_TRANSPORT_SSH);
+		nc_ssh_pref(NC_SSH_AUTH_PASSWORD, -1);
+		nc_ssh_pref(NC_SSH_AUTH_INTERACTIVE, -1);
+		nc_ssh_pref(NC_SSH_AUTH_PUBLIC_KEYS, 3);
+		return nc_set_keypair_path(opts.privkey, opts.pubkey);
+#endif
+#ifdef NP_TLS
+	case BENCH_TLS:
+		if (nc_session_transport(NC_TRANSPORT_TLS) != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		return nc_tls_init(opts.cert, opts.key, opts.ca, NULL, NULL, NULL);
+#endif
+	default:
+		return EXIT_FAILURE;
+	}
+}
+
+static void transport_destroy(enum bench_transport transport) {
+#ifdef NP_TLS
+	if (transport == BENCH_TLS) {
+		nc_tls_destroy();
+	}
+#else
+	(void)transport;
+#endif
+}
+
+static struct nc_session* bench_connect(enum bench_transport transport) {
+	return nc_session_connect(opts.host, (transport == BENCH_TLS ? opts.tls_port : opts.ssh_port), opts.user, cpblts);
+}
+
+/* 1 if the RPC was replied without an error */
+static int bench_rpc(struct nc_session* session, const nc_rpc* rpc, NC_MSG_TYPE* type) {
+	nc_reply* reply = NULL;
+	int ret;
+
+	*type = nc_session_send_recv(session, (nc_rpc*)rpc, &reply);
+	ret = (*type == NC_MSG_REPLY && nc_reply_get_type(reply) != NC_REPLY_ERROR);
+	if (reply != NULL) {
+		nc_reply_free(reply);
+	}
+	return ret;
+}
+
+static void* worker_thread(void* arg) {
+	struct worker* worker = (struct worker*)arg;
+	struct nc_session* session = NULL;
+	nc_rpc* rpc = NULL;
+	NC_MSG_TYPE type;
+	char config[sizeof(EDIT_CONFIG) + 16];
+	unsigned int i;
+	uint64_t start;
+
+	if (transport_init(worker->transport)) {
+		++worker->samples.errors;
+		return NULL;
+	}
+
+	if (worker->work != WORK_CONNECT) {
+		if ((session = bench_connect(worker->transport)) == NULL) {
+			++worker->samples.errors;
+			goto cleanup;
+		}
+		if (worker->work == WORK_GET_CONFIG) {
+			rpc = nc_rpc_getconfig(NC_DATASTORE_RUNNING, NULL);
+		}
+	}
+
+	for (i = 0; now_usec() < worker->deadline; ++i) {
+		start = now_usec();
+		switch (worker->work) {
+		case WORK_CONNECT:
+			if ((session = bench_connect(worker->transport)) == NULL) {
+				++worker->samples.errors;
+				continue;
+			}
+			samples_add(&worker->samples, now_usec() - start);
+			nc_session_free(session);
+			session = NULL;
+			break;
+		case WORK_EDIT_CONFIG:
+			snprintf(config, sizeof(config), EDIT_CONFIG, 600 + (i & 1));
+			rpc = nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET, config);
+			start = now_usec();
+			/* fallthrough */
+		case WORK_GET_CONFIG:
+			if (bench_rpc(session, rpc, &type)) {
+				samples_add(&worker->samples, now_usec() - start);
+			} else {
+				++worker->samples.errors;
+			}
+			if (worker->work == WORK_EDIT_CONFIG) {
+				nc_rpc_free(rpc);
+				rpc = NULL;
+			}
+			if (type == NC_MSG_UNKNOWN) {
+				/* the session is broken */
+				goto cleanup;
+			}
+			break;
+		}
+	}
+
+cleanup:
+	if (rpc != NULL) {
+		nc_rpc_free(rpc);
+	}
+	if (session != NULL) {
+		nc_session_free(session);
+	}
+	transport_destroy(worker->transport);
+	return NULL;
+}
+
+static void print_skipped(const char* scenario, const char* reason) {
+	printf("{\"scenario\":\"%s\",\"skipped\":\"%s\"}\n", scenario, reason);
+	fflush(stdout);
+}
+
+/* run the workers for the duration and print the throughput and the latencies of all of them */
+static void run_workers(const char* scenario, enum bench_transport transport, int work) {
+	struct worker* workers;
+	struct samples all = {NULL, 0, 0, 0};
+	unsigned int i, j;
+	uint64_t start, elapsed;
+	int ret;
+
+	if ((workers = calloc(opts.threads, sizeof(struct worker))) == NULL) {
+		fprintf(stderr, "Memory allocation failed (%s:%d).\n", __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	start = now_usec();
+	for (i = 0; i < opts.threads; ++i) {
+		workers[i].transport = transport;
+		workers[i].work = work;
+		workers[i].deadline = start + opts.duration * 1000000ULL;
+		if ((ret = pthread_create(&workers[i].tid, NULL, worker_thread, &workers[i])) != 0) {
+			fprintf(stderr, "Failed to create a thread (%s).\n", strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < opts.threads; ++i) {
+		pthread_join(workers[i].tid, NULL);
+		for (j = 0; j < workers[i].samples.count; ++j) {
+			samples_add(&all, workers[i].samples.usec[j]);
+		}
+		all.errors += workers[i].samples.errors;
+		free(workers[i].samples.usec);
+	}
+	elapsed = now_usec() - start;
+	free(workers);
+
+	qsort(all.usec, all.count, sizeof(uint64_t), usec_cmp);
+	printf("{\"scenario\":\"%s\",\"transport\":\"%s\",\"threads\":%u,\"duration\":%.3f,\"ops\":%zu,\"errors\":%" PRIu64
+			",\"rate\":%.1f,\"p50_us\":%" PRIu64 ",\"p99_us\":%" PRIu64 ",\"max_us\":%" PRIu64 "}\n",
+			scenario, transport_name(transport), opts.threads, elapsed / 1e6, all.count, all.errors,
+			all.count / (elapsed / 1e6),
+			(all.count ? all.usec[all.count / 2] : 0),
+			(all.count ? all.usec[(all.count * 99) / 100] : 0),
+			(all.count ? all.usec[all.count - 1] : 0));
+	fflush(stdout);
+	free(all.usec);
+}
+
+static void bench_handshake(enum bench_transport transport) {
+	const char* reason;
+
+	if ((reason = transport_unusable(transport)) != NULL) {
+		print_skipped(transport_name(transport), reason);
+		return;
+	}
+	run_workers(transport_name(transport), transport, WORK_CONNECT);
+}
+
+static void bench_rpcs(const char* scenario, int work) {
+	enum bench_transport transport;
+
+	if (rpc_transport(&transport)) {
+		print_skipped(scenario, "no usable transport");
+		return;
+	}
+	run_workers(scenario, transport, work);
+}
+
+/* VmRSS of the server in kB, 0 on error */
+static unsigned long server_rss(void) {
+	char path[64], line[256];
+	unsigned long rss = 0;
+	FILE* file;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", (int)opts.server_pid);
+	if ((file = fopen(path, "r")) == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "VmRSS: %lu kB", &rss) == 1) {
+			break;
+		}
+	}
+	fclose(file);
+	return rss;
+}
+
+static void bench_idle_memory(void) {
+	enum bench_transport transport;
+	struct nc_session** sessions;
+	unsigned long before, after;
+	unsigned int i, opened = 0;
+
+	if (opts.server_pid == 0) {
+		print_skipped("idle-memory", "no server pid");
+		return;
+	}
+	if (rpc_transport(&transport) || transport_init(transport)) {
+		print_skipped("idle-memory", "no usable transport");
+		return;
+	}
+	if ((sessions = calloc(opts.sessions, sizeof(struct nc_session*))) == NULL) {
+		fprintf(stderr, "Memory allocation failed (%s:%d).\n", __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	before = server_rss();
+	for (i = 0; i < opts.sessions; ++i) {
+		if ((sessions[i] = bench_connect(transport)) != NULL) {
+			++opened;
+		}
+	}
+	sleep(IDLE_SETTLE);
+	after = server_rss();
+
+	for (i = 0; i < opts.sessions; ++i) {
+		if (sessions[i] != NULL) {
+			nc_session_free(sessions[i]);
+		}
+	}
+	free(sessions);
+	transport_destroy(transport);
+
+	printf("{\"scenario\":\"idle-memory\",\"transport\":\"%s\",\"sessions\":%u,\"errors\":%u,\"rss_before_kb\":%lu"
+			",\"rss_after_kb\":%lu,\"per_session_bytes\":%lu}\n",
+			transport_name(transport), opened, opts.sessions - opened, before, after,
+			(opened && after > before ? ((after - before) * 1024) / opened : 0));
+	fflush(stdout);
+}
+
+static void* subscriber_thread(void* arg) {
+	enum bench_transport transport = *(enum bench_transport*)arg;
+	struct nc_session* session = NULL;
+	nc_rpc* rpc;
+	nc_ntf* ntf;
+	NC_MSG_TYPE type;
+	int subscribed = 0;
+
+	if (transport_init(transport) == EXIT_SUCCESS && (session = bench_connect(transport)) != NULL) {
+		rpc = nc_rpc_subscribe("NETCONF", NULL, NULL, NULL);
+		subscribed = bench_rpc(session, rpc, &type);
+		nc_rpc_free(rpc);
+	}
+	if (!subscribed) {
+		__sync_fetch_and_add(&fanout.failed, 1);
+		goto cleanup;
+	}
+	__sync_fetch_and_add(&fanout.ready, 1);
+
+	while (!fanout.stop) {
+		ntf = NULL;
+		type = nc_session_recv_notif(session, 100, &ntf);
+		if (type == NC_MSG_NOTIFICATION) {
+			__sync_fetch_and_add(&fanout.delivered, 1);
+			fanout.last_usec = now_usec();
+		} else if (type == NC_MSG_UNKNOWN) {
+			break;
+		}
+		if (ntf != NULL) {
+			ncntf_notif_free(ntf);
+		}
+	}
+
+cleanup:
+	if (session != NULL) {
+		nc_session_free(session);
+	}
+	transport_destroy(transport);
+	return NULL;
+}
+
+static void bench_notif_fanout(void) {
+	enum bench_transport transport;
+	struct nc_session* session;
+	pthread_t* tids;
+	nc_rpc* rpc;
+	NC_MSG_TYPE type;
+	char config[sizeof(EDIT_CONFIG) + 16];
+	uint64_t start, deadline, events = 0, expected;
+	unsigned int i;
+	int ret;
+
+	if (rpc_transport(&transport) || transport_init(transport)) {
+		print_skipped("notif-fanout", "no usable transport");
+		return;
+	}
+	if ((tids = calloc(opts.subscribers, sizeof(pthread_t))) == NULL) {
+		fprintf(stderr, "Memory allocation failed (%s:%d).\n", __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(&fanout, 0, sizeof(fanout));
+	for (i = 0; i < opts.subscribers; ++i) {
+		if ((ret = pthread_create(&tids[i], NULL, subscriber_thread, &transport)) != 0) {
+			fprintf(stderr, "Failed to create a thread (%s).\n", strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+	}
+	while (fanout.ready + fanout.failed < opts.subscribers) {
+		usleep(10000);
+	}
+
+	/* every edit of the running datastore is a netconf-config-change notification for every subscriber */
+	start = now_usec();
+	if ((session = bench_connect(transport)) != NULL) {
+		deadline = start + opts.duration * 1000000ULL;
+		for (i = 0; now_usec() < deadline; ++i) {
+			snprintf(config, sizeof(config), EDIT_CONFIG, 600 + (i & 1));
+			rpc = nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET, config);
+			ret = bench_rpc(session, rpc, &type);
+			nc_rpc_free(rpc);
+			if (ret) {
+				++events;
+			} else if (type == NC_MSG_UNKNOWN) {
+				break;
+			}
+		}
+		nc_session_free(session);
+	}
+
+	expected = events * fanout.ready;
+	deadline = now_usec() + NOTIF_GRACE * 1000000ULL;
+	while (fanout.delivered < expected && now_usec() < deadline) {
+		usleep(10000);
+	}
+	fanout.stop = 1;
+	for (i = 0; i < opts.subscribers; ++i) {
+		pthread_join(tids[i], NULL);
+	}
+	free(tids);
+	transport_destroy(transport);
+
+	printf("{\"scenario\":\"notif-fanout\",\"transport\":\"%s\",\"subscribers\":%u,\"errors\":%u,\"events\":%" PRIu64
+			",\"delivered\":%" PRIu64 ",\"lost\":%" PRIu64 ",\"rate\":%.1f}\n",
+			transport_name(transport), fanout.ready, fanout.failed, events, fanout.delivered,
+			(expected > fanout.delivered ? expected - fanout.delivered : 0),
+			(fanout.delivered && fanout.last_usec > start ? fanout.delivered / ((fanout.last_usec - start) / 1e6) : 0.0));
+	fflush(stdout);
+}
+
+/* wait until the server accepts the TCP connections */
+static int wait_server(void) {
+	struct addrinfo hints, *res, *ai;
+	char port[8];
+	uint64_t deadline;
+	int sock, ret;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port, sizeof(port), "%u", (transport_unusable(BENCH_SSH_PUBKEY) && transport_unusable(BENCH_SSH_PASSWORD)) ? opts.tls_port : opts.ssh_port);
+	if ((ret = getaddrinfo(opts.host, port, &hints, &res)) != 0) {
+		fprintf(stderr, "Failed to resolve \"%s\" (%s).\n", opts.host, gai_strerror(ret));
+		return EXIT_FAILURE;
+	}
+
+	deadline = now_usec() + opts.wait * 1000000ULL;
+	do {
+		for (ai = res; ai != NULL; ai = ai->ai_next) {
+			if ((sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == -1) {
+				continue;
+			}
+			ret = connect(sock, ai->ai_addr, ai->ai_addrlen);
+			close(sock);
+			if (ret == 0) {
+				freeaddrinfo(res);
+				return EXIT_SUCCESS;
+			}
+		}
+		usleep(100000);
+	} while (now_usec() < deadline);
+
+	freeaddrinfo(res);
+	fprintf(stderr, "The server on \"%s\" port %s does not accept connections.\n", opts.host, port);
+	return EXIT_FAILURE;
+}
+
+static void print_usage(const char* progname) {
+	fprintf(stdout, "Usage: %s [options] [scenario ...]\n\n", progname);
+	fprintf(stdout, " -H host       server host (localhost)\n");
+	fprintf(stdout, " -p port       SSH port (830)\n");
+	fprintf(stdout, " -P port       TLS port (6513)\n");
+	fprintf(stdout, " -u user       SSH username\n");
+	fprintf(stdout, " -w password   SSH password, enables ssh-password\n");
+	fprintf(stdout, " -k path       SSH private key, enables ssh-pubkey\n");
+	fprintf(stdout, " -K path       SSH public key\n");
+	fprintf(stdout, " -c path       TLS client certificate, enables tls\n");
+	fprintf(stdout, " -C path       TLS client key\n");
+	fprintf(stdout, " -a path       TLS trusted CA certificates\n");
+	fprintf(stdout, " -s pid        server process, enables idle-memory\n");
+	fprintf(stdout, " -t threads    concurrent sessions of the rate scenarios (4)\n");
+	fprintf(stdout, " -d secs       duration of every scenario (10)\n");
+	fprintf(stdout, " -n sessions   idle sessions of idle-memory (100)\n");
+	fprintf(stdout, " -m sessions   subscribers of notif-fanout (16)\n");
+	fprintf(stdout, " -W secs       wait for the server to start listening\n\n");
+	fprintf(stdout, "Scenarios: ssh-password ssh-pubkey tls idle-memory get-config edit-config notif-fanout (all)\n");
+	fprintf(stdout, "Every result is printed as a JSON object on a separate line.\n");
+}
+
+int main(int argc, char** argv) {
+	const char* all[] = {"ssh-password", "ssh-pubkey", "tls", "idle-memory", "get-config", "edit-config", "notif-fanout"};
+	const char** scenarios;
+	int opt, count, i, ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "H:p:P:u:w:k:K:c:C:a:s:t:d:n:m:W:h")) != -1) {
+		switch (opt) {
+		case 'H':
+			opts.host = optarg;
+			break;
+		case 'p':
+			opts.ssh_port = atoi(optarg);
+			break;
+		case 'P':
+			opts.tls_port = atoi(optarg);
+			break;
+		case 'u':
+			opts.user = optarg;
+			break;
+		case 'w':
+			opts.password = optarg;
+			break;
+		case 'k':
+			opts.privkey = optarg;
+			break;
+		case 'K':
+			opts.pubkey = optarg;
+			break;
+		case 'c':
+			opts.cert = optarg;
+			break;
+		case 'C':
+			opts.key = optarg;
+			break;
+		case 'a':
+			opts.ca = optarg;
+			break;
+		case 's':
+			opts.server_pid = atoi(optarg);
+			break;
+		case 't':
+			opts.threads = atoi(optarg);
+			break;
+		case 'd':
+			opts.duration = atoi(optarg);
+			break;
+		case 'n':
+			opts.sessions = atoi(optarg);
+			break;
+		case 'm':
+			opts.subscribers = atoi(optarg);
+			break;
+		case 'W':
+			opts.wait = atoi(optarg);
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (opts.threads == 0 || opts.duration == 0) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (optind < argc) {
+		scenarios = (const char**)&argv[optind];
+		count = argc - optind;
+	} else {
+		scenarios = all;
+		count = sizeof(all) / sizeof(all[0]);
+	}
+
+	nc_init(NC_INIT_CLIENT | NC_INIT_LIBSSH_PTHREAD);
+	nc_verbosity(NC_VERB_ERROR);
+	nc_callback_print(clb_print);
+#ifdef NP_SSH
+	nc_callback_sshauth_password(clb_password);
+	nc_callback_ssh_host_authenticity_check(clb_hostkey);
+#endif
+	cpblts = nc_session_get_cpblts_default();
+
+	if (opts.wait && wait_server()) {
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (strcmp(scenarios[i], "ssh-password") == 0) {
+			bench_handshake(BENCH_SSH_PASSWORD);
+		} else if (strcmp(scenarios[i], "ssh-pubkey") == 0) {
+			bench_handshake(BENCH_SSH_PUBKEY);
+		} else if (strcmp(scenarios[i], "tls") == 0) {
+			bench_handshake(BENCH_TLS);
+		} else if (strcmp(scenarios[i], "idle-memory") == 0) {
+			bench_idle_memory();
+		} else if (strcmp(scenarios[i], "get-config") == 0) {
+			bench_rpcs("get-config", WORK_GET_CONFIG);
+		} else if (strcmp(scenarios[i], "edit-config") == 0) {
+			bench_rpcs("edit-config", WORK_EDIT_CONFIG);
+		} else if (strcmp(scenarios[i], "notif-fanout") == 0) {
+			bench_notif_fanout();
+		} else {
+			fprintf(stderr, "Unknown scenario \"%s\".\n", scenarios[i]);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+cleanup:
+	nc_cpblts_free(cpblts);
+	nc_close();
+	return ret;
+}
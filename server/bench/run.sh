@@ -0,0 +1,153 @@
+#!/bin/sh
+#
+# Start a throwaway netopeer-server instance with its own configuration
+# and datastores and run the np-bench scenarios against it. The results
+# are printed to stdout, one JSON object per scenario. Run by "make bench"
+# from the server build directory, as root like the server itself.
+#
+# usage: bench/run.sh <netopeer-server> <np-bench> [scenario ...]
+#
+# BENCH_PORT, BENCH_TLS_PORT  ports the instance listens on (8300, 8301)
+# BENCH_USER                  local account the sessions are opened as (the current user)
+# BENCH_PASSWORD              its password, ssh-password is skipped without it
+# BENCH_TLS                   "yes" if the server was built with TLS
+# BENCH_THREADS, BENCH_DURATION, BENCH_SESSIONS, BENCH_SUBSCRIBERS
+#                             passed to np-bench, see "np-bench -h"
+#
+# edit-config and notif-fanout need the NACM write access of BENCH_USER
+# to /netopeer/hello-timeout, unless it is root.
+#
+
+set -e
+
+if [ $# -lt 2 ]; then
+	echo "usage: $0 <netopeer-server> <np-bench> [scenario ...]" >&2
+	exit 1
+fi
+SERVER=$1
+BENCH=$2
+shift 2
+
+SRCDIR=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${BENCH_PORT:-8300}
+TLS_PORT=${BENCH_TLS_PORT:-8301}
+USER_NAME=${BENCH_USER:-$(id -un)}
+TMP=$(mktemp -d /tmp/netopeer-bench.XXXXXX)
+SERVER_PID=
+
+cleanup() {
+	if [ -n "$SERVER_PID" ]; then
+		kill "$SERVER_PID" 2>/dev/null || true
+		wait "$SERVER_PID" 2>/dev/null || true
+	fi
+	rm -rf "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+# the certificate or key body without the PEM armor, as the datastore stores it
+pem_body() {
+	sed -e '/^-----/d' "$1"
+}
+
+mkdir "$TMP/modules"
+ssh-keygen -q -t rsa -b 2048 -N "" -f "$TMP/host_rsa"
+ssh-keygen -q -t rsa -b 2048 -N "" -f "$TMP/client_rsa"
+
+# the models from the build directory, the datastores from the temporary one
+for module in Netopeer NETCONF-server; do
+	sed -e "s|<path>.*/\([^/]*\.yin\)</path>|<path>$SRCDIR/config/\1</path>|" \
+	    -e "s|<path>.*/\(datastore[^/]*\.xml\)</path>|<path>$TMP/\1</path>|" \
+	    "$SRCDIR/config/$module.xml" > "$TMP/modules/$module.xml"
+done
+
+TLS_CONFIG=
+TLS_LISTEN=
+if [ "$BENCH_TLS" = "yes" ]; then
+	FINGERPRINT=$(openssl x509 -noout -fingerprint -sha1 -in "$SRCDIR/certs/client.crt" | sed -e 's/.*=/02:/')
+	TLS_CONFIG="<tls>
+				<server-cert>$(pem_body "$SRCDIR/certs/server.crt")</server-cert>
+				<server-key>
+					<key-data>$(pem_body "$SRCDIR/certs/server.key")</key-data>
+					<key-type>RSA</key-type>
+				</server-key>
+				<trusted-ca-certs>
+					<trusted-ca-cert>$(pem_body "$SRCDIR/certs/ca.pem")</trusted-ca-cert>
+				</trusted-ca-certs>
+				<cert-maps>
+					<cert-to-name>
+						<id>1</id>
+						<fingerprint>$FINGERPRINT</fingerprint>
+						<map-type>x509c2n:specified</map-type>
+						<name>$USER_NAME</name>
+					</cert-to-name>
+				</cert-maps>
+			</tls>"
+	TLS_LISTEN="<tls>
+				<listen>
+					<interface>
+						<address>127.0.0.1</address>
+						<port>$TLS_PORT</port>
+					</interface>
+				</listen>
+			</tls>"
+fi
+
+NETOPEER_CONFIG="<netopeer xmlns=\"urn:cesnet:tmc:netopeer:1.0\" xmlns:x509c2n=\"urn:ietf:params:xml:ns:yang:ietf-x509-cert-to-name\">
+			<max-sessions>0</max-sessions>
+			<ssh>
+				<server-keys>
+					<rsa-key>$TMP/host_rsa</rsa-key>
+				</server-keys>
+				<client-auth-keys>
+					<client-auth-key>
+						<path>$TMP/client_rsa.pub</path>
+						<username>$USER_NAME</username>
+					</client-auth-key>
+				</client-auth-keys>
+				<password-auth-enabled>true</password-auth-enabled>
+			</ssh>
+			$TLS_CONFIG
+		</netopeer>"
+
+SERVER_CONFIG="<netconf xmlns=\"urn:ietf:params:xml:ns:yang:ietf-netconf-server\">
+			<ssh>
+				<listen>
+					<interface>
+						<address>127.0.0.1</address>
+						<port>$PORT</port>
+					</interface>
+				</listen>
+			</ssh>
+			$TLS_LISTEN
+		</netconf>"
+
+# the same configuration in running and startup, the instance may or may not copy startup
+for ds in "datastore.xml:$NETOPEER_CONFIG" "datastore-server.xml:$SERVER_CONFIG"; do
+	cat > "$TMP/${ds%%:*}" <<EOF
+<?xml version="1.0"?>
+<datastores xmlns="urn:cesnet:tmc:datastores:file">
+	<running lock="" locktime="">
+		${ds#*:}
+	</running>
+	<startup lock="">
+		${ds#*:}
+	</startup>
+	<candidate lock="" modified="false"/>
+</datastores>
+EOF
+done
+
+NETOPEER_MODULES_DIR="$TMP/modules" "$SERVER" -v 0 &
+SERVER_PID=$!
+
+set -- -H 127.0.0.1 -p "$PORT" -P "$TLS_PORT" -u "$USER_NAME" -s "$SERVER_PID" -W 30 \
+	-k "$TMP/client_rsa" -K "$TMP/client_rsa.pub" \
+	${BENCH_PASSWORD:+-w "$BENCH_PASSWORD"} \
+	${BENCH_THREADS:+-t "$BENCH_THREADS"} ${BENCH_DURATION:+-d "$BENCH_DURATION"} \
+	${BENCH_SESSIONS:+-n "$BENCH_SESSIONS"} ${BENCH_SUBSCRIBERS:+-m "$BENCH_SUBSCRIBERS"} \
+	"$@"
+if [ "$BENCH_TLS" = "yes" ]; then
+	set -- -c "$SRCDIR/certs/client.crt" -C "$SRCDIR/certs/client.key" -a "$SRCDIR/certs/ca.pem" "$@"
+fi
+
+"$BENCH" "$@"
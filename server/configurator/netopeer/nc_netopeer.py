@@ -98,7 +98,7 @@ class nc_netopeer(ncmodule.ncmodule):
 					elif len(xpath_repo_type) != 1:
 						messages.append('Module {s} is not valid, there are multiple repo types specified'.format(s=module_name), 'warning')
 						continue
-					elif xpath_repo_type[0].get_content() == 'file':
+					elif xpath_repo_type[0].get_content() in ('file', 'journal'):
 						xpath_repo_path = module_ctxt.xpathEval('/device/repo/path')
 						if not xpath_repo_path:
 							messages.append('Module {s} is not valid, repo path is not specified'.format(s=module_name), 'warning')
@@ -107,7 +107,7 @@ class nc_netopeer(ncmodule.ncmodule):
 							messages.append('Module {s} is not valid, there are multiple repo paths specified'.format(s=module_name), 'warning')
 							continue
 						# it is not necessary to test that the datastore exists
-						if module_name == 'Netopeer':
+						if module_name == 'Netopeer' and xpath_repo_type[0].get_content() == 'file':
 							self.netopeer_path = xpath_repo_path[0].get_content()
 
 					xpath_augmentyin = module_ctxt.xpathEval('/device/data-models/model/path')
@@ -44,21 +44,41 @@
  */
 
 #define _GNU_SOURCE
+#include <inttypes.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <libxml/tree.h>
 #include <libnetconf_xml.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "server.h"
+#include "hash.h"
+#include "stats.h"
+#include "registry.h"
+#include "notif.h"
+#include "pool.h"
+#include "reactor.h"
+#include "statecache.h"
+#include "snapshot.h"
+#include "logging.h"
+#include "journal.h"
+#include "memacct.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
 extern int quit, restart_soft, restart_hard;
 extern int server_start;
 
+/* set during the server start, the enabled modules are then initialized all at once */
+static int module_batch = 0;
+
 /* transAPI version which must be compatible with libnetconf */
 /* int transapi_version = 6; */
 
@@ -80,6 +100,10 @@ Feel free to use it to distinguish module behavior for different error-option va
 NC_EDIT_ERROPT_TYPE netopeer_erropt = NC_EDIT_ERROPT_NOTSET;
 
 struct np_options netopeer_options = {
+	.conn_limit = {.rate = 0, .burst = 10},
+	.auth_limit = {.rate = 0, .burst = 5},
+	.rpc_limit = {.rate = 0, .burst = 32},
+	.config_snapshot_ttl = 1000,
 	.binds_lock = PTHREAD_MUTEX_INITIALIZER
 };
 
@@ -102,6 +126,89 @@ void module_free(struct np_module* module) {
 	}
 }
 
+/*
+ * The augment models stay in libnetconf until nc_close(), even when the
+ * modules using them are disabled. Remember the ones added so that
+ * reloading or restarting the modules does not compile them again
+ * unless their content changed.
+ */
+struct model_cache_entry {
+	char* path;
+	uint64_t hash;
+	struct model_cache_entry* next;
+};
+
+static struct model_cache_entry* model_cache = NULL;
+
+/* FNV-1a of the file content, 0 on error */
+static uint64_t model_hash(const char* path) {
+	uint64_t hash;
+	const unsigned char* data;
+	struct stat st;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		return 0;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return 0;
+	}
+
+	hash = np_hash64(NP_HASH64_INIT, data, st.st_size);
+	munmap((void*)data, st.st_size);
+
+	return hash;
+}
+
+static void augment_model_add(const char* path) {
+	struct model_cache_entry* entry;
+	uint64_t hash;
+
+	hash = model_hash(path);
+	for (entry = model_cache; entry != NULL; entry = entry->next) {
+		if (strcmp(entry->path, path) == 0) {
+			break;
+		}
+	}
+
+	if (entry != NULL && hash != 0 && entry->hash == hash) {
+		nc_verb_verbose("Augment model \"%s\" unchanged, already added", path);
+		return;
+	}
+
+	nc_verb_verbose("Adding augment model \"%s\"", path);
+	if (ncds_add_model(path) != 0) {
+		return;
+	}
+
+	if (entry == NULL) {
+		if ((entry = malloc(sizeof(struct model_cache_entry))) == NULL) {
+			return;
+		}
+		entry->path = strdup(path);
+		entry->next = model_cache;
+		model_cache = entry;
+	}
+	entry->hash = hash;
+}
+
+void model_cache_cleanup(void) {
+	struct model_cache_entry* entry;
+
+	while (model_cache != NULL) {
+		entry = model_cache;
+		model_cache = entry->next;
+		free(entry->path);
+		free(entry);
+	}
+}
+
 /*
  * if repo_type is -1, then we are working with augment models specifications
  */
@@ -136,8 +243,7 @@ static int parse_model_cfg(struct np_module* module, xmlNodePtr node, NCDS_TYPE
 			ncds_add_augment_transapi(model_path, transapi_path);
 		} else if (repo_type == -1) {
 			/* augment model */
-			nc_verb_verbose("Adding augment model \"%s\"", model_path);
-			ncds_add_model(model_path);
+			augment_model_add(model_path);
 		} else {
 			nc_verb_verbose("Adding static transapi \"%s\"", model_path);
 			if ((module->ds = ncds_new_transapi_static(repo_type, model_path, st)) == NULL) {
@@ -163,8 +269,7 @@ static int parse_model_cfg(struct np_module* module, xmlNodePtr node, NCDS_TYPE
 	} else if (model_path) {
 		if (repo_type == -1) {
 			/* augment model */
-			nc_verb_verbose("Adding augment model \"%s\"", model_path);
-			ncds_add_model(model_path);
+			augment_model_add(model_path);
 		} else {
 			/* base model for datastore */
 			nc_verb_verbose("Adding base model \"%s\"", model_path);
@@ -214,18 +319,36 @@ static int parse_model_cfg(struct np_module* module, xmlNodePtr node, NCDS_TYPE
 	return (EXIT_SUCCESS);
 }
 
-int module_enable(struct np_module* module, int add) {
-	char *config_path = NULL, *repo_path = NULL, *repo_type_str = NULL;
-	int repo_type = -1, main_model_count;
+/* a separate server instance can use its own modules and datastores, see bench/run.sh */
+static const char* modules_cfg_dir(void) {
+	const char* dir;
+
+	if ((dir = getenv(ENVIRONMENT_MODULES_DIR)) != NULL && dir[0] != '\0') {
+		return dir;
+	}
+	return MODULES_CFG_DIR;
+}
+
+/* read the module configuration and create its datastore, without initializing the device */
+static int module_load(struct np_module* module) {
+	char *config_path = NULL, *repo_path = NULL, *repo_type_str = NULL, *sync_delay_str;
+	int repo_type = -1, main_model_count, journal = 0;
+	unsigned int sync_delay = 0;
 	xmlDocPtr module_config;
 	xmlNodePtr node;
 	xmlXPathContextPtr xpath_ctxt;
 	xmlXPathObjectPtr xpath_obj;
+	struct stat st;
 
-	if (asprintf(&config_path, "%s/%s.xml", MODULES_CFG_DIR, module->name) == -1) {
+	if (asprintf(&config_path, "%s/%s.xml", modules_cfg_dir(), module->name) == -1) {
 		nc_verb_error("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 		return(EXIT_FAILURE);
 	}
+	/* remember the version of the configuration, a reload can then skip unchanged modules */
+	if (stat(config_path, &st) == 0) {
+		module->cfg_mtime = st.st_mtim;
+		module->cfg_ino = st.st_ino;
+	}
 	if ((module_config = xmlReadFile(config_path, NULL, XML_PARSE_NOBLANKS|XML_PARSE_NSCLEAN|XML_PARSE_NOWARNING|XML_PARSE_NOERROR)) == NULL) {
 		nc_verb_error("Reading configuration for %s module failed", module->name);
 		free(config_path);
@@ -256,6 +379,10 @@ int module_enable(struct np_module* module, int add) {
 			repo_type_str = (char*)xmlNodeGetContent(node);
 		} else if (xmlStrcmp(node->name, BAD_CAST "path") == 0) {
 			repo_path = (char*)xmlNodeGetContent(node);
+		} else if (xmlStrcmp(node->name, BAD_CAST "sync-delay") == 0) {
+			sync_delay_str = (char*)xmlNodeGetContent(node);
+			sync_delay = strtoul(sync_delay_str, NULL, 10);
+			free(sync_delay_str);
 		}
 	}
 	if (repo_type_str == NULL) {
@@ -266,6 +393,10 @@ int module_enable(struct np_module* module, int add) {
 		repo_type = NCDS_TYPE_EMPTY;
 	} else if (strcmp(repo_type_str, "file") == 0) {
 		repo_type = NCDS_TYPE_FILE;
+	} else if (strcmp(repo_type_str, "journal") == 0) {
+		/* in memory, the changes are journaled into the files */
+		repo_type = NCDS_TYPE_CUSTOM;
+		journal = 1;
 	} else {
 		nc_verb_warning("Unknown repo type \'%s\' in %s transAPI module configuration", repo_type_str, module->name);
 		nc_verb_warning("Continuing with \'empty\' datastore type.");
@@ -273,8 +404,8 @@ int module_enable(struct np_module* module, int add) {
 	}
 	free(repo_type_str);
 
-	if (repo_type == NCDS_TYPE_FILE && repo_path == NULL) {
-		nc_verb_error("Missing path for \'file\' datastore type in %s transAPI module configuration.", module->name);
+	if ((repo_type == NCDS_TYPE_FILE || journal) && repo_path == NULL) {
+		nc_verb_error("Missing path for \'%s\' datastore type in %s transAPI module configuration.", journal ? "journal" : "file", module->name);
 		xmlXPathFreeObject(xpath_obj);
 		goto err_cleanup;
 	}
@@ -318,6 +449,11 @@ int module_enable(struct np_module* module, int add) {
 			nc_verb_verbose("Unable to set path to datastore of the \'%s\' transAPI module.", module->name);
 			goto err_cleanup;
 		}
+	} else if (journal) {
+		if (np_journal_set(module->ds, repo_path, sync_delay)) {
+			nc_verb_verbose("Unable to set the journal of the datastore of the \'%s\' transAPI module.", module->name);
+			goto err_cleanup;
+		}
 	}
 	free(repo_path);
 	repo_path = NULL;
@@ -329,6 +465,69 @@ int module_enable(struct np_module* module, int add) {
 	xmlXPathFreeContext(xpath_ctxt);
 	xmlFreeDoc(module_config);
 
+	return (EXIT_SUCCESS);
+
+err_cleanup:
+
+	xmlXPathFreeContext(xpath_ctxt);
+	xmlFreeDoc(module_config);
+
+	ncds_free(module->ds);
+	module->ds = NULL;
+
+	free(repo_path);
+
+	return (EXIT_FAILURE);
+}
+
+static int module_device_init(struct np_module* module) {
+	if (ncds_device_init(&(module->id), NULL, 1) != 0) {
+		nc_verb_error("Device initialization of module %s failed.", module->name);
+		ncds_free(module->ds);
+		module->ds = NULL;
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void module_link(struct np_module* module) {
+	if (netopeer_options.modules) {
+		netopeer_options.modules->prev = module;
+	}
+	module->prev = NULL;
+	module->next = netopeer_options.modules;
+	netopeer_options.modules = module;
+}
+
+static void module_unlink(struct np_module* module) {
+	if (module->next) {
+		module->next->prev = module->prev;
+	}
+	if (module->prev) {
+		module->prev->next = module->next;
+	}
+	if (netopeer_options.modules == module) {
+		netopeer_options.modules = module->next;
+	}
+}
+
+int module_enable(struct np_module* module, int add) {
+	uint64_t start;
+
+	start = np_clock_ms();
+	if (module_load(module)) {
+		return (EXIT_FAILURE);
+	}
+	module->load_ms = np_clock_ms() - start;
+
+	if (add && module_batch) {
+		/* consolidated and initialized together with the others in module_batch_end() */
+		module->pending = 1;
+		module_link(module);
+		return (EXIT_SUCCESS);
+	}
+
 	if (ncds_consolidate() != 0) {
 		nc_verb_warning("%s: consolidating libnetconf datastores failed for module %s.", __func__, module->name);
 		return (EXIT_FAILURE);
@@ -338,34 +537,17 @@ int module_enable(struct np_module* module, int add) {
 	if (server_start) {
 		ncds_break_locks(NULL);
 	}
-	if (ncds_device_init(&(module->id), NULL, 1) != 0) {
-		nc_verb_error("Device initialization of module %s failed.", module->name);
-		ncds_free(module->ds);
-		module->ds = NULL;
+	start = np_clock_ms();
+	if (module_device_init(module)) {
 		return (EXIT_FAILURE);
 	}
+	module->init_ms = np_clock_ms() - start;
 
 	if (add) {
-		if (netopeer_options.modules) {
-			netopeer_options.modules->prev = module;
-		}
-		module->next = netopeer_options.modules;
-		netopeer_options.modules = module;
+		module_link(module);
 	}
 
 	return (EXIT_SUCCESS);
-
-err_cleanup:
-
-	xmlXPathFreeContext(xpath_ctxt);
-	xmlFreeDoc(module_config);
-
-	ncds_free(module->ds);
-	module->ds = NULL;
-
-	free(repo_path);
-
-	return (EXIT_FAILURE);
 }
 
 int module_disable(struct np_module* module, int destroy) {
@@ -377,19 +559,147 @@ int module_disable(struct np_module* module, int destroy) {
 	}
 
 	if (destroy) {
-		if (module->next) {
-			module->next->prev = module->prev;
+		module_unlink(module);
+		module_free(module);
+	}
+	return(EXIT_SUCCESS);
+}
+
+void module_batch_begin(void) {
+	module_batch = 1;
+}
+
+/* the modules initialized by one thread, shared by all the initializing threads */
+struct module_init_job {
+	struct np_module** modules;
+	unsigned int count;
+	unsigned int next;
+};
+
+static void* module_init_thread(void* arg) {
+	struct module_init_job* job = (struct module_init_job*)arg;
+	struct np_module* module;
+	unsigned int i;
+	uint64_t start;
+
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count) {
+		module = job->modules[i];
+
+		start = np_clock_ms();
+		if (module_device_init(module) == EXIT_SUCCESS) {
+			module->init_ms = np_clock_ms() - start;
 		}
-		if (module->prev) {
-			module->prev->next = module->next;
+	}
+
+	return NULL;
+}
+
+int module_batch_end(void) {
+	struct module_init_job job;
+	struct np_module* module;
+	pthread_t tids[MODULE_INIT_THREADS];
+	unsigned int i, thread_count;
+	uint64_t start;
+	int ret = EXIT_SUCCESS;
+
+	module_batch = 0;
+
+	memset(&job, 0, sizeof(struct module_init_job));
+	for (module = netopeer_options.modules; module != NULL; module = module->next) {
+		if (module->pending) {
+			++job.count;
 		}
-		if (netopeer_options.modules == module) {
-			netopeer_options.modules = module->next;
+	}
+	if (job.count == 0) {
+		return EXIT_SUCCESS;
+	}
+	if ((job.modules = malloc(job.count * sizeof(struct np_module*))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	for (i = 0, module = netopeer_options.modules; module != NULL; module = module->next) {
+		if (module->pending) {
+			job.modules[i++] = module;
+			module->pending = 0;
 		}
+	}
 
-		module_free(module);
+	start = np_clock_ms();
+
+	/* one consolidation for all the modules loaded */
+	if (ncds_consolidate() != 0) {
+		nc_verb_warning("%s: consolidating libnetconf datastores failed.", __func__);
+		for (i = 0; i < job.count; ++i) {
+			module_disable(job.modules[i], 1);
+		}
+		free(job.modules);
+		return EXIT_FAILURE;
 	}
-	return(EXIT_SUCCESS);
+
+	/* remove datastore locks if any kept */
+	if (server_start) {
+		ncds_break_locks(NULL);
+	}
+
+	/* the datastores are independent, this thread initializes some of them, too */
+	thread_count = (job.count < MODULE_INIT_THREADS ? job.count : MODULE_INIT_THREADS) - 1;
+	for (i = 0; i < thread_count; ++i) {
+		if (pthread_create(&tids[i], NULL, module_init_thread, &job) != 0) {
+			nc_verb_warning("%s: failed to create a thread, initializing the modules with %u threads.", __func__, i + 1);
+			thread_count = i;
+			break;
+		}
+	}
+	module_init_thread(&job);
+	for (i = 0; i < thread_count; ++i) {
+		pthread_join(tids[i], NULL);
+	}
+
+	for (i = 0; i < job.count; ++i) {
+		module = job.modules[i];
+		if (module->ds == NULL) {
+			/* the datastore was already freed */
+			nc_verb_error("Starting module %s failed, it is disabled.", module->name);
+			module_unlink(module);
+			module_free(module);
+			ret = EXIT_FAILURE;
+		} else {
+			nc_verb_verbose("Module %s loaded in %" PRIu32 " ms and initialized in %" PRIu32 " ms.", module->name, module->load_ms, module->init_ms);
+		}
+	}
+	nc_verb_verbose("%u modules initialized in %" PRIu64 " ms by %u threads.", job.count, np_clock_ms() - start, thread_count + 1);
+
+	free(job.modules);
+	return ret;
+}
+
+int module_reload(struct np_module* module) {
+	if (module_disable(module, 0) || module_enable(module, 0)) {
+		nc_verb_error("Reloading module %s failed.", module->name);
+		return EXIT_FAILURE;
+	}
+
+	nc_verb_verbose("Module %s reloaded.", module->name);
+	return EXIT_SUCCESS;
+}
+
+int module_changed(const struct np_module* module) {
+	char* config_path;
+	struct stat st;
+	int ret;
+
+	if (asprintf(&config_path, "%s/%s.xml", modules_cfg_dir(), module->name) == -1) {
+		nc_verb_error("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return 1;
+	}
+	ret = stat(config_path, &st);
+	free(config_path);
+
+	if (ret != 0 || st.st_ino != module->cfg_ino || st.st_mtim.tv_sec != module->cfg_mtime.tv_sec
+			|| st.st_mtim.tv_nsec != module->cfg_mtime.tv_nsec) {
+		return 1;
+	}
+	return 0;
 }
 
 /**
@@ -400,9 +710,145 @@ int module_disable(struct np_module* module, int destroy) {
  * @param[out] err  Double pointer to error structure. Fill error when some occurs.
  * @return State data as libxml2 xmlDocPtr or NULL in case of error.
  */
+static void state_add_uint(xmlNodePtr parent, const char* name, uint64_t value) {
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), "%" PRIu64, value);
+	xmlNewChild(parent, parent->ns, BAD_CAST name, BAD_CAST buf);
+}
+
+static void state_add_rate(xmlNodePtr parent, const char* name, double value) {
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%.2f", value);
+	xmlNewChild(parent, parent->ns, BAD_CAST name, BAD_CAST buf);
+}
+
 xmlDocPtr netopeer_get_state_data (xmlDocPtr UNUSED(model), xmlDocPtr UNUSED(running), struct nc_err** UNUSED(err)) {
-	/* no state data */
-	return(NULL);
+	xmlDocPtr state_doc;
+	xmlNodePtr state_root, container, node;
+	xmlNsPtr ns;
+	struct np_stat_rpc rpc;
+	struct np_pool_stat pool;
+	struct np_memacct_usage* usage;
+	const char* op, *name;
+	unsigned int i, subscribers, queued, max_queued, count;
+	uint64_t bytes_in, bytes_out, total;
+#ifdef NP_SSH
+	uint64_t sessions;
+#endif
+
+	state_doc = xmlNewDoc(BAD_CAST "1.0");
+	state_root = xmlNewNode(NULL, BAD_CAST "netopeer-state");
+	xmlDocSetRootElement(state_doc, state_root);
+	ns = xmlNewNs(state_root, BAD_CAST "urn:cesnet:tmc:netopeer:1.0", NULL);
+	xmlSetNs(state_root, ns);
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "sessions", NULL);
+#ifdef NP_SSH
+	state_add_uint(container, "ssh", np_session_count(NC_TRANSPORT_SSH));
+#endif
+#ifdef NP_TLS
+	state_add_uint(container, "tls", np_session_count(NC_TRANSPORT_TLS));
+	state_add_uint(container, "tls-kernel-offload", np_tls_ktls_count());
+#endif
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "connections", NULL);
+	state_add_uint(container, "accepted", np_stat_get(NP_STAT_ACCEPTS));
+	state_add_rate(container, "rate", np_stat_rate(NP_STAT_ACCEPTS));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "handshakes", NULL);
+	state_add_uint(container, "finished", np_stat_get(NP_STAT_HANDSHAKES));
+	state_add_uint(container, "failed", np_stat_get(NP_STAT_HANDSHAKE_FAILURES));
+	state_add_uint(container, "timed-out", np_stat_get(NP_STAT_HANDSHAKE_TIMEOUTS));
+	state_add_rate(container, "rate", np_stat_rate(NP_STAT_HANDSHAKES));
+#ifdef NP_TLS
+	state_add_uint(container, "tls-full", np_stat_get(NP_STAT_TLS_FULL_HANDSHAKES));
+	state_add_uint(container, "tls-resumed", np_stat_get(NP_STAT_TLS_RESUMED_HANDSHAKES));
+#endif
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "authentication", NULL);
+	state_add_uint(container, "failures", np_stat_get(NP_STAT_AUTH_FAILURES));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "rpcs", NULL);
+	for (i = 0; (op = np_stat_rpc_get(i, &rpc)) != NULL; ++i) {
+		if (rpc.count == 0) {
+			continue;
+		}
+		node = xmlNewChild(container, container->ns, BAD_CAST "rpc", NULL);
+		xmlNewChild(node, node->ns, BAD_CAST "operation", BAD_CAST op);
+		state_add_uint(node, "count", rpc.count);
+		node = xmlNewChild(node, node->ns, BAD_CAST "latency", NULL);
+		state_add_uint(node, "p50", rpc.p50);
+		state_add_uint(node, "p99", rpc.p99);
+		state_add_uint(node, "max", rpc.max);
+	}
+
+	np_stats_traffic(&bytes_in, &bytes_out);
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "traffic", NULL);
+	state_add_uint(container, "bytes-in", bytes_in);
+	state_add_uint(container, "bytes-out", bytes_out);
+
+	np_notif_stats(&subscribers, &queued, &max_queued);
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "notifications", NULL);
+	state_add_uint(container, "subscribers", subscribers);
+	state_add_uint(container, "queued", queued);
+	state_add_uint(container, "max-queued", max_queued);
+	state_add_uint(container, "dropped", np_stat_get(NP_STAT_NOTIF_DROPPED));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "rate-limits", NULL);
+	state_add_uint(container, "connections", np_stat_get(NP_STAT_LIMITED_CONNECTIONS));
+	state_add_uint(container, "auth-attempts", np_stat_get(NP_STAT_LIMITED_AUTH));
+	state_add_uint(container, "rpcs", np_stat_get(NP_STAT_LIMITED_RPCS));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "state-cache", NULL);
+	state_add_uint(container, "hits", np_stat_get(NP_STAT_STATE_CACHE_HITS));
+	state_add_uint(container, "misses", np_stat_get(NP_STAT_STATE_CACHE_MISSES));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "config-snapshots", NULL);
+	state_add_uint(container, "hits", np_stat_get(NP_STAT_SNAPSHOT_HITS));
+	state_add_uint(container, "misses", np_stat_get(NP_STAT_SNAPSHOT_MISSES));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "nacm-cache", NULL);
+	state_add_uint(container, "hits", np_stat_get(NP_STAT_NACM_CACHE_HITS));
+	state_add_uint(container, "misses", np_stat_get(NP_STAT_NACM_CACHE_MISSES));
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "logging", NULL);
+	state_add_uint(container, "dropped", np_stat_get(NP_STAT_LOG_DROPPED));
+	state_add_uint(container, "suppressed", np_stat_get(NP_STAT_LOG_SUPPRESSED));
+
+#ifdef NP_SSH
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "ssh", NULL);
+	for (i = 0; (op = np_ssh_algo_stat_get(i, &name, &sessions)) != NULL; ++i) {
+		node = xmlNewChild(container, container->ns, BAD_CAST "algorithm", NULL);
+		xmlNewChild(node, node->ns, BAD_CAST "type", BAD_CAST op);
+		xmlNewChild(node, node->ns, BAD_CAST "name", BAD_CAST name);
+		state_add_uint(node, "sessions", sessions);
+	}
+#endif
+
+	container = xmlNewChild(state_root, state_root->ns, BAD_CAST "memory", NULL);
+	for (i = 0; (name = np_pool_stat_get(i, &pool)) != NULL; ++i) {
+		node = xmlNewChild(container, container->ns, BAD_CAST "pool", NULL);
+		xmlNewChild(node, node->ns, BAD_CAST "name", BAD_CAST name);
+		state_add_uint(node, "object-size", pool.size);
+		state_add_uint(node, "in-use", pool.in_use);
+		state_add_uint(node, "reserved", pool.reserved);
+	}
+	usage = np_memacct_usage(&count, &total);
+	state_add_uint(container, "total", total);
+	state_add_uint(container, "denied", np_stat_get(NP_STAT_MEM_DENIED));
+	for (i = 0; i < count; ++i) {
+		node = xmlNewChild(container, container->ns, BAD_CAST "session", NULL);
+		xmlNewChild(node, node->ns, BAD_CAST "id", BAD_CAST usage[i].sid);
+		xmlNewChild(node, node->ns, BAD_CAST "username", BAD_CAST usage[i].user);
+		state_add_uint(node, "replies", usage[i].used[NP_MEM_REPLIES]);
+		state_add_uint(node, "streams", usage[i].used[NP_MEM_STREAMS]);
+		state_add_uint(node, "notifications", usage[i].used[NP_MEM_NOTIFS]);
+	}
+	np_memacct_usage_free(usage, count);
+
+	return state_doc;
 }
 /*
  * Mapping prefixes with namespaces.
@@ -476,6 +922,7 @@ int callback_n_netopeer_n_idle_timeout(void** UNUSED(data), XMLDIFF_OP op, xmlNo
 
 	if (op & XMLDIFF_REM) {
 		netopeer_options.idle_timeout = 3600;
+		np_reactor_kick_all();
 		return EXIT_SUCCESS;
 	}
 
@@ -498,6 +945,8 @@ int callback_n_netopeer_n_idle_timeout(void** UNUSED(data), XMLDIFF_OP op, xmlNo
 	}
 
 	netopeer_options.idle_timeout = num;
+	/* the deadlines of all the clients change */
+	np_reactor_kick_all();
 	return EXIT_SUCCESS;
 }
 
@@ -585,7 +1034,7 @@ int callback_n_netopeer_n_response_time(void** UNUSED(data), XMLDIFF_OP op, xmlN
 }
 
 /**
- * @brief This callback will be run when node in path /n:netopeer/n:modules/n:module/n:module/n:enabled changes
+ * @brief This callback will be run when node in path /n:netopeer/n:worker-threads changes
  *
  * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
  * @param[in] op	Observed change in path. XMLDIFF_OP type.
@@ -595,44 +1044,583 @@ int callback_n_netopeer_n_response_time(void** UNUSED(data), XMLDIFF_OP op, xmlN
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
 /* !DO NOT ALTER FUNCTION SIGNATURE! */
-int callback_n_netopeer_n_modules_n_module_n_enabled(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** UNUSED(error)) {
-	xmlNodePtr tmp, node;
-	char* module_name = NULL, *module_enabled = NULL;
-	struct np_module* module = netopeer_options.modules;
+int callback_n_netopeer_n_worker_threads(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	uint16_t num;
 
-	node = (op & XMLDIFF_REM ? old_node : new_node);
-	if (node == NULL) {
-		return EXIT_FAILURE;
+	if (op & XMLDIFF_REM) {
+		netopeer_options.worker_threads = 4;
+		return EXIT_SUCCESS;
 	}
 
-	for (tmp = node->parent->children; tmp != NULL; tmp = tmp->next) {
-		if (xmlStrEqual(tmp->name, BAD_CAST "name")) {
-			module_name = get_node_content(tmp);
-			break;
-		}
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
 	}
-	module_enabled = get_node_content(node);
 
-	if (module_name == NULL || module_enabled == NULL) {
-		nc_verb_error("%s: missing module \"name\" or \"enabled\" node", __func__);
+	num = strtol(content, &ptr, 10);
+	if (*ptr != '\0' || num == 0) {
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		if (asprintf(&msg, "Could not convert '%s' to a positive number.", content) != -1) {
+			nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "/netopeer/worker-threads");
+			free(msg);
+		}
 		return EXIT_FAILURE;
 	}
 
-	if ((op & (XMLDIFF_REM | XMLDIFF_ADD)) && strcmp(module_enabled, "false") == 0) {
-		/* module is/was not enabled, nothing to enable/disable */
+	netopeer_options.worker_threads = num;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rpc-threads changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rpc_threads(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	uint16_t num;
+
+	if (op & XMLDIFF_REM) {
+		netopeer_options.rpc_threads = 4;
 		return EXIT_SUCCESS;
 	}
 
-	while (module) {
-		if (strcmp(module->name, module_name) == 0) {
-			break;
-		}
-		module = module->next;
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
 	}
 
-	if ((op & XMLDIFF_REM) || ((op & XMLDIFF_MOD) && strcmp(module_enabled, "false") == 0)) {
-		if (module == NULL) {
-			/* it does not exist, so it is disabled */
+	num = strtol(content, &ptr, 10);
+	if (*ptr != '\0' || num == 0) {
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		if (asprintf(&msg, "Could not convert '%s' to a positive number.", content) != -1) {
+			nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "/netopeer/rpc-threads");
+			free(msg);
+		}
+		return EXIT_FAILURE;
+	}
+
+	netopeer_options.rpc_threads = num;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:handshake-timeout changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_handshake_timeout(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	uint16_t num;
+
+	if (op & XMLDIFF_REM) {
+		netopeer_options.handshake_timeout = 10;
+		np_reactor_kick_all();
+		return EXIT_SUCCESS;
+	}
+
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
+	}
+
+	num = strtol(content, &ptr, 10);
+	if (*ptr != '\0' || num == 0) {
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		if (asprintf(&msg, "Could not convert '%s' to a positive number.", content) != -1) {
+			nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "/netopeer/handshake-timeout");
+			free(msg);
+		}
+		return EXIT_FAILURE;
+	}
+
+	netopeer_options.handshake_timeout = num;
+	/* the deadlines of all the clients change */
+	np_reactor_kick_all();
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:acceptor-threads changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_acceptor_threads(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	uint16_t num;
+
+	if (op & XMLDIFF_REM) {
+		num = 1;
+	} else {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+
+		num = strtol(content, &ptr, 10);
+		if (*ptr != '\0' || num == 0) {
+			*error = nc_err_new(NC_ERR_BAD_ELEM);
+			if (asprintf(&msg, "Could not convert '%s' to a positive number.", content) != -1) {
+				nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+				nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "/netopeer/acceptor-threads");
+				free(msg);
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* applied on the next (re)start of the listening threads */
+	netopeer_options.acceptor_threads = num;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:listen-backlog changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_listen_backlog(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	uint16_t num;
+
+	if (op & XMLDIFF_REM) {
+		num = 128;
+	} else {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+
+		num = strtol(content, &ptr, 10);
+		if (*ptr != '\0' || num == 0) {
+			*error = nc_err_new(NC_ERR_BAD_ELEM);
+			if (asprintf(&msg, "Could not convert '%s' to a positive number.", content) != -1) {
+				nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+				nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "/netopeer/listen-backlog");
+				free(msg);
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* BINDS LOCK */
+	pthread_mutex_lock(&netopeer_options.binds_lock);
+
+	if (netopeer_options.listen_backlog != num) {
+		netopeer_options.listen_backlog = num;
+		/* recreate the listening sockets with the new backlog */
+		netopeer_options.binds_change_flag = 1;
+	}
+
+	/* BINDS UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.binds_lock);
+	return EXIT_SUCCESS;
+}
+
+/* common part of the uint32 option callbacks, the values are applied to the next checks */
+static int option_uint32_set(XMLDIFF_OP op, xmlNodePtr new_node, const char* path, uint32_t* value, uint32_t def, int positive, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	unsigned long num;
+
+	if (op & XMLDIFF_REM) {
+		*value = def;
+		return EXIT_SUCCESS;
+	}
+
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
+	}
+
+	num = strtoul(content, &ptr, 10);
+	if (*ptr != '\0' || num > UINT32_MAX || (positive && num == 0)) {
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		if (asprintf(&msg, "Could not convert '%s' to a%s number.", content, (positive ? " positive" : "")) != -1) {
+			nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, path);
+			free(msg);
+		}
+		return EXIT_FAILURE;
+	}
+
+	*value = num;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rate-limits/n:connections/n:rate changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rate_limits_n_connections_n_rate(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return option_uint32_set(op, new_node, "/netopeer/rate-limits/connections/rate", &netopeer_options.conn_limit.rate, 0, 0, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rate-limits/n:connections/n:burst changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rate_limits_n_connections_n_burst(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return option_uint32_set(op, new_node, "/netopeer/rate-limits/connections/burst", &netopeer_options.conn_limit.burst, 10, 1, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rate-limits/n:auth-attempts/n:rate changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rate_limits_n_auth_attempts_n_rate(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return option_uint32_set(op, new_node, "/netopeer/rate-limits/auth-attempts/rate", &netopeer_options.auth_limit.rate, 0, 0, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rate-limits/n:auth-attempts/n:burst changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rate_limits_n_auth_attempts_n_burst(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return option_uint32_set(op, new_node, "/netopeer/rate-limits/auth-attempts/burst", &netopeer_options.auth_limit.burst, 5, 1, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rate-limits/n:rpcs/n:rate changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rate_limits_n_rpcs_n_rate(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return option_uint32_set(op, new_node, "/netopeer/rate-limits/rpcs/rate", &netopeer_options.rpc_limit.rate, 0, 0, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:rate-limits/n:rpcs/n:burst changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_rate_limits_n_rpcs_n_burst(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return option_uint32_set(op, new_node, "/netopeer/rate-limits/rpcs/burst", &netopeer_options.rpc_limit.burst, 32, 1, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:state-cache/n:ttl changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_state_cache_n_ttl(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	if (option_uint32_set(op, new_node, "/netopeer/state-cache/ttl", &netopeer_options.state_cache_ttl, 0, 0, error)) {
+		return EXIT_FAILURE;
+	}
+
+	/* the cached replies may be too old for the new TTL */
+	np_statecache_invalidate();
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:config-snapshots/n:ttl changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_config_snapshots_n_ttl(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	if (option_uint32_set(op, new_node, "/netopeer/config-snapshots/ttl", &netopeer_options.config_snapshot_ttl, 1000, 0, error)) {
+		return EXIT_FAILURE;
+	}
+
+	/* the published snapshots may be too old for the new TTL */
+	np_snapshot_invalidate();
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:call-home/n:parallel-connect changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_call_home_n_parallel_connect(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content;
+
+	if (op & XMLDIFF_REM) {
+		netopeer_options.callhome_parallel = 0;
+		return EXIT_SUCCESS;
+	}
+
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
+	}
+
+	/* read by the call home scheduler at the next connection attempt */
+	netopeer_options.callhome_parallel = (strcmp(content, "true") == 0);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:logging/n:asynchronous changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_logging_n_asynchronous(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content;
+
+	if (op & XMLDIFF_REM) {
+		np_log_async(0);
+		return EXIT_SUCCESS;
+	}
+
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
+	}
+
+	if (np_log_async(strcmp(content, "true") == 0)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Failed to start the logging thread.");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:logging/n:file changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_logging_n_file(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content;
+
+	if (op & XMLDIFF_REM) {
+		np_log_file(NULL);
+		return EXIT_SUCCESS;
+	}
+
+	content = get_node_content(new_node);
+	if (content == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_verb_error("%s: node content missing", __func__);
+		return EXIT_FAILURE;
+	}
+
+	if (np_log_file(content)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Failed to open the log file.");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:memory/n:session-budget changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_memory_n_session_budget(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	if (option_uint32_set(op, new_node, "/netopeer/memory/session-budget", &netopeer_options.mem_session_budget, 0, 0, error)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:memory/n:total-budget changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_memory_n_total_budget(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	if (option_uint32_set(op, new_node, "/netopeer/memory/total-budget", &netopeer_options.mem_total_budget, 0, 0, error)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:memory/n:reply-budget changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_memory_n_reply_budget(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	if (option_uint32_set(op, new_node, "/netopeer/memory/reply-budget", &netopeer_options.mem_reply_budget, 0, 0, error)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:modules/n:module/n:module/n:enabled changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_modules_n_module_n_enabled(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** UNUSED(error)) {
+	xmlNodePtr tmp, node;
+	char* module_name = NULL, *module_enabled = NULL;
+	struct np_module* module = netopeer_options.modules;
+
+	node = (op & XMLDIFF_REM ? old_node : new_node);
+	if (node == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	for (tmp = node->parent->children; tmp != NULL; tmp = tmp->next) {
+		if (xmlStrEqual(tmp->name, BAD_CAST "name")) {
+			module_name = get_node_content(tmp);
+			break;
+		}
+	}
+	module_enabled = get_node_content(node);
+
+	if (module_name == NULL || module_enabled == NULL) {
+		nc_verb_error("%s: missing module \"name\" or \"enabled\" node", __func__);
+		return EXIT_FAILURE;
+	}
+
+	if ((op & (XMLDIFF_REM | XMLDIFF_ADD)) && strcmp(module_enabled, "false") == 0) {
+		/* module is/was not enabled, nothing to enable/disable */
+		return EXIT_SUCCESS;
+	}
+
+	while (module) {
+		if (strcmp(module->name, module_name) == 0) {
+			break;
+		}
+		module = module->next;
+	}
+
+	if ((op & XMLDIFF_REM) || ((op & XMLDIFF_MOD) && strcmp(module_enabled, "false") == 0)) {
+		if (module == NULL) {
+			/* it does not exist, so it is disabled */
 			return EXIT_SUCCESS;
 		}
 
@@ -663,9 +1651,11 @@ int callback_n_netopeer_n_modules_n_module_n_enabled(void** UNUSED(data), XMLDIF
 */
 struct transapi_data_callbacks netopeer_clbks = {
 #if defined(NP_SSH) && defined(NP_TLS)
-	.callbacks_count = 17,
+	.callbacks_count = 46,
+#elif defined(NP_SSH)
+	.callbacks_count = 35,
 #else
-	.callbacks_count = 11,
+	.callbacks_count = 35,
 #endif
 	.data = NULL,
 	.callbacks = {
@@ -673,6 +1663,25 @@ struct transapi_data_callbacks netopeer_clbks = {
 		{.path = "/n:netopeer/n:idle-timeout", .func = callback_n_netopeer_n_idle_timeout},
 		{.path = "/n:netopeer/n:max-sessions", .func = callback_n_netopeer_n_max_sessions},
 		{.path = "/n:netopeer/n:response-time", .func = callback_n_netopeer_n_response_time},
+		{.path = "/n:netopeer/n:worker-threads", .func = callback_n_netopeer_n_worker_threads},
+		{.path = "/n:netopeer/n:rpc-threads", .func = callback_n_netopeer_n_rpc_threads},
+		{.path = "/n:netopeer/n:handshake-timeout", .func = callback_n_netopeer_n_handshake_timeout},
+		{.path = "/n:netopeer/n:acceptor-threads", .func = callback_n_netopeer_n_acceptor_threads},
+		{.path = "/n:netopeer/n:listen-backlog", .func = callback_n_netopeer_n_listen_backlog},
+		{.path = "/n:netopeer/n:rate-limits/n:connections/n:rate", .func = callback_n_netopeer_n_rate_limits_n_connections_n_rate},
+		{.path = "/n:netopeer/n:rate-limits/n:connections/n:burst", .func = callback_n_netopeer_n_rate_limits_n_connections_n_burst},
+		{.path = "/n:netopeer/n:rate-limits/n:auth-attempts/n:rate", .func = callback_n_netopeer_n_rate_limits_n_auth_attempts_n_rate},
+		{.path = "/n:netopeer/n:rate-limits/n:auth-attempts/n:burst", .func = callback_n_netopeer_n_rate_limits_n_auth_attempts_n_burst},
+		{.path = "/n:netopeer/n:rate-limits/n:rpcs/n:rate", .func = callback_n_netopeer_n_rate_limits_n_rpcs_n_rate},
+		{.path = "/n:netopeer/n:rate-limits/n:rpcs/n:burst", .func = callback_n_netopeer_n_rate_limits_n_rpcs_n_burst},
+		{.path = "/n:netopeer/n:state-cache/n:ttl", .func = callback_n_netopeer_n_state_cache_n_ttl},
+		{.path = "/n:netopeer/n:config-snapshots/n:ttl", .func = callback_n_netopeer_n_config_snapshots_n_ttl},
+		{.path = "/n:netopeer/n:call-home/n:parallel-connect", .func = callback_n_netopeer_n_call_home_n_parallel_connect},
+		{.path = "/n:netopeer/n:logging/n:asynchronous", .func = callback_n_netopeer_n_logging_n_asynchronous},
+		{.path = "/n:netopeer/n:logging/n:file", .func = callback_n_netopeer_n_logging_n_file},
+		{.path = "/n:netopeer/n:memory/n:session-budget", .func = callback_n_netopeer_n_memory_n_session_budget},
+		{.path = "/n:netopeer/n:memory/n:total-budget", .func = callback_n_netopeer_n_memory_n_total_budget},
+		{.path = "/n:netopeer/n:memory/n:reply-budget", .func = callback_n_netopeer_n_memory_n_reply_budget},
 #ifdef NP_SSH
 		{.path = "/n:netopeer/n:ssh/n:server-keys/n:rsa-key", .func = callback_n_netopeer_n_ssh_n_server_keys_n_rsa_key},
 		{.path = "/n:netopeer/n:ssh/n:server-keys/n:dsa-key", .func = callback_n_netopeer_n_ssh_n_server_keys_n_dsa_key},
@@ -680,10 +1689,20 @@ struct transapi_data_callbacks netopeer_clbks = {
 		{.path = "/n:netopeer/n:ssh/n:password-auth-enabled", .func = callback_n_netopeer_n_ssh_n_password_auth_enabled},
 		{.path = "/n:netopeer/n:ssh/n:auth-attempts", .func = callback_n_netopeer_n_ssh_n_auth_attempts},
 		{.path = "/n:netopeer/n:ssh/n:auth-timeout", .func = callback_n_netopeer_n_ssh_n_auth_timeout},
+		{.path = "/n:netopeer/n:ssh/n:compression/n:enabled", .func = callback_n_netopeer_n_ssh_n_compression_n_enabled},
+		{.path = "/n:netopeer/n:ssh/n:compression/n:level", .func = callback_n_netopeer_n_ssh_n_compression_n_level},
+		{.path = "/n:netopeer/n:ssh/n:ciphers", .func = callback_n_netopeer_n_ssh_n_ciphers},
+		{.path = "/n:netopeer/n:ssh/n:macs", .func = callback_n_netopeer_n_ssh_n_macs},
+		{.path = "/n:netopeer/n:ssh/n:key-exchange", .func = callback_n_netopeer_n_ssh_n_key_exchange},
 #endif
 #ifdef NP_TLS
 		{.path = "/n:netopeer/n:tls/n:server-cert", .func = callback_n_netopeer_n_tls_n_server_cert},
 		{.path = "/n:netopeer/n:tls/n:server-key", .func = callback_n_netopeer_n_tls_n_server_key},
+		{.path = "/n:netopeer/n:tls/n:min-version", .func = callback_n_netopeer_n_tls_n_min_version},
+		{.path = "/n:netopeer/n:tls/n:max-version", .func = callback_n_netopeer_n_tls_n_max_version},
+		{.path = "/n:netopeer/n:tls/n:cipher-list", .func = callback_n_netopeer_n_tls_n_cipher_list},
+		{.path = "/n:netopeer/n:tls/n:ciphersuites", .func = callback_n_netopeer_n_tls_n_ciphersuites},
+		{.path = "/n:netopeer/n:tls/n:kernel-offload", .func = callback_n_netopeer_n_tls_n_kernel_offload},
 		{.path = "/n:netopeer/n:tls/n:trusted-ca-certs/n:trusted-ca-cert", .func = callback_n_netopeer_n_tls_n_trusted_ca_certs_n_trusted_ca_cert},
 		{.path = "/n:netopeer/n:tls/n:trusted-client-certs/n:trusted-client-cert", .func = callback_n_netopeer_n_tls_n_trusted_client_certs_n_trusted_client_cert},
 		{.path = "/n:netopeer/n:tls/n:crl-dir", .func = callback_n_netopeer_n_tls_n_crl_dir},
@@ -717,7 +1736,7 @@ int netopeer_transapi_init(xmlDocPtr* UNUSED(running)) {
 
 	nc_verb_verbose("Setting the default configuration for the cfgnetopeer module...");
 
-	doc = xmlReadDoc(BAD_CAST "<netopeer xmlns=\"urn:cesnet:tmc:netopeer:1.0\"><hello-timeout>600</hello-timeout><idle-timeout>3600</idle-timeout><max-sessions>8</max-sessions><response-time>50</response-time></netopeer>",
+	doc = xmlReadDoc(BAD_CAST "<netopeer xmlns=\"urn:cesnet:tmc:netopeer:1.0\"><hello-timeout>600</hello-timeout><idle-timeout>3600</idle-timeout><max-sessions>8</max-sessions><response-time>50</response-time><worker-threads>4</worker-threads><handshake-timeout>10</handshake-timeout><acceptor-threads>1</acceptor-threads><listen-backlog>128</listen-backlog><rpc-threads>4</rpc-threads></netopeer>",
 		NULL, NULL, 0);
 	if (doc == NULL) {
 		nc_verb_error("Unable to parse the default cfgnetopeer configuration.");
@@ -772,6 +1791,66 @@ int netopeer_transapi_init(xmlDocPtr* UNUSED(running)) {
 		return EXIT_FAILURE;
 	}
 
+	if (callback_n_netopeer_n_worker_threads(NULL, XMLDIFF_ADD, NULL, doc->children->children->next->next->next->next, &error) != EXIT_SUCCESS) {
+		if (error != NULL) {
+			str_err = nc_err_get(error, NC_ERR_PARAM_MSG);
+			if (str_err != NULL) {
+				nc_verb_error(str_err);
+			}
+			nc_err_free(error);
+		}
+		xmlFreeDoc(doc);
+		return EXIT_FAILURE;
+	}
+
+	if (callback_n_netopeer_n_handshake_timeout(NULL, XMLDIFF_ADD, NULL, doc->children->children->next->next->next->next->next, &error) != EXIT_SUCCESS) {
+		if (error != NULL) {
+			str_err = nc_err_get(error, NC_ERR_PARAM_MSG);
+			if (str_err != NULL) {
+				nc_verb_error(str_err);
+			}
+			nc_err_free(error);
+		}
+		xmlFreeDoc(doc);
+		return EXIT_FAILURE;
+	}
+
+	if (callback_n_netopeer_n_acceptor_threads(NULL, XMLDIFF_ADD, NULL, doc->children->children->next->next->next->next->next->next, &error) != EXIT_SUCCESS) {
+		if (error != NULL) {
+			str_err = nc_err_get(error, NC_ERR_PARAM_MSG);
+			if (str_err != NULL) {
+				nc_verb_error(str_err);
+			}
+			nc_err_free(error);
+		}
+		xmlFreeDoc(doc);
+		return EXIT_FAILURE;
+	}
+
+	if (callback_n_netopeer_n_listen_backlog(NULL, XMLDIFF_ADD, NULL, doc->children->children->next->next->next->next->next->next->next, &error) != EXIT_SUCCESS) {
+		if (error != NULL) {
+			str_err = nc_err_get(error, NC_ERR_PARAM_MSG);
+			if (str_err != NULL) {
+				nc_verb_error(str_err);
+			}
+			nc_err_free(error);
+		}
+		xmlFreeDoc(doc);
+		return EXIT_FAILURE;
+	}
+
+	if (callback_n_netopeer_n_rpc_threads(NULL, XMLDIFF_ADD, NULL, doc->children->children->next->next->next->next->next->next->next->next, &error) != EXIT_SUCCESS) {
+		if (error != NULL) {
+			str_err = nc_err_get(error, NC_ERR_PARAM_MSG);
+			if (str_err != NULL) {
+				nc_verb_error(str_err);
+			}
+			nc_err_free(error);
+		}
+		xmlFreeDoc(doc);
+		return EXIT_FAILURE;
+	}
+
 	xmlFreeDoc(doc);
 
 #ifdef NP_SSH
@@ -883,7 +1962,7 @@ nc_reply* rpc_reload_module(xmlNodePtr input) {
 		return nc_reply_error(nc_err_new(NC_ERR_INVALID_VALUE));
 	}
 
-	if (module_disable(module, 0) || module_enable(module, 0)) {
+	if (module_reload(module)) {
 		return nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
 	}
 
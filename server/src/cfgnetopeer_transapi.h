@@ -40,13 +40,36 @@
 #ifndef _CFGNETOPEER_TRANSAPI_H_
 #define _CFGNETOPEER_TRANSAPI_H_
 
+#include <time.h>
+#include <sys/types.h>
+
 #include "netconf_server_transapi.h"
 
+/* token bucket parameters, a rate of 0 means unlimited */
+struct np_rate_limit {
+	uint32_t rate;
+	uint32_t burst;
+};
+
 struct np_options {
 	uint8_t verbose;
 	uint32_t idle_timeout;
 	uint16_t max_sessions;
 	uint16_t response_time;
+	uint16_t worker_threads;
+	uint16_t handshake_timeout;
+	uint16_t acceptor_threads;
+	uint16_t listen_backlog;
+	uint16_t rpc_threads;
+	struct np_rate_limit conn_limit;	// new connections per second of a source address
+	struct np_rate_limit auth_limit;	// authentication attempts per minute of a username
+	struct np_rate_limit rpc_limit;		// RPCs per second of a session
+	uint32_t state_cache_ttl;			// msecs the get replies are cached for, 0 disables the cache
+	uint32_t config_snapshot_ttl;		// msecs the get-config snapshots are replied from, 0 disables them
+	uint8_t callhome_parallel;			// race the connects to the call home servers of an app
+	uint32_t mem_session_budget;		// KiB of replies, streams and notifications a session may hold, 0 unlimited
+	uint32_t mem_total_budget;			// KiB all the sessions together may hold, 0 unlimited
+	uint32_t mem_reply_budget;			// KiB of a single reply, 0 unlimited
 
 	struct np_options_ssh* ssh_opts;
 	struct np_options_tls* tls_opts;
@@ -55,6 +78,11 @@ struct np_options {
 		char* name; /**< Module name, same as filename (without .xml extension) in MODULES_CFG_DIR */
 		struct ncds_ds* ds; /**< pointer to datastore returned by libnetconf */
 		ncds_id id; /**< Related datastore ID */
+		struct timespec cfg_mtime; /**< modification time of the module configuration when enabled */
+		ino_t cfg_ino; /**< inode of the module configuration when enabled */
+		uint32_t load_ms; /**< time the module configuration and datastore took to load */
+		uint32_t init_ms; /**< time the device initialization took */
+		uint8_t pending; /**< loaded in a batch, but not initialized yet */
 		struct np_module* prev, *next;
 	} *modules;
 
@@ -83,4 +111,41 @@ int module_enable(struct np_module* module, int add);
  */
 int module_disable(struct np_module* module, int destroy);
 
+/**
+ * @brief Start a batch, modules enabled and added to the list until
+ * module_batch_end() are only loaded
+ */
+void module_batch_begin(void);
+
+/**
+ * @brief Consolidate the datastores of the modules loaded in a batch and
+ * initialize them in parallel, the modules failing to initialize are removed
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE if any module failed
+ */
+int module_batch_end(void);
+
+/**
+ * @brief Disable and enable a module again with its current configuration
+ *
+ * @param module Module to reload
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int module_reload(struct np_module* module);
+
+/**
+ * @brief Check whether the configuration file of a module changed since it was enabled
+ *
+ * @param module Module to check
+ *
+ * @return 1 if changed or not accessible, 0 otherwise
+ */
+int module_changed(const struct np_module* module);
+
+/**
+ * @brief Forget the augment models added, call with nc_close()
+ */
+void model_cache_cleanup(void);
+
 #endif /* _CFGNETOPEER_TRANSAPI_H_ */
@@ -0,0 +1,70 @@
+/**
+ * @file epoch.c
+ * @author agent <agent@local>
+ * @brief Netopeer server epochs of the indices read without locking
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#include <sched.h>
+
+#include "epoch.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+unsigned int np_epoch_enter(struct np_epoch* epoch) {
+	unsigned int slot;
+
+	slot = __atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_fetch_add(&epoch->readers[slot], 1, __ATOMIC_SEQ_CST);
+	return slot;
+}
+
+void np_epoch_leave(struct np_epoch* epoch, unsigned int slot) {
+	__atomic_fetch_sub(&epoch->readers[slot], 1, __ATOMIC_SEQ_CST);
+}
+
+void* np_epoch_publish(void** index, void* new_index, struct np_epoch* epoch) {
+	void* old;
+	unsigned int slot, i;
+
+	old = __atomic_exchange_n(index, new_index, __ATOMIC_SEQ_CST);
+	for (i = 0; i < 2; ++i) {
+		slot = __atomic_fetch_add(&epoch->epoch, 1, __ATOMIC_SEQ_CST) & 1;
+		while (__atomic_load_n(&epoch->readers[slot], __ATOMIC_SEQ_CST) != 0) {
+			sched_yield();
+		}
+	}
+
+	return old;
+}
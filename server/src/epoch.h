@@ -0,0 +1,81 @@
+/**
+ * @file epoch.h
+ * @author agent <agent@local>
+ * @brief Netopeer server epochs of the indices read without locking header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+/*
+ * An index read without any lock is replaced by publishing a new one. Every
+ * reader counts itself in the slot of the current epoch and the writer waits
+ * for the slots of the two epochs it ends before it frees the old index, a
+ * reader may have taken its slot before the previous publish.
+ */
+struct np_epoch {
+	unsigned int epoch;
+	unsigned int readers[2];
+};
+
+/**
+ * @brief Start reading the indices of an epoch
+ *
+ * @param epoch Epoch of the index
+ *
+ * @return Slot to pass to np_epoch_leave()
+ */
+unsigned int np_epoch_enter(struct np_epoch* epoch);
+
+/**
+ * @brief Stop reading the indices of an epoch, nothing read from them must be used afterwards
+ *
+ * @param epoch Epoch of the index
+ * @param slot Slot returned by np_epoch_enter()
+ */
+void np_epoch_leave(struct np_epoch* epoch, unsigned int slot);
+
+/**
+ * @brief Publish a new index and wait for all the readers of the previous one
+ *
+ * @param index Pointer to the published index
+ * @param new_index Index to publish, can be NULL
+ * @param epoch Epoch of the index
+ *
+ * @return Previous index, no reader uses it anymore
+ */
+void* np_epoch_publish(void** index, void* new_index, struct np_epoch* epoch);
+
+#endif /* _EPOCH_H_ */
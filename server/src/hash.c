@@ -0,0 +1,79 @@
+/**
+ * @file hash.c
+ * @author agent <agent@local>
+ * @brief Netopeer server FNV-1a hash of the lookup tables
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+uint32_t np_hash(uint32_t hash, const void* data, size_t len) {
+	const unsigned char* ptr = data;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= ptr[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+uint32_t np_hash_str(uint32_t hash, const char* str) {
+	for (; *str != '\0'; ++str) {
+		hash ^= (unsigned char)*str;
+		hash *= 16777619u;
+	}
+	/* the terminating zero */
+	hash *= 16777619u;
+
+	return hash;
+}
+
+uint64_t np_hash64(uint64_t hash, const void* data, size_t len) {
+	const unsigned char* ptr = data;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= ptr[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file hash.h
+ * @author agent <agent@local>
+ * @brief Netopeer server FNV-1a hash of the lookup tables header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* initial value of a hash, the following parts are chained by passing it on */
+#define NP_HASH_INIT 2166136261u
+#define NP_HASH64_INIT 14695981039346656037ULL
+
+/**
+ * @brief 32-bit FNV-1a of a buffer
+ *
+ * @param hash NP_HASH_INIT or the hash of the previous parts
+ * @param data Data to hash
+ * @param len Length of data
+ *
+ * @return Updated hash
+ */
+uint32_t np_hash(uint32_t hash, const void* data, size_t len);
+
+/**
+ * @brief 32-bit FNV-1a of a string including its terminating zero, so the
+ * chained strings are separated
+ *
+ * @param hash NP_HASH_INIT or the hash of the previous parts
+ * @param str String to hash
+ *
+ * @return Updated hash
+ */
+uint32_t np_hash_str(uint32_t hash, const char* str);
+
+/**
+ * @brief 64-bit FNV-1a of a buffer
+ *
+ * @param hash NP_HASH64_INIT or the hash of the previous parts
+ * @param data Data to hash
+ * @param len Length of data
+ *
+ * @return Updated hash
+ */
+uint64_t np_hash64(uint64_t hash, const void* data, size_t len);
+
+#endif /* _HASH_H_ */
@@ -0,0 +1,1193 @@
+/**
+ * @file journal.c
+ * @author agent <agent@local>
+ * @brief Netopeer server journaled datastore
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+#include <libxml/xmlsave.h>
+#include <libnetconf_xml.h>
+
+#include "server.h"
+#include "journal.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/*
+ * The journal is a sequence of records "<length>\n<commit/>\n", a commit holds
+ * the operations turning the previous content of a datastore into the new one:
+ * <remove>, <replace> or <insert> of a subtree, or <reset> of the whole datastore.
+ * The nodes are addressed by paths of <s> steps, a step is the node name and
+ * namespace and, if the name is not unique among the siblings, the value of the
+ * leaf or of the first leaf of the list entry with the occurrence of the same
+ * ones. A path is valid in the datastore as it is just before its operation,
+ * so the replay goes through the same states.
+ */
+
+#define JOURNAL_DS_COUNT 3
+
+/* the journal is compacted once larger than the snapshot, but not below this */
+#define JOURNAL_COMPACT_MIN (1024*1024)
+
+#define JOURNAL_PARSE_FLAGS (XML_PARSE_NOBLANKS|XML_PARSE_NSCLEAN|XML_PARSE_NOWARNING|XML_PARSE_NOERROR|XML_PARSE_HUGE)
+
+static const char* journal_ds_names[JOURNAL_DS_COUNT] = {"running", "startup", "candidate"};
+
+struct np_journal {
+	char* path;				// snapshot
+	char* journal_path;
+	unsigned int sync_delay;
+
+	pthread_mutex_t lock;
+	int fd;					// journal, opened for appending
+	off_t size;
+	off_t snapshot_size;
+	uint64_t seq;			// last commit
+
+	xmlDocPtr config[JOURNAL_DS_COUNT];		// top-level nodes are the children of the <config> root
+	xmlDocPtr backup;		// content of backup_ds before its last commit, for a rollback
+	int backup_ds;
+	struct ncds_lockinfo locks[JOURNAL_DS_COUNT];
+
+	pthread_t sync_thread;
+	pthread_cond_t sync_cond;
+	int sync_started;
+	int sync_pending;		// appended, but not synced yet
+	int quit;
+	uint64_t last_sync;
+};
+
+/* a child matched in the diff */
+struct journal_child {
+	xmlNodePtr node;
+	const xmlChar* href;
+	const xmlChar* value;	// of the leaf or of the first leaf of the entry
+	int leaf;
+	unsigned int pos;		// among the element siblings
+	unsigned int occ;		// among the siblings with the same name and value
+	unsigned int group;		// number of the siblings with the same name
+	int match;				// pos of the matching child, -1 if none
+};
+
+static int journal_ds_index(NC_DATASTORE ds) {
+	switch (ds) {
+	case NC_DATASTORE_RUNNING:
+		return 0;
+	case NC_DATASTORE_STARTUP:
+		return 1;
+	case NC_DATASTORE_CANDIDATE:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
+static struct nc_err* journal_error(NC_ERR type, NC_ERR_PARAM param, const char* value) {
+	struct nc_err* error;
+
+	error = nc_err_new(type);
+	if (value != NULL) {
+		nc_err_set(error, param, value);
+	}
+	return error;
+}
+
+static xmlNodePtr first_element(xmlNodePtr node) {
+	for (; node != NULL && node->type != XML_ELEMENT_NODE; node = node->next);
+	return node;
+}
+
+static xmlNodePtr next_element(xmlNodePtr node) {
+	return first_element(node->next);
+}
+
+static const xmlChar* node_href(xmlNodePtr node) {
+	return (node->ns != NULL && node->ns->href != NULL) ? node->ns->href : BAD_CAST "";
+}
+
+static int same_name(xmlNodePtr a, xmlNodePtr b) {
+	return xmlStrcmp(a->name, b->name) == 0 && xmlStrcmp(node_href(a), node_href(b)) == 0;
+}
+
+static const xmlChar* leaf_value(xmlNodePtr node) {
+	xmlNodePtr child;
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if ((child->type == XML_TEXT_NODE || child->type == XML_CDATA_SECTION_NODE) && child->content != NULL) {
+			return child->content;
+		}
+	}
+	return BAD_CAST "";
+}
+
+/* value identifying the node among the siblings of the same name */
+static const xmlChar* node_value(xmlNodePtr node, int* leaf) {
+	xmlNodePtr key;
+
+	if ((key = first_element(node->children)) == NULL) {
+		*leaf = 1;
+		return leaf_value(node);
+	}
+	*leaf = 0;
+	return first_element(key->children) == NULL ? leaf_value(key) : BAD_CAST "";
+}
+
+static int leaf_equal(xmlNodePtr a, xmlNodePtr b) {
+	for (a = a->children, b = b->children; a != NULL && b != NULL; a = a->next, b = b->next) {
+		if (a->type != b->type || xmlStrcmp(a->content, b->content) != 0) {
+			return 0;
+		}
+	}
+	return a == NULL && b == NULL;
+}
+
+static int props_equal(xmlNodePtr a, xmlNodePtr b) {
+	xmlAttrPtr pa, pb;
+	xmlChar *va, *vb;
+	int equal;
+
+	for (pa = a->properties, pb = b->properties; pa != NULL && pb != NULL; pa = pa->next, pb = pb->next) {
+		if (xmlStrcmp(pa->name, pb->name) != 0 || (pa->ns == NULL) != (pb->ns == NULL)
+				|| (pa->ns != NULL && xmlStrcmp(pa->ns->href, pb->ns->href) != 0)) {
+			return 0;
+		}
+		va = xmlNodeGetContent((xmlNodePtr)pa);
+		vb = xmlNodeGetContent((xmlNodePtr)pb);
+		equal = (xmlStrcmp(va, vb) == 0);
+		xmlFree(va);
+		xmlFree(vb);
+		if (!equal) {
+			return 0;
+		}
+	}
+	return pa == NULL && pb == NULL;
+}
+
+static xmlDocPtr config_new(void) {
+	xmlDocPtr doc;
+
+	if ((doc = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		return NULL;
+	}
+	xmlDocSetRootElement(doc, xmlNewDocNode(doc, NULL, BAD_CAST "config", NULL));
+	if (xmlDocGetRootElement(doc) == NULL) {
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+	return doc;
+}
+
+static xmlDocPtr config_parse(const char* config) {
+	xmlDocPtr doc;
+	char* str;
+
+	if (asprintf(&str, "<config>%s</config>", config != NULL ? config : "") == -1) {
+		return NULL;
+	}
+	doc = xmlReadMemory(str, strlen(str), NULL, NULL, JOURNAL_PARSE_FLAGS);
+	free(str);
+	return doc;
+}
+
+static int config_copy(xmlNodePtr to, xmlNodePtr from) {
+	xmlNodePtr child, copy;
+
+	for (child = first_element(from->children); child != NULL; child = next_element(child)) {
+		if ((copy = xmlDocCopyNode(child, to->doc, 1)) == NULL) {
+			return EXIT_FAILURE;
+		}
+		xmlAddChild(to, copy);
+	}
+	return EXIT_SUCCESS;
+}
+
+static char* config_dump(xmlDocPtr doc) {
+	xmlBufferPtr buf;
+	xmlNodePtr child;
+	char* ret;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		return NULL;
+	}
+	for (child = first_element(xmlDocGetRootElement(doc)->children); child != NULL; child = next_element(child)) {
+		xmlNodeDump(buf, doc, child, 0, 0);
+	}
+	ret = strdup(xmlBufferLength(buf) > 0 ? (char*)xmlBufferContent(buf) : "");
+	xmlBufferFree(buf);
+	return ret;
+}
+
+/* step to the node as it is among its current siblings */
+static void journal_add_step(xmlNodePtr op, xmlNodePtr node) {
+	xmlNodePtr sibling, step;
+	const xmlChar *value;
+	unsigned int group = 0, occ = 0;
+	int leaf, sibling_leaf, before = 1;
+	char buf[16];
+
+	value = node_value(node, &leaf);
+	for (sibling = first_element(node->parent->children); sibling != NULL; sibling = next_element(sibling)) {
+		if (sibling == node) {
+			before = 0;
+		}
+		if (!same_name(sibling, node)) {
+			continue;
+		}
+		++group;
+		if (before && xmlStrcmp(node_value(sibling, &sibling_leaf), value) == 0 && sibling_leaf == leaf) {
+			++occ;
+		}
+	}
+
+	step = xmlNewChild(op, NULL, BAD_CAST "s", NULL);
+	xmlNewProp(step, BAD_CAST "name", node->name);
+	if (node->ns != NULL && node->ns->href != NULL) {
+		xmlNewProp(step, BAD_CAST "ns", node->ns->href);
+	}
+	if (group > 1) {
+		xmlNewProp(step, BAD_CAST (leaf ? "value" : "key"), value);
+		if (occ > 0) {
+			snprintf(buf, sizeof(buf), "%u", occ);
+			xmlNewProp(step, BAD_CAST "n", BAD_CAST buf);
+		}
+	}
+}
+
+static void journal_add_path(xmlNodePtr op, xmlNodePtr node) {
+	if (node->parent == NULL || node->parent->type != XML_ELEMENT_NODE) {
+		/* the <config> root */
+		return;
+	}
+	journal_add_path(op, node->parent);
+	journal_add_step(op, node);
+}
+
+static xmlNodePtr journal_find(xmlNodePtr parent, xmlNodePtr step) {
+	xmlNodePtr child;
+	xmlChar *name, *href, *key, *value, *n;
+	const xmlChar* child_value;
+	unsigned long occ;
+	int leaf;
+
+	if (step == NULL || xmlStrcmp(step->name, BAD_CAST "s") != 0) {
+		return NULL;
+	}
+	name = xmlGetProp(step, BAD_CAST "name");
+	href = xmlGetProp(step, BAD_CAST "ns");
+	key = xmlGetProp(step, BAD_CAST "key");
+	value = xmlGetProp(step, BAD_CAST "value");
+	n = xmlGetProp(step, BAD_CAST "n");
+	occ = (n != NULL) ? strtoul((char*)n, NULL, 10) : 0;
+
+	for (child = first_element(parent->children); child != NULL; child = next_element(child)) {
+		if (xmlStrcmp(child->name, name) != 0 || xmlStrcmp(node_href(child), href != NULL ? href : BAD_CAST "") != 0) {
+			continue;
+		}
+		if (key == NULL && value == NULL) {
+			break;
+		}
+		child_value = node_value(child, &leaf);
+		if ((value != NULL) == leaf && xmlStrcmp(child_value, value != NULL ? value : key) == 0 && occ-- == 0) {
+			break;
+		}
+	}
+
+	xmlFree(name);
+	xmlFree(href);
+	xmlFree(key);
+	xmlFree(value);
+	xmlFree(n);
+	return child;
+}
+
+/* follow the steps from *next, set it to the element after them */
+static xmlNodePtr journal_resolve(xmlNodePtr root, xmlNodePtr* next) {
+	xmlNodePtr node = root, step;
+
+	for (step = first_element(*next); step != NULL && xmlStrcmp(step->name, BAD_CAST "s") == 0; step = next_element(step)) {
+		if ((node = journal_find(node, step)) == NULL) {
+			return NULL;
+		}
+	}
+	*next = step;
+	return node;
+}
+
+static void journal_link(xmlNodePtr parent, xmlNodePtr prev, xmlNodePtr node) {
+	xmlNodePtr first;
+
+	if (prev != NULL) {
+		xmlAddNextSibling(prev, node);
+	} else if ((first = first_element(parent->children)) != NULL) {
+		xmlAddPrevSibling(first, node);
+	} else {
+		xmlAddChild(parent, node);
+	}
+}
+
+static int journal_add_data(xmlNodePtr op, xmlNodePtr node) {
+	xmlNodePtr data, copy;
+
+	data = xmlNewChild(op, NULL, BAD_CAST "data", NULL);
+	if (data == NULL || (copy = xmlDocCopyNode(node, op->doc, 1)) == NULL) {
+		return EXIT_FAILURE;
+	}
+	xmlAddChild(data, copy);
+	return EXIT_SUCCESS;
+}
+
+/* replace old in the working tree with a copy of node, return the copy */
+static xmlNodePtr journal_replace(xmlNodePtr commit, xmlNodePtr old, xmlNodePtr node) {
+	xmlNodePtr op, copy;
+
+	op = xmlNewChild(commit, NULL, BAD_CAST "replace", NULL);
+	journal_add_path(op, old);
+	if (journal_add_data(op, node) != EXIT_SUCCESS || (copy = xmlDocCopyNode(node, old->doc, 1)) == NULL) {
+		return NULL;
+	}
+	xmlReplaceNode(old, copy);
+	xmlFreeNode(old);
+	return copy;
+}
+
+/* insert a copy of node after prev (first if NULL) into parent in the working tree, return the copy */
+static xmlNodePtr journal_insert(xmlNodePtr commit, xmlNodePtr parent, xmlNodePtr prev, xmlNodePtr node) {
+	xmlNodePtr op, after, copy;
+
+	op = xmlNewChild(commit, NULL, BAD_CAST "insert", NULL);
+	journal_add_path(op, parent);
+	if (prev != NULL) {
+		after = xmlNewChild(op, NULL, BAD_CAST "after", NULL);
+		journal_add_step(after, prev);
+	}
+	if (journal_add_data(op, node) != EXIT_SUCCESS || (copy = xmlDocCopyNode(node, parent->doc, 1)) == NULL) {
+		return NULL;
+	}
+	journal_link(parent, prev, copy);
+	return copy;
+}
+
+static int child_name_cmp(const struct journal_child* a, const struct journal_child* b) {
+	int ret;
+
+	if ((ret = xmlStrcmp(a->href, b->href)) != 0) {
+		return ret;
+	}
+	return xmlStrcmp(a->node->name, b->node->name);
+}
+
+static int child_key_cmp(const struct journal_child* a, const struct journal_child* b) {
+	int ret;
+
+	if (a->leaf != b->leaf) {
+		return a->leaf - b->leaf;
+	}
+	if ((ret = xmlStrcmp(a->value, b->value)) != 0) {
+		return ret;
+	}
+	return (a->occ > b->occ) - (a->occ < b->occ);
+}
+
+static int child_cmp(const void* a, const void* b) {
+	const struct journal_child *x = a, *y = b;
+	int ret;
+
+	if ((ret = child_name_cmp(x, y)) != 0) {
+		return ret;
+	}
+	if (x->leaf != y->leaf) {
+		return x->leaf - y->leaf;
+	}
+	if ((ret = xmlStrcmp(x->value, y->value)) != 0) {
+		return ret;
+	}
+	return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int child_pos_cmp(const void* a, const void* b) {
+	const struct journal_child *x = a, *y = b;
+
+	return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/* element children of parent sorted by the name, value and position */
+static struct journal_child* journal_children(xmlNodePtr parent, unsigned int* count) {
+	struct journal_child* children;
+	xmlNodePtr child;
+	unsigned int i, j, k;
+
+	*count = 0;
+	for (child = first_element(parent->children); child != NULL; child = next_element(child)) {
+		++(*count);
+	}
+	if ((children = malloc((*count > 0 ? *count : 1) * sizeof(struct journal_child))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return NULL;
+	}
+	for (i = 0, child = first_element(parent->children); child != NULL; ++i, child = next_element(child)) {
+		children[i].node = child;
+		children[i].href = node_href(child);
+		children[i].value = node_value(child, &children[i].leaf);
+		children[i].pos = i;
+		children[i].match = -1;
+	}
+
+	qsort(children, *count, sizeof(struct journal_child), child_cmp);
+	for (i = 0; i < *count; i = j) {
+		for (j = i + 1; j < *count && child_name_cmp(&children[i], &children[j]) == 0; ++j);
+		for (k = i; k < j; ++k) {
+			children[k].group = j - i;
+			if (k > i && children[k].leaf == children[k - 1].leaf && xmlStrcmp(children[k].value, children[k - 1].value) == 0) {
+				children[k].occ = children[k - 1].occ + 1;
+			} else {
+				children[k].occ = 0;
+			}
+		}
+	}
+	return children;
+}
+
+/*
+ * turn the children of work into the ones of node, both are matched already,
+ * the operations are appended to commit and applied to work as they go
+ * return 0 on success, 1 if the matched children are reordered and work is to
+ * be replaced as a whole, -1 on error
+ */
+static int journal_diff(xmlNodePtr commit, xmlNodePtr work, xmlNodePtr node) {
+	struct journal_child *old = NULL, *new = NULL;
+	unsigned int old_count, new_count, i, j;
+	xmlNodePtr prev, cur;
+	int ret = 0, last, r;
+
+	if ((old = journal_children(work, &old_count)) == NULL || (new = journal_children(node, &new_count)) == NULL) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	/* a child unique by its name matches the other one of the name, the others by the value and occurrence */
+	for (i = 0, j = 0; i < old_count && j < new_count;) {
+		if ((r = child_name_cmp(&old[i], &new[j])) == 0 && (old[i].group > 1 || new[j].group > 1)) {
+			r = child_key_cmp(&old[i], &new[j]);
+		}
+		if (r < 0) {
+			++i;
+		} else if (r > 0) {
+			++j;
+		} else {
+			old[i].match = new[j].pos;
+			new[j].match = old[i].pos;
+			++i;
+			++j;
+		}
+	}
+	qsort(old, old_count, sizeof(struct journal_child), child_pos_cmp);
+	qsort(new, new_count, sizeof(struct journal_child), child_pos_cmp);
+
+	for (i = 0, last = -1; i < new_count; ++i) {
+		if (new[i].match > -1) {
+			if (new[i].match < last) {
+				ret = 1;
+				goto cleanup;
+			}
+			last = new[i].match;
+		}
+	}
+
+	for (i = 0; i < old_count; ++i) {
+		if (old[i].match == -1) {
+			journal_add_path(xmlNewChild(commit, NULL, BAD_CAST "remove", NULL), old[i].node);
+			xmlUnlinkNode(old[i].node);
+			xmlFreeNode(old[i].node);
+		}
+	}
+
+	for (i = 0, prev = NULL; i < new_count; ++i, prev = cur) {
+		if (new[i].match == -1) {
+			cur = journal_insert(commit, work, prev, new[i].node);
+		} else {
+			cur = old[new[i].match].node;
+			if (old[new[i].match].leaf != new[i].leaf || !props_equal(cur, new[i].node) || (new[i].leaf && !leaf_equal(cur, new[i].node))
+					|| (!new[i].leaf && (r = journal_diff(commit, cur, new[i].node)) == 1)) {
+				cur = journal_replace(commit, cur, new[i].node);
+			} else if (!new[i].leaf && r == -1) {
+				cur = NULL;
+			}
+		}
+		if (cur == NULL) {
+			ret = -1;
+			break;
+		}
+	}
+
+cleanup:
+	free(old);
+	free(new);
+	return ret;
+}
+
+static int journal_append(struct np_journal* j, xmlNodePtr commit) {
+	xmlBufferPtr buf;
+	struct iovec iov[3];
+	char head[32];
+	ssize_t len;
+	int ret = EXIT_SUCCESS;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		return EXIT_FAILURE;
+	}
+	xmlNodeDump(buf, commit->doc, commit, 0, 0);
+	iov[0].iov_base = head;
+	iov[0].iov_len = snprintf(head, sizeof(head), "%d\n", xmlBufferLength(buf));
+	iov[1].iov_base = (void*)xmlBufferContent(buf);
+	iov[1].iov_len = xmlBufferLength(buf);
+	iov[2].iov_base = "\n";
+	iov[2].iov_len = 1;
+	len = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+	if (writev(j->fd, iov, 3) != len) {
+		nc_verb_error("Writing the journal %s failed (%s).", j->journal_path, strerror(errno));
+		ret = EXIT_FAILURE;
+	} else if (j->sync_delay == 0 && fdatasync(j->fd) == -1) {
+		nc_verb_error("Syncing the journal %s failed (%s).", j->journal_path, strerror(errno));
+		ret = EXIT_FAILURE;
+	}
+	xmlBufferFree(buf);
+
+	if (ret != EXIT_SUCCESS) {
+		/* not to be replayed */
+		if (ftruncate(j->fd, j->size) == -1) {
+			nc_verb_error("Truncating the journal %s failed (%s).", j->journal_path, strerror(errno));
+		}
+		return ret;
+	}
+	j->size += len;
+	if (j->sync_delay > 0) {
+		j->sync_pending = 1;
+		pthread_cond_signal(&j->sync_cond);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* write all the datastores into a new snapshot and empty the journal */
+static int journal_compact(struct np_journal* j) {
+	xmlDocPtr doc;
+	xmlNodePtr root, node;
+	xmlSaveCtxtPtr save;
+	struct stat st;
+	char *tmp_path = NULL, *dir_path = NULL, buf[32];
+	int fd = -1, i, ret = EXIT_FAILURE;
+
+	if ((doc = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		return EXIT_FAILURE;
+	}
+	root = xmlNewDocNode(doc, NULL, BAD_CAST "datastores", NULL);
+	xmlDocSetRootElement(doc, root);
+	snprintf(buf, sizeof(buf), "%" PRIu64, j->seq);
+	xmlNewProp(root, BAD_CAST "seq", BAD_CAST buf);
+	for (i = 0; i < JOURNAL_DS_COUNT; ++i) {
+		node = xmlNewChild(root, NULL, BAD_CAST journal_ds_names[i], NULL);
+		if (node == NULL || config_copy(node, xmlDocGetRootElement(j->config[i])) != EXIT_SUCCESS) {
+			goto cleanup;
+		}
+	}
+
+	if (asprintf(&tmp_path, "%s.tmp", j->path) == -1 || (dir_path = strdup(j->path)) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		goto cleanup;
+	}
+	if ((fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600)) == -1) {
+		nc_verb_error("Creating the snapshot %s failed (%s).", tmp_path, strerror(errno));
+		goto cleanup;
+	}
+	if ((save = xmlSaveToFd(fd, "UTF-8", 0)) == NULL || xmlSaveDoc(save, doc) == -1 || xmlSaveClose(save) == -1
+			|| fsync(fd) == -1 || fstat(fd, &st) == -1) {
+		nc_verb_error("Writing the snapshot %s failed.", tmp_path);
+		goto cleanup;
+	}
+	close(fd);
+	fd = -1;
+	if (rename(tmp_path, j->path) == -1) {
+		nc_verb_error("Replacing the snapshot %s failed (%s).", j->path, strerror(errno));
+		goto cleanup;
+	}
+	/* the rename must be durable before the journal is gone */
+	if ((fd = open(dirname(dir_path), O_RDONLY|O_DIRECTORY|O_CLOEXEC)) != -1) {
+		fsync(fd);
+		close(fd);
+		fd = -1;
+	}
+
+	/* the snapshot has the seq, a crash before the truncation only makes the journal skipped */
+	if (ftruncate(j->fd, 0) == -1) {
+		nc_verb_error("Truncating the journal %s failed (%s).", j->journal_path, strerror(errno));
+		goto cleanup;
+	}
+	j->size = 0;
+	j->snapshot_size = st.st_size;
+	ret = EXIT_SUCCESS;
+
+cleanup:
+	if (fd != -1) {
+		close(fd);
+		unlink(tmp_path);
+	}
+	free(tmp_path);
+	free(dir_path);
+	xmlFreeDoc(doc);
+	return ret;
+}
+
+/* make doc the content of ds, journal the difference */
+static int journal_commit(struct np_journal* j, int ds, xmlDocPtr doc, struct nc_err** error) {
+	xmlDocPtr work = NULL, rec = NULL;
+	xmlNodePtr commit;
+	char buf[32];
+	int ret;
+
+	if (doc == NULL || (work = xmlCopyDoc(j->config[ds], 1)) == NULL || (rec = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		goto fail;
+	}
+	commit = xmlNewDocNode(rec, NULL, BAD_CAST "commit", NULL);
+	xmlDocSetRootElement(rec, commit);
+	snprintf(buf, sizeof(buf), "%" PRIu64, j->seq + 1);
+	xmlNewProp(commit, BAD_CAST "seq", BAD_CAST buf);
+	xmlNewProp(commit, BAD_CAST "ds", BAD_CAST journal_ds_names[ds]);
+
+	ret = journal_diff(commit, xmlDocGetRootElement(work), xmlDocGetRootElement(doc));
+	if (ret == 1) {
+		/* the top-level nodes are reordered */
+		if (journal_add_data(xmlNewChild(commit, NULL, BAD_CAST "reset", NULL), xmlDocGetRootElement(doc)) != EXIT_SUCCESS) {
+			ret = -1;
+		}
+	}
+	xmlFreeDoc(work);
+	work = NULL;
+	if (ret == -1) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		goto fail;
+	}
+
+	if (first_element(commit->children) != NULL) {
+		if (journal_append(j, commit) != EXIT_SUCCESS) {
+			goto fail;
+		}
+		++j->seq;
+	}
+	xmlFreeDoc(rec);
+
+	xmlFreeDoc(j->backup);
+	j->backup = j->config[ds];
+	j->backup_ds = ds;
+	j->config[ds] = doc;
+
+	if (j->size > (j->snapshot_size > JOURNAL_COMPACT_MIN ? j->snapshot_size : JOURNAL_COMPACT_MIN) && journal_compact(j) != EXIT_SUCCESS) {
+		nc_verb_warning("Compacting the journal %s failed, it keeps growing.", j->journal_path);
+	}
+	return EXIT_SUCCESS;
+
+fail:
+	xmlFreeDoc(work);
+	xmlFreeDoc(rec);
+	xmlFreeDoc(doc);
+	if (error != NULL) {
+		*error = journal_error(NC_ERR_OP_FAILED, NC_ERR_PARAM_MSG, "Storing the configuration failed.");
+	}
+	return EXIT_FAILURE;
+}
+
+static int journal_apply(struct np_journal* j, xmlNodePtr commit) {
+	xmlNodePtr root, op, next, node, after, data, copy;
+	xmlDocPtr doc;
+	xmlChar* name;
+	int ds;
+
+	if ((name = xmlGetProp(commit, BAD_CAST "ds")) == NULL) {
+		return EXIT_FAILURE;
+	}
+	for (ds = 0; ds < JOURNAL_DS_COUNT && xmlStrcmp(name, BAD_CAST journal_ds_names[ds]) != 0; ++ds);
+	xmlFree(name);
+	if (ds == JOURNAL_DS_COUNT) {
+		return EXIT_FAILURE;
+	}
+
+	root = xmlDocGetRootElement(j->config[ds]);
+	for (op = first_element(commit->children); op != NULL; op = next_element(op)) {
+		next = op->children;
+		if (xmlStrcmp(op->name, BAD_CAST "reset") == 0) {
+			if ((data = first_element(op->children)) == NULL || (data = first_element(data->children)) == NULL
+					|| (doc = config_new()) == NULL) {
+				return EXIT_FAILURE;
+			}
+			if (config_copy(xmlDocGetRootElement(doc), data) != EXIT_SUCCESS) {
+				xmlFreeDoc(doc);
+				return EXIT_FAILURE;
+			}
+			xmlFreeDoc(j->config[ds]);
+			j->config[ds] = doc;
+			root = xmlDocGetRootElement(doc);
+			continue;
+		}
+
+		if ((node = journal_resolve(root, &next)) == NULL) {
+			return EXIT_FAILURE;
+		}
+		if (xmlStrcmp(op->name, BAD_CAST "remove") == 0) {
+			if (node == root) {
+				return EXIT_FAILURE;
+			}
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+			continue;
+		}
+
+		after = NULL;
+		if (xmlStrcmp(op->name, BAD_CAST "insert") == 0 && next != NULL && xmlStrcmp(next->name, BAD_CAST "after") == 0) {
+			if ((after = journal_find(node, first_element(next->children))) == NULL) {
+				return EXIT_FAILURE;
+			}
+			next = next_element(next);
+		}
+		if (next == NULL || xmlStrcmp(next->name, BAD_CAST "data") != 0 || (data = first_element(next->children)) == NULL
+				|| (copy = xmlDocCopyNode(data, root->doc, 1)) == NULL) {
+			return EXIT_FAILURE;
+		}
+		if (xmlStrcmp(op->name, BAD_CAST "insert") == 0) {
+			journal_link(node, after, copy);
+		} else if (xmlStrcmp(op->name, BAD_CAST "replace") == 0 && node != root) {
+			xmlReplaceNode(node, copy);
+			xmlFreeNode(node);
+		} else {
+			xmlFreeNode(copy);
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+static uint64_t journal_seq(xmlNodePtr node) {
+	xmlChar* seq;
+	uint64_t ret;
+
+	if ((seq = xmlGetProp(node, BAD_CAST "seq")) == NULL) {
+		return 0;
+	}
+	ret = strtoull((char*)seq, NULL, 10);
+	xmlFree(seq);
+	return ret;
+}
+
+/* load the snapshot and replay the newer commits of the journal */
+static int journal_load(struct np_journal* j) {
+	xmlDocPtr doc;
+	xmlNodePtr node;
+	struct stat st;
+	char *data, *end;
+	off_t off, size, start;
+	unsigned long len;
+	ssize_t r;
+	uint64_t seq;
+	int i;
+
+	if (stat(j->path, &st) == 0) {
+		if ((doc = xmlReadFile(j->path, NULL, JOURNAL_PARSE_FLAGS)) == NULL) {
+			nc_verb_error("Reading the snapshot %s failed.", j->path);
+			return EXIT_FAILURE;
+		}
+		j->seq = journal_seq(xmlDocGetRootElement(doc));
+		for (node = first_element(xmlDocGetRootElement(doc)->children); node != NULL; node = next_element(node)) {
+			for (i = 0; i < JOURNAL_DS_COUNT && xmlStrcmp(node->name, BAD_CAST journal_ds_names[i]) != 0; ++i);
+			if (i < JOURNAL_DS_COUNT && config_copy(xmlDocGetRootElement(j->config[i]), node) != EXIT_SUCCESS) {
+				nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+				xmlFreeDoc(doc);
+				return EXIT_FAILURE;
+			}
+		}
+		xmlFreeDoc(doc);
+		j->snapshot_size = st.st_size;
+	} else if (errno != ENOENT) {
+		nc_verb_error("Accessing the snapshot %s failed (%s).", j->path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if ((j->fd = open(j->journal_path, O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC, 0600)) == -1 || fstat(j->fd, &st) == -1) {
+		nc_verb_error("Opening the journal %s failed (%s).", j->journal_path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	size = st.st_size;
+	if ((data = malloc(size + 1)) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	for (off = 0; off < size; off += r) {
+		if ((r = pread(j->fd, data + off, size - off, off)) <= 0) {
+			nc_verb_error("Reading the journal %s failed (%s).", j->journal_path, r == 0 ? "unexpected end" : strerror(errno));
+			free(data);
+			return EXIT_FAILURE;
+		}
+	}
+	data[size] = '\0';
+
+	for (off = 0; off < size; off = start + len + 1) {
+		len = strtoul(data + off, &end, 10);
+		start = end + 1 - data;
+		if (end == data + off || *end != '\n' || len >= (unsigned long)(size - start) || data[start + len] != '\n') {
+			break;
+		}
+		if ((doc = xmlReadMemory(data + start, len, NULL, NULL, JOURNAL_PARSE_FLAGS)) == NULL) {
+			break;
+		}
+		if ((seq = journal_seq(xmlDocGetRootElement(doc))) > j->seq) {
+			if (journal_apply(j, xmlDocGetRootElement(doc)) != EXIT_SUCCESS) {
+				nc_verb_error("The journal %s does not match the datastore at the commit %" PRIu64 ".", j->journal_path, seq);
+				xmlFreeDoc(doc);
+				free(data);
+				return EXIT_FAILURE;
+			}
+			j->seq = seq;
+		}
+		xmlFreeDoc(doc);
+	}
+	free(data);
+
+	if (off < size) {
+		/* an interrupted append */
+		nc_verb_warning("Discarding the incomplete end of the journal %s.", j->journal_path);
+		if (ftruncate(j->fd, off) == -1) {
+			nc_verb_error("Truncating the journal %s failed (%s).", j->journal_path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+	j->size = off;
+	return EXIT_SUCCESS;
+}
+
+/* sync the appended commits at most sync_delay after the previous sync */
+static void* journal_sync_thread(void* arg) {
+	struct np_journal* j = (struct np_journal*)arg;
+	struct timespec ts;
+	uint64_t deadline;
+	int fd;
+
+	pthread_mutex_lock(&j->lock);
+	while (!j->quit) {
+		if (!j->sync_pending) {
+			pthread_cond_wait(&j->sync_cond, &j->lock);
+			continue;
+		}
+		deadline = j->last_sync + j->sync_delay;
+		if (np_clock_ms() < deadline) {
+			ts.tv_sec = deadline / 1000;
+			ts.tv_nsec = (deadline % 1000) * 1000000;
+			pthread_cond_timedwait(&j->sync_cond, &j->lock, &ts);
+			continue;
+		}
+
+		j->sync_pending = 0;
+		fd = j->fd;
+		pthread_mutex_unlock(&j->lock);
+		if (fdatasync(fd) == -1) {
+			nc_verb_error("Syncing the journal %s failed (%s).", j->journal_path, strerror(errno));
+		}
+		pthread_mutex_lock(&j->lock);
+		j->last_sync = np_clock_ms();
+	}
+	pthread_mutex_unlock(&j->lock);
+
+	return NULL;
+}
+
+static int journal_init(void* data) {
+	struct np_journal* j = (struct np_journal*)data;
+	int i;
+
+	for (i = 0; i < JOURNAL_DS_COUNT; ++i) {
+		if ((j->config[i] = config_new()) == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			return EXIT_FAILURE;
+		}
+	}
+	if (journal_load(j) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	if (j->sync_delay > 0) {
+		if (pthread_create(&j->sync_thread, NULL, journal_sync_thread, j) != 0) {
+			nc_verb_warning("%s: failed to create a thread, the journal %s is synced on every change.", __func__, j->journal_path);
+			j->sync_delay = 0;
+		} else {
+			j->sync_started = 1;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+static void journal_free(void* data) {
+	struct np_journal* j = (struct np_journal*)data;
+	int i;
+
+	if (j->sync_started) {
+		pthread_mutex_lock(&j->lock);
+		j->quit = 1;
+		pthread_cond_signal(&j->sync_cond);
+		pthread_mutex_unlock(&j->lock);
+		pthread_join(j->sync_thread, NULL);
+	}
+	if (j->fd != -1) {
+		if (j->sync_pending) {
+			fdatasync(j->fd);
+		}
+		close(j->fd);
+	}
+
+	for (i = 0; i < JOURNAL_DS_COUNT; ++i) {
+		xmlFreeDoc(j->config[i]);
+		free(j->locks[i].sid);
+		free(j->locks[i].time);
+	}
+	xmlFreeDoc(j->backup);
+	pthread_cond_destroy(&j->sync_cond);
+	pthread_mutex_destroy(&j->lock);
+	free(j->path);
+	free(j->journal_path);
+	free(j);
+}
+
+static int journal_was_changed(void* UNUSED(data)) {
+	/* nobody else writes the files */
+	return 0;
+}
+
+static int journal_rollback(void* data) {
+	struct np_journal* j = (struct np_journal*)data;
+	xmlDocPtr doc;
+	int ret;
+
+	pthread_mutex_lock(&j->lock);
+	if ((doc = j->backup) == NULL) {
+		pthread_mutex_unlock(&j->lock);
+		return EXIT_FAILURE;
+	}
+	j->backup = NULL;
+	ret = journal_commit(j, j->backup_ds, doc, NULL);
+	/* a rollback is not to be rolled back */
+	xmlFreeDoc(j->backup);
+	j->backup = NULL;
+	pthread_mutex_unlock(&j->lock);
+
+	return ret;
+}
+
+static const struct ncds_lockinfo* journal_get_lockinfo(void* data, NC_DATASTORE target) {
+	struct np_journal* j = (struct np_journal*)data;
+	int i;
+
+	if ((i = journal_ds_index(target)) == -1) {
+		return NULL;
+	}
+	return &j->locks[i];
+}
+
+static int journal_lock(void* data, NC_DATASTORE target, const char* session_id, struct nc_err** error) {
+	struct np_journal* j = (struct np_journal*)data;
+	int i, ret = EXIT_SUCCESS;
+
+	if ((i = journal_ds_index(target)) == -1) {
+		*error = journal_error(NC_ERR_BAD_ELEM, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&j->lock);
+	if (j->locks[i].sid != NULL) {
+		*error = journal_error(NC_ERR_LOCK_DENIED, NC_ERR_PARAM_INFO_SID, j->locks[i].sid);
+		ret = EXIT_FAILURE;
+	} else {
+		j->locks[i].datastore = target;
+		j->locks[i].sid = strdup(session_id);
+		j->locks[i].time = nc_time2datetime(time(NULL), NULL);
+	}
+	pthread_mutex_unlock(&j->lock);
+
+	return ret;
+}
+
+static int journal_unlock(void* data, NC_DATASTORE target, const char* session_id, struct nc_err** error) {
+	struct np_journal* j = (struct np_journal*)data;
+	int i, ret = EXIT_FAILURE;
+
+	if ((i = journal_ds_index(target)) == -1) {
+		*error = journal_error(NC_ERR_BAD_ELEM, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&j->lock);
+	if (j->locks[i].sid == NULL) {
+		*error = journal_error(NC_ERR_OP_FAILED, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
+	} else if (strcmp(j->locks[i].sid, session_id) != 0) {
+		*error = journal_error(NC_ERR_LOCK_DENIED, NC_ERR_PARAM_INFO_SID, j->locks[i].sid);
+	} else {
+		free(j->locks[i].sid);
+		free(j->locks[i].time);
+		j->locks[i].sid = NULL;
+		j->locks[i].time = NULL;
+		ret = EXIT_SUCCESS;
+	}
+	pthread_mutex_unlock(&j->lock);
+
+	return ret;
+}
+
+static char* journal_getconfig(void* data, NC_DATASTORE target, struct nc_err** error) {
+	struct np_journal* j = (struct np_journal*)data;
+	char* ret;
+	int i;
+
+	if ((i = journal_ds_index(target)) == -1) {
+		*error = journal_error(NC_ERR_BAD_ELEM, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&j->lock);
+	ret = config_dump(j->config[i]);
+	pthread_mutex_unlock(&j->lock);
+
+	if (ret == NULL) {
+		*error = journal_error(NC_ERR_OP_FAILED, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+	}
+	return ret;
+}
+
+static int journal_copyconfig(void* data, NC_DATASTORE target, NC_DATASTORE source, char* config, struct nc_err** error) {
+	struct np_journal* j = (struct np_journal*)data;
+	xmlDocPtr doc;
+	int i, s, ret;
+
+	if ((i = journal_ds_index(target)) == -1) {
+		*error = journal_error(NC_ERR_BAD_ELEM, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return EXIT_FAILURE;
+	}
+	if (source != NC_DATASTORE_CONFIG && (s = journal_ds_index(source)) == -1) {
+		*error = journal_error(NC_ERR_BAD_ELEM, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&j->lock);
+	if (source == NC_DATASTORE_CONFIG) {
+		if ((doc = config_parse(config)) == NULL) {
+			pthread_mutex_unlock(&j->lock);
+			*error = journal_error(NC_ERR_INVALID_VALUE, NC_ERR_PARAM_MSG, "Invalid configuration data.");
+			return EXIT_FAILURE;
+		}
+	} else {
+		doc = xmlCopyDoc(j->config[s], 1);
+	}
+	ret = journal_commit(j, i, doc, error);
+	pthread_mutex_unlock(&j->lock);
+
+	return ret;
+}
+
+static int journal_deleteconfig(void* data, NC_DATASTORE target, struct nc_err** error) {
+	struct np_journal* j = (struct np_journal*)data;
+	int i, ret;
+
+	if ((i = journal_ds_index(target)) == -1) {
+		*error = journal_error(NC_ERR_BAD_ELEM, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&j->lock);
+	ret = journal_commit(j, i, config_new(), error);
+	pthread_mutex_unlock(&j->lock);
+
+	return ret;
+}
+
+int np_journal_set(struct ncds_ds* ds, const char* path, unsigned int sync_delay) {
+	/* no editconfig, libnetconf edits the getconfig() result and passes it to copyconfig() */
+	static const struct ncds_custom_funcs funcs = {
+		.init = journal_init,
+		.free = journal_free,
+		.was_changed = journal_was_changed,
+		.rollback = journal_rollback,
+		.get_lockinfo = journal_get_lockinfo,
+		.lock = journal_lock,
+		.unlock = journal_unlock,
+		.getconfig = journal_getconfig,
+		.copyconfig = journal_copyconfig,
+		.deleteconfig = journal_deleteconfig,
+		.editconfig = NULL
+	};
+	struct np_journal* j;
+	pthread_condattr_t attr;
+
+	if ((j = calloc(1, sizeof(struct np_journal))) == NULL || (j->path = strdup(path)) == NULL
+			|| asprintf(&j->journal_path, "%s.journal", path) == -1) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		if (j != NULL) {
+			free(j->path);
+		}
+		free(j);
+		return EXIT_FAILURE;
+	}
+	j->fd = -1;
+	j->sync_delay = sync_delay;
+	pthread_mutex_init(&j->lock, NULL);
+	/* the deadlines are in np_clock_ms() time */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&j->sync_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	ncds_custom_set_data(ds, j, &funcs);
+	return EXIT_SUCCESS;
+}
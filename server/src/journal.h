@@ -0,0 +1,62 @@
+/**
+ * @file journal.h
+ * @author agent <agent@local>
+ * @brief Netopeer server journaled datastore
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <libnetconf.h>
+
+/**
+ * @brief Make a datastore created with NCDS_TYPE_CUSTOM a journaled one. The
+ * configuration is kept in memory, each change is appended to a journal as
+ * the list of the modified subtrees and once the journal outgrows the snapshot
+ * of the datastores, it is compacted into a new one. Must be called before
+ * ncds_init(), which loads the snapshot and replays the journal.
+ *
+ * @param ds Datastore to be journaled, it becomes the owner of the journal
+ * @param path Path of the snapshot, the journal is the same path with the
+ * ".journal" suffix
+ * @param sync_delay Maximum time in ms a change may wait for being synced to
+ * the disk so that more changes are synced at once, 0 to sync every change
+ * before it is confirmed
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_journal_set(struct ncds_ds* ds, const char* path, unsigned int sync_delay);
+
+#endif /* _JOURNAL_H_ */
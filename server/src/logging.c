@@ -0,0 +1,468 @@
+/**
+ * @file logging.c
+ * @author agent <agent@local>
+ * @brief Netopeer server asynchronous logging
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "stats.h"
+#include "logging.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+struct log_record {
+	NC_VERB_LEVEL level;
+	unsigned int len;
+	char msg[LOG_MSG_SIZE];
+};
+
+/*
+ * Every thread logging while the asynchronous mode is on writes into its own
+ * ring, so the callers never wait for each other or for syslog. A single
+ * thread drains all the rings every LOG_FLUSH_INTERVAL, or sooner when
+ * a ring gets half full. The records of a full ring are dropped and counted.
+ */
+struct log_ring {
+	/* written by the owning thread */
+	volatile unsigned int head;
+	volatile int writing;		// checking the mode and writing a record, see np_log_async()
+	uint64_t dropped;
+	volatile int orphaned;		// the thread exited, freed once drained
+
+	/* written by the drain thread */
+	volatile unsigned int tail __attribute__((aligned(CACHELINE_SIZE)));
+	struct log_ring* next;
+
+	struct log_record records[LOG_RING_SIZE];
+};
+
+static __thread struct log_ring* thread_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+static struct {
+	volatile int async;
+	volatile int stop;
+	pthread_t tid;
+	int running;
+	int wakefd;				// eventfd interrupting the drain thread when a ring is half full
+
+	/* locked when adding or removing rings and when draining them */
+	pthread_mutex_t rings_lock;
+	struct log_ring* rings;
+
+	/* locked when writing a message out, the file can be changed and reopened */
+	pthread_mutex_t sink_lock;
+	FILE* file;
+	char* path;
+
+	/* the last message written out by the drain thread, the same ones following are only counted */
+	NC_VERB_LEVEL last_level;
+	unsigned int last_len;
+	char last_msg[LOG_MSG_SIZE];
+	uint64_t last_time;
+	unsigned int repeats;
+} logger = {
+	.wakefd = -1,
+	.rings_lock = PTHREAD_MUTEX_INITIALIZER,
+	.sink_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static const char* level_name(NC_VERB_LEVEL level) {
+	switch (level) {
+	case NC_VERB_ERROR:
+		return "ERROR";
+	case NC_VERB_WARNING:
+		return "WARNING";
+	case NC_VERB_VERBOSE:
+		return "VERBOSE";
+	default:
+		return "DEBUG";
+	}
+}
+
+/* write out a message to the file or syslog */
+static void log_write(NC_VERB_LEVEL level, const char* msg) {
+	struct timespec ts;
+	struct tm tm;
+	char timestr[32];
+
+	/* SINK LOCK */
+	pthread_mutex_lock(&logger.sink_lock);
+	if (logger.file != NULL) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		localtime_r(&ts.tv_sec, &tm);
+		strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", &tm);
+		fprintf(logger.file, "%s.%03ld [%d] %s: %s\n", timestr, ts.tv_nsec / 1000000, getpid(), level_name(level), msg);
+		if (!logger.async) {
+			fflush(logger.file);
+		}
+		/* SINK UNLOCK */
+		pthread_mutex_unlock(&logger.sink_lock);
+		return;
+	}
+	/* SINK UNLOCK */
+	pthread_mutex_unlock(&logger.sink_lock);
+
+	switch (level) {
+	case NC_VERB_ERROR:
+		syslog(LOG_ERR, "%s", msg);
+		break;
+	case NC_VERB_WARNING:
+		syslog(LOG_WARNING, "%s", msg);
+		break;
+	case NC_VERB_VERBOSE:
+		syslog(LOG_INFO, "%s", msg);
+		break;
+	case NC_VERB_DEBUG:
+		syslog(LOG_DEBUG, "%s", msg);
+		break;
+	}
+}
+
+/* the drain thread only, report the suppressed repetitions of the last message */
+static void log_flush_repeats(void) {
+	char msg[64];
+
+	if (logger.repeats == 0) {
+		return;
+	}
+	snprintf(msg, sizeof(msg), "Last message repeated %u times.", logger.repeats);
+	log_write(logger.last_level, msg);
+	logger.repeats = 0;
+}
+
+/* the drain thread only */
+static void log_emit(NC_VERB_LEVEL level, const char* msg, unsigned int len, uint64_t now) {
+	if (level == logger.last_level && len == logger.last_len && now < logger.last_time + LOG_REPEAT_WINDOW * 1000ULL
+			&& memcmp(msg, logger.last_msg, len) == 0) {
+		++logger.repeats;
+		np_stat_inc(NP_STAT_LOG_SUPPRESSED);
+		return;
+	}
+
+	log_flush_repeats();
+	log_write(level, msg);
+
+	logger.last_level = level;
+	logger.last_len = len;
+	memcpy(logger.last_msg, msg, len + 1);
+	logger.last_time = now;
+}
+
+static void ring_destroy(void* arg) {
+	struct log_ring* ring = (struct log_ring*)arg;
+
+	/* any later message of this thread gets a new ring */
+	thread_ring = NULL;
+	__atomic_store_n(&ring->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+static void ring_key_create(void) {
+	if (pthread_key_create(&ring_key, ring_destroy) != 0) {
+		/* no nc_verb_error(), it would log again */
+		syslog(LOG_ERR, "%s: failed to create a thread-specific key", __func__);
+	}
+}
+
+static struct log_ring* ring_get(void) {
+	struct log_ring* ring;
+
+	if (thread_ring != NULL) {
+		return thread_ring;
+	}
+
+	pthread_once(&ring_once, ring_key_create);
+	ring = calloc(1, sizeof(struct log_ring));
+	if (ring == NULL || pthread_setspecific(ring_key, ring) != 0) {
+		free(ring);
+		return NULL;
+	}
+
+	/* RINGS LOCK */
+	pthread_mutex_lock(&logger.rings_lock);
+	ring->next = logger.rings;
+	logger.rings = ring;
+	/* RINGS UNLOCK */
+	pthread_mutex_unlock(&logger.rings_lock);
+
+	thread_ring = ring;
+	return ring;
+}
+
+/* returns EXIT_FAILURE if the message is to be written out right away */
+static int log_queue(NC_VERB_LEVEL level, const char* msg) {
+	struct log_ring* ring;
+	struct log_record* record;
+	unsigned int head, tail;
+	size_t len;
+	uint64_t one = 1;
+
+	len = strlen(msg);
+	if (len >= LOG_MSG_SIZE || (ring = ring_get()) == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	__atomic_store_n(&ring->writing, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&logger.async, __ATOMIC_SEQ_CST)) {
+		/* switched off meanwhile */
+		__atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+		return EXIT_FAILURE;
+	}
+
+	head = ring->head;
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (head - tail == LOG_RING_SIZE) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+		return EXIT_SUCCESS;
+	}
+
+	record = &ring->records[head % LOG_RING_SIZE];
+	record->level = level;
+	record->len = len;
+	memcpy(record->msg, msg, len + 1);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+
+	/* wake the drain thread only once per filling */
+	if (head + 1 - tail == LOG_RING_SIZE / 2 && write(logger.wakefd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+		syslog(LOG_ERR, "%s: write failed (%s)", __func__, strerror(errno));
+	}
+	return EXIT_SUCCESS;
+}
+
+/* the drain thread only, write out all the queued records */
+static void log_drain(void) {
+	struct log_ring* ring, **link;
+	struct log_record* record;
+	unsigned int head, tail;
+	uint64_t dropped, now;
+	char msg[64];
+
+	now = np_clock_ms();
+
+	/* RINGS LOCK */
+	pthread_mutex_lock(&logger.rings_lock);
+	for (link = &logger.rings; (ring = *link) != NULL;) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		for (tail = ring->tail; tail != head; ++tail) {
+			record = &ring->records[tail % LOG_RING_SIZE];
+			log_emit(record->level, record->msg, record->len, now);
+			__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+		}
+
+		if ((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) != 0) {
+			np_stat_add(NP_STAT_LOG_DROPPED, dropped);
+			log_flush_repeats();
+			snprintf(msg, sizeof(msg), "%" PRIu64 " log messages dropped.", dropped);
+			log_write(NC_VERB_WARNING, msg);
+		}
+
+		/* the owner is gone and it was empty before it left */
+		if (__atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE) && __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+			*link = ring->next;
+			free(ring);
+			continue;
+		}
+		link = &ring->next;
+	}
+	/* RINGS UNLOCK */
+	pthread_mutex_unlock(&logger.rings_lock);
+
+	if (now >= logger.last_time + LOG_REPEAT_WINDOW * 1000ULL) {
+		log_flush_repeats();
+		logger.last_len = 0;
+	}
+
+	/* SINK LOCK */
+	pthread_mutex_lock(&logger.sink_lock);
+	if (logger.file != NULL) {
+		fflush(logger.file);
+	}
+	/* SINK UNLOCK */
+	pthread_mutex_unlock(&logger.sink_lock);
+}
+
+static void* log_thread(void* UNUSED(arg)) {
+	struct pollfd pfd;
+	uint64_t count;
+
+	pfd.fd = logger.wakefd;
+	pfd.events = POLLIN;
+	while (!logger.stop) {
+		if (poll(&pfd, 1, LOG_FLUSH_INTERVAL) == 1 && read(logger.wakefd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+			syslog(LOG_ERR, "%s: read failed (%s)", __func__, strerror(errno));
+		}
+		log_drain();
+	}
+
+	/* the writers are done by now */
+	log_drain();
+	log_flush_repeats();
+	return NULL;
+}
+
+void np_log(NC_VERB_LEVEL level, const char* msg) {
+	if (__atomic_load_n(&logger.async, __ATOMIC_RELAXED) && log_queue(level, msg) == EXIT_SUCCESS) {
+		return;
+	}
+	log_write(level, msg);
+}
+
+int np_log_async(int enable) {
+	struct log_ring* ring;
+	int ret;
+
+	if (enable && !logger.running) {
+		if ((logger.wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+			nc_verb_error("%s: eventfd failed (%s)", __func__, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		logger.stop = 0;
+		if ((ret = pthread_create(&logger.tid, NULL, log_thread, NULL)) != 0) {
+			nc_verb_error("%s: failed to create a thread (%s)", __func__, strerror(ret));
+			close(logger.wakefd);
+			logger.wakefd = -1;
+			return EXIT_FAILURE;
+		}
+		logger.running = 1;
+		__atomic_store_n(&logger.async, 1, __ATOMIC_SEQ_CST);
+		nc_verb_verbose("Asynchronous logging started.");
+	} else if (!enable && logger.running) {
+		__atomic_store_n(&logger.async, 0, __ATOMIC_SEQ_CST);
+
+		/* wait for the threads that saw the mode still on */
+		/* RINGS LOCK */
+		pthread_mutex_lock(&logger.rings_lock);
+		for (ring = logger.rings; ring != NULL; ring = ring->next) {
+			while (__atomic_load_n(&ring->writing, __ATOMIC_SEQ_CST)) {
+				sched_yield();
+			}
+		}
+		/* RINGS UNLOCK */
+		pthread_mutex_unlock(&logger.rings_lock);
+
+		logger.stop = 1;
+		if ((ret = pthread_join(logger.tid, NULL)) != 0) {
+			nc_verb_error("%s: failed to join the logging thread (%s)", __func__, strerror(ret));
+		}
+		logger.running = 0;
+		close(logger.wakefd);
+		logger.wakefd = -1;
+		nc_verb_verbose("Asynchronous logging stopped.");
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int np_log_file(const char* path) {
+	FILE* file = NULL, *old;
+	char* new_path = NULL;
+
+	if (path != NULL) {
+		if ((file = fopen(path, "a")) == NULL) {
+			nc_verb_error("%s: unable to open \"%s\" (%s)", __func__, path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		if ((new_path = strdup(path)) == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			fclose(file);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* SINK LOCK */
+	pthread_mutex_lock(&logger.sink_lock);
+	old = logger.file;
+	logger.file = file;
+	free(logger.path);
+	logger.path = new_path;
+	/* SINK UNLOCK */
+	pthread_mutex_unlock(&logger.sink_lock);
+
+	if (old != NULL) {
+		fclose(old);
+	}
+	return EXIT_SUCCESS;
+}
+
+void np_log_reopen(void) {
+	FILE* file;
+
+	/* SINK LOCK */
+	pthread_mutex_lock(&logger.sink_lock);
+	if (logger.path != NULL && (file = fopen(logger.path, "a")) != NULL) {
+		/* rotated, new messages go to a new file */
+		fclose(logger.file);
+		logger.file = file;
+	}
+	/* SINK UNLOCK */
+	pthread_mutex_unlock(&logger.sink_lock);
+}
+
+void np_log_cleanup(void) {
+	struct log_ring* ring;
+
+	np_log_async(0);
+	np_log_file(NULL);
+
+	/* RINGS LOCK */
+	pthread_mutex_lock(&logger.rings_lock);
+	while ((ring = logger.rings) != NULL) {
+		logger.rings = ring->next;
+		free(ring);
+	}
+	thread_ring = NULL;
+	/* RINGS UNLOCK */
+	pthread_mutex_unlock(&logger.rings_lock);
+}
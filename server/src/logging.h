@@ -0,0 +1,82 @@
+/**
+ * @file logging.h
+ * @author agent <agent@local>
+ * @brief Netopeer server asynchronous logging header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _LOGGING_H_
+#define _LOGGING_H_
+
+#include <libnetconf.h>
+
+/**
+ * @brief Write out a message, only queue it if the asynchronous
+ * logging is on, can be called from any thread
+ *
+ * @param level Verbosity level of the message
+ * @param msg Message to write out
+ */
+void np_log(NC_VERB_LEVEL level, const char* msg);
+
+/**
+ * @brief Switch the asynchronous logging, switching it off writes out
+ * all the queued messages first
+ *
+ * @param enable 1 to queue the messages, 0 to write them out right away
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_log_async(int enable);
+
+/**
+ * @brief Write the messages into a file instead of syslog
+ *
+ * @param path File to append to, NULL for syslog
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_log_file(const char* path);
+
+/**
+ * @brief Reopen the log file, after it was rotated
+ */
+void np_log_reopen(void);
+
+/**
+ * @brief Stop the asynchronous logging, close the file and free all the rings
+ */
+void np_log_cleanup(void);
+
+#endif /* _LOGGING_H_ */
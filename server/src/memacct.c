@@ -0,0 +1,281 @@
+/**
+ * @file memacct.c
+ * @author agent <agent@local>
+ * @brief Netopeer server memory accounting of the sessions
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "stats.h"
+#include "memacct.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+extern struct np_options netopeer_options;
+
+struct np_memacct {
+	char* sid;
+	char* user;
+	volatile int refs;
+	volatile uint64_t used[NP_MEM_USE_COUNT];
+	volatile uint64_t total;
+	struct np_memacct* prev;
+	struct np_memacct* next;
+};
+
+/*
+ * The memory held for the sessions between the RPC execution and the transport,
+ * the data replies waiting to be sent or being streamed and the notifications
+ * queued for the subscribers. The memory of the RPC being executed is only
+ * bounded by refusing to start it while the session or all of them are over
+ * their budget, a finished data reply is then checked against the budgets
+ * before it is queued.
+ */
+static struct {
+	/* locked when accessing the list */
+	pthread_mutex_t lock;
+	struct np_memacct* sessions;
+	unsigned int count;
+	volatile uint64_t total;
+} accts = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/* the budgets are configured in KiB, 0 is unlimited */
+static uint64_t budget_bytes(uint32_t budget) {
+	return (budget == 0 ? UINT64_MAX : (uint64_t)budget << 10);
+}
+
+static struct nc_err* memacct_denied(const char* msg) {
+	struct nc_err* err;
+
+	np_stat_inc(NP_STAT_MEM_DENIED);
+	err = nc_err_new(NC_ERR_RES_DENIED);
+	nc_err_set(err, NC_ERR_PARAM_TYPE, "application");
+	nc_err_set(err, NC_ERR_PARAM_MSG, msg);
+	return err;
+}
+
+struct np_memacct* np_memacct_new(struct nc_session* session) {
+	struct np_memacct* acct;
+	const char* user;
+
+	if ((acct = calloc(1, sizeof(struct np_memacct))) == NULL || (acct->sid = strdup(nc_session_get_id(session))) == NULL
+			|| (acct->user = strdup((user = nc_session_get_user(session)) != NULL ? user : "")) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		if (acct != NULL) {
+			free(acct->sid);
+		}
+		free(acct);
+		return NULL;
+	}
+	acct->refs = 1;
+
+	/* LIST LOCK */
+	pthread_mutex_lock(&accts.lock);
+	acct->next = accts.sessions;
+	if (accts.sessions != NULL) {
+		accts.sessions->prev = acct;
+	}
+	accts.sessions = acct;
+	++accts.count;
+	/* LIST UNLOCK */
+	pthread_mutex_unlock(&accts.lock);
+
+	return acct;
+}
+
+struct np_memacct* np_memacct_ref(struct np_memacct* acct) {
+	if (acct != NULL) {
+		__sync_fetch_and_add(&acct->refs, 1);
+	}
+	return acct;
+}
+
+void np_memacct_unref(struct np_memacct* acct) {
+	if (acct == NULL || __sync_sub_and_fetch(&acct->refs, 1) > 0) {
+		return;
+	}
+
+	/* LIST LOCK */
+	pthread_mutex_lock(&accts.lock);
+	if (acct->prev == NULL) {
+		accts.sessions = acct->next;
+	} else {
+		acct->prev->next = acct->next;
+	}
+	if (acct->next != NULL) {
+		acct->next->prev = acct->prev;
+	}
+	--accts.count;
+	/* LIST UNLOCK */
+	pthread_mutex_unlock(&accts.lock);
+
+	if (acct->total > 0) {
+		nc_verb_error("%s: internal error: %" PRIu64 " bytes of the session %s still accounted", __func__, acct->total, acct->sid);
+		__sync_fetch_and_sub(&accts.total, acct->total);
+	}
+	free(acct->sid);
+	free(acct->user);
+	free(acct);
+}
+
+int np_memacct_charge(struct np_memacct* acct, enum np_mem_use use, size_t bytes) {
+	uint64_t session, total;
+
+	if (acct == NULL || bytes == 0) {
+		return EXIT_SUCCESS;
+	}
+
+	session = __sync_add_and_fetch(&acct->total, bytes);
+	total = __sync_add_and_fetch(&accts.total, bytes);
+	if (session > budget_bytes(netopeer_options.mem_session_budget) || total > budget_bytes(netopeer_options.mem_total_budget)) {
+		__sync_fetch_and_sub(&acct->total, bytes);
+		__sync_fetch_and_sub(&accts.total, bytes);
+		return EXIT_FAILURE;
+	}
+	__sync_fetch_and_add(&acct->used[use], bytes);
+
+	return EXIT_SUCCESS;
+}
+
+void np_memacct_force(struct np_memacct* acct, enum np_mem_use use, size_t bytes) {
+	if (acct == NULL || bytes == 0) {
+		return;
+	}
+
+	__sync_fetch_and_add(&acct->used[use], bytes);
+	__sync_fetch_and_add(&acct->total, bytes);
+	__sync_fetch_and_add(&accts.total, bytes);
+}
+
+void np_memacct_release(struct np_memacct* acct, enum np_mem_use use, size_t bytes) {
+	if (acct == NULL || bytes == 0) {
+		return;
+	}
+
+	__sync_fetch_and_sub(&acct->used[use], bytes);
+	__sync_fetch_and_sub(&acct->total, bytes);
+	__sync_fetch_and_sub(&accts.total, bytes);
+}
+
+struct nc_err* np_memacct_check(struct np_memacct* acct) {
+	if (acct == NULL) {
+		return NULL;
+	}
+
+	if (acct->total >= budget_bytes(netopeer_options.mem_session_budget)) {
+		return memacct_denied("The replies and notifications of the session not read yet exceed session-budget.");
+	}
+	if (accts.total >= budget_bytes(netopeer_options.mem_total_budget)) {
+		return memacct_denied("The replies and notifications of all the sessions not read yet exceed total-budget.");
+	}
+	return NULL;
+}
+
+int np_memacct_enabled(void) {
+	return (netopeer_options.mem_session_budget != 0 || netopeer_options.mem_total_budget != 0 || netopeer_options.mem_reply_budget != 0);
+}
+
+struct nc_err* np_memacct_charge_reply(struct np_memacct* acct, size_t bytes) {
+	uint64_t budget;
+	struct nc_err* err;
+	char* msg;
+
+	if (bytes > (budget = budget_bytes(netopeer_options.mem_reply_budget))) {
+		if (asprintf(&msg, "The reply of %zu bytes exceeds reply-budget of %" PRIu64 " bytes, use a filter.", bytes, budget) == -1) {
+			return memacct_denied("The reply exceeds reply-budget, use a filter.");
+		}
+		err = memacct_denied(msg);
+		free(msg);
+		return err;
+	}
+	if (np_memacct_charge(acct, NP_MEM_REPLIES, bytes) != EXIT_SUCCESS) {
+		return memacct_denied("The reply would exceed session-budget or total-budget, the replies and notifications not read yet are to be read first.");
+	}
+	return NULL;
+}
+
+struct np_memacct_usage* np_memacct_usage(unsigned int* count, uint64_t* total) {
+	struct np_memacct_usage* usage;
+	struct np_memacct* acct;
+	unsigned int i, j;
+
+	*count = 0;
+	*total = accts.total;
+
+	/* LIST LOCK */
+	pthread_mutex_lock(&accts.lock);
+	if (accts.count == 0 || (usage = calloc(accts.count, sizeof(struct np_memacct_usage))) == NULL) {
+		/* LIST UNLOCK */
+		pthread_mutex_unlock(&accts.lock);
+		return NULL;
+	}
+	for (i = 0, acct = accts.sessions; acct != NULL; ++i, acct = acct->next) {
+		usage[i].sid = strdup(acct->sid);
+		usage[i].user = strdup(acct->user);
+		for (j = 0; j < NP_MEM_USE_COUNT; ++j) {
+			usage[i].used[j] = acct->used[j];
+		}
+	}
+	*count = accts.count;
+	/* LIST UNLOCK */
+	pthread_mutex_unlock(&accts.lock);
+
+	return usage;
+}
+
+void np_memacct_usage_free(struct np_memacct_usage* usage, unsigned int count) {
+	unsigned int i;
+
+	if (usage == NULL) {
+		return;
+	}
+	for (i = 0; i < count; ++i) {
+		free(usage[i].sid);
+		free(usage[i].user);
+	}
+	free(usage);
+}
@@ -0,0 +1,162 @@
+/**
+ * @file memacct.h
+ * @author agent <agent@local>
+ * @brief Netopeer server memory accounting of the sessions
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _MEMACCT_H_
+#define _MEMACCT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libnetconf.h>
+
+/* memory held for a NETCONF session */
+struct np_memacct;
+
+enum np_mem_use {
+	NP_MEM_REPLIES,			/**< replies executed, but not taken by the transport yet */
+	NP_MEM_STREAMS,			/**< replies being streamed to the transport */
+	NP_MEM_NOTIFS,			/**< notifications queued for the subscriber */
+	NP_MEM_USE_COUNT
+};
+
+/**
+ * @brief Start accounting the memory of a new session
+ *
+ * @param session NETCONF session, only its ID and user are kept
+ *
+ * @return New accounting with a single reference, NULL on error
+ */
+struct np_memacct* np_memacct_new(struct nc_session* session);
+
+/**
+ * @brief Take another reference, for anything that can outlive the RPC queue of the session
+ *
+ * @param acct Accounting of the session, can be NULL
+ *
+ * @return acct
+ */
+struct np_memacct* np_memacct_ref(struct np_memacct* acct);
+
+/**
+ * @brief Drop a reference, the accounting is removed with the last one
+ *
+ * @param acct Accounting of the session, can be NULL
+ */
+void np_memacct_unref(struct np_memacct* acct);
+
+/**
+ * @brief Account memory unless it exceeds the session or the total budget
+ *
+ * @param acct Accounting of the session, can be NULL
+ * @param use What the memory is held for
+ * @param bytes Size of the memory
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if a budget would be exceeded and nothing was accounted
+ */
+int np_memacct_charge(struct np_memacct* acct, enum np_mem_use use, size_t bytes);
+
+/**
+ * @brief Account memory that is held already, regardless of the budgets
+ *
+ * @param acct Accounting of the session, can be NULL
+ * @param use What the memory is held for
+ * @param bytes Size of the memory
+ */
+void np_memacct_force(struct np_memacct* acct, enum np_mem_use use, size_t bytes);
+
+/**
+ * @brief Stop accounting memory that was freed
+ *
+ * @param acct Accounting of the session, can be NULL
+ * @param use What the memory was held for
+ * @param bytes Size of the memory, as it was accounted
+ */
+void np_memacct_release(struct np_memacct* acct, enum np_mem_use use, size_t bytes);
+
+/**
+ * @brief Check whether a session may execute another RPC, the one over its budget
+ * or any when the total budget is exhausted may not until some memory is released
+ *
+ * @param acct Accounting of the session, can be NULL
+ *
+ * @return NULL if it may, resource-denied error otherwise
+ */
+struct nc_err* np_memacct_check(struct np_memacct* acct);
+
+/**
+ * @brief Learn whether any of the budgets is set, the replies are measured only then
+ *
+ * @return Non-zero if set, 0 if all of them are unlimited
+ */
+int np_memacct_enabled(void);
+
+/**
+ * @brief Account a data reply unless it exceeds reply-budget, the session or the total budget
+ *
+ * @param acct Accounting of the session, can be NULL
+ * @param bytes Size of the reply data
+ *
+ * @return NULL if it was accounted as NP_MEM_REPLIES, resource-denied error otherwise
+ */
+struct nc_err* np_memacct_charge_reply(struct np_memacct* acct, size_t bytes);
+
+/* memory usage of a session */
+struct np_memacct_usage {
+	char* sid;
+	char* user;
+	uint64_t used[NP_MEM_USE_COUNT];
+};
+
+/**
+ * @brief Get the memory usage of all the sessions
+ *
+ * @param[out] count Number of the sessions
+ * @param[out] total Memory held for all of them
+ *
+ * @return Array of count usages to be freed by np_memacct_usage_free(), NULL if there are none
+ */
+struct np_memacct_usage* np_memacct_usage(unsigned int* count, uint64_t* total);
+
+/**
+ * @brief Free the usages returned by np_memacct_usage()
+ *
+ * @param usage Array of usages
+ * @param count Number of usages
+ */
+void np_memacct_usage_free(struct np_memacct_usage* usage, unsigned int count);
+
+#endif /* _MEMACCT_H_ */
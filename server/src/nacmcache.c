@@ -0,0 +1,177 @@
+/**
+ * @file nacmcache.c
+ * @author agent <agent@local>
+ * @brief Netopeer server cache of the NACM notification decisions
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "hash.h"
+#include "stats.h"
+#include "nacmcache.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+struct nacm_decision {
+	char* user;
+	char* event;			// namespace and name of the event
+	uint32_t hash;
+	int decision;			// NACM_PERMIT or not
+	uint64_t expires;		// np_clock_ms() the decision is valid until
+	unsigned int gen;		// generation of the NACM rules it was made with
+};
+
+/*
+ * libnetconf evaluates the NACM rule lists of the user for every notification
+ * sent to every subscriber. The result depends only on the user (and so its
+ * groups) and the notification, so it is reused for all the following events
+ * of the same name. Any RPC that can modify the NACM datastore starts a new
+ * generation and so drops the cache, NACM_CACHE_TTL covers the groups defined
+ * outside of it.
+ */
+static struct {
+	pthread_mutex_t lock;
+	struct nacm_decision entries[NACM_CACHE_SIZE];	// direct-mapped by the hash
+	unsigned int gen;
+} cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.gen = 1
+};
+
+static uint32_t decision_hash(const char* user, const char* event) {
+	return np_hash_str(np_hash_str(NP_HASH_INIT, user), event);
+}
+
+int np_nacmcache_check_notification(const nc_ntf* ntf, const char* event, const struct nc_session* session) {
+	struct nacm_decision* entry;
+	const char* user;
+	char* new_user, *new_event;
+	unsigned int gen;
+	uint32_t hash;
+	uint64_t now;
+	int decision;
+
+	user = nc_session_get_user(session);
+	if (event == NULL || user == NULL) {
+		return nacm_check_notification(ntf, session);
+	}
+	hash = decision_hash(user, event);
+	entry = &cache.entries[hash % NACM_CACHE_SIZE];
+	now = np_clock_ms();
+
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache.lock);
+	if (entry->gen == cache.gen && entry->hash == hash && entry->expires > now
+			&& strcmp(entry->event, event) == 0 && strcmp(entry->user, user) == 0) {
+		decision = entry->decision;
+		/* CACHE UNLOCK */
+		pthread_mutex_unlock(&cache.lock);
+
+		np_stat_inc(NP_STAT_NACM_CACHE_HITS);
+		return decision;
+	}
+	gen = cache.gen;
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache.lock);
+
+	np_stat_inc(NP_STAT_NACM_CACHE_MISSES);
+	decision = nacm_check_notification(ntf, session);
+
+	new_user = strdup(user);
+	new_event = strdup(event);
+	if (new_user == NULL || new_event == NULL) {
+		free(new_user);
+		free(new_event);
+		return decision;
+	}
+
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache.lock);
+	if (gen == cache.gen) {
+		/* the rules did not change meanwhile */
+		free(entry->user);
+		free(entry->event);
+		entry->user = new_user;
+		entry->event = new_event;
+		new_user = NULL;
+		new_event = NULL;
+		entry->hash = hash;
+		entry->decision = decision;
+		entry->expires = now + NACM_CACHE_TTL * 1000ULL;
+		entry->gen = gen;
+	}
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache.lock);
+
+	free(new_user);
+	free(new_event);
+	return decision;
+}
+
+void np_nacmcache_invalidate(void) {
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache.lock);
+	/* the entries of the previous generations are never matched */
+	++cache.gen;
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache.lock);
+}
+
+void np_nacmcache_cleanup(void) {
+	unsigned int i;
+
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache.lock);
+
+	for (i = 0; i < NACM_CACHE_SIZE; ++i) {
+		free(cache.entries[i].user);
+		free(cache.entries[i].event);
+		cache.entries[i].user = NULL;
+		cache.entries[i].event = NULL;
+		cache.entries[i].gen = 0;
+	}
+	++cache.gen;
+
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache.lock);
+}
@@ -0,0 +1,69 @@
+/**
+ * @file nacmcache.h
+ * @author agent <agent@local>
+ * @brief Netopeer server cache of the NACM notification decisions
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _NACMCACHE_H_
+#define _NACMCACHE_H_
+
+#include <libnetconf.h>
+
+/* namespace of the ietf-netconf-acm rules */
+#define NP_NACM_NS "urn:ietf:params:xml:ns:yang:ietf-netconf-acm"
+
+/**
+ * @brief Check whether a notification can be sent to a session, the decision
+ * is cached for the user of the session and the event
+ *
+ * @param ntf Notification
+ * @param event Namespace and name of the event, NULL to always ask libnetconf
+ * @param session Session to send the notification to
+ *
+ * @return NACM_PERMIT if allowed
+ */
+int np_nacmcache_check_notification(const nc_ntf* ntf, const char* event, const struct nc_session* session);
+
+/**
+ * @brief Drop all the decisions, called whenever the NACM datastore could change
+ */
+void np_nacmcache_invalidate(void);
+
+/**
+ * @brief Free the cache, no checks must be in progress
+ */
+void np_nacmcache_cleanup(void);
+
+#endif /* _NACMCACHE_H_ */
@@ -47,6 +47,7 @@
 #define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
@@ -55,6 +56,7 @@
 #include <pthread.h>
 #include <sys/poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
@@ -62,6 +64,7 @@
 #include <netinet/in.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <libxml/tree.h>
@@ -325,196 +328,638 @@ static xmlNodePtr find_node(xmlNodePtr parent, xmlChar* name) {
 	return NULL;
 }
 
-static struct client_struct* sock_connect(const char* address, uint16_t port) {
-	struct client_struct* ret;
-	int is_ipv4;
+/* call home app states */
+#define CH_WAIT 0			/* next connection attempt at next_time */
+#define CH_CONNECTING 1		/* some server sockets are connecting */
+#define CH_QUEUED 2			/* client connected, waiting in the ready queue for the main loop to admit it */
+#define CH_CONNECTED 3		/* client admitted, waiting for it to be removed */
+
+/* a single thread connects all the call home apps */
+static struct {
+	/* locked when accessing callhome_apps, removed or the state of any app */
+	pthread_mutex_t lock;
+	pthread_t tid;
+	int running;
+	volatile int stop;
+	int wakefd;				// eventfd interrupting poll() on config changes and admitted clients
+	unsigned int seed;		// random state of the reconnect jitter
+	struct ch_app* removed;	// unconfigured apps not freed yet, linked by next
+
+	/* the apps with a connected client, pushed lock-free, taken all at once by the main loop */
+	struct ch_app* ready;	// linked by next_ready, the most recent first
+	int readyfd;			// eventfd waking the main loop when ready stops being empty
+} ch_sched = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wakefd = -1,
+	.readyfd = -1
+};
+
+void np_callhome_notify(void) {
+	uint64_t one = 1;
+
+	if (ch_sched.wakefd != -1 && write(ch_sched.wakefd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+		nc_verb_error("%s: write failed (%s)", __func__, strerror(errno));
+	}
+}
+
+static void ch_ready_push(struct ch_app* app) {
+	struct ch_app* head;
+	uint64_t one = 1;
 
+	head = __atomic_load_n(&ch_sched.ready, __ATOMIC_RELAXED);
+	do {
+		app->next_ready = head;
+	} while (!__atomic_compare_exchange_n(&ch_sched.ready, &head, app, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	/* the main loop takes the whole queue, it needs waking only for the first app */
+	if (head == NULL && write(ch_sched.readyfd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+		nc_verb_error("%s: write failed (%s)", __func__, strerror(errno));
+	}
+}
+
+void np_callhome_client_removed(struct client_struct* client) {
+	struct ch_app* app;
+
+	/* SCHED LOCK */
+	pthread_mutex_lock(&ch_sched.lock);
+
+	for (app = callhome_apps; app != NULL && app->client != client; app = app->next);
+	if (app == NULL) {
+		for (app = ch_sched.removed; app != NULL && app->client != client; app = app->next);
+	}
+	if (app != NULL) {
+		/* it may still be CH_QUEUED, the main loop not having called np_callhome_admitted() yet */
+		app->client = NULL;
+		np_callhome_notify();
+	}
+
+	/* SCHED UNLOCK */
+	pthread_mutex_unlock(&ch_sched.lock);
+}
+
+static void ch_server_close(struct ch_server* srv) {
+	if (srv->sock != -1) {
+		close(srv->sock);
+		srv->sock = -1;
+	}
+	srv->revents = 0;
+}
+
+/* start a non-blocking connect, EXIT_FAILURE if it failed right away */
+static int ch_server_connect(struct ch_app* app, struct ch_server* srv, uint64_t now) {
 	struct sockaddr_in* saddr4;
 	struct sockaddr_in6* saddr6;
+	socklen_t len;
 
-	ret = calloc(1, sizeof(struct client_struct));
-	ret->sock = -1;
+	memset(&srv->saddr, 0, sizeof(srv->saddr));
+	if (strchr(srv->address, ':') != NULL) {
+		saddr6 = (struct sockaddr_in6*)&srv->saddr;
 
-	if (strchr(address, ':') != NULL) {
-		is_ipv4 = 0;
+		saddr6->sin6_family = AF_INET6;
+		saddr6->sin6_port = htons(srv->port);
+
+		if (inet_pton(AF_INET6, srv->address, &saddr6->sin6_addr) != 1) {
+			nc_verb_error("%s: failed to convert IPv6 address \"%s\"", __func__, srv->address);
+			return EXIT_FAILURE;
+		}
+		len = sizeof(struct sockaddr_in6);
 	} else {
-		is_ipv4 = 1;
+		saddr4 = (struct sockaddr_in*)&srv->saddr;
+
+		saddr4->sin_family = AF_INET;
+		saddr4->sin_port = htons(srv->port);
+
+		if (inet_pton(AF_INET, srv->address, &saddr4->sin_addr) != 1) {
+			nc_verb_error("%s: failed to convert IPv4 address \"%s\"", __func__, srv->address);
+			return EXIT_FAILURE;
+		}
+		len = sizeof(struct sockaddr_in);
 	}
 
-	if ((ret->sock = socket((is_ipv4 ? AF_INET : AF_INET6), SOCK_STREAM, IPPROTO_TCP)) == -1) {
+	if ((srv->sock = socket(srv->saddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP)) == -1) {
 		nc_verb_error("%s: creating socket failed (%s)", __func__, strerror(errno));
-		goto fail;
+		return EXIT_FAILURE;
 	}
 
-	if (is_ipv4) {
-		saddr4 = (struct sockaddr_in*)&ret->saddr;
+	if (connect(srv->sock, (struct sockaddr*)&srv->saddr, len) == -1 && errno != EINPROGRESS) {
+		nc_verb_error("Call Home (app %s): could not connect to %s:%u (%s)", app->name, srv->address, srv->port, strerror(errno));
+		ch_server_close(srv);
+		return EXIT_FAILURE;
+	}
 
-		saddr4->sin_family = AF_INET;
-		saddr4->sin_port = htons(port);
+	/* even an immediate success is reported by poll() */
+	srv->connect_start = now;
+	srv->revents = 0;
+	return EXIT_SUCCESS;
+}
 
-		if (inet_pton(AF_INET, address, &saddr4->sin_addr) != 1) {
-			nc_verb_error("%s: failed to convert IPv4 address \"%s\"", __func__, address);
-			goto fail;
-		}
+/* the server a new connection starts with, per start-with */
+static void ch_app_restart(struct ch_app* app) {
+	struct ch_server* srv = NULL;
 
-		if (connect(ret->sock, (struct sockaddr*)saddr4, sizeof(struct sockaddr_in)) == -1) {
-			nc_verb_error("Call Home: could not connect to %s:%u (%s)", address, port, strerror(errno));
-			goto fail;
-		}
+	if (app->start_server) {
+		for (srv = app->servers; srv != NULL && !srv->active; srv = srv->next);
+	}
+	app->cur_server = (srv != NULL ? srv : app->servers);
+	app->attempts = 0;
+}
 
-	} else {
-		saddr6 = (struct sockaddr_in6*)&ret->saddr;
+/* schedule the next attempt, the interval doubles after every failed pass over the servers */
+static void ch_app_retry(struct ch_app* app, uint64_t now, int pass_failed) {
+	uint64_t delay;
 
-		saddr6->sin6_family = AF_INET6;
-		saddr6->sin6_port = htons(port);
+	if (pass_failed && app->backoff < 16) {
+		++app->backoff;
+	}
 
-		if (inet_pton(AF_INET6, address, &saddr6->sin6_addr) != 1) {
-			nc_verb_error("%s: failed to convert IPv6 address \"%s\"", __func__, address);
-			goto fail;
-		}
+	delay = (app->rec_interval ? app->rec_interval : 1) * 1000ULL;
+	delay <<= (app->backoff < 10 ? app->backoff : 10);
+	if (delay > CALLHOME_BACKOFF_MAX * 1000ULL) {
+		delay = CALLHOME_BACKOFF_MAX * 1000ULL;
+	}
+	/* +-25 %, so that the apps failing together do not retry together */
+	delay = delay - delay / 4 + rand_r(&ch_sched.seed) % (delay / 2 + 1);
 
-		if (connect(ret->sock, (struct sockaddr*)saddr6, sizeof(struct sockaddr_in6)) == -1) {
-			nc_verb_error("Call Home: could not connect %s:%u (%s)",address, port, strerror(errno));
-			goto fail;
+	app->state = CH_WAIT;
+	app->next_time = now + delay;
+}
+
+/* a connection to the current server failed, count-max attempts are made before moving to the next one */
+static void ch_app_failed(struct ch_app* app, uint64_t now) {
+	int pass_failed = 0;
+
+	if (++app->attempts >= app->rec_count) {
+		app->attempts = 0;
+		app->cur_server = app->cur_server->next;
+		if (app->cur_server == NULL) {
+			app->cur_server = app->servers;
+			pass_failed = 1;
 		}
 	}
+	ch_app_retry(app, now, pass_failed);
+}
 
-	nc_verb_verbose("Call Home: connected to %s:%u", address, port);
-	return ret;
+/* a server connected, the others are closed and the client handed over */
+static void ch_app_connected(struct ch_app* app, struct ch_server* srv, uint64_t now) {
+	struct ch_server* iter;
 
-fail:
-	if (ret->sock != -1) {
-		close(ret->sock);
+	for (iter = app->servers; iter != NULL; iter = iter->next) {
+		iter->active = 0;
+		if (iter != srv) {
+			ch_server_close(iter);
+		}
 	}
-	free(ret);
-	return NULL;
-}
+	srv->active = 1;
+	app->cur_server = srv;
 
-pthread_mutex_t callhome_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t callhome_cond = PTHREAD_COND_INITIALIZER;
-volatile struct ch_app* callhome_app = NULL;
+	if ((app->client = np_client_new(app->transport)) == NULL) {
+		ch_server_close(srv);
+		ch_app_failed(app, now);
+		return;
+	}
+	app->client->sock = srv->sock;
+	memcpy(&app->client->saddr, &srv->saddr, sizeof(srv->saddr));
+	app->client->callhome = 1;
+	srv->sock = -1;
+	srv->revents = 0;
+
+	nc_verb_verbose("Call Home (app %s): connected to %s:%u", app->name, srv->address, srv->port);
+	app->state = CH_QUEUED;
+	ch_ready_push(app);
+}
 
-/* each app has its own thread */
-__attribute__((noreturn))
-static void* app_loop(void* app_v) {
-	struct ch_app* app = (struct ch_app*)app_v;
-	struct ch_server* cur_server = NULL;
-	struct timespec ts;
-	int i, ret;
+/* the next server with parallel-connect, in the list order starting after the current one */
+static struct ch_server* ch_app_untried(struct ch_app* app) {
+	struct ch_server* srv = app->cur_server;
 
-	/* TODO sigmask for the thread? */
+	do {
+		if (!srv->tried) {
+			return srv;
+		}
+		srv = (srv->next != NULL ? srv->next : app->servers);
+	} while (srv != app->cur_server);
 
-	nc_verb_verbose("Starting Call Home thread (%s).", app->name);
+	return NULL;
+}
 
-	nc_session_transport(app->transport);
+static void ch_app_connecting(struct ch_app* app, uint64_t now) {
+	struct ch_server* srv;
+	int err, pending = 0;
+	socklen_t len;
 
-	for (;;) {
-		pthread_testcancel();
+	for (srv = app->servers; srv != NULL; srv = srv->next) {
+		if (srv->sock == -1) {
+			continue;
+		}
 
-		/* get last connected server if any */
-		for (cur_server = app->servers; cur_server != NULL && cur_server->active == 0; cur_server = cur_server->next);
-		if (cur_server == NULL) {
-			/*
-			 * first-listed start-with's value is set in config or this is the
-			 * first attempt to connect, so use the first listed server spec
-			 */
-			cur_server = app->servers;
+		if (srv->revents) {
+			len = sizeof(err);
+			if (getsockopt(srv->sock, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+				err = errno;
+			}
+			if (err == 0) {
+				ch_app_connected(app, srv, now);
+				return;
+			}
+			nc_verb_error("Call Home (app %s): could not connect to %s:%u (%s)", app->name, srv->address, srv->port, strerror(err));
+			ch_server_close(srv);
+		} else if (now >= srv->connect_start + CALLHOME_CONNECT_TIMEOUT) {
+			nc_verb_error("Call Home (app %s): connecting to %s:%u timed out", app->name, srv->address, srv->port);
+			ch_server_close(srv);
 		} else {
-			/* remove active flag */
-			cur_server->active = 0;
+			pending = 1;
 		}
+	}
 
-		/* try to connect to a server indefinitely */
-		for (;;) {
-			for (i = 0; i < app->rec_count; ++i) {
-				if ((app->client = sock_connect(cur_server->address, cur_server->port)) != NULL) {
-                    app->client->transport = app->transport;
-					break;
-				}
-				sleep(app->rec_interval);
+	if (netopeer_options.callhome_parallel) {
+		/* start the next server once the previous ones either failed or are taking too long */
+		while ((!pending || now >= app->next_time) && (srv = ch_app_untried(app)) != NULL) {
+			srv->tried = 1;
+			if (ch_server_connect(app, srv, now) == EXIT_SUCCESS) {
+				pending = 1;
+				app->next_time = now + CALLHOME_RACE_DELAY;
+				break;
 			}
+		}
+		if (!pending) {
+			ch_app_retry(app, now, 1);
+		}
+	} else if (!pending) {
+		ch_app_failed(app, now);
+	}
+}
 
-			if (app->client != NULL) {
-				break;
+static void ch_app_start(struct ch_app* app, uint64_t now) {
+	struct ch_server* srv;
+
+	for (srv = app->servers; srv != NULL; srv = srv->next) {
+		srv->tried = 0;
+	}
+	app->cur_server->tried = 1;
+
+	app->state = CH_CONNECTING;
+	app->next_time = now + CALLHOME_RACE_DELAY;
+	/* an immediate failure is handled as any other */
+	ch_server_connect(app, app->cur_server, now);
+	ch_app_connecting(app, now);
+}
+
+static uint64_t ch_app_linger_check(struct ch_app* app) {
+	switch (app->client->transport) {
+#ifdef NP_SSH
+	case NC_TRANSPORT_SSH:
+		return np_ssh_chapp_linger_check(app);
+#endif
+#ifdef NP_TLS
+	case NC_TRANSPORT_TLS:
+		return np_tls_chapp_linger_check(app);
+#endif
+	default:
+		nc_verb_error("%s: unknown client transport", __func__);
+		return app->rep_linger*1000ULL;
+	}
+}
+
+static void ch_app_process(struct ch_app* app, uint64_t now) {
+	uint64_t linger_left;
+
+	switch (app->state) {
+	case CH_WAIT:
+		if (now >= app->next_time) {
+			ch_app_start(app, now);
+		}
+		break;
+	case CH_CONNECTING:
+		ch_app_connecting(app, now);
+		break;
+	case CH_CONNECTED:
+		if (app->client == NULL) {
+			nc_verb_verbose("Call Home (app %s) disconnected.", app->name);
+			ch_app_restart(app);
+			app->state = CH_WAIT;
+			/* periodic connection, reconnect after the set timeout */
+			app->next_time = (app->linger_expired ? now + app->rep_timeout*60000ULL : now);
+			app->linger_expired = 0;
+			ch_app_process(app, now);
+		} else if (app->connection && !app->linger_expired && now >= app->next_time) {
+			if ((linger_left = ch_app_linger_check(app)) == 0) {
+				app->linger_expired = 1;
+			} else {
+				app->next_time = now + linger_left;
 			}
+		}
+		break;
+	}
+}
+
+int np_callhome_fd(void) {
+	return ch_sched.readyfd;
+}
+
+struct ch_app* np_callhome_ready(void) {
+	struct ch_app* head, *app, *list = NULL;
+	uint64_t count;
+
+	if (ch_sched.readyfd == -1) {
+		return NULL;
+	}
+
+	/* read before taking the queue, a push made meanwhile then wakes the main loop again */
+	if (read(ch_sched.readyfd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+		nc_verb_error("%s: read failed (%s)", __func__, strerror(errno));
+	}
+	head = __atomic_exchange_n(&ch_sched.ready, NULL, __ATOMIC_ACQUIRE);
+
+	/* reverse it, the clients are admitted in the order they connected */
+	while (head != NULL) {
+		app = head;
+		head = head->next_ready;
+		app->next_ready = list;
+		list = app;
+	}
+
+	return list;
+}
+
+void np_callhome_admitted(struct ch_app* app, int fail) {
+	/* SCHED LOCK */
+	pthread_mutex_lock(&ch_sched.lock);
+
+	if (fail) {
+		nc_verb_error("Call Home (app %s) client creation failed.", app->name);
+		app->client = NULL;
+		ch_app_failed(app, np_clock_ms());
+	} else {
+		/* the client may be removed already, then it is handled as a disconnect */
+		app->state = CH_CONNECTED;
+		app->backoff = 0;
+		app->linger_expired = 0;
+		app->next_time = np_clock_ms() + app->rep_linger*1000ULL;
+	}
+	np_callhome_notify();
 
-			cur_server = cur_server->next;
-			if (cur_server == NULL) {
-				cur_server = app->servers;
+	/* SCHED UNLOCK */
+	pthread_mutex_unlock(&ch_sched.lock);
+}
+
+static void ch_timeout_min(int* timeout, uint64_t when, uint64_t now) {
+	uint64_t left;
+
+	left = (when > now ? when - now : 0);
+	if (left > INT_MAX) {
+		left = INT_MAX;
+	}
+	if (*timeout == -1 || (int)left < *timeout) {
+		*timeout = left;
+	}
+}
+
+/* the earliest time the app has to be processed at, events not counted */
+static void ch_app_timeout(struct ch_app* app, int* timeout, uint64_t now) {
+	struct ch_server* srv;
+
+	switch (app->state) {
+	case CH_WAIT:
+		ch_timeout_min(timeout, app->next_time, now);
+		break;
+	case CH_CONNECTING:
+		for (srv = app->servers; srv != NULL; srv = srv->next) {
+			if (srv->sock != -1) {
+				ch_timeout_min(timeout, srv->connect_start + CALLHOME_CONNECT_TIMEOUT, now);
 			}
 		}
+		if (netopeer_options.callhome_parallel && ch_app_untried(app) != NULL) {
+			ch_timeout_min(timeout, app->next_time, now);
+		}
+		break;
+	case CH_CONNECTED:
+		if (app->connection && app->client != NULL && !app->linger_expired) {
+			ch_timeout_min(timeout, app->next_time, now);
+		}
+		break;
+	default:
+		/* woken up by np_callhome_notify() */
+		break;
+	}
+}
+
+static void ch_app_free(struct ch_app* app) {
+	struct ch_server* srv, *del_srv;
+
+	for (srv = app->servers; srv != NULL;) {
+		del_srv = srv;
+		srv = srv->next;
+		ch_server_close(del_srv);
+		free(del_srv->address);
+		free(del_srv);
+	}
+	free(app->name);
+	free(app);
+}
+
+/* free the unconfigured apps, the queued ones only after the main loop is done with them */
+static void ch_sched_reap(void) {
+	struct ch_app* app, **link;
+
+	for (link = &ch_sched.removed; (app = *link) != NULL;) {
+		if (app->state == CH_QUEUED) {
+			link = &app->next;
+			continue;
+		}
 
-		/* publish the new client for the main application loop to create a new session */
-        /* CALLHOME LOCK */
-        pthread_mutex_lock(&callhome_lock);
-        while (callhome_app) {
-            /* someone else is waiting already, let's wait with them */
-            pthread_cond_wait(&callhome_cond, &callhome_lock);
-        }
-        callhome_app = app;
-
-        while (callhome_app) {
-            /* wait for client thread creation */
-            pthread_cond_wait(&callhome_cond, &callhome_lock);
-        }
-
-        /* CALLHOME UNLOCK */
-        pthread_mutex_unlock(&callhome_lock);
-
-        if (!app->client) {
-            nc_verb_error("Call Home (app %s) client creation failed.", app->name);
-            continue;
-        }
-
-		cur_server->active = 1;
-
-		if (app->connection) {
-			/* periodic connection */
-			while (1) {
-				clock_gettime(CLOCK_REALTIME, &ts);
-				ts.tv_sec += CALLHOME_PERIODIC_LINGER_CHECK;
-				ret = pthread_timedjoin_np(app->client->tid, NULL, &ts);
-				if (ret == 0) {
-					break;
-				} else if (ret == ETIMEDOUT) {
-					switch (app->client->transport) {
+		/* a valid client running, mark it for deletion */
+		if (app->client != NULL && !quit) {
+			switch (app->client->transport) {
 #ifdef NP_SSH
-					case NC_TRANSPORT_SSH:
-						i = np_ssh_chapp_linger_check(app);
-						break;
+			case NC_TRANSPORT_SSH:
+				if (((struct client_struct_ssh*)app->client)->ssh_chans != NULL) {
+					((struct client_struct_ssh*)app->client)->ssh_chans->to_free = 1;
+				} else {
+					app->client->to_free = 1;
+				}
+				break;
 #endif
 #ifdef NP_TLS
-					case NC_TRANSPORT_TLS:
-						i =  np_tls_chapp_linger_check(app);
-						break;
+			case NC_TRANSPORT_TLS:
+				app->client->to_free = 1;
+				break;
 #endif
-					default:
-						nc_verb_error("%s: unknown client transport", __func__);
+			default:
+				nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
+				app->client->to_free = 1;
+			}
+			np_client_kick(app->client);
+		}
+
+		*link = app->next;
+		ch_app_free(app);
+	}
+}
+
+static void* ch_sched_loop(void* UNUSED(arg)) {
+	struct pollfd* pfds = NULL, *new_pfds;
+	struct ch_server** srvs = NULL, **new_srvs;
+	unsigned int i, count = 0, size = 0;
+	struct ch_app* app;
+	struct ch_server* srv;
+	uint64_t now, expirations;
+	int timeout;
+
+	while (!ch_sched.stop) {
+		/* SCHED LOCK */
+		pthread_mutex_lock(&ch_sched.lock);
+
+		/* the servers are freed only by this thread, the previous poll() results are still theirs */
+		for (i = 1; i < count; ++i) {
+			srvs[i]->revents = pfds[i].revents;
+		}
+
+		now = np_clock_ms();
+		ch_sched_reap();
+		for (app = callhome_apps; app != NULL; app = app->next) {
+			ch_app_process(app, now);
+		}
+
+		/* wait for the sockets still connecting until the earliest deadline */
+		count = 1;
+		timeout = -1;
+		for (app = callhome_apps; app != NULL; app = app->next) {
+			ch_app_timeout(app, &timeout, now);
+			for (srv = app->servers; srv != NULL; srv = srv->next) {
+				if (srv->sock == -1) {
+					continue;
+				}
+				if (count == size) {
+					new_pfds = realloc(pfds, (size ? size * 2 : 16) * sizeof *pfds);
+					if (new_pfds != NULL) {
+						pfds = new_pfds;
 					}
-					if (i) {
-						break;
+					new_srvs = realloc(srvs, (size ? size * 2 : 16) * sizeof *srvs);
+					if (new_srvs != NULL) {
+						srvs = new_srvs;
 					}
-				} else {
-					nc_verb_error("Call Home (app %s) client thread timed join failed (%s).", app->name, strerror(ret));
-					app->client->to_free = 1;
-					break;
+					if (new_pfds == NULL || new_srvs == NULL) {
+						/* the socket times out eventually */
+						nc_verb_error("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+						continue;
+					}
+					size = (size ? size * 2 : 16);
 				}
+				pfds[count].fd = srv->sock;
+				pfds[count].events = POLLOUT;
+				pfds[count].revents = 0;
+				srvs[count] = srv;
+				++count;
 			}
+		}
 
-		} else {
-			/* persistent connection */
-			ret = pthread_join(app->client->tid, NULL);
-			if (ret != 0) {
-				nc_verb_error("Call Home (app %s) client thread join failed (%s).", app->name, strerror(ret));
+		/* SCHED UNLOCK */
+		pthread_mutex_unlock(&ch_sched.lock);
+
+		if (size == 0) {
+			/* only the eventfd */
+			if ((pfds = malloc(16 * sizeof *pfds)) == NULL || (srvs = malloc(16 * sizeof *srvs)) == NULL) {
+				nc_verb_error("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				free(pfds);
+				pfds = NULL;
+				count = 0;
+				usleep(READ_SLEEP * 1000);
+				continue;
 			}
+			size = 16;
 		}
+		pfds[0].fd = ch_sched.wakefd;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+
+		if (poll(pfds, count, timeout) == -1) {
+			if (errno != EINTR) {
+				nc_verb_error("%s: poll failed (%s)", __func__, strerror(errno));
+				usleep(READ_SLEEP * 1000);
+			}
+			count = 0;
+			continue;
+		}
+		if ((pfds[0].revents & POLLIN) && read(ch_sched.wakefd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+			nc_verb_error("%s: read failed (%s)", __func__, strerror(errno));
+		}
+	}
+
+	/* SCHED LOCK */
+	pthread_mutex_lock(&ch_sched.lock);
+	/* there is no main loop to admit the queued clients anymore */
+	for (app = __atomic_exchange_n(&ch_sched.ready, NULL, __ATOMIC_ACQUIRE); app != NULL; app = app->next_ready) {
+		np_client_free(app->client);
 		app->client = NULL;
-		nc_verb_verbose("Call Home (app %s) disconnected.", app->name);
+		app->state = CH_WAIT;
+	}
+	ch_sched_reap();
+	/* SCHED UNLOCK */
+	pthread_mutex_unlock(&ch_sched.lock);
 
-		if (quit) {
-			pthread_exit(NULL);
-		}
+	free(pfds);
+	free(srvs);
+	return NULL;
+}
+
+static int ch_sched_start(void) {
+	int ret;
+
+	if (ch_sched.running) {
+		return EXIT_SUCCESS;
 	}
+
+	if ((ch_sched.wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+		nc_verb_error("%s: eventfd failed (%s)", __func__, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if ((ch_sched.readyfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+		nc_verb_error("%s: eventfd failed (%s)", __func__, strerror(errno));
+		close(ch_sched.wakefd);
+		ch_sched.wakefd = -1;
+		return EXIT_FAILURE;
+	}
+	ch_sched.seed = time(NULL) ^ getpid();
+	ch_sched.stop = 0;
+
+	if ((ret = pthread_create(&ch_sched.tid, NULL, ch_sched_loop, NULL)) != 0) {
+		nc_verb_error("%s: pthread_create() error (%s)", __func__, strerror(ret));
+		close(ch_sched.wakefd);
+		ch_sched.wakefd = -1;
+		close(ch_sched.readyfd);
+		ch_sched.readyfd = -1;
+		return EXIT_FAILURE;
+	}
+	ch_sched.running = 1;
+
+	nc_verb_verbose("Starting the Call Home scheduler thread.");
+	return EXIT_SUCCESS;
+}
+
+static void ch_sched_stop(void) {
+	int ret;
+
+	if (!ch_sched.running) {
+		return;
+	}
+
+	ch_sched.stop = 1;
+	np_callhome_notify();
+	if ((ret = pthread_join(ch_sched.tid, NULL)) != 0) {
+		nc_verb_error("%s: failed to join the Call Home scheduler thread (%s)", __func__, strerror(ret));
+	}
+	ch_sched.running = 0;
+
+	/* only the main loop, stopping the scheduler, uses it */
+	close(ch_sched.readyfd);
+	ch_sched.readyfd = -1;
+
+	/* SCHED LOCK */
+	pthread_mutex_lock(&ch_sched.lock);
+	close(ch_sched.wakefd);
+	ch_sched.wakefd = -1;
+	/* SCHED UNLOCK */
+	pthread_mutex_unlock(&ch_sched.lock);
 }
 
 static int app_create(xmlNodePtr node, struct nc_err** error, NC_TRANSPORT transport) {
@@ -522,7 +967,6 @@ static int app_create(xmlNodePtr node, struct nc_err** error, NC_TRANSPORT trans
 	struct ch_server* srv, *del_srv;
 	xmlNodePtr auxnode, servernode, childnode;
 	xmlChar* auxstr;
-	int ret;
 
 	new = calloc(1, sizeof(struct ch_app));
 	new->transport = transport;
@@ -550,6 +994,7 @@ static int app_create(xmlNodePtr node, struct nc_err** error, NC_TRANSPORT trans
 			srv->next->prev = srv;
 			srv = srv->next;
 		}
+		srv->sock = -1;
 
 		for (childnode = servernode->children; childnode != NULL; childnode = childnode->next) {
 			if (childnode->type != XML_ELEMENT_NODE) {
@@ -632,12 +1077,17 @@ static int app_create(xmlNodePtr node, struct nc_err** error, NC_TRANSPORT trans
 		}
 	}
 
-	ret = pthread_create(&(new->thread), NULL, app_loop, new);
-	if (ret) {
-		nc_verb_error("%s: pthread_create() error (%s)", __func__, strerror(ret));
+	if (ch_sched_start() != EXIT_SUCCESS) {
 		goto fail;
 	}
 
+	/* connect right away */
+	new->state = CH_WAIT;
+	ch_app_restart(new);
+
+	/* SCHED LOCK */
+	pthread_mutex_lock(&ch_sched.lock);
+
 	/* insert the created app structure into the list */
 	if (!callhome_apps) {
 		callhome_apps = new;
@@ -650,6 +1100,10 @@ static int app_create(xmlNodePtr node, struct nc_err** error, NC_TRANSPORT trans
 		callhome_apps = new;
 	}
 
+	/* SCHED UNLOCK */
+	pthread_mutex_unlock(&ch_sched.lock);
+
+	np_callhome_notify();
 	return EXIT_SUCCESS;
 
 fail:
@@ -684,15 +1138,16 @@ static struct ch_app* app_get(const char* name, NC_TRANSPORT transport) {
 
 static int app_rm(const char* name, NC_TRANSPORT transport) {
 	struct ch_app* app;
-	struct ch_server* srv, *del_srv;
+
+	/* SCHED LOCK */
+	pthread_mutex_lock(&ch_sched.lock);
 
 	if ((app = app_get(name, transport)) == NULL) {
+		/* SCHED UNLOCK */
+		pthread_mutex_unlock(&ch_sched.lock);
 		return EXIT_FAILURE;
 	}
 
-	pthread_cancel(app->thread);
-	pthread_join(app->thread, NULL);
-
 	if (app->prev) {
 		app->prev->next = app->next;
 	} else {
@@ -704,35 +1159,15 @@ static int app_rm(const char* name, NC_TRANSPORT transport) {
 		app->prev->next = NULL;
 	}
 
-	for (srv = app->servers; srv != NULL;) {
-		del_srv = srv;
-		srv = srv->next;
-		free(del_srv->address);
-		free(del_srv);
-	}
-
-	/* a valid client running, mark it for deletion */
-	if (app->client != NULL && !quit) {
-		switch (app->client->transport) {
-#ifdef NP_SSH
-		case NC_TRANSPORT_SSH:
-			((struct client_struct_ssh*)app->client)->ssh_chans->to_free = 1;
-			break;
-#endif
-#ifdef NP_TLS
-		case NC_TRANSPORT_TLS:
-			app->client->to_free = 1;
-			break;
-#endif
-		default:
-			nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
-			app->client->to_free = 1;
-		}
-	}
+	/* its sockets and client are the scheduler's, it frees the app */
+	app->prev = NULL;
+	app->next = ch_sched.removed;
+	ch_sched.removed = app;
 
-	free(app->name);
-	free(app);
+	/* SCHED UNLOCK */
+	pthread_mutex_unlock(&ch_sched.lock);
 
+	np_callhome_notify();
 	return EXIT_SUCCESS;
 }
 
@@ -818,6 +1253,7 @@ void server_transapi_close(void) {
 	while (callhome_apps != NULL) {
 		app_rm(callhome_apps->name, callhome_apps->transport);
 	}
+	ch_sched_stop();
 }
 
 /*
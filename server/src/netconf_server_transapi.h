@@ -39,8 +39,12 @@
 #ifndef _NETCONF_SERVER_TRANSAPI_H_
 #define _NETCONF_SERVER_TRANSAPI_H_
 
+#include <stdint.h>
+#include <sys/socket.h>
 #include <libnetconf.h>
 
+struct client_struct;
+
 struct np_bind_addr {
 	NC_TRANSPORT transport;
 	char* addr;
@@ -55,6 +59,11 @@ struct ch_app {
 		char* address;
 		uint16_t port;
 		uint8_t active;
+		int sock;                   /* connect in progress, -1 otherwise */
+		uint64_t connect_start;
+		uint8_t tried;              /* connect started in the current parallel round */
+		short revents;              /* poll() result of sock */
+		struct sockaddr_storage saddr;
 		struct ch_server* next;
 		struct ch_server* prev;
 	} *servers;
@@ -64,12 +73,56 @@ struct ch_app {
 	uint8_t connection;   /* 0 persistent, 1 periodic */
 	uint8_t rep_timeout;        /* connection-type/periodic/timeout-mins */
 	uint8_t rep_linger;         /* connection-type/periodic/linger-secs */
-	pthread_t thread;
+	/* call home scheduler state, see netconf_server_transapi.c */
+	uint8_t state;
+	uint8_t attempts;           /* failed connects to cur_server */
+	uint8_t backoff;            /* failed rounds since the last connection */
+	uint8_t linger_expired;     /* client disconnected by the linger check */
+	struct ch_server* cur_server;
+	uint64_t next_time;         /* np_clock_ms() of the next attempt, parallel connect or linger check */
 	struct client_struct* client;
+	struct ch_app* next_ready;  /* in the ready queue, see np_callhome_ready() */
 	struct ch_app *next;
 	struct ch_app *prev;
 };
 
+/**
+ * @brief Wake the call home scheduler up
+ */
+void np_callhome_notify(void);
+
+/**
+ * @brief Get the eventfd readable when there are new call home clients to admit
+ *
+ * @return eventfd, -1 if there are no call home apps
+ */
+int np_callhome_fd(void);
+
+/**
+ * @brief Take all the call home apps with a connected client, safe to be
+ * called only from the main loop, each must be passed to np_callhome_admitted()
+ *
+ * @return List linked by next_ready in the connection order, NULL if empty
+ */
+struct ch_app* np_callhome_ready(void);
+
+/**
+ * @brief Report the admission of the client of a ready app to the scheduler,
+ * the app may be freed right after
+ *
+ * @param app App from np_callhome_ready()
+ * @param fail Non-zero if the client was freed instead of being admitted
+ */
+void np_callhome_admitted(struct ch_app* app, int fail);
+
+/**
+ * @brief Let the call home scheduler reconnect the app of a removed client,
+ * called before the client is freed
+ *
+ * @param client Removed client with the callhome flag set
+ */
+void np_callhome_client_removed(struct client_struct* client);
+
 int callback_srv_netconf_srv_call_home_srv_applications_srv_application(XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** error, NC_TRANSPORT transport);
 
 int callback_srv_netconf_srv_listen_srv_port(XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** error, NC_TRANSPORT transport);
@@ -0,0 +1,501 @@
+/**
+ * @file notif.c
+ * @author agent <agent@local>
+ * @brief Netopeer server notification dispatcher
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libnetconf.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "server.h"
+#include "reactor.h"
+#include "nacmcache.h"
+#include "notif.h"
+#include "memacct.h"
+#include "stats.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* one event shared by all the subscribers it is queued for */
+struct notif_event {
+	nc_ntf* ntf;
+	char* name;					// namespace and name of the event, the NACM decisions are cached by it
+	size_t size;				// accounted to every subscriber it is queued for
+	volatile int refs;
+};
+
+struct notif_stream {
+	char* name;
+	int started;				// the dispatcher is iterating over it
+	time_t since;				// older events are not dispatched
+	struct np_subscriber* subscribers;
+	struct notif_stream* next;
+};
+
+struct np_subscriber {
+	struct client_struct* client;
+	struct nc_session* session;
+	struct notif_stream* stream;
+	struct np_memacct* mem;
+
+	/* bounded queue of the events not sent yet */
+	struct notif_event* queue[NOTIF_QUEUE_LIMIT];
+	unsigned int head;
+	unsigned int count;
+	int overflow;				// some events were dropped since the queue was last emptied
+
+	int woken;					// in the wake list
+	struct np_subscriber* next;
+	struct np_subscriber* prev;
+	struct np_subscriber* next_woken;
+};
+
+/*
+ * A single thread follows every stream with at least one subscriber, reads
+ * each event once and queues it for all the subscribers. The notifications
+ * are sent by the threads owning the clients, the same way as the RPC
+ * replies, so a slow subscriber only fills its own queue.
+ */
+static struct {
+	/* locked when accessing the streams, subscribers or the wake list */
+	pthread_mutex_t lock;
+	pthread_cond_t stop_cond;
+	volatile int stop;
+	struct notif_stream* streams;
+	struct np_subscriber* woken_head;
+
+	pthread_t tid;
+	int running;
+} dispatcher = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.stop_cond = PTHREAD_COND_INITIALIZER
+};
+
+static void notif_event_put(struct notif_event* event) {
+	if (__sync_sub_and_fetch(&event->refs, 1) == 0) {
+		ncntf_notif_free(event->ntf);
+		free(event->name);
+		free(event);
+	}
+}
+
+/* DISPATCHER LOCK must be held, returns 1 if the event loop is to be notified */
+static int notif_queue(struct np_subscriber* subscriber, struct notif_event* event) {
+	if (subscriber->count == NOTIF_QUEUE_LIMIT) {
+		/* drop the oldest event */
+		np_memacct_release(subscriber->mem, NP_MEM_NOTIFS, subscriber->queue[subscriber->head]->size);
+		notif_event_put(subscriber->queue[subscriber->head]);
+		subscriber->head = (subscriber->head + 1) % NOTIF_QUEUE_LIMIT;
+		--subscriber->count;
+		np_stat_inc(NP_STAT_NOTIF_DROPPED);
+
+		if (!subscriber->overflow) {
+			nc_verb_warning("Notification queue of the session %s is full, dropping events.", nc_session_get_id(subscriber->session));
+			subscriber->overflow = 1;
+		}
+	}
+	if (np_memacct_charge(subscriber->mem, NP_MEM_NOTIFS, event->size) != EXIT_SUCCESS) {
+		/* the new event does not fit into the memory budgets */
+		np_stat_inc(NP_STAT_NOTIF_DROPPED);
+		if (!subscriber->overflow) {
+			nc_verb_warning("Notifications of the session %s exceed the memory budgets, dropping events.", nc_session_get_id(subscriber->session));
+			subscriber->overflow = 1;
+		}
+		return 0;
+	}
+
+	__sync_fetch_and_add(&event->refs, 1);
+	subscriber->queue[(subscriber->head + subscriber->count) % NOTIF_QUEUE_LIMIT] = event;
+	++subscriber->count;
+
+	if (subscriber->woken) {
+		return 0;
+	}
+	subscriber->woken = 1;
+	subscriber->next_woken = dispatcher.woken_head;
+	dispatcher.woken_head = subscriber;
+
+	return 1;
+}
+
+/* namespace and name of the event, NULL if it cannot be parsed */
+static char* notif_event_name(const char* content) {
+	xmlDocPtr doc;
+	xmlNodePtr node;
+	char* name = NULL;
+
+	doc = xmlReadMemory(content, strlen(content), NULL, NULL, XML_PARSE_NOBLANKS | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+	if (doc == NULL) {
+		return NULL;
+	}
+
+	node = xmlDocGetRootElement(doc);
+	if (node != NULL && xmlStrcmp(node->name, BAD_CAST "notification") == 0) {
+		/* skip the envelope and the eventTime */
+		for (node = node->children; node != NULL && (node->type != XML_ELEMENT_NODE || xmlStrcmp(node->name, BAD_CAST "eventTime") == 0); node = node->next);
+	}
+	if (node != NULL && asprintf(&name, "%s %s", (node->ns != NULL ? (char*)node->ns->href : ""), (char*)node->name) == -1) {
+		name = NULL;
+	}
+
+	xmlFreeDoc(doc);
+	return name;
+}
+
+static int notif_dispatch(struct notif_stream* stream) {
+	struct notif_event* event;
+	struct np_subscriber* subscriber;
+	char* content;
+	time_t event_time;
+	int notify = 0;
+
+	while ((content = ncntf_stream_iter_next(stream->name, stream->since, -1, &event_time)) != NULL) {
+		event = malloc(sizeof(struct notif_event));
+		if (event == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			free(content);
+			continue;
+		}
+		event->ntf = ncntf_notif_create(event_time, content);
+		event->name = notif_event_name(content);
+		event->size = strlen(content);
+		free(content);
+		if (event->ntf == NULL) {
+			nc_verb_error("%s: failed to create a notification from the stream %s", __func__, stream->name);
+			free(event->name);
+			free(event);
+			continue;
+		}
+		event->refs = 1;
+
+		/* DISPATCHER LOCK */
+		pthread_mutex_lock(&dispatcher.lock);
+		for (subscriber = stream->subscribers; subscriber != NULL; subscriber = subscriber->next) {
+			notify |= notif_queue(subscriber, event);
+		}
+		/* DISPATCHER UNLOCK */
+		pthread_mutex_unlock(&dispatcher.lock);
+
+		notif_event_put(event);
+	}
+
+	return notify;
+}
+
+static void* notif_thread(void* UNUSED(arg)) {
+	struct notif_stream* stream, *prev, *next;
+	struct timespec ts;
+	int notify;
+
+	/* DISPATCHER LOCK */
+	pthread_mutex_lock(&dispatcher.lock);
+
+	while (!dispatcher.stop) {
+		/* start following new streams, forget the ones nobody is subscribed to */
+		for (prev = NULL, stream = dispatcher.streams; stream != NULL; stream = next) {
+			next = stream->next;
+
+			if (stream->subscribers == NULL) {
+				if (prev == NULL) {
+					dispatcher.streams = next;
+				} else {
+					prev->next = next;
+				}
+				if (stream->started) {
+					ncntf_stream_iter_finish(stream->name);
+				}
+				free(stream->name);
+				free(stream);
+				continue;
+			}
+
+			if (!stream->started) {
+				ncntf_stream_iter_start(stream->name);
+				stream->since = time(NULL);
+				stream->started = 1;
+			}
+			prev = stream;
+		}
+
+		/* only this thread removes streams, new ones are prepended */
+		stream = dispatcher.streams;
+		/* DISPATCHER UNLOCK */
+		pthread_mutex_unlock(&dispatcher.lock);
+
+		notify = 0;
+		for (; stream != NULL; stream = stream->next) {
+			if (stream->started) {
+				notify |= notif_dispatch(stream);
+			}
+		}
+		if (notify) {
+			np_reactor_notify();
+		}
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += NOTIF_DISPATCH_SLEEP * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			++ts.tv_sec;
+			ts.tv_nsec -= 1000000000L;
+		}
+
+		/* DISPATCHER LOCK */
+		pthread_mutex_lock(&dispatcher.lock);
+		if (!dispatcher.stop) {
+			pthread_cond_timedwait(&dispatcher.stop_cond, &dispatcher.lock, &ts);
+		}
+	}
+
+	for (stream = dispatcher.streams; stream != NULL; stream = next) {
+		next = stream->next;
+		if (stream->subscribers != NULL) {
+			nc_verb_error("%s: internal error: stream %s still has subscribers", __func__, stream->name);
+		}
+		if (stream->started) {
+			ncntf_stream_iter_finish(stream->name);
+		}
+		free(stream->name);
+		free(stream);
+	}
+	dispatcher.streams = NULL;
+
+	/* DISPATCHER UNLOCK */
+	pthread_mutex_unlock(&dispatcher.lock);
+
+	return NULL;
+}
+
+int np_notif_init(void) {
+	int ret;
+
+	dispatcher.stop = 0;
+	if ((ret = pthread_create(&dispatcher.tid, NULL, notif_thread, NULL)) != 0) {
+		nc_verb_error("%s: failed to create a thread (%s)", __func__, strerror(ret));
+		return EXIT_FAILURE;
+	}
+	dispatcher.running = 1;
+
+	return EXIT_SUCCESS;
+}
+
+void np_notif_cleanup(void) {
+	int ret;
+
+	if (!dispatcher.running) {
+		return;
+	}
+
+	/* DISPATCHER LOCK */
+	pthread_mutex_lock(&dispatcher.lock);
+	dispatcher.stop = 1;
+	pthread_cond_signal(&dispatcher.stop_cond);
+	/* DISPATCHER UNLOCK */
+	pthread_mutex_unlock(&dispatcher.lock);
+
+	if ((ret = pthread_join(dispatcher.tid, NULL)) != 0) {
+		nc_verb_error("%s: failed to join the notification thread (%s)", __func__, strerror(ret));
+	}
+	dispatcher.running = 0;
+}
+
+void np_notif_stats(unsigned int* subscribers, unsigned int* queued, unsigned int* max_queued) {
+	struct notif_stream* stream;
+	struct np_subscriber* subscriber;
+
+	*subscribers = 0;
+	*queued = 0;
+	*max_queued = 0;
+
+	/* DISPATCHER LOCK */
+	pthread_mutex_lock(&dispatcher.lock);
+	for (stream = dispatcher.streams; stream != NULL; stream = stream->next) {
+		for (subscriber = stream->subscribers; subscriber != NULL; subscriber = subscriber->next) {
+			++(*subscribers);
+			*queued += subscriber->count;
+			if (subscriber->count > *max_queued) {
+				*max_queued = subscriber->count;
+			}
+		}
+	}
+	/* DISPATCHER UNLOCK */
+	pthread_mutex_unlock(&dispatcher.lock);
+}
+
+void np_notif_wakeups(void) {
+	struct np_subscriber* subscriber;
+
+	/* DISPATCHER LOCK */
+	pthread_mutex_lock(&dispatcher.lock);
+
+	/* a subscriber is freed only after being removed from the list, so the client is valid */
+	for (subscriber = dispatcher.woken_head; subscriber != NULL; subscriber = subscriber->next_woken) {
+		subscriber->woken = 0;
+		np_reactor_schedule(subscriber->client);
+	}
+	dispatcher.woken_head = NULL;
+
+	/* DISPATCHER UNLOCK */
+	pthread_mutex_unlock(&dispatcher.lock);
+}
+
+struct np_subscriber* np_notif_subscribe(struct client_struct* client, struct nc_session* session, const char* stream_name, struct np_memacct* mem) {
+	struct np_subscriber* subscriber;
+	struct notif_stream* stream;
+
+	subscriber = calloc(1, sizeof(struct np_subscriber));
+	if (subscriber == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return NULL;
+	}
+	subscriber->client = client;
+	subscriber->session = session;
+	subscriber->mem = np_memacct_ref(mem);
+
+	/* DISPATCHER LOCK */
+	pthread_mutex_lock(&dispatcher.lock);
+
+	for (stream = dispatcher.streams; stream != NULL; stream = stream->next) {
+		if (strcmp(stream->name, stream_name) == 0) {
+			break;
+		}
+	}
+	if (stream == NULL) {
+		stream = calloc(1, sizeof(struct notif_stream));
+		if (stream == NULL || (stream->name = strdup(stream_name)) == NULL) {
+			/* DISPATCHER UNLOCK */
+			pthread_mutex_unlock(&dispatcher.lock);
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			free(stream);
+			np_memacct_unref(subscriber->mem);
+			free(subscriber);
+			return NULL;
+		}
+		stream->next = dispatcher.streams;
+		dispatcher.streams = stream;
+		pthread_cond_signal(&dispatcher.stop_cond);
+	}
+
+	subscriber->stream = stream;
+	subscriber->next = stream->subscribers;
+	if (stream->subscribers != NULL) {
+		stream->subscribers->prev = subscriber;
+	}
+	stream->subscribers = subscriber;
+
+	/* DISPATCHER UNLOCK */
+	pthread_mutex_unlock(&dispatcher.lock);
+
+	nc_verb_verbose("Session %s subscribed to the stream %s.", nc_session_get_id(session), stream_name);
+	return subscriber;
+}
+
+int np_notif_flush(struct np_subscriber* subscriber, struct nc_session* session) {
+	struct notif_event* event;
+	int sent = 0;
+
+	while (1) {
+		/* DISPATCHER LOCK */
+		pthread_mutex_lock(&dispatcher.lock);
+		if (subscriber->count == 0) {
+			subscriber->overflow = 0;
+			/* DISPATCHER UNLOCK */
+			pthread_mutex_unlock(&dispatcher.lock);
+			break;
+		}
+		event = subscriber->queue[subscriber->head];
+		subscriber->head = (subscriber->head + 1) % NOTIF_QUEUE_LIMIT;
+		--subscriber->count;
+		/* DISPATCHER UNLOCK */
+		pthread_mutex_unlock(&dispatcher.lock);
+		np_memacct_release(subscriber->mem, NP_MEM_NOTIFS, event->size);
+
+		if (np_nacmcache_check_notification(event->ntf, event->name, session) == NACM_PERMIT) {
+			nc_session_send_notif(session, event->ntf);
+			++sent;
+		}
+		notif_event_put(event);
+	}
+
+	return sent;
+}
+
+void np_notif_unsubscribe(struct np_subscriber* subscriber) {
+	struct np_subscriber* cur, *prev;
+
+	if (subscriber == NULL) {
+		return;
+	}
+
+	/* DISPATCHER LOCK */
+	pthread_mutex_lock(&dispatcher.lock);
+
+	if (subscriber->prev == NULL) {
+		subscriber->stream->subscribers = subscriber->next;
+	} else {
+		subscriber->prev->next = subscriber->next;
+	}
+	if (subscriber->next != NULL) {
+		subscriber->next->prev = subscriber->prev;
+	}
+
+	if (subscriber->woken) {
+		for (prev = NULL, cur = dispatcher.woken_head; cur != subscriber; prev = cur, cur = cur->next_woken);
+		if (prev == NULL) {
+			dispatcher.woken_head = subscriber->next_woken;
+		} else {
+			prev->next_woken = subscriber->next_woken;
+		}
+	}
+
+	/* DISPATCHER UNLOCK */
+	pthread_mutex_unlock(&dispatcher.lock);
+
+	for (; subscriber->count > 0; --subscriber->count) {
+		np_memacct_release(subscriber->mem, NP_MEM_NOTIFS, subscriber->queue[subscriber->head]->size);
+		notif_event_put(subscriber->queue[subscriber->head]);
+		subscriber->head = (subscriber->head + 1) % NOTIF_QUEUE_LIMIT;
+	}
+	np_memacct_unref(subscriber->mem);
+	free(subscriber);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file notif.h
+ * @author agent <agent@local>
+ * @brief Netopeer server notification dispatcher header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _NOTIF_H_
+#define _NOTIF_H_
+
+#include <libnetconf.h>
+
+struct client_struct;
+struct np_memacct;
+
+/* a session subscribed to a notification stream */
+struct np_subscriber;
+
+/**
+ * @brief Start the notification dispatcher thread
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_notif_init(void);
+
+/**
+ * @brief Stop the dispatcher thread, there must be no subscribers left
+ */
+void np_notif_cleanup(void);
+
+/**
+ * @brief Get the current state of the subscriber queues
+ *
+ * @param subscribers Number of the subscribers served by the dispatcher
+ * @param queued Number of notifications queued for all of them
+ * @param max_queued Number of notifications in the longest queue
+ */
+void np_notif_stats(unsigned int* subscribers, unsigned int* queued, unsigned int* max_queued);
+
+/**
+ * @brief Schedule all the clients with new notifications, called from the event loop thread
+ */
+void np_notif_wakeups(void);
+
+/**
+ * @brief Subscribe a session to the new events of a stream
+ *
+ * @param client Client the session belongs to, it is scheduled whenever there are new events
+ * @param session NETCONF session
+ * @param stream Name of the stream
+ * @param mem Memory accounting of the session the queued notifications are accounted to, can be NULL
+ *
+ * @return New subscriber, NULL on error
+ */
+struct np_subscriber* np_notif_subscribe(struct client_struct* client, struct nc_session* session, const char* stream, struct np_memacct* mem);
+
+/**
+ * @brief Send all the queued notifications of a subscriber, called by the thread owning the client
+ *
+ * @param subscriber Subscriber
+ * @param session Session of the subscriber
+ *
+ * @return Number of sent notifications
+ */
+int np_notif_flush(struct np_subscriber* subscriber, struct nc_session* session);
+
+/**
+ * @brief Cancel a subscription, must be called before the session is freed
+ *
+ * @param subscriber Subscriber to free
+ */
+void np_notif_unsubscribe(struct np_subscriber* subscriber);
+
+#endif /* _NOTIF_H_ */
@@ -0,0 +1,189 @@
+/**
+ * @file pool.c
+ * @author agent <agent@local>
+ * @brief Netopeer server fixed-size object pools
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetconf.h>
+
+#include "pool.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* the pools are never unregistered, they are all static */
+static struct {
+	pthread_mutex_t lock;
+	struct np_pool* head;
+} pools = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static void pool_register(struct np_pool* pool) {
+	struct np_pool** iter;
+
+	/* POOLS LOCK */
+	pthread_mutex_lock(&pools.lock);
+
+	/* keep the creation order */
+	for (iter = &pools.head; *iter != NULL; iter = &(*iter)->next);
+	pool->next = NULL;
+	*iter = pool;
+	pool->registered = 1;
+
+	/* POOLS UNLOCK */
+	pthread_mutex_unlock(&pools.lock);
+}
+
+/* POOL LOCK must be held */
+static int pool_grow(struct np_pool* pool) {
+	char* slab, *obj;
+	unsigned int i;
+
+	/* the first cache line is the slab header */
+	if (posix_memalign((void**)&slab, CACHELINE_SIZE, CACHELINE_SIZE + pool->per_slab*pool->size) != 0) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+
+	*(void**)slab = pool->slabs;
+	pool->slabs = slab;
+	++pool->slab_count;
+
+	for (i = pool->per_slab; i > 0; --i) {
+		obj = slab + CACHELINE_SIZE + (i-1)*pool->size;
+		*(void**)obj = pool->free_objs;
+		pool->free_objs = obj;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void* np_pool_alloc(struct np_pool* pool) {
+	void* obj = NULL;
+	int reg = 0;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->free_objs == NULL) {
+		if (pool_grow(pool) != EXIT_SUCCESS) {
+			goto unlock;
+		}
+		reg = !pool->registered;
+	}
+
+	obj = pool->free_objs;
+	pool->free_objs = *(void**)obj;
+	++pool->in_use;
+
+unlock:
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool->lock);
+
+	if (reg) {
+		pool_register(pool);
+	}
+	if (obj != NULL) {
+		memset(obj, 0, pool->size);
+	}
+
+	return obj;
+}
+
+void np_pool_free(struct np_pool* pool, void* obj) {
+	if (obj == NULL) {
+		return;
+	}
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool->lock);
+
+	*(void**)obj = pool->free_objs;
+	pool->free_objs = obj;
+	--pool->in_use;
+
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool->lock);
+}
+
+const char* np_pool_stat_get(unsigned int idx, struct np_pool_stat* stat) {
+	struct np_pool* pool;
+
+	/* POOLS LOCK */
+	pthread_mutex_lock(&pools.lock);
+	for (pool = pools.head; pool != NULL && idx > 0; pool = pool->next, --idx);
+	/* POOLS UNLOCK */
+	pthread_mutex_unlock(&pools.lock);
+
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool->lock);
+	stat->size = pool->size;
+	stat->in_use = pool->in_use;
+	stat->reserved = (uint64_t)pool->slab_count * (CACHELINE_SIZE + pool->per_slab*pool->size);
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool->lock);
+
+	return pool->name;
+}
+
+void np_pool_cleanup(struct np_pool* pool) {
+	void* slab;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->in_use) {
+		/* better to leak them than to crash */
+		nc_verb_error("%s: %u objects of the \"%s\" pool still in use", __func__, pool->in_use, pool->name);
+	} else {
+		while ((slab = pool->slabs) != NULL) {
+			pool->slabs = *(void**)slab;
+			free(slab);
+		}
+		pool->slab_count = 0;
+		pool->free_objs = NULL;
+	}
+
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file pool.h
+ * @author agent <agent@local>
+ * @brief Netopeer server fixed-size object pools header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Objects of a single type carved from cache line aligned slabs, every
+ * object occupies whole cache lines so that objects used by different
+ * threads never share one. The slabs are kept until the pool is destroyed,
+ * so connection churn reuses the same memory instead of fragmenting the heap.
+ */
+struct np_pool {
+	const char* name;
+	size_t size;			// object size rounded up to CACHELINE_SIZE
+	unsigned int per_slab;
+
+	/* locked when allocating or freeing an object */
+	pthread_mutex_t lock;
+	void* free_objs;		// linked through the first pointer of a free object
+	void* slabs;			// linked through the first pointer of a slab
+	unsigned int slab_count;
+	unsigned int in_use;
+
+	int registered;
+	struct np_pool* next;	// all the pools a slab was created for
+};
+
+#define NP_POOL_SIZE(type) ((sizeof(type) + CACHELINE_SIZE - 1) & ~((size_t)CACHELINE_SIZE - 1))
+
+/**
+ * @brief Static initializer of a pool
+ *
+ * @param pname Name of the pool in the netopeer-state data
+ * @param type Type of the objects
+ * @param count Number of objects allocated at once
+ */
+#define NP_POOL_INITIALIZER(pname, type, count) {.name = pname, .size = NP_POOL_SIZE(type), .per_slab = count, .lock = PTHREAD_MUTEX_INITIALIZER}
+
+/* state of a single pool */
+struct np_pool_stat {
+	uint64_t size;			/**< size of an object in bytes */
+	uint64_t in_use;		/**< number of allocated objects */
+	uint64_t reserved;		/**< bytes of all the slabs */
+};
+
+/**
+ * @brief Get a zeroed object, can be called from any thread
+ *
+ * @param pool Pool to allocate from
+ *
+ * @return Cache line aligned object, NULL on memory allocation failure
+ */
+void* np_pool_alloc(struct np_pool* pool);
+
+/**
+ * @brief Return an object into its pool, can be called from any thread
+ *
+ * @param pool Pool the object was allocated from
+ * @param obj Object to free, can be NULL
+ */
+void np_pool_free(struct np_pool* pool, void* obj);
+
+/**
+ * @brief Get the state of a pool
+ *
+ * @param idx Index of the pool, starting from 0
+ * @param stat State of the pool
+ *
+ * @return Name of the pool, NULL if idx is past the last one
+ */
+const char* np_pool_stat_get(unsigned int idx, struct np_pool_stat* stat);
+
+/**
+ * @brief Free all the slabs of a pool, there must be no objects in use
+ *
+ * @param pool Pool to clean
+ */
+void np_pool_cleanup(struct np_pool* pool);
+
+#endif /* _POOL_H_ */
@@ -0,0 +1,233 @@
+/**
+ * @file ratelimit.c
+ * @author agent <agent@local>
+ * @brief Netopeer server token bucket rate limits
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "hash.h"
+#include "ratelimit.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* number of the hash table buckets of every limited entity type, a power of 2 */
+#define RATELIMIT_TABLE_SIZE 1024
+
+/* limit of the remembered addresses or usernames, beyond it the full buckets are forgotten */
+#define RATELIMIT_MAX_ENTRIES 65536
+
+extern struct np_options netopeer_options;
+
+struct limit_entry {
+	struct np_bucket bucket;
+	struct limit_entry* next;
+	size_t key_len;
+	char key[];
+};
+
+struct limit_table {
+	/* locked when accessing the table */
+	pthread_mutex_t lock;
+	struct limit_entry* buckets[RATELIMIT_TABLE_SIZE];
+	unsigned int count;
+};
+
+static struct limit_table addresses = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static struct limit_table usernames = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static uint32_t key_hash(const char* key, size_t key_len) {
+	return np_hash(NP_HASH_INIT, key, key_len);
+}
+
+/* refill the bucket, period is the time in msecs the rate is given for */
+static void bucket_refill(struct np_bucket* bucket, const struct np_rate_limit* limit, uint64_t period, uint64_t now) {
+	if (bucket->last == 0) {
+		bucket->tokens = limit->burst;
+	} else if (now > bucket->last) {
+		bucket->tokens += (double)(now - bucket->last) * limit->rate / period;
+		if (bucket->tokens > limit->burst) {
+			bucket->tokens = limit->burst;
+		}
+	}
+	bucket->last = now;
+}
+
+static int bucket_take(struct np_bucket* bucket, const struct np_rate_limit* limit, uint64_t period, uint64_t now) {
+	bucket_refill(bucket, limit, period, now);
+	if (bucket->tokens < 1) {
+		return EXIT_FAILURE;
+	}
+	bucket->tokens -= 1;
+
+	return EXIT_SUCCESS;
+}
+
+/* TABLE LOCK must be held, a full bucket is the same as no bucket */
+static void table_purge(struct limit_table* table, const struct np_rate_limit* limit, uint64_t period, uint64_t now) {
+	struct limit_entry** entry, *del;
+	unsigned int i;
+
+	for (i = 0; i < RATELIMIT_TABLE_SIZE; ++i) {
+		for (entry = &table->buckets[i]; *entry != NULL;) {
+			bucket_refill(&(*entry)->bucket, limit, period, now);
+			if ((*entry)->bucket.tokens < limit->burst) {
+				entry = &(*entry)->next;
+				continue;
+			}
+
+			del = *entry;
+			*entry = del->next;
+			free(del);
+			--table->count;
+		}
+	}
+}
+
+static int table_take(struct limit_table* table, const char* key, size_t key_len, const struct np_rate_limit* limit, uint64_t period) {
+	struct limit_entry* entry;
+	struct np_rate_limit cur_limit;
+	uint64_t now;
+	uint32_t idx;
+	int ret = EXIT_SUCCESS;
+
+	/* the configuration may change anytime */
+	cur_limit = *limit;
+	if (cur_limit.rate == 0) {
+		return EXIT_SUCCESS;
+	}
+
+	now = np_clock_ms();
+	idx = key_hash(key, key_len) & (RATELIMIT_TABLE_SIZE - 1);
+
+	/* TABLE LOCK */
+	pthread_mutex_lock(&table->lock);
+
+	for (entry = table->buckets[idx]; entry != NULL; entry = entry->next) {
+		if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		if (table->count >= RATELIMIT_MAX_ENTRIES) {
+			table_purge(table, &cur_limit, period, now);
+		}
+		if (table->count >= RATELIMIT_MAX_ENTRIES || (entry = calloc(1, sizeof(struct limit_entry) + key_len)) == NULL) {
+			/* do not let the table grow without limits, rather allow it */
+			goto unlock;
+		}
+		entry->key_len = key_len;
+		memcpy(entry->key, key, key_len);
+		entry->next = table->buckets[idx];
+		table->buckets[idx] = entry;
+		++table->count;
+	}
+
+	ret = bucket_take(&entry->bucket, &cur_limit, period, now);
+
+unlock:
+	/* TABLE UNLOCK */
+	pthread_mutex_unlock(&table->lock);
+
+	return ret;
+}
+
+int np_ratelimit_connection(const struct sockaddr_storage* saddr) {
+	switch (saddr->ss_family) {
+	case AF_INET:
+		return table_take(&addresses, (const char*)&((const struct sockaddr_in*)saddr)->sin_addr, sizeof(struct in_addr), &netopeer_options.conn_limit, 1000);
+	case AF_INET6:
+		return table_take(&addresses, (const char*)&((const struct sockaddr_in6*)saddr)->sin6_addr, sizeof(struct in6_addr), &netopeer_options.conn_limit, 1000);
+	default:
+		return EXIT_SUCCESS;
+	}
+}
+
+int np_ratelimit_auth(const char* username) {
+	if (username == NULL) {
+		return EXIT_SUCCESS;
+	}
+
+	return table_take(&usernames, username, strlen(username), &netopeer_options.auth_limit, 60000);
+}
+
+int np_ratelimit_rpc(struct np_bucket* bucket) {
+	struct np_rate_limit cur_limit;
+
+	cur_limit = netopeer_options.rpc_limit;
+	if (cur_limit.rate == 0) {
+		return EXIT_SUCCESS;
+	}
+
+	return bucket_take(bucket, &cur_limit, 1000, np_clock_ms());
+}
+
+static void table_cleanup(struct limit_table* table) {
+	struct limit_entry* entry, *next;
+	unsigned int i;
+
+	/* TABLE LOCK */
+	pthread_mutex_lock(&table->lock);
+
+	for (i = 0; i < RATELIMIT_TABLE_SIZE; ++i) {
+		for (entry = table->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+		table->buckets[i] = NULL;
+	}
+	table->count = 0;
+
+	/* TABLE UNLOCK */
+	pthread_mutex_unlock(&table->lock);
+}
+
+void np_ratelimit_cleanup(void) {
+	table_cleanup(&addresses);
+	table_cleanup(&usernames);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file ratelimit.h
+ * @author agent <agent@local>
+ * @brief Netopeer server token bucket rate limits header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _RATELIMIT_H_
+#define _RATELIMIT_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+/* tokens of a single limited entity, a zeroed bucket is full */
+struct np_bucket {
+	double tokens;
+	uint64_t last;		// np_clock_ms() of the last refill, 0 if never used
+};
+
+/**
+ * @brief Check the new connections limit of a source address,
+ * can be called from any thread
+ *
+ * @param saddr Address of the peer
+ *
+ * @return EXIT_SUCCESS if the connection is allowed, EXIT_FAILURE otherwise
+ */
+int np_ratelimit_connection(const struct sockaddr_storage* saddr);
+
+/**
+ * @brief Check the authentication attempts limit of a username,
+ * can be called from any thread
+ *
+ * @param username User trying to authenticate
+ *
+ * @return EXIT_SUCCESS if the attempt is allowed, EXIT_FAILURE otherwise
+ */
+int np_ratelimit_auth(const char* username);
+
+/**
+ * @brief Check the RPC limit of a session, called by the worker owning it
+ *
+ * @param bucket Bucket of the session
+ *
+ * @return EXIT_SUCCESS if the RPC is allowed, EXIT_FAILURE otherwise
+ */
+int np_ratelimit_rpc(struct np_bucket* bucket);
+
+/**
+ * @brief Forget all the addresses and usernames
+ */
+void np_ratelimit_cleanup(void);
+
+#endif /* _RATELIMIT_H_ */
@@ -0,0 +1,684 @@
+/**
+ * @file reactor.c
+ * @author agent <agent@local>
+ * @brief Netopeer server event loop dispatching the clients to the worker threads
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "reactor.h"
+#include "rpcpool.h"
+#include "notif.h"
+#include "stats.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* maximum number of events retrieved by a single epoll_wait() */
+#define REACTOR_MAX_EVENTS 64
+
+extern struct np_state netopeer_state;
+
+/*
+ * A client socket is watched by the epoll only while no worker owns the client,
+ * a readable socket or an expired timer makes the event loop thread remove it
+ * from the epoll and enqueue the client. Only the event loop thread retrieves
+ * events, so once a client is scheduled, no pending event can refer to it and
+ * the owning worker is free to destroy it. Scheduling a client that is already
+ * owned by a worker makes the worker process it once more.
+ *
+ * Every client has at most one timer, its earliest deadline (handshake,
+ * authentication or idle timeout) computed by the owning worker when done
+ * processing it. The timers are kept in a binary min-heap and the timerfd
+ * is armed to the earliest of them, so an idle client costs nothing until
+ * its deadline. Other threads make a client processed by giving it a timer
+ * that is already expired (np_reactor_kick()).
+ *
+ * The SSH clients that have not authenticated yet are processed by their own
+ * threads, so the password hashing of a burst of logins cannot delay the
+ * authenticated sessions. A client is moved to the session workers by the
+ * authentication thread once it authenticates.
+ */
+struct reactor_lane {
+	int auth;					// processes the authenticating clients
+	pthread_cond_t cond;
+	struct client_struct* head;
+	struct client_struct* tail;
+	unsigned int queued;		// clients waiting in the queue
+	pthread_t* threads;
+	unsigned int count;
+};
+
+#define REACTOR_LANE_SESSIONS 0
+#define REACTOR_LANE_AUTH 1
+
+static struct {
+	int epfd;
+	int wakefd;					// eventfd interrupting epoll_wait() on exit, with new RPC replies or notifications
+	int timerfd;				// timerfd armed to the earliest client deadline
+	int statsfd;				// timerfd triggering the periodic statistics sampling
+	volatile int stop;
+	volatile int sweep;			// process all the clients on the next wakeup
+
+	pthread_t loop_tid;
+	int loop_running;
+
+	/* locked when changing the scheduled flag of a client, the ready queues or the timers */
+	pthread_mutex_t lock;
+	struct reactor_lane lanes[2];
+
+	struct client_struct** timers;	// min-heap ordered by the client deadlines
+	unsigned int timer_count;
+	unsigned int timer_size;		// there is always space for every client
+	unsigned int client_count;		// clients added and not freed yet
+	uint64_t armed;					// deadline the timerfd is set to, 0 if disarmed
+} reactor = {
+	.epfd = -1,
+	.wakefd = -1,
+	.timerfd = -1,
+	.statsfd = -1,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.lanes = {
+		{.auth = 0, .cond = PTHREAD_COND_INITIALIZER},
+		{.auth = 1, .cond = PTHREAD_COND_INITIALIZER}
+	}
+};
+
+static void timer_swap(unsigned int i, unsigned int j) {
+	struct client_struct* aux;
+
+	aux = reactor.timers[i];
+	reactor.timers[i] = reactor.timers[j];
+	reactor.timers[j] = aux;
+	reactor.timers[i]->timer_idx = i+1;
+	reactor.timers[j]->timer_idx = j+1;
+}
+
+static void timer_sift(unsigned int i) {
+	unsigned int child;
+
+	/* up */
+	while (i > 0 && reactor.timers[i]->deadline < reactor.timers[(i-1)/2]->deadline) {
+		timer_swap(i, (i-1)/2);
+		i = (i-1)/2;
+	}
+
+	/* down */
+	while ((child = 2*i+1) < reactor.timer_count) {
+		if (child+1 < reactor.timer_count && reactor.timers[child+1]->deadline < reactor.timers[child]->deadline) {
+			++child;
+		}
+		if (reactor.timers[i]->deadline <= reactor.timers[child]->deadline) {
+			break;
+		}
+		timer_swap(i, child);
+		i = child;
+	}
+}
+
+/* REACTOR LOCK must be held */
+static void timer_arm(void) {
+	struct itimerspec its;
+	uint64_t deadline;
+
+	deadline = (reactor.timer_count ? reactor.timers[0]->deadline : 0);
+	if (deadline == reactor.armed) {
+		return;
+	}
+
+	/* a zero value disarms the timer, any deadline in the past expires immediately */
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / 1000;
+	its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+	if (timerfd_settime(reactor.timerfd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+		nc_verb_error("%s: timerfd_settime failed (%s)", __func__, strerror(errno));
+		return;
+	}
+	reactor.armed = deadline;
+}
+
+/* REACTOR LOCK must be held, deadline 0 removes the timer */
+static void timer_set(struct client_struct* client, uint64_t deadline) {
+	unsigned int i;
+
+	if (client->timer_idx) {
+		i = client->timer_idx-1;
+		if (deadline) {
+			client->deadline = deadline;
+		} else {
+			client->timer_idx = 0;
+			if (i == --reactor.timer_count) {
+				timer_arm();
+				return;
+			}
+			reactor.timers[i] = reactor.timers[reactor.timer_count];
+			reactor.timers[i]->timer_idx = i+1;
+		}
+		timer_sift(i);
+	} else if (deadline) {
+		/* reactor_reserve() made sure there is space for every client */
+		i = reactor.timer_count++;
+		client->deadline = deadline;
+		client->timer_idx = i+1;
+		reactor.timers[i] = client;
+		timer_sift(i);
+	}
+
+	timer_arm();
+}
+
+/* REACTOR LOCK must be held */
+static int reactor_reserve(void) {
+	struct client_struct** timers;
+	unsigned int size;
+
+	if (reactor.client_count < reactor.timer_size) {
+		return EXIT_SUCCESS;
+	}
+
+	size = (reactor.timer_size ? reactor.timer_size*2 : 64);
+	if ((timers = realloc(reactor.timers, size*sizeof(struct client_struct*))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	reactor.timers = timers;
+	reactor.timer_size = size;
+
+	return EXIT_SUCCESS;
+}
+
+/* REACTOR LOCK must be held */
+static int reactor_watch(struct client_struct* client) {
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN | (client->want_write ? EPOLLOUT : 0);
+	ev.data.ptr = client;
+	if (epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, client->sock, &ev) == -1) {
+		nc_verb_error("%s: epoll_ctl failed (%s)", __func__, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* REACTOR LOCK must be held */
+static void reactor_schedule(struct client_struct* client) {
+	struct reactor_lane* lane;
+
+	if (client->scheduled) {
+		/* the worker has to check it again */
+		client->scheduled = 2;
+		return;
+	}
+	client->scheduled = 1;
+
+	/* the owning worker starts watching the socket again when finished */
+	if (epoll_ctl(reactor.epfd, EPOLL_CTL_DEL, client->sock, NULL) == -1 && errno != ENOENT) {
+		nc_verb_error("%s: epoll_ctl failed (%s)", __func__, strerror(errno));
+	}
+
+	lane = &reactor.lanes[client->authenticating ? REACTOR_LANE_AUTH : REACTOR_LANE_SESSIONS];
+	client->next_ready = NULL;
+	if (lane->tail == NULL) {
+		lane->head = client;
+	} else {
+		lane->tail->next_ready = client;
+	}
+	lane->tail = client;
+	++lane->queued;
+
+	pthread_cond_signal(&lane->cond);
+}
+
+/* needed only when the conditions of all the deadlines change (timeouts reconfigured, quit) */
+static void reactor_sweep(void) {
+	struct client_struct* client;
+
+	/* GLOBAL LOCK */
+	pthread_mutex_lock(&netopeer_state.global_lock);
+	/* REACTOR LOCK */
+	pthread_mutex_lock(&reactor.lock);
+
+	for (client = netopeer_state.clients; client != NULL; client = client->next) {
+		reactor_schedule(client);
+	}
+
+	/* REACTOR UNLOCK */
+	pthread_mutex_unlock(&reactor.lock);
+	/* GLOBAL UNLOCK */
+	pthread_mutex_unlock(&netopeer_state.global_lock);
+}
+
+/* REACTOR LOCK must be held */
+static void reactor_expire(void) {
+	struct client_struct* client;
+	uint64_t now;
+
+	now = np_clock_ms();
+	while (reactor.timer_count && reactor.timers[0]->deadline <= now) {
+		client = reactor.timers[0];
+		timer_set(client, 0);
+		reactor_schedule(client);
+	}
+}
+
+static void* reactor_loop(void* UNUSED(arg)) {
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	uint64_t expirations;
+	int i, count, sample, wakeup;
+
+	while (!reactor.stop) {
+		count = epoll_wait(reactor.epfd, events, REACTOR_MAX_EVENTS, -1);
+		if (count == -1) {
+			if (errno != EINTR) {
+				nc_verb_error("%s: epoll_wait failed (%s)", __func__, strerror(errno));
+			}
+			continue;
+		}
+
+		sample = 0;
+		wakeup = 0;
+
+		/* REACTOR LOCK */
+		pthread_mutex_lock(&reactor.lock);
+		for (i = 0; i < count; ++i) {
+			if (events[i].data.ptr == &reactor.statsfd) {
+				if (read(reactor.statsfd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+					nc_verb_error("%s: read failed (%s)", __func__, strerror(errno));
+				}
+				sample = 1;
+			} else if (events[i].data.ptr == &reactor.timerfd) {
+				if (read(reactor.timerfd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+					nc_verb_error("%s: read failed (%s)", __func__, strerror(errno));
+				}
+				/* the timerfd is not armed anymore */
+				reactor.armed = 0;
+			} else if (events[i].data.ptr == &reactor.wakefd) {
+				if (read(reactor.wakefd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+					nc_verb_error("%s: read failed (%s)", __func__, strerror(errno));
+				}
+				wakeup = 1;
+			} else {
+				reactor_schedule((struct client_struct*)events[i].data.ptr);
+			}
+		}
+
+		/* the timers of the scheduled clients are kept until they are freed, so they are still valid */
+		reactor_expire();
+		timer_arm();
+		/* REACTOR UNLOCK */
+		pthread_mutex_unlock(&reactor.lock);
+
+		/* scheduled clients may be already freed, do not touch the events anymore */
+		if (wakeup) {
+			np_rpcpool_wakeups();
+			np_notif_wakeups();
+			if (reactor.sweep) {
+				reactor.sweep = 0;
+				reactor_sweep();
+			}
+		}
+		if (sample) {
+			np_stats_sample();
+		}
+	}
+
+	return NULL;
+}
+
+static void* reactor_worker(void* arg) {
+	struct reactor_lane* lane = (struct reactor_lane*)arg;
+	struct client_struct* client;
+	uint64_t deadline;
+	int progress;
+
+	while (1) {
+		/* REACTOR LOCK */
+		pthread_mutex_lock(&reactor.lock);
+		while (lane->head == NULL && !reactor.stop) {
+			pthread_cond_wait(&lane->cond, &reactor.lock);
+		}
+
+		client = lane->head;
+		if (client == NULL) {
+			/* REACTOR UNLOCK */
+			pthread_mutex_unlock(&reactor.lock);
+			break;
+		}
+
+		lane->head = client->next_ready;
+		if (lane->head == NULL) {
+			lane->tail = NULL;
+		}
+		--lane->queued;
+		/* REACTOR UNLOCK */
+		pthread_mutex_unlock(&reactor.lock);
+
+process:
+		/* do everything there is to do, the socket is level-triggered anyway */
+		do {
+			progress = np_client_process(client);
+		} while (progress && !client->to_free && client->authenticating == lane->auth);
+
+		if (!client->to_free) {
+			deadline = np_client_deadline(client);
+
+			/* REACTOR LOCK */
+			pthread_mutex_lock(&reactor.lock);
+			if (client->authenticating != lane->auth) {
+				/* authenticated, the session workers finish whatever is left */
+				client->scheduled = 0;
+				timer_set(client, deadline);
+				reactor_schedule(client);
+				/* REACTOR UNLOCK */
+				pthread_mutex_unlock(&reactor.lock);
+				continue;
+			}
+			if (client->scheduled == 2) {
+				/* scheduled again meanwhile, a reply may be ready */
+				client->scheduled = 1;
+				/* REACTOR UNLOCK */
+				pthread_mutex_unlock(&reactor.lock);
+				goto process;
+			}
+			client->scheduled = 0;
+			timer_set(client, deadline);
+			if (reactor_watch(client) != EXIT_SUCCESS) {
+				/* we would never hear from the client again */
+				client->to_free = 1;
+				reactor_schedule(client);
+			}
+			/* REACTOR UNLOCK */
+			pthread_mutex_unlock(&reactor.lock);
+		} else {
+			/* REACTOR LOCK */
+			pthread_mutex_lock(&reactor.lock);
+			timer_set(client, 0);
+			--reactor.client_count;
+			/* REACTOR UNLOCK */
+			pthread_mutex_unlock(&reactor.lock);
+
+			np_client_remove(client);
+		}
+	}
+
+#ifdef NP_TLS
+	np_tls_thread_cleanup();
+#endif
+
+	return NULL;
+}
+
+static int reactor_lane_start(struct reactor_lane* lane, unsigned int threads) {
+	int ret;
+
+	if ((lane->threads = calloc(threads, sizeof(pthread_t))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	for (lane->count = 0; lane->count < threads; ++lane->count) {
+		if ((ret = pthread_create(&lane->threads[lane->count], NULL, reactor_worker, lane)) != 0) {
+			nc_verb_error("%s: failed to create a thread (%s)", __func__, strerror(ret));
+			break;
+		}
+	}
+
+	return (lane->count ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static void reactor_lane_stop(struct reactor_lane* lane) {
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < lane->count; ++i) {
+		if ((ret = pthread_join(lane->threads[i], NULL)) != 0) {
+			nc_verb_error("%s: failed to join a worker thread (%s)", __func__, strerror(ret));
+		}
+	}
+	free(lane->threads);
+	lane->threads = NULL;
+	lane->count = 0;
+}
+
+int np_reactor_init(unsigned int workers) {
+	struct epoll_event ev;
+	struct itimerspec its;
+	int ret;
+
+	reactor.stop = 0;
+
+	if ((reactor.epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		nc_verb_error("%s: epoll_create1 failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+
+	if ((reactor.wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+		nc_verb_error("%s: eventfd failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &reactor.wakefd;
+	if (epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, reactor.wakefd, &ev) == -1) {
+		nc_verb_error("%s: epoll_ctl failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+
+	if ((reactor.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) == -1) {
+		nc_verb_error("%s: timerfd_create failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+	reactor.armed = 0;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &reactor.timerfd;
+	if (epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, reactor.timerfd, &ev) == -1) {
+		nc_verb_error("%s: epoll_ctl failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+
+	if ((reactor.statsfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) == -1) {
+		nc_verb_error("%s: timerfd_create failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+	its.it_interval.tv_sec = STATS_SAMPLE_INTERVAL;
+	its.it_interval.tv_nsec = 0;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(reactor.statsfd, 0, &its, NULL) == -1) {
+		nc_verb_error("%s: timerfd_settime failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &reactor.statsfd;
+	if (epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, reactor.statsfd, &ev) == -1) {
+		nc_verb_error("%s: epoll_ctl failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+
+	if ((ret = pthread_create(&reactor.loop_tid, NULL, reactor_loop, NULL)) != 0) {
+		nc_verb_error("%s: failed to create a thread (%s)", __func__, strerror(ret));
+		goto fail;
+	}
+	reactor.loop_running = 1;
+
+	if (workers == 0) {
+		workers = 1;
+	}
+	if (reactor_lane_start(&reactor.lanes[REACTOR_LANE_SESSIONS], workers) != EXIT_SUCCESS) {
+		goto fail;
+	}
+#ifdef NP_SSH
+	if (reactor_lane_start(&reactor.lanes[REACTOR_LANE_AUTH], AUTH_THREADS) != EXIT_SUCCESS) {
+		goto fail;
+	}
+#endif
+
+	nc_verb_verbose("Processing the sessions with %u worker threads and the authentication with %u threads.",
+			reactor.lanes[REACTOR_LANE_SESSIONS].count, reactor.lanes[REACTOR_LANE_AUTH].count);
+	return EXIT_SUCCESS;
+
+fail:
+	np_reactor_cleanup();
+	return EXIT_FAILURE;
+}
+
+void np_reactor_notify(void) {
+	const uint64_t one = 1;
+
+	if (write(reactor.wakefd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+		nc_verb_error("%s: write failed (%s)", __func__, strerror(errno));
+	}
+}
+
+void np_reactor_schedule(struct client_struct* client) {
+	/* REACTOR LOCK */
+	pthread_mutex_lock(&reactor.lock);
+	reactor_schedule(client);
+	/* REACTOR UNLOCK */
+	pthread_mutex_unlock(&reactor.lock);
+}
+
+void np_reactor_kick(struct client_struct* client) {
+	/* REACTOR LOCK */
+	pthread_mutex_lock(&reactor.lock);
+	if (client->scheduled) {
+		/* the owning worker has to check it again */
+		client->scheduled = 2;
+	} else {
+		/* expired already, the event loop thread schedules it */
+		timer_set(client, 1);
+	}
+	/* REACTOR UNLOCK */
+	pthread_mutex_unlock(&reactor.lock);
+}
+
+int np_reactor_auth_saturated(void) {
+	return (__atomic_load_n(&reactor.lanes[REACTOR_LANE_AUTH].queued, __ATOMIC_RELAXED) >= AUTH_QUEUE_LIMIT);
+}
+
+void np_reactor_kick_all(void) {
+	reactor.sweep = 1;
+	if (reactor.wakefd != -1) {
+		np_reactor_notify();
+	}
+}
+
+int np_reactor_add(struct client_struct* client) {
+	uint64_t deadline;
+	int ret;
+
+	/* the handshake timeout applies even if the client never sends anything */
+	deadline = np_client_deadline(client);
+
+	/* REACTOR LOCK */
+	pthread_mutex_lock(&reactor.lock);
+	client->scheduled = 0;
+	client->timer_idx = 0;
+	ret = reactor_reserve();
+	if (ret == EXIT_SUCCESS) {
+		ret = reactor_watch(client);
+	}
+	if (ret == EXIT_SUCCESS) {
+		++reactor.client_count;
+		timer_set(client, deadline);
+	}
+	/* REACTOR UNLOCK */
+	pthread_mutex_unlock(&reactor.lock);
+
+	return ret;
+}
+
+void np_reactor_cleanup(void) {
+	const uint64_t one = 1;
+	unsigned int i;
+	int ret;
+
+	reactor.stop = 1;
+
+	if (reactor.loop_running) {
+		if (write(reactor.wakefd, &one, sizeof(one)) == -1) {
+			nc_verb_error("%s: write failed (%s)", __func__, strerror(errno));
+		}
+		if ((ret = pthread_join(reactor.loop_tid, NULL)) != 0) {
+			nc_verb_error("%s: failed to join the event loop thread (%s)", __func__, strerror(ret));
+		}
+		reactor.loop_running = 0;
+	}
+
+	/* REACTOR LOCK */
+	pthread_mutex_lock(&reactor.lock);
+	for (i = 0; i < 2; ++i) {
+		pthread_cond_broadcast(&reactor.lanes[i].cond);
+	}
+	/* REACTOR UNLOCK */
+	pthread_mutex_unlock(&reactor.lock);
+
+	for (i = 0; i < 2; ++i) {
+		reactor_lane_stop(&reactor.lanes[i]);
+	}
+
+	if (reactor.statsfd != -1) {
+		close(reactor.statsfd);
+		reactor.statsfd = -1;
+	}
+	if (reactor.timerfd != -1) {
+		close(reactor.timerfd);
+		reactor.timerfd = -1;
+	}
+	free(reactor.timers);
+	reactor.timers = NULL;
+	reactor.timer_count = 0;
+	reactor.timer_size = 0;
+	reactor.client_count = 0;
+	reactor.armed = 0;
+	if (reactor.wakefd != -1) {
+		close(reactor.wakefd);
+		reactor.wakefd = -1;
+	}
+	if (reactor.epfd != -1) {
+		close(reactor.epfd);
+		reactor.epfd = -1;
+	}
+}
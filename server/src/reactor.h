@@ -0,0 +1,108 @@
+/**
+ * @file reactor.h
+ * @author agent <agent@local>
+ * @brief Netopeer server event loop header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+struct client_struct;
+
+/**
+ * @brief Create the event loop thread and the worker threads
+ *
+ * @param workers Number of threads processing the client sessions
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_reactor_init(unsigned int workers);
+
+/**
+ * @brief Start watching the socket of a client, its processing
+ * is triggered once it becomes readable or its deadline expires.
+ * Must be called with the GLOBAL LOCK held right after the client
+ * was added into the list.
+ *
+ * @param client Client to watch
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_reactor_add(struct client_struct* client);
+
+/**
+ * @brief Wake the event loop thread up, it then schedules the clients
+ * with new RPC replies or notifications (np_rpcpool_wakeups(), np_notif_wakeups())
+ */
+void np_reactor_notify(void);
+
+/**
+ * @brief Let a worker process the client, safe to be called only
+ * from the event loop thread
+ *
+ * @param client Client to process
+ */
+void np_reactor_schedule(struct client_struct* client);
+
+/**
+ * @brief Let a worker process the client as soon as possible, safe to be
+ * called from any thread while the client is guaranteed not to be freed
+ * (GLOBAL LOCK held and the client in the list, see np_client_kick())
+ *
+ * @param client Client to process
+ */
+void np_reactor_kick(struct client_struct* client);
+
+/**
+ * @brief Check whether too many SSH clients wait for an authentication
+ * thread (AUTH_QUEUE_LIMIT), no new ones should be accepted then
+ *
+ * @return 1 if saturated, 0 otherwise
+ */
+int np_reactor_auth_saturated(void);
+
+/**
+ * @brief Let the workers process all the clients, needed when
+ * the timeouts are reconfigured or when quitting
+ */
+void np_reactor_kick_all(void);
+
+/**
+ * @brief Stop the event loop and join all the worker threads,
+ * there must be no clients left
+ */
+void np_reactor_cleanup(void);
+
+#endif /* _REACTOR_H_ */
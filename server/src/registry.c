@@ -0,0 +1,268 @@
+/**
+ * @file registry.c
+ * @author agent <agent@local>
+ * @brief Netopeer server session registry
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "hash.h"
+#include "registry.h"
+#include "reactor.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* initial number of session hash table buckets, always a power of 2 */
+#define REGISTRY_INIT_SIZE 64
+
+struct sess_entry {
+	char* sid;
+	struct client_struct* client;
+	volatile int* to_free;
+	struct sess_entry* next;
+};
+
+static struct {
+	/* locked when accessing the session table */
+	pthread_mutex_t lock;
+	struct sess_entry** buckets;
+	unsigned int size;
+	unsigned int count;
+} sessions = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static volatile int ssh_session_count;
+static volatile int tls_session_count;
+
+static uint32_t sid_hash(const char* sid) {
+	return np_hash_str(NP_HASH_INIT, sid);
+}
+
+/* SESSIONS LOCK must be held */
+static int registry_resize(unsigned int size) {
+	struct sess_entry** buckets, *entry, *next;
+	unsigned int i, idx;
+
+	buckets = calloc(size, sizeof(struct sess_entry*));
+	if (buckets == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sessions.size; ++i) {
+		for (entry = sessions.buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			idx = sid_hash(entry->sid) & (size - 1);
+			entry->next = buckets[idx];
+			buckets[idx] = entry;
+		}
+	}
+
+	free(sessions.buckets);
+	sessions.buckets = buckets;
+	sessions.size = size;
+
+	return EXIT_SUCCESS;
+}
+
+int np_registry_add_session(const char* sid, struct client_struct* client, volatile int* to_free) {
+	struct sess_entry* entry;
+	unsigned int idx;
+
+	if (sid == NULL || client == NULL || to_free == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	entry = malloc(sizeof(struct sess_entry));
+	if (entry == NULL || (entry->sid = strdup(sid)) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		free(entry);
+		return EXIT_FAILURE;
+	}
+	entry->client = client;
+	entry->to_free = to_free;
+
+	/* SESSIONS LOCK */
+	pthread_mutex_lock(&sessions.lock);
+
+	if (sessions.size == 0) {
+		registry_resize(REGISTRY_INIT_SIZE);
+	} else if (sessions.count >= sessions.size) {
+		/* keep the chains short, failure only makes them longer */
+		registry_resize(sessions.size * 2);
+	}
+	if (sessions.size == 0) {
+		/* SESSIONS UNLOCK */
+		pthread_mutex_unlock(&sessions.lock);
+		free(entry->sid);
+		free(entry);
+		return EXIT_FAILURE;
+	}
+
+	idx = sid_hash(sid) & (sessions.size - 1);
+	entry->next = sessions.buckets[idx];
+	sessions.buckets[idx] = entry;
+	++sessions.count;
+
+	/* SESSIONS UNLOCK */
+	pthread_mutex_unlock(&sessions.lock);
+
+	return EXIT_SUCCESS;
+}
+
+void np_registry_del_session(const char* sid) {
+	struct sess_entry* entry, *prev = NULL;
+	unsigned int idx;
+
+	if (sid == NULL) {
+		return;
+	}
+
+	/* SESSIONS LOCK */
+	pthread_mutex_lock(&sessions.lock);
+
+	if (sessions.size > 0) {
+		idx = sid_hash(sid) & (sessions.size - 1);
+		for (entry = sessions.buckets[idx]; entry != NULL; prev = entry, entry = entry->next) {
+			if (strcmp(entry->sid, sid) == 0) {
+				if (prev == NULL) {
+					sessions.buckets[idx] = entry->next;
+				} else {
+					prev->next = entry->next;
+				}
+				--sessions.count;
+				free(entry->sid);
+				free(entry);
+				break;
+			}
+		}
+	}
+
+	/* SESSIONS UNLOCK */
+	pthread_mutex_unlock(&sessions.lock);
+}
+
+int np_registry_kill_session(const char* sid, const struct client_struct* cur_client) {
+	struct sess_entry* entry = NULL;
+	int ret = 1;
+
+	if (sid == NULL) {
+		return 1;
+	}
+
+	/* SESSIONS LOCK */
+	pthread_mutex_lock(&sessions.lock);
+
+	if (sessions.size > 0) {
+		for (entry = sessions.buckets[sid_hash(sid) & (sessions.size - 1)]; entry != NULL; entry = entry->next) {
+			if (strcmp(entry->sid, sid) == 0) {
+				break;
+			}
+		}
+	}
+
+	/* the flag and the client stay valid until the session is deleted from the registry */
+	if (entry != NULL && entry->client == cur_client) {
+		ret = -1;
+	} else if (entry != NULL) {
+		*entry->to_free = 1;
+		np_reactor_kick(entry->client);
+		ret = 0;
+	}
+
+	/* SESSIONS UNLOCK */
+	pthread_mutex_unlock(&sessions.lock);
+
+	return ret;
+}
+
+void np_registry_cleanup(void) {
+	struct sess_entry* entry, *next;
+	unsigned int i;
+
+	/* SESSIONS LOCK */
+	pthread_mutex_lock(&sessions.lock);
+
+	for (i = 0; i < sessions.size; ++i) {
+		for (entry = sessions.buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			free(entry->sid);
+			free(entry);
+		}
+	}
+	free(sessions.buckets);
+	sessions.buckets = NULL;
+	sessions.size = 0;
+	sessions.count = 0;
+
+	/* SESSIONS UNLOCK */
+	pthread_mutex_unlock(&sessions.lock);
+}
+
+void np_session_count_add(NC_TRANSPORT transport, int diff) {
+	switch (transport) {
+	case NC_TRANSPORT_SSH:
+		__sync_fetch_and_add(&ssh_session_count, diff);
+		break;
+	case NC_TRANSPORT_TLS:
+		__sync_fetch_and_add(&tls_session_count, diff);
+		break;
+	default:
+		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
+		break;
+	}
+}
+
+unsigned int np_session_count(NC_TRANSPORT transport) {
+	switch (transport) {
+	case NC_TRANSPORT_SSH:
+		return __sync_fetch_and_add(&ssh_session_count, 0);
+	case NC_TRANSPORT_TLS:
+		return __sync_fetch_and_add(&tls_session_count, 0);
+	default:
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file registry.h
+ * @author agent <agent@local>
+ * @brief Netopeer server session registry header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _REGISTRY_H_
+#define _REGISTRY_H_
+
+#include <libnetconf.h>
+
+struct client_struct;
+
+/**
+ * @brief Remember a new NETCONF session so that it can be found by its ID
+ *
+ * @param sid Session ID
+ * @param client Client the session belongs to
+ * @param to_free Flag to set when the session is to be killed,
+ * the flag of the SSH channel or of the TLS client
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_registry_add_session(const char* sid, struct client_struct* client, volatile int* to_free);
+
+/**
+ * @brief Forget a NETCONF session, must be called before it is freed
+ *
+ * @param sid Session ID
+ */
+void np_registry_del_session(const char* sid);
+
+/**
+ * @brief Mark a session for removal
+ *
+ * @param sid ID of the session to kill
+ * @param cur_client Client requesting the kill, its sessions are not killed
+ *
+ * @return 0 if the session was killed, -1 if it belongs to cur_client, 1 if it was not found
+ */
+int np_registry_kill_session(const char* sid, const struct client_struct* cur_client);
+
+/**
+ * @brief Free the whole session index
+ */
+void np_registry_cleanup(void);
+
+/**
+ * @brief Adjust the number of sessions of a transport, can be called from any thread
+ *
+ * @param transport Transport of the sessions
+ * @param diff Number of added (positive) or removed (negative) sessions
+ */
+void np_session_count_add(NC_TRANSPORT transport, int diff);
+
+/**
+ * @brief Get the number of sessions of a transport, a client without any
+ * session yet (handshake, authentication) counts as one
+ *
+ * @param transport Transport of the sessions
+ *
+ * @return Number of sessions
+ */
+unsigned int np_session_count(NC_TRANSPORT transport);
+
+#endif /* _REGISTRY_H_ */
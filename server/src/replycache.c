@@ -0,0 +1,238 @@
+/**
+ * @file replycache.c
+ * @author agent <agent@local>
+ * @brief Netopeer server cache of the read-only RPC replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetconf_xml.h>
+
+#include "server.h"
+#include "hash.h"
+#include "stats.h"
+#include "replycache.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+struct np_replycache_entry {
+	char* user;
+	char* request;			// content of the operation
+	uint32_t hash;
+	char* data;				// reply data, NULL while being read, immutable afterwards
+	uint64_t expires;		// np_clock_ms() the data are valid until
+	int busy;				// being read, the others wait for it
+	int listed;				// in the cache, not invalidated
+	unsigned int refs;		// the cache, the one reading it and the ones copying the data
+	struct np_replycache_entry* next;
+};
+
+static uint32_t request_hash(const char* user, const char* request) {
+	return np_hash_str(np_hash_str(NP_HASH_INIT, user), request);
+}
+
+/* CACHE LOCK must be held */
+static void entry_unref(struct np_replycache_entry* entry) {
+	if (--entry->refs == 0) {
+		free(entry->user);
+		free(entry->request);
+		free(entry->data);
+		free(entry);
+	}
+}
+
+/* CACHE LOCK must be held */
+static void entry_unlink(struct np_replycache* cache, struct np_replycache_entry* entry) {
+	struct np_replycache_entry** prev;
+
+	for (prev = &cache->entries; *prev != NULL && *prev != entry; prev = &(*prev)->next);
+	if (*prev != NULL) {
+		*prev = entry->next;
+		--cache->count;
+		entry->listed = 0;
+		entry_unref(entry);
+	}
+}
+
+/* CACHE LOCK must be held, make room for a new entry, returns 0 if there is none */
+static int cache_evict(struct np_replycache* cache, uint64_t now) {
+	struct np_replycache_entry* entry, *victim = NULL;
+
+	if (cache->count < cache->size) {
+		return 1;
+	}
+
+	/* the expired one or the one expiring first */
+	for (entry = cache->entries; entry != NULL; entry = entry->next) {
+		if (entry->busy) {
+			continue;
+		}
+		if (victim == NULL || entry->expires < victim->expires) {
+			victim = entry;
+			if (victim->expires <= now) {
+				break;
+			}
+		}
+	}
+
+	if (victim == NULL) {
+		return 0;
+	}
+	entry_unlink(cache, victim);
+	return 1;
+}
+
+nc_reply* np_replycache_lookup(struct np_replycache* cache, const char* user, const nc_rpc* rpc, struct np_replycache_entry** entry) {
+	struct np_replycache_entry* cur, *found = NULL;
+	nc_reply* reply = NULL;
+	char* request;
+	uint32_t hash;
+	uint64_t now;
+
+	*entry = NULL;
+	if (*cache->ttl == 0 || user == NULL) {
+		return NULL;
+	}
+	if ((request = nc_rpc_get_op_content(rpc)) == NULL) {
+		return NULL;
+	}
+	hash = request_hash(user, request);
+
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache->lock);
+
+	while (1) {
+		for (cur = cache->entries; cur != NULL; cur = cur->next) {
+			if (cur->hash == hash && strcmp(cur->request, request) == 0 && strcmp(cur->user, user) == 0) {
+				break;
+			}
+		}
+		if (cur == NULL || !cur->busy) {
+			break;
+		}
+		/* someone is reading the same reply right now, the entry may be gone afterwards */
+		pthread_cond_wait(&cache->cond, &cache->lock);
+	}
+
+	now = np_clock_ms();
+	if (cur != NULL && cur->expires > now) {
+		/* the data do not change, only the reference keeps them meanwhile */
+		++cur->refs;
+		found = cur;
+	} else if (cur != NULL) {
+		/* expired, read it again */
+		entry_unlink(cache, cur);
+	}
+	if (found == NULL && cache_evict(cache, now) && (cur = calloc(1, sizeof(struct np_replycache_entry))) != NULL) {
+		cur->user = strdup(user);
+		cur->request = request;
+		request = NULL;
+		cur->hash = hash;
+		cur->busy = 1;
+		cur->listed = 1;
+		cur->refs = 2;
+		cur->next = cache->entries;
+		cache->entries = cur;
+		++cache->count;
+		*entry = cur;
+	}
+
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache->lock);
+
+	if (found != NULL) {
+		reply = nc_reply_data(found->data);
+
+		/* CACHE LOCK */
+		pthread_mutex_lock(&cache->lock);
+		entry_unref(found);
+		/* CACHE UNLOCK */
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	free(request);
+	np_stat_inc(reply != NULL ? cache->hits : cache->misses);
+	return reply;
+}
+
+void np_replycache_store(struct np_replycache* cache, struct np_replycache_entry* entry, const nc_reply* reply) {
+	char* data = NULL;
+
+	if (entry == NULL) {
+		return;
+	}
+
+	if (reply != NULL && nc_reply_get_type(reply) == NC_REPLY_DATA) {
+		data = nc_reply_get_data(reply);
+	}
+
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache->lock);
+
+	entry->busy = 0;
+	if (data != NULL && entry->listed) {
+		entry->data = data;
+		entry->expires = np_clock_ms() + *cache->ttl;
+	} else {
+		/* failed or outdated, the waiting ones read it themselves */
+		free(data);
+		entry_unlink(cache, entry);
+	}
+	entry_unref(entry);
+	pthread_cond_broadcast(&cache->cond);
+
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void np_replycache_invalidate(struct np_replycache* cache) {
+	/* CACHE LOCK */
+	pthread_mutex_lock(&cache->lock);
+
+	/* the busy ones are freed once stored, the copied ones by their readers */
+	while (cache->entries != NULL) {
+		entry_unlink(cache, cache->entries);
+	}
+	/* the ones waiting for a busy entry read the reply themselves */
+	pthread_cond_broadcast(&cache->cond);
+
+	/* CACHE UNLOCK */
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file replycache.h
+ * @author agent <agent@local>
+ * @brief Netopeer server cache of the read-only RPC replies header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _REPLYCACHE_H_
+#define _REPLYCACHE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <libnetconf.h>
+
+#include "stats.h"
+
+/* an entry reserved for a reply being read from the datastores */
+struct np_replycache_entry;
+
+/*
+ * Replies of the RPCs with the same content from the same user, reused for at most
+ * ttl msecs. The readers of the same reply wait for the first one to read it and
+ * the replies are copied outside of the lock.
+ */
+struct np_replycache {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;	// signalled when a busy entry is released
+	struct np_replycache_entry* entries;
+	unsigned int count;
+	unsigned int size;		// maximum number of entries
+	const uint32_t* ttl;	// option with the ttl, 0 disables the cache
+	enum np_stat hits;
+	enum np_stat misses;
+};
+
+#define NP_REPLYCACHE_INITIALIZER(SIZE, TTL, HITS, MISSES) {.lock = PTHREAD_MUTEX_INITIALIZER, \
+	.cond = PTHREAD_COND_INITIALIZER, .size = (SIZE), .ttl = (TTL), .hits = (HITS), .misses = (MISSES)}
+
+/**
+ * @brief Look up a cached reply. If there is none, the caller is expected to
+ * read it and pass it to np_replycache_store(), the others asking for the same
+ * reply wait for it meanwhile.
+ *
+ * @param cache Cache to look into
+ * @param user User of the session, the replies depend on its access rights
+ * @param rpc RPC
+ * @param[out] entry Set to the entry to store the reply into, NULL if the reply
+ * is not to be stored
+ *
+ * @return Copy of the cached reply, NULL if it must be read
+ */
+nc_reply* np_replycache_lookup(struct np_replycache* cache, const char* user, const nc_rpc* rpc, struct np_replycache_entry** entry);
+
+/**
+ * @brief Store a reply read after an unsuccessful lookup and wake the ones
+ * waiting for it, the error replies and the replies read while the cache was
+ * invalidated are not stored
+ *
+ * @param cache Cache of the entry
+ * @param entry Entry returned by np_replycache_lookup(), can be NULL
+ * @param reply Reply read from the datastores, it is not freed
+ */
+void np_replycache_store(struct np_replycache* cache, struct np_replycache_entry* entry, const nc_reply* reply);
+
+/**
+ * @brief Drop all the cached replies, the ones still being copied are freed by their readers
+ *
+ * @param cache Cache to invalidate
+ */
+void np_replycache_invalidate(struct np_replycache* cache);
+
+#endif /* _REPLYCACHE_H_ */
@@ -0,0 +1,877 @@
+/**
+ * @file rpcpool.c
+ * @author agent <agent@local>
+ * @brief Netopeer server RPC processing threads
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libnetconf_xml.h>
+
+#include "server.h"
+#include "notif.h"
+#include "reactor.h"
+#include "registry.h"
+#include "stats.h"
+#include "memacct.h"
+#include "snapshot.h"
+#include "statecache.h"
+#include "nacmcache.h"
+#include "rpcpool.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+struct rpc_job {
+	nc_rpc* rpc;
+	nc_reply* reply;
+	size_t reply_size;			// accounted to the session until the transport takes the reply
+	char* reply_data;			// data of a measured reply large enough to be streamed
+	int closing;				// close-session, send the reply and free the session
+	struct np_subscriber* subscriber;	// create-subscription, active once the reply is taken
+	struct ntf_thread_config* ntf_config;	// create-subscription sent by libnetconf, started once the reply is taken
+	struct rpc_job* next;
+};
+
+struct np_rpcq {
+	struct client_struct* client;
+	struct nc_session* session;
+	struct np_memacct* mem;
+
+	struct rpc_job* queued_head;	// waiting for execution
+	struct rpc_job* queued_tail;
+	struct rpc_job* running;
+	struct rpc_job* done_head;		// waiting for the transport to send the reply
+	struct rpc_job* done_tail;
+	unsigned int pending;			// all the jobs not taken by the transport yet
+	int subscribed;					// a subscription was created, the RPC threads only
+	struct np_subscriber* subscriber;
+	int nc_notif;					// libnetconf writes the notifications itself, the transport only
+
+	int ready;						// in the ready queue of the pool
+	int woken;						// in the wake list of the pool
+	int closed;						// nothing more is going to be executed
+	struct np_rpcq* next_ready;
+	struct np_rpcq* next_woken;
+};
+
+/*
+ * Every session queue is executed by at most one thread at a time, so the RPCs
+ * of a session are executed in order while the sessions are processed
+ * in parallel. The replies are not sent from here, the client is scheduled
+ * by the event loop thread and the thread owning it sends them to keep
+ * all the I/O of a transport session in a single thread.
+ */
+static struct {
+	/* locked when accessing any queue or the lists */
+	pthread_mutex_t lock;
+	pthread_cond_t ready_cond;
+	/* signalled when a job finishes */
+	pthread_cond_t done_cond;
+	struct np_rpcq* ready_head;
+	struct np_rpcq* ready_tail;
+	struct np_rpcq* woken_head;
+	volatile int stop;
+
+	/* read-only operations share it, all the others are exclusive */
+	pthread_rwlock_t ds_lock;
+
+	pthread_t* workers;
+	unsigned int worker_count;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.ready_cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+	.ds_lock = PTHREAD_RWLOCK_INITIALIZER
+};
+
+/* POOL LOCK must be held */
+static void rpcq_make_ready(struct np_rpcq* rpcq) {
+	if (rpcq->ready || rpcq->running != NULL || rpcq->closed || rpcq->queued_head == NULL) {
+		return;
+	}
+	rpcq->ready = 1;
+
+	rpcq->next_ready = NULL;
+	if (pool.ready_tail == NULL) {
+		pool.ready_head = rpcq;
+	} else {
+		pool.ready_tail->next_ready = rpcq;
+	}
+	pool.ready_tail = rpcq;
+
+	pthread_cond_signal(&pool.ready_cond);
+}
+
+static uint64_t usec_since(const struct timespec* start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * UINT64_C(1000000) + now.tv_nsec / 1000 - start->tv_nsec / 1000;
+}
+
+static void rpc_job_free(struct rpc_job* job) {
+	np_notif_unsubscribe(job->subscriber);
+	if (job->ntf_config != NULL) {
+		nc_rpc_free(job->ntf_config->subscribe_rpc);
+		free(job->ntf_config);
+	}
+	nc_rpc_free(job->rpc);
+	if (job->reply != NULL) {
+		nc_reply_free(job->reply);
+	}
+	free(job->reply_data);
+	free(job);
+}
+
+static nc_reply* rpc_kill_session(struct np_rpcq* rpcq, const nc_rpc* rpc) {
+	xmlNodePtr op;
+	struct nc_err* err;
+	char* sid;
+	int ret;
+
+	if ((op = ncxml_rpc_get_op_content(rpc)) == NULL || op->name == NULL ||
+			xmlStrEqual(op->name, BAD_CAST "kill-session") == 0) {
+		nc_verb_error("%s: corrupted RPC message", __func__);
+		xmlFreeNodeList(op);
+		return nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
+	}
+	if (op->children == NULL || xmlStrEqual(op->children->name, BAD_CAST "session-id") == 0) {
+		nc_verb_error("%s: no session ID found", __func__);
+		xmlFreeNodeList(op);
+		err = nc_err_new(NC_ERR_MISSING_ELEM);
+		nc_err_set(err, NC_ERR_PARAM_INFO_BADELEM, "session-id");
+		return nc_reply_error(err);
+	}
+
+	sid = (char*)xmlNodeGetContent(op->children);
+	xmlFreeNodeList(op);
+
+	/* check if this client is not requested to be killed */
+	if (strcmp(nc_session_get_id(rpcq->session), sid) == 0 || (ret = np_registry_kill_session(sid, rpcq->client)) == -1) {
+		free(sid);
+		err = nc_err_new(NC_ERR_INVALID_VALUE);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "Requested to kill this session.");
+		return nc_reply_error(err);
+	}
+
+	if (ret != 0) {
+		free(sid);
+		err = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "No session with the requested ID found.");
+		return nc_reply_error(err);
+	}
+
+	nc_verb_verbose("Session with the ID %s killed.", sid);
+	free(sid);
+
+	return nc_reply_ok();
+}
+
+/* returns the stream name if the subscription can be served by the dispatcher */
+static char* rpc_subscription_stream(const nc_rpc* rpc) {
+	xmlNodePtr op, node;
+	char* stream = NULL;
+	int shared = 1;
+
+	if ((op = ncxml_rpc_get_op_content(rpc)) == NULL) {
+		return NULL;
+	}
+
+	for (node = op->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrEqual(node->name, BAD_CAST "stream")) {
+			free(stream);
+			stream = (char*)xmlNodeGetContent(node);
+		} else {
+			/* replay and filtering are specific for every subscriber */
+			shared = 0;
+		}
+	}
+	xmlFreeNodeList(op);
+
+	if (!shared) {
+		free(stream);
+		return NULL;
+	}
+	if (stream == NULL) {
+		stream = strdup("NETCONF");
+	}
+
+	return stream;
+}
+
+static nc_reply* rpc_create_subscription(struct np_rpcq* rpcq, const nc_rpc* rpc, struct np_subscriber** subscriber, struct ntf_thread_config** ntf_config) {
+	nc_reply* rpc_reply;
+	struct nc_err* err;
+	char* stream;
+
+	if (nc_cpblts_enabled(rpcq->session, "urn:ietf:params:netconf:capability:notification:1.0") == 0) {
+		return nc_reply_error(nc_err_new(NC_ERR_OP_NOT_SUPPORTED));
+	}
+
+	/* check if notifications are allowed on this session */
+	if (rpcq->subscribed || nc_session_notif_allowed(rpcq->session) == 0) {
+		nc_verb_error("%s: notification subscription is not allowed on the session %s", __func__, nc_session_get_id(rpcq->session));
+		err = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(err, NC_ERR_PARAM_TYPE, "protocol");
+		nc_err_set(err, NC_ERR_PARAM_MSG, "Another notification subscription is currently active on this session.");
+		return nc_reply_error(err);
+	}
+
+	rpc_reply = ncntf_subscription_check((nc_rpc*)rpc);
+	if (nc_reply_get_type(rpc_reply) != NC_REPLY_OK) {
+		return rpc_reply;
+	}
+
+	/* live events of a stream are read once and queued for all the subscribers */
+	if ((stream = rpc_subscription_stream(rpc)) != NULL) {
+		*subscriber = np_notif_subscribe(rpcq->client, rpcq->session, stream, rpcq->mem);
+		free(stream);
+		if (*subscriber == NULL) {
+			nc_reply_free(rpc_reply);
+			err = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+			return nc_reply_error(err);
+		}
+		rpcq->subscribed = 1;
+		return rpc_reply;
+	}
+
+	if ((*ntf_config = malloc(sizeof(struct ntf_thread_config))) == NULL) {
+		nc_verb_error("%s: memory allocation failed", __func__);
+		nc_reply_free(rpc_reply);
+		err = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+		return nc_reply_error(err);
+	}
+	(*ntf_config)->session = rpcq->session;
+	(*ntf_config)->subscribe_rpc = nc_rpc_dup((nc_rpc*)rpc);
+
+	/*
+	 * the thread writes to the session behind the back of the transport, it is started
+	 * only when the transport takes the reply, no streamed reply can be in progress then
+	 */
+	rpcq->subscribed = 1;
+
+	return rpc_reply;
+}
+
+/* filter of the get being applied by this thread */
+static __thread xmlNodePtr state_filter;
+
+xmlNodePtr np_get_state_filter(void) {
+	return state_filter;
+}
+
+static xmlNodePtr rpc_subtree_filter(xmlNodePtr op_content) {
+	xmlNodePtr node;
+	xmlChar* type;
+	int subtree;
+
+	if (op_content == NULL) {
+		return NULL;
+	}
+
+	for (node = op_content->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE || !xmlStrEqual(node->name, BAD_CAST "filter")) {
+			continue;
+		}
+
+		/* subtree is the default type */
+		type = xmlGetProp(node, BAD_CAST "type");
+		subtree = (type == NULL || xmlStrEqual(type, BAD_CAST "subtree"));
+		xmlFree(type);
+
+		return (subtree ? node : NULL);
+	}
+
+	return NULL;
+}
+
+/* an element child of an operation or its parameter, the prefix does not matter */
+static xmlNodePtr rpc_param(xmlNodePtr parent, const char* name) {
+	xmlNodePtr child;
+
+	for (child = parent->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE && xmlStrEqual(child->name, BAD_CAST name)
+				&& (child->ns == NULL || xmlStrEqual(child->ns->href, BAD_CAST "urn:ietf:params:xml:ns:netconf:base:1.0"))) {
+			return child;
+		}
+	}
+
+	return NULL;
+}
+
+/* whether there is an element of the namespace in the subtrees */
+static int rpc_config_has_ns(xmlNodePtr node, const char* ns) {
+	for (; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if ((node->ns != NULL && xmlStrEqual(node->ns->href, BAD_CAST ns)) || rpc_config_has_ns(node->children, ns)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* whether an RPC could have changed the NACM rules */
+static int rpc_changes_nacm(const nc_rpc* rpc, NC_OP op) {
+	xmlNodePtr op_content, node;
+	xmlChar* defop;
+	int ret;
+
+	switch (op) {
+	case NC_OP_LOCK:
+	case NC_OP_UNLOCK:
+	case NC_OP_VALIDATE:
+		return 0;
+	case NC_OP_EDITCONFIG:
+	case NC_OP_COPYCONFIG:
+	case NC_OP_DELETECONFIG:
+		break;
+	default:
+		/* commit, discard-changes or an RPC of a module */
+		return 1;
+	}
+
+	if ((op_content = ncxml_rpc_get_op_content(rpc)) == NULL) {
+		return 1;
+	}
+
+	if (op == NC_OP_EDITCONFIG) {
+		if (rpc_param(op_content, "url") != NULL) {
+			/* the content is not known */
+			ret = 1;
+		} else {
+			/* the rules are replaced even if not mentioned, otherwise edited only with the elements of their namespace */
+			ret = 0;
+			if ((node = rpc_param(op_content, "default-operation")) != NULL && (defop = xmlNodeGetContent(node)) != NULL) {
+				ret = xmlStrEqual(defop, BAD_CAST "replace");
+				xmlFree(defop);
+			}
+			if (!ret) {
+				ret = ((node = rpc_param(op_content, "config")) == NULL || rpc_config_has_ns(node->children, NP_NACM_NS));
+			}
+		}
+	} else {
+		/* copy-config and delete-config to an URL do not change any datastore */
+		ret = ((node = rpc_param(op_content, "target")) == NULL || rpc_param(node, "url") == NULL);
+	}
+
+	xmlFreeNode(op_content);
+	return ret;
+}
+
+static nc_reply* rpc_apply(struct np_rpcq* rpcq, nc_rpc* rpc) {
+	nc_reply* rpc_reply;
+	struct nc_err* err;
+	struct timespec start;
+	struct np_replycache_entry* cached = NULL, *snapshot = NULL;
+	xmlNodePtr op_content = NULL;
+	NC_OP op;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	op = nc_rpc_get_op(rpc);
+	if (op == NC_OP_GET && (rpc_reply = np_statecache_lookup(nc_session_get_user(rpcq->session), rpc, &cached)) != NULL) {
+		np_stat_rpc(op, usec_since(&start));
+		return rpc_reply;
+	}
+	/* the configuration as of the last change, even while another one is being applied */
+	if (op == NC_OP_GETCONFIG && (rpc_reply = np_snapshot_lookup(nc_session_get_user(rpcq->session), rpc, &snapshot)) != NULL) {
+		np_stat_rpc(op, usec_since(&start));
+		return rpc_reply;
+	}
+
+	switch (op) {
+	case NC_OP_GET:
+	case NC_OP_GETCONFIG:
+	case NC_OP_GETSCHEMA:
+		/* DS READ LOCK */
+		pthread_rwlock_rdlock(&pool.ds_lock);
+		break;
+	default:
+		/* DS WRITE LOCK */
+		pthread_rwlock_wrlock(&pool.ds_lock);
+		break;
+	}
+
+	if (op == NC_OP_GET) {
+		/* the modules may then build only the filtered state data */
+		op_content = ncxml_rpc_get_op_content(rpc);
+		state_filter = rpc_subtree_filter(op_content);
+	}
+
+	rpc_reply = ncds_apply_rpc2all(rpcq->session, rpc, NULL);
+	np_stat_rpc(op, usec_since(&start));
+
+	state_filter = NULL;
+	xmlFreeNode(op_content);
+
+	switch (op) {
+	case NC_OP_GET:
+	case NC_OP_GETCONFIG:
+	case NC_OP_GETSCHEMA:
+		break;
+	default:
+		/* the datastores may have changed, still under the write lock so no get reads the old data */
+		np_statecache_invalidate();
+		np_snapshot_invalidate();
+		if (rpc_changes_nacm(rpc, op)) {
+			np_nacmcache_invalidate();
+		}
+		break;
+	}
+
+	/* DS UNLOCK */
+	pthread_rwlock_unlock(&pool.ds_lock);
+
+	if (rpc_reply == NULL) {
+		err = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "For unknown reason no reply was returned by the library.");
+		rpc_reply = nc_reply_error(err);
+	} else if (rpc_reply == NCDS_RPC_NOT_APPLICABLE) {
+		err = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "There is no device/data that could be affected.");
+		nc_reply_free(rpc_reply);
+		rpc_reply = nc_reply_error(err);
+	}
+	np_statecache_store(cached, rpc_reply);
+	np_snapshot_publish(snapshot, rpc_reply);
+
+	return rpc_reply;
+}
+
+static void rpc_execute(struct np_rpcq* rpcq, struct rpc_job* job) {
+	struct timespec start;
+	struct nc_err* err;
+	NC_OP op;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* nothing is built for a session over its budget until it reads its replies, it can still close */
+	op = nc_rpc_get_op(job->rpc);
+	if (op != NC_OP_CLOSESESSION && op != NC_OP_KILLSESSION && (err = np_memacct_check(rpcq->mem)) != NULL) {
+		job->reply = nc_reply_error(err);
+		np_stat_rpc(op, usec_since(&start));
+		return;
+	}
+
+	switch (op) {
+	case NC_OP_CLOSESESSION:
+		job->closing = 1;
+		job->reply = nc_reply_ok();
+		break;
+
+	case NC_OP_KILLSESSION:
+		job->reply = rpc_kill_session(rpcq, job->rpc);
+		break;
+
+	case NC_OP_CREATESUBSCRIPTION:
+		job->reply = rpc_create_subscription(rpcq, job->rpc, &job->subscriber, &job->ntf_config);
+		break;
+
+	default:
+		/* counted around the datastore operation itself */
+		job->reply = rpc_apply(rpcq, job->rpc);
+		return;
+	}
+
+	np_stat_rpc(op, usec_since(&start));
+}
+
+/* account the data reply to the session, or replace it with an error if it does not fit */
+static void rpc_account_reply(struct np_rpcq* rpcq, struct rpc_job* job) {
+	struct nc_err* err;
+	char* data;
+	size_t size;
+
+	/* measuring the reply takes a dump of its data, it is paid only for the budgets */
+	if (!np_memacct_enabled() || job->reply == NULL || nc_reply_get_type(job->reply) != NC_REPLY_DATA
+			|| (data = nc_reply_get_data(job->reply)) == NULL) {
+		return;
+	}
+	size = strlen(data);
+
+	if ((err = np_memacct_charge_reply(rpcq->mem, size)) != NULL) {
+		nc_verb_warning("Reply of %zu bytes to the session %s denied by the memory budgets.", size, nc_session_get_id(rpcq->session));
+		free(data);
+		nc_reply_free(job->reply);
+		job->reply = nc_reply_error(err);
+		return;
+	}
+	job->reply_size = size;
+
+	if (size < STREAM_REPLY_THRESHOLD) {
+		/* sent by libnetconf, which dumps it itself */
+		free(data);
+	} else {
+		/* the stream takes it instead of dumping the reply again */
+		job->reply_data = data;
+	}
+}
+
+static void* rpcpool_worker(void* UNUSED(arg)) {
+	struct np_rpcq* rpcq;
+	struct rpc_job* job;
+	int notify;
+
+	while (1) {
+		/* POOL LOCK */
+		pthread_mutex_lock(&pool.lock);
+		while (pool.ready_head == NULL && !pool.stop) {
+			pthread_cond_wait(&pool.ready_cond, &pool.lock);
+		}
+
+		rpcq = pool.ready_head;
+		if (rpcq == NULL) {
+			/* POOL UNLOCK */
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+
+		pool.ready_head = rpcq->next_ready;
+		if (pool.ready_head == NULL) {
+			pool.ready_tail = NULL;
+		}
+		rpcq->ready = 0;
+
+		job = rpcq->queued_head;
+		rpcq->queued_head = job->next;
+		if (rpcq->queued_head == NULL) {
+			rpcq->queued_tail = NULL;
+		}
+		job->next = NULL;
+		rpcq->running = job;
+		/* POOL UNLOCK */
+		pthread_mutex_unlock(&pool.lock);
+
+		rpc_execute(rpcq, job);
+		rpc_account_reply(rpcq, job);
+
+		/* POOL LOCK */
+		pthread_mutex_lock(&pool.lock);
+		rpcq->running = NULL;
+		if (rpcq->done_tail == NULL) {
+			rpcq->done_head = job;
+		} else {
+			rpcq->done_tail->next = job;
+		}
+		rpcq->done_tail = job;
+
+		/* nothing after close-session is executed */
+		if (job->closing) {
+			rpcq->closed = 1;
+		}
+		rpcq_make_ready(rpcq);
+
+		notify = 0;
+		if (!rpcq->woken) {
+			rpcq->woken = 1;
+			rpcq->next_woken = pool.woken_head;
+			pool.woken_head = rpcq;
+			notify = 1;
+		}
+		pthread_cond_broadcast(&pool.done_cond);
+		/* POOL UNLOCK */
+		pthread_mutex_unlock(&pool.lock);
+
+		if (notify) {
+			np_reactor_notify();
+		}
+	}
+
+	return NULL;
+}
+
+int np_rpcpool_init(unsigned int workers) {
+	int ret;
+
+	pool.stop = 0;
+
+	if (workers == 0) {
+		workers = 1;
+	}
+	pool.workers = calloc(workers, sizeof(pthread_t));
+	if (pool.workers == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	for (pool.worker_count = 0; pool.worker_count < workers; ++pool.worker_count) {
+		if ((ret = pthread_create(&pool.workers[pool.worker_count], NULL, rpcpool_worker, NULL)) != 0) {
+			nc_verb_error("%s: failed to create a thread (%s)", __func__, strerror(ret));
+			break;
+		}
+	}
+	if (pool.worker_count == 0) {
+		np_rpcpool_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	nc_verb_verbose("Processing the RPCs with %u threads.", pool.worker_count);
+	return EXIT_SUCCESS;
+}
+
+void np_rpcpool_cleanup(void) {
+	unsigned int i;
+	int ret;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.ready_cond);
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i = 0; i < pool.worker_count; ++i) {
+		if ((ret = pthread_join(pool.workers[i], NULL)) != 0) {
+			nc_verb_error("%s: failed to join an RPC thread (%s)", __func__, strerror(ret));
+		}
+	}
+	free(pool.workers);
+	pool.workers = NULL;
+	pool.worker_count = 0;
+}
+
+void np_rpcpool_wakeups(void) {
+	struct np_rpcq* rpcq;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+
+	/* a queue is freed only after being removed from the list, so the client is valid */
+	for (rpcq = pool.woken_head; rpcq != NULL; rpcq = rpcq->next_woken) {
+		rpcq->woken = 0;
+		np_reactor_schedule(rpcq->client);
+	}
+	pool.woken_head = NULL;
+
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+}
+
+struct np_rpcq* np_rpcq_new(struct client_struct* client, struct nc_session* session) {
+	struct np_rpcq* rpcq;
+
+	rpcq = calloc(1, sizeof(struct np_rpcq));
+	if (rpcq == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return NULL;
+	}
+	rpcq->client = client;
+	rpcq->session = session;
+	if ((rpcq->mem = np_memacct_new(session)) == NULL) {
+		free(rpcq);
+		return NULL;
+	}
+
+	return rpcq;
+}
+
+int np_rpcq_push(struct np_rpcq* rpcq, nc_rpc* rpc) {
+	struct rpc_job* job;
+
+	job = calloc(1, sizeof(struct rpc_job));
+	if (job == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	job->rpc = rpc;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+
+	if (rpcq->queued_tail == NULL) {
+		rpcq->queued_head = job;
+	} else {
+		rpcq->queued_tail->next = job;
+	}
+	rpcq->queued_tail = job;
+	++rpcq->pending;
+	rpcq_make_ready(rpcq);
+
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+
+	return EXIT_SUCCESS;
+}
+
+nc_reply* np_rpcq_pop_reply(struct np_rpcq* rpcq, nc_rpc** rpc, char** data, int* closing) {
+	struct rpc_job* job;
+	nc_reply* reply = NULL;
+	pthread_t thread;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+
+	job = rpcq->done_head;
+	if (job != NULL) {
+		rpcq->done_head = job->next;
+		if (rpcq->done_head == NULL) {
+			rpcq->done_tail = NULL;
+		}
+		--rpcq->pending;
+
+		/* no notification may precede the reply */
+		if (job->subscriber != NULL) {
+			rpcq->subscriber = job->subscriber;
+		}
+	}
+
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+
+	if (job != NULL) {
+		if (job->ntf_config != NULL) {
+			/* no reply is streamed from now on, it could be interleaved with the notifications */
+			rpcq->nc_notif = 1;
+			if (pthread_create(&thread, NULL, client_notif_thread, job->ntf_config) == 0) {
+				pthread_detach(thread);
+			} else {
+				nc_verb_error("%s: creating thread for sending Notifications of the session %s failed", __func__, nc_session_get_id(rpcq->session));
+				nc_rpc_free(job->ntf_config->subscribe_rpc);
+				free(job->ntf_config);
+			}
+		}
+		np_memacct_release(rpcq->mem, NP_MEM_REPLIES, job->reply_size);
+		*rpc = job->rpc;
+		*data = job->reply_data;
+		*closing = job->closing;
+		reply = job->reply;
+		free(job);
+	}
+
+	return reply;
+}
+
+int np_rpcq_streamable(struct np_rpcq* rpcq) {
+	return !rpcq->nc_notif;
+}
+
+struct np_subscriber* np_rpcq_subscriber(struct np_rpcq* rpcq) {
+	struct np_subscriber* subscriber;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+	subscriber = rpcq->subscriber;
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+
+	return subscriber;
+}
+
+struct np_memacct* np_rpcq_memacct(struct np_rpcq* rpcq) {
+	return rpcq->mem;
+}
+
+unsigned int np_rpcq_pending(struct np_rpcq* rpcq) {
+	unsigned int pending;
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+	pending = rpcq->pending;
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+
+	return pending;
+}
+
+void np_rpcq_free(struct np_rpcq* rpcq) {
+	struct np_rpcq* cur, *prev;
+	struct rpc_job* job, *next;
+
+	if (rpcq == NULL) {
+		return;
+	}
+
+	/* POOL LOCK */
+	pthread_mutex_lock(&pool.lock);
+
+	/* no thread picks it up anymore */
+	rpcq->closed = 1;
+	if (rpcq->ready) {
+		for (prev = NULL, cur = pool.ready_head; cur != rpcq; prev = cur, cur = cur->next_ready);
+		if (prev == NULL) {
+			pool.ready_head = rpcq->next_ready;
+		} else {
+			prev->next_ready = rpcq->next_ready;
+		}
+		if (pool.ready_tail == rpcq) {
+			pool.ready_tail = prev;
+		}
+		rpcq->ready = 0;
+	}
+
+	/* the RPC being executed uses the session */
+	while (rpcq->running != NULL) {
+		pthread_cond_wait(&pool.done_cond, &pool.lock);
+	}
+
+	if (rpcq->woken) {
+		for (prev = NULL, cur = pool.woken_head; cur != rpcq; prev = cur, cur = cur->next_woken);
+		if (prev == NULL) {
+			pool.woken_head = rpcq->next_woken;
+		} else {
+			prev->next_woken = rpcq->next_woken;
+		}
+		rpcq->woken = 0;
+	}
+
+	/* POOL UNLOCK */
+	pthread_mutex_unlock(&pool.lock);
+
+	np_notif_unsubscribe(rpcq->subscriber);
+	for (job = rpcq->queued_head; job != NULL; job = next) {
+		next = job->next;
+		rpc_job_free(job);
+	}
+	for (job = rpcq->done_head; job != NULL; job = next) {
+		next = job->next;
+		np_memacct_release(rpcq->mem, NP_MEM_REPLIES, job->reply_size);
+		rpc_job_free(job);
+	}
+	np_memacct_unref(rpcq->mem);
+	free(rpcq);
+}
@@ -0,0 +1,162 @@
+/**
+ * @file rpcpool.h
+ * @author agent <agent@local>
+ * @brief Netopeer server RPC processing threads header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _RPCPOOL_H_
+#define _RPCPOOL_H_
+
+#include <libxml/tree.h>
+#include <libnetconf.h>
+
+struct client_struct;
+struct np_subscriber;
+struct np_memacct;
+
+/* RPCs of a single NETCONF session, they are executed and replied in order */
+struct np_rpcq;
+
+/**
+ * @brief Create the RPC processing threads
+ *
+ * @param workers Number of threads
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int np_rpcpool_init(unsigned int workers);
+
+/**
+ * @brief Join all the RPC processing threads, there must be no queues left
+ */
+void np_rpcpool_cleanup(void);
+
+/**
+ * @brief Schedule all the clients with new replies, called from the event loop thread
+ */
+void np_rpcpool_wakeups(void);
+
+/**
+ * @brief Create a queue for a new NETCONF session
+ *
+ * @param client Client the session belongs to, it is scheduled whenever a reply is ready
+ * @param session NETCONF session
+ *
+ * @return New queue, NULL on error
+ */
+struct np_rpcq* np_rpcq_new(struct client_struct* client, struct nc_session* session);
+
+/**
+ * @brief Queue a received RPC for execution
+ *
+ * @param rpcq Queue of the session
+ * @param rpc RPC to execute, the queue takes care of freeing it
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE, the RPC is not freed then
+ */
+int np_rpcq_push(struct np_rpcq* rpcq, nc_rpc* rpc);
+
+/**
+ * @brief Take the oldest RPC whose reply is ready, the replies are returned
+ * in the order of the RPCs
+ *
+ * @param rpcq Queue of the session
+ * @param rpc RPC the reply belongs to, must be freed by the caller
+ * @param data Data of the reply if they were dumped to measure it, NULL otherwise,
+ * to be passed to np_stream_new()
+ * @param closing Set if the session is to be closed once the reply is sent
+ *
+ * @return Reply to be sent and freed by the caller, NULL if there is none
+ */
+nc_reply* np_rpcq_pop_reply(struct np_rpcq* rpcq, nc_rpc** rpc, char** data, int* closing);
+
+/**
+ * @brief Learn whether the replies of the session may be streamed, they may not once
+ * libnetconf writes the notifications of a replayed or filtered subscription itself,
+ * to be called by the transport only
+ *
+ * @param rpcq Queue of the session
+ *
+ * @return Non-zero if they may, 0 otherwise
+ */
+int np_rpcq_streamable(struct np_rpcq* rpcq);
+
+/**
+ * @brief Get the subscriber of the session, it is set once the reply
+ * to its create-subscription was taken
+ *
+ * @param rpcq Queue of the session
+ *
+ * @return Subscriber whose notifications are to be sent, NULL if there is none
+ */
+struct np_subscriber* np_rpcq_subscriber(struct np_rpcq* rpcq);
+
+/**
+ * @brief Get the memory accounting of the session, to account the streamed replies to
+ *
+ * @param rpcq Queue of the session
+ *
+ * @return Accounting valid while the queue is, a reference must be taken to keep it longer
+ */
+struct np_memacct* np_rpcq_memacct(struct np_rpcq* rpcq);
+
+/**
+ * @brief Get the number of RPCs which were not replied yet
+ *
+ * @param rpcq Queue of the session
+ *
+ * @return Number of RPCs
+ */
+unsigned int np_rpcq_pending(struct np_rpcq* rpcq);
+
+/**
+ * @brief Drop all the RPCs that were not executed yet, wait for the one being
+ * executed and free the queue, must be called before the session is freed
+ *
+ * @param rpcq Queue to free
+ */
+void np_rpcq_free(struct np_rpcq* rpcq);
+
+/**
+ * @brief Get the subtree filter of the get RPC being applied by the calling
+ * thread. It is exported for the transAPI modules so that they can build only
+ * the requested state data, they are expected to declare it weak and build all
+ * the data if it is not available.
+ *
+ * @return Filter element, NULL if there is none or it is not a subtree filter
+ */
+xmlNodePtr np_get_state_filter(void);
+
+#endif /* _RPCPOOL_H_ */
@@ -41,6 +41,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -64,40 +65,56 @@
 #include <libnetconf_xml.h>
 
 #include "server.h"
+#include "reactor.h"
+#include "registry.h"
+#include "rpcpool.h"
+#include "notif.h"
+#include "stats.h"
+#include "ratelimit.h"
+#include "snapshot.h"
+#include "statecache.h"
+#include "nacmcache.h"
+#include "logging.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
 extern struct np_options netopeer_options;
 
-extern pthread_mutex_t callhome_lock;
-extern pthread_cond_t callhome_cond;
-extern struct ch_app* callhome_app;
 
 /* one global structure holding all the client information */
 struct np_state netopeer_state = {
-	.global_lock = PTHREAD_MUTEX_INITIALIZER
+	.global_lock = PTHREAD_MUTEX_INITIALIZER,
+	.clients_cond = PTHREAD_COND_INITIALIZER
 };
 
 /* flags of main server loop, they are turned when a signal comes */
 volatile int quit = 0, restart_soft = 0, restart_hard = 0;
 
+/* set by SIGHUP, the configuration is then reloaded without restarting the server */
+static volatile int reload = 0;
+
+/* the base modules, all the other ones are in netopeer_options.modules */
+static struct np_module* server_module = NULL, *netopeer_module = NULL;
+
 volatile int server_start = 0;
 
+/* maximum number of connections accepted from one listening socket in one go */
+#define ACCEPT_BATCH 32
+
+/* the server identity shared by all the acceptors */
+static pthread_mutex_t server_id_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifdef NP_SSH
+static ssh_bind server_sshbind = NULL;
+#endif
+#ifdef NP_TLS
+static SSL_CTX* server_tlsctx = NULL;
+#endif
+
+/* increased on every binds change, the acceptors then update their sockets */
+static volatile unsigned int binds_gen = 0;
+
 void clb_print(NC_VERB_LEVEL level, const char* msg) {
-	switch (level) {
-	case NC_VERB_ERROR:
-		syslog(LOG_ERR, "%s", msg);
-		break;
-	case NC_VERB_WARNING:
-		syslog(LOG_WARNING, "%s", msg);
-		break;
-	case NC_VERB_VERBOSE:
-		syslog(LOG_INFO, "%s", msg);
-		break;
-	case NC_VERB_DEBUG:
-		syslog(LOG_DEBUG, "%s", msg);
-		break;
-	}
+	np_log(level, msg);
 }
 
 void print_debug(const char* format, ...) {
@@ -153,8 +170,8 @@ void signal_handler(int sig) {
 		}
 		break;
 	case SIGHUP:
-		/* restart the daemon */
-		restart_soft = 1;
+		/* reload the configuration */
+		reload = 1;
 		break;
 	default:
 		exit(EXIT_FAILURE);
@@ -162,43 +179,39 @@ void signal_handler(int sig) {
 	}
 }
 
-static void client_append(struct client_struct** root, struct client_struct* clients) {
-	struct client_struct* cur;
-
+static void client_append(struct client_struct** root, struct client_struct* client) {
 	if (root == NULL) {
 		return;
 	}
 
-	if (*root == NULL) {
-		*root = clients;
-		return;
+	/* the order does not matter, so prepend */
+	client->prev = NULL;
+	client->next = *root;
+	if (*root != NULL) {
+		(*root)->prev = client;
 	}
+	*root = client;
 
-	for (cur = *root; cur->next != NULL; cur = cur->next);
-
-	cur->next = clients;
+	np_session_count_add(client->transport, 1);
 }
 
 void np_client_detach(struct client_struct** root, struct client_struct* del_client) {
-	struct client_struct* client, *prev_client = NULL;
-
-	for (client = *root; client != NULL; client = client->next) {
-		if (client == del_client) {
-			break;
+	if (del_client->prev == NULL) {
+		if (*root != del_client) {
+			nc_verb_error("%s: internal error: client not found (%s:%d)", __func__, __FILE__, __LINE__);
+			return;
 		}
-		prev_client = client;
+		*root = del_client->next;
+	} else {
+		del_client->prev->next = del_client->next;
 	}
-
-	if (client == NULL) {
-		nc_verb_error("%s: internal error: client not found (%s:%d)", __func__, __FILE__, __LINE__);
-		return;
+	if (del_client->next != NULL) {
+		del_client->next->prev = del_client->prev;
 	}
+	del_client->next = NULL;
+	del_client->prev = NULL;
 
-	if (prev_client == NULL) {
-		*root = (*root)->next;
-	} else {
-		prev_client->next = client->next;
-	}
+	np_session_count_add(del_client->transport, -1);
 }
 
 /* return seconds rounded down */
@@ -219,6 +232,13 @@ unsigned int timeval_diff(struct timeval tv1, struct timeval tv2) {
 	return sec;
 }
 
+uint64_t np_clock_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
 void* client_notif_thread(void* arg) {
 	struct ntf_thread_config *config = (struct ntf_thread_config*)arg;
 
@@ -229,44 +249,131 @@ void* client_notif_thread(void* arg) {
 	return NULL;
 }
 
-void* client_main_thread(void* arg) {
-	struct client_struct* client = (struct client_struct*)arg;
-	int skip_sleep;
+/* returns 1 if the handshake is finished, 0 if it is still in progress */
+static int client_handshake(struct client_struct* client) {
+	int ret;
 
-	do {
-		skip_sleep = 0;
+	switch (client->transport) {
+#ifdef NP_SSH
+	case NC_TRANSPORT_SSH:
+		ret = np_ssh_client_handshake((struct client_struct_ssh*)client);
+		break;
+#endif
+#ifdef NP_TLS
+	case NC_TRANSPORT_TLS:
+		ret = np_tls_client_handshake((struct client_struct_tls*)client);
+		break;
+#endif
+	default:
+		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
+		ret = -1;
+	}
+
+	if (ret == -1) {
+		client->to_free = 1;
+		return 1;
+	}
+	client->handshake_done = ret;
+
+	return ret;
+}
+
+int np_client_process(struct client_struct* client) {
+	int progress = 0;
+
+	if (!client->handshake_done && !client_handshake(client)) {
+		/* wait for more data */
+		return 0;
+	}
+	if (client->to_free) {
+		return 1;
+	}
 
-		switch (client->transport) {
+	switch (client->transport) {
 #ifdef NP_SSH
-		case NC_TRANSPORT_SSH:
-			skip_sleep += np_ssh_client_transport((struct client_struct_ssh*)client);
-			skip_sleep += np_ssh_client_netconf_rpc((struct client_struct_ssh*)client);
-			break;
+	case NC_TRANSPORT_SSH:
+		progress += np_ssh_client_transport((struct client_struct_ssh*)client);
+		progress += np_ssh_client_netconf_rpc((struct client_struct_ssh*)client);
+		break;
 #endif
 #ifdef NP_TLS
-		case NC_TRANSPORT_TLS:
-			skip_sleep += np_tls_client_transport((struct client_struct_tls*)client);
-			skip_sleep += np_tls_client_netconf_rpc((struct client_struct_tls*)client);
-			break;
+	case NC_TRANSPORT_TLS:
+		progress += np_tls_client_transport((struct client_struct_tls*)client);
+		progress += np_tls_client_netconf_rpc((struct client_struct_tls*)client);
+		break;
 #endif
-		default:
-			nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
-		}
+	default:
+		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
+		client->to_free = 1;
+	}
 
-		if (!skip_sleep) {
-			/* we did not do anything productive, so let the thread sleep */
-			usleep(netopeer_options.response_time*1000);
-		}
-	} while (!client->to_free);
+	return progress;
+}
+
+uint64_t np_client_deadline(struct client_struct* client) {
+	if (client->to_free) {
+		return 0;
+	}
+
+	switch (client->transport) {
+#ifdef NP_SSH
+	case NC_TRANSPORT_SSH:
+		return np_ssh_client_deadline((struct client_struct_ssh*)client);
+#endif
+#ifdef NP_TLS
+	case NC_TRANSPORT_TLS:
+		return np_tls_client_deadline((struct client_struct_tls*)client);
+#endif
+	default:
+		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
+		return 0;
+	}
+}
+
+int np_client_kick(struct client_struct* client) {
+	struct client_struct* cur;
 
 	/* GLOBAL LOCK */
 	pthread_mutex_lock(&netopeer_state.global_lock);
 
-	np_client_detach(&netopeer_state.clients, client);
+	for (cur = netopeer_state.clients; cur != NULL && cur != client; cur = cur->next);
+	if (cur != NULL) {
+		np_reactor_kick(client);
+	}
 
 	/* GLOBAL UNLOCK */
 	pthread_mutex_unlock(&netopeer_state.global_lock);
 
+	return (cur == NULL ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+struct client_struct* np_client_new(NC_TRANSPORT transport) {
+	struct client_struct* client;
+
+	switch (transport) {
+#ifdef NP_SSH
+	case NC_TRANSPORT_SSH:
+		client = np_ssh_client_new();
+		break;
+#endif
+#ifdef NP_TLS
+	case NC_TRANSPORT_TLS:
+		client = np_tls_client_new();
+		break;
+#endif
+	default:
+		nc_verb_error("Client with an unknown transport protocol, dropping it.");
+		return NULL;
+	}
+
+	if (client == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+	}
+	return client;
+}
+
+void np_client_free(struct client_struct* client) {
+	client->to_free = 1;
 	switch (client->transport) {
 #ifdef NP_SSH
 	case NC_TRANSPORT_SSH:
@@ -279,17 +386,26 @@ void* client_main_thread(void* arg) {
 		break;
 #endif
 	default:
-		free(client);
+		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
 		break;
 	}
+}
 
-#ifdef NP_TLS
-	np_tls_thread_cleanup();
-#endif
+void np_client_remove(struct client_struct* client) {
+	/* GLOBAL LOCK */
+	pthread_mutex_lock(&netopeer_state.global_lock);
 
-	pthread_detach(pthread_self());
+	np_stats_client_removed(client);
+	np_client_detach(&netopeer_state.clients, client);
+	pthread_cond_broadcast(&netopeer_state.clients_cond);
 
-	return NULL;
+	/* GLOBAL UNLOCK */
+	pthread_mutex_unlock(&netopeer_state.global_lock);
+
+	if (client->callhome) {
+		np_callhome_client_removed(client);
+	}
+	np_client_free(client);
 }
 
 static void sock_cleanup(struct np_sock* npsock) {
@@ -300,198 +416,431 @@ static void sock_cleanup(struct np_sock* npsock) {
 	}
 
 	for (i = 0; i < npsock->count; ++i) {
-		close(npsock->pollsock[i].fd);
+		if (npsock->pollsock[i].fd != -1) {
+			close(npsock->pollsock[i].fd);
+		}
+		free(npsock->binds[i].addr);
 	}
 	free(npsock->pollsock);
 	npsock->pollsock = NULL;
 	free(npsock->transport);
 	npsock->transport = NULL;
+	free(npsock->binds);
+	npsock->binds = NULL;
 	npsock->count = 0;
 }
 
-static void sock_listen(const struct np_bind_addr* addrs, struct np_sock* npsock) {
+/* create a listening socket for a single address, returns -1 on error */
+static int sock_open(const struct np_bind_addr* addr, int reuseport) {
 	const int optVal = 1;
 	const socklen_t optLen = sizeof(optVal);
+	int sock, flags;
 	char is_ipv4;
 	struct sockaddr_storage saddr;
 
 	struct sockaddr_in* saddr4;
 	struct sockaddr_in6* saddr6;
 
-	if (addrs == NULL || npsock == NULL) {
-		return;
+	if (strchr(addr->addr, ':') == NULL) {
+		is_ipv4 = 1;
+	} else {
+		is_ipv4 = 0;
 	}
 
-	if (npsock->count > 0) {
-		sock_cleanup(npsock);
+	sock = socket((is_ipv4 ? AF_INET : AF_INET6), SOCK_STREAM, 0);
+	if (sock == -1) {
+		nc_verb_error("%s: could not create socket (%s)", __func__, strerror(errno));
+		return -1;
 	}
 
-	/*
-	 * Always have the last pollfd structure ready -
-	 * this way we can reuse it safely (continue;)
-	 * every time an error occurs during its
-	 * modification.
-	 */
-	npsock->count = 1;
-	npsock->pollsock = calloc(1, sizeof(struct pollfd));
-	npsock->transport = calloc(1, sizeof(NC_TRANSPORT));
+	if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void*) &optVal, optLen) != 0) {
+		nc_verb_error("%s: could not set socket SO_REUSEADDR option (%s)", __func__, strerror(errno));
+		goto fail;
+	}
 
-	/* for every address and port a pollfd struct is created */
-	for (;addrs != NULL; addrs = addrs->next) {
-		npsock->transport[npsock->count-1] = addrs->transport;
+	/* every acceptor has its own socket and the kernel distributes the connections */
+	if (reuseport && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void*) &optVal, optLen) != 0) {
+		nc_verb_error("%s: could not set socket SO_REUSEPORT option (%s)", __func__, strerror(errno));
+		goto fail;
+	}
 
-		if (strchr(addrs->addr, ':') == NULL) {
-			is_ipv4 = 1;
-		} else {
-			is_ipv4 = 0;
+	if (fcntl(sock, F_SETFD, FD_CLOEXEC) != 0) {
+		nc_verb_error("%s: fcntl failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+
+	/* accept until there are no more pending connections */
+	if (((flags = fcntl(sock, F_GETFL)) == -1) || (fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)) {
+		nc_verb_error("%s: fcntl failed (%s)", __func__, strerror(errno));
+		goto fail;
+	}
+
+	bzero(&saddr, sizeof(struct sockaddr_storage));
+	if (is_ipv4) {
+		saddr4 = (struct sockaddr_in*)&saddr;
+
+		saddr4->sin_family = AF_INET;
+		saddr4->sin_port = htons(addr->port);
+
+		if (inet_pton(AF_INET, addr->addr, &saddr4->sin_addr) != 1) {
+			nc_verb_error("%s: failed to convert IPv4 address \"%s\"", __func__, addr->addr);
+			goto fail;
 		}
 
-		npsock->pollsock[npsock->count-1].fd = socket((is_ipv4 ? AF_INET : AF_INET6), SOCK_STREAM, 0);
-		if (npsock->pollsock[npsock->count-1].fd == -1) {
-			nc_verb_error("%s: could not create socket (%s)", __func__, strerror(errno));
-			continue;
+		if (bind(sock, (struct sockaddr*)saddr4, sizeof(struct sockaddr_in)) == -1) {
+			nc_verb_error("%s: could not bind \"%s\" port %d (%s)", __func__, addr->addr, addr->port, strerror(errno));
+			goto fail;
 		}
 
-		if (setsockopt(npsock->pollsock[npsock->count-1].fd, SOL_SOCKET, SO_REUSEADDR, (void*) &optVal, optLen) != 0) {
-			nc_verb_error("%s: could not set socket SO_REUSEADDR option (%s)", __func__, strerror(errno));
-			continue;
+	} else {
+		saddr6 = (struct sockaddr_in6*)&saddr;
+
+		saddr6->sin6_family = AF_INET6;
+		saddr6->sin6_port = htons(addr->port);
+
+		if (inet_pton(AF_INET6, addr->addr, &saddr6->sin6_addr) != 1) {
+			nc_verb_error("%s: failed to convert IPv6 address \"%s\"", __func__, addr->addr);
+			goto fail;
 		}
 
-		if (fcntl(npsock->pollsock[npsock->count-1].fd, F_SETFD, FD_CLOEXEC) != 0) {
-			nc_verb_error("%s: fcntl failed (%s)", __func__, strerror(errno));
-			continue;
+		if (bind(sock, (struct sockaddr*)saddr6, sizeof(struct sockaddr_in6)) == -1) {
+			nc_verb_error("%s: could not bind \"%s\" port %d (%s)", __func__, addr->addr, addr->port, strerror(errno));
+			goto fail;
 		}
+	}
 
-		bzero(&saddr, sizeof(struct sockaddr_storage));
-		if (is_ipv4) {
-			saddr4 = (struct sockaddr_in*)&saddr;
+	if (listen(sock, netopeer_options.listen_backlog) == -1) {
+		nc_verb_error("%s: unable to start listening on \"%s\" port %d (%s)", __func__, addr->addr, addr->port, strerror(errno));
+		goto fail;
+	}
 
-			saddr4->sin_family = AF_INET;
-			saddr4->sin_port = htons(addrs->port);
+	return sock;
 
-			if (inet_pton(AF_INET, addrs->addr, &saddr4->sin_addr) != 1) {
-				nc_verb_error("%s: failed to convert IPv4 address \"%s\"", __func__, addrs->addr);
-				continue;
-			}
+fail:
+	close(sock);
+	return -1;
+}
 
-			if (bind(npsock->pollsock[npsock->count-1].fd, (struct sockaddr*)saddr4, sizeof(struct sockaddr_in)) == -1) {
-				nc_verb_error("%s: could not bind \"%s\" port %d (%s)", __func__, addrs->addr, addrs->port, strerror(errno));
-				continue;
-			}
+/*
+ * Bring the listening sockets in line with the addresses. The sockets
+ * of the addresses still present are kept, so the connections waiting
+ * in their queues are not lost, only the removed ones are closed and
+ * the new ones opened.
+ */
+static void sock_listen(const struct np_bind_addr* addrs, struct np_sock* npsock, int reuseport) {
+	const struct np_bind_addr* addr;
+	struct np_sock new_npsock;
+	unsigned int i, count;
+	int sock;
 
-		} else {
-			saddr6 = (struct sockaddr_in6*)&saddr;
+	if (npsock == NULL) {
+		return;
+	}
 
-			saddr6->sin6_family = AF_INET6;
-			saddr6->sin6_port = htons(addrs->port);
+	for (count = 0, addr = addrs; addr != NULL; addr = addr->next, ++count);
+
+	bzero(&new_npsock, sizeof(struct np_sock));
+	new_npsock.backlog = netopeer_options.listen_backlog;
+	/* even with no addresses there is the wake up fd */
+	new_npsock.pollsock = calloc(count + 1, sizeof(struct pollfd));
+	new_npsock.transport = calloc(count + 1, sizeof(NC_TRANSPORT));
+	new_npsock.binds = calloc(count + 1, sizeof(struct np_bind_addr));
+	if (new_npsock.pollsock == NULL || new_npsock.transport == NULL || new_npsock.binds == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		free(new_npsock.pollsock);
+		free(new_npsock.transport);
+		free(new_npsock.binds);
+		return;
+	}
 
-			if (inet_pton(AF_INET6, addrs->addr, &saddr6->sin6_addr) != 1) {
-				nc_verb_error("%s: failed to convert IPv6 address \"%s\"", __func__, addrs->addr);
-				continue;
+	/* for every address and port a pollfd struct is created */
+	for (addr = addrs; addr != NULL; addr = addr->next) {
+		for (i = 0; i < npsock->count; ++i) {
+			if (npsock->pollsock[i].fd != -1 && npsock->transport[i] == addr->transport
+					&& npsock->binds[i].port == addr->port && strcmp(npsock->binds[i].addr, addr->addr) == 0) {
+				break;
 			}
+		}
 
-			if (bind(npsock->pollsock[npsock->count-1].fd, (struct sockaddr*)saddr6, sizeof(struct sockaddr_in6)) == -1) {
-				nc_verb_error("%s: could not bind \"%s\" port %d (%s)", __func__, addrs->addr, addrs->port, strerror(errno));
-				continue;
+		if (i < npsock->count) {
+			/* take over the old socket */
+			sock = npsock->pollsock[i].fd;
+			npsock->pollsock[i].fd = -1;
+			if (npsock->backlog != new_npsock.backlog && listen(sock, new_npsock.backlog) == -1) {
+				nc_verb_warning("%s: failed to change the backlog of \"%s\" port %d (%s)", __func__, addr->addr, addr->port, strerror(errno));
 			}
+		} else if ((sock = sock_open(addr, reuseport)) == -1) {
+			continue;
 		}
 
-		if (listen(npsock->pollsock[npsock->count-1].fd, 5) == -1) {
-			nc_verb_error("%s: unable to start listening on \"%s\" port %d (%s)", __func__, addrs->addr, addrs->port, strerror(errno));
-			continue;
+		new_npsock.pollsock[new_npsock.count].fd = sock;
+		new_npsock.pollsock[new_npsock.count].events = POLLIN;
+		new_npsock.transport[new_npsock.count] = addr->transport;
+		new_npsock.binds[new_npsock.count].transport = addr->transport;
+		new_npsock.binds[new_npsock.count].addr = strdup(addr->addr);
+		new_npsock.binds[new_npsock.count].port = addr->port;
+		++new_npsock.count;
+	}
+
+	/* close the sockets of the removed addresses */
+	for (i = 0; i < npsock->count; ++i) {
+		if (npsock->pollsock[i].fd != -1) {
+			nc_verb_verbose("Stopped listening on \"%s\" port %d.", npsock->binds[i].addr, npsock->binds[i].port);
+		}
+	}
+	sock_cleanup(npsock);
+
+	*npsock = new_npsock;
+}
+
+/* close a connection with a TCP reset, it is the cheapest way for both sides */
+static void sock_reset(int sock) {
+	struct linger lin;
+
+	lin.l_onoff = 1;
+	lin.l_linger = 0;
+	if (setsockopt(sock, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin)) == -1) {
+		nc_verb_warning("%s: setsockopt failed (%s)", __func__, strerror(errno));
+	}
+	close(sock);
+}
+
+/* create the full client structure and let the workers handle it, returns 0 on success */
+static int client_admit(struct client_struct* new_client) {
+	unsigned int count;
+	int ret;
+
+	/* Maximum number of sessions check */
+	if (netopeer_options.max_sessions > 0) {
+		count = 0;
+#ifdef NP_SSH
+		count += np_session_count(NC_TRANSPORT_SSH);
+#endif
+#ifdef NP_TLS
+		count += np_session_count(NC_TRANSPORT_TLS);
+#endif
+
+		if (count >= netopeer_options.max_sessions) {
+			nc_verb_error("Maximum number of sessions reached, droppping the new client.");
+			np_stat_inc(NP_STAT_LIMITED_CONNECTIONS);
+			sock_reset(new_client->sock);
+			new_client->sock = -1;
+			np_client_free(new_client);
+			return 1;
 		}
+	}
+
+	/* SERVER ID LOCK */
+	pthread_mutex_lock(&server_id_lock);
+	switch (new_client->transport) {
+#ifdef NP_SSH
+	case NC_TRANSPORT_SSH:
+		ret = np_ssh_create_client((struct client_struct_ssh*)new_client, server_sshbind);
+		break;
+#endif
+#ifdef NP_TLS
+	case NC_TRANSPORT_TLS:
+		ret = np_tls_create_client((struct client_struct_tls*)new_client, server_tlsctx);
+		break;
+#endif
+	default:
+		nc_verb_error("Client with an unknown transport protocol, dropping it.");
+		ret = 1;
+	}
+	/* SERVER ID UNLOCK */
+	pthread_mutex_unlock(&server_id_lock);
 
-		npsock->pollsock[npsock->count-1].events = POLLIN;
+	/* client is not valid, some error occured */
+	if (ret != 0) {
+		np_client_free(new_client);
+		return 1;
+	}
+
+	/* add the client into the global clients structure and let the workers handle it */
+	/* GLOBAL LOCK */
+	pthread_mutex_lock(&netopeer_state.global_lock);
+	client_append(&netopeer_state.clients, new_client);
+	ret = np_reactor_add(new_client);
+	if (ret != EXIT_SUCCESS) {
+		np_client_detach(&netopeer_state.clients, new_client);
+	}
+	/* GLOBAL UNLOCK */
+	pthread_mutex_unlock(&netopeer_state.global_lock);
 
-		npsock->pollsock = realloc(npsock->pollsock, (npsock->count+1)*sizeof(struct pollfd));
-		bzero(npsock->pollsock+npsock->count, sizeof(struct pollfd));
-		npsock->transport = realloc(npsock->transport, (npsock->count+1)*sizeof(NC_TRANSPORT));
-		++npsock->count;
+	if (ret != EXIT_SUCCESS) {
+		np_client_free(new_client);
+		return 1;
 	}
 
-	/* the last pollsock is not valid */
-	--npsock->count;
+	return 0;
 }
 
-/* always returns only a single new connection */
-static struct client_struct* sock_accept(const struct np_sock* npsock) {
-	int r, flags;
-	unsigned int i;
+/* accepts all the pending connections on all the ready sockets, the poll is interrupted by wakefd as well */
+static void sock_accept(const struct np_sock* npsock, int wakefd) {
+	int r, sock;
+	unsigned int i, j;
 	socklen_t client_saddr_len;
-	struct client_struct* ret;
+	struct sockaddr_storage client_saddr;
+	struct client_struct* new_client;
+	struct pollfd wake;
 
 	if (npsock == NULL) {
-		return NULL;
+		return;
 	}
 
-	/* poll for a new connection */
+	/* poll for new connections */
 	errno = 0;
-	r = poll(npsock->pollsock, npsock->count, netopeer_options.response_time);
+	if (npsock->pollsock == NULL) {
+		/* no sockets were ever created */
+		wake.fd = wakefd;
+		wake.events = POLLIN;
+		poll(&wake, 1, netopeer_options.response_time);
+		return;
+	}
+	npsock->pollsock[npsock->count].fd = wakefd;
+	npsock->pollsock[npsock->count].events = POLLIN;
+	r = poll(npsock->pollsock, npsock->count + 1, netopeer_options.response_time);
 	if (r == 0 || (r == -1 && errno == EINTR)) {
 		/* we either timeouted or going to exit or restart */
-		return NULL;
+		return;
 	}
 	if (r == -1) {
 		nc_verb_error("%s: poll failed (%s)", __func__, strerror(errno));
-		return NULL;
+		return;
 	}
 
-	ret = calloc(1, sizeof(struct client_struct));
-	client_saddr_len = sizeof(struct sockaddr_storage);
-
-	/* accept the first polled connection */
 	for (i = 0; i < npsock->count; ++i) {
-		if (npsock->pollsock[i].revents & POLLIN) {
-			ret->sock = accept(npsock->pollsock[i].fd, (struct sockaddr*)&ret->saddr, &client_saddr_len);
-			if (ret->sock == -1) {
-				nc_verb_error("%s: accept failed (%s)", __func__, strerror(errno));
-				free(ret);
-				return NULL;
+		if (!(npsock->pollsock[i].revents & POLLIN)) {
+			continue;
+		}
+		npsock->pollsock[i].revents = 0;
+
+		/* drain the socket, but give the other ones a chance too */
+		for (j = 0; j < ACCEPT_BATCH; ++j) {
+			client_saddr_len = sizeof(struct sockaddr_storage);
+			sock = accept4(npsock->pollsock[i].fd, (struct sockaddr*)&client_saddr, &client_saddr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (sock == -1) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					nc_verb_error("%s: accept failed (%s)", __func__, strerror(errno));
+				}
+				break;
+			}
+			np_stat_inc(NP_STAT_ACCEPTS);
+
+			/* reject the excessive connections before any work is done for them */
+			if (np_ratelimit_connection(&client_saddr) != EXIT_SUCCESS) {
+				np_stat_inc(NP_STAT_LIMITED_CONNECTIONS);
+				sock_reset(sock);
+				continue;
 			}
-			/* make the socket non-blocking */
-			if (((flags = fcntl(ret->sock, F_GETFL)) == -1) || (fcntl(ret->sock, F_SETFL, flags | O_NONBLOCK) == -1)) {
-				nc_verb_error("%s: fcntl failed (%s)", __func__, strerror(errno));
-				close(ret->sock);
-				free(ret);
-				return NULL;
+#ifdef NP_SSH
+			/* the clients already waiting for their password check would only time out later */
+			if (npsock->transport[i] == NC_TRANSPORT_SSH && np_reactor_auth_saturated()) {
+				np_stat_inc(NP_STAT_LIMITED_CONNECTIONS);
+				sock_reset(sock);
+				continue;
 			}
-			ret->transport = npsock->transport[i];
-			npsock->pollsock[i].revents = 0;
-			break;
+#endif
+
+			new_client = np_client_new(npsock->transport[i]);
+			if (new_client == NULL) {
+				close(sock);
+				break;
+			}
+			new_client->sock = sock;
+			new_client->saddr = client_saddr;
+
+			client_admit(new_client);
 		}
 	}
+}
 
-	return ret;
+/* rebuild the listening sockets if the binds changed since the last time */
+static void acceptor_check_binds(struct np_acceptor* acceptor, int reuseport) {
+	if (acceptor->binds_gen == binds_gen) {
+		return;
+	}
+
+	/* BINDS LOCK */
+	pthread_mutex_lock(&netopeer_options.binds_lock);
+
+	sock_listen(netopeer_options.binds, &acceptor->npsock, reuseport);
+	acceptor->binds_gen = binds_gen;
+
+	/* BINDS UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.binds_lock);
 }
 
-static void clear_broadcast_callhome_client(int fail) {
-    /* CALLHOME LOCK */
-    pthread_mutex_lock(&callhome_lock);
-    if (callhome_app) {
-        if (fail) {
-            callhome_app->client = NULL;
-        }
-        callhome_app = NULL;
-        pthread_cond_broadcast(&callhome_cond);
-    }
-    /* CALLHOME UNLOCK */
-    pthread_mutex_unlock(&callhome_lock);
+/*
+ * Reload the modules whose configuration file changed, the sessions
+ * stay connected and the binds are applied incrementally afterwards.
+ * Reloading the Netopeer module reloads all the other modules, too.
+ */
+static void config_reload(void) {
+	struct np_module* module;
+
+	nc_verb_verbose("Reloading the server configuration.");
+	np_statecache_invalidate();
+	np_snapshot_invalidate();
+	np_nacmcache_invalidate();
+	np_log_reopen();
+
+	if (module_changed(server_module)) {
+		module_reload(server_module);
+	}
+	if (module_changed(netopeer_module)) {
+		module_reload(netopeer_module);
+		return;
+	}
+	for (module = netopeer_options.modules; module != NULL; module = module->next) {
+		if (module_changed(module)) {
+			module_reload(module);
+		}
+	}
 }
 
-void listen_loop(int do_init) {
-	struct client_struct* new_client;
-	struct np_sock npsock = {.count = 0};
-	pthread_t client_tid;
-	int ret;
-#ifdef NP_SSH
-	ssh_bind sshbind = NULL;
-#endif
+static void* acceptor_thread(void* arg) {
+	struct np_acceptor* acceptor = (struct np_acceptor*)arg;
+
+	while (!quit && !restart_soft) {
+		acceptor_check_binds(acceptor, 1);
+		sock_accept(&acceptor->npsock, -1);
+	}
+
+	sock_cleanup(&acceptor->npsock);
 #ifdef NP_TLS
-	SSL_CTX* tlsctx = NULL;
+	np_tls_thread_cleanup();
 #endif
 
+	return NULL;
+}
+
+void listen_loop(int do_init) {
+	struct ch_app* app, *next_app;
+	struct np_acceptor* acceptors;
+	unsigned int i, acceptor_count;
+	int ret, reuseport;
+
 	/* Init */
 	if (do_init) {
+		if (np_rpcpool_init(netopeer_options.rpc_threads) != EXIT_SUCCESS) {
+			nc_verb_error("Failed to start the RPC processing threads.");
+			quit = 1;
+			return;
+		}
+		if (np_notif_init() != EXIT_SUCCESS) {
+			nc_verb_error("Failed to start the notification thread.");
+			np_rpcpool_cleanup();
+			quit = 1;
+			return;
+		}
+		if (np_reactor_init(netopeer_options.worker_threads) != EXIT_SUCCESS) {
+			nc_verb_error("Failed to start the session processing threads.");
+			np_notif_cleanup();
+			np_rpcpool_cleanup();
+			quit = 1;
+			return;
+		}
 #ifdef NP_SSH
 		np_ssh_init();
 #endif
@@ -500,204 +849,129 @@ void listen_loop(int do_init) {
 #endif
 	}
 
+	/* the first acceptor is this thread, it also takes care of the configuration changes */
+	acceptor_count = (netopeer_options.acceptor_threads > 0 ? netopeer_options.acceptor_threads : 1);
+	reuseport = (acceptor_count > 1);
+	acceptors = calloc(acceptor_count, sizeof(struct np_acceptor));
+	if (acceptors == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		quit = 1;
+		return;
+	}
+	for (i = 0; i < acceptor_count; ++i) {
+		/* force creating the sockets */
+		acceptors[i].binds_gen = binds_gen - 1;
+	}
+
 	/* Main accept loop */
 	do {
-		new_client = NULL;
+		if (reload) {
+			reload = 0;
+			config_reload();
+		}
 
 		/* Binds change check */
 		if (netopeer_options.binds_change_flag) {
 			/* BINDS LOCK */
 			pthread_mutex_lock(&netopeer_options.binds_lock);
-
-			sock_cleanup(&npsock);
-			sock_listen(netopeer_options.binds, &npsock);
-
+			++binds_gen;
 			netopeer_options.binds_change_flag = 0;
 			/* BINDS UNLOCK */
 			pthread_mutex_unlock(&netopeer_options.binds_lock);
-
-			if (npsock.count == 0) {
+		}
+		if (acceptors[0].binds_gen != binds_gen) {
+			acceptor_check_binds(&acceptors[0], reuseport);
+			if (acceptors[0].npsock.count == 0) {
 				nc_verb_warning("Server is not listening on any address!");
 			}
 		}
 
+		/* SERVER ID LOCK */
+		pthread_mutex_lock(&server_id_lock);
 #ifdef NP_SSH
-		sshbind = np_ssh_server_id_check(sshbind);
-#endif
-#ifdef NP_TLS
-		tlsctx = np_tls_server_id_check(tlsctx);
-#endif
-
-		/* Callhome client check */
-        /* CALLHOME LOCK */
-        pthread_mutex_lock(&callhome_lock);
-		if (callhome_app) {
-			new_client = callhome_app->client;
-		}
-		/* CALLHOME UNLOCK */
-        pthread_mutex_unlock(&callhome_lock);
-
-		/* Listen client check */
-		if (new_client == NULL) {
-			new_client = sock_accept(&npsock);
-		}
-
-		/* New client full structure creation */
-		if (new_client != NULL) {
-
-			/* Maximum number of sessions check */
-			if (netopeer_options.max_sessions > 0) {
-				ret = 0;
-				/* GLOBAL LOCK */
-				pthread_mutex_lock(&netopeer_state.global_lock);
-#ifdef NP_SSH
-				ret += np_ssh_session_count();
+		server_sshbind = np_ssh_server_id_check(server_sshbind);
 #endif
 #ifdef NP_TLS
-				ret += np_tls_session_count();
+		server_tlsctx = np_tls_server_id_check(server_tlsctx);
 #endif
-				/* GLOBAL UNLOCK */
-				pthread_mutex_unlock(&netopeer_state.global_lock);
+		/* SERVER ID UNLOCK */
+		pthread_mutex_unlock(&server_id_lock);
 
-				if (ret >= netopeer_options.max_sessions) {
-					nc_verb_error("Maximum number of sessions reached, droppping the new client.");
-					new_client->to_free = 1;
-					switch (new_client->transport) {
 #ifdef NP_SSH
-					case NC_TRANSPORT_SSH:
-						client_free_ssh((struct client_struct_ssh*)new_client);
-						break;
+		np_ssh_auth_keys_check();
 #endif
 #ifdef NP_TLS
-					case NC_TRANSPORT_TLS:
-						client_free_tls((struct client_struct_tls*)new_client);
-						break;
+		np_tls_crl_check();
+		np_tls_ctn_check();
 #endif
-					default:
-						free(new_client);
-						nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
-					}
 
-					clear_broadcast_callhome_client(1);
-
-					/* sleep to prevent clients from immediate connection retry */
-					usleep(netopeer_options.response_time*1000);
-					continue;
-				}
-			}
-
-			switch (new_client->transport) {
-#ifdef NP_SSH
-			case NC_TRANSPORT_SSH:
-				ret = np_ssh_create_client((struct client_struct_ssh*)new_client, sshbind);
-				if (ret != 0) {
-					new_client->to_free = 1;
-					client_free_ssh((struct client_struct_ssh*)new_client);
-				}
-				break;
-#endif
-#ifdef NP_TLS
-			case NC_TRANSPORT_TLS:
-				ret = np_tls_create_client((struct client_struct_tls*)new_client, tlsctx);
-				if (ret != 0) {
-					new_client->to_free = 1;
-					client_free_tls((struct client_struct_tls*)new_client);
-				}
-				break;
-#endif
-			default:
-				nc_verb_error("Client with an unknown transport protocol, dropping it.");
-				free(new_client);
-				ret = 1;
-			}
-
-			/* client is not valid, some error occured */
-			if (ret != 0) {
-                clear_broadcast_callhome_client(1);
+		/* the other acceptors are started once the configuration is ready */
+		for (i = 1; i < acceptor_count; ++i) {
+			if (acceptors[i].running) {
 				continue;
 			}
-
-			/* add the client into the global clients structure */
-			/* GLOBAL LOCK */
-			pthread_mutex_lock(&netopeer_state.global_lock);
-			client_append(&netopeer_state.clients, new_client);
-			/* GLOBAL UNLOCK */
-			pthread_mutex_unlock(&netopeer_state.global_lock);
-
-			/* start the client thread */
-			if ((ret = pthread_create((pthread_t*)&new_client->tid, NULL, client_main_thread, (void*)new_client)) != 0) {
+			if ((ret = pthread_create(&acceptors[i].tid, NULL, acceptor_thread, &acceptors[i])) != 0) {
 				nc_verb_error("%s: failed to create a thread (%s)", __func__, strerror(ret));
-
-				/* GLOBAL LOCK */
-				pthread_mutex_lock(&netopeer_state.global_lock);
-				np_client_detach(&netopeer_state.clients, new_client);
-				/* GLOBAL UNLOCK */
-				pthread_mutex_unlock(&netopeer_state.global_lock);
-
-				new_client->tid = 0;
-				new_client->to_free = 1;
-				switch (new_client->transport) {
-#ifdef NP_SSH
-				case NC_TRANSPORT_SSH:
-					client_free_ssh((struct client_struct_ssh*)new_client);
-					break;
-#endif
-#ifdef NP_TLS
-				case NC_TRANSPORT_TLS:
-					client_free_tls((struct client_struct_tls*)new_client);
-					break;
-#endif
-				default:
-					free(new_client);
-					break;
-				}
-
-				clear_broadcast_callhome_client(1);
-				continue;
+				acceptor_count = i;
+				break;
 			}
+			acceptors[i].running = 1;
+		}
 
-			/* Signal app loops if needed */
-			clear_broadcast_callhome_client(0);
+		/* Callhome clients check, all that connected since the last time */
+		for (app = np_callhome_ready(); app != NULL; app = next_app) {
+			next_app = app->next_ready;
+			np_callhome_admitted(app, client_admit(app->client));
 		}
 
+		/* Listen clients check, woken up by new callhome clients as well */
+		sock_accept(&acceptors[0].npsock, np_callhome_fd());
+
 	} while (!quit && !restart_soft);
 
 	/* Cleanup */
-	sock_cleanup(&npsock);
+	for (i = 1; i < acceptor_count; ++i) {
+		if (acceptors[i].running && (ret = pthread_join(acceptors[i].tid, NULL)) != 0) {
+			nc_verb_error("Failed to join an acceptor thread (%s).", strerror(ret));
+		}
+	}
+	sock_cleanup(&acceptors[0].npsock);
+	free(acceptors);
+
+	/* SERVER ID LOCK */
+	pthread_mutex_lock(&server_id_lock);
 #ifdef NP_SSH
-	ssh_bind_free(sshbind);
+	ssh_bind_free(server_sshbind);
+	server_sshbind = NULL;
 #endif
 #ifdef NP_TLS
-	SSL_CTX_free(tlsctx);
+	SSL_CTX_free(server_tlsctx);
+	server_tlsctx = NULL;
 #endif
-	if (!restart_soft) {
-		/* wait for all the clients to exit nicely themselves */
-		while (1) {
-			/* GLOBAL LOCK */
-			pthread_mutex_lock(&netopeer_state.global_lock);
+	/* SERVER ID UNLOCK */
+	pthread_mutex_unlock(&server_id_lock);
 
-			if (netopeer_state.clients == NULL) {
-				/* GLOBAL UNLOCK */
-				pthread_mutex_unlock(&netopeer_state.global_lock);
-
-				break;
-			}
-
-			client_tid = netopeer_state.clients->tid;
-
-			/* GLOBAL UNLOCK */
-			pthread_mutex_unlock(&netopeer_state.global_lock);
+	if (!restart_soft) {
+		/* the clients notice quit only when processed */
+		np_reactor_kick_all();
 
-			ret = pthread_join(client_tid, NULL);
-			if (ret == EINVAL) {
-				/* Call Home app is already waiting for it, let it handle it */
-				usleep(10000);
-				continue;
-			}
-			if (ret != 0) {
-				nc_verb_error("Failed to join client thread (%s).", strerror(ret));
-			}
+		/* wait for all the clients to exit nicely themselves */
+		/* GLOBAL LOCK */
+		pthread_mutex_lock(&netopeer_state.global_lock);
+		while (netopeer_state.clients != NULL) {
+			pthread_cond_wait(&netopeer_state.clients_cond, &netopeer_state.global_lock);
 		}
+		/* GLOBAL UNLOCK */
+		pthread_mutex_unlock(&netopeer_state.global_lock);
+
+		np_reactor_cleanup();
+		np_notif_cleanup();
+		np_rpcpool_cleanup();
+		np_registry_cleanup();
+		np_ratelimit_cleanup();
+		np_statecache_cleanup();
+		np_snapshot_cleanup();
+		np_nacmcache_cleanup();
 
 #ifdef NP_SSH
 		np_ssh_cleanup();
@@ -716,7 +990,7 @@ int main(int argc, char** argv) {
 	int next_option;
 	int daemonize = 0, len;
 	int listen_init = 1;
-	struct np_module* netopeer_module = NULL, *server_module = NULL;
+	uint64_t start;
 
 	/* initialize message system and set verbose and debug variables */
 	if ((aux_string = getenv(ENVIRONMENT_VERBOSE)) == NULL) {
@@ -821,13 +1095,20 @@ restart:
 		return EXIT_FAILURE;
 	}
 	netopeer_module->name = strdup(NETOPEER_MODULE_NAME);
+	start = np_clock_ms();
+	module_batch_begin();
 	if (module_enable(netopeer_module, 0)) {
 		nc_verb_error("Starting necessary Netopeer plugin failed!");
+		module_batch_end();
 		module_disable(server_module, 1);
 		free(netopeer_module->name);
 		free(netopeer_module);
 		return EXIT_FAILURE;
 	}
+	if (module_batch_end()) {
+		nc_verb_warning("Some of the modules failed to start.");
+	}
+	nc_verb_verbose("Modules started in %" PRIu64 " ms.", np_clock_ms() - start);
 
 	server_start = 0;
 	nc_verb_verbose("Netopeer server successfully initialized.");
@@ -842,6 +1123,7 @@ restart:
 
 	if (!restart_soft) {
 		/* close libnetconf only when shutting down or hard restarting the server */
+		model_cache_cleanup();
 		nc_close();
 	}
 
@@ -855,10 +1137,12 @@ restart:
 		len = readlink("/proc/self/exe", path, PATH_MAX);
 		if (len > 0) {
 			path[len] = 0;
+			np_log_cleanup();
 			xmlCleanupParser();
 			execv(path, argv);
 		}
 		nc_verb_error("Failed to get the path to self.");
+		np_log_cleanup();
 		xmlCleanupParser();
 		return EXIT_FAILURE;
 	}
@@ -867,6 +1151,7 @@ restart:
 	 *Free the global variables that may
 	 *have been allocated by the parser.
 	 */
+	np_log_cleanup();
 	xmlCleanupParser();
 
 	return EXIT_SUCCESS;
@@ -40,6 +40,7 @@
 #define _SERVER_H_
 
 #include <pthread.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <libnetconf.h>
 
@@ -50,22 +51,47 @@
 
 /* for each client */
 struct client_struct {
-	NC_TRANSPORT transport;
+	NC_TRANSPORT transport;		// tells the transport-specific structure embedding this one
 
 	int sock;
 	struct sockaddr_storage saddr;
-	volatile pthread_t tid;
+	int handshake_done;			// SSH key exchange or TLS handshake finished
 	char* username;
-	volatile int to_free;
 	struct client_struct* next;
+	struct client_struct* prev;
+	struct client_struct* next_ready;
+	uint64_t deadline;			// earliest timeout of the client, see reactor.c
+	unsigned int timer_idx;		// position in the timer heap, 0 if not there
+	int want_write;				// a write would block, wait for the socket to be writable
+	int authenticating;			// processed by the authentication threads, see reactor.c
+	int callhome;				// connected by the call home scheduler, see netconf_server_transapi.c
 
-	char __padding[((((CLIENT_STRUCT_MAX_SIZE) - 2*sizeof(int)) - sizeof(struct sockaddr_storage)) - 3*sizeof(void*)) - sizeof(NC_TRANSPORT)];
+	/* written also by the threads not owning the client, in a separate cache line */
+	volatile int scheduled __attribute__((aligned(CACHELINE_SIZE)));	// owned by a worker thread, see reactor.c
+	volatile int to_free;
 };
 
+/* the transport-specific structures embed struct client_struct */
+#ifdef NP_SSH
+#	include <libnetconf_ssh.h>
+#	include "ssh/server_ssh.h"
+#	include "ssh/cfgnetopeer_transapi_ssh.h"
+#	include "ssh/netconf_server_transapi_ssh.h"
+#endif
+
+#ifdef NP_TLS
+#	include <libnetconf_tls.h>
+#	include "tls/server_tls.h"
+#	include "tls/cfgnetopeer_transapi_tls.h"
+#	include "tls/netconf_server_transapi_tls.h"
+#endif
+
 /* one global structure */
 struct np_state {
 	/* locked when adding/removing clients */
 	pthread_mutex_t global_lock;
+	/* signalled when a client is removed */
+	pthread_cond_t clients_cond;
 	struct client_struct* clients;
 	struct np_state_tls* tls_state;
 };
@@ -76,15 +102,84 @@ struct ntf_thread_config {
 };
 
 struct np_sock {
-	struct pollfd* pollsock;
+	struct pollfd* pollsock;	// count + 1 items, the last one for the wake up fd of sock_accept()
 	NC_TRANSPORT* transport;
+	struct np_bind_addr* binds;	// the address of each socket, next is not used
+	uint16_t backlog;			// listen backlog the sockets were created with
 	unsigned int count;
 };
 
+/* a thread accepting new connections on its own listening sockets */
+struct np_acceptor {
+	pthread_t tid;
+	int running;
+	struct np_sock npsock;
+	unsigned int binds_gen;
+};
+
 unsigned int timeval_diff(struct timeval tv1, struct timeval tv2);
 
+/**
+ * @brief Get the CLOCK_MONOTONIC time, all the session timestamps use it
+ *
+ * @return Milliseconds since an unspecified point in the past
+ */
+uint64_t np_clock_ms(void);
+
 void* client_notif_thread(void* arg);
 
 void np_client_detach(struct client_struct** root, struct client_struct* del_client);
 
+/**
+ * @brief Allocate a zeroed client of a transport
+ *
+ * @param transport Transport of the client
+ *
+ * @return New client with transport set and no socket, NULL on error
+ */
+struct client_struct* np_client_new(NC_TRANSPORT transport);
+
+/**
+ * @brief Free a client that is not in the global list
+ *
+ * @param client Client to free
+ */
+void np_client_free(struct client_struct* client);
+
+/**
+ * @brief Do all the pending work of a client
+ *
+ * @param client Client to process
+ *
+ * @return non-zero if something was done and it is worth calling it again
+ */
+int np_client_process(struct client_struct* client);
+
+/**
+ * @brief Get the time the client has to be processed at even
+ * if it does not send anything, called by its owning worker
+ *
+ * @param client Client to check
+ *
+ * @return Deadline in np_clock_ms() time, 0 if there is none
+ */
+uint64_t np_client_deadline(struct client_struct* client);
+
+/**
+ * @brief Make a worker process the client soon, for flags
+ * set by threads not owning the client (to_free)
+ *
+ * @param client Client to process, it is looked up in the global list first
+ *
+ * @return EXIT_SUCCESS, EXIT_FAILURE if the client is already gone
+ */
+int np_client_kick(struct client_struct* client);
+
+/**
+ * @brief Unlink the client from the global list and free it
+ *
+ * @param client Client with to_free set
+ */
+void np_client_remove(struct client_struct* client);
+
 #endif /* _SERVER_H_ */
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**
+ * @file snapshot.c
+ * @author agent <agent@local>
+ * @brief Netopeer server snapshots of the configuration replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "replycache.h"
+#include "snapshot.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+extern struct np_options netopeer_options;
+
+/*
+ * A get-config reply is published as an immutable snapshot until the next change
+ * of the datastores, so the get-config RPCs repeated by the monitoring managers
+ * are replied without waiting for the datastore lock behind a long edit-config
+ * or commit, they get the configuration as it was before it. A change withdraws
+ * all the snapshots and the new ones are published as they are read again. The
+ * ttl bounds the changes made outside the RPCs, by the file monitors of the
+ * transAPI modules or to the NACM groups of the system.
+ *
+ * The snapshots are not published by the change itself, the replies depend on
+ * the user (NACM), the filter and with-defaults, all applied inside libnetconf,
+ * so they are published by the first get-config of every user and request.
+ */
+static struct np_replycache snapshots = NP_REPLYCACHE_INITIALIZER(CONFIG_SNAPSHOT_SIZE, &netopeer_options.config_snapshot_ttl,
+		NP_STAT_SNAPSHOT_HITS, NP_STAT_SNAPSHOT_MISSES);
+
+nc_reply* np_snapshot_lookup(const char* user, const nc_rpc* rpc, struct np_replycache_entry** snapshot) {
+	*snapshot = NULL;
+	switch (nc_rpc_get_source(rpc)) {
+	case NC_DATASTORE_RUNNING:
+	case NC_DATASTORE_STARTUP:
+	case NC_DATASTORE_CANDIDATE:
+		break;
+	default:
+		/* an URL is read every time */
+		return NULL;
+	}
+
+	return np_replycache_lookup(&snapshots, user, rpc, snapshot);
+}
+
+void np_snapshot_publish(struct np_replycache_entry* snapshot, const nc_reply* reply) {
+	np_replycache_store(&snapshots, snapshot, reply);
+}
+
+void np_snapshot_invalidate(void) {
+	np_replycache_invalidate(&snapshots);
+}
+
+void np_snapshot_cleanup(void) {
+	np_replycache_invalidate(&snapshots);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file snapshot.h
+ * @author agent <agent@local>
+ * @brief Netopeer server snapshots of the configuration replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <libnetconf.h>
+
+#include "replycache.h"
+
+/**
+ * @brief Reply to a get-config from the snapshot of the configuration published
+ * since the last change of the datastores and at most the configured ttl ago, no
+ * datastore lock is needed. If there is none, the caller is expected to read it
+ * and pass it to np_snapshot_publish(), the others asking for the same one wait
+ * for it meanwhile.
+ *
+ * @param user User of the session, the replies depend on its access rights
+ * @param rpc get-config RPC
+ * @param[out] snapshot Set to the snapshot to publish the reply as, NULL if the
+ * reply is not to be published
+ *
+ * @return Reply with a copy of the snapshot data, NULL if it must be read
+ */
+nc_reply* np_snapshot_lookup(const char* user, const nc_rpc* rpc, struct np_replycache_entry** snapshot);
+
+/**
+ * @brief Publish a reply read after an unsuccessful lookup, unless the datastores
+ * have changed meanwhile or the reply is an error
+ *
+ * @param snapshot Snapshot returned by np_snapshot_lookup(), can be NULL, it is freed
+ * @param reply Reply read from the datastores, it is not freed
+ */
+void np_snapshot_publish(struct np_replycache_entry* snapshot, const nc_reply* reply);
+
+/**
+ * @brief Withdraw all the snapshots, called on every change of the datastores
+ * before the datastore write lock is released, the readers still copying one
+ * keep it until they are done
+ */
+void np_snapshot_invalidate(void);
+
+/**
+ * @brief Free the snapshots, no lookups must be in progress
+ */
+void np_snapshot_cleanup(void);
+
+#endif /* _SNAPSHOT_H_ */
@@ -50,8 +50,10 @@
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 #include <string.h>
+#include <libssh/libssh.h>
 
 #include "../server.h"
+#include "../reactor.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
@@ -234,6 +236,7 @@ int callback_n_netopeer_n_ssh_n_client_auth_keys_n_client_auth_key(void** UNUSED
 			free(key->username);
 			key->username = strdup(username);
 		}
+		netopeer_options.ssh_opts->client_keys_change_flag = 1;
 
 		/* CLIENT KEYS UNLOCK */
 		pthread_mutex_unlock(&netopeer_options.ssh_opts->client_keys_lock);
@@ -243,19 +246,16 @@ int callback_n_netopeer_n_ssh_n_client_auth_keys_n_client_auth_key(void** UNUSED
 		/* CLIENT KEYS LOCK */
 		pthread_mutex_lock(&netopeer_options.ssh_opts->client_keys_lock);
 
-		/* add the key */
-		if (netopeer_options.ssh_opts->client_auth_keys == NULL) {
-			netopeer_options.ssh_opts->client_auth_keys = calloc(1, sizeof(struct np_auth_key));
-			netopeer_options.ssh_opts->client_auth_keys->path = strdup(path);
-			netopeer_options.ssh_opts->client_auth_keys->username = strdup(username);
-		} else {
-			for (key = netopeer_options.ssh_opts->client_auth_keys; key->next != NULL; key = key->next) {
-				key->next = calloc(1, sizeof(struct np_auth_key));
-				key->path = strdup(path);
-				key->username = strdup(username);
-				key->next->prev = key;
-			}
+		/* add the key, the order does not matter */
+		key = calloc(1, sizeof(struct np_auth_key));
+		key->path = strdup(path);
+		key->username = strdup(username);
+		key->next = netopeer_options.ssh_opts->client_auth_keys;
+		if (key->next != NULL) {
+			key->next->prev = key;
 		}
+		netopeer_options.ssh_opts->client_auth_keys = key;
+		netopeer_options.ssh_opts->client_keys_change_flag = 1;
 
 		/* CLIENT KEYS UNLOCK */
 		pthread_mutex_unlock(&netopeer_options.ssh_opts->client_keys_lock);
@@ -357,6 +357,7 @@ int callback_n_netopeer_n_ssh_n_auth_timeout(void** UNUSED(data), XMLDIFF_OP op,
 
 	if (op & XMLDIFF_REM) {
 		netopeer_options.ssh_opts->auth_timeout = 10;
+		np_reactor_kick_all();
 		return EXIT_SUCCESS;
 	}
 
@@ -378,9 +379,171 @@ int callback_n_netopeer_n_ssh_n_auth_timeout(void** UNUSED(data), XMLDIFF_OP op,
 	}
 
 	netopeer_options.ssh_opts->auth_timeout = num;
+	/* the deadlines of all the clients change */
+	np_reactor_kick_all();
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:ssh/n:compression/n:enabled changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_ssh_n_compression_n_enabled(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL;
+	uint8_t compression = 0;
+
+	if (!(op & XMLDIFF_REM)) {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+		compression = (strcmp(content, "true") == 0);
+	}
+
+	/* ALGORITHMS LOCK */
+	pthread_mutex_lock(&netopeer_options.ssh_opts->algorithms_lock);
+	netopeer_options.ssh_opts->compression = compression;
+	/* ALGORITHMS UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.ssh_opts->algorithms_lock);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:ssh/n:compression/n:level changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_ssh_n_compression_n_level(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL, *ptr, *msg;
+	long num = 6;
+
+	if (!(op & XMLDIFF_REM)) {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+
+		num = strtol(content, &ptr, 10);
+		if (*ptr != '\0' || num < 1 || num > 9) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			if (asprintf(&msg, "Could not convert '%s' to a compression level.", content) != -1) {
+				nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+				free(msg);
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* ALGORITHMS LOCK */
+	pthread_mutex_lock(&netopeer_options.ssh_opts->algorithms_lock);
+	netopeer_options.ssh_opts->compression_level = num;
+	/* ALGORITHMS UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.ssh_opts->algorithms_lock);
+	return EXIT_SUCCESS;
+}
+
+/* libssh checks the list against the algorithms it supports when setting it on a session */
+static int ssh_algorithms_set(XMLDIFF_OP op, xmlNodePtr new_node, enum ssh_options_e type, char** value, struct nc_err** error) {
+	char* content = NULL, *msg;
+	ssh_session session;
+	int ret;
+
+	if (!(op & XMLDIFF_REM)) {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+
+		if ((session = ssh_new()) == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: failed to allocate a new SSH session", __func__);
+			return EXIT_FAILURE;
+		}
+		ret = ssh_options_set(session, type, content);
+		ssh_free(session);
+		if (ret != SSH_OK) {
+			*error = nc_err_new(NC_ERR_INVALID_VALUE);
+			if (asprintf(&msg, "None of the algorithms '%s' is supported.", content) != -1) {
+				nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+				free(msg);
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* ALGORITHMS LOCK */
+	pthread_mutex_lock(&netopeer_options.ssh_opts->algorithms_lock);
+	free(*value);
+	*value = (content == NULL ? NULL : strdup(content));
+	/* ALGORITHMS UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.ssh_opts->algorithms_lock);
 	return EXIT_SUCCESS;
 }
 
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:ssh/n:ciphers changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_ssh_n_ciphers(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return ssh_algorithms_set(op, new_node, SSH_OPTIONS_CIPHERS_C_S, &netopeer_options.ssh_opts->ciphers, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:ssh/n:macs changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_ssh_n_macs(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return ssh_algorithms_set(op, new_node, SSH_OPTIONS_HMAC_C_S, &netopeer_options.ssh_opts->macs, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:ssh/n:key-exchange changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_ssh_n_key_exchange(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return ssh_algorithms_set(op, new_node, SSH_OPTIONS_KEY_EXCHANGE, &netopeer_options.ssh_opts->key_exchange, error);
+}
+
 int netopeer_transapi_init_ssh(void) {
 	xmlDocPtr doc;
 	struct nc_err* error = NULL;
@@ -390,6 +553,8 @@ int netopeer_transapi_init_ssh(void) {
 
 	netopeer_options.ssh_opts = calloc(1, sizeof(struct np_options_ssh));
 	pthread_mutex_init(&netopeer_options.ssh_opts->client_keys_lock, NULL);
+	pthread_mutex_init(&netopeer_options.ssh_opts->algorithms_lock, NULL);
+	netopeer_options.ssh_opts->compression_level = 6;
 
 	doc = xmlReadDoc(BAD_CAST "<netopeer xmlns=\"urn:cesnet:tmc:netopeer:1.0\"><ssh><server-keys><rsa-key>/etc/ssh/ssh_host_rsa_key</rsa-key></server-keys><password-auth-enabled>true</password-auth-enabled><auth-attempts>3</auth-attempts><auth-timeout>10</auth-timeout></ssh></netopeer>",
 		NULL, NULL, 0);
@@ -460,6 +625,9 @@ void netopeer_transapi_close_ssh(void) {
 
 	free(netopeer_options.ssh_opts->rsa_key);
 	free(netopeer_options.ssh_opts->dsa_key);
+	free(netopeer_options.ssh_opts->ciphers);
+	free(netopeer_options.ssh_opts->macs);
+	free(netopeer_options.ssh_opts->key_exchange);
 	for (key = netopeer_options.ssh_opts->client_auth_keys; key != NULL;) {
 		del_key = key;
 		key = key->next;
@@ -468,7 +636,11 @@ void netopeer_transapi_close_ssh(void) {
 		free(del_key);
 	}
 
+	/* the keys must not authenticate anyone anymore */
+	np_ssh_auth_keys_clear();
+
 	pthread_mutex_destroy(&netopeer_options.ssh_opts->client_keys_lock);
+	pthread_mutex_destroy(&netopeer_options.ssh_opts->algorithms_lock);
 	free(netopeer_options.ssh_opts);
 	netopeer_options.ssh_opts = NULL;
 }
@@ -44,15 +44,24 @@ struct np_options_ssh {
 	char* rsa_key;
 	char* dsa_key;
 	pthread_mutex_t client_keys_lock;
+	uint8_t client_keys_change_flag;	// the keys are to be read again, see np_ssh_auth_keys_check()
 	struct np_auth_key {
 		char* path;
 		char* username;
+		ino_t ino;					// of the file when last read
+		struct timespec mtime;
 		struct np_auth_key* next;
 		struct np_auth_key* prev;
 	} *client_auth_keys;
 	uint8_t password_auth_enabled;
 	uint8_t auth_attempts;
 	uint16_t auth_timeout;
+	pthread_mutex_t algorithms_lock;	// the new sessions read the algorithms in np_ssh_create_client()
+	uint8_t compression;
+	uint8_t compression_level;
+	char* ciphers;						// comma-separated lists of the allowed algorithms, NULL allows all
+	char* macs;
+	char* key_exchange;
 };
 
 int netopeer_transapi_init_ssh(void);
@@ -69,6 +78,16 @@ int callback_n_netopeer_n_ssh_n_auth_attempts(void** UNUSED(data), XMLDIFF_OP op
 
 int callback_n_netopeer_n_ssh_n_auth_timeout(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
 
+int callback_n_netopeer_n_ssh_n_compression_n_enabled(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_ssh_n_compression_n_level(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_ssh_n_ciphers(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_ssh_n_macs(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_ssh_n_key_exchange(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
 void netopeer_transapi_close_ssh(void);
 
 #endif /* _CFGNETOPEER_TRANSAPI_SSH_H_ */
\ No newline at end of file
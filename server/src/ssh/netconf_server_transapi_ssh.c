@@ -146,18 +146,19 @@ int callback_srv_netconf_srv_ssh_srv_call_home_srv_applications_srv_application(
 	return callback_srv_netconf_srv_call_home_srv_applications_srv_application(op, old_node, new_node, error, NC_TRANSPORT_SSH);
 }
 
-int np_ssh_chapp_linger_check(struct ch_app* app) {
-	struct timeval cur_time;
-
-	gettimeofday(&cur_time, NULL);
-	if (timeval_diff(cur_time, ((struct client_struct_ssh*)app->client)->ssh_chans->last_rpc_time) >= app->rep_linger) {
-		/* no data flow for too long, disconnect the client, wait for the set timeout and reconnect */
-		nc_verb_verbose("Call Home (app %s) did not communicate for too long, disconnecting.", app->name);
-		((struct client_struct_ssh*)app->client)->ssh_chans->to_free = 1;
-		sleep(app->rep_timeout*60);
-		return 1;
+uint64_t np_ssh_chapp_linger_check(struct ch_app* app) {
+	uint64_t linger_end, cur_time;
+
+	linger_end = ((struct client_struct_ssh*)app->client)->ssh_chans->last_rpc_time + app->rep_linger*1000ULL;
+	cur_time = np_clock_ms();
+	if (cur_time < linger_end) {
+		return linger_end - cur_time;
 	}
 
+	/* no data flow for too long, disconnect the client, the scheduler reconnects after the set timeout */
+	nc_verb_verbose("Call Home (app %s) did not communicate for too long, disconnecting.", app->name);
+	((struct client_struct_ssh*)app->client)->ssh_chans->to_free = 1;
+	np_client_kick(app->client);
 	return 0;
 }
 
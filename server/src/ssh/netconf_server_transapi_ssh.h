@@ -39,7 +39,8 @@
 #ifndef _NETCONF_SERVER_TRANSAPI_SSH_H_
 #define _NETCONF_SERVER_TRANSAPI_SSH_H_
 
-int np_ssh_chapp_linger_check(struct ch_app* app);
+/* returns the msecs left until the linger expires, 0 when the client got disconnected, called with the call home apps locked */
+uint64_t np_ssh_chapp_linger_check(struct ch_app* app);
 
 int server_transapi_init_ssh(void);
 
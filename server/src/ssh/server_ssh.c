@@ -49,6 +49,7 @@
 #include <pthread.h>
 #include <sys/poll.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -56,15 +57,28 @@
 #include <unistd.h>
 #include <shadow.h>
 #include <pwd.h>
+#include <crypt.h>
 
 #include <libssh/libssh.h>
 #include <libssh/callbacks.h>
 #include <libssh/server.h>
 
 #include "../server.h"
+#include "../hash.h"
+#include "../epoch.h"
+#include "../stats.h"
+#include "../registry.h"
+#include "../rpcpool.h"
+#include "../notif.h"
+#include "../pool.h"
+#include "../ratelimit.h"
+#include "../stream.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
+static struct np_pool client_pool = NP_POOL_INITIALIZER("ssh-clients", struct client_struct_ssh, CLIENT_POOL_SLAB);
+static struct np_pool chan_pool = NP_POOL_INITIALIZER("ssh-channels", struct chan_struct, CLIENT_POOL_SLAB);
+
 extern int quit, restart_soft;
 
 /* one global structure holding all the client information */
@@ -72,8 +86,14 @@ extern struct np_state netopeer_state;
 extern struct np_options netopeer_options;
 
 static inline void _chan_free(struct client_struct_ssh* client, struct chan_struct* chan) {
+	np_stream_free(chan->stream);
+	chan->stream = NULL;
+
 	if (chan->nc_sess != NULL) {
 		nc_verb_error("%s: internal error: freeing a channel with an opened NC session", __func__);
+		np_rpcq_free(chan->rpcq);
+		chan->rpcq = NULL;
+		np_registry_del_session(nc_session_get_id(chan->nc_sess));
 		nc_session_free(chan->nc_sess);
 	}
 
@@ -93,34 +113,95 @@ void client_free_ssh(struct client_struct_ssh* client) {
 	}
 
 	/* ssh_free does this for us */
-	/*if (client->sock != -1) {
-		close(client->sock);
+	/*if (client->common.sock != -1) {
+		close(client->common.sock);
 	}*/
 
-	free(client->username);
-	free(client);
+	free(client->chan_index);
+	free(client->common.username);
+	np_pool_free(&client_pool, client);
 }
 
-static struct client_struct_ssh* client_find_by_sshsession(struct client_struct* root, ssh_session sshsession) {
+struct client_struct* np_ssh_client_new(void) {
 	struct client_struct_ssh* client;
 
-	if (sshsession == NULL) {
+	if ((client = np_pool_alloc(&client_pool)) == NULL) {
 		return NULL;
 	}
+	client->common.transport = NC_TRANSPORT_SSH;
+	client->common.sock = -1;
+	client->common.authenticating = 1;
 
-	for (client = (struct client_struct_ssh*)root; client != NULL; client = (struct client_struct_ssh*)client->next) {
-		if (client->transport == NC_TRANSPORT_SSH && client->ssh_sess == sshsession) {
-			break;
+	return &client->common;
+}
+
+/*
+ * The channels of a client are kept in a list in the order they were opened
+ * and also hashed by their libssh channel, so that the channel of an SSH
+ * message is found no matter how many channels the client has open.
+ */
+static unsigned int chan_index_bucket(ssh_channel sshchannel, unsigned int size) {
+	uint64_t key = (uintptr_t)sshchannel;
+
+	/* Fibonacci hashing, the low bits of a pointer are always the same */
+	return (unsigned int)((key * 11400714819323198485ull) >> 32) & (size - 1);
+}
+
+static int chan_index_add(struct client_struct_ssh* client, struct chan_struct* chan) {
+	struct chan_struct** index, *cur, *next;
+	unsigned int size, i, bucket;
+
+	if (client->chan_count >= client->chan_index_size) {
+		size = (client->chan_index_size ? client->chan_index_size*2 : 4);
+		if ((index = calloc(size, sizeof(struct chan_struct*))) == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < client->chan_index_size; ++i) {
+			for (cur = client->chan_index[i]; cur != NULL; cur = next) {
+				next = cur->index_next;
+				bucket = chan_index_bucket(cur->ssh_chan, size);
+				cur->index_next = index[bucket];
+				index[bucket] = cur;
+			}
 		}
+		free(client->chan_index);
+		client->chan_index = index;
+		client->chan_index_size = size;
 	}
 
-	return client;
+	bucket = chan_index_bucket(chan->ssh_chan, client->chan_index_size);
+	chan->index_next = client->chan_index[bucket];
+	client->chan_index[bucket] = chan;
+	++client->chan_count;
+
+	return EXIT_SUCCESS;
+}
+
+static void chan_index_del(struct client_struct_ssh* client, struct chan_struct* chan) {
+	struct chan_struct** cur;
+
+	if (client->chan_index == NULL) {
+		return;
+	}
+
+	for (cur = &client->chan_index[chan_index_bucket(chan->ssh_chan, client->chan_index_size)]; *cur != NULL; cur = &(*cur)->index_next) {
+		if (*cur == chan) {
+			*cur = chan->index_next;
+			--client->chan_count;
+			break;
+		}
+	}
 }
 
 static struct chan_struct* client_find_channel_by_sshchan(struct client_struct_ssh* client, ssh_channel sshchannel) {
-	struct chan_struct* chan = NULL;
+	struct chan_struct* chan;
 
-	for (chan = client->ssh_chans; chan != NULL; chan = chan->next) {
+	if (client->chan_index == NULL) {
+		return NULL;
+	}
+
+	for (chan = client->chan_index[chan_index_bucket(sshchannel, client->chan_index_size)]; chan != NULL; chan = chan->index_next) {
 		if (chan->ssh_chan == sshchannel) {
 			break;
 		}
@@ -145,44 +226,37 @@ static struct chan_struct* client_free_channel(struct client_struct_ssh* client,
 		return NULL;
 	}
 
+	if (client->ssh_chans_tail == cur_chan) {
+		client->ssh_chans_tail = prev_chan;
+	}
+	if (client->chans_next == cur_chan) {
+		client->chans_next = cur_chan->next;
+	}
+	chan_index_del(client, cur_chan);
+
 	if (prev_chan == NULL) {
 		_chan_free(client, cur_chan);
 		client->ssh_chans = cur_chan->next;
-		free(cur_chan);
+		np_pool_free(&chan_pool, cur_chan);
+		if (client->ssh_chans != NULL) {
+			/* the last channel is counted as the client itself */
+			np_session_count_add(NC_TRANSPORT_SSH, -1);
+		}
 		return client->ssh_chans;
 	}
 
 	prev_chan->next = cur_chan->next;
 	_chan_free(client, cur_chan);
-	free(cur_chan);
+	np_pool_free(&chan_pool, cur_chan);
+	np_session_count_add(NC_TRANSPORT_SSH, -1);
 	return prev_chan;
 }
 
-static struct chan_struct* client_find_channel_by_sid(struct client_struct_ssh* client, const char* sid) {
-	struct chan_struct* chan = NULL;
-
-	if (client == NULL || sid == NULL) {
-		return NULL;
-	}
-
-	for (chan = client->ssh_chans; chan != NULL; chan = chan->next) {
-		if (chan->nc_sess == NULL) {
-			continue;
-		}
-
-		if (strcmp(sid, nc_session_get_id(chan->nc_sess)) == 0) {
-			break;
-		}
-	}
-
-	return chan;
-}
-
 static int create_netconf_session(struct client_struct_ssh* client, struct chan_struct* channel) {
 	struct nc_cpblts* caps = NULL;
 
 	caps = nc_session_get_cpblts_default();
-	channel->nc_sess = nc_session_accept_libssh_channel(caps, client->username, channel->ssh_chan);
+	channel->nc_sess = nc_session_accept_libssh_channel(caps, client->common.username, channel->ssh_chan);
 	nc_cpblts_free(caps);
 	if (channel->to_free == 1) {
 		/* probably a signal received */
@@ -200,8 +274,22 @@ static int create_netconf_session(struct client_struct_ssh* client, struct chan_
 	}
 
 	/* new session was created */
-	nc_verb_verbose("New server session for '%s' with ID %s", client->username, nc_session_get_id(channel->nc_sess));
-	gettimeofday((struct timeval*)&channel->last_rpc_time, NULL);
+	nc_verb_verbose("New server session for '%s' with ID %s", client->common.username, nc_session_get_id(channel->nc_sess));
+	if ((channel->rpcq = np_rpcq_new(&client->common, channel->nc_sess)) == NULL) {
+		nc_session_free(channel->nc_sess);
+		channel->nc_sess = NULL;
+		channel->to_free = 1;
+		return EXIT_FAILURE;
+	}
+	if (np_registry_add_session(nc_session_get_id(channel->nc_sess), &client->common, &channel->to_free) != EXIT_SUCCESS) {
+		np_rpcq_free(channel->rpcq);
+		channel->rpcq = NULL;
+		nc_session_free(channel->nc_sess);
+		channel->nc_sess = NULL;
+		channel->to_free = 1;
+		return EXIT_FAILURE;
+	}
+	channel->last_rpc_time = np_clock_ms();
 
 	return EXIT_SUCCESS;
 }
@@ -210,33 +298,149 @@ static int create_netconf_session(struct client_struct_ssh* client, struct chan_
 static int sshcb_channel_subsystem(struct client_struct_ssh* client, struct chan_struct* channel, const char* subsystem) {
 	if (strcmp(subsystem, "netconf") == 0) {
 		if (channel->netconf_subsystem) {
-			nc_verb_warning("Client '%s' requested subsystem 'netconf' for the second time", client->username);
+			nc_verb_warning("Client '%s' requested subsystem 'netconf' for the second time", client->common.username);
 		} else {
 			channel->netconf_subsystem = 1;
 		}
 	} else {
-		nc_verb_warning("Client '%s' requested unknown subsystem '%s'", client->username, subsystem);
+		nc_verb_warning("Client '%s' requested unknown subsystem '%s'", client->common.username, subsystem);
 	}
 
 	return 0;
 }
 
-static char* auth_password_get_pwd_hash(const char* username) {
-	struct passwd* pwd;
-	struct spwd* spwd;
+/*
+ * The passwords are checked by the authentication threads of the reactor,
+ * which may run several checks at once, so only the reentrant lookups are
+ * used. A client usually tries its password several times or opens several
+ * sessions in a row, the retrieved shadow entries are therefore kept for
+ * a short while (AUTH_SHADOW_CACHE_TTL) to spare the NSS lookups.
+ */
+struct auth_shadow_entry {
+	char* username;
+	char* pass_hash;
+	uint64_t expires;
+};
+
+static struct auth_shadow_entry auth_shadow_cache[AUTH_SHADOW_CACHE_SIZE];
+static pthread_mutex_t auth_shadow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char* auth_shadow_cache_get(const char* username) {
 	char* pass_hash = NULL;
+	uint64_t now;
+	int i;
+
+	now = np_clock_ms();
+
+	/* SHADOW LOCK */
+	pthread_mutex_lock(&auth_shadow_lock);
+	for (i = 0; i < AUTH_SHADOW_CACHE_SIZE; ++i) {
+		if (auth_shadow_cache[i].username != NULL && auth_shadow_cache[i].expires > now
+				&& strcmp(auth_shadow_cache[i].username, username) == 0) {
+			pass_hash = strdup(auth_shadow_cache[i].pass_hash);
+			break;
+		}
+	}
+	/* SHADOW UNLOCK */
+	pthread_mutex_unlock(&auth_shadow_lock);
+
+	return pass_hash;
+}
 
-	pwd = getpwnam(username);
+static void auth_shadow_cache_put(const char* username, const char* pass_hash) {
+	struct auth_shadow_entry* entry = NULL;
+	int i;
+
+	/* SHADOW LOCK */
+	pthread_mutex_lock(&auth_shadow_lock);
+	for (i = 0; i < AUTH_SHADOW_CACHE_SIZE; ++i) {
+		if (auth_shadow_cache[i].username != NULL && strcmp(auth_shadow_cache[i].username, username) == 0) {
+			entry = &auth_shadow_cache[i];
+			break;
+		}
+		/* replace the entry expiring first */
+		if (entry == NULL || auth_shadow_cache[i].expires < entry->expires) {
+			entry = &auth_shadow_cache[i];
+		}
+	}
+
+	free(entry->username);
+	free(entry->pass_hash);
+	entry->username = strdup(username);
+	entry->pass_hash = strdup(pass_hash);
+	if (entry->username == NULL || entry->pass_hash == NULL) {
+		free(entry->username);
+		free(entry->pass_hash);
+		entry->username = NULL;
+		entry->pass_hash = NULL;
+	}
+	entry->expires = np_clock_ms() + AUTH_SHADOW_CACHE_TTL * 1000;
+	/* SHADOW UNLOCK */
+	pthread_mutex_unlock(&auth_shadow_lock);
+}
+
+static void auth_shadow_cache_clear(void) {
+	int i;
+
+	/* SHADOW LOCK */
+	pthread_mutex_lock(&auth_shadow_lock);
+	for (i = 0; i < AUTH_SHADOW_CACHE_SIZE; ++i) {
+		free(auth_shadow_cache[i].username);
+		free(auth_shadow_cache[i].pass_hash);
+		auth_shadow_cache[i].username = NULL;
+		auth_shadow_cache[i].pass_hash = NULL;
+		auth_shadow_cache[i].expires = 0;
+	}
+	/* SHADOW UNLOCK */
+	pthread_mutex_unlock(&auth_shadow_lock);
+}
+
+/* returns a newly allocated hash */
+static char* auth_password_get_pwd_hash(const char* username) {
+	struct passwd pwd_buf, *pwd = NULL;
+	struct spwd spwd_buf, *spwd = NULL;
+	char* pass_hash = NULL, *buf;
+	long buf_len;
+	int ret;
+
+	if ((pass_hash = auth_shadow_cache_get(username)) != NULL) {
+		return pass_hash;
+	}
+
+	if ((buf_len = sysconf(_SC_GETPW_R_SIZE_MAX)) < 1024) {
+		buf_len = 1024;
+	}
+	if ((buf = malloc(buf_len)) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return NULL;
+	}
+
+	while ((ret = getpwnam_r(username, &pwd_buf, buf, buf_len, &pwd)) == ERANGE) {
+		buf_len *= 2;
+		free(buf);
+		if ((buf = malloc(buf_len)) == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			return NULL;
+		}
+	}
 	if (pwd == NULL) {
 		nc_verb_verbose("User '%s' not found locally.", username);
-		return NULL;
+		goto cleanup;
 	}
 
 	if (strcmp(pwd->pw_passwd, "x") == 0) {
-		spwd = getspnam(username);
+		/* the buffer is still big enough, the shadow entry is shorter */
+		while ((ret = getspnam_r(username, &spwd_buf, buf, buf_len, &spwd)) == ERANGE) {
+			buf_len *= 2;
+			free(buf);
+			if ((buf = malloc(buf_len)) == NULL) {
+				nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+				return NULL;
+			}
+		}
 		if (spwd == NULL) {
 			nc_verb_verbose("Failed to retrieve the shadow entry for '%s'.", username);
-			return NULL;
+			goto cleanup;
 		}
 
 		pass_hash = spwd->sp_pwdp;
@@ -246,24 +450,34 @@ static char* auth_password_get_pwd_hash(const char* username) {
 
 	if (pass_hash == NULL) {
 		nc_verb_error("%s: no password could be retrieved for '%s'", __func__, username);
-		return NULL;
+		goto cleanup;
 	}
 
 	/* check the hash structure for special meaning */
 	if (strcmp(pass_hash, "*") == 0 || strcmp(pass_hash, "!") == 0) {
 		nc_verb_verbose("User '%s' is not allowed to authenticate using a password.", username);
-		return NULL;
+		pass_hash = NULL;
+		goto cleanup;
 	}
 	if (strcmp(pass_hash, "*NP*") == 0) {
 		nc_verb_verbose("Retrieving password for '%s' from a NIS+ server not supported.", username);
-		return NULL;
+		pass_hash = NULL;
+		goto cleanup;
 	}
 
+	auth_shadow_cache_put(username, pass_hash);
+	pass_hash = strdup(pass_hash);
+
+cleanup:
+	memset(buf, 0, buf_len);
+	free(buf);
 	return pass_hash;
 }
 
 static int auth_password_compare_pwd(const char* pass_hash, const char* pass_clear) {
+	struct crypt_data* data;
 	char* new_pass_hash;
+	int ret;
 
 	if (strcmp(pass_hash, "") == 0) {
 		if (strcmp(pass_clear, "") == 0) {
@@ -276,27 +490,39 @@ static int auth_password_compare_pwd(const char* pass_hash, const char* pass_cle
 		}
 	}
 
-	new_pass_hash = crypt(pass_clear, pass_hash);
+	/* too big for the stack of a thread */
+	if ((data = calloc(1, sizeof(struct crypt_data))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return 1;
+	}
+	new_pass_hash = crypt_r(pass_clear, pass_hash, data);
 	if (!new_pass_hash) {
-		nc_verb_error("%s: crypt() failed (setting \"%s\").", __func__, pass_hash);
+		nc_verb_error("%s: crypt_r() failed (setting \"%s\").", __func__, pass_hash);
+		free(data);
 		return 1;
 	}
-	return strcmp(new_pass_hash, pass_hash);
+	ret = strcmp(new_pass_hash, pass_hash);
+	free(data);
+	return ret;
 }
 
 static void sshcb_auth_password(struct client_struct_ssh* client, ssh_message msg) {
 	char* pass_hash;
 
-	pass_hash = auth_password_get_pwd_hash(client->username);
+	pass_hash = auth_password_get_pwd_hash(client->common.username);
 	if (pass_hash != NULL && auth_password_compare_pwd(pass_hash, ssh_message_auth_password(msg)) == 0) {
-		nc_verb_verbose("User '%s' authenticated.", client->username);
+		free(pass_hash);
+		nc_verb_verbose("User '%s' authenticated.", client->common.username);
 		ssh_message_auth_reply_success(msg, 0);
 		client->authenticated = 1;
+		client->common.authenticating = 0;
 		return;
 	}
+	free(pass_hash);
 
 	client->auth_attempts++;
-	nc_verb_verbose("Failed user '%s' authentication attempt (#%d).", client->username, client->auth_attempts);
+	np_stat_inc(NP_STAT_AUTH_FAILURES);
+	nc_verb_verbose("Failed user '%s' authentication attempt (#%d).", client->common.username, client->auth_attempts);
 	ssh_message_reply_default(msg);
 }
 
@@ -313,32 +539,112 @@ static void sshcb_auth_kbdint(struct client_struct_ssh* client, ssh_message msg)
 			ssh_message_reply_default(msg);
 			return;
 		}
-		pass_hash = auth_password_get_pwd_hash(client->username);
+		pass_hash = auth_password_get_pwd_hash(client->common.username);
 		if (pass_hash == NULL) {
 			ssh_message_reply_default(msg);
 			return;
 		}
 		if (auth_password_compare_pwd(pass_hash, ssh_userauth_kbdint_getanswer(client->ssh_sess, 0)) == 0) {
-			nc_verb_verbose("User '%s' authenticated.", client->username);
+			nc_verb_verbose("User '%s' authenticated.", client->common.username);
 			client->authenticated = 1;
+			client->common.authenticating = 0;
 			ssh_message_auth_reply_success(msg, 0);
 		} else {
 			client->auth_attempts++;
-			nc_verb_verbose("Failed user '%s' authentication attempt (#%d).", client->username, client->auth_attempts);
+			np_stat_inc(NP_STAT_AUTH_FAILURES);
+			nc_verb_verbose("Failed user '%s' authentication attempt (#%d).", client->common.username, client->auth_attempts);
 			ssh_message_reply_default(msg);
 		}
+		free(pass_hash);
 	}
 }
 
-static char* auth_pubkey_compare_key(ssh_key key) {
+/*
+ * The public keys of client-auth-keys are read from their files only when
+ * the configuration or the files change, into an index hashed by the key
+ * fingerprint. The authenticating threads look the keys up without any
+ * lock, a replaced index is freed only after all the lookups that could
+ * still see it finished, as np_epoch_publish() guarantees.
+ */
+struct auth_key_entry {
+	unsigned char* hash;
+	size_t hash_len;
+	ssh_key key;
+	char* username;
+	struct auth_key_entry* next;
+};
+
+struct auth_key_index {
+	unsigned int size;		// power of 2
+	struct auth_key_entry** buckets;
+};
+
+static struct auth_key_index* auth_keys = NULL;
+static struct np_epoch auth_keys_epoch;
+static uint64_t auth_keys_checked = 0;
+
+static uint32_t auth_key_bucket(const unsigned char* hash, size_t hash_len, unsigned int size) {
+	return np_hash(NP_HASH_INIT, hash, hash_len) & (size - 1);
+}
+
+static void auth_key_index_free(struct auth_key_index* index) {
+	struct auth_key_entry* entry;
+	unsigned int i;
+
+	if (index == NULL) {
+		return;
+	}
+
+	for (i = 0; i < index->size; ++i) {
+		while ((entry = index->buckets[i]) != NULL) {
+			index->buckets[i] = entry->next;
+			ssh_clean_pubkey_hash(&entry->hash);
+			ssh_key_free(entry->key);
+			free(entry->username);
+			free(entry);
+		}
+	}
+	free(index->buckets);
+	free(index);
+}
+
+/* publish a new index and free the old one once nobody uses it */
+static void auth_key_index_swap(struct auth_key_index* index) {
+	auth_key_index_free(np_epoch_publish((void**)&auth_keys, index, &auth_keys_epoch));
+}
+
+/* CLIENT KEYS LOCK must be held */
+static void auth_keys_rebuild(void) {
+	struct auth_key_index* index;
+	struct auth_key_entry* entry;
 	struct np_auth_key* auth_key;
+	struct stat st;
+	unsigned int count, bucket;
 	ssh_key pub_key;
-	char* username = NULL;
+	unsigned char* hash;
+	size_t hash_len;
 
-	/* CLIENT KEYS LOCK */
-	pthread_mutex_lock(&netopeer_options.ssh_opts->client_keys_lock);
+	for (count = 0, auth_key = netopeer_options.ssh_opts->client_auth_keys; auth_key != NULL; auth_key = auth_key->next, ++count);
+
+	if ((index = calloc(1, sizeof(struct auth_key_index))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return;
+	}
+	for (index->size = 16; index->size < 2*count; index->size *= 2);
+	if ((index->buckets = calloc(index->size, sizeof(struct auth_key_entry*))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		free(index);
+		return;
+	}
 
 	for (auth_key = netopeer_options.ssh_opts->client_auth_keys; auth_key != NULL; auth_key = auth_key->next) {
+		if (stat(auth_key->path, &st) == 0) {
+			auth_key->ino = st.st_ino;
+			auth_key->mtime = st.st_mtim;
+		} else {
+			auth_key->ino = 0;
+		}
+
 		if (ssh_pki_import_pubkey_file(auth_key->path, &pub_key) != SSH_OK) {
 			if (eaccess(auth_key->path, R_OK) != 0) {
 				nc_verb_verbose("%s: failed to import the public key \"%s\" (%s)", __func__, auth_key->path, strerror(errno));
@@ -347,22 +653,99 @@ static char* auth_pubkey_compare_key(ssh_key key) {
 			}
 			continue;
 		}
-
-		if (ssh_key_cmp(key, pub_key, SSH_KEY_CMP_PUBLIC) == 0) {
+		if (ssh_get_publickey_hash(pub_key, SSH_PUBLICKEY_HASH_SHA1, &hash, &hash_len) != 0) {
+			nc_verb_verbose("%s: failed to get the fingerprint of the public key \"%s\"", __func__, auth_key->path);
 			ssh_key_free(pub_key);
-			break;
+			continue;
+		}
+		if ((entry = malloc(sizeof(struct auth_key_entry))) == NULL) {
+			ssh_clean_pubkey_hash(&hash);
+			ssh_key_free(pub_key);
+			continue;
 		}
 
-		ssh_key_free(pub_key);
+		entry->hash = hash;
+		entry->hash_len = hash_len;
+		entry->key = pub_key;
+		entry->username = strdup(auth_key->username);
+		bucket = auth_key_bucket(hash, hash_len, index->size);
+		entry->next = index->buckets[bucket];
+		index->buckets[bucket] = entry;
+	}
+
+	auth_key_index_swap(index);
+	nc_verb_verbose("Client public keys loaded.");
+}
+
+void np_ssh_auth_keys_check(void) {
+	struct np_auth_key* auth_key;
+	struct stat st;
+	uint64_t now;
+	int changed;
+
+	if (netopeer_options.ssh_opts == NULL) {
+		return;
 	}
 
-	if (auth_key != NULL) {
-		username = strdup(auth_key->username);
+	now = np_clock_ms();
+	if (!netopeer_options.ssh_opts->client_keys_change_flag && now < auth_keys_checked + AUTH_KEYS_CHECK_INTERVAL*1000) {
+		return;
 	}
+	auth_keys_checked = now;
+
+	/* CLIENT KEYS LOCK */
+	pthread_mutex_lock(&netopeer_options.ssh_opts->client_keys_lock);
+
+	changed = netopeer_options.ssh_opts->client_keys_change_flag;
+	for (auth_key = netopeer_options.ssh_opts->client_auth_keys; !changed && auth_key != NULL; auth_key = auth_key->next) {
+		if (stat(auth_key->path, &st) != 0) {
+			changed = (auth_key->ino != 0);
+		} else if (st.st_ino != auth_key->ino || st.st_mtim.tv_sec != auth_key->mtime.tv_sec
+				|| st.st_mtim.tv_nsec != auth_key->mtime.tv_nsec) {
+			changed = 1;
+		}
+	}
+	if (changed) {
+		auth_keys_rebuild();
+	}
+	netopeer_options.ssh_opts->client_keys_change_flag = 0;
 
 	/* CLIENT KEYS UNLOCK */
 	pthread_mutex_unlock(&netopeer_options.ssh_opts->client_keys_lock);
+}
 
+void np_ssh_auth_keys_clear(void) {
+	auth_key_index_swap(NULL);
+}
+
+static char* auth_pubkey_compare_key(ssh_key key) {
+	struct auth_key_index* index;
+	struct auth_key_entry* entry;
+	char* username = NULL;
+	unsigned char* hash;
+	size_t hash_len;
+	unsigned int slot;
+
+	if (ssh_get_publickey_hash(key, SSH_PUBLICKEY_HASH_SHA1, &hash, &hash_len) != 0) {
+		return NULL;
+	}
+
+	slot = np_epoch_enter(&auth_keys_epoch);
+	index = __atomic_load_n(&auth_keys, __ATOMIC_SEQ_CST);
+
+	if (index != NULL) {
+		for (entry = index->buckets[auth_key_bucket(hash, hash_len, index->size)]; entry != NULL; entry = entry->next) {
+			if (entry->hash_len == hash_len && memcmp(entry->hash, hash, hash_len) == 0
+					&& ssh_key_cmp(key, entry->key, SSH_KEY_CMP_PUBLIC) == 0) {
+				username = strdup(entry->username);
+				break;
+			}
+		}
+	}
+
+	np_epoch_leave(&auth_keys_epoch, slot);
+
+	ssh_clean_pubkey_hash(&hash);
 	return username;
 }
 
@@ -371,17 +754,18 @@ static void sshcb_auth_pubkey(struct client_struct_ssh* client, ssh_message msg)
 	int signature_state;
 
 	if ((username = auth_pubkey_compare_key(ssh_message_auth_pubkey(msg))) == NULL) {
-		nc_verb_verbose("User '%s' tried to use an unknown (unauthorized) public key.", client->username);
+		nc_verb_verbose("User '%s' tried to use an unknown (unauthorized) public key.", client->common.username);
 		goto fail;
-	} else if (strcmp(client->username, username) != 0) {
-		nc_verb_verbose("User '%s' is not the username identified with the presented public key.", client->username);
+	} else if (strcmp(client->common.username, username) != 0) {
+		nc_verb_verbose("User '%s' is not the username identified with the presented public key.", client->common.username);
 		goto fail;
 	}
 
 	signature_state = ssh_message_auth_publickey_state(msg);
 	if (signature_state == SSH_PUBLICKEY_STATE_VALID) {
-		nc_verb_verbose("User '%s' authenticated.", client->username);
+		nc_verb_verbose("User '%s' authenticated.", client->common.username);
 		client->authenticated = 1;
+		client->common.authenticating = 0;
 		ssh_message_auth_reply_success(msg, 0);
 	} else if (signature_state == SSH_PUBLICKEY_STATE_NONE) {
 		free(username);
@@ -396,7 +780,8 @@ static void sshcb_auth_pubkey(struct client_struct_ssh* client, ssh_message msg)
 fail:
 	free(username);
 	client->auth_attempts++;
-	nc_verb_verbose("Failed user '%s' authentication attempt (#%d).", client->username, client->auth_attempts);
+	np_stat_inc(NP_STAT_AUTH_FAILURES);
+	nc_verb_verbose("Failed user '%s' authentication attempt (#%d).", client->common.username, client->auth_attempts);
 	ssh_message_reply_default(msg);
 }
 
@@ -404,99 +789,164 @@ fail:
 static int sshcb_channel_open(struct client_struct_ssh* client, ssh_channel channel) {
 	struct chan_struct* cur_chan;
 
+	if ((cur_chan = np_pool_alloc(&chan_pool)) == NULL) {
+		ssh_channel_free(channel);
+		return -1;
+	}
+	cur_chan->ssh_chan = channel;
+
 	/* GLOBAL LOCK */
 	pthread_mutex_lock(&netopeer_state.global_lock);
 
+	if (chan_index_add(client, cur_chan) != EXIT_SUCCESS) {
+		/* GLOBAL UNLOCK */
+		pthread_mutex_unlock(&netopeer_state.global_lock);
+		np_pool_free(&chan_pool, cur_chan);
+		ssh_channel_free(channel);
+		return -1;
+	}
+
 	if (client->ssh_chans == NULL) {
-		client->ssh_chans = calloc(1, sizeof(struct chan_struct));
-		cur_chan = client->ssh_chans;
+		client->ssh_chans = cur_chan;
 	} else {
-		for (cur_chan = client->ssh_chans; cur_chan->next != NULL; cur_chan = cur_chan->next);
-		cur_chan->next = calloc(1, sizeof(struct chan_struct));
-		cur_chan = cur_chan->next;
+		client->ssh_chans_tail->next = cur_chan;
+		/* the first channel is already counted as the client itself */
+		np_session_count_add(NC_TRANSPORT_SSH, 1);
 	}
-	cur_chan->ssh_chan = channel;
+	client->ssh_chans_tail = cur_chan;
 
 	/* GLOBAL UNLOCK */
 	pthread_mutex_unlock(&netopeer_state.global_lock);
 
-	gettimeofday((struct timeval*)&cur_chan->last_rpc_time, NULL);
+	cur_chan->last_rpc_time = np_clock_ms();
 
 	return 0;
 }
 
-int np_ssh_kill_session(const char* sid, struct client_struct_ssh* cur_client) {
-	struct client_struct_ssh* kill_client;
-	struct chan_struct* kill_chan = NULL;
+/* write only what fits into the channel window, the rest would be buffered by libssh */
+static ssize_t chan_stream_write(void* arg, const char* buf, size_t len) {
+	struct chan_struct* chan = (struct chan_struct*)arg;
+	uint32_t window;
+	int ret;
 
-	if (sid == NULL) {
-		return 1;
+	/* a window adjust comes as a new message, so the socket becomes readable */
+	if ((window = ssh_channel_window_size(chan->ssh_chan)) == 0) {
+		return 0;
+	}
+	if (len > window) {
+		len = window;
 	}
 
-	/* find the requested session (channel) */
-	for (kill_client = (struct client_struct_ssh*)netopeer_state.clients; kill_client != NULL; kill_client = (struct client_struct_ssh*)kill_client->next) {
-		if (kill_client->transport != NC_TRANSPORT_SSH || kill_client == cur_client) {
-			continue;
-		}
-
-		kill_chan = client_find_channel_by_sid(kill_client, sid);
-		if (kill_chan != NULL) {
-			break;
-		}
+	if ((ret = ssh_channel_write(chan->ssh_chan, buf, len)) == SSH_ERROR) {
+		return -1;
 	}
+	return ret;
+}
 
-	if (kill_chan == NULL) {
-		return 1;
+/* continue writing the streamed reply, returns 1 if there is none anymore */
+static int chan_stream(struct chan_struct* chan, int* skip_sleep) {
+	ssize_t ret;
+
+	if ((ret = np_stream_send(chan->stream, chan_stream_write, chan)) < 0) {
+		nc_verb_error("%s: failed to write a reply to session %s", __func__, nc_session_get_id(chan->nc_sess));
+		chan->to_free = 1;
+		return 0;
+	}
+	if (ret > 0) {
+		++(*skip_sleep);
+		chan->last_rpc_time = np_clock_ms();
 	}
 
-	kill_chan->to_free = 1;
-	return 0;
+	if (!np_stream_done(chan->stream)) {
+		return 0;
+	}
+	np_stream_free(chan->stream);
+	chan->stream = NULL;
+	return 1;
 }
 
-/* return: 0 - nothing happened (sleep), 1 - something happened (skip sleep) */
-int np_ssh_client_netconf_rpc(struct client_struct_ssh* client) {
+/* serve a single channel in a pass, return: 0 - nothing happened (sleep), 1 - something happened (skip sleep) */
+static int chan_netconf_rpc(struct client_struct_ssh* client, struct chan_struct* chan) {
 	nc_rpc* rpc = NULL;
 	nc_reply* rpc_reply = NULL;
+	char* reply_data;
 	NC_MSG_TYPE rpc_type;
-	xmlNodePtr op;
-	int closing = 0, skip_sleep = 0;
+	int closing, skip_sleep = 0, quantum;
 	struct nc_err* err;
-	struct chan_struct* chan;
+	struct np_subscriber* subscriber;
 
-	if (client->to_free) {
+	if (chan->to_free) {
 		return 1;
 	}
 
-	for (chan = client->ssh_chans; chan != NULL; chan = chan->next) {
-		if (chan->to_free) {
-			++skip_sleep;
-			continue;
+	/* block this client until the hello is received */
+	if (chan->nc_sess == NULL) {
+		if (!chan->netconf_subsystem) {
+			return 0;
+		}
+		if (create_netconf_session(client, chan)) {
+			return 0;
 		}
+	}
 
-		/* block this client until the hello is received */
-		if (chan->nc_sess == NULL) {
-			if (!chan->netconf_subsystem) {
-				continue;
-			}
-			if (create_netconf_session(client, chan)) {
-				continue;
-			}
+	/* nothing else can be sent before the streamed reply is finished */
+	if (chan->stream != NULL && !chan_stream(chan, &skip_sleep)) {
+		return skip_sleep;
+	}
+
+	/* send the replies of the executed RPCs */
+	while ((rpc_reply = np_rpcq_pop_reply(chan->rpcq, &rpc, &reply_data, &closing)) != NULL) {
+		++skip_sleep;
+		if (np_rpcq_streamable(chan->rpcq)) {
+			chan->stream = np_stream_new(chan->nc_sess, rpc, rpc_reply, reply_data, np_rpcq_memacct(chan->rpcq));
+		} else {
+			free(reply_data);
+		}
+		if (chan->stream == NULL) {
+			nc_session_send_reply(chan->nc_sess, rpc, rpc_reply);
+		}
+		nc_reply_free(rpc_reply);
+		nc_rpc_free(rpc);
+		chan->last_rpc_time = np_clock_ms();
+
+		if (closing) {
+			chan->to_free = 1;
+			break;
+		}
+		if (chan->stream != NULL && !chan_stream(chan, &skip_sleep)) {
+			break;
+		}
+	}
+	if (chan->to_free || chan->stream != NULL) {
+		return skip_sleep;
+	}
+
+	/* send the notifications dispatched for this session */
+	if ((subscriber = np_rpcq_subscriber(chan->rpcq)) != NULL) {
+		skip_sleep += np_notif_flush(subscriber, chan->nc_sess);
+	}
+
+	/* receive new RPCs, at most the quantum of the channel in a pass */
+	for (quantum = CHAN_RPC_QUANTUM; quantum > 0; --quantum) {
+		/* do not read more than the session is allowed to have queued */
+		if (np_rpcq_pending(chan->rpcq) >= RPC_QUEUE_LIMIT) {
+			break;
 		}
 
-		/* receive a new RPC */
 		rpc_type = nc_session_recv_rpc(chan->nc_sess, 0, &rpc);
 		if (rpc_type == NC_MSG_WOULDBLOCK || rpc_type == NC_MSG_NONE) {
 			/* no RPC, or processed internally */
-			continue;
+			break;
 		}
 
-		gettimeofday((struct timeval*)&chan->last_rpc_time, NULL);
+		chan->last_rpc_time = np_clock_ms();
 
 		if (rpc_type == NC_MSG_UNKNOWN) {
 			if (nc_session_get_status(chan->nc_sess) != NC_SESSION_STATUS_WORKING) {
 				/* something really bad happened, and communication is not possible anymore */
 				nc_verb_error("%s: failed to receive client's message (nc session not working)", __func__);
 				chan->to_free = 1;
+				break;
 			}
 			/* ignore */
 			continue;
@@ -513,184 +963,121 @@ int np_ssh_client_netconf_rpc(struct client_struct_ssh* client) {
 
 		++skip_sleep;
 
-		/* process the new RPC */
-		switch (nc_rpc_get_op(rpc)) {
-		case NC_OP_CLOSESESSION:
-			closing = 1;
-			rpc_reply = nc_reply_ok();
-			break;
-
-		case NC_OP_KILLSESSION:
-			if ((op = ncxml_rpc_get_op_content(rpc)) == NULL || op->name == NULL ||
-					xmlStrEqual(op->name, BAD_CAST "kill-session") == 0) {
-				nc_verb_error("%s: corrupted RPC message", __func__);
-				rpc_reply = nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
-				err = NULL;
-				xmlFreeNodeList(op);
-				break;
-			}
-			if (op->children == NULL || xmlStrEqual(op->children->name, BAD_CAST "session-id") == 0) {
-				nc_verb_error("%s: no session ID found");
-				err = nc_err_new(NC_ERR_MISSING_ELEM);
-				nc_err_set(err, NC_ERR_PARAM_INFO_BADELEM, "session-id");
-				rpc_reply = nc_reply_error(err);
-				err = NULL;
-				xmlFreeNodeList(op);
-				break;
-			}
-
-			/* block-local variables */
-			char* sid;
-			int ret;
-
-			sid = (char*)xmlNodeGetContent(op->children);
-			xmlFreeNodeList(op);
-
-			/* check if this client is not requested to be killed */
-			if (client_find_channel_by_sid(client, sid) != NULL) {
-				free(sid);
-				err = nc_err_new(NC_ERR_INVALID_VALUE);
-				nc_err_set(err, NC_ERR_PARAM_MSG, "Requested to kill this session.");
-				rpc_reply = nc_reply_error(err);
-				break;
-			}
-
-			ret = 1;
-#ifdef NP_TLS
-			ret = np_tls_kill_session(sid, (struct client_struct_tls*)client);
-#endif
-			if (ret != 0 && np_ssh_kill_session(sid, client) != 0) {
-				free(sid);
-				err = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(err, NC_ERR_PARAM_MSG, "No session with the requested ID found.");
-				rpc_reply = nc_reply_error(err);
-				break;
-			}
-
-			nc_verb_verbose("Session with the ID %s killed.", sid);
-			rpc_reply = nc_reply_ok();
-
-			free(sid);
-			break;
-
-		case NC_OP_CREATESUBSCRIPTION:
-			/* create-subscription message */
-			if (nc_cpblts_enabled(chan->nc_sess, "urn:ietf:params:netconf:capability:notification:1.0") == 0) {
-				rpc_reply = nc_reply_error(nc_err_new(NC_ERR_OP_NOT_SUPPORTED));
-				break;
-			}
+		/* close-session is always let through so that a flooding client can still leave */
+		if (nc_rpc_get_op(rpc) != NC_OP_CLOSESESSION && np_ratelimit_rpc(&chan->rpc_bucket) != EXIT_SUCCESS) {
+			np_stat_inc(NP_STAT_LIMITED_RPCS);
+			err = nc_err_new(NC_ERR_RES_DENIED);
+			nc_err_set(err, NC_ERR_PARAM_MSG, "Too many RPCs, slow down.");
+			rpc_reply = nc_reply_error(err);
+			nc_session_send_reply(chan->nc_sess, rpc, rpc_reply);
+			nc_reply_free(rpc_reply);
+			nc_rpc_free(rpc);
+			continue;
+		}
 
-			/* check if notifications are allowed on this session */
-			if (nc_session_notif_allowed(chan->nc_sess) == 0) {
-				nc_verb_error("%s: notification subscription is not allowed on the session %s", __func__, nc_session_get_id(chan->nc_sess));
-				err = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(err, NC_ERR_PARAM_TYPE, "protocol");
-				nc_err_set(err, NC_ERR_PARAM_MSG, "Another notification subscription is currently active on this session.");
-				rpc_reply = nc_reply_error(err);
-				err = NULL;
-				break;
-			}
+		/* let the RPC threads process it, the reply is sent once ready */
+		if (np_rpcq_push(chan->rpcq, rpc) != EXIT_SUCCESS) {
+			err = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+			rpc_reply = nc_reply_error(err);
+			nc_session_send_reply(chan->nc_sess, rpc, rpc_reply);
+			nc_reply_free(rpc_reply);
+			nc_rpc_free(rpc);
+		}
+	}
 
-			rpc_reply = ncntf_subscription_check(rpc);
-			if (nc_reply_get_type(rpc_reply) != NC_REPLY_OK) {
-				break;
-			}
+	return skip_sleep;
+}
 
-			pthread_t thread;
-			struct ntf_thread_config* ntf_config;
+/*
+ * Every pass serves all the channels of the client round-robin, each of them
+ * may have up to CHAN_RPC_QUANTUM new RPCs received. The channel served first
+ * moves by one with every pass, so no channel is always ahead of the others.
+ * The reactor repeats the passes for as long as any channel makes progress,
+ * so all the pending RPCs are drained on a single wakeup.
+ *
+ * return: 0 - nothing happened (sleep), 1 - something happened (skip sleep)
+ */
+int np_ssh_client_netconf_rpc(struct client_struct_ssh* client) {
+	struct chan_struct* chan, *first;
+	int skip_sleep = 0;
 
-			if ((ntf_config = malloc(sizeof(struct ntf_thread_config))) == NULL) {
-				nc_verb_error("%s: memory allocation failed", __func__);
-				err = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
-				rpc_reply = nc_reply_error(err);
-				err = NULL;
-				break;
-			}
-			ntf_config->session = chan->nc_sess;
-			ntf_config->subscribe_rpc = nc_rpc_dup(rpc);
-
-			/* perform notification sending */
-			if ((pthread_create(&thread, NULL, client_notif_thread, ntf_config)) != 0) {
-				nc_reply_free(rpc_reply);
-				err = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(err, NC_ERR_PARAM_MSG, "Creating thread for sending Notifications failed.");
-				rpc_reply = nc_reply_error(err);
-				err = NULL;
-				break;
-			}
-			pthread_detach(thread);
-			break;
+	if (client->common.to_free) {
+		return 1;
+	}
 
-		default:
-			if ((rpc_reply = ncds_apply_rpc2all(chan->nc_sess, rpc, NULL)) == NULL) {
-				err = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(err, NC_ERR_PARAM_MSG, "For unknown reason no reply was returned by the library.");
-				rpc_reply = nc_reply_error(err);
-			} else if (rpc_reply == NCDS_RPC_NOT_APPLICABLE) {
-				err = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(err, NC_ERR_PARAM_MSG, "There is no device/data that could be affected.");
-				nc_reply_free(rpc_reply);
-				rpc_reply = nc_reply_error(err);
-			}
+	if ((first = client->chans_next) == NULL) {
+		first = client->ssh_chans;
+	}
+	if (first == NULL) {
+		return 0;
+	}
+	client->chans_next = first->next;
 
-			break;
-		}
+	chan = first;
+	do {
+		skip_sleep += chan_netconf_rpc(client, chan);
+		chan = (chan->next != NULL ? chan->next : client->ssh_chans);
+	} while (chan != first);
 
-		/* send reply */
-		nc_session_send_reply(chan->nc_sess, rpc, rpc_reply);
-		nc_reply_free(rpc_reply);
-		nc_rpc_free(rpc);
+	return skip_sleep;
+}
 
-		if (closing) {
-			chan->to_free = 1;
-			closing = 0;
-		}
+/*
+ * RPCs being processed count as activity and a session with an active
+ * event subscription can never be disconnected for being idle
+ */
+static int chan_idle(struct chan_struct* chan) {
+	if (chan->rpcq != NULL && (np_rpcq_pending(chan->rpcq) || np_rpcq_subscriber(chan->rpcq) != NULL)) {
+		return 0;
+	}
+	if (chan->nc_sess != NULL && ncntf_session_get_active_subscription(chan->nc_sess)) {
+		return 0;
 	}
 
-	return skip_sleep;
+	return 1;
 }
 
 /* return: 0 - nothing happened (sleep), 1 - something happened (skip sleep) */
 int np_ssh_client_transport(struct client_struct_ssh* client) {
 	struct chan_struct* chan;
-	struct timeval cur_time;
+	uint64_t cur_time;
 	int skip_sleep = 0;
 
 	/* special corner case */
 	if (quit && client->ssh_chans == NULL) {
-		client->to_free = 1;
+		client->common.to_free = 1;
 	}
 
 	/* check whether the client shouldn't be freed */
-	if (client->to_free) {
+	if (client->common.to_free) {
 		return 1;
 	}
 
-	gettimeofday(&cur_time, NULL);
+	cur_time = np_clock_ms();
 
 	/* check the client for authentication timeout and failed attempts */
 	if (!client->authenticated) {
-		if (timeval_diff(cur_time, client->conn_time) >= netopeer_options.ssh_opts->auth_timeout) {
-			if (client->username == NULL) {
+		if (cur_time - client->conn_time >= netopeer_options.ssh_opts->auth_timeout*1000ULL) {
+			if (client->common.username == NULL) {
 				nc_verb_warning("Failed to authenticate for too long, dropping a client.");
 			} else {
-				nc_verb_warning("Failed to authenticate for too long, dropping client '%s'.", client->username);
+				nc_verb_warning("Failed to authenticate for too long, dropping client '%s'.", client->common.username);
 			}
 
 			/* mark client for deletion */
-			client->to_free = 1;
+			client->common.to_free = 1;
 			return 0;
 		}
 
 		if (client->auth_attempts >= netopeer_options.ssh_opts->auth_attempts) {
-			if (client->username == NULL) {
+			if (client->common.username == NULL) {
 				nc_verb_warning("Reached the number of failed authentication attempts, dropping a client.");
 			} else {
-				nc_verb_warning("Reached the number of failed authentication attempts, dropping client '%s'.", client->username);
+				nc_verb_warning("Reached the number of failed authentication attempts, dropping client '%s'.", client->common.username);
 			}
 
-			client->to_free = 1;
+			client->common.to_free = 1;
 			return 0;
 		}
 	}
@@ -702,16 +1089,16 @@ int np_ssh_client_transport(struct client_struct_ssh* client) {
 				chan->to_free = 1;
 			}
 		} else {
-			client->to_free = 1;
+			client->common.to_free = 1;
 			return 1;
 		}
 	}
 
 	if (ssh_execute_message_callbacks(client->ssh_sess) != SSH_OK) {
-		if (client->username == NULL) {
+		if (client->common.username == NULL) {
 			nc_verb_error("Failed to receive new messages (%s), dropping a client.", ssh_get_error(client->ssh_sess));
 		} else {
-			nc_verb_error("Failed to receive new messages (%s), dropping client '%s'.", ssh_get_error(client->ssh_sess), client->username);
+			nc_verb_error("Failed to receive new messages (%s), dropping client '%s'.", ssh_get_error(client->ssh_sess), client->common.username);
 		}
 
 		if (client->ssh_chans != NULL) {
@@ -719,7 +1106,7 @@ int np_ssh_client_transport(struct client_struct_ssh* client) {
 				chan->to_free = 1;
 			}
 		} else {
-			client->to_free = 1;
+			client->common.to_free = 1;
 		}
 	}
 	if (client->new_ssh_msg) {
@@ -734,36 +1121,38 @@ int np_ssh_client_transport(struct client_struct_ssh* client) {
 
 			/* don't sleep, we may have been asked to quit */
 			skip_sleep = 1;
-			nc_verb_verbose("Freeing session for '%s'", client->username);
-			nc_session_free(chan->nc_sess);
-			chan->nc_sess = NULL;
+			nc_verb_verbose("Freeing session for '%s'", client->common.username);
+			if (chan->nc_sess != NULL) {
+				np_rpcq_free(chan->rpcq);
+				chan->rpcq = NULL;
+				np_registry_del_session(nc_session_get_id(chan->nc_sess));
+				nc_session_free(chan->nc_sess);
+				chan->nc_sess = NULL;
+			}
 
 			/* make sure the channel iteration continues correctly */
 			chan = client_free_channel(client, chan);
 			if (chan == NULL) {
 				/* last channel removed, remove client */
-				client->to_free = 1;
+				client->common.to_free = 1;
 				return skip_sleep;
 			}
 		}
 
 		/* check the channel for idle timeout */
-		if (timeval_diff(cur_time, chan->last_rpc_time) >= netopeer_options.idle_timeout) {
-			/* check for active event subscriptions, in that case we can never disconnect an idle session */
-			if (chan->nc_sess == NULL || !ncntf_session_get_active_subscription(chan->nc_sess)) {
-				nc_verb_warning("Session of client '%s' did not send/receive an RPC for too long, disconnecting.", client->username);
-				chan->to_free = 1;
-			}
+		if (chan_idle(chan) && cur_time - chan->last_rpc_time >= netopeer_options.idle_timeout*1000ULL) {
+			nc_verb_warning("Session of client '%s' did not send/receive an RPC for too long, disconnecting.", client->common.username);
+			chan->to_free = 1;
 		}
 	}
 
 	return skip_sleep;
 }
 
-int sshcb_msg(ssh_session session, ssh_message msg, void* UNUSED(data)) {
+int sshcb_msg(ssh_session UNUSED(session), ssh_message msg, void* data) {
 	const char* str_type, *str_subtype = NULL, *username;
 	int subtype, type;
-	struct client_struct_ssh* client;
+	struct client_struct_ssh* client = (struct client_struct_ssh*)data;
 	struct chan_struct* channel = NULL;
 
 	type = ssh_message_type(msg);
@@ -882,7 +1271,7 @@ int sshcb_msg(ssh_session session, ssh_message msg, void* UNUSED(data)) {
 
 	nc_verb_verbose("Received an SSH message \"%s\" of subtype \"%s\".", str_type, str_subtype);
 
-	if ((client = client_find_by_sshsession(netopeer_state.clients, session)) == NULL) {
+	if (client == NULL) {
 		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
 		return 1;
 	}
@@ -901,7 +1290,7 @@ int sshcb_msg(ssh_session session, ssh_message msg, void* UNUSED(data)) {
 	 */
 	if (type == SSH_REQUEST_AUTH) {
 		if (client->authenticated) {
-			nc_verb_warning("User '%s' authenticated, but requested another authentication.", client->username);
+			nc_verb_warning("User '%s' authenticated, but requested another authentication.", client->common.username);
 			ssh_message_reply_default(msg);
 			return 0;
 		}
@@ -914,21 +1303,32 @@ int sshcb_msg(ssh_session session, ssh_message msg, void* UNUSED(data)) {
 
 		/* save the username, do not let the client change it */
 		username = ssh_message_auth_user(msg);
-		if (client->username == NULL) {
+		if (client->common.username == NULL) {
 			if (username == NULL) {
 				nc_verb_error("Denying an auth request without a username.");
 				return 1;
 			}
 
-			client->username = strdup(username);
+			client->common.username = strdup(username);
 		} else if (username != NULL) {
-			if (strcmp(username, client->username) != 0) {
-				nc_verb_error("User '%s' changed its username to '%s', disconnecting.", client->username, username);
-				client->to_free = 1;
+			if (strcmp(username, client->common.username) != 0) {
+				nc_verb_error("User '%s' changed its username to '%s', disconnecting.", client->common.username, username);
+				client->common.to_free = 1;
 				return 1;
 			}
 		}
 
+		/* public key probes carry no signature and are not real attempts */
+		if ((subtype == SSH_AUTH_METHOD_PASSWORD || subtype == SSH_AUTH_METHOD_INTERACTIVE
+				|| (subtype == SSH_AUTH_METHOD_PUBLICKEY && ssh_message_auth_publickey_state(msg) != SSH_PUBLICKEY_STATE_NONE))
+				&& np_ratelimit_auth(client->common.username) != EXIT_SUCCESS) {
+			nc_verb_verbose("Too many authentication attempts for '%s', denying.", client->common.username);
+			np_stat_inc(NP_STAT_LIMITED_AUTH);
+			++client->auth_attempts;
+			ssh_message_reply_default(msg);
+			return 0;
+		}
+
 		if (subtype == SSH_AUTH_METHOD_NONE) {
 			/* libssh will return the supported auth methods */
 			return 1;
@@ -1015,35 +1415,98 @@ ssh_bind np_ssh_server_id_check(ssh_bind sshbind) {
 	return ret;
 }
 
-int np_ssh_session_count(void) {
-	struct client_struct_ssh* client;
-	struct chan_struct* chan;
-	int count = 0;
+/*
+ * The algorithms negotiated by the finished key exchanges, counted for
+ * netopeer-state. There are only a few of them, the table never shrinks.
+ */
+struct ssh_algo_stat {
+	const char* type;
+	char* name;
+	uint64_t sessions;
+};
 
-	for (client = (struct client_struct_ssh*)netopeer_state.clients; client != NULL; client = (struct client_struct_ssh*)client->next) {
-		if (client->transport != NC_TRANSPORT_SSH) {
-			continue;
-		}
+static struct ssh_algo_stat ssh_algo_stats[SSH_ALGO_STATS_SIZE];
+static unsigned int ssh_algo_stat_count = 0;
+static pthread_mutex_t ssh_algo_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
-		if (client->ssh_chans == NULL) {
-			/* count this client as one soon-to-be valid session */
-			++count;
-		}
-		for (chan = client->ssh_chans; chan != NULL; chan = chan->next) {
-			/* count every channel, we rather include some invalid ones than
-			 * exclude some soon-to-be valid, which could cause more sessions
-			 * to be allowed than max_sessions
-			 */
-			++count;
+static void ssh_algo_stat_add(const char* type, const char* name) {
+	unsigned int i;
+
+	if (name == NULL) {
+		return;
+	}
+
+	/* ALGO STATS LOCK */
+	pthread_mutex_lock(&ssh_algo_stats_lock);
+	for (i = 0; i < ssh_algo_stat_count; ++i) {
+		if (ssh_algo_stats[i].type == type && strcmp(ssh_algo_stats[i].name, name) == 0) {
+			break;
 		}
 	}
+	if (i == ssh_algo_stat_count && i < SSH_ALGO_STATS_SIZE && (ssh_algo_stats[i].name = strdup(name)) != NULL) {
+		ssh_algo_stats[i].type = type;
+		++ssh_algo_stat_count;
+	}
+	if (i < ssh_algo_stat_count) {
+		++ssh_algo_stats[i].sessions;
+	}
+	/* ALGO STATS UNLOCK */
+	pthread_mutex_unlock(&ssh_algo_stats_lock);
+}
+
+const char* np_ssh_algo_stat_get(unsigned int idx, const char** name, uint64_t* sessions) {
+	const char* type = NULL;
 
-	return count;
+	/* ALGO STATS LOCK */
+	pthread_mutex_lock(&ssh_algo_stats_lock);
+	if (idx < ssh_algo_stat_count) {
+		/* the entries are never changed once added, only counted */
+		type = ssh_algo_stats[idx].type;
+		*name = ssh_algo_stats[idx].name;
+		*sessions = ssh_algo_stats[idx].sessions;
+	}
+	/* ALGO STATS UNLOCK */
+	pthread_mutex_unlock(&ssh_algo_stats_lock);
+
+	return type;
 }
 
-int np_ssh_create_client(struct client_struct_ssh* new_client, ssh_bind sshbind) {
-	int ret;
+/* the algorithms are set on the session, the bind of libssh 0.6 has no such options */
+static void ssh_session_algorithms(ssh_session session) {
+	struct np_options_ssh* opts = netopeer_options.ssh_opts;
+	const char* compression;
+	int level;
+
+	/* ALGORITHMS LOCK */
+	pthread_mutex_lock(&opts->algorithms_lock);
 
+	if (opts->ciphers != NULL && (ssh_options_set(session, SSH_OPTIONS_CIPHERS_C_S, opts->ciphers) != SSH_OK
+			|| ssh_options_set(session, SSH_OPTIONS_CIPHERS_S_C, opts->ciphers) != SSH_OK)) {
+		nc_verb_warning("Failed to set the SSH ciphers (%s).", ssh_get_error(session));
+	}
+	if (opts->macs != NULL && (ssh_options_set(session, SSH_OPTIONS_HMAC_C_S, opts->macs) != SSH_OK
+			|| ssh_options_set(session, SSH_OPTIONS_HMAC_S_C, opts->macs) != SSH_OK)) {
+		nc_verb_warning("Failed to set the SSH MACs (%s).", ssh_get_error(session));
+	}
+	if (opts->key_exchange != NULL && ssh_options_set(session, SSH_OPTIONS_KEY_EXCHANGE, opts->key_exchange) != SSH_OK) {
+		nc_verb_warning("Failed to set the SSH key exchange algorithms (%s).", ssh_get_error(session));
+	}
+
+	/* the clients not wanting compression are still fine */
+	compression = (opts->compression ? "zlib@openssh.com,zlib,none" : "none");
+	level = opts->compression_level;
+	if (ssh_options_set(session, SSH_OPTIONS_COMPRESSION_C_S, compression) != SSH_OK
+			|| ssh_options_set(session, SSH_OPTIONS_COMPRESSION_S_C, compression) != SSH_OK) {
+		nc_verb_warning("Failed to set the SSH compression (%s).", ssh_get_error(session));
+	} else if (opts->compression) {
+		ssh_options_set(session, SSH_OPTIONS_COMPRESSION_LEVEL, &level);
+	}
+
+	/* ALGORITHMS UNLOCK */
+	pthread_mutex_unlock(&opts->algorithms_lock);
+}
+
+int np_ssh_create_client(struct client_struct_ssh* new_client, ssh_bind sshbind) {
 	new_client->ssh_sess = ssh_new();
 	if (new_client->ssh_sess == NULL) {
 		nc_verb_error("%s: ssh error: failed to allocate a new SSH session (%s:%d)", __func__, __FILE__, __LINE__);
@@ -1056,28 +1519,89 @@ int np_ssh_create_client(struct client_struct_ssh* new_client, ssh_bind sshbind)
 		ssh_set_auth_methods(new_client->ssh_sess, SSH_AUTH_METHOD_PUBLICKEY | SSH_AUTH_METHOD_INTERACTIVE);
 	}
 
-	ssh_set_message_callback(new_client->ssh_sess, sshcb_msg, NULL);
+	/* the client is passed to every callback, no need to look it up */
+	ssh_set_message_callback(new_client->ssh_sess, sshcb_msg, new_client);
 
-	if (ssh_bind_accept_fd(sshbind, new_client->ssh_sess, new_client->sock) == SSH_ERROR) {
+	if (ssh_bind_accept_fd(sshbind, new_client->ssh_sess, new_client->common.sock) == SSH_ERROR) {
 		nc_verb_error("%s: SSH failed to accept a new connection: %s", __func__, ssh_get_error(sshbind));
 		return 1;
 	}
 
-	gettimeofday((struct timeval*)&new_client->conn_time, NULL);
+	/* used once the key exchange starts */
+	ssh_session_algorithms(new_client->ssh_sess);
 
-	while ((ret = ssh_handle_key_exchange(new_client->ssh_sess)) == SSH_AGAIN) {
-		usleep(READ_SLEEP * 2);
-	}
-	if (ret != SSH_OK) {
-		nc_verb_error("%s: SSH key exchange error (%s:%d): %s", __func__, __FILE__, __LINE__, ssh_get_error(new_client->ssh_sess));
-		return 1;
-	}
+	new_client->conn_time = np_clock_ms();
 
+	/* the key exchange is performed by a worker in np_ssh_client_handshake() */
 	ssh_set_blocking(new_client->ssh_sess, 0);
 
 	return 0;
 }
 
+int np_ssh_client_handshake(struct client_struct_ssh* client) {
+	int ret;
+
+	ret = ssh_handle_key_exchange(client->ssh_sess);
+	if (ret == SSH_OK) {
+		np_stat_inc(NP_STAT_HANDSHAKES);
+		ssh_algo_stat_add("cipher", ssh_get_cipher_out(client->ssh_sess));
+		ssh_algo_stat_add("mac", ssh_get_hmac_out(client->ssh_sess));
+		ssh_algo_stat_add("key-exchange", ssh_get_kex_algo(client->ssh_sess));
+		return 1;
+	}
+
+	if (ret == SSH_AGAIN) {
+		if (np_clock_ms() - client->conn_time < netopeer_options.handshake_timeout*1000ULL) {
+			return 0;
+		}
+
+		nc_verb_warning("SSH key exchange not finished in %u seconds, dropping a client.", netopeer_options.handshake_timeout);
+		np_stat_inc(NP_STAT_HANDSHAKE_TIMEOUTS);
+	} else {
+		nc_verb_error("%s: SSH key exchange error (%s:%d): %s", __func__, __FILE__, __LINE__, ssh_get_error(client->ssh_sess));
+	}
+
+	np_stat_inc(NP_STAT_HANDSHAKE_FAILURES);
+	return -1;
+}
+
+uint64_t np_ssh_client_deadline(struct client_struct_ssh* client) {
+	struct chan_struct* chan;
+	uint64_t deadline, ret = 0;
+
+	if (!client->common.handshake_done) {
+		return client->conn_time + netopeer_options.handshake_timeout*1000ULL;
+	}
+
+	if (!client->authenticated) {
+		ret = client->conn_time + netopeer_options.ssh_opts->auth_timeout*1000ULL;
+	}
+
+	for (chan = client->ssh_chans; chan != NULL; chan = chan->next) {
+		if (chan->to_free || !chan_idle(chan)) {
+			continue;
+		}
+		deadline = chan->last_rpc_time + netopeer_options.idle_timeout*1000ULL;
+		if (ret == 0 || deadline < ret) {
+			ret = deadline;
+		}
+	}
+
+	return ret;
+}
+
 void np_ssh_cleanup(void) {
-	/* nothing to do here, libssh finalize is called by libnetconf */
+	unsigned int i;
+
+	np_ssh_auth_keys_clear();
+	auth_shadow_cache_clear();
+
+	for (i = 0; i < ssh_algo_stat_count; ++i) {
+		free(ssh_algo_stats[i].name);
+	}
+	ssh_algo_stat_count = 0;
+
+	/* libssh finalize is called by libnetconf */
+	np_pool_cleanup(&chan_pool);
+	np_pool_cleanup(&client_pool);
 }
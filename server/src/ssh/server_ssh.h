@@ -43,31 +43,38 @@
 #include <libssh/callbacks.h>
 #include <libssh/server.h>
 
+#include "../ratelimit.h"
+#include "../stream.h"
+
 /* for each SSH channel of each SSH session */
 struct chan_struct {
 	ssh_channel ssh_chan;
 	int netconf_subsystem;
 	struct nc_session* nc_sess;
-	volatile struct timeval last_rpc_time;	// timestamp of the last RPC either in or out
-	volatile int to_free;		// is this channel valid?
+	struct np_rpcq* rpcq;		// RPCs of nc_sess being processed
+	struct np_bucket rpc_bucket;	// RPC rate limit of nc_sess
+	struct np_stream* stream;		// reply being written, see stream.c
 	struct chan_struct* next;
+	struct chan_struct* index_next;	// next channel in the same bucket of the client channel index
+
+	/* written also by the threads not owning the client, in a separate cache line */
+	volatile uint64_t last_rpc_time __attribute__((aligned(CACHELINE_SIZE)));	// np_clock_ms() of the last RPC either in or out
+	volatile int to_free;		// is this channel valid?
 };
 
 /* for each client */
 struct client_struct_ssh {
-	NC_TRANSPORT transport;
-
-	int sock;
-	struct sockaddr_storage saddr;
-	pthread_t tid;
-	char* username;
-	volatile int to_free;
-	struct client_struct* next;
+	struct client_struct common;	// must be the first member
 
-	volatile struct timeval conn_time;	// timestamp of the new connection
+	volatile uint64_t conn_time;		// np_clock_ms() of the new connection
 	int auth_attempts;					// number of failed auth attempts
 	int authenticated;
 	struct chan_struct* ssh_chans;
+	struct chan_struct* ssh_chans_tail;	// the channels are appended
+	struct chan_struct* chans_next;		// channel served first in the next pass, see np_ssh_client_netconf_rpc()
+	struct chan_struct** chan_index;	// channels hashed by their libssh channel
+	unsigned int chan_index_size;		// power of 2
+	unsigned int chan_count;
 	ssh_session ssh_sess;
 	int new_ssh_msg;
 };
@@ -85,14 +92,22 @@ void np_ssh_init(void);
 
 ssh_bind np_ssh_server_id_check(ssh_bind sshbind);
 
-int np_ssh_session_count(void);
+void np_ssh_auth_keys_check(void);
 
-int np_ssh_kill_session(const char* sid, struct client_struct_ssh* cur_client);
+void np_ssh_auth_keys_clear(void);
 
 int np_ssh_create_client(struct client_struct_ssh* new_client, ssh_bind sshbind);
 
+int np_ssh_client_handshake(struct client_struct_ssh* client);
+
+uint64_t np_ssh_client_deadline(struct client_struct_ssh* client);
+
+const char* np_ssh_algo_stat_get(unsigned int idx, const char** name, uint64_t* sessions);
+
 void np_ssh_cleanup(void);
 
+struct client_struct* np_ssh_client_new(void);
+
 void client_free_ssh(struct client_struct_ssh* client);
 
 #endif /* _SERVER_SSH_H_ */
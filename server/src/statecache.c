@@ -0,0 +1,82 @@
+/**
+ * @file statecache.c
+ * @author agent <agent@local>
+ * @brief Netopeer server cache of the state data replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include <libnetconf.h>
+
+#include "server.h"
+#include "replycache.h"
+#include "statecache.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+extern struct np_options netopeer_options;
+
+/*
+ * All the get RPCs with the same content from the same user within
+ * state-cache/ttl share a single read of the datastores, which usually
+ * means calling the get_state_data() of every module. Any RPC that can
+ * modify the datastores drops the cache.
+ *
+ * The replies are kept per user, not per the set of its NACM groups,
+ * because libnetconf applies NACM inside the read and does not say which
+ * of the groups and rules shaped the reply. The recovery session bypasses
+ * NACM completely, for example. So the coalescing works among the polls
+ * of the same manager, not across the managers of different users.
+ */
+static struct np_replycache cache = NP_REPLYCACHE_INITIALIZER(STATE_CACHE_SIZE, &netopeer_options.state_cache_ttl,
+		NP_STAT_STATE_CACHE_HITS, NP_STAT_STATE_CACHE_MISSES);
+
+nc_reply* np_statecache_lookup(const char* user, const nc_rpc* rpc, struct np_replycache_entry** entry) {
+	return np_replycache_lookup(&cache, user, rpc, entry);
+}
+
+void np_statecache_store(struct np_replycache_entry* entry, const nc_reply* reply) {
+	np_replycache_store(&cache, entry, reply);
+}
+
+void np_statecache_invalidate(void) {
+	np_replycache_invalidate(&cache);
+}
+
+void np_statecache_cleanup(void) {
+	np_replycache_invalidate(&cache);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file statecache.h
+ * @author agent <agent@local>
+ * @brief Netopeer server cache of the state data replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _STATECACHE_H_
+#define _STATECACHE_H_
+
+#include <libnetconf.h>
+
+#include "replycache.h"
+
+/**
+ * @brief Look up a cached reply to a get RPC. If there is none, the caller
+ * is expected to read it and pass it to np_statecache_store(), the others
+ * asking for the same data wait for it meanwhile.
+ *
+ * @param user User of the session, the replies depend on its access rights
+ * @param rpc get RPC
+ * @param[out] entry Set to the entry to store the reply into, NULL if the reply
+ * is not to be stored
+ *
+ * @return Copy of the cached reply, NULL if it must be read
+ */
+nc_reply* np_statecache_lookup(const char* user, const nc_rpc* rpc, struct np_replycache_entry** entry);
+
+/**
+ * @brief Store a reply read after an unsuccessful lookup and wake the ones
+ * waiting for it, the error replies are not stored
+ *
+ * @param entry Entry returned by np_statecache_lookup(), can be NULL
+ * @param reply Reply read from the datastores, it is not freed
+ */
+void np_statecache_store(struct np_replycache_entry* entry, const nc_reply* reply);
+
+/**
+ * @brief Drop all the cached replies, called whenever the datastores could change
+ */
+void np_statecache_invalidate(void);
+
+/**
+ * @brief Free the cache, no lookups must be in progress
+ */
+void np_statecache_cleanup(void);
+
+#endif /* _STATECACHE_H_ */
@@ -0,0 +1,371 @@
+/**
+ * @file stats.c
+ * @author agent <agent@local>
+ * @brief Netopeer server statistics
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+#include "server.h"
+#include "stats.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+extern struct np_state netopeer_state;
+
+static const struct {
+	NC_OP op;
+	const char* name;
+} rpc_ops[] = {
+	{NC_OP_GET, "get"},
+	{NC_OP_GETCONFIG, "get-config"},
+	{NC_OP_EDITCONFIG, "edit-config"},
+	{NC_OP_COPYCONFIG, "copy-config"},
+	{NC_OP_DELETECONFIG, "delete-config"},
+	{NC_OP_LOCK, "lock"},
+	{NC_OP_UNLOCK, "unlock"},
+	{NC_OP_CLOSESESSION, "close-session"},
+	{NC_OP_KILLSESSION, "kill-session"},
+	{NC_OP_COMMIT, "commit"},
+	{NC_OP_DISCARDCHANGES, "discard-changes"},
+	{NC_OP_VALIDATE, "validate"},
+	{NC_OP_GETSCHEMA, "get-schema"},
+	{NC_OP_CREATESUBSCRIPTION, "create-subscription"},
+	/* everything else, must be the last one */
+	{NC_OP_UNKNOWN, "other"}
+};
+#define RPC_OPS (sizeof(rpc_ops) / sizeof(rpc_ops[0]))
+
+/*
+ * Every thread counts into its own slab, so there is never any contention
+ * on the counters. Readers sum all the slabs, the slab of a finished thread
+ * is added into the retired one.
+ */
+struct stat_slab {
+	uint64_t counters[NP_STAT_COUNT];
+	uint64_t rpc_latency[RPC_OPS][NP_STAT_LATENCY_BUCKETS];
+	uint64_t rpc_max[RPC_OPS];
+	uint64_t traffic_in;
+	uint64_t traffic_out;
+	struct stat_slab* next;
+};
+
+static __thread struct stat_slab* thread_slab;
+static pthread_key_t slab_key;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+
+/* locked when adding or removing slabs and when reading them */
+static pthread_mutex_t slabs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stat_slab* slabs;
+static struct stat_slab retired;
+
+/* ring of past counter values, the oldest sample is at samples_next */
+static pthread_mutex_t samples_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t samples[NP_STAT_RATE_SAMPLES][NP_STAT_COUNT];
+static unsigned int samples_next;
+static unsigned int samples_count;
+
+static inline void stat_add(uint64_t* counter, uint64_t value) {
+	__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stat_load(const uint64_t* counter) {
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64_t* counter, uint64_t value) {
+	uint64_t cur = stat_load(counter);
+
+	while (cur < value && !__atomic_compare_exchange_n(counter, &cur, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* SLABS LOCK must be held */
+static void slab_merge(struct stat_slab* dst, const struct stat_slab* src) {
+	unsigned int i, j;
+
+	for (i = 0; i < NP_STAT_COUNT; ++i) {
+		stat_add(&dst->counters[i], stat_load(&src->counters[i]));
+	}
+	for (i = 0; i < RPC_OPS; ++i) {
+		for (j = 0; j < NP_STAT_LATENCY_BUCKETS; ++j) {
+			stat_add(&dst->rpc_latency[i][j], stat_load(&src->rpc_latency[i][j]));
+		}
+		stat_max(&dst->rpc_max[i], stat_load(&src->rpc_max[i]));
+	}
+	stat_add(&dst->traffic_in, stat_load(&src->traffic_in));
+	stat_add(&dst->traffic_out, stat_load(&src->traffic_out));
+}
+
+static void slab_destroy(void* arg) {
+	struct stat_slab* slab = (struct stat_slab*)arg, *cur, *prev = NULL;
+
+	/* SLABS LOCK */
+	pthread_mutex_lock(&slabs_lock);
+	for (cur = slabs; cur != NULL && cur != slab; prev = cur, cur = cur->next);
+	if (cur != NULL) {
+		if (prev == NULL) {
+			slabs = cur->next;
+		} else {
+			prev->next = cur->next;
+		}
+	}
+	slab_merge(&retired, slab);
+	/* SLABS UNLOCK */
+	pthread_mutex_unlock(&slabs_lock);
+
+	free(slab);
+}
+
+static void slab_key_create(void) {
+	if (pthread_key_create(&slab_key, slab_destroy) != 0) {
+		nc_verb_error("%s: failed to create a thread-specific key", __func__);
+	}
+}
+
+static struct stat_slab* slab_get(void) {
+	struct stat_slab* slab;
+
+	if (thread_slab != NULL) {
+		return thread_slab;
+	}
+
+	pthread_once(&slab_once, slab_key_create);
+	slab = calloc(1, sizeof(struct stat_slab));
+	if (slab == NULL || pthread_setspecific(slab_key, slab) != 0) {
+		/* the counting is atomic, so sharing the retired slab is only slower */
+		free(slab);
+		return &retired;
+	}
+
+	/* SLABS LOCK */
+	pthread_mutex_lock(&slabs_lock);
+	slab->next = slabs;
+	slabs = slab;
+	/* SLABS UNLOCK */
+	pthread_mutex_unlock(&slabs_lock);
+
+	thread_slab = slab;
+	return slab;
+}
+
+void np_stat_inc(enum np_stat stat) {
+	stat_add(&slab_get()->counters[stat], 1);
+}
+
+void np_stat_add(enum np_stat stat, uint64_t count) {
+	stat_add(&slab_get()->counters[stat], count);
+}
+
+uint64_t np_stat_get(enum np_stat stat) {
+	struct stat_slab* slab;
+	uint64_t value;
+
+	/* SLABS LOCK */
+	pthread_mutex_lock(&slabs_lock);
+	value = stat_load(&retired.counters[stat]);
+	for (slab = slabs; slab != NULL; slab = slab->next) {
+		value += stat_load(&slab->counters[stat]);
+	}
+	/* SLABS UNLOCK */
+	pthread_mutex_unlock(&slabs_lock);
+
+	return value;
+}
+double np_stat_rate(enum np_stat stat) {
+	uint64_t oldest;
+	unsigned int count;
+
+	/* STATS LOCK */
+	pthread_mutex_lock(&samples_lock);
+	count = samples_count;
+	if (count == 0) {
+		/* STATS UNLOCK */
+		pthread_mutex_unlock(&samples_lock);
+		return 0;
+	}
+	if (count < NP_STAT_RATE_SAMPLES) {
+		oldest = samples[0][stat];
+	} else {
+		oldest = samples[samples_next][stat];
+	}
+	/* STATS UNLOCK */
+	pthread_mutex_unlock(&samples_lock);
+
+	return (double)(np_stat_get(stat) - oldest) / (count * STATS_SAMPLE_INTERVAL);
+}
+
+void np_stats_sample(void) {
+	int i;
+
+	/* STATS LOCK */
+	pthread_mutex_lock(&samples_lock);
+	for (i = 0; i < NP_STAT_COUNT; ++i) {
+		samples[samples_next][i] = np_stat_get(i);
+	}
+	samples_next = (samples_next + 1) % NP_STAT_RATE_SAMPLES;
+	if (samples_count < NP_STAT_RATE_SAMPLES) {
+		++samples_count;
+	}
+	/* STATS UNLOCK */
+	pthread_mutex_unlock(&samples_lock);
+}
+
+void np_stat_rpc(NC_OP op, uint64_t usec) {
+	struct stat_slab* slab = slab_get();
+	unsigned int i, bucket;
+
+	for (i = 0; i < RPC_OPS - 1 && rpc_ops[i].op != op; ++i);
+
+	for (bucket = 0; bucket < NP_STAT_LATENCY_BUCKETS - 1 && (usec >> (bucket + 1)) != 0; ++bucket);
+
+	stat_add(&slab->rpc_latency[i][bucket], 1);
+	stat_max(&slab->rpc_max[i], usec);
+}
+
+/* upper bound of the bucket with the requested fraction of the durations */
+static uint64_t latency_percentile(const uint64_t* buckets, uint64_t count, unsigned int percent, uint64_t max) {
+	uint64_t sum = 0, limit;
+	unsigned int i;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	limit = (count * percent + 99) / 100;
+	for (i = 0; i < NP_STAT_LATENCY_BUCKETS; ++i) {
+		sum += buckets[i];
+		if (sum >= limit) {
+			break;
+		}
+	}
+
+	if (i >= 63 || (UINT64_C(1) << (i + 1)) > max) {
+		return max;
+	}
+	return UINT64_C(1) << (i + 1);
+}
+
+const char* np_stat_rpc_get(unsigned int idx, struct np_stat_rpc* rpc) {
+	uint64_t buckets[NP_STAT_LATENCY_BUCKETS] = {0};
+	struct stat_slab* slab;
+	unsigned int i;
+
+	if (idx >= RPC_OPS) {
+		return NULL;
+	}
+
+	rpc->max = stat_load(&retired.rpc_max[idx]);
+	for (i = 0; i < NP_STAT_LATENCY_BUCKETS; ++i) {
+		buckets[i] = stat_load(&retired.rpc_latency[idx][i]);
+	}
+
+	/* SLABS LOCK */
+	pthread_mutex_lock(&slabs_lock);
+	for (slab = slabs; slab != NULL; slab = slab->next) {
+		for (i = 0; i < NP_STAT_LATENCY_BUCKETS; ++i) {
+			buckets[i] += stat_load(&slab->rpc_latency[idx][i]);
+		}
+		if (stat_load(&slab->rpc_max[idx]) > rpc->max) {
+			rpc->max = stat_load(&slab->rpc_max[idx]);
+		}
+	}
+	/* SLABS UNLOCK */
+	pthread_mutex_unlock(&slabs_lock);
+
+	rpc->count = 0;
+	for (i = 0; i < NP_STAT_LATENCY_BUCKETS; ++i) {
+		rpc->count += buckets[i];
+	}
+	rpc->p50 = latency_percentile(buckets, rpc->count, 50, rpc->max);
+	rpc->p99 = latency_percentile(buckets, rpc->count, 99, rpc->max);
+
+	return rpc_ops[idx].name;
+}
+
+/* bytes received and acknowledged on a TCP socket, other sockets are not counted */
+static void sock_traffic(int sock, uint64_t* in, uint64_t* out) {
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+
+	if (sock < 0 || getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 || len < sizeof(info)) {
+		return;
+	}
+
+	*in += info.tcpi_bytes_received;
+	*out += info.tcpi_bytes_acked;
+}
+
+void np_stats_client_removed(const struct client_struct* client) {
+	struct stat_slab* slab = slab_get();
+	uint64_t in = 0, out = 0;
+
+	sock_traffic(client->sock, &in, &out);
+	stat_add(&slab->traffic_in, in);
+	stat_add(&slab->traffic_out, out);
+}
+
+void np_stats_traffic(uint64_t* in, uint64_t* out) {
+	struct client_struct* client;
+	struct stat_slab* slab;
+
+	*in = 0;
+	*out = 0;
+
+	/* GLOBAL LOCK */
+	pthread_mutex_lock(&netopeer_state.global_lock);
+
+	for (client = netopeer_state.clients; client != NULL; client = client->next) {
+		sock_traffic(client->sock, in, out);
+	}
+
+	/* SLABS LOCK */
+	pthread_mutex_lock(&slabs_lock);
+	*in += stat_load(&retired.traffic_in);
+	*out += stat_load(&retired.traffic_out);
+	for (slab = slabs; slab != NULL; slab = slab->next) {
+		*in += stat_load(&slab->traffic_in);
+		*out += stat_load(&slab->traffic_out);
+	}
+	/* SLABS UNLOCK */
+	pthread_mutex_unlock(&slabs_lock);
+
+	/* GLOBAL UNLOCK */
+	pthread_mutex_unlock(&netopeer_state.global_lock);
+}
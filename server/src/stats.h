@@ -0,0 +1,160 @@
+/**
+ * @file stats.h
+ * @author agent <agent@local>
+ * @brief Netopeer server statistics header
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <libnetconf.h>
+
+struct client_struct;
+
+enum np_stat {
+	NP_STAT_ACCEPTS,				/**< accepted connections */
+	NP_STAT_HANDSHAKES,				/**< finished SSH key exchanges and TLS handshakes */
+	NP_STAT_HANDSHAKE_FAILURES,		/**< failed SSH key exchanges and TLS handshakes */
+	NP_STAT_HANDSHAKE_TIMEOUTS,		/**< handshakes not finished in handshake-timeout */
+	NP_STAT_AUTH_FAILURES,			/**< failed SSH authentication attempts and rejected TLS client certificates */
+	NP_STAT_NOTIF_DROPPED,			/**< notifications dropped from full subscriber queues */
+	NP_STAT_LIMITED_CONNECTIONS,	/**< connections reset because of rate-limits or max-sessions */
+	NP_STAT_LIMITED_AUTH,			/**< authentication attempts refused because of rate-limits */
+	NP_STAT_LIMITED_RPCS,			/**< RPCs denied because of rate-limits */
+	NP_STAT_STATE_CACHE_HITS,		/**< get RPCs replied from the state cache */
+	NP_STAT_STATE_CACHE_MISSES,		/**< get RPCs read from the datastores while the state cache was on */
+	NP_STAT_SNAPSHOT_HITS,			/**< get-config RPCs replied from a configuration snapshot */
+	NP_STAT_SNAPSHOT_MISSES,		/**< get-config RPCs read from the datastores */
+	NP_STAT_NACM_CACHE_HITS,		/**< NACM notification checks answered from the cache */
+	NP_STAT_NACM_CACHE_MISSES,		/**< NACM notification checks evaluated by libnetconf */
+	NP_STAT_TLS_FULL_HANDSHAKES,	/**< finished TLS handshakes with a new session */
+	NP_STAT_TLS_RESUMED_HANDSHAKES,	/**< finished TLS handshakes resuming a cached session or a ticket */
+	NP_STAT_LOG_DROPPED,			/**< log messages dropped from full asynchronous logging rings */
+	NP_STAT_LOG_SUPPRESSED,			/**< repeated log messages not written out */
+	NP_STAT_MEM_DENIED,				/**< RPCs and replies refused with resource-denied by the memory budgets */
+	NP_STAT_COUNT
+};
+
+/* number of STATS_SAMPLE_INTERVAL samples the rates are averaged over */
+#define NP_STAT_RATE_SAMPLES 60
+
+/* latency histogram buckets, bucket i counts durations below 2^(i+1) microseconds */
+#define NP_STAT_LATENCY_BUCKETS 32
+
+/* statistics of a single RPC operation */
+struct np_stat_rpc {
+	uint64_t count;
+	uint64_t p50;		/**< median latency in microseconds */
+	uint64_t p99;		/**< 99th percentile latency in microseconds */
+	uint64_t max;		/**< maximum latency in microseconds */
+};
+
+/**
+ * @brief Increase a counter, can be called from any thread
+ *
+ * @param stat Counter to increase
+ */
+void np_stat_inc(enum np_stat stat);
+
+/**
+ * @brief Increase a counter by more events at once, can be called from any thread
+ *
+ * @param stat Counter to increase
+ * @param count Number of events
+ */
+void np_stat_add(enum np_stat stat, uint64_t count);
+
+/**
+ * @brief Get the current value of a counter
+ *
+ * @param stat Counter to read
+ *
+ * @return Number of counted events since the server start
+ */
+uint64_t np_stat_get(enum np_stat stat);
+
+/**
+ * @brief Get the average number of events per second of a counter
+ * over the last NP_STAT_RATE_SAMPLES samples
+ *
+ * @param stat Counter to read
+ *
+ * @return Events per second
+ */
+double np_stat_rate(enum np_stat stat);
+
+/**
+ * @brief Take a new sample of all the counters for the rates,
+ * called once every STATS_SAMPLE_INTERVAL from the event loop
+ */
+void np_stats_sample(void);
+
+/**
+ * @brief Count an executed RPC, can be called from any thread
+ *
+ * @param op Operation of the RPC
+ * @param usec Execution time in microseconds
+ */
+void np_stat_rpc(NC_OP op, uint64_t usec);
+
+/**
+ * @brief Get the statistics of an RPC operation
+ *
+ * @param idx Index of the operation, starting from 0
+ * @param rpc Statistics of the operation
+ *
+ * @return Name of the operation, NULL if idx is past the last one
+ */
+const char* np_stat_rpc_get(unsigned int idx, struct np_stat_rpc* rpc);
+
+/**
+ * @brief Account the traffic of a client being removed,
+ * must be called with the GLOBAL LOCK held before it is detached
+ *
+ * @param client Client to be removed
+ */
+void np_stats_client_removed(const struct client_struct* client);
+
+/**
+ * @brief Get the number of bytes received and sent by all the clients,
+ * the current ones and those already gone
+ *
+ * @param in Received bytes
+ * @param out Sent and acknowledged bytes
+ */
+void np_stats_traffic(uint64_t* in, uint64_t* out);
+
+#endif /* _STATS_H_ */
@@ -0,0 +1,274 @@
+/**
+ * @file stream.c
+ * @author agent <agent@local>
+ * @brief Netopeer server streaming of large replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetconf_xml.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "server.h"
+#include "memacct.h"
+#include "stream.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/*
+ * libnetconf dumps the whole reply into a string before writing it, on top
+ * of the document it was built from. A streamed reply keeps only its data,
+ * the reply can be freed right away, and the message is written around them
+ * in STREAM_CHUNK_SIZE frames as the transport accepts them. The frames are
+ * built one at a time, so a write that would block is retried with the same
+ * buffer as TLS requires. The replies are written past libnetconf, so they are
+ * not counted in the out-rpcs of ietf-netconf-monitoring, and they must not be
+ * streamed on a session libnetconf writes notifications to from its own thread.
+ */
+struct np_stream {
+	char* head;			// rpc-reply start tag up to data
+	char* data;
+	size_t data_len;
+	struct np_memacct* mem;
+	int chunked;		// :base:1.1 chunked framing, end-of-message otherwise
+
+	size_t pos;			// position in the whole message, head included
+	size_t len;			// length of the whole message, without the framing
+	int end_sent;		// the end of the message is in the frame
+
+	char frame[STREAM_CHUNK_SIZE + 32];
+	size_t frame_len;
+	size_t frame_off;
+};
+
+static const char stream_tail[] = "</data></rpc-reply>";
+
+/* copy a part of the message, the head, data and tail are virtually concatenated */
+static void stream_copy(const struct np_stream* stream, char* buf, size_t pos, size_t len) {
+	size_t head_len = strlen(stream->head), n;
+	const char* src;
+
+	while (len > 0) {
+		if (pos < head_len) {
+			src = stream->head + pos;
+			n = head_len - pos;
+		} else if (pos < head_len + stream->data_len) {
+			src = stream->data + (pos - head_len);
+			n = head_len + stream->data_len - pos;
+		} else {
+			src = stream_tail + (pos - head_len - stream->data_len);
+			n = stream->len - pos;
+		}
+		if (n > len) {
+			n = len;
+		}
+
+		memcpy(buf, src, n);
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+}
+
+/* build the next frame, returns 0 if the whole message is framed */
+static int stream_frame(struct np_stream* stream) {
+	size_t n;
+	int r;
+
+	stream->frame_len = 0;
+	stream->frame_off = 0;
+
+	if (stream->pos < stream->len) {
+		n = stream->len - stream->pos;
+		if (n > STREAM_CHUNK_SIZE) {
+			n = STREAM_CHUNK_SIZE;
+		}
+		if (stream->chunked) {
+			r = sprintf(stream->frame, "\n#%zu\n", n);
+			stream->frame_len = r;
+		}
+		stream_copy(stream, stream->frame + stream->frame_len, stream->pos, n);
+		stream->frame_len += n;
+		stream->pos += n;
+	} else if (!stream->end_sent) {
+		strcpy(stream->frame, (stream->chunked ? NC_V11_END_MSG : NC_V10_END_MSG));
+		stream->frame_len = strlen(stream->frame);
+		stream->end_sent = 1;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+/* append an attribute value escaped and quoted */
+static void head_add_value(xmlBufferPtr buf, xmlDocPtr doc, xmlAttrPtr attr, const xmlChar* value) {
+	xmlBufferCCat(buf, "=\"");
+	if (value != NULL) {
+		xmlAttrSerializeTxtContent(buf, doc, attr, value);
+	}
+	xmlBufferCCat(buf, "\"");
+}
+
+/*
+ * rpc-reply start tag with all the attributes of the rpc and the namespaces
+ * they need, as libnetconf builds it, the rpc is only available as a dump
+ */
+static char* stream_head(const nc_rpc* rpc) {
+	xmlDocPtr doc;
+	xmlNodePtr root;
+	xmlNsPtr ns;
+	xmlAttrPtr attr;
+	xmlBufferPtr buf;
+	xmlChar* value;
+	char* dump, *head = NULL;
+
+	if ((dump = nc_rpc_dump(rpc)) == NULL) {
+		return NULL;
+	}
+	doc = xmlReadMemory(dump, strlen(dump), NULL, NULL, XML_PARSE_NOBLANKS | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+	free(dump);
+	if (doc == NULL || (root = xmlDocGetRootElement(doc)) == NULL || (buf = xmlBufferCreate()) == NULL) {
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+
+	xmlBufferCCat(buf, "<rpc-reply xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\"");
+	for (ns = root->nsDef; ns != NULL; ns = ns->next) {
+		/* the default one is the base namespace */
+		if (ns->prefix != NULL) {
+			xmlBufferCCat(buf, " xmlns:");
+			xmlBufferCat(buf, ns->prefix);
+			head_add_value(buf, doc, NULL, ns->href);
+		}
+	}
+	for (attr = root->properties; attr != NULL; attr = attr->next) {
+		xmlBufferCCat(buf, " ");
+		if (attr->ns != NULL && attr->ns->prefix != NULL) {
+			xmlBufferCat(buf, attr->ns->prefix);
+			xmlBufferCCat(buf, ":");
+		}
+		xmlBufferCat(buf, attr->name);
+		value = xmlNodeGetContent((xmlNodePtr)attr);
+		head_add_value(buf, doc, attr, value);
+		xmlFree(value);
+	}
+	xmlBufferCCat(buf, "><data>");
+
+	head = strdup((const char*)xmlBufferContent(buf));
+	xmlBufferFree(buf);
+	xmlFreeDoc(doc);
+	return head;
+}
+
+struct np_stream* np_stream_new(struct nc_session* session, const nc_rpc* rpc, const nc_reply* reply, char* data, struct np_memacct* mem) {
+	struct np_stream* stream;
+	size_t data_len;
+
+	if (nc_reply_get_type(reply) != NC_REPLY_DATA || nc_rpc_get_msgid(rpc) == NULL) {
+		free(data);
+		return NULL;
+	}
+	if (data == NULL && (data = nc_reply_get_data(reply)) == NULL) {
+		return NULL;
+	}
+	data_len = strlen(data);
+	if (data_len < STREAM_REPLY_THRESHOLD) {
+		free(data);
+		return NULL;
+	}
+
+	if ((stream = calloc(1, sizeof(struct np_stream))) == NULL) {
+		free(data);
+		return NULL;
+	}
+	if ((stream->head = stream_head(rpc)) == NULL) {
+		free(data);
+		free(stream);
+		return NULL;
+	}
+	stream->data = data;
+	stream->data_len = data_len;
+	stream->chunked = (nc_session_get_version(session) == 1);
+	stream->len = strlen(stream->head) + data_len + strlen(stream_tail);
+	/* the data are held already, the session may be over its budget only until they are sent */
+	stream->mem = np_memacct_ref(mem);
+	np_memacct_force(stream->mem, NP_MEM_STREAMS, data_len);
+
+	stream_frame(stream);
+	return stream;
+}
+
+ssize_t np_stream_send(struct np_stream* stream, np_stream_write write, void* arg) {
+	ssize_t ret, written = 0;
+
+	while (stream->frame_off < stream->frame_len) {
+		ret = write(arg, stream->frame + stream->frame_off, stream->frame_len - stream->frame_off);
+		if (ret < 0) {
+			return -1;
+		} else if (ret == 0) {
+			break;
+		}
+
+		written += ret;
+		stream->frame_off += ret;
+		if (stream->frame_off == stream->frame_len && !stream_frame(stream)) {
+			break;
+		}
+	}
+
+	return written;
+}
+
+int np_stream_done(const struct np_stream* stream) {
+	return (stream->end_sent && stream->frame_off == stream->frame_len);
+}
+
+void np_stream_free(struct np_stream* stream) {
+	if (stream == NULL) {
+		return;
+	}
+
+	np_memacct_release(stream->mem, NP_MEM_STREAMS, stream->data_len);
+	np_memacct_unref(stream->mem);
+	free(stream->head);
+	free(stream->data);
+	free(stream);
+}
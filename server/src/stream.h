@@ -0,0 +1,101 @@
+/**
+ * @file stream.h
+ * @author agent <agent@local>
+ * @brief Netopeer server streaming of large replies
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ */
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <sys/types.h>
+#include <libnetconf.h>
+
+/* a reply being written to the transport in chunks */
+struct np_stream;
+
+struct np_memacct;
+
+/**
+ * @brief Write data to the transport without blocking
+ *
+ * @param arg Transport-specific argument
+ * @param buf Data to write
+ * @param len Length of data, it is the same when retrying a write that would block
+ *
+ * @return Number of bytes written, 0 if it would block, -1 on error
+ */
+typedef ssize_t (*np_stream_write)(void* arg, const char* buf, size_t len);
+
+/**
+ * @brief Prepare a reply for streaming, only large data replies are streamed
+ *
+ * @param session Session the reply is sent to
+ * @param rpc RPC the reply belongs to
+ * @param reply Reply, it can be freed right afterwards
+ * @param data Data of the reply dumped already, NULL to dump them here, they are freed in any case
+ * @param mem Memory accounting of the session the streamed data are accounted to, can be NULL
+ *
+ * @return New stream, NULL if the reply is to be sent by nc_session_send_reply()
+ */
+struct np_stream* np_stream_new(struct nc_session* session, const nc_rpc* rpc, const nc_reply* reply, char* data, struct np_memacct* mem);
+
+/**
+ * @brief Write as much of the reply as possible without blocking
+ *
+ * @param stream Stream to write
+ * @param write Transport write function
+ * @param arg Argument of write
+ *
+ * @return Number of bytes written, -1 on error
+ */
+ssize_t np_stream_send(struct np_stream* stream, np_stream_write write, void* arg);
+
+/**
+ * @brief Check whether the whole reply was written
+ *
+ * @param stream Stream to check
+ *
+ * @return 1 if finished, 0 otherwise
+ */
+int np_stream_done(const struct np_stream* stream);
+
+/**
+ * @brief Free a stream, finished or not
+ *
+ * @param stream Stream to free
+ */
+void np_stream_free(struct np_stream* stream);
+
+#endif /* _STREAM_H_ */
@@ -136,6 +136,7 @@ static int del_trusted_cert(struct np_trusted_cert** root, const char* cert, uin
 		tr_cert->prev->next = tr_cert->next;
 	}
 	free(tr_cert->cert);
+	X509_free(tr_cert->x509);
 	free(tr_cert);
 
 	return 0;
@@ -431,6 +432,8 @@ int callback_n_netopeer_n_tls_n_trusted_client_certs_n_trusted_client_cert(void*
 
 		if (del_trusted_cert(&netopeer_options.tls_opts->trusted_certs, content, 1) != 0) {
 			nc_verb_error("%s: inconsistent state (%s:%d)", __func__, __FILE__, __LINE__);
+		} else {
+			netopeer_options.tls_opts->trusted_clients_change_flag = 1;
 		}
 
 		/* TLS_CTX UNLOCK */
@@ -449,6 +452,7 @@ int callback_n_netopeer_n_tls_n_trusted_client_certs_n_trusted_client_cert(void*
 		pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
 
 		add_trusted_cert(&netopeer_options.tls_opts->trusted_certs, content, 1);
+		netopeer_options.tls_opts->trusted_clients_change_flag = 1;
 
 		/* TLS_CTX UNLOCK */
 		pthread_mutex_unlock(&netopeer_options.tls_opts->tls_ctx_lock);
@@ -457,6 +461,185 @@ int callback_n_netopeer_n_tls_n_trusted_client_certs_n_trusted_client_cert(void*
 	return EXIT_SUCCESS;
 }
 
+static int tls_version_set(XMLDIFF_OP op, xmlNodePtr new_node, uint16_t def_version, uint16_t* version, struct nc_err** error) {
+	char* content = NULL, *msg;
+	uint16_t value = def_version;
+
+	if (!(op & XMLDIFF_REM)) {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(content, "tls1.0") == 0) {
+			value = TLS1_VERSION;
+		} else if (strcmp(content, "tls1.1") == 0) {
+			value = TLS1_1_VERSION;
+		} else if (strcmp(content, "tls1.2") == 0) {
+			value = TLS1_2_VERSION;
+		} else if (strcmp(content, "tls1.3") == 0) {
+			value = TLS1_3_VERSION;
+		} else {
+			*error = nc_err_new(NC_ERR_INVALID_VALUE);
+			if (asprintf(&msg, "Unknown TLS version '%s'.", content) != -1) {
+				nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+				free(msg);
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* TLS_CTX LOCK */
+	pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
+	*version = value;
+	netopeer_options.tls_opts->tls_ctx_change_flag = 1;
+	/* TLS_CTX UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.tls_opts->tls_ctx_lock);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:tls/n:min-version changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_tls_n_min_version(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return tls_version_set(op, new_node, TLS1_2_VERSION, &netopeer_options.tls_opts->min_version, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:tls/n:max-version changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_tls_n_max_version(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return tls_version_set(op, new_node, TLS1_3_VERSION, &netopeer_options.tls_opts->max_version, error);
+}
+
+/* OpenSSL checks the list against the ciphers it supports, tls13 selects the TLS 1.3 ciphersuites */
+static int tls_ciphers_set(XMLDIFF_OP op, xmlNodePtr new_node, int tls13, char** value, struct nc_err** error) {
+	char* content = NULL, *msg;
+	SSL_CTX* tlsctx;
+	int ret;
+
+	if (!(op & XMLDIFF_REM)) {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+
+		if ((tlsctx = SSL_CTX_new(SSLv23_server_method())) == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: failed to create SSL context", __func__);
+			return EXIT_FAILURE;
+		}
+#ifdef NP_TLS_LEGACY
+		/* not known, applying them is skipped with a warning */
+		ret = (tls13 ? 1 : SSL_CTX_set_cipher_list(tlsctx, content));
+#else
+		ret = (tls13 ? SSL_CTX_set_ciphersuites(tlsctx, content) : SSL_CTX_set_cipher_list(tlsctx, content));
+#endif
+		SSL_CTX_free(tlsctx);
+		if (ret != 1) {
+			*error = nc_err_new(NC_ERR_INVALID_VALUE);
+			if (asprintf(&msg, "None of the ciphers '%s' is supported.", content) != -1) {
+				nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+				free(msg);
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* TLS_CTX LOCK */
+	pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
+	free(*value);
+	*value = (content == NULL ? NULL : strdup(content));
+	netopeer_options.tls_opts->tls_ctx_change_flag = 1;
+	/* TLS_CTX UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.tls_opts->tls_ctx_lock);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:tls/n:cipher-list changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_tls_n_cipher_list(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return tls_ciphers_set(op, new_node, 0, &netopeer_options.tls_opts->cipher_list, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:tls/n:ciphersuites changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_tls_n_ciphersuites(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	return tls_ciphers_set(op, new_node, 1, &netopeer_options.tls_opts->ciphersuites, error);
+}
+
+/**
+ * @brief This callback will be run when node in path /n:netopeer/n:tls/n:kernel-offload changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+int callback_n_netopeer_n_tls_n_kernel_offload(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error) {
+	char* content = NULL;
+	uint8_t ktls = 0;
+
+	if (!(op & XMLDIFF_REM)) {
+		content = get_node_content(new_node);
+		if (content == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_verb_error("%s: node content missing", __func__);
+			return EXIT_FAILURE;
+		}
+		ktls = (strcmp(content, "true") == 0);
+	}
+
+	/* TLS_CTX LOCK */
+	pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
+	netopeer_options.tls_opts->ktls = ktls;
+	netopeer_options.tls_opts->tls_ctx_change_flag = 1;
+	/* TLS_CTX UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.tls_opts->tls_ctx_lock);
+	return EXIT_SUCCESS;
+}
+
 /**
  * @brief This callback will be run when node in path /n:netopeer/n:tls/n:crl-dir changes
  *
@@ -488,6 +671,7 @@ int callback_n_netopeer_n_tls_n_crl_dir(void** UNUSED(data), XMLDIFF_OP op, xmlN
 	if (op & (XMLDIFF_MOD | XMLDIFF_ADD)) {
 		netopeer_options.tls_opts->crl_dir = strdup(content);
 	}
+	netopeer_options.tls_opts->crl_dir_change_flag = 1;
 
 	/* CRL_DIR UNLOCK */
 	pthread_mutex_unlock(&netopeer_options.tls_opts->crl_dir_lock);
@@ -568,6 +752,7 @@ callback_restart:
 	if (op & XMLDIFF_ADD) {
 		add_ctn_item(&netopeer_options.tls_opts->ctn_map, atoi(id), fingerprint, ctn_type_parse(map_type), name);
 	}
+	netopeer_options.tls_opts->ctn_map_change_flag = 1;
 
 	/* CTN_MAP UNLOCK */
 	pthread_mutex_unlock(&netopeer_options.tls_opts->ctn_map_lock);
@@ -590,6 +775,8 @@ int netopeer_transapi_init_tls(void) {
 	pthread_mutex_init(&netopeer_options.tls_opts->tls_ctx_lock, NULL);
 	pthread_mutex_init(&netopeer_options.tls_opts->crl_dir_lock, NULL);
 	pthread_mutex_init(&netopeer_options.tls_opts->ctn_map_lock, NULL);
+	netopeer_options.tls_opts->min_version = TLS1_2_VERSION;
+	netopeer_options.tls_opts->max_version = TLS1_3_VERSION;
 
 	return EXIT_SUCCESS;
 }
@@ -609,8 +796,11 @@ void netopeer_transapi_close_tls(void) {
 		del_cert = cert;
 		cert = cert->next;
 		free(del_cert->cert);
+		X509_free(del_cert->x509);
 		free(del_cert);
 	}
+	free(netopeer_options.tls_opts->cipher_list);
+	free(netopeer_options.tls_opts->ciphersuites);
 	free(netopeer_options.tls_opts->crl_dir);
 	for (item = netopeer_options.tls_opts->ctn_map; item != NULL;) {
 		del_item = item;
@@ -54,15 +54,23 @@ struct np_options_tls {
 	char* server_cert;		/* All certificates are stored in base64-encoded DER format */
 	char* server_key;
 	uint8_t server_key_type;	/* 1 - RSA, 0 - DSA */
+	uint16_t min_version;		/* TLS1_VERSION to TLS1_3_VERSION */
+	uint16_t max_version;
+	char* cipher_list;		/* up to TLS 1.2, in the OpenSSL format */
+	char* ciphersuites;		/* TLS 1.3 */
+	uint8_t ktls;			/* kernel TLS after the handshake, if supported */
 	struct np_trusted_cert {	/* Must contain the server certificate CA chain certificates! */
 		char* cert;
+		X509* x509;				/* decoded when first needed, see server_tls.c */
 		uint8_t client_cert;
 		struct np_trusted_cert* next;
 		struct np_trusted_cert* prev;
 	} *trusted_certs;
+	uint8_t trusted_clients_change_flag;	/* the trusted client certificates changed, tls_ctx_lock */
 
 	pthread_mutex_t crl_dir_lock;
 	char* crl_dir;
+	uint8_t crl_dir_change_flag;	// the CRLs are to be read again, see np_tls_crl_check()
 
 	pthread_mutex_t ctn_map_lock;
 	struct np_ctn_item {
@@ -73,6 +81,7 @@ struct np_options_tls {
 		struct np_ctn_item* next;
 		struct np_ctn_item* prev;
 	} *ctn_map;
+	uint8_t ctn_map_change_flag;	// the cert-to-name index is to be rebuilt, see np_tls_ctn_check()
 };
 
 int netopeer_transapi_init_tls(void);
@@ -85,6 +94,16 @@ int callback_n_netopeer_n_tls_n_trusted_ca_certs_n_trusted_ca_cert(void** UNUSED
 
 int callback_n_netopeer_n_tls_n_trusted_client_certs_n_trusted_client_cert(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** error);
 
+int callback_n_netopeer_n_tls_n_min_version(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_tls_n_max_version(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_tls_n_cipher_list(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_tls_n_ciphersuites(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
+int callback_n_netopeer_n_tls_n_kernel_offload(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
+
 int callback_n_netopeer_n_tls_n_crl_dir(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr UNUSED(old_node), xmlNodePtr new_node, struct nc_err** error);
 
 int callback_n_netopeer_n_tls_n_cert_maps_n_cert_to_name(void** UNUSED(data), XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** error);
@@ -39,7 +39,8 @@
 #ifndef _NETCONF_SERVER_TRANSAPI_TLS_H_
 #define _NETCONF_SERVER_TRANSAPI_TLS_H_
 
-int np_tls_chapp_linger_check(struct ch_app* app);
+/* returns the msecs left until the linger expires, 0 when the client got disconnected, called with the call home apps locked */
+uint64_t np_tls_chapp_linger_check(struct ch_app* app);
 
 int server_transapi_init_tls(void);
 
@@ -54,46 +54,105 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <shadow.h>
 #include <pwd.h>
 
 #include <openssl/ssl.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
 #include <openssl/x509v3.h>
 
 #include "../server.h"
+#include "../hash.h"
+#include "../epoch.h"
+#include "../stats.h"
+#include "../registry.h"
+#include "../rpcpool.h"
+#include "../notif.h"
+#include "../pool.h"
+#include "../ratelimit.h"
+#include "../stream.h"
+
+#ifdef NP_TLS_LEGACY
+/* OpenSSL 1.0 */
+#	define TLS_server_method SSLv23_server_method
+#	define ASN1_STRING_get0_data ASN1_STRING_data
+#	define X509_REVOKED_get0_serialNumber(revoked) ((revoked)->serialNumber)
+#	define X509_CRL_get0_nextUpdate X509_CRL_get_nextUpdate
+#	define TLS_SESSION_ID unsigned char
+#else
+#	define TLS_SESSION_ID const unsigned char
+#endif
+
+#if !defined(NP_TLS_LEGACY) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+/* OpenSSL 3 deprecates HMAC_CTX */
+#	include <openssl/core_names.h>
+#	define TLS_TICKET_EVP_MAC
+#	define TLS_TICKET_MAC_CTX EVP_MAC_CTX
+#else
+#	define TLS_TICKET_MAC_CTX HMAC_CTX
+#endif
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
+static struct np_pool client_pool = NP_POOL_INITIALIZER("tls-clients", struct client_struct_tls, CLIENT_POOL_SLAB);
+
 extern int quit, restart_soft;
 
 extern struct np_options netopeer_options;
 extern struct np_state netopeer_state;
 
+/* the sessions with kernel TLS */
+static unsigned int ktls_session_count = 0;
+
 void client_free_tls(struct client_struct_tls* client) {
-	if (!client->to_free) {
+	if (!client->common.to_free) {
 		nc_verb_error("%s: internal error: freeing a client not marked for deletion", __func__);
 	}
+	np_stream_free(client->stream);
+	client->stream = NULL;
 	if (client->nc_sess != NULL) {
 		nc_verb_error("%s: internal error: freeing a client with an opened NC session", __func__);
+		np_rpcq_free(client->rpcq);
+		client->rpcq = NULL;
+		np_registry_del_session(nc_session_get_id(client->nc_sess));
 		nc_session_free(client->nc_sess);
 	}
 
+	if (client->ktls) {
+		__sync_fetch_and_sub(&ktls_session_count, 1);
+	}
 	if (client->tls != NULL) {
 		SSL_shutdown(client->tls);
 		SSL_free(client->tls);
 	}
-	if (client->sock != -1) {
-		close(client->sock);
+	if (client->common.sock != -1) {
+		close(client->common.sock);
 	}
-	free(client->username);
+	free(client->common.username);
 	X509_free(client->cert);
 
-	free(client);
+	np_pool_free(&client_pool, client);
+}
+
+struct client_struct* np_tls_client_new(void) {
+	struct client_struct_tls* client;
+
+	if ((client = np_pool_alloc(&client_pool)) == NULL) {
+		return NULL;
+	}
+	client->common.transport = NC_TRANSPORT_TLS;
+	client->common.sock = -1;
+
+	return &client->common;
 }
 
-static char* asn1time_to_str(ASN1_TIME *t) {
+static char* asn1time_to_str(const ASN1_TIME *t) {
 	char *cp;
 	BIO *bio;
 	int n;
@@ -105,7 +164,7 @@ static char* asn1time_to_str(ASN1_TIME *t) {
 	if (bio == NULL) {
 		return NULL;
 	}
-	ASN1_TIME_print(bio, t);
+	ASN1_TIME_print(bio, (ASN1_TIME*)t);
 	n = BIO_pending(bio);
 	cp = malloc(n+1);
 	n = BIO_read(bio, cp, n);
@@ -119,16 +178,6 @@ static char* asn1time_to_str(ASN1_TIME *t) {
 	return cp;
 }
 
-static void digest_to_str(const unsigned char* digest, unsigned int dig_len, char** str) {
-	unsigned int i;
-
-	*str = malloc(dig_len*3);
-	for (i = 0; i < dig_len-1; ++i) {
-		sprintf((*str)+(i*3), "%02x:", digest[i]);
-	}
-	sprintf((*str)+(i*3), "%02x", digest[i]);
-}
-
 /* return NULL - SSL error can be retrieved */
 static X509* base64der_to_cert(const char* in) {
 	X509* out;
@@ -190,20 +239,6 @@ static EVP_PKEY* base64der_to_privatekey(const char* in, int rsa) {
 	return out;
 }
 
-static int cert_pubkey_match(X509* cert1, X509* cert2) {
-	ASN1_BIT_STRING* bitstr1, *bitstr2;
-
-    bitstr1 = X509_get0_pubkey_bitstr(cert1);
-	bitstr2 = X509_get0_pubkey_bitstr(cert2);
-
-    if (bitstr1 == NULL || bitstr2 == NULL || bitstr1->length != bitstr2->length ||
-            memcmp(bitstr1->data, bitstr2->data, bitstr1->length)) {
-        return 0;
-    }
-
-    return 1;
-}
-
 /* return: 0 - username assigned, 1 - error occured, username unchanged */
 static int tls_ctn_get_username_from_cert(X509* client_cert, CTN_MAP_TYPE map_type, char** username) {
 	STACK_OF(GENERAL_NAME)* san_names;
@@ -241,14 +276,14 @@ static int tls_ctn_get_username_from_cert(X509* client_cert, CTN_MAP_TYPE map_ty
 			/* rfc822Name (email) */
 			if ((map_type == CTN_MAP_TYPE_SAN_ANY || map_type == CTN_MAP_TYPE_SAN_RFC822_NAME) &&
 					san_name->type == GEN_EMAIL) {
-				*username = strdup((char*)ASN1_STRING_data(san_name->d.rfc822Name));
+				*username = strdup((const char*)ASN1_STRING_get0_data(san_name->d.rfc822Name));
 				break;
 			}
 
 			/* dNSName */
 			if ((map_type == CTN_MAP_TYPE_SAN_ANY || map_type == CTN_MAP_TYPE_SAN_DNS_NAME) &&
 					san_name->type == GEN_DNS) {
-				*username = strdup((char*)ASN1_STRING_data(san_name->d.dNSName));
+				*username = strdup((const char*)ASN1_STRING_get0_data(san_name->d.dNSName));
 				break;
 			}
 
@@ -304,419 +339,791 @@ static int tls_ctn_get_username_from_cert(X509* client_cert, CTN_MAP_TYPE map_ty
 	return 0;
 }
 
-/* return: 0 - result assigned, 1 - result unchanged (no match or some error occured) */
-static int tls_cert_to_name(X509* cert, CTN_MAP_TYPE* map_type, char** name) {
-	char* digest_md5 = NULL, *digest_sha1 = NULL, *digest_sha224 = NULL;
-	char* digest_sha256 = NULL, *digest_sha384 = NULL, *digest_sha512 = NULL;
-	struct np_ctn_item* ctn;
-	unsigned char* buf = malloc(64);
-	unsigned int buf_len = 64;
+/*
+ * The indices below (trusted client certificates, cert-to-name, CRLs) are
+ * read by the verifying threads without any lock, guarded by their epochs.
+ */
 
-	if (cert == NULL || map_type == NULL || name == NULL) {
-		free(buf);
-		return 1;
-	}
+/*
+ * The trusted client certificates are decoded once and their public keys
+ * hashed into a set, a client certificate that failed the standard
+ * verification is accepted if its public key is in it.
+ */
+struct trusted_client_index {
+	unsigned int size;				// power of 2
+	unsigned char (*keys)[SHA256_DIGEST_LENGTH];	// open addressing
+	uint8_t* used;
+};
 
-	/* CTN_MAP LOCK */
-	pthread_mutex_lock(&netopeer_options.tls_opts->ctn_map_lock);
+static struct trusted_client_index* trusted_clients = NULL;
+static struct np_epoch trusted_clients_epoch;
 
-	for (ctn = netopeer_options.tls_opts->ctn_map; ctn != NULL; ctn = ctn->next) {
-		/* MD5 */
-		if (strncmp(ctn->fingerprint, "01", 2) == 0) {
-			if (digest_md5 == NULL) {
-				if (X509_digest(cert, EVP_md5(), buf, &buf_len) != 1) {
-					nc_verb_error("%s: calculating MD5 digest: %s", __func__, ERR_reason_error_string(ERR_get_error()));
-					goto fail;
-				}
-				digest_to_str(buf, buf_len, &digest_md5);
-			}
+static int cert_pubkey_digest(X509* cert, unsigned char* digest) {
+	ASN1_BIT_STRING* bitstr;
 
-			if (strcasecmp(ctn->fingerprint+3, digest_md5) == 0) {
-				/* we got ourselves a winner! */
-				nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
-				*map_type = ctn->map_type;
-				if (ctn->map_type == CTN_MAP_TYPE_SPECIFIED) {
-					*name = strdup(ctn->name);
-				}
-				break;
-			}
+	if ((bitstr = X509_get0_pubkey_bitstr(cert)) == NULL) {
+		return EXIT_FAILURE;
+	}
+	if (!EVP_Digest(bitstr->data, bitstr->length, digest, NULL, EVP_sha256(), NULL)) {
+		return EXIT_FAILURE;
+	}
 
-		/* SHA-1 */
-		} else if (strncmp(ctn->fingerprint, "02", 2) == 0) {
-			if (digest_sha1 == NULL) {
-				if (X509_digest(cert, EVP_sha1(), buf, &buf_len) != 1) {
-					nc_verb_error("%s: calculating SHA-1 digest: %s", __func__, ERR_reason_error_string(ERR_get_error()));
-					goto fail;
-				}
-				digest_to_str(buf, buf_len, &digest_sha1);
-			}
+	return EXIT_SUCCESS;
+}
 
-			if (strcasecmp(ctn->fingerprint+3, digest_sha1) == 0) {
-				/* we got ourselves a winner! */
-				nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
-				*map_type = ctn->map_type;
-				if (ctn->map_type == CTN_MAP_TYPE_SPECIFIED) {
-					*name = strdup(ctn->name);
-				}
-				break;
-			}
+/* the digest is a hash already */
+static unsigned int trusted_client_bucket(const unsigned char* digest, unsigned int size) {
+	return (((unsigned int)digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) | digest[3]) & (size - 1);
+}
 
-		/* SHA-224 */
-		} else if (strncmp(ctn->fingerprint, "03", 2) == 0) {
-			if (digest_sha224 == NULL) {
-				if (X509_digest(cert, EVP_sha224(), buf, &buf_len) != 1) {
-					nc_verb_error("%s: calculating SHA-224 digest: %s", __func__, ERR_reason_error_string(ERR_get_error()));
-					goto fail;
-				}
-				digest_to_str(buf, buf_len, &digest_sha224);
-			}
+static void trusted_client_index_free(struct trusted_client_index* index) {
+	if (index == NULL) {
+		return;
+	}
 
-			if (strcasecmp(ctn->fingerprint+3, digest_sha224) == 0) {
-				/* we got ourselves a winner! */
-				nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
-				*map_type = ctn->map_type;
-				if (ctn->map_type == CTN_MAP_TYPE_SPECIFIED) {
-					*name = strdup(ctn->name);
-				}
-				break;
-			}
+	free(index->keys);
+	free(index->used);
+	free(index);
+}
 
-		/* SHA-256 */
-		} else if (strncmp(ctn->fingerprint, "04", 2) == 0) {
-			if (digest_sha256 == NULL) {
-				if (X509_digest(cert, EVP_sha256(), buf, &buf_len) != 1) {
-					nc_verb_error("%s: calculating SHA-256 digest: %s", __func__, ERR_reason_error_string(ERR_get_error()));
-					goto fail;
-				}
-				digest_to_str(buf, buf_len, &digest_sha256);
-			}
+/* the decoded certificate of a configured one, NULL on error */
+static X509* trusted_cert_x509(struct np_trusted_cert* trusted_cert) {
+	if (trusted_cert->x509 == NULL) {
+		trusted_cert->x509 = base64der_to_cert(trusted_cert->cert);
+	}
+	return trusted_cert->x509;
+}
 
-			if (strcasecmp(ctn->fingerprint+3, digest_sha256) == 0) {
-				/* we got ourselves a winner! */
-				nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
-				*map_type = ctn->map_type;
-				if (ctn->map_type == CTN_MAP_TYPE_SPECIFIED) {
-					*name = strdup(ctn->name);
-				}
-				break;
-			}
+/* TLS_CTX LOCK must be held */
+static void trusted_clients_rebuild(void) {
+	struct trusted_client_index* index;
+	struct np_trusted_cert* trusted_cert;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	unsigned int count, i;
 
-		/* SHA-384 */
-		} else if (strncmp(ctn->fingerprint, "05", 2) == 0) {
-			if (digest_sha384 == NULL) {
-				if (X509_digest(cert, EVP_sha384(), buf, &buf_len) != 1) {
-					nc_verb_error("%s: calculating SHA-384 digest: %s", __func__, ERR_reason_error_string(ERR_get_error()));
-					goto fail;
-				}
-				digest_to_str(buf, buf_len, &digest_sha384);
-			}
+	for (count = 0, trusted_cert = netopeer_options.tls_opts->trusted_certs; trusted_cert != NULL; trusted_cert = trusted_cert->next) {
+		count += trusted_cert->client_cert;
+	}
 
-			if (strcasecmp(ctn->fingerprint+3, digest_sha384) == 0) {
-				/* we got ourselves a winner! */
-				nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
-				*map_type = ctn->map_type;
-				if (ctn->map_type == CTN_MAP_TYPE_SPECIFIED) {
-					*name = strdup(ctn->name);
-				}
-				break;
-			}
+	if ((index = calloc(1, sizeof(struct trusted_client_index))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return;
+	}
+	/* at most half full */
+	for (index->size = 16; index->size < 2*count; index->size *= 2);
+	index->keys = malloc(index->size * SHA256_DIGEST_LENGTH);
+	index->used = calloc(index->size, sizeof(uint8_t));
+	if (index->keys == NULL || index->used == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		trusted_client_index_free(index);
+		return;
+	}
 
-		/* SHA-512 */
-		} else if (strncmp(ctn->fingerprint, "06", 2) == 0) {
-			if (digest_sha512 == NULL) {
-				if (X509_digest(cert, EVP_sha512(), buf, &buf_len) != 1) {
-					nc_verb_error("%s: calculating SHA-512 digest: %s", __func__, ERR_reason_error_string(ERR_get_error()));
-					goto fail;
-				}
-				digest_to_str(buf, buf_len, &digest_sha512);
-			}
+	for (trusted_cert = netopeer_options.tls_opts->trusted_certs; trusted_cert != NULL; trusted_cert = trusted_cert->next) {
+		if (!trusted_cert->client_cert) {
+			continue;
+		}
+		if (trusted_cert_x509(trusted_cert) == NULL || cert_pubkey_digest(trusted_cert->x509, digest) != EXIT_SUCCESS) {
+			nc_verb_error("%s: loading a trusted client certificate failed (%s).", __func__, ERR_reason_error_string(ERR_get_error()));
+			continue;
+		}
 
-			if (strcasecmp(ctn->fingerprint+3, digest_sha512) == 0) {
-				/* we got ourselves a winner! */
-				nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
-				*map_type = ctn->map_type;
-				if (ctn->map_type == CTN_MAP_TYPE_SPECIFIED) {
-					*name = strdup(ctn->name);
-				}
+		for (i = trusted_client_bucket(digest, index->size); index->used[i]; i = (i + 1) & (index->size - 1)) {
+			if (memcmp(index->keys[i], digest, SHA256_DIGEST_LENGTH) == 0) {
 				break;
 			}
-
-		/* unknown */
-		} else {
-			nc_verb_warning("%s: unknown fingerprint algorithm used (%s), skipping", __func__, ctn->fingerprint);
 		}
+		memcpy(index->keys[i], digest, SHA256_DIGEST_LENGTH);
+		index->used[i] = 1;
 	}
 
-	if (ctn == NULL) {
-		goto fail;
+	trusted_client_index_free(np_epoch_publish((void**)&trusted_clients, index, &trusted_clients_epoch));
+}
+
+/* return 1 if the public key of cert is trusted */
+static int trusted_client_match(X509* cert) {
+	struct trusted_client_index* index;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	unsigned int i, slot;
+	int ret = 0;
+
+	if (cert_pubkey_digest(cert, digest) != EXIT_SUCCESS) {
+		return 0;
 	}
 
-	/* CTN_MAP UNLOCK */
-	pthread_mutex_unlock(&netopeer_options.tls_opts->ctn_map_lock);
+	slot = np_epoch_enter(&trusted_clients_epoch);
+	if ((index = __atomic_load_n(&trusted_clients, __ATOMIC_SEQ_CST)) != NULL) {
+		for (i = trusted_client_bucket(digest, index->size); index->used[i]; i = (i + 1) & (index->size - 1)) {
+			if (memcmp(index->keys[i], digest, SHA256_DIGEST_LENGTH) == 0) {
+				ret = 1;
+				break;
+			}
+		}
+	}
+	np_epoch_leave(&trusted_clients_epoch, slot);
 
-	free(digest_md5);
-	free(digest_sha1);
-	free(digest_sha224);
-	free(digest_sha256);
-	free(digest_sha384);
-	free(digest_sha512);
-	free(buf);
-	return 0;
+	return ret;
+}
 
-fail:
-	/* CTN_MAP UNLOCK */
-	pthread_mutex_unlock(&netopeer_options.tls_opts->ctn_map_lock);
+/*
+ * The cert-to-name entries are compiled after every change into an index
+ * of their binary fingerprints, a hash table for each digest algorithm.
+ */
+#define CTN_ALGORITHMS 6
+
+struct ctn_entry {
+	uint32_t id;
+	CTN_MAP_TYPE map_type;
+	char* name;
+	unsigned int digest_len;
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	struct ctn_entry* next;
+};
+
+struct ctn_index {
+	struct {
+		unsigned int size;			// power of 2, 0 if no entry uses the algorithm
+		struct ctn_entry** buckets;
+	} algs[CTN_ALGORITHMS];
+};
+
+static struct ctn_index* ctn_index = NULL;
+static struct np_epoch ctn_index_epoch;
+
+/* in the order of the fingerprint algorithm identifiers, 01 is MD5 */
+static const EVP_MD* ctn_algorithm(unsigned int alg) {
+	switch (alg) {
+	case 0:
+		return EVP_md5();
+	case 1:
+		return EVP_sha1();
+	case 2:
+		return EVP_sha224();
+	case 3:
+		return EVP_sha256();
+	case 4:
+		return EVP_sha384();
+	case 5:
+		return EVP_sha512();
+	}
+	return NULL;
+}
 
-	free(digest_md5);
-	free(digest_sha1);
-	free(digest_sha224);
-	free(digest_sha256);
-	free(digest_sha384);
-	free(digest_sha512);
-	free(buf);
-	return 1;
+static unsigned int ctn_bucket(const unsigned char* digest, unsigned int digest_len, unsigned int size) {
+	return np_hash(NP_HASH_INIT, digest, digest_len) & (size - 1);
 }
 
-static int tls_verify_callback(int preverify_ok, X509_STORE_CTX* x509_ctx) {
-	X509_STORE *store;
-	X509_LOOKUP *lookup;
-	X509_STORE_CTX store_ctx;
-	X509_OBJECT obj;
-	X509_NAME* subject;
-	X509_NAME* issuer;
-	X509* cert;
-	X509_CRL* crl;
-	X509_REVOKED* revoked;
-	STACK_OF(X509)* cert_chain_stack;
-	EVP_PKEY* pubkey;
-	SSL* cur_tls;
-	struct client_struct_tls* new_client;
-	struct np_trusted_cert* trusted_cert;
-	long serial;
-	int i, n, rc, depth;
-	char* cp;
-	CTN_MAP_TYPE map_type = 0;
-	ASN1_TIME* last_update = NULL, *next_update = NULL;
+/* "04:ab:cd:..." to the algorithm index and the binary digest, return EXIT_SUCCESS or EXIT_FAILURE */
+static int ctn_fingerprint_parse(const char* fingerprint, unsigned int* alg, unsigned char* digest, unsigned int* digest_len) {
+	unsigned int byte;
+	int len;
 
-	/* get the new client structure */
-	cur_tls = X509_STORE_CTX_get_ex_data(x509_ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
-	new_client = (struct client_struct_tls*)SSL_get_ex_data(cur_tls, netopeer_state.tls_state->last_tls_idx);
-	if (new_client == NULL) {
-		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
-		return 0;
+	if (sscanf(fingerprint, "%2x%n", &byte, &len) != 1 || len != 2 || byte < 1 || byte > CTN_ALGORITHMS) {
+		return EXIT_FAILURE;
 	}
+	*alg = byte - 1;
+	fingerprint += 2;
 
-	/* get the last certificate, that is the peer (client) certificate */
-	if (new_client->cert == NULL) {
-		cert_chain_stack = X509_STORE_CTX_get1_chain(x509_ctx);
-		while ((cert = sk_X509_pop(cert_chain_stack)) != NULL) {
-			X509_free(new_client->cert);
-			new_client->cert = cert;
+	for (*digest_len = 0; *fingerprint != '\0'; ++(*digest_len)) {
+		if (*fingerprint != ':' || *digest_len == (unsigned int)EVP_MD_size(ctn_algorithm(*alg))
+				|| sscanf(fingerprint+1, "%2x%n", &byte, &len) != 1 || len != 2) {
+			return EXIT_FAILURE;
 		}
-		sk_X509_pop_free(cert_chain_stack, X509_free);
+		digest[*digest_len] = byte;
+		fingerprint += 3;
+	}
+	if (*digest_len != (unsigned int)EVP_MD_size(ctn_algorithm(*alg))) {
+		return EXIT_FAILURE;
 	}
 
-	/* standard certificate verification failed, so a local client cert must match to continue */
-	if (!preverify_ok) {
-		/* TLS_CTX LOCK */
-		pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
+	return EXIT_SUCCESS;
+}
 
-		for (trusted_cert = netopeer_options.tls_opts->trusted_certs; trusted_cert != NULL; trusted_cert = trusted_cert->next) {
-			if (!trusted_cert->client_cert) {
-				continue;
-			}
-			cert = base64der_to_cert(trusted_cert->cert);
-			if (cert == NULL) {
-				nc_verb_error("%s: loading a trusted client certificate failed (%s).", __func__, ERR_reason_error_string(ERR_get_error()));
-				continue;
-			}
+static void ctn_index_free(struct ctn_index* index) {
+	struct ctn_entry* entry;
+	unsigned int alg, i;
 
-			if (cert_pubkey_match(new_client->cert, cert)) {
-				X509_free(cert);
-				break;
+	if (index == NULL) {
+		return;
+	}
+
+	for (alg = 0; alg < CTN_ALGORITHMS; ++alg) {
+		for (i = 0; i < index->algs[alg].size; ++i) {
+			while ((entry = index->algs[alg].buckets[i]) != NULL) {
+				index->algs[alg].buckets[i] = entry->next;
+				free(entry->name);
+				free(entry);
 			}
-			X509_free(cert);
 		}
+		free(index->algs[alg].buckets);
+	}
+	free(index);
+}
 
-		/* TLS_CTX UNLOCK */
-		pthread_mutex_unlock(&netopeer_options.tls_opts->tls_ctx_lock);
+static void ctn_index_swap(struct ctn_index* index) {
+	ctn_index_free(np_epoch_publish((void**)&ctn_index, index, &ctn_index_epoch));
+}
 
-		if (trusted_cert == NULL) {
-			nc_verb_error("Cert verify: fail (%s).", X509_verify_cert_error_string(X509_STORE_CTX_get_error(x509_ctx)));
-			return 0;
+/* CTN_MAP LOCK must be held */
+static void ctn_index_rebuild(void) {
+	struct ctn_index* index;
+	struct ctn_entry* entry, **prev;
+	struct np_ctn_item* ctn;
+	unsigned int count[CTN_ALGORITHMS] = {0};
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int alg, digest_len, bucket;
+
+	for (ctn = netopeer_options.tls_opts->ctn_map; ctn != NULL; ctn = ctn->next) {
+		if (ctn_fingerprint_parse(ctn->fingerprint, &alg, digest, &digest_len) == EXIT_SUCCESS) {
+			++count[alg];
 		}
+	}
 
-		/* we are just overriding the failed standard certificate verification (preverify_ok == 0),
-		 * this callback will be called again with the same current certificate and preverify_ok == 1 */
-		nc_verb_warning("Cert verify: fail (%s), but the client certificate is trusted, continuing.", X509_verify_cert_error_string(X509_STORE_CTX_get_error(x509_ctx)));
-		X509_STORE_CTX_set_error(x509_ctx, X509_V_OK);
-		return 1;
+	if ((index = calloc(1, sizeof(struct ctn_index))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return;
+	}
+	for (alg = 0; alg < CTN_ALGORITHMS; ++alg) {
+		if (count[alg] == 0) {
+			continue;
+		}
+		/* at most 1 entry per bucket on average */
+		for (index->algs[alg].size = 16; index->algs[alg].size < count[alg]; index->algs[alg].size *= 2);
+		if ((index->algs[alg].buckets = calloc(index->algs[alg].size, sizeof(struct ctn_entry*))) == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			index->algs[alg].size = 0;
+			ctn_index_free(index);
+			return;
+		}
 	}
 
-	/* print cert verify info */
-	depth = X509_STORE_CTX_get_error_depth(x509_ctx);
-	nc_verb_verbose("Cert verify: depth %d", depth);
+	for (ctn = netopeer_options.tls_opts->ctn_map; ctn != NULL; ctn = ctn->next) {
+		if (ctn_fingerprint_parse(ctn->fingerprint, &alg, digest, &digest_len) != EXIT_SUCCESS) {
+			nc_verb_warning("%s: invalid or unknown fingerprint (%s), skipping", __func__, ctn->fingerprint);
+			continue;
+		}
 
-	cert = X509_STORE_CTX_get_current_cert(x509_ctx);
-	subject = X509_get_subject_name(cert);
-	issuer = X509_get_issuer_name(cert);
+		if ((entry = calloc(1, sizeof(struct ctn_entry))) == NULL) {
+			nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+			ctn_index_free(index);
+			return;
+		}
+		entry->id = ctn->id;
+		entry->map_type = ctn->map_type;
+		entry->name = (ctn->name ? strdup(ctn->name) : NULL);
+		entry->digest_len = digest_len;
+		memcpy(entry->digest, digest, digest_len);
+
+		/* the list is sorted by id, keep the same fingerprints in a bucket in the same order */
+		bucket = ctn_bucket(digest, digest_len, index->algs[alg].size);
+		for (prev = &index->algs[alg].buckets[bucket]; *prev != NULL; prev = &(*prev)->next);
+		*prev = entry;
+	}
 
-	cp = X509_NAME_oneline(subject, NULL, 0);
-	nc_verb_verbose("Cert verify: subject: %s", cp);
-	OPENSSL_free(cp);
-	cp = X509_NAME_oneline(issuer, NULL, 0);
-	nc_verb_verbose("Cert verify: issuer:  %s", cp);
-	OPENSSL_free(cp);
+	ctn_index_swap(index);
+}
 
-	/* check for revocation if set */
-	/* CRL_DIR LOCK */
-	pthread_mutex_lock(&netopeer_options.tls_opts->crl_dir_lock);
+void np_tls_ctn_check(void) {
+	if (netopeer_options.tls_opts == NULL || !netopeer_options.tls_opts->ctn_map_change_flag) {
+		return;
+	}
 
-	if (netopeer_options.tls_opts->crl_dir != NULL) {
-		store = X509_STORE_new();
-		lookup = X509_STORE_add_lookup(store, X509_LOOKUP_hash_dir());
-		if (lookup == NULL) {
-			nc_verb_error("%s: failed to add lookup method", __func__);
-			X509_STORE_free(store);
-			/* CRL_DIR UNLOCK */
-			pthread_mutex_unlock(&netopeer_options.tls_opts->crl_dir_lock);
-			return 0;
-		}
+	/* CTN_MAP LOCK */
+	pthread_mutex_lock(&netopeer_options.tls_opts->ctn_map_lock);
 
-		i = X509_LOOKUP_add_dir(lookup, netopeer_options.tls_opts->crl_dir, X509_FILETYPE_PEM);
+	netopeer_options.tls_opts->ctn_map_change_flag = 0;
+	ctn_index_rebuild();
 
-		/* CRL_DIR UNLOCK */
-		pthread_mutex_unlock(&netopeer_options.tls_opts->crl_dir_lock);
+	/* CTN_MAP UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.tls_opts->ctn_map_lock);
+}
 
-		if (i == 0) {
-			nc_verb_error("%s: failed to add revocation lookup directory", __func__);
-			X509_STORE_free(store);
-			return 0;
-		}
+void np_tls_ctn_clear(void) {
+	ctn_index_swap(NULL);
+}
 
-		/* try to retrieve a CRL corresponding to the _subject_ of
-		* the current certificate in order to verify it's integrity */
-		memset((char*)&obj, 0, sizeof(obj));
-		X509_STORE_CTX_init(&store_ctx, store, NULL, NULL);
-		rc = X509_STORE_get_by_subject(&store_ctx, X509_LU_CRL, subject, &obj);
-		X509_STORE_CTX_cleanup(&store_ctx);
-		crl = obj.data.crl;
-		if (rc > 0 && crl) {
-			cp = X509_NAME_oneline(subject, NULL, 0);
-			nc_verb_verbose("Cert verify CRL: issuer: %s", cp);
-			OPENSSL_free(cp);
+/* return: 0 - result assigned, 1 - result unchanged (no match or some error occured) */
+static int tls_cert_to_name(X509* cert, CTN_MAP_TYPE* map_type, char** name) {
+	struct ctn_index* index;
+	struct ctn_entry* entry, *match = NULL;
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int alg, digest_len, slot;
+	int ret = 1;
 
-			last_update = X509_CRL_get_lastUpdate(crl);
-			next_update = X509_CRL_get_nextUpdate(crl);
-			cp = asn1time_to_str(last_update);
-			nc_verb_verbose("Cert verify CRL: last update: %s", cp);
-			free(cp);
-			cp = asn1time_to_str(next_update);
-			nc_verb_verbose("Cert verify CRL: next update: %s", cp);
-			free(cp);
+	if (cert == NULL || map_type == NULL || name == NULL) {
+		return 1;
+	}
 
-			/* verify the signature on this CRL */
-			pubkey = X509_get_pubkey(cert);
-			if (X509_CRL_verify(crl, pubkey) <= 0) {
-				nc_verb_error("Cert verify CRL: invalid signature.");
-				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_CRL_SIGNATURE_FAILURE);
-				X509_OBJECT_free_contents(&obj);
-				if (pubkey) {
-					EVP_PKEY_free(pubkey);
-				}
-				X509_STORE_free(store);
-				return 0;
-			}
-			if (pubkey) {
-				EVP_PKEY_free(pubkey);
-			}
+	slot = np_epoch_enter(&ctn_index_epoch);
+	if ((index = __atomic_load_n(&ctn_index, __ATOMIC_SEQ_CST)) == NULL) {
+		goto finish;
+	}
 
-			/* check date of CRL to make sure it's not expired */
-			if (next_update == NULL) {
-				nc_verb_error("Cert verify CRL: invalid nextUpdate field.");
-				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_ERROR_IN_CRL_NEXT_UPDATE_FIELD);
-				X509_OBJECT_free_contents(&obj);
-				X509_STORE_free(store);
-				return 0;
-			}
-			if (X509_cmp_current_time(next_update) < 0) {
-				nc_verb_error("Cert verify CRL: expired - revoking all certificates.");
-				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_CRL_HAS_EXPIRED);
-				X509_OBJECT_free_contents(&obj);
-				X509_STORE_free(store);
-				return 0;
-			}
-			X509_OBJECT_free_contents(&obj);
+	/* the digest of every algorithm in use, the entry with the lowest id wins */
+	for (alg = 0; alg < CTN_ALGORITHMS; ++alg) {
+		if (index->algs[alg].size == 0) {
+			continue;
+		}
+		if (X509_digest(cert, ctn_algorithm(alg), digest, &digest_len) != 1) {
+			nc_verb_error("%s: calculating %s digest: %s", __func__, OBJ_nid2sn(EVP_MD_type(ctn_algorithm(alg))), ERR_reason_error_string(ERR_get_error()));
+			goto finish;
 		}
 
-		/* try to retrieve a CRL corresponding to the _issuer_ of
-		* the current certificate in order to check for revocation */
-		memset((char*)&obj, 0, sizeof(obj));
-		X509_STORE_CTX_init(&store_ctx, store, NULL, NULL);
-		rc = X509_STORE_get_by_subject(&store_ctx, X509_LU_CRL, issuer, &obj);
-		X509_STORE_CTX_cleanup(&store_ctx);
-		crl = obj.data.crl;
-		if (rc > 0 && crl) {
-			/* check if the current certificate is revoked by this CRL */
-			n = sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl));
-			for (i = 0; i < n; i++) {
-				revoked = sk_X509_REVOKED_value(X509_CRL_get_REVOKED(crl), i);
-				if (ASN1_INTEGER_cmp(revoked->serialNumber, X509_get_serialNumber(cert)) == 0) {
-					serial = ASN1_INTEGER_get(revoked->serialNumber);
-					cp = X509_NAME_oneline(issuer, NULL, 0);
-					nc_verb_error("Cert verify CRL: certificate with serial %ld (0x%lX) revoked per CRL from issuer %s", serial, serial, cp);
-					OPENSSL_free(cp);
-					X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_CERT_REVOKED);
-					X509_OBJECT_free_contents(&obj);
-					X509_STORE_free(store);
-					return 0;
+		for (entry = index->algs[alg].buckets[ctn_bucket(digest, digest_len, index->algs[alg].size)]; entry != NULL; entry = entry->next) {
+			if (entry->digest_len == digest_len && memcmp(entry->digest, digest, digest_len) == 0) {
+				if (match == NULL || entry->id < match->id) {
+					match = entry;
 				}
+				break;
 			}
-			X509_OBJECT_free_contents(&obj);
 		}
-		X509_STORE_free(store);
 	}
-	/* CRL_DIR UNLOCK */
-	pthread_mutex_unlock(&netopeer_options.tls_opts->crl_dir_lock);
 
-	/* cert-to-name already successful */
-	if (new_client->username != NULL) {
-		return 1;
+	if (match != NULL) {
+		/* we got ourselves a winner! */
+		nc_verb_verbose("Cert verify CTN: entry with a matching fingerprint found");
+		*map_type = match->map_type;
+		if (match->map_type == CTN_MAP_TYPE_SPECIFIED) {
+			*name = strdup(match->name);
+		}
+		ret = 0;
 	}
 
-	/* cert-to-name */
-	if (tls_cert_to_name(cert, &map_type, &cp) != 0) {
-		/* cert-to-name was not successful on this certificate */
-		goto fail;
+finish:
+	np_epoch_leave(&ctn_index_epoch, slot);
+	return ret;
+}
+
+/*
+ * The CRLs of crl-dir are read only when the directory changes or any of
+ * them reaches its nextUpdate, into a store hashed by the CRL issuer, each
+ * CRL with a hash set of its revoked serial numbers. The signature of a CRL
+ * is verified once for every issuer key it is checked against.
+ */
+struct crl_entry {
+	X509_CRL* crl;
+	unsigned int serial_size;		// power of 2
+	ASN1_INTEGER** serials;			// open addressing, owned by crl
+	pthread_mutex_t verify_lock;
+	int verified;					// the signature is valid for verified_key
+	unsigned char verified_key[SHA_DIGEST_LENGTH];
+	struct crl_entry* next;
+};
+
+struct crl_store {
+	unsigned int size;				// power of 2
+	struct crl_entry** buckets;
+	time_t next_update;				// earliest nextUpdate of all the CRLs, 0 if none
+};
+
+static struct crl_store* crl_store = NULL;
+static struct np_epoch crl_store_epoch;
+static uint64_t crl_store_checked = 0;
+static ino_t crl_dir_ino = 0;
+static struct timespec crl_dir_mtime;
+
+static uint32_t crl_serial_hash(const ASN1_INTEGER* serial) {
+	uint32_t ret;
+
+	ret = np_hash(NP_HASH_INIT, ASN1_STRING_get0_data((ASN1_INTEGER*)serial), ASN1_STRING_length((ASN1_INTEGER*)serial));
+	/* the sign */
+	return ret ^ (uint32_t)ASN1_STRING_type((ASN1_INTEGER*)serial);
+}
+
+static void crl_entry_free(struct crl_entry* entry) {
+	X509_CRL_free(entry->crl);
+	free(entry->serials);
+	pthread_mutex_destroy(&entry->verify_lock);
+	free(entry);
+}
+
+static void crl_store_free(struct crl_store* store) {
+	struct crl_entry* entry;
+	unsigned int i;
+
+	if (store == NULL) {
+		return;
 	}
 
-	if (map_type == CTN_MAP_TYPE_SPECIFIED) {
-		new_client->username = cp;
-	} else if (tls_ctn_get_username_from_cert(new_client->cert, map_type, &new_client->username) != 0) {
-		goto fail;
+	for (i = 0; i < store->size; ++i) {
+		while ((entry = store->buckets[i]) != NULL) {
+			store->buckets[i] = entry->next;
+			crl_entry_free(entry);
+		}
 	}
+	free(store->buckets);
+	free(store);
+}
 
-	nc_verb_verbose("Cert verify CTN: new client username recognized as '%s'.", new_client->username);
-	return 1;
+static struct crl_entry* crl_entry_new(X509_CRL* crl) {
+	struct crl_entry* entry;
+	STACK_OF(X509_REVOKED)* revoked;
+	ASN1_INTEGER* serial;
+	unsigned int i, j, count;
 
-fail:
-	if (depth > 0) {
-		nc_verb_verbose("Cert verify CTN: cert fail: cert-to-name will continue on the next cert in chain");
-		return 1;
+	if ((entry = calloc(1, sizeof(struct crl_entry))) == NULL) {
+		return NULL;
 	}
+	revoked = X509_CRL_get_REVOKED(crl);
+	count = sk_X509_REVOKED_num(revoked);
 
-	nc_verb_error("Cert-to-name unsuccessful, dropping the new client.");
-	X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_APPLICATION_VERIFICATION);
-	return 0;
+	/* at most half full */
+	for (entry->serial_size = 8; entry->serial_size < 2*count; entry->serial_size *= 2);
+	if ((entry->serials = calloc(entry->serial_size, sizeof(ASN1_INTEGER*))) == NULL) {
+		free(entry);
+		return NULL;
+	}
+	for (i = 0; i < count; ++i) {
+		serial = (ASN1_INTEGER*)X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i));
+		for (j = crl_serial_hash(serial) & (entry->serial_size - 1); entry->serials[j] != NULL; j = (j + 1) & (entry->serial_size - 1));
+		entry->serials[j] = serial;
+	}
+
+	pthread_mutex_init(&entry->verify_lock, NULL);
+	entry->crl = crl;
+	return entry;
 }
 
-static int create_netconf_session(struct client_struct_tls* client) {
-	struct nc_cpblts* caps = NULL;
+static unsigned int crl_store_bucket(const struct crl_store* store, X509_NAME* issuer) {
+	return (unsigned int)X509_NAME_hash(issuer) & (store->size - 1);
+}
+
+static int crl_store_add(struct crl_store* store, X509_CRL* crl) {
+	struct crl_entry* entry;
+	const ASN1_TIME* next_update;
+	time_t next;
+	int days, secs;
+	char* cp;
+
+	/* an expired CRL still has to revoke all the certificates of its issuer */
+	next_update = X509_CRL_get0_nextUpdate(crl);
+	if (next_update != NULL && ASN1_TIME_diff(&days, &secs, NULL, next_update)) {
+		next = time(NULL) + days*86400L + secs;
+		if (store->next_update == 0 || next < store->next_update) {
+			store->next_update = next;
+		}
+	}
+
+	if ((entry = crl_entry_new(crl)) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+	entry->next = store->buckets[crl_store_bucket(store, X509_CRL_get_issuer(crl))];
+	store->buckets[crl_store_bucket(store, X509_CRL_get_issuer(crl))] = entry;
+
+	if (netopeer_options.verbose >= NC_VERB_VERBOSE) {
+		cp = X509_NAME_oneline(X509_CRL_get_issuer(crl), NULL, 0);
+		nc_verb_verbose("CRL of %s loaded, %d revoked.", cp, sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl)));
+		OPENSSL_free(cp);
+		cp = asn1time_to_str(next_update);
+		nc_verb_verbose("CRL next update: %s", (cp ? cp : "none"));
+		free(cp);
+	}
+	return EXIT_SUCCESS;
+}
+
+static struct crl_store* crl_store_load(const char* dir_path) {
+	struct crl_store* store;
+	struct dirent* dent;
+	struct stat st;
+	X509_CRL* crl;
+	DIR* dir;
+	FILE* file;
+	char* path;
+
+	if ((store = calloc(1, sizeof(struct crl_store))) == NULL || (store->buckets = calloc(64, sizeof(struct crl_entry*))) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		free(store);
+		return NULL;
+	}
+	store->size = 64;
+
+	if ((dir = opendir(dir_path)) == NULL) {
+		nc_verb_error("%s: failed to open the CRL directory \"%s\" (%s)", __func__, dir_path, strerror(errno));
+		return store;
+	}
+	while ((dent = readdir(dir)) != NULL) {
+		if (dent->d_name[0] == '.' || asprintf(&path, "%s/%s", dir_path, dent->d_name) == -1) {
+			continue;
+		}
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || (file = fopen(path, "r")) == NULL) {
+			free(path);
+			continue;
+		}
+
+		/* a file may hold several CRLs */
+		while ((crl = PEM_read_X509_CRL(file, NULL, NULL, NULL)) != NULL) {
+			if (crl_store_add(store, crl) != EXIT_SUCCESS) {
+				X509_CRL_free(crl);
+			}
+		}
+		ERR_clear_error();
+		fclose(file);
+		free(path);
+	}
+	closedir(dir);
+
+	return store;
+}
+
+static void crl_store_swap(struct crl_store* store) {
+	crl_store_free(np_epoch_publish((void**)&crl_store, store, &crl_store_epoch));
+}
+
+void np_tls_crl_check(void) {
+	struct crl_store* store;
+	struct stat st;
+	uint64_t now;
+	int changed;
+
+	if (netopeer_options.tls_opts == NULL) {
+		return;
+	}
+
+	now = np_clock_ms();
+	if (!netopeer_options.tls_opts->crl_dir_change_flag && now < crl_store_checked + CRL_CHECK_INTERVAL*1000) {
+		return;
+	}
+	crl_store_checked = now;
+
+	/* CRL_DIR LOCK */
+	pthread_mutex_lock(&netopeer_options.tls_opts->crl_dir_lock);
+
+	changed = netopeer_options.tls_opts->crl_dir_change_flag;
+	netopeer_options.tls_opts->crl_dir_change_flag = 0;
+	if (netopeer_options.tls_opts->crl_dir == NULL) {
+		crl_dir_ino = 0;
+		if (changed) {
+			crl_store_swap(NULL);
+		}
+		goto unlock;
+	}
+
+	if (stat(netopeer_options.tls_opts->crl_dir, &st) != 0) {
+		changed = changed || (crl_dir_ino != 0);
+		crl_dir_ino = 0;
+	} else if (st.st_ino != crl_dir_ino || st.st_mtim.tv_sec != crl_dir_mtime.tv_sec || st.st_mtim.tv_nsec != crl_dir_mtime.tv_nsec) {
+		changed = 1;
+		crl_dir_ino = st.st_ino;
+		crl_dir_mtime = st.st_mtim;
+	}
+
+	/* an updated CRL may be there already */
+	store = __atomic_load_n(&crl_store, __ATOMIC_SEQ_CST);
+	if (store != NULL && store->next_update && store->next_update <= time(NULL)) {
+		changed = 1;
+	}
+
+	if (changed) {
+		crl_store_swap(crl_store_load(netopeer_options.tls_opts->crl_dir));
+	}
+
+unlock:
+	/* CRL_DIR UNLOCK */
+	pthread_mutex_unlock(&netopeer_options.tls_opts->crl_dir_lock);
+}
+
+void np_tls_crl_clear(void) {
+	crl_store_swap(NULL);
+	crl_dir_ino = 0;
+}
+
+/* the CRLs issued by issuer that revoke serial, return 1 if revoked */
+static int crl_store_revoked(const struct crl_store* store, X509_NAME* issuer, ASN1_INTEGER* serial) {
+	struct crl_entry* entry;
+	unsigned int i;
+
+	for (entry = store->buckets[crl_store_bucket(store, issuer)]; entry != NULL; entry = entry->next) {
+		if (X509_NAME_cmp(X509_CRL_get_issuer(entry->crl), issuer) != 0) {
+			continue;
+		}
+		for (i = crl_serial_hash(serial) & (entry->serial_size - 1); entry->serials[i] != NULL; i = (i + 1) & (entry->serial_size - 1)) {
+			if (ASN1_INTEGER_cmp(entry->serials[i], serial) == 0) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* the CRLs issued by the CA certificate must be valid, return 0 if they are, X509_V_ERR_* otherwise */
+static int crl_store_check_issued(const struct crl_store* store, X509* cert) {
+	struct crl_entry* entry;
+	X509_NAME* subject;
+	EVP_PKEY* pubkey;
+	unsigned char key_md[SHA_DIGEST_LENGTH];
+	unsigned int key_md_len;
+	int valid;
+
+	subject = X509_get_subject_name(cert);
+	for (entry = store->buckets[crl_store_bucket(store, subject)]; entry != NULL; entry = entry->next) {
+		if (X509_NAME_cmp(X509_CRL_get_issuer(entry->crl), subject) != 0) {
+			continue;
+		}
+
+		/* verify the signature on this CRL, unless done with this key already */
+		if (!X509_pubkey_digest(cert, EVP_sha1(), key_md, &key_md_len)) {
+			return X509_V_ERR_CRL_SIGNATURE_FAILURE;
+		}
+		if (!__atomic_load_n(&entry->verified, __ATOMIC_ACQUIRE) || memcmp(entry->verified_key, key_md, SHA_DIGEST_LENGTH) != 0) {
+			pubkey = X509_get_pubkey(cert);
+			valid = (X509_CRL_verify(entry->crl, pubkey) > 0);
+			EVP_PKEY_free(pubkey);
+			if (!valid) {
+				nc_verb_error("Cert verify CRL: invalid signature.");
+				return X509_V_ERR_CRL_SIGNATURE_FAILURE;
+			}
+
+			/* ENTRY VERIFY LOCK */
+			pthread_mutex_lock(&entry->verify_lock);
+			if (!entry->verified) {
+				memcpy(entry->verified_key, key_md, SHA_DIGEST_LENGTH);
+				__atomic_store_n(&entry->verified, 1, __ATOMIC_RELEASE);
+			}
+			/* ENTRY VERIFY UNLOCK */
+			pthread_mutex_unlock(&entry->verify_lock);
+		}
+
+		/* check date of CRL to make sure it's not expired */
+		if (X509_CRL_get0_nextUpdate(entry->crl) == NULL) {
+			nc_verb_error("Cert verify CRL: invalid nextUpdate field.");
+			return X509_V_ERR_ERROR_IN_CRL_NEXT_UPDATE_FIELD;
+		}
+		if (X509_cmp_current_time(X509_CRL_get0_nextUpdate(entry->crl)) < 0) {
+			nc_verb_error("Cert verify CRL: expired - revoking all certificates.");
+			return X509_V_ERR_CRL_HAS_EXPIRED;
+		}
+	}
+
+	return 0;
+}
+
+static int tls_verify_callback(int preverify_ok, X509_STORE_CTX* x509_ctx) {
+	X509_NAME* subject;
+	X509_NAME* issuer;
+	X509* cert;
+	STACK_OF(X509)* cert_chain_stack;
+	SSL* cur_tls;
+	struct client_struct_tls* new_client;
+	struct crl_store* store;
+	long serial;
+	int rc, depth;
+	unsigned int slot;
+	char* cp;
+	CTN_MAP_TYPE map_type = 0;
+
+	/* get the new client structure */
+	cur_tls = X509_STORE_CTX_get_ex_data(x509_ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
+	new_client = (struct client_struct_tls*)SSL_get_ex_data(cur_tls, netopeer_state.tls_state->client_idx);
+	if (new_client == NULL) {
+		nc_verb_error("%s: internal error (%s:%d)", __func__, __FILE__, __LINE__);
+		return 0;
+	}
+
+	/* get the last certificate, that is the peer (client) certificate */
+	if (new_client->cert == NULL) {
+		cert_chain_stack = X509_STORE_CTX_get1_chain(x509_ctx);
+		while ((cert = sk_X509_pop(cert_chain_stack)) != NULL) {
+			X509_free(new_client->cert);
+			new_client->cert = cert;
+		}
+		sk_X509_pop_free(cert_chain_stack, X509_free);
+	}
+
+	/* standard certificate verification failed, so a local client cert must match to continue */
+	if (!preverify_ok) {
+		if (!trusted_client_match(new_client->cert)) {
+			nc_verb_error("Cert verify: fail (%s).", X509_verify_cert_error_string(X509_STORE_CTX_get_error(x509_ctx)));
+			return 0;
+		}
+
+		/* we are just overriding the failed standard certificate verification (preverify_ok == 0),
+		 * this callback will be called again with the same current certificate and preverify_ok == 1 */
+		nc_verb_warning("Cert verify: fail (%s), but the client certificate is trusted, continuing.", X509_verify_cert_error_string(X509_STORE_CTX_get_error(x509_ctx)));
+		X509_STORE_CTX_set_error(x509_ctx, X509_V_OK);
+		return 1;
+	}
+
+	/* print cert verify info */
+	depth = X509_STORE_CTX_get_error_depth(x509_ctx);
+	nc_verb_verbose("Cert verify: depth %d", depth);
+
+	cert = X509_STORE_CTX_get_current_cert(x509_ctx);
+	subject = X509_get_subject_name(cert);
+	issuer = X509_get_issuer_name(cert);
+
+	cp = X509_NAME_oneline(subject, NULL, 0);
+	nc_verb_verbose("Cert verify: subject: %s", cp);
+	OPENSSL_free(cp);
+	cp = X509_NAME_oneline(issuer, NULL, 0);
+	nc_verb_verbose("Cert verify: issuer:  %s", cp);
+	OPENSSL_free(cp);
+
+	/* check for revocation if set */
+	slot = np_epoch_enter(&crl_store_epoch);
+	store = __atomic_load_n(&crl_store, __ATOMIC_SEQ_CST);
+
+	if (store != NULL) {
+		/* the CRLs issued by the current certificate */
+		if ((rc = crl_store_check_issued(store, cert)) != 0) {
+			np_epoch_leave(&crl_store_epoch, slot);
+			X509_STORE_CTX_set_error(x509_ctx, rc);
+			return 0;
+		}
+
+		/* the CRLs of its issuer that could revoke it */
+		if (crl_store_revoked(store, issuer, X509_get_serialNumber(cert))) {
+			np_epoch_leave(&crl_store_epoch, slot);
+			serial = ASN1_INTEGER_get(X509_get_serialNumber(cert));
+			cp = X509_NAME_oneline(issuer, NULL, 0);
+			nc_verb_error("Cert verify CRL: certificate with serial %ld (0x%lX) revoked per CRL from issuer %s", serial, serial, cp);
+			OPENSSL_free(cp);
+			X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_CERT_REVOKED);
+			return 0;
+		}
+	}
+
+	np_epoch_leave(&crl_store_epoch, slot);
+
+	/* cert-to-name already successful */
+	if (new_client->common.username != NULL) {
+		return 1;
+	}
+
+	/* cert-to-name */
+	if (tls_cert_to_name(cert, &map_type, &cp) != 0) {
+		/* cert-to-name was not successful on this certificate */
+		goto fail;
+	}
+
+	if (map_type == CTN_MAP_TYPE_SPECIFIED) {
+		new_client->common.username = cp;
+	} else if (tls_ctn_get_username_from_cert(new_client->cert, map_type, &new_client->common.username) != 0) {
+		goto fail;
+	}
+
+	nc_verb_verbose("Cert verify CTN: new client username recognized as '%s'.", new_client->common.username);
+	return 1;
+
+fail:
+	if (depth > 0) {
+		nc_verb_verbose("Cert verify CTN: cert fail: cert-to-name will continue on the next cert in chain");
+		return 1;
+	}
+
+	nc_verb_error("Cert-to-name unsuccessful, dropping the new client.");
+	X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_APPLICATION_VERIFICATION);
+	return 0;
+}
+
+static int create_netconf_session(struct client_struct_tls* client) {
+	struct nc_cpblts* caps = NULL;
 
 	caps = nc_session_get_cpblts_default();
-	client->nc_sess = nc_session_accept_tls(caps, client->username, client->tls);
+	client->nc_sess = nc_session_accept_tls(caps, client->common.username, client->tls);
 	nc_cpblts_free(caps);
-	if (client->to_free == 1) {
+	if (client->common.to_free == 1) {
 		/* probably a signal received */
 		if (client->nc_sess != NULL) {
 			/* unlikely to happen */
@@ -726,52 +1133,83 @@ static int create_netconf_session(struct client_struct_tls* client) {
 	}
 	if (client->nc_sess == NULL) {
 		nc_verb_error("%s: failed to create a new NETCONF session", __func__);
-		client->to_free = 1;
+		client->common.to_free = 1;
 		return EXIT_FAILURE;
 	}
 
-	nc_verb_verbose("New server session for '%s' with ID %s", client->username, nc_session_get_id(client->nc_sess));
-	gettimeofday((struct timeval*)&client->last_rpc_time, NULL);
+	nc_verb_verbose("New server session for '%s' with ID %s", client->common.username, nc_session_get_id(client->nc_sess));
+	if ((client->rpcq = np_rpcq_new(&client->common, client->nc_sess)) == NULL) {
+		nc_session_free(client->nc_sess);
+		client->nc_sess = NULL;
+		client->common.to_free = 1;
+		return EXIT_FAILURE;
+	}
+	if (np_registry_add_session(nc_session_get_id(client->nc_sess), &client->common, &client->common.to_free) != EXIT_SUCCESS) {
+		np_rpcq_free(client->rpcq);
+		client->rpcq = NULL;
+		nc_session_free(client->nc_sess);
+		client->nc_sess = NULL;
+		client->common.to_free = 1;
+		return EXIT_FAILURE;
+	}
+	client->last_rpc_time = np_clock_ms();
 
 	return EXIT_SUCCESS;
 }
 
-int np_tls_kill_session(const char* sid, struct client_struct_tls* cur_client) {
-	struct client_struct_tls* kill_client;
+static ssize_t tls_stream_write(void* arg, const char* buf, size_t len) {
+	struct client_struct_tls* client = (struct client_struct_tls*)arg;
+	int ret;
 
-	if (sid == NULL) {
-		return 1;
+	if ((ret = SSL_write(client->tls, buf, len)) > 0) {
+		return ret;
 	}
 
-	for (kill_client = (struct client_struct_tls*)netopeer_state.clients; kill_client != NULL; kill_client = (struct client_struct_tls*)kill_client->next) {
-		if (kill_client->transport != NC_TRANSPORT_TLS || kill_client == cur_client) {
-			continue;
-		}
-
-		if (strcmp(sid, nc_session_get_id(kill_client->nc_sess)) == 0) {
-			break;
-		}
+	switch (SSL_get_error(client->tls, ret)) {
+	case SSL_ERROR_WANT_WRITE:
+		client->common.want_write = 1;
+		return 0;
+	case SSL_ERROR_WANT_READ:
+		return 0;
+	default:
+		return -1;
 	}
+}
 
-	if (kill_client == NULL) {
-		return 1;
-	}
+/* continue writing the streamed reply, returns 1 if there is none anymore */
+static int client_stream(struct client_struct_tls* client, int* skip_sleep) {
+	ssize_t ret;
 
-	kill_client->to_free = 1;
+	client->common.want_write = 0;
+	if ((ret = np_stream_send(client->stream, tls_stream_write, client)) < 0) {
+		nc_verb_error("%s: failed to write a reply to session %s", __func__, nc_session_get_id(client->nc_sess));
+		client->common.to_free = 1;
+		return 0;
+	}
+	if (ret > 0) {
+		++(*skip_sleep);
+		client->last_rpc_time = np_clock_ms();
+	}
 
-	return 0;
+	if (!np_stream_done(client->stream)) {
+		return 0;
+	}
+	np_stream_free(client->stream);
+	client->stream = NULL;
+	return 1;
 }
 
 /* return: 0 - nothing happened (sleep), 1 - something happened (skip sleep) */
 int np_tls_client_netconf_rpc(struct client_struct_tls* client) {
 	nc_rpc* rpc = NULL;
 	nc_reply* rpc_reply = NULL;
+	char* reply_data;
 	NC_MSG_TYPE rpc_type;
-	xmlNodePtr op;
-	int closing = 0, skip_sleep = 0;
+	int closing, skip_sleep = 0;
 	struct nc_err* err;
+	struct np_subscriber* subscriber;
 
-	if (client->to_free) {
+	if (client->common.to_free) {
 		return 1;
 	}
 
@@ -779,6 +1217,54 @@ int np_tls_client_netconf_rpc(struct client_struct_tls* client) {
 		return 1;
 	}
 
+	/* nothing else can be sent before the streamed reply is finished */
+	if (client->stream != NULL && !client_stream(client, &skip_sleep)) {
+		return skip_sleep;
+	}
+
+	/* send the replies of the executed RPCs */
+	while ((rpc_reply = np_rpcq_pop_reply(client->rpcq, &rpc, &reply_data, &closing)) != NULL) {
+		++skip_sleep;
+		if (np_rpcq_streamable(client->rpcq)) {
+			client->stream = np_stream_new(client->nc_sess, rpc, rpc_reply, reply_data, np_rpcq_memacct(client->rpcq));
+		} else {
+			free(reply_data);
+		}
+		if (client->stream == NULL) {
+			nc_session_send_reply(client->nc_sess, rpc, rpc_reply);
+		}
+		nc_reply_free(rpc_reply);
+		nc_rpc_free(rpc);
+		client->last_rpc_time = np_clock_ms();
+
+		/* so that we do not free the client before
+		 * this reply gets sent
+		 */
+		if (closing) {
+			nc_verb_verbose("Freeing session for '%s'", client->common.username);
+			np_rpcq_free(client->rpcq);
+			client->rpcq = NULL;
+			np_registry_del_session(nc_session_get_id(client->nc_sess));
+			nc_session_free(client->nc_sess);
+			client->nc_sess = NULL;
+			client->common.to_free = 1;
+			return skip_sleep;
+		}
+		if (client->stream != NULL && !client_stream(client, &skip_sleep)) {
+			return skip_sleep;
+		}
+	}
+
+	/* send the notifications dispatched for this session */
+	if ((subscriber = np_rpcq_subscriber(client->rpcq)) != NULL) {
+		skip_sleep += np_notif_flush(subscriber, client->nc_sess);
+	}
+
+	/* do not read more than the session is allowed to have queued */
+	if (np_rpcq_pending(client->rpcq) >= RPC_QUEUE_LIMIT) {
+		return skip_sleep;
+	}
+
 	/* receive a new RPC */
 	rpc_type = nc_session_recv_rpc(client->nc_sess, 0, &rpc);
 	if (rpc_type == NC_MSG_WOULDBLOCK || rpc_type == NC_MSG_NONE) {
@@ -786,13 +1272,13 @@ int np_tls_client_netconf_rpc(struct client_struct_tls* client) {
 		return skip_sleep;
 	}
 
-	gettimeofday((struct timeval*)&client->last_rpc_time, NULL);
+	client->last_rpc_time = np_clock_ms();
 
 	if (rpc_type == NC_MSG_UNKNOWN) {
 		if (nc_session_get_status(client->nc_sess) != NC_SESSION_STATUS_WORKING) {
 			/* something really bad happened, and communication is not possible anymore */
 			nc_verb_error("%s: failed to receive client's message (nc session not working)", __func__);
-			client->to_free = 1;
+			client->common.to_free = 1;
 		}
 		/* ignore */
 		return 1;
@@ -808,188 +1294,86 @@ int np_tls_client_netconf_rpc(struct client_struct_tls* client) {
 
 	++skip_sleep;
 
-	/* process the new RPC */
-	switch (nc_rpc_get_op(rpc)) {
-	case NC_OP_CLOSESESSION:
-		closing = 1;
-		rpc_reply = nc_reply_ok();
-		break;
-
-	case NC_OP_KILLSESSION:
-		if ((op = ncxml_rpc_get_op_content(rpc)) == NULL || op->name == NULL ||
-				xmlStrEqual(op->name, BAD_CAST "kill-session") == 0) {
-			nc_verb_error("%s: corrupted RPC message", __func__);
-			rpc_reply = nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
-			err = NULL;
-			xmlFreeNodeList(op);
-			break;
-		}
-		if (op->children == NULL || xmlStrEqual(op->children->name, BAD_CAST "session-id") == 0) {
-			nc_verb_error("%s: no session ID found");
-			err = nc_err_new(NC_ERR_MISSING_ELEM);
-			nc_err_set(err, NC_ERR_PARAM_INFO_BADELEM, "session-id");
-			rpc_reply = nc_reply_error(err);
-			err = NULL;
-			xmlFreeNodeList(op);
-			break;
-		}
-
-		/* block-local variables */
-		char* sid;
-		int ret;
-
-		sid = (char*)xmlNodeGetContent(op->children);
-		xmlFreeNodeList(op);
-
-		/* check if this client is not requested to be killed */
-		if (strcmp(nc_session_get_id(client->nc_sess), sid) == 0) {
-			free(sid);
-			err = nc_err_new(NC_ERR_INVALID_VALUE);
-			nc_err_set(err, NC_ERR_PARAM_MSG, "Requested to kill this session.");
-			rpc_reply = nc_reply_error(err);
-			break;
-		}
-
-		ret = 1;
-#ifdef NP_SSH
-		ret = np_ssh_kill_session(sid, (struct client_struct_ssh*)client);
-#endif
-		if (ret != 0 && np_tls_kill_session(sid, client) != 0) {
-			free(sid);
-			err = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(err, NC_ERR_PARAM_MSG, "No session with the requested ID found.");
-			rpc_reply = nc_reply_error(err);
-			break;
-		}
-
-		nc_verb_verbose("Session with the ID %s killed.", sid);
-		rpc_reply = nc_reply_ok();
-
-		free(sid);
-		break;
-
-	case NC_OP_CREATESUBSCRIPTION:
-		/* create-subscription message */
-		if (nc_cpblts_enabled(client->nc_sess, "urn:ietf:params:netconf:capability:notification:1.0") == 0) {
-			rpc_reply = nc_reply_error(nc_err_new(NC_ERR_OP_NOT_SUPPORTED));
-			break;
-		}
-
-		/* check if notifications are allowed on this session */
-		if (nc_session_notif_allowed(client->nc_sess) == 0) {
-			nc_verb_error("%s: notification subscription is not allowed on the session %s", __func__, nc_session_get_id(client->nc_sess));
-			err = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(err, NC_ERR_PARAM_TYPE, "protocol");
-			nc_err_set(err, NC_ERR_PARAM_MSG, "Another notification subscription is currently active on this session.");
-			rpc_reply = nc_reply_error(err);
-			err = NULL;
-			break;
-		}
-
-		rpc_reply = ncntf_subscription_check(rpc);
-		if (nc_reply_get_type(rpc_reply) != NC_REPLY_OK) {
-			break;
-		}
-
-		pthread_t thread;
-		struct ntf_thread_config* ntf_config;
-
-		if ((ntf_config = malloc(sizeof(struct ntf_thread_config))) == NULL) {
-			nc_verb_error("%s: memory allocation failed", __func__);
-			err = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
-			rpc_reply = nc_reply_error(err);
-			err = NULL;
-			break;
-		}
-		ntf_config->session = client->nc_sess;
-		ntf_config->subscribe_rpc = nc_rpc_dup(rpc);
-
-		/* perform notification sending */
-		if ((pthread_create(&thread, NULL, client_notif_thread, ntf_config)) != 0) {
-			nc_reply_free(rpc_reply);
-			err = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(err, NC_ERR_PARAM_MSG, "Creating thread for sending Notifications failed.");
-			rpc_reply = nc_reply_error(err);
-			err = NULL;
-			break;
-		}
-		pthread_detach(thread);
-		break;
-
-	default:
-		if ((rpc_reply = ncds_apply_rpc2all(client->nc_sess, rpc, NULL)) == NULL) {
-			err = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(err, NC_ERR_PARAM_MSG, "For unknown reason no reply was returned by the library.");
-			rpc_reply = nc_reply_error(err);
-		} else if (rpc_reply == NCDS_RPC_NOT_APPLICABLE) {
-			err = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(err, NC_ERR_PARAM_MSG, "There is no device/data that could be affected.");
-			nc_reply_free(rpc_reply);
-			rpc_reply = nc_reply_error(err);
-		}
+	/* close-session is always let through so that a flooding client can still leave */
+	if (nc_rpc_get_op(rpc) != NC_OP_CLOSESESSION && np_ratelimit_rpc(&client->rpc_bucket) != EXIT_SUCCESS) {
+		np_stat_inc(NP_STAT_LIMITED_RPCS);
+		err = nc_err_new(NC_ERR_RES_DENIED);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "Too many RPCs, slow down.");
+		rpc_reply = nc_reply_error(err);
+		nc_session_send_reply(client->nc_sess, rpc, rpc_reply);
+		nc_reply_free(rpc_reply);
+		nc_rpc_free(rpc);
+		return skip_sleep;
+	}
 
-		break;
+	/* let the RPC threads process it, the reply is sent once ready */
+	if (np_rpcq_push(client->rpcq, rpc) != EXIT_SUCCESS) {
+		err = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+		rpc_reply = nc_reply_error(err);
+		nc_session_send_reply(client->nc_sess, rpc, rpc_reply);
+		nc_reply_free(rpc_reply);
+		nc_rpc_free(rpc);
 	}
 
-	/* send reply */
-	nc_session_send_reply(client->nc_sess, rpc, rpc_reply);
-	nc_reply_free(rpc_reply);
-	nc_rpc_free(rpc);
+	return skip_sleep;
+}
 
-	/* so that we do not free the client before
-	 * this reply gets sent
-	 */
-	if (closing) {
-		nc_verb_verbose("Freeing session for '%s'", client->username);
-		nc_session_free(client->nc_sess);
-		client->nc_sess = NULL;
-		client->to_free = 1;
+/*
+ * RPCs being processed count as activity and a session with an active
+ * event subscription can never be disconnected for being idle
+ */
+static int client_idle(struct client_struct_tls* client) {
+	if (client->rpcq != NULL && (np_rpcq_pending(client->rpcq) || np_rpcq_subscriber(client->rpcq) != NULL)) {
+		return 0;
+	}
+	if (client->nc_sess != NULL && ncntf_session_get_active_subscription(client->nc_sess)) {
+		return 0;
 	}
 
-	return skip_sleep;
+	return 1;
 }
 
 /* return: 0 - nothing happened (sleep), 1 - something happened (skip sleep) */
 int np_tls_client_transport(struct client_struct_tls* client) {
-	struct timeval cur_time;
 	int skip_sleep = 0;
 
 	if (quit) {
 		if (client->nc_sess != NULL) {
-			nc_verb_verbose("Freeing session for '%s'", client->username);
+			nc_verb_verbose("Freeing session for '%s'", client->common.username);
+			np_rpcq_free(client->rpcq);
+			client->rpcq = NULL;
+			np_registry_del_session(nc_session_get_id(client->nc_sess));
 			nc_session_free(client->nc_sess);
 			client->nc_sess = NULL;
 		}
-		client->to_free = 1;
+		client->common.to_free = 1;
 	}
 
-	if (client->to_free || client->nc_sess == NULL) {
+	if (client->common.to_free || client->nc_sess == NULL) {
 		return 1;
 	}
 
-	gettimeofday(&cur_time, NULL);
-
 	/* check the session for idle timeout */
-	if (timeval_diff(cur_time, client->last_rpc_time) >= netopeer_options.idle_timeout) {
-		/* check for active event subscriptions, in that case we can never disconnect an idle session */
-		if (client->nc_sess == NULL || !ncntf_session_get_active_subscription(client->nc_sess)) {
-			nc_verb_warning("Session of client '%s' did not send/receive an RPC for too long, disconnecting.", client->username);
-			client->to_free = 1;
-			++skip_sleep;
-		}
+	if (client_idle(client) && np_clock_ms() - client->last_rpc_time >= netopeer_options.idle_timeout*1000ULL) {
+		nc_verb_warning("Session of client '%s' did not send/receive an RPC for too long, disconnecting.", client->common.username);
+		client->common.to_free = 1;
+		++skip_sleep;
 	}
 
 	return skip_sleep;
 }
 
 void np_tls_thread_cleanup(void) {
+#ifdef NP_TLS_LEGACY
 	CRYPTO_THREADID crypto_tid;
 
 	CRYPTO_THREADID_current(&crypto_tid);
 	ERR_remove_thread_state(&crypto_tid);
+#endif
 }
 
+#ifdef NP_TLS_LEGACY
 static void tls_thread_locking_func(int mode, int n, const char* UNUSED(file), int UNUSED(line)) {
 	if (mode & CRYPTO_LOCK) {
 		pthread_mutex_lock(netopeer_state.tls_state->tls_mutex_buf+n);
@@ -1024,13 +1408,378 @@ static void tls_thread_cleanup(void) {
 	}
 	free(netopeer_state.tls_state->tls_mutex_buf);
 }
+#endif
 
 void np_tls_init(void) {
+#ifdef NP_TLS_LEGACY
 	SSL_load_error_strings();
 	SSL_library_init();
+#else
+	/* OpenSSL locks and frees the per-thread state itself */
+	OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
+#endif
 
 	netopeer_state.tls_state = calloc(1, sizeof(struct np_state_tls));
+	netopeer_state.tls_state->client_idx = SSL_get_ex_new_index(0, "netopeer client", NULL, NULL, NULL);
+#ifdef NP_TLS_LEGACY
 	tls_thread_setup();
+#endif
+}
+
+/*
+ * The TLS sessions are resumed either from a session ticket or, for the
+ * clients without ticket support, from the session cache. Both are kept
+ * outside of the SSL_CTX, so they survive it being created again after
+ * a configuration change. Since a resumed handshake skips the client
+ * certificate verification, it is done again afterwards to get the client
+ * username and to apply any revocations or trust changes meanwhile. The
+ * intermediate CA certificates the clients sent are kept for that, they
+ * are not stored in the sessions.
+ */
+struct tls_session_entry {
+	unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	unsigned int id_len;
+	unsigned char* der;			// serialized session
+	int der_len;
+	time_t expires;
+};
+
+struct tls_ticket_key {
+	unsigned char name[16];
+	unsigned char aes_key[32];
+	unsigned char hmac_key[32];
+	uint64_t created;			// np_clock_ms(), 0 if not generated yet
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct tls_session_entry cache[TLS_SESSION_CACHE_SIZE];	// direct-mapped by the session ID
+	struct tls_ticket_key keys[TLS_TICKET_KEYS];			// the current key first
+	STACK_OF(X509)* chain_cache;
+} resumption = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static unsigned int tls_session_slot(const unsigned char* id, unsigned int id_len) {
+	return np_hash(NP_HASH_INIT, id, id_len) % TLS_SESSION_CACHE_SIZE;
+}
+
+static void tls_session_entry_clear(struct tls_session_entry* entry) {
+	free(entry->der);
+	entry->der = NULL;
+	entry->der_len = 0;
+	entry->id_len = 0;
+}
+
+static int tls_session_new_cb(SSL* UNUSED(tls), SSL_SESSION* session) {
+	struct tls_session_entry* entry;
+	const unsigned char* id;
+	unsigned char* der, *ptr;
+	unsigned int id_len;
+	int der_len;
+
+	id = SSL_SESSION_get_id(session, &id_len);
+	if (id_len == 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH || (der_len = i2d_SSL_SESSION(session, NULL)) <= 0) {
+		return 0;
+	}
+	if ((der = malloc(der_len)) == NULL) {
+		nc_verb_error("%s: memory allocation failed (%s:%d)", __func__, __FILE__, __LINE__);
+		return 0;
+	}
+	ptr = der;
+	i2d_SSL_SESSION(session, &ptr);
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+	entry = &resumption.cache[tls_session_slot(id, id_len)];
+	tls_session_entry_clear(entry);
+	memcpy(entry->id, id, id_len);
+	entry->id_len = id_len;
+	entry->der = der;
+	entry->der_len = der_len;
+	entry->expires = SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session);
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+
+	/* the session was not kept */
+	return 0;
+}
+
+static SSL_SESSION* tls_session_get_cb(SSL* UNUSED(tls), TLS_SESSION_ID* id, int id_len, int* copy) {
+	struct tls_session_entry* entry;
+	SSL_SESSION* session = NULL;
+	const unsigned char* ptr;
+
+	/* the session is a new object, nobody else holds a reference */
+	*copy = 0;
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+	entry = &resumption.cache[tls_session_slot(id, id_len)];
+	if (entry->der != NULL && entry->id_len == (unsigned int)id_len && memcmp(entry->id, id, id_len) == 0) {
+		if (entry->expires <= time(NULL)) {
+			tls_session_entry_clear(entry);
+		} else {
+			ptr = entry->der;
+			session = d2i_SSL_SESSION(NULL, &ptr, entry->der_len);
+		}
+	}
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+
+	return session;
+}
+
+static void tls_session_remove_cb(SSL_CTX* UNUSED(tlsctx), SSL_SESSION* session) {
+	struct tls_session_entry* entry;
+	const unsigned char* id;
+	unsigned int id_len;
+
+	id = SSL_SESSION_get_id(session, &id_len);
+	if (id_len == 0) {
+		return;
+	}
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+	entry = &resumption.cache[tls_session_slot(id, id_len)];
+	if (entry->der != NULL && entry->id_len == id_len && memcmp(entry->id, id, id_len) == 0) {
+		tls_session_entry_clear(entry);
+	}
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+}
+
+/* RESUMPTION LOCK must be held */
+static int tls_ticket_keys_rotate(void) {
+	struct tls_ticket_key key;
+	uint64_t now;
+
+	now = np_clock_ms();
+	if (resumption.keys[0].created && now - resumption.keys[0].created < TLS_TICKET_KEY_LIFETIME*1000ULL) {
+		return EXIT_SUCCESS;
+	}
+
+	if (RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1
+			|| RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+		nc_verb_error("%s: failed to generate a session ticket key (%s)", __func__, ERR_reason_error_string(ERR_get_error()));
+		OPENSSL_cleanse(&key, sizeof(key));
+		/* keep using the current key, if any */
+		return (resumption.keys[0].created ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	key.created = now;
+
+	OPENSSL_cleanse(&resumption.keys[TLS_TICKET_KEYS-1], sizeof(struct tls_ticket_key));
+	memmove(&resumption.keys[1], &resumption.keys[0], (TLS_TICKET_KEYS-1)*sizeof(struct tls_ticket_key));
+	resumption.keys[0] = key;
+	OPENSSL_cleanse(&key, sizeof(key));
+
+	return EXIT_SUCCESS;
+}
+
+static int tls_ticket_mac_init(TLS_TICKET_MAC_CTX* mac_ctx, struct tls_ticket_key* key) {
+#ifdef TLS_TICKET_EVP_MAC
+	OSSL_PARAM params[3];
+
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmac_key, sizeof(key->hmac_key));
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+	return EVP_MAC_CTX_set_params(mac_ctx, params);
+#else
+	return HMAC_Init_ex(mac_ctx, key->hmac_key, sizeof(key->hmac_key), EVP_sha256(), NULL);
+#endif
+}
+
+static int tls_ticket_key_cb(SSL* UNUSED(tls), unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx, TLS_TICKET_MAC_CTX* mac_ctx, int enc) {
+	struct tls_ticket_key* key;
+	int i, ret = -1;
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+
+	if (tls_ticket_keys_rotate() != EXIT_SUCCESS) {
+		goto unlock;
+	}
+
+	if (enc) {
+		key = &resumption.keys[0];
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+			goto unlock;
+		}
+		memcpy(key_name, key->name, sizeof(key->name));
+		if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv) != 1 || tls_ticket_mac_init(mac_ctx, key) != 1) {
+			goto unlock;
+		}
+		ret = 1;
+	} else {
+		for (i = 0; i < TLS_TICKET_KEYS; ++i) {
+			if (resumption.keys[i].created && memcmp(key_name, resumption.keys[i].name, sizeof(resumption.keys[i].name)) == 0) {
+				break;
+			}
+		}
+		if (i == TLS_TICKET_KEYS) {
+			/* unknown or too old key, a full handshake */
+			ret = 0;
+			goto unlock;
+		}
+
+		key = &resumption.keys[i];
+		if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv) != 1 || tls_ticket_mac_init(mac_ctx, key) != 1) {
+			goto unlock;
+		}
+		/* the ticket of an older key is renewed */
+		ret = (i == 0 ? 1 : 2);
+	}
+
+unlock:
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+	return ret;
+}
+
+/* remember the intermediate CA certificates of a full handshake */
+static void tls_chain_cache_add(SSL* tls) {
+	STACK_OF(X509)* chain;
+	X509* cert;
+	int i, j;
+
+	/* on the server side the chain does not include the client certificate itself */
+	if ((chain = SSL_get_peer_cert_chain(tls)) == NULL || sk_X509_num(chain) == 0) {
+		return;
+	}
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+	if (resumption.chain_cache == NULL && (resumption.chain_cache = sk_X509_new_null()) == NULL) {
+		goto unlock;
+	}
+	for (i = 0; i < sk_X509_num(chain); ++i) {
+		cert = sk_X509_value(chain, i);
+		for (j = 0; j < sk_X509_num(resumption.chain_cache); ++j) {
+			if (X509_cmp(cert, sk_X509_value(resumption.chain_cache, j)) == 0) {
+				break;
+			}
+		}
+		if (j < sk_X509_num(resumption.chain_cache)) {
+			continue;
+		}
+
+		if (sk_X509_num(resumption.chain_cache) == TLS_CHAIN_CACHE_SIZE) {
+			X509_free(sk_X509_shift(resumption.chain_cache));
+		}
+		if ((cert = X509_dup(cert)) != NULL && !sk_X509_push(resumption.chain_cache, cert)) {
+			X509_free(cert);
+		}
+	}
+
+unlock:
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+}
+
+/* verify the client certificate of a resumed session the same way as in a full handshake */
+static int tls_resumed_verify(struct client_struct_tls* client) {
+	X509_STORE_CTX* store_ctx;
+	STACK_OF(X509)* untrusted;
+	X509* cert;
+	int ret = EXIT_FAILURE;
+
+	if ((cert = SSL_get_peer_certificate(client->tls)) == NULL) {
+		nc_verb_error("%s: the resumed session has no client certificate", __func__);
+		return EXIT_FAILURE;
+	}
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+	untrusted = (resumption.chain_cache != NULL ? X509_chain_up_ref(resumption.chain_cache) : NULL);
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+
+	if ((store_ctx = X509_STORE_CTX_new()) == NULL
+			|| !X509_STORE_CTX_init(store_ctx, SSL_CTX_get_cert_store(SSL_get_SSL_CTX(client->tls)), cert, untrusted)) {
+		nc_verb_error("%s: failed to initialize the certificate verification (%s)", __func__, ERR_reason_error_string(ERR_get_error()));
+		goto cleanup;
+	}
+	X509_STORE_CTX_set_default(store_ctx, "ssl_client");
+	/* tls_verify_callback() finds the client the same way */
+	X509_STORE_CTX_set_ex_data(store_ctx, SSL_get_ex_data_X509_STORE_CTX_idx(), client->tls);
+	X509_STORE_CTX_set_verify_cb(store_ctx, tls_verify_callback);
+
+	if (X509_verify_cert(store_ctx) == 1 && client->common.username != NULL) {
+		ret = EXIT_SUCCESS;
+	} else {
+		nc_verb_error("Resumed TLS session verification failed (%s).", X509_verify_cert_error_string(X509_STORE_CTX_get_error(store_ctx)));
+	}
+
+cleanup:
+	X509_STORE_CTX_free(store_ctx);
+	sk_X509_pop_free(untrusted, X509_free);
+	X509_free(cert);
+	return ret;
+}
+
+static void tls_resumption_cleanup(void) {
+	int i;
+
+	/* RESUMPTION LOCK */
+	pthread_mutex_lock(&resumption.lock);
+	for (i = 0; i < TLS_SESSION_CACHE_SIZE; ++i) {
+		tls_session_entry_clear(&resumption.cache[i]);
+	}
+	OPENSSL_cleanse(resumption.keys, sizeof(resumption.keys));
+	sk_X509_pop_free(resumption.chain_cache, X509_free);
+	resumption.chain_cache = NULL;
+	/* RESUMPTION UNLOCK */
+	pthread_mutex_unlock(&resumption.lock);
+}
+
+/* TLS_CTX LOCK must be held */
+static void tls_ctx_set_protocol(SSL_CTX* tlsctx) {
+	uint16_t max_version;
+#ifdef NP_TLS_LEGACY
+	long options = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
+#endif
+
+	max_version = netopeer_options.tls_opts->max_version;
+#ifdef NP_TLS_LEGACY
+	if (max_version > TLS1_2_VERSION) {
+		max_version = TLS1_2_VERSION;
+	}
+	if (netopeer_options.tls_opts->min_version > TLS1_VERSION || max_version < TLS1_VERSION) {
+		options |= SSL_OP_NO_TLSv1;
+	}
+	if (netopeer_options.tls_opts->min_version > TLS1_1_VERSION || max_version < TLS1_1_VERSION) {
+		options |= SSL_OP_NO_TLSv1_1;
+	}
+	if (netopeer_options.tls_opts->min_version > TLS1_2_VERSION || max_version < TLS1_2_VERSION) {
+		options |= SSL_OP_NO_TLSv1_2;
+	}
+	SSL_CTX_set_options(tlsctx, options);
+
+	if (netopeer_options.tls_opts->ciphersuites != NULL) {
+		nc_verb_warning("TLS 1.3 ciphersuites are not supported by this OpenSSL, ignoring them.");
+	}
+#else
+	if (!SSL_CTX_set_min_proto_version(tlsctx, netopeer_options.tls_opts->min_version)
+			|| !SSL_CTX_set_max_proto_version(tlsctx, max_version)) {
+		nc_verb_error("Setting the TLS protocol versions failed (%s).", ERR_reason_error_string(ERR_get_error()));
+	}
+	if (netopeer_options.tls_opts->ciphersuites != NULL && !SSL_CTX_set_ciphersuites(tlsctx, netopeer_options.tls_opts->ciphersuites)) {
+		nc_verb_error("Setting the TLS 1.3 ciphersuites failed (%s).", ERR_reason_error_string(ERR_get_error()));
+	}
+#endif
+
+	if (netopeer_options.tls_opts->cipher_list != NULL && !SSL_CTX_set_cipher_list(tlsctx, netopeer_options.tls_opts->cipher_list)) {
+		nc_verb_error("Setting the TLS cipher list failed (%s).", ERR_reason_error_string(ERR_get_error()));
+	}
+
+	if (netopeer_options.tls_opts->ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+		SSL_CTX_set_options(tlsctx, SSL_OP_ENABLE_KTLS);
+#else
+		nc_verb_warning("Kernel TLS is not supported by this OpenSSL, the TLS records are processed by OpenSSL.");
+#endif
+	}
 }
 
 SSL_CTX* np_tls_server_id_check(SSL_CTX* tlsctx) {
@@ -1043,15 +1792,30 @@ SSL_CTX* np_tls_server_id_check(SSL_CTX* tlsctx) {
 	/* Check server keys for a change */
 	if (netopeer_options.tls_opts->tls_ctx_change_flag || tlsctx == NULL) {
 		SSL_CTX_free(tlsctx);
-		if ((ret = SSL_CTX_new(TLSv1_2_server_method())) == NULL) {
+		if ((ret = SSL_CTX_new(TLS_server_method())) == NULL) {
 			nc_verb_error("%s: failed to create SSL context", __func__);
 			return NULL;
 		}
 		SSL_CTX_set_verify(ret, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, tls_verify_callback);
 
+		/* the sessions are stored outside of the context, see tls_session_new_cb() */
+		SSL_CTX_set_session_id_context(ret, (const unsigned char*)"netopeer", 8);
+		SSL_CTX_set_session_cache_mode(ret, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+		SSL_CTX_set_timeout(ret, TLS_SESSION_TIMEOUT);
+		SSL_CTX_sess_set_new_cb(ret, tls_session_new_cb);
+		SSL_CTX_sess_set_get_cb(ret, tls_session_get_cb);
+		SSL_CTX_sess_set_remove_cb(ret, tls_session_remove_cb);
+#ifdef TLS_TICKET_EVP_MAC
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(ret, tls_ticket_key_cb);
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb(ret, tls_ticket_key_cb);
+#endif
+
 		/* TLS_CTX LOCK */
 		pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
 
+		tls_ctx_set_protocol(ret);
+
 		if (netopeer_options.tls_opts->server_cert == NULL || netopeer_options.tls_opts->server_key == NULL) {
 			nc_verb_warning("Server certificate and/or private key not set, client TLS verification will fail.");
 		} else {
@@ -1077,13 +1841,11 @@ SSL_CTX* np_tls_server_id_check(SSL_CTX* tlsctx) {
 				if (trusted_cert->client_cert) {
 					continue;
 				}
-				cert = base64der_to_cert(trusted_cert->cert);
-				if (cert == NULL) {
+				if (trusted_cert_x509(trusted_cert) == NULL) {
 					nc_verb_error("Loading a trusted certificate failed (%s).", ERR_reason_error_string(ERR_get_error()));
 					continue;
 				}
-				X509_STORE_add_cert(trusted_store, cert);
-				X509_free(cert);
+				X509_STORE_add_cert(trusted_store, trusted_cert->x509);
 			}
 
 			SSL_CTX_set_cert_store(ret, trusted_store);
@@ -1098,25 +1860,21 @@ SSL_CTX* np_tls_server_id_check(SSL_CTX* tlsctx) {
 		ret = tlsctx;
 	}
 
-	return ret;
-}
-
-int np_tls_session_count(void) {
-	struct client_struct_tls* client;
-	int count = 0;
-
-	for (client = (struct client_struct_tls*)netopeer_state.clients; client != NULL; client = (struct client_struct_tls*)client->next) {
-		if (client->transport != NC_TRANSPORT_TLS) {
-			continue;
-		}
-		++count;
+	/* Check trusted client certificates for a change */
+	if (netopeer_options.tls_opts->trusted_clients_change_flag || trusted_clients == NULL) {
+		/* TLS_CTX LOCK */
+		pthread_mutex_lock(&netopeer_options.tls_opts->tls_ctx_lock);
+		trusted_clients_rebuild();
+		netopeer_options.tls_opts->trusted_clients_change_flag = 0;
+		/* TLS_CTX UNLOCK */
+		pthread_mutex_unlock(&netopeer_options.tls_opts->tls_ctx_lock);
 	}
 
-	return count;
+	return ret;
 }
 
 int np_tls_create_client(struct client_struct_tls* new_client, SSL_CTX* tlsctx) {
-	int ret;
+	int flags;
 
 	new_client->tls = SSL_new(tlsctx);
 	if (new_client->tls == NULL) {
@@ -1124,32 +1882,115 @@ int np_tls_create_client(struct client_struct_tls* new_client, SSL_CTX* tlsctx)
 		return 1;
 	}
 
-	SSL_set_fd(new_client->tls, new_client->sock);
+	/* the handshake is performed by a worker in np_tls_client_handshake() */
+	if (((flags = fcntl(new_client->common.sock, F_GETFL)) == -1) || (fcntl(new_client->common.sock, F_SETFL, flags | O_NONBLOCK) == -1)) {
+		nc_verb_error("%s: fcntl failed (%s)", __func__, strerror(errno));
+		return 1;
+	}
+
+	SSL_set_fd(new_client->tls, new_client->common.sock);
 	SSL_set_mode(new_client->tls, SSL_MODE_AUTO_RETRY);
+	SSL_set_accept_state(new_client->tls);
+
+	/* for the verify callback */
+	SSL_set_ex_data(new_client->tls, netopeer_state.tls_state->client_idx, new_client);
+
+	/* until the handshake is finished, it is the connection time */
+	new_client->last_rpc_time = np_clock_ms();
+
+	return 0;
+}
 
-	/* generate new index for TLS-specific data, for the verify callback */
-	netopeer_state.tls_state->last_tls_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
-	SSL_set_ex_data(new_client->tls, netopeer_state.tls_state->last_tls_idx, new_client);
+/*
+ * OpenSSL enables kernel TLS itself once the handshake finishes
+ * (SSL_OP_ENABLE_KTLS), if the kernel supports the negotiated cipher,
+ * all the following SSL_read() and SSL_write() calls then only copy
+ * the plain data to and from the socket.
+ */
+static void tls_ktls_check(struct client_struct_tls* client) {
+#ifdef SSL_OP_ENABLE_KTLS
+	if (!(SSL_get_options(client->tls) & SSL_OP_ENABLE_KTLS)) {
+		return;
+	}
 
-	while (((ret = SSL_accept(new_client->tls)) == -1) && (SSL_get_error(new_client->tls, ret) == SSL_ERROR_WANT_READ)) {
-		usleep(READ_SLEEP);
+	if (BIO_get_ktls_send(SSL_get_wbio(client->tls))) {
+		client->ktls |= NP_KTLS_SEND;
 	}
-	if (ret != 1) {
-		nc_verb_error("TLS accept failed (%s).", ERR_reason_error_string(ERR_get_error()));
-		return 1;
+	if (BIO_get_ktls_recv(SSL_get_rbio(client->tls))) {
+		client->ktls |= NP_KTLS_RECV;
 	}
+	if (client->ktls) {
+		__sync_fetch_and_add(&ktls_session_count, 1);
+		nc_verb_verbose("TLS session with %s uses kernel TLS to %s.", SSL_get_cipher_name(client->tls),
+				(client->ktls == (NP_KTLS_SEND | NP_KTLS_RECV) ? "send and receive" : (client->ktls & NP_KTLS_SEND ? "send" : "receive")));
+	} else {
+		nc_verb_verbose("TLS session with %s not offloaded to the kernel.", SSL_get_cipher_name(client->tls));
+	}
+#else
+	(void)client;
+#endif
+}
 
-	if (fcntl(new_client->sock, F_SETFL, O_NONBLOCK) != 0) {
-		nc_verb_error("%s: fcntl failed (%s)", __func__, strerror(errno));
+unsigned int np_tls_ktls_count(void) {
+	return __sync_fetch_and_add(&ktls_session_count, 0);
+}
+
+int np_tls_client_handshake(struct client_struct_tls* client) {
+	int ret;
+
+	ret = SSL_accept(client->tls);
+	if (ret == 1) {
+		if (!SSL_session_reused(client->tls)) {
+			tls_chain_cache_add(client->tls);
+			np_stat_inc(NP_STAT_TLS_FULL_HANDSHAKES);
+		} else if (tls_resumed_verify(client) == EXIT_SUCCESS) {
+			np_stat_inc(NP_STAT_TLS_RESUMED_HANDSHAKES);
+		} else {
+			/* the next attempt without this session gets a full handshake */
+			SSL_CTX_remove_session(SSL_get_SSL_CTX(client->tls), SSL_get_session(client->tls));
+			np_stat_inc(NP_STAT_AUTH_FAILURES);
+			np_stat_inc(NP_STAT_HANDSHAKE_FAILURES);
+			return -1;
+		}
+		np_stat_inc(NP_STAT_HANDSHAKES);
+		tls_ktls_check(client);
+		client->last_rpc_time = np_clock_ms();
 		return 1;
 	}
 
-	gettimeofday((struct timeval*)&new_client->last_rpc_time, NULL);
+	ret = SSL_get_error(client->tls, ret);
+	if (ret == SSL_ERROR_WANT_READ || ret == SSL_ERROR_WANT_WRITE) {
+		if (np_clock_ms() - client->last_rpc_time < netopeer_options.handshake_timeout*1000ULL) {
+			return 0;
+		}
 
-	return 0;
+		nc_verb_warning("TLS handshake not finished in %u seconds, dropping a client.", netopeer_options.handshake_timeout);
+		np_stat_inc(NP_STAT_HANDSHAKE_TIMEOUTS);
+	} else {
+		nc_verb_error("TLS accept failed (%s).", ERR_reason_error_string(ERR_get_error()));
+		if (SSL_get_verify_result(client->tls) != X509_V_OK) {
+			/* client certificate rejected */
+			np_stat_inc(NP_STAT_AUTH_FAILURES);
+		}
+	}
+
+	np_stat_inc(NP_STAT_HANDSHAKE_FAILURES);
+	return -1;
+}
+
+uint64_t np_tls_client_deadline(struct client_struct_tls* client) {
+	if (!client->common.handshake_done) {
+		return client->last_rpc_time + netopeer_options.handshake_timeout*1000ULL;
+	}
+	if (client->common.to_free || !client_idle(client)) {
+		return 0;
+	}
+
+	return client->last_rpc_time + netopeer_options.idle_timeout*1000ULL;
 }
 
 void np_tls_cleanup(void) {
+#ifdef NP_TLS_LEGACY
 	CRYPTO_THREADID crypto_tid;
 
 	EVP_cleanup();
@@ -1158,8 +1999,17 @@ void np_tls_cleanup(void) {
 	sk_SSL_COMP_free(SSL_COMP_get_compression_methods());
 	CRYPTO_THREADID_current(&crypto_tid);
 	ERR_remove_thread_state(&crypto_tid);
+#endif
 
+	tls_resumption_cleanup();
+	np_tls_crl_clear();
+	np_tls_ctn_clear();
+	trusted_client_index_free(np_epoch_publish((void**)&trusted_clients, NULL, &trusted_clients_epoch));
+#ifdef NP_TLS_LEGACY
 	tls_thread_cleanup();
+#endif
 	free(netopeer_state.tls_state);
 	netopeer_state.tls_state = NULL;
+
+	np_pool_cleanup(&client_pool);
 }
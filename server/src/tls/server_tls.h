@@ -44,26 +44,37 @@
 #include <sys/socket.h>
 #include <libnetconf.h>
 
+#include "../ratelimit.h"
+#include "../stream.h"
+
+#define NP_KTLS_SEND 0x01
+#define NP_KTLS_RECV 0x02
+
+#ifndef TLS1_3_VERSION
+#	define TLS1_3_VERSION 0x0304
+#endif
+
 /* for each client */
 struct client_struct_tls {
-	NC_TRANSPORT transport;
-
-	int sock;
-	struct sockaddr_storage saddr;
-	pthread_t tid;
-	char* username;
-	volatile int to_free;
-	struct client_struct* next;
+	struct client_struct common;	// must be the first member
 
 	SSL* tls;
 	X509* cert;
 	struct nc_session* nc_sess;
-	volatile struct timeval last_rpc_time;	// timestamp of the last RPC either in or out
+	struct np_rpcq* rpcq;		// RPCs of nc_sess being processed
+	struct np_bucket rpc_bucket;	// RPC rate limit of nc_sess
+	struct np_stream* stream;		// reply being written, see stream.c
+	uint8_t ktls;				// kernel TLS enabled, NP_KTLS_SEND | NP_KTLS_RECV
+
+	/* written also by the threads not owning the client, in a separate cache line */
+	volatile uint64_t last_rpc_time __attribute__((aligned(CACHELINE_SIZE)));	// np_clock_ms() of the last RPC either in or out
 };
 
 struct np_state_tls {
-	int last_tls_idx;
+	int client_idx;			// SSL ex_data index of the client structure
+#ifdef NP_TLS_LEGACY
 	pthread_mutex_t* tls_mutex_buf;
+#endif
 };
 
 int np_tls_client_netconf_rpc(struct client_struct_tls* client);
@@ -76,14 +87,31 @@ void np_tls_init(void);
 
 SSL_CTX* np_tls_server_id_check(SSL_CTX* ctx);
 
-int np_tls_session_count(void);
+/**
+ * @brief Get the number of TLS sessions using kernel TLS
+ *
+ * @return Number of sessions
+ */
+unsigned int np_tls_ktls_count(void);
+
+void np_tls_crl_check(void);
+
+void np_tls_crl_clear(void);
+
+void np_tls_ctn_check(void);
 
-int np_tls_kill_session(const char* sid, struct client_struct_tls* cur_client);
+void np_tls_ctn_clear(void);
 
 int np_tls_create_client(struct client_struct_tls* new_client, SSL_CTX* tlsctx);
 
+int np_tls_client_handshake(struct client_struct_tls* client);
+
+uint64_t np_tls_client_deadline(struct client_struct_tls* client);
+
 void np_tls_cleanup(void);
 
+struct client_struct* np_tls_client_new(void);
+
 void client_free_tls(struct client_struct_tls* client);
 
 #endif /* _SERVER_TLS_H_ */
\ No newline at end of file
@@ -1,23 +1,24 @@
 #ifndef _CFGINTERFACES_H_
 #define _CFGINTERFACES_H_
 
+#include <stdint.h>
 #include <libnetconf_xml.h>
 
 struct device_stats {
 	char reset_time[21];	/* discontinuity time (reset time) */
-	char in_octets[16];		/* total bytes received */
-	char in_pkts[16];		/* total packets received */
+	uint64_t in_octets;		/* total bytes received */
+	uint64_t in_pkts;		/* total packets received */
 	/* missing in-broadcast-pkts */
-	char in_mult_pkts[16];	/* multicast packets received */
-	char in_discards[16];	/* no space in linux buffers */
-	char in_errors[16];		/* bad packets received */
+	uint64_t in_mult_pkts;	/* multicast packets received */
+	uint64_t in_discards;	/* no space in linux buffers */
+	uint64_t in_errors;		/* bad packets received */
 	/* missing in-unknown-protos */
-	char out_octets[16];	/* total bytes transmitted */
-	char out_pkts[16];		/* total packets transmitted */
+	uint64_t out_octets;	/* total bytes transmitted */
+	uint64_t out_pkts;		/* total packets transmitted */
 	/* missing out-broadcast-pkts */
 	/* missing out-multicast-pkts */
-	char out_discards[16];	/* no space available in linux  */
-	char out_errors[16];	/* packet transmit problems */
+	uint64_t out_discards;	/* no space available in linux  */
+	uint64_t out_errors;	/* packet transmit problems */
 };
 
 struct ip_addrs {
@@ -31,6 +32,9 @@ struct ip_addrs {
 
 void iface_cleanup(void);
 
+/* write the configuration files modified since the last call back to the disk */
+int iface_flush_files(char** msg);
+
 /* config */
 int iface_enabled(const char* if_name, unsigned char boolean, char** msg);
 
@@ -59,6 +63,8 @@ char* iface_get_operstatus(const char* if_name, char** msg);
 char* iface_get_lastchange(const char* if_name, char** msg);
 char* iface_get_hwaddr(const char* if_name, char** msg);
 char* iface_get_speed(const char* if_name, char** msg);
+/* read the counters of all the interfaces at once, iface_get_stats() then returns them */
+int iface_snapshot_stats(char** msg);
 int iface_get_stats(const char* if_name, struct device_stats* stats, char** msg);
 
 int iface_get_ipv4_presence(unsigned char config, const char* if_name, char** msg);
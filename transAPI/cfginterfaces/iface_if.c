@@ -11,10 +11,16 @@
 #include <dirent.h>
 #include <time.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <net/if.h>
+#include <linux/if.h>
+#include <linux/rtnetlink.h>
 #include <libnetconf_xml.h>
 
 #include "cfginterfaces.h"
 #include "config.h"
+#include "iface_nl.h"
+#include "iface_mon.h"
 
 extern int callback_if_interfaces_if_interface_ip_ipv4_ip_address(void** data, XMLDIFF_OP op, xmlNodePtr node, struct nc_err** error);
 extern int callback_if_interfaces_if_interface_ip_ipv4_ip_neighbor(void** data, XMLDIFF_OP op, xmlNodePtr node, struct nc_err** error);
@@ -254,37 +260,190 @@ static char* read_from_sys_net(const char* if_name, const char* variable) {
 	return strdup(ret);
 }
 
-#if defined(REDHAT) || defined(SUSE)
-/* variables ending with the "x" suffix get a unique suffix instead,
- * other variables are rewritten if found in the file
+/*
+ * Cache of the ifcfg files (the interfaces file on Debian), each one is read only once
+ * and kept until it changes on the disk. The helpers below modify the cached content,
+ * iface_flush_files() then writes every modified file back in one atomic replace.
  */
-static int write_ifcfg_var(const char* if_name, const char* variable, const char* value, char** suffix) {
-	int fd = -1, i;
-	unsigned int size;
-	char* path, *content = NULL, *ptr, *ptr2, *tmp = NULL, *new_var = NULL;
+struct ifcfg_file {
+	char* path;
+	char* content;
+	unsigned char dirty;
+	struct stat st;			/* of the file the content was read from or written to */
+	struct ifcfg_file* next;
+};
 
-	asprintf(&path, "%s/ifcfg-%s", IFCFG_FILES_PATH, if_name);
+static struct ifcfg_file* ifcfg_files;
 
-	if ((fd = open(path, O_RDWR)) == -1) {
-		goto fail;
+static void ifcfg_file_drop(struct ifcfg_file* file) {
+	struct ifcfg_file** prev;
+
+	for (prev = &ifcfg_files; *prev != file; prev = &(*prev)->next);
+	*prev = file->next;
+
+	free(file->path);
+	free(file->content);
+	free(file);
+}
+
+static struct ifcfg_file* ifcfg_file_get(const char* path) {
+	int fd;
+	struct ifcfg_file* file;
+	struct stat st;
+
+	for (file = ifcfg_files; file != NULL; file = file->next) {
+		if (strcmp(file->path, path) == 0) {
+			break;
+		}
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
+	/* not written yet, our content is the newest one */
+	if (file != NULL && file->dirty) {
+		return file;
 	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
+
+	if (stat(path, &st) == -1) {
+		if (file != NULL) {
+			ifcfg_file_drop(file);
+		}
+		return NULL;
 	}
 
-	content = malloc(size+1);
+	if (file != NULL) {
+		if (file->st.st_ino == st.st_ino && file->st.st_dev == st.st_dev && file->st.st_size == st.st_size &&
+				file->st.st_mtim.tv_sec == st.st_mtim.tv_sec && file->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec) {
+			return file;
+		}
+		/* changed on the disk */
+		ifcfg_file_drop(file);
+	}
 
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return NULL;
+	}
+
+	file = calloc(1, sizeof(struct ifcfg_file));
+	file->content = malloc(st.st_size+1);
+	if (read(fd, file->content, st.st_size) != st.st_size) {
+		close(fd);
+		free(file->content);
+		free(file);
+		return NULL;
+	}
+	close(fd);
+	file->content[st.st_size] = '\0';
+
+	file->path = strdup(path);
+	file->st = st;
+	file->next = ifcfg_files;
+	ifcfg_files = file;
+
+	return file;
+}
+
+/* copy of the current content of the file, NULL if it cannot be read */
+static char* ifcfg_file_read(const char* path) {
+	struct ifcfg_file* file;
+
+	if ((file = ifcfg_file_get(path)) == NULL) {
+		return NULL;
+	}
+
+	return strdup(file->content);
+}
+
+/* the new content written into (*out) replaces the current content of the file,
+ * (*out) is closed and (*new_content) taken in any case
+ */
+static int ifcfg_file_replace(const char* path, FILE** out, char** new_content) {
+	int err;
+	struct ifcfg_file* file;
+
+	err = ferror(*out);
+	fclose(*out);
+	*out = NULL;
+
+	if (err || (file = ifcfg_file_get(path)) == NULL) {
+		free(*new_content);
+		*new_content = NULL;
+		return EXIT_FAILURE;
+	}
+
+	free(file->content);
+	file->content = *new_content;
+	*new_content = NULL;
+	file->dirty = 1;
+
+	return EXIT_SUCCESS;
+}
+
+int iface_flush_files(char** msg) {
+	int fd, ret = EXIT_SUCCESS;
+	char* tmp_path;
+	size_t len;
+	struct ifcfg_file* file, *next;
+
+	for (file = ifcfg_files; file != NULL; file = next) {
+		next = file->next;
+		if (!file->dirty) {
+			continue;
+		}
+
+		/* write a new file next to the old one and replace it, so that it is never seen half-written */
+		asprintf(&tmp_path, "%s.tmp", file->path);
+		len = strlen(file->content);
+		if ((fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, file->st.st_mode & 07777)) == -1) {
+			goto fail;
+		}
+		if (fchown(fd, file->st.st_uid, file->st.st_gid) == -1 || write(fd, file->content, len) != len ||
+				fsync(fd) == -1) {
+			close(fd);
+			unlink(tmp_path);
+			goto fail;
+		}
+		close(fd);
+		if (rename(tmp_path, file->path) == -1) {
+			unlink(tmp_path);
+			goto fail;
+		}
+		free(tmp_path);
+
+		file->dirty = 0;
+		if (stat(file->path, &file->st) == -1) {
+			ifcfg_file_drop(file);
+		}
+		continue;
+
+fail:
+		if (ret == EXIT_SUCCESS) {
+			asprintf(msg, "%s: failed to write \"%s\" (%s).", __func__, file->path, strerror(errno));
+		}
+		ret = EXIT_FAILURE;
+		free(tmp_path);
+		/* the changes are lost, read the file again next time */
+		ifcfg_file_drop(file);
+	}
+
+	return ret;
+}
+
+#if defined(REDHAT) || defined(SUSE)
+/* variables ending with the "x" suffix get a unique suffix instead,
+ * other variables are rewritten if found in the file
+ */
+static int write_ifcfg_var(const char* if_name, const char* variable, const char* value, char** suffix) {
+	int i;
+	FILE* out = NULL;
+	size_t new_size;
+	char* path, *content = NULL, *new_content = NULL, *ptr, *ptr2, *tmp = NULL, *new_var = NULL;
+
+	asprintf(&path, "%s/ifcfg-%s", IFCFG_FILES_PATH, if_name);
+
+	if ((content = ifcfg_file_read(path)) == NULL) {
 		goto fail;
 	}
-	content[size] = '\0';
 
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
@@ -314,9 +473,7 @@ static int write_ifcfg_var(const char* if_name, const char* variable, const char
 
 	/* write the stuff before the variable, if any */
 	if (ptr != NULL) {
-		if (write(fd, content, ptr-content) != ptr-content) {
-			goto fail;
-		}
+		fwrite(content, 1, ptr-content, out);
 		if ((ptr = strchr(ptr, '\n')) != NULL) {
 			++ptr;
 		}
@@ -324,20 +481,19 @@ static int write_ifcfg_var(const char* if_name, const char* variable, const char
 
 	/* write the variable and its new value */
 	asprintf(&tmp, "%s=%s\n", (new_var == NULL ? variable : new_var), value);
-	if (write(fd, tmp, strlen(tmp)) != strlen(tmp)) {
-		goto fail;
-	}
+	fputs(tmp, out);
 
 	if (ptr == NULL) {
 		ptr = content;
 	}
 
 	/* either write the remaining part of the old content or the whole previous content */
-	if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
+	fputs(ptr, out);
+
+	if (ifcfg_file_replace(path, &out, &new_content) != EXIT_SUCCESS) {
 		goto fail;
 	}
 
-	close(fd);
 	free(path);
 	free(content);
 	free(tmp);
@@ -345,9 +501,10 @@ static int write_ifcfg_var(const char* if_name, const char* variable, const char
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(path);
 	free(content);
 	free(tmp);
@@ -363,34 +520,15 @@ fail:
  * suffix or returns NULL and FREES (*suffix)
  */
 static char* read_ifcfg_var(const char* if_name, const char* variable, char** suffix) {
-	int fd = -1;
-	unsigned int size;
 	unsigned char with_index = 0;
 	char* path, *ptr, *ptr2, *values = NULL, *content = NULL;
 
 	asprintf(&path, "%s/ifcfg-%s", IFCFG_FILES_PATH, if_name);
 
-	if ((fd = open(path, O_RDONLY)) == -1) {
+	if ((content = ifcfg_file_read(path)) == NULL) {
 		goto finish;
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto finish;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto finish;
-	}
-
-	content = malloc((size+1)*sizeof(char));
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto finish;
-	}
-	close(fd);
-	fd = -1;
-	content[size] = '\0';
-
 	/* nasty business, but const holds */
 	if (variable[strlen(variable)-1] == 'x') {
 		variable = strndup(variable, strlen(variable)-1);
@@ -469,9 +607,6 @@ static char* read_ifcfg_var(const char* if_name, const char* variable, char** su
 	}
 
 finish:
-	if (fd != -1) {
-		close(fd);
-	}
 	free(path);
 	free(content);
 	if (with_index) {
@@ -483,31 +618,16 @@ finish:
 
 /* variables ending with the "x" suffix are interpreted as a regexp "*" instead of the "x" */
 static int remove_ifcfg_var(const char* if_name, const char* variable, const char* value, char** suffix) {
-	int fd = -1;
-	unsigned int size;
-	char* path, *content = NULL, *ptr, *ptr2, *new_var = NULL;
+	FILE* out = NULL;
+	size_t new_size;
+	char* path, *content = NULL, *new_content = NULL, *ptr, *ptr2, *new_var = NULL;
 
 	asprintf(&path, "%s/ifcfg-%s", IFCFG_FILES_PATH, if_name);
 
-	if ((fd = open(path, O_RDWR)) == -1) {
+	if ((content = ifcfg_file_read(path)) == NULL) {
 		goto fail;
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto fail;
-	}
-	content[size] = '\0';
-
 	if (variable[strlen(variable)-1] == 'x') {
 		new_var = strndup(variable, strlen(variable)-1);
 		/* find the variable with the exact same value */
@@ -546,24 +666,23 @@ static int remove_ifcfg_var(const char* if_name, const char* variable, const cha
 		*suffix = strndup(ptr2, strchr(ptr2, '=')-ptr2);
 	}
 
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
 	/* write the stuff before the variable */
-	if (write(fd, content, ptr-content) != ptr-content) {
-		goto fail;
-	}
+	fwrite(content, 1, ptr-content, out);
 	if ((ptr = strchr(ptr, '\n')) != NULL) {
 		++ptr;
 	}
 
 	/* write the remaining part of the content */
-	if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
+	fputs(ptr, out);
+
+	if (ifcfg_file_replace(path, &out, &new_content) != EXIT_SUCCESS) {
 		goto fail;
 	}
 
-	close(fd);
 	free(path);
 	free(content);
 	free(new_var);
@@ -571,9 +690,10 @@ static int remove_ifcfg_var(const char* if_name, const char* variable, const cha
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(path);
 	free(content);
 	free(new_var);
@@ -584,9 +704,9 @@ fail:
 
 #ifdef REDHAT
 static int write_ifcfg_multival_var(const char* if_name, const char* variable, const char* value) {
-	int fd = -1;
-	unsigned int size;
-	char* path, *content = NULL, *ptr, *ptr2, *tmp = NULL;
+	FILE* out = NULL;
+	size_t new_size;
+	char* path, *content = NULL, *new_content = NULL, *ptr, *ptr2, *tmp = NULL;
 
 	if ((ptr = read_ifcfg_var(if_name, variable, NULL)) != NULL && strstr(ptr, value) != NULL) {
 		free(ptr);
@@ -595,26 +715,11 @@ static int write_ifcfg_multival_var(const char* if_name, const char* variable, c
 
 	asprintf(&path, "%s/ifcfg-%s", IFCFG_FILES_PATH, if_name);
 
-	if ((fd = open(path, O_RDWR)) == -1) {
-		goto fail;
-	}
-
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
+	if ((content = ifcfg_file_read(path)) == NULL) {
 		goto fail;
 	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
 
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto fail;
-	}
-	content[size] = '\0';
-
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
@@ -629,17 +734,13 @@ static int write_ifcfg_multival_var(const char* if_name, const char* variable, c
 
 	/* write the stuff before the variable, if any */
 	if (ptr != NULL) {
-		if (write(fd, content, ptr-content) != ptr-content) {
-			goto fail;
-		}
+		fwrite(content, 1, ptr-content, out);
 	}
 
 	/* write the variable and its new value */
 	if (ptr == NULL) {
 		asprintf(&tmp, "%s=%s\n", variable, value);
-		if (write(fd, tmp, strlen(tmp)) != strlen(tmp)) {
-			goto fail;
-		}
+		fputs(tmp, out);
 		free(tmp);
 		tmp = NULL;
 		ptr = content;
@@ -649,9 +750,7 @@ static int write_ifcfg_multival_var(const char* if_name, const char* variable, c
 			goto fail;
 		}
 		/* ptr:VARIABLE   =   values... */
-		if (write(fd, ptr, (strchr(ptr, '=')+1)-ptr) != (strchr(ptr, '=')+1)-ptr) {
-			goto fail;
-		}
+		fwrite(ptr, 1, (strchr(ptr, '=')+1)-ptr, out);
 
 		ptr = strchr(ptr, '=')+1;
 		/* ptr:    values... */
@@ -662,9 +761,7 @@ static int write_ifcfg_multival_var(const char* if_name, const char* variable, c
 		/* ptr:values... */
 
 		/* we need " for more values */
-		if (write(fd, "\"", 1) != 1) {
-			goto fail;
-		}
+		fputs("\"", out);
 
 		if (ptr[0] != '"') {
 			if (strchr(ptr, '\n') == NULL) {
@@ -690,40 +787,34 @@ static int write_ifcfg_multival_var(const char* if_name, const char* variable, c
 		/* tmp has all the values */
 		ptr2 = strtok(tmp, " \\\n");
 		while (ptr2 != NULL) {
-			if (write(fd, ptr2, strlen(ptr2)) != strlen(ptr2)) {
-				goto fail;
-			}
-			if (write(fd, " \\\n", 3) != 3) {
-				goto fail;
-			}
+			fputs(ptr2, out);
+			fputs(" \\\n", out);
 			ptr2 = strtok(NULL, " \\\n");
 		}
 
 		/* all the previous values are written now */
-		if (write(fd, value, strlen(value)) != strlen(value)) {
-			goto fail;
-		}
-		if (write(fd, "\"\n", 2) != 2) {
-			goto fail;
-		}
+		fputs(value, out);
+		fputs("\"\n", out);
 
 	}
 
 	/* either write the remaining part of the old content or the whole previous content */
-	if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
+	fputs(ptr, out);
+
+	if (ifcfg_file_replace(path, &out, &new_content) != EXIT_SUCCESS) {
 		goto fail;
 	}
 
-	close(fd);
 	free(path);
 	free(content);
 	free(tmp);
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(path);
 	free(content);
 	free(tmp);
@@ -731,32 +822,18 @@ fail:
 }
 
 static int remove_ifcfg_multival_var(const char* if_name, const char* variable, const char* value) {
-	int fd = -1;
-	unsigned int size;
-	char* path, *content = NULL, *ptr, *ptr2, *values = NULL;
+	FILE* out = NULL;
+	size_t new_size;
+	char* path, *content = NULL, *new_content = NULL, *ptr, *ptr2, *values = NULL;
 
 	if ((values = read_ifcfg_var(if_name, variable, NULL)) == NULL || strstr(values, value) == NULL) {
 		goto fail;
 	}
 
 	asprintf(&path, "%s/ifcfg-%s", IFCFG_FILES_PATH, if_name);
-	if ((fd = open(path, O_RDWR)) == -1) {
-		goto fail;
-	}
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
+	if ((content = ifcfg_file_read(path)) == NULL) {
 		goto fail;
 	}
-	content[size] = '\0';
 
 	/* find the exact same variable */
 	ptr = content;
@@ -770,14 +847,12 @@ static int remove_ifcfg_multival_var(const char* if_name, const char* variable,
 		goto fail;
 	}
 
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
 	/* write the stuff before the variable */
-	if (write(fd, content, ptr-content) != ptr-content) {
-		goto fail;
-	}
+	fwrite(content, 1, ptr-content, out);
 
 	/* make ptr point to the next variable */
 	ptr2 = strchr(ptr, '=')+1;
@@ -792,41 +867,32 @@ static int remove_ifcfg_multival_var(const char* if_name, const char* variable,
 
 	/* write the variable with the new content */
 	if (strcmp(values, value) != 0) {
-		if (write(fd, variable, strlen(variable)) != strlen(variable)) {
-			goto fail;
-		}
-		if (write(fd, "=\"", 2) != 2) {
-			goto fail;
-		}
+		fputs(variable, out);
+		fputs("=\"", out);
 
 		ptr2 = strtok(values, " ");
 		while (ptr2 != NULL) {
-			if (write(fd, ptr2, strlen(ptr2)) != strlen(ptr2)) {
-				goto fail;
-			}
+			fputs(ptr2, out);
 
 			if ((ptr2 = strtok(NULL, " ")) != NULL) {
 				if (strcmp(ptr2, value) != 0) {
-					if (write(fd, " \\\n", 3) != 3) {
-						goto fail;
-					}
+					fputs(" \\\n", out);
 				} else {
 					ptr2 = strtok(NULL, " ");
 				}
 			}
 		}
 
-		if (write(fd, "\"\n", 2) != 2) {
-			goto fail;
-		}
+		fputs("\"\n", out);
 	}
 
 	/* write the remaining part of the original content */
-	if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
+	fputs(ptr, out);
+
+	if (ifcfg_file_replace(path, &out, &new_content) != EXIT_SUCCESS) {
 		goto fail;
 	}
 
-	close(fd);
 	free(path);
 	free(content);
 	free(values);
@@ -834,9 +900,10 @@ static int remove_ifcfg_multival_var(const char* if_name, const char* variable,
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(path);
 	free(content);
 	free(values);
@@ -848,30 +915,15 @@ fail:
 #ifdef DEBIAN
 /* post-up variable is treated specially since there can be several of them */
 static int write_iface_subs_var(unsigned char ipv4, const char* if_name, const char* variable, const char* value) {
-	int fd = -1;
-	unsigned int size;
-	char* content = NULL, *ptr, *ptr2, *tmp = NULL;
+	FILE* out = NULL;
+	size_t new_size;
+	char* content = NULL, *new_content = NULL, *ptr, *ptr2, *tmp = NULL;
 
-	if ((fd = open(IFCFG_FILES_PATH, O_RDWR)) == -1) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto fail;
-	}
-	content[size] = '\0';
-
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
@@ -924,76 +976,47 @@ static int write_iface_subs_var(unsigned char ipv4, const char* if_name, const c
 	/* write the new content */
 	if (ptr2 == NULL) {
 		asprintf(&tmp, "\n\t%s %s", variable, value);
-		if (write(fd, content, ptr-content) != ptr-content) {
-			goto fail;
-		}
-		if (write(fd, tmp, strlen(tmp)) != strlen(tmp)) {
-			goto fail;
-		}
-		if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
-			goto fail;
-		}
+		fwrite(content, 1, ptr-content, out);
+		fputs(tmp, out);
+		fputs(ptr, out);
 	} else {
-		if (write(fd, content, ptr2-content) != ptr2-content) {
-			goto fail;
-		}
-		if (write(fd, value, strlen(value)) != strlen(value)) {
-			goto fail;
-		}
+		fwrite(content, 1, ptr2-content, out);
+		fputs(value, out);
 		if (strchr(ptr2, '\n') == NULL) {
-			if (write(fd, "\n", 1) != 1) {
-				goto fail;
-			}
+			fputs("\n", out);
 			ptr2 += strlen(ptr2);
 		} else {
 			ptr2 = strchr(ptr2, '\n');
 		}
-		if (write(fd, ptr2, strlen(ptr2)) != strlen(ptr2)) {
-			goto fail;
-		}
+		fputs(ptr2, out);
+	}
+
+	if (ifcfg_file_replace(IFCFG_FILES_PATH, &out, &new_content) != EXIT_SUCCESS) {
+		goto fail;
 	}
 
-	close(fd);
 	free(content);
 	free(tmp);
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(content);
 	free(tmp);
 	return EXIT_FAILURE;
 }
 
 static char* read_iface_subs_var(unsigned char ipv4, const char* if_name, const char* variable) {
-	int fd = -1;
-	unsigned int size, ret_len = 1, val_len;
+	unsigned int ret_len = 1, val_len;
 	char* content = NULL, *ptr, *ret = NULL, *tmp = NULL;
 
-	if ((fd = open(IFCFG_FILES_PATH, O_RDWR)) == -1) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto fail;
-	}
-	content[size] = '\0';
-
-	close(fd);
-	fd = -1;
-
 	/* find our section */
 	asprintf(&tmp, "iface %s %s ", if_name, (ipv4 ? "inet" : "inet6"));
 	if ((ptr = strstr(content, tmp)) == NULL) {
@@ -1048,45 +1071,26 @@ static char* read_iface_subs_var(unsigned char ipv4, const char* if_name, const
 
 	ret[strlen(ret)-1] = '\0';
 
-	close(fd);
 	free(content);
 	free(tmp);
 	return ret;
 
 fail:
-	if (fd != -1) {
-		close(fd);
-	}
 	free(content);
 	free(tmp);
 	return NULL;
 }
 
 static int remove_iface_subs_var(unsigned char ipv4, const char* if_name, const char* variable, const char* value) {
-	int fd = -1;
-	unsigned int size;
-	char* content = NULL, *ptr, *tmp = NULL;
-
-	if ((fd = open(IFCFG_FILES_PATH, O_RDWR)) == -1) {
-		goto fail;
-	}
-
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
+	FILE* out = NULL;
+	size_t new_size;
+	char* content = NULL, *new_content = NULL, *ptr, *tmp = NULL;
 
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
-	content[size] = '\0';
 
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
@@ -1128,60 +1132,43 @@ static int remove_iface_subs_var(unsigned char ipv4, const char* if_name, const
 	}
 
 	/* write the new content */
-	if (write(fd, content, ptr-content) != ptr-content) {
-		goto fail;
-	}
+	fwrite(content, 1, ptr-content, out);
 	if (strchr(ptr, '\n') == NULL) {
-		if (write(fd, "\n", 1) != 1) {
-			goto fail;
-		}
+		fputs("\n", out);
 		ptr += strlen(ptr);
 	} else {
 		ptr = strchr(ptr, '\n')+1;
 	}
-	if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
+	fputs(ptr, out);
+
+	if (ifcfg_file_replace(IFCFG_FILES_PATH, &out, &new_content) != EXIT_SUCCESS) {
 		goto fail;
 	}
 
-	close(fd);
 	free(content);
 	free(tmp);
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(content);
 	free(tmp);
 	return EXIT_FAILURE;
 }
 
 static int write_iface_method(unsigned char ipv4, const char* if_name, const char* method) {
-	int fd = -1;
-	unsigned int size;
-	char* content = NULL, *ptr, *tmp = NULL;
+	FILE* out = NULL;
+	size_t new_size;
+	char* content = NULL, *new_content = NULL, *ptr, *tmp = NULL;
 
-	if ((fd = open(IFCFG_FILES_PATH, O_RDWR)) == -1) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto fail;
-	}
-	content[size] = '\0';
-
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
@@ -1193,75 +1180,47 @@ static int write_iface_method(unsigned char ipv4, const char* if_name, const cha
 		/* it's not there, add it at the end */
 		free(tmp);
 		asprintf(&tmp, "iface %s %s %s\n", if_name, (ipv4 ? "inet" : "inet6"), method);
-		if (write(fd, content, strlen(content)) != strlen(content)) {
-			goto fail;
-		}
+		fputs(content, out);
 		if (content[strlen(content)-1] != '\n') {
-			if (write(fd, "\n", 1) != 1) {
-				goto fail;
-			}
-		}
-		if (write(fd, tmp, strlen(tmp)) != strlen(tmp)) {
-			goto fail;
+			fputs("\n", out);
 		}
+		fputs(tmp, out);
 	} else {
 		ptr += strlen(tmp);
-		if (write(fd, content, ptr-content) != ptr-content) {
-			goto fail;
-		}
-		if (write(fd, method, strlen(method)) != strlen(method)) {
-			goto fail;
-		}
+		fwrite(content, 1, ptr-content, out);
+		fputs(method, out);
 		if (strchr(ptr, '\n') == NULL) {
 			ptr += strlen(ptr);
 		} else {
 			ptr = strchr(ptr, '\n');
 		}
-		if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
-			goto fail;
-		}
+		fputs(ptr, out);
+	}
+
+	if (ifcfg_file_replace(IFCFG_FILES_PATH, &out, &new_content) != EXIT_SUCCESS) {
+		goto fail;
 	}
 
-	close(fd);
 	free(content);
 	free(tmp);
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(content);
 	free(tmp);
 	return EXIT_FAILURE;
 }
 
 static char* read_iface_method(unsigned char ipv4, const char* if_name) {
-	int fd = -1;
-	unsigned int size;
 	char* content = NULL, *ptr, *tmp = NULL;
 
-	if ((fd = open(IFCFG_FILES_PATH, O_RDONLY)) == -1) {
-		goto fail;
-	}
-
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
-	content[size] = '\0';
-
-	close(fd);
-	fd = -1;
 
 	/* find our interface */
 	asprintf(&tmp, "iface %s %s ", if_name, (ipv4 ? "inet" : "inet6"));
@@ -1275,44 +1234,25 @@ static char* read_iface_method(unsigned char ipv4, const char* if_name) {
 	}
 	ptr = strdup(ptr);
 
-	close(fd);
 	free(content);
 	free(tmp);
 	return ptr;
 
 fail:
-	if (fd != -1) {
-		close(fd);
-	}
 	free(content);
 	free(tmp);
 	return NULL;
 }
 
 static int add_iface_auto(const char* if_name) {
-	int fd = -1;
-	unsigned int size;
-	char* content = NULL, *ptr, *tmp = NULL;
+	FILE* out = NULL;
+	size_t new_size;
+	char* content = NULL, *new_content = NULL, *ptr, *tmp = NULL;
 
-	if ((fd = open(IFCFG_FILES_PATH, O_RDWR)) == -1) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
 
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
-
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		goto fail;
-	}
-	content[size] = '\0';
-
 	/* find our interface */
 	asprintf(&tmp, "iface %s", if_name);
 	if ((ptr = strstr(content, tmp)) == NULL) {
@@ -1326,58 +1266,41 @@ static int add_iface_auto(const char* if_name) {
 		goto success;
 	}
 
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
-	if (write(fd, content, ptr-content) != ptr-content) {
-		goto fail;
-	}
-	if (write(fd, tmp, strlen(tmp)) != strlen(tmp)) {
-		goto fail;
-	}
-	if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
+	fwrite(content, 1, ptr-content, out);
+	fputs(tmp, out);
+	fputs(ptr, out);
+
+	if (ifcfg_file_replace(IFCFG_FILES_PATH, &out, &new_content) != EXIT_SUCCESS) {
 		goto fail;
 	}
 
 success:
-	close(fd);
 	free(content);
 	free(tmp);
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(content);
 	free(tmp);
 	return EXIT_FAILURE;
 }
 
 static int remove_iface_auto(const char* if_name) {
-	int fd = -1;
-	unsigned int size;
-	char* content = NULL, *ptr, *tmp = NULL;
-
-	if ((fd = open(IFCFG_FILES_PATH, O_RDWR)) == -1) {
-		goto fail;
-	}
-
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		goto fail;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		goto fail;
-	}
-
-	content = malloc(size+1);
+	FILE* out = NULL;
+	size_t new_size;
+	char* content = NULL, *new_content = NULL, *ptr, *tmp = NULL;
 
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		goto fail;
 	}
-	content[size] = '\0';
 
 	asprintf(&tmp, "auto %s", if_name);
 	if ((ptr = strstr(content, tmp)) == NULL) {
@@ -1385,63 +1308,41 @@ static int remove_iface_auto(const char* if_name) {
 		goto success;
 	}
 
-	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+	if ((out = open_memstream(&new_content, &new_size)) == NULL) {
 		goto fail;
 	}
 
-	if (write(fd, content, ptr-content) != ptr-content) {
-		goto fail;
-	}
+	fwrite(content, 1, ptr-content, out);
 	if (strchr(ptr, '\n') != NULL) {
 		ptr = strchr(ptr, '\n')+1;
-		if (write(fd, ptr, strlen(ptr)) != strlen(ptr)) {
-			goto fail;
-		}
+		fputs(ptr, out);
+	}
+
+	if (ifcfg_file_replace(IFCFG_FILES_PATH, &out, &new_content) != EXIT_SUCCESS) {
+		goto fail;
 	}
 
 success:
-	close(fd);
 	free(content);
 	free(tmp);
 	return EXIT_SUCCESS;
 
 fail:
-	if (fd != -1) {
-		close(fd);
+	if (out != NULL) {
+		fclose(out);
 	}
+	free(new_content);
 	free(content);
 	free(tmp);
 	return EXIT_FAILURE;
 }
 
 static int present_iface_auto(const char* if_name) {
-	int fd = -1;
-	unsigned int size;
-	char* content = NULL, *tmp = NULL;
-
-	if ((fd = open(IFCFG_FILES_PATH, O_RDONLY)) == -1) {
-		return 0;
-	}
-
-	if ((size = lseek(fd, 0, SEEK_END)) == -1) {
-		close(fd);
-		return 0;
-	}
-	if (lseek(fd, 0, SEEK_SET) == -1) {
-		close(fd);
-		return 0;
-	}
-
-	content = malloc(size+1);
+	char* content, *tmp = NULL;
 
-	/* we store the whole file content */
-	if (read(fd, content, size) != size) {
-		free(content);
-		close(fd);
+	if ((content = ifcfg_file_read(IFCFG_FILES_PATH)) == NULL) {
 		return 0;
 	}
-	close(fd);
-	content[size] = '\0';
 
 	asprintf(&tmp, "auto %s", if_name);
 	if (strstr(content, tmp) != NULL) {
@@ -1466,29 +1367,37 @@ static int iface_ip(unsigned char ipv4, const char* if_name, const char* ip, uns
 	char* cmd, *line = NULL, *value = NULL, str_prefix[4];
 	FILE* output;
 	size_t len = 0;
-
-	asprintf(&cmd, "ip addr %s %s/%d dev %s 2>&1", (op & XMLDIFF_ADD ? "add" : "del"), ip, prefix, if_name);
-	output = popen(cmd, "r");
-	free(cmd);
-
-	if (output == NULL) {
-		asprintf(msg, "%s: failed to execute a command.", __func__);
-		return EXIT_FAILURE;
-	}
+	int ret;
 
 	/*
 	 * The IPs may not be actually set anymore, for instance on the whole "ipv4/6" node deletion.
 	 * Also, when adding an IP, it may already be set if called during init with some manually-
 	 * -added addresses in addition to some obtained by DHCP.
 	 */
-	if (getline(&line, &len, output) != -1 && op & XMLDIFF_ADD && strstr(line, "File exists") == NULL) {
-		asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
+	ret = nl_addr_change(ipv4 ? AF_INET : AF_INET6, if_name, ip, prefix, op & XMLDIFF_ADD);
+	if (ret == NL_UNAVAILABLE) {
+		asprintf(&cmd, "ip addr %s %s/%d dev %s 2>&1", (op & XMLDIFF_ADD ? "add" : "del"), ip, prefix, if_name);
+		output = popen(cmd, "r");
+		free(cmd);
+
+		if (output == NULL) {
+			asprintf(msg, "%s: failed to execute a command.", __func__);
+			return EXIT_FAILURE;
+		}
+
+		if (getline(&line, &len, output) != -1 && op & XMLDIFF_ADD && strstr(line, "File exists") == NULL) {
+			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
+			free(line);
+			pclose(output);
+			return EXIT_FAILURE;
+		}
 		free(line);
+		line = NULL;
 		pclose(output);
+	} else if (ret != 0 && op & XMLDIFF_ADD && ret != EEXIST) {
+		asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
 		return EXIT_FAILURE;
 	}
-	free(line);
-	pclose(output);
 
 	/* permanent */
 	sprintf(str_prefix, "%d", prefix);
@@ -1664,8 +1573,89 @@ static int iface_ip(unsigned char ipv4, const char* if_name, const char* ip, uns
 	return EXIT_SUCCESS;
 }
 
-static int iface_get_neighs(unsigned char ipv4, unsigned char config, const char* if_name, struct ip_addrs* neighs, char** msg) {
+/* flush the addresses of the scope (-1 any) and with the flags (IFA_F_*, only temporary without netlink) */
+static int iface_addr_flush(unsigned char ipv4, const char* if_name, int scope, unsigned int flags, char** msg) {
+	int ret;
+	char* cmd, *line = NULL;
+	FILE* output;
+	size_t len = 0;
+
+	if ((ret = nl_addr_flush(ipv4 ? AF_INET : AF_INET6, if_name, scope, flags)) != NL_UNAVAILABLE) {
+		if (ret != 0) {
+			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	asprintf(&cmd, "ip -%c addr flush dev %s%s%s 2>&1", (ipv4 ? '4' : '6'), if_name,
+			(scope == RT_SCOPE_LINK ? " scope link" : ""), (flags & IFA_F_TEMPORARY ? " temporary" : ""));
+	output = popen(cmd, "r");
+	free(cmd);
+
+	if (output == NULL) {
+		asprintf(msg, "%s: failed to execute a command.", __func__);
+		return EXIT_FAILURE;
+	}
+
+	if (getline(&line, &len, output) != -1) {
+		asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
+		free(line);
+		pclose(output);
+		return EXIT_FAILURE;
+	}
+
+	free(line);
+	pclose(output);
+	return EXIT_SUCCESS;
+}
+
+/* append a neighbor unless it is one of the static ones already stored, state is only for IPv6 */
+static void add_dynamic_neigh(struct ip_addrs* neighs, unsigned char ipv4, const char* ip, const char* mac, unsigned char is_router, const char* state) {
 	int i;
+
+	for (i = 0; i < neighs->count; ++i) {
+		if (strcmp(neighs->ip[i], ip) == 0 && strcmp(neighs->prefix_or_mac[i], mac) == 0) {
+			/* it is a static neighbor */
+			return;
+		}
+	}
+
+	/* add a new neighbor */
+	if (neighs->count == 0) {
+		neighs->ip = malloc(sizeof(char*));
+		neighs->prefix_or_mac = malloc(sizeof(char*));
+		neighs->origin = malloc(sizeof(char*));
+		if (!ipv4) {
+			neighs->status_or_state = malloc(sizeof(char*));
+			neighs->is_router = malloc(sizeof(char));
+		}
+	} else {
+		neighs->ip = realloc(neighs->ip, (neighs->count+1)*sizeof(char*));
+		neighs->prefix_or_mac = realloc(neighs->prefix_or_mac, (neighs->count+1)*sizeof(char*));
+		neighs->origin = realloc(neighs->origin, (neighs->count+1)*sizeof(char*));
+		if (!ipv4) {
+			neighs->status_or_state = realloc(neighs->status_or_state, (neighs->count+1)*sizeof(char*));
+			neighs->is_router = realloc(neighs->is_router, (neighs->count+1)*sizeof(char));
+		}
+	}
+
+	neighs->ip[neighs->count] = strdup(ip);
+	neighs->prefix_or_mac[neighs->count] = strdup(mac);
+	if (!ipv4) {
+		neighs->is_router[neighs->count] = (is_router ? 1 : 0);
+		neighs->status_or_state[neighs->count] = strdup(state);
+	}
+	neighs->origin[neighs->count] = strdup("dynamic");
+	++neighs->count;
+}
+
+static int iface_get_neighs(unsigned char ipv4, unsigned char config, const char* if_name, struct ip_addrs* neighs, char** msg) {
+	int ret;
+	unsigned int j, nl_count;
+	unsigned char is_router;
+	struct nl_neigh* nl_neighs;
+	const char* state;
 	char* cmd, *ptr, *line = NULL, *ip, *mac;
 	FILE* output;
 	size_t len = 0;
@@ -1856,130 +1846,83 @@ static int iface_get_neighs(unsigned char ipv4, unsigned char config, const char
 dynamic_neighs:
 
 	/* static neighbors are stored, now the dynamic ones */
-	if (!config && ipv4) {
-		asprintf(&cmd, "ip -4 neigh show dev %s 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
+	if (config) {
+		return EXIT_SUCCESS;
+	}
 
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
+	if ((ret = nl_get_neighs(ipv4 ? AF_INET : AF_INET6, if_name, &nl_neighs, &nl_count)) != NL_UNAVAILABLE) {
+		if (ret != 0) {
+			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
 			return EXIT_FAILURE;
 		}
 
-		while (getline(&line, &len, output) != -1) {
-			ip = strtok(line, " \n");
-			mac = strtok(NULL, " \n");
-			if (strcmp(mac, "lladdr") == 0) {
-				mac = strtok(NULL, " \n");
-			} else {
-				/* FAILED neighbor, ignore */
-				continue;
-			}
-
-			for (i = 0; i < neighs->count; ++i) {
-				if (strcmp(neighs->ip[i], ip) == 0 && strcmp(neighs->prefix_or_mac[i], mac) == 0) {
-					break;
-				}
-			}
-			/* it is a static neighbor */
-			if (i < neighs->count) {
-				continue;
-			}
-
-			/* add a new neighbor */
-			if (neighs->count == 0) {
-				neighs->ip = malloc(sizeof(char*));
-				neighs->prefix_or_mac = malloc(sizeof(char*));
-				neighs->origin = malloc(sizeof(char*));
+		for (j = 0; j < nl_count; ++j) {
+			if (ipv4) {
+				state = NULL;
+			} else if (nl_neighs[j].state & (NUD_REACHABLE | NUD_NOARP | NUD_PERMANENT)) {
+				state = "reachable";
+			} else if (nl_neighs[j].state & NUD_STALE) {
+				state = "stale";
+			} else if (nl_neighs[j].state & NUD_DELAY) {
+				state = "delay";
+			} else if (nl_neighs[j].state & NUD_PROBE) {
+				state = "probe";
 			} else {
-				neighs->ip = realloc(neighs->ip, (neighs->count+1)*sizeof(char*));
-				neighs->prefix_or_mac = realloc(neighs->prefix_or_mac, (neighs->count+1)*sizeof(char*));
-				neighs->origin = realloc(neighs->origin, (neighs->count+1)*sizeof(char*));
+				state = "incomplete";
 			}
+			add_dynamic_neigh(neighs, ipv4, nl_neighs[j].ip, nl_neighs[j].mac, nl_neighs[j].flags & NTF_ROUTER, state);
+		}
 
-			neighs->ip[neighs->count] = strdup(ip);
-			neighs->prefix_or_mac[neighs->count] = strdup(mac);
-			neighs->origin[neighs->count] = strdup("dynamic");
+		free(nl_neighs);
+		return EXIT_SUCCESS;
+	}
 
-			++neighs->count;
-		}
+	/* no netlink, parse the output of ip */
+	asprintf(&cmd, "ip -%c neigh show dev %s 2>&1", (ipv4 ? '4' : '6'), if_name);
+	output = popen(cmd, "r");
+	free(cmd);
 
-		free(line);
-		pclose(output);
+	if (output == NULL) {
+		asprintf(msg, "%s: failed to execute a command.", __func__);
+		return EXIT_FAILURE;
 	}
-	if (!config && !ipv4) {
-		asprintf(&cmd, "ip -6 neigh show dev %s 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
 
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
-			return EXIT_FAILURE;
+	while (getline(&line, &len, output) != -1) {
+		ip = strtok(line, " \n");
+		ptr = strtok(NULL, " \n");
+		if (ptr != NULL && strcmp(ptr, "lladdr") == 0) {
+			mac = strtok(NULL, " \n");
+			ptr = strtok(NULL, " \n");
+		} else {
+			/* FAILED neighbor, ignore */
+			continue;
 		}
 
-		while (getline(&line, &len, output) != -1) {
-			ip = strtok(line, " \n");
+		is_router = 0;
+		if (ptr != NULL && strcmp(ptr, "router") == 0) {
+			is_router = 1;
 			ptr = strtok(NULL, " \n");
-			if (strcmp(ptr, "lladdr") == 0) {
-				mac = strtok(NULL, " \n");
-				ptr = strtok(NULL, " \n");
-			} else {
-				/* FAILED neighbor, ignore */
-				continue;
-			}
-
-			for (i = 0; i < neighs->count; ++i) {
-				if (strcmp(neighs->ip[i], ip) == 0 && strcmp(neighs->prefix_or_mac[i], mac) == 0) {
-					break;
-				}
-			}
-			/* it is a static neighbor */
-			if (i < neighs->count) {
-				continue;
-			}
-
-			/* add a new neighbor */
-			if (neighs->count == 0) {
-				neighs->ip = malloc(sizeof(char*));
-				neighs->prefix_or_mac = malloc(sizeof(char*));
-				neighs->status_or_state = malloc(sizeof(char*));
-				neighs->origin = malloc(sizeof(char*));
-				neighs->is_router = malloc(sizeof(char));
-			} else {
-				neighs->ip = realloc(neighs->ip, (neighs->count+1)*sizeof(char*));
-				neighs->prefix_or_mac = realloc(neighs->prefix_or_mac, (neighs->count+1)*sizeof(char*));
-				neighs->status_or_state = realloc(neighs->status_or_state, (neighs->count+1)*sizeof(char*));
-				neighs->origin = realloc(neighs->origin, (neighs->count+1)*sizeof(char*));
-				neighs->is_router = realloc(neighs->is_router, (neighs->count+1)*sizeof(char));
-			}
-
-			neighs->ip[neighs->count] = strdup(ip);
-			neighs->prefix_or_mac[neighs->count] = strdup(mac);
-			if (strcmp(ptr, "router") == 0) {
-				neighs->is_router[neighs->count] = 1;
-				ptr = strtok(NULL, " \n");
-			} else {
-				neighs->is_router[neighs->count] = 0;
-			}
-			if (strcmp(ptr, "REACHABLE") == 0 || strcmp(ptr, "NOARP") == 0 || strcmp(ptr, "PERMANENT") == 0) {
-				neighs->status_or_state[neighs->count] = strdup("reachable");
-			} else if (strcmp(ptr, "STALE") == 0) {
-				neighs->status_or_state[neighs->count] = strdup("stale");
-			} else if (strcmp(ptr, "DELAY") == 0) {
-				neighs->status_or_state[neighs->count] = strdup("delay");
-			} else if (strcmp(ptr, "PROBE") == 0) {
-				neighs->status_or_state[neighs->count] = strdup("probe");
-			} else {
-				neighs->status_or_state[neighs->count] = strdup("incomplete");
-			}
-			neighs->origin[neighs->count] = strdup("dynamic");
-			++neighs->count;
 		}
 
-		free(line);
-		pclose(output);
+		if (ipv4) {
+			state = NULL;
+		} else if (ptr != NULL && (strcmp(ptr, "REACHABLE") == 0 || strcmp(ptr, "NOARP") == 0 || strcmp(ptr, "PERMANENT") == 0)) {
+			state = "reachable";
+		} else if (ptr != NULL && strcmp(ptr, "STALE") == 0) {
+			state = "stale";
+		} else if (ptr != NULL && strcmp(ptr, "DELAY") == 0) {
+			state = "delay";
+		} else if (ptr != NULL && strcmp(ptr, "PROBE") == 0) {
+			state = "probe";
+		} else {
+			state = "incomplete";
+		}
+		add_dynamic_neigh(neighs, ipv4, ip, mac, is_router, state);
 	}
 
+	free(line);
+	pclose(output);
+
 	return EXIT_SUCCESS;
 }
 
@@ -2026,25 +1969,32 @@ int iface_enabled(const char* if_name, unsigned char boolean, char** msg) {
 	FILE* output;
 	size_t len = 0;
 
-	asprintf(&cmd, "ip link set dev %s %s 2>&1", if_name, (boolean ? "up" : "down"));
-	output = popen(cmd, "r");
-	free(cmd);
+	if ((ret = nl_link_set_up(if_name, boolean)) == NL_UNAVAILABLE) {
+		asprintf(&cmd, "ip link set dev %s %s 2>&1", if_name, (boolean ? "up" : "down"));
+		output = popen(cmd, "r");
+		free(cmd);
 
-	if (output == NULL) {
-		asprintf(msg, "%s: failed to execute a command.", __func__);
-		return EXIT_FAILURE;
-	}
+		if (output == NULL) {
+			asprintf(msg, "%s: failed to execute a command.", __func__);
+			return EXIT_FAILURE;
+		}
 
-	if (getline(&line, &len, output) == -1) {
-		ret = EXIT_SUCCESS;
-	} else {
-		asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
+		if (getline(&line, &len, output) == -1) {
+			ret = EXIT_SUCCESS;
+		} else {
+			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
+			ret = EXIT_FAILURE;
+		}
+
+		free(line);
+		pclose(output);
+	} else if (ret != 0) {
+		asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
 		ret = EXIT_FAILURE;
+	} else {
+		ret = EXIT_SUCCESS;
 	}
 
-	free(line);
-	pclose(output);
-
 	/* permanent */
 #ifdef REDHAT
 	if (write_ifcfg_var(if_name, "ONBOOT", (boolean ? "yes" : "no"), NULL) != EXIT_SUCCESS)
@@ -2129,39 +2079,51 @@ int iface_ipv4_neighbor(const char* if_name, const char* ip, const char* mac, XM
 	struct stat st;
 #endif
 	size_t len = 0;
+	int ret;
 
-	asprintf(&cmd, "ip neigh %s %s lladdr %s dev %s 2>&1", (op & XMLDIFF_ADD ? "add" : "del"), ip, mac, if_name);
-	output = popen(cmd, "r");
-
-	if (output == NULL) {
-		asprintf(msg, "%s: failed to execute a command.", __func__);
-		goto fail;
-	}
+	/* an existing neighbor is replaced */
+	ret = nl_neigh_change(AF_INET, if_name, ip, mac, op & XMLDIFF_ADD);
+	if (ret == NL_UNAVAILABLE) {
+		asprintf(&cmd, "ip neigh %s %s lladdr %s dev %s 2>&1", (op & XMLDIFF_ADD ? "add" : "del"), ip, mac, if_name);
+		output = popen(cmd, "r");
+		free(cmd);
+		cmd = NULL;
 
-	if (getline(&line, &len, output) != -1 && op & XMLDIFF_ADD) {
-		if (strstr(line, "File exists") != NULL) {
-			pclose(output);
-			asprintf(&cmd, "ip neigh replace %s lladdr %s dev %s 2>&1", ip, mac, if_name);
-			output = popen(cmd, "r");
+		if (output == NULL) {
+			asprintf(msg, "%s: failed to execute a command.", __func__);
+			goto fail;
+		}
 
-			if (output == NULL) {
-				asprintf(msg, "%s: failed to execute a command.", __func__);
-				goto fail;
-			}
+		if (getline(&line, &len, output) != -1 && op & XMLDIFF_ADD) {
+			if (strstr(line, "File exists") != NULL) {
+				pclose(output);
+				asprintf(&cmd, "ip neigh replace %s lladdr %s dev %s 2>&1", ip, mac, if_name);
+				output = popen(cmd, "r");
+				free(cmd);
+				cmd = NULL;
+
+				if (output == NULL) {
+					asprintf(msg, "%s: failed to execute a command.", __func__);
+					goto fail;
+				}
 
-			if (getline(&line, &len, output) != -1) {
+				if (getline(&line, &len, output) != -1) {
+					asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
+					goto fail;
+				}
+			} else {
 				asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
 				goto fail;
 			}
-		} else {
-			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
-			goto fail;
 		}
+		free(line);
+		line = NULL;
+		pclose(output);
+		output = NULL;
+	} else if (ret != 0 && op & XMLDIFF_ADD) {
+		asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
+		goto fail;
 	}
-	free(line);
-	line = NULL;
-	pclose(output);
-	output = NULL;
 
 	/* permanent */
 #if defined(REDHAT) || defined(SUSE)
@@ -2353,46 +2315,15 @@ int iface_ipv4_enabled(const char* if_name, unsigned char enabled, xmlNodePtr no
 			pclose(output);
 		}
 
-		asprintf(&cmd, "ip -4 addr flush dev %s 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
-
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
-			return EXIT_FAILURE;
-		}
-
-		if (getline(&line, &len, output) != -1) {
-			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
-			free(line);
-			pclose(output);
-			return EXIT_FAILURE;
-		}
-
-		free(line);
-		pclose(output);
-
-	/* flush IPv4 addresses and enable DHCP daemon */
-	} else if (enabled == 1) {
-		asprintf(&cmd, "ip -4 addr flush dev %s 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
-
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
-			return EXIT_FAILURE;
-		}
-
-		if (getline(&line, &len, output) != -1) {
-			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
-			free(line);
-			pclose(output);
+		if (iface_addr_flush(1, if_name, -1, 0, msg) != EXIT_SUCCESS) {
 			return EXIT_FAILURE;
 		}
 
-		free(line);
-		line = NULL;
-		pclose(output);
+	/* flush IPv4 addresses and enable DHCP daemon */
+	} else if (enabled == 1) {
+		if (iface_addr_flush(1, if_name, -1, 0, msg) != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
 
 		if (!is_loopback) {
 			asprintf(&cmd, DHCP_CLIENT_RENEW " %s 2>&1", if_name);
@@ -2561,34 +2492,13 @@ int iface_ipv6_dup_addr_det(const char* if_name, unsigned int dup_addr_det, char
 }
 
 int iface_ipv6_creat_glob_addr(const char* if_name, unsigned char boolean, char** msg) {
-	char* cmd, *line = NULL;
-	FILE* output;
-	size_t len = 0;
-
 	if (write_to_proc_net(0, if_name, "autoconf", (boolean ? "1" : "0")) != EXIT_SUCCESS) {
 		asprintf(msg, "%s: interface %s fail: Unable to open/write to \"/proc/sys/net/...\"", __func__, if_name);
 		return EXIT_FAILURE;
 	}
 
-	if (!boolean) {
-		asprintf(&cmd, "ip -6 addr flush dev %s scope link 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
-
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
-			return EXIT_FAILURE;
-		}
-
-		if (getline(&line, &len, output) != -1) {
-			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
-			free(line);
-			pclose(output);
-			return EXIT_FAILURE;
-		}
-
-		free(line);
-		pclose(output);
+	if (!boolean && iface_addr_flush(0, if_name, RT_SCOPE_LINK, 0, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
 	}
 
 	/* permanent */
@@ -2616,9 +2526,6 @@ int iface_ipv6_creat_glob_addr(const char* if_name, unsigned char boolean, char*
 
 int iface_ipv6_creat_temp_addr(const char* if_name, unsigned char boolean, char** msg) {
 	int ret = EXIT_SUCCESS;
-	char* cmd, *line = NULL;
-	FILE* output;
-	size_t len = 0;
 
 	if (write_to_proc_net(0, if_name, "use_tempaddr", (boolean ? "1" : "0")) != EXIT_SUCCESS) {
 		asprintf(msg, "%s: interface %s fail: Unable to open/write to \"/proc/sys/net/...\"", __func__, if_name);
@@ -2626,22 +2533,7 @@ int iface_ipv6_creat_temp_addr(const char* if_name, unsigned char boolean, char*
 	}
 
 	if (!boolean) {
-		asprintf(&cmd, "ip -6 addr flush dev %s temporary 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
-
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
-			return EXIT_FAILURE;
-		}
-
-		if (getline(&line, &len, output) != -1) {
-			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, line);
-			ret = EXIT_FAILURE;
-		}
-
-		free(line);
-		pclose(output);
+		ret = iface_addr_flush(0, if_name, -1, IFA_F_TEMPORARY, msg);
 	}
 
 	/* permanent */
@@ -2832,6 +2724,12 @@ char** iface_get_ifcs(unsigned char config, unsigned int* dev_count, char** msg)
 	}
 	closedir(dir);
 
+	if (config && iface_flush_files(msg) != EXIT_SUCCESS) {
+		nc_verb_warning("%s: failed to write the normalized configuration (%s), some configuration problems may occur.", __func__, *msg);
+		free(*msg);
+		*msg = NULL;
+	}
+
 	if (ret == NULL) {
 		asprintf(msg, "%s: no %snetwork interfaces detected.", __func__, (config ? "managed " : ""));
 	}
@@ -2897,6 +2795,27 @@ char* iface_get_type(const char* if_name, char** msg) {
 
 char* iface_get_operstatus(const char* if_name, char** msg) {
 	char* sysval;
+	unsigned char operstate;
+	time_t last_change;
+
+	if (mon_get_link(if_nametoindex(if_name), &operstate, &last_change) == 0) {
+		switch (operstate) {
+		case IF_OPER_UP:
+			return strdup("up");
+		case IF_OPER_DOWN:
+			return strdup("down");
+		case IF_OPER_TESTING:
+			return strdup("testing");
+		case IF_OPER_DORMANT:
+			return strdup("dormant");
+		case IF_OPER_NOTPRESENT:
+			return strdup("not-present");
+		case IF_OPER_LOWERLAYERDOWN:
+			return strdup("lower-layer-down");
+		default:
+			return strdup("unknown");
+		}
+	}
 
 	if ((sysval = read_from_sys_net(if_name, "operstate")) == NULL) {
 		asprintf(msg, "%s: failed to read from \"/sys/class/net/...\".", __func__);
@@ -2921,6 +2840,13 @@ char* iface_get_operstatus(const char* if_name, char** msg) {
 char* iface_get_lastchange(const char* if_name, char** msg) {
 	char* path;
 	struct stat st;
+	unsigned char operstate;
+	time_t last_change;
+
+	/* not changed since the monitor started, the sysfs time is the best guess */
+	if (mon_get_link(if_nametoindex(if_name), &operstate, &last_change) == 0 && last_change != 0) {
+		return nc_time2datetime(last_change, NULL);
+	}
 
 	asprintf(&path, "/sys/class/net/%s/operstate", if_name);
 
@@ -2958,122 +2884,248 @@ char* iface_get_speed(const char* if_name, char** msg) {
 	return ret;
 }
 
-static unsigned int if_count = 0;
-static char** if_names;
-static struct device_stats* if_old_stats;
+/* saved statistics of an interface, chained in stats_hash by its ifindex */
+struct iface_stats {
+	unsigned int index;
+	char name[IFNAMSIZ];
+	unsigned int snapshot;		/* the last snapshot the interface was in */
+	struct device_stats stats;
+	struct iface_stats* next;
+};
+
+#define STATS_HASH_MIN 64
+
+static struct iface_stats** stats_hash;
+static unsigned int stats_hash_size = 0;
+static unsigned int stats_count = 0;
+static unsigned int stats_snapshot = 0;
+static char stats_now[21];
 
 void iface_cleanup(void) {
-	int i;
+	struct iface_stats* cur, *next;
+	unsigned int i;
 
-	for (i = 0; i < if_count; ++i) {
-		free(if_names[i]);
+	for (i = 0; i < stats_hash_size; ++i) {
+		for (cur = stats_hash[i]; cur != NULL; cur = next) {
+			next = cur->next;
+			free(cur);
+		}
 	}
+	free(stats_hash);
+	stats_hash = NULL;
+	stats_hash_size = 0;
+	stats_count = 0;
 
-	if (if_count != 0) {
-		free(if_names);
-		free(if_old_stats);
+	while (ifcfg_files != NULL) {
+		ifcfg_file_drop(ifcfg_files);
 	}
+
+	mon_stop();
+	nl_cleanup();
 }
 
-int iface_get_stats(const char* if_name, struct device_stats* stats, char** msg) {
+static int stats_hash_resize(unsigned int size) {
+	struct iface_stats** hash, *cur, *next;
+	unsigned int i;
+
+	if ((hash = calloc(size, sizeof *hash)) == NULL) {
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < stats_hash_size; ++i) {
+		for (cur = stats_hash[i]; cur != NULL; cur = next) {
+			next = cur->next;
+			cur->next = hash[cur->index % size];
+			hash[cur->index % size] = cur;
+		}
+	}
+
+	free(stats_hash);
+	stats_hash = hash;
+	stats_hash_size = size;
+	return EXIT_SUCCESS;
+}
+
+static struct iface_stats* stats_find(unsigned int index) {
+	struct iface_stats* cur;
+
+	if (stats_hash_size == 0) {
+		return NULL;
+	}
+	for (cur = stats_hash[index % stats_hash_size]; cur != NULL && cur->index != index; cur = cur->next);
+
+	return cur;
+}
+
+/* store the new counters of an interface, detecting any reset since the previous snapshot */
+static int stats_update(unsigned int index, const char* if_name, const struct device_stats* stats) {
+	struct iface_stats* old;
+	char reset_time[21];
+	int reset;
+
+	if ((old = stats_find(index)) == NULL) {
+		if (stats_count >= stats_hash_size && stats_hash_resize(stats_hash_size ? stats_hash_size * 2 : STATS_HASH_MIN) != EXIT_SUCCESS) {
+			return ENOMEM;
+		}
+		if ((old = calloc(1, sizeof *old)) == NULL) {
+			return ENOMEM;
+		}
+		old->index = index;
+		old->next = stats_hash[index % stats_hash_size];
+		stats_hash[index % stats_hash_size] = old;
+		++stats_count;
+		reset = 1;
+	} else {
+		/* the index may have been reused by a new interface */
+		reset = strcmp(old->name, if_name) != 0 ||
+				stats->in_octets < old->stats.in_octets ||
+				stats->in_pkts < old->stats.in_pkts ||
+				stats->in_errors < old->stats.in_errors ||
+				stats->in_discards < old->stats.in_discards ||
+				stats->in_mult_pkts < old->stats.in_mult_pkts ||
+				stats->out_octets < old->stats.out_octets ||
+				stats->out_pkts < old->stats.out_pkts ||
+				stats->out_errors < old->stats.out_errors ||
+				stats->out_discards < old->stats.out_discards;
+	}
+
+	strcpy(reset_time, reset ? stats_now : old->stats.reset_time);
+	memcpy(&old->stats, stats, sizeof *stats);
+	strcpy(old->stats.reset_time, reset_time);
+	strncpy(old->name, if_name, IFNAMSIZ-1);
+	old->snapshot = stats_snapshot;
+
+	return 0;
+}
+
+/* forget the interfaces that are gone */
+static void stats_purge(void) {
+	struct iface_stats** cur, *old;
+	unsigned int i;
+
+	for (i = 0; i < stats_hash_size; ++i) {
+		for (cur = &stats_hash[i]; *cur != NULL;) {
+			if ((*cur)->snapshot != stats_snapshot) {
+				old = *cur;
+				*cur = old->next;
+				free(old);
+				--stats_count;
+			} else {
+				cur = &(*cur)->next;
+			}
+		}
+	}
+}
+
+static int stats_nl_clb(unsigned int index, const char* if_name, const struct rtnl_link_stats64* nl_stats, void* arg) {
+	struct device_stats stats;
+
+	stats.in_octets = nl_stats->rx_bytes;
+	stats.in_pkts = nl_stats->rx_packets;
+	stats.in_mult_pkts = nl_stats->multicast;
+	stats.in_discards = nl_stats->rx_dropped;
+	stats.in_errors = nl_stats->rx_errors;
+	stats.out_octets = nl_stats->tx_bytes;
+	stats.out_pkts = nl_stats->tx_packets;
+	stats.out_discards = nl_stats->tx_dropped;
+	stats.out_errors = nl_stats->tx_errors;
+
+	return stats_update(index, if_name, &stats);
+}
+
+/* no netlink, all the interfaces in one pass over DEV_STATS_PATH */
+static int stats_read_proc(char** msg) {
 	FILE* file;
-	char* line = NULL, *ptr;
+	char* line = NULL, *name, *ptr;
 	size_t len = 0;
-	char aux[16];
-	int i;
+	struct device_stats stats;
+	unsigned int index;
+	int ret = 0;
 
 	if ((file = fopen(DEV_STATS_PATH, "r")) == NULL) {
 		asprintf(msg, "%s: unable to open \"%s\" (%s).", __func__, DEV_STATS_PATH, strerror(errno));
 		return EXIT_FAILURE;
 	}
 
-	while (getline(&line, &len, file) != -1) {
-		if (strchr(line, '|') != NULL || strchr(line, ':') == NULL) {
+	while (ret == 0 && getline(&line, &len, file) != -1) {
+		if (strchr(line, '|') != NULL || (ptr = strchr(line, ':')) == NULL) {
 			continue;
 		}
+		*ptr = '\0';
+		++ptr;
 
-		ptr = line;
-		while (*ptr == ' ' || *ptr == '\t') {
-			++ptr;
+		name = line;
+		while (*name == ' ' || *name == '\t') {
+			++name;
+		}
+		if ((index = if_nametoindex(name)) == 0) {
+			continue;
 		}
 
-		/* we found our device */
-		if (strncmp(ptr, if_name, strlen(if_name)) == 0) {
-			ptr = strchr(line, ':')+1;
-			sscanf(ptr, "%s %s %s %s %s %s %s %s %s %s %s %s",
-				stats->in_octets,
-				stats->in_pkts,
-				stats->in_errors,
-				stats->in_discards,
-				aux, aux, aux,
-				stats->in_mult_pkts,
-				stats->out_octets,
-				stats->out_pkts,
-				stats->out_errors,
-				stats->out_discards);
-			free(line);
-			fclose(file);
-
-			/* find or create if_old_stats for this interface */
-			if (if_count == 0) {
-				if_names = malloc(sizeof(char*));
-				if_names[0] = strdup(if_name);
-				if_old_stats = malloc(sizeof(struct device_stats));
-				if_old_stats[0].reset_time[0] = '\0';
-				i = 0;
-				if_count = 1;
-			} else {
-				for (i = 0; i < if_count; ++i) {
-					if (strcmp(if_name, if_names[i]) == 0) {
-						break;
-					}
-				}
-
-				/* no saved stats */
-				if (i == if_count) {
-					if_names = realloc(if_names, (if_count+1)*sizeof(char*));
-					if_names[if_count] = strdup(if_name);
-					if_old_stats = realloc(if_old_stats, (if_count+1)*sizeof(struct device_stats));
-					if_old_stats[if_count].reset_time[0] = '\0';
-					++if_count;
-				}
-			}
-
-			/* compare old stats and detect any reset */
-			if (if_old_stats[i].reset_time[0] == '\0') {
-				ptr = nc_time2datetime(time(NULL), NULL);
-				strcpy(stats->reset_time, ptr);
-				free(ptr);
-			} else {
-				if (strcmp(stats->in_octets, if_old_stats[i].in_octets) < 0 ||
-						strcmp(stats->in_pkts, if_old_stats[i].in_pkts) < 0 ||
-						strcmp(stats->in_errors, if_old_stats[i].in_errors) < 0 ||
-						strcmp(stats->in_discards, if_old_stats[i].in_discards) < 0 ||
-						strcmp(stats->in_mult_pkts, if_old_stats[i].in_mult_pkts) < 0 ||
-						strcmp(stats->out_octets, if_old_stats[i].out_octets) < 0 ||
-						strcmp(stats->out_pkts, if_old_stats[i].out_pkts) < 0 ||
-						strcmp(stats->out_errors, if_old_stats[i].out_errors) < 0 ||
-						strcmp(stats->out_discards, if_old_stats[i].out_discards) < 0) {
-					ptr = nc_time2datetime(time(NULL), NULL);
-					strcpy(stats->reset_time, ptr);
-					free(ptr);
-				} else {
-					strcpy(stats->reset_time, if_old_stats[i].reset_time);
-				}
-			}
-			memcpy(if_old_stats+i, stats, sizeof(struct device_stats));
-
-			return EXIT_SUCCESS;
+		if (sscanf(ptr, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %*u %*u %*u %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+				&stats.in_octets,
+				&stats.in_pkts,
+				&stats.in_errors,
+				&stats.in_discards,
+				&stats.in_mult_pkts,
+				&stats.out_octets,
+				&stats.out_pkts,
+				&stats.out_errors,
+				&stats.out_discards) != 9) {
+			continue;
 		}
+		ret = stats_update(index, name, &stats);
 	}
 
 	free(line);
 	fclose(file);
-	return EXIT_FAILURE;
+
+	if (ret != 0) {
+		asprintf(msg, "%s: failed to store the interface statistics (%s).", __func__, strerror(ret));
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+int iface_snapshot_stats(char** msg) {
+	char* ptr;
+	int ret;
+
+	++stats_snapshot;
+	ptr = nc_time2datetime(time(NULL), NULL);
+	strncpy(stats_now, ptr, sizeof stats_now - 1);
+	free(ptr);
+
+	if ((ret = nl_get_link_stats(stats_nl_clb, NULL)) == NL_UNAVAILABLE) {
+		ret = stats_read_proc(msg);
+	} else if (ret != 0) {
+		asprintf(msg, "%s: failed to get the interface statistics (%s).", __func__, strerror(ret));
+		ret = EXIT_FAILURE;
+	}
+
+	/* keep the saved statistics of all the interfaces if the snapshot did not finish */
+	if (ret == EXIT_SUCCESS) {
+		stats_purge();
+	}
+	return ret;
+}
+
+int iface_get_stats(const char* if_name, struct device_stats* stats, char** msg) {
+	struct iface_stats* cur;
+	unsigned int index;
+
+	if ((index = if_nametoindex(if_name)) == 0 || (cur = stats_find(index)) == NULL || cur->snapshot != stats_snapshot) {
+		asprintf(msg, "%s: no statistics of the interface %s.", __func__, if_name);
+		return EXIT_FAILURE;
+	}
+
+	memcpy(stats, &cur->stats, sizeof *stats);
+	return EXIT_SUCCESS;
 }
 
 int iface_get_ipv4_presence(unsigned char config, const char* if_name, char** msg) {
 	int ret;
+	unsigned int nl_count;
+	struct nl_addr* nl_addrs;
 	char* cmd, *line = NULL, *tmp;
 	size_t len = 0;
 	FILE* output;
@@ -3107,6 +3159,11 @@ int iface_get_ipv4_presence(unsigned char config, const char* if_name, char** ms
 		}
 		free(tmp);
 #endif
+	} else if ((ret = nl_get_addrs(AF_INET, if_name, &nl_addrs, &nl_count)) != NL_UNAVAILABLE) {
+		if (ret == 0) {
+			free(nl_addrs);
+		}
+		ret = (ret == 0 && nl_count > 0);
 	} else {
 		asprintf(&cmd, "ip -4 addr show dev %s 2>&1", if_name);
 		output = popen(cmd, "r");
@@ -3201,9 +3258,99 @@ char* iface_get_ipv4_mtu(unsigned char config, const char* if_name, char** msg)
 	return ret;
 }
 
-int iface_get_ipv4_ipaddrs(unsigned char config, const char* if_name, struct ip_addrs* ips, char** msg) {
+/* append a runtime IPv4 address, the origin is learned from the static addresses */
+static void add_dynamic_ipv4(struct ip_addrs* ips, struct ip_addrs* static_ips, const char* ip, const char* prefix, const char* origin) {
+	int i;
+
+	/* add a new IP */
+	if (ips->count == 0) {
+		ips->ip = malloc(sizeof(char*));
+		ips->prefix_or_mac = malloc(sizeof(char*));
+		ips->origin = malloc(sizeof(char*));
+	} else {
+		ips->ip = realloc(ips->ip, (ips->count+1)*sizeof(char*));
+		ips->prefix_or_mac = realloc(ips->prefix_or_mac, (ips->count+1)*sizeof(char*));
+		ips->origin = realloc(ips->origin, (ips->count+1)*sizeof(char*));
+	}
+
+	ips->ip[ips->count] = strdup(ip);
+	ips->prefix_or_mac[ips->count] = strdup(prefix);
+	ips->origin[ips->count] = NULL;
+
+	for (i = 0; i < static_ips->count; ++i) {
+		if (strcmp(ip, static_ips->ip[i]) == 0 && strcmp(prefix, static_ips->prefix_or_mac[i]) == 0) {
+			ips->origin[ips->count] = strdup("static");
+			break;
+		}
+	}
+
+	if (ips->origin[ips->count] == NULL) {
+		if (strncmp(ip, "169.254", 7) == 0) {
+			ips->origin[ips->count] = strdup("random");
+		} else if (strcmp(ip, "127.0.0.1") == 0) {
+			ips->origin[ips->count] = strdup("static");
+		} else {
+			ips->origin[ips->count] = strdup(origin);
+		}
+	}
+	++ips->count;
+}
+
+/* append a runtime IPv6 address, the origin and status are learned from the static addresses and the flags (IFA_F_*) */
+static void add_dynamic_ipv6(struct ip_addrs* ips, struct ip_addrs* static_ips, const char* ip, const char* prefix, unsigned int flags, const char* origin) {
 	int i;
-	char* cmd, *line = NULL, *origin, *ip, *prefix;
+
+	/* add a new IP */
+	if (ips->count == 0) {
+		ips->ip = malloc(sizeof(char*));
+		ips->prefix_or_mac = malloc(sizeof(char*));
+		ips->origin = malloc(sizeof(char*));
+		ips->status_or_state = malloc(sizeof(char*));
+	} else {
+		ips->ip = realloc(ips->ip, (ips->count+1)*sizeof(char*));
+		ips->prefix_or_mac = realloc(ips->prefix_or_mac, (ips->count+1)*sizeof(char*));
+		ips->origin = realloc(ips->origin, (ips->count+1)*sizeof(char*));
+		ips->status_or_state = realloc(ips->status_or_state, (ips->count+1)*sizeof(char*));
+	}
+
+	ips->ip[ips->count] = strdup(ip);
+	ips->prefix_or_mac[ips->count] = strdup(prefix);
+	ips->origin[ips->count] = NULL;
+
+	for (i = 0; i < static_ips->count; ++i) {
+		if (strcmp(ip, static_ips->ip[i]) == 0 && strcmp(prefix, static_ips->prefix_or_mac[i]) == 0) {
+			ips->origin[ips->count] = strdup("static");
+			break;
+		}
+	}
+
+	if (ips->origin[ips->count] == NULL) {
+		if (strncmp(ip, "fe80:", 5) == 0 && strstr(ip, "ff:fe") != NULL) {
+			ips->origin[ips->count] = strdup("link-layer");
+		} else if (flags & IFA_F_TEMPORARY || !(flags & IFA_F_PERMANENT)) {
+			ips->origin[ips->count] = strdup("other");
+		} else {
+			ips->origin[ips->count] = strdup(origin);
+		}
+	}
+
+	if (flags & IFA_F_DEPRECATED) {
+		ips->status_or_state[ips->count] = strdup("deprecated");
+	} else if (flags & IFA_F_TENTATIVE) {
+		ips->status_or_state[ips->count] = strdup("tentative");
+	} else if (flags & IFA_F_DADFAILED) {
+		ips->status_or_state[ips->count] = strdup("invalid");
+	} else {
+		ips->status_or_state[ips->count] = strdup("preferred");
+	}
+	++ips->count;
+}
+
+int iface_get_ipv4_ipaddrs(unsigned char config, const char* if_name, struct ip_addrs* ips, char** msg) {
+	int i, ret;
+	unsigned int j, nl_count;
+	struct nl_addr* nl_addrs;
+	char* cmd, *line = NULL, *origin, *ip, *prefix, str_prefix[4];
 	struct ip_addrs static_ips;
 	FILE* output;
 	size_t len = 0;
@@ -3356,58 +3503,40 @@ int iface_get_ipv4_ipaddrs(unsigned char config, const char* if_name, struct ip_
 			origin = strdup("other");
 		}
 
-		asprintf(&cmd, "ip -4 addr show dev %s 2>&1", if_name);
-		output = popen(cmd, "r");
-		free(cmd);
-
-		if (output == NULL) {
-			asprintf(msg, "%s: failed to execute a command.", __func__);
-			free(origin);
-			return EXIT_FAILURE;
-		}
+		if ((ret = nl_get_addrs(AF_INET, if_name, &nl_addrs, &nl_count)) == NL_UNAVAILABLE) {
+			asprintf(&cmd, "ip -4 addr show dev %s 2>&1", if_name);
+			output = popen(cmd, "r");
+			free(cmd);
 
-		while (getline(&line, &len, output) != -1) {
-			if ((ip = strstr(line, "inet")) == NULL) {
-				continue;
+			if (output == NULL) {
+				asprintf(msg, "%s: failed to execute a command.", __func__);
+				free(origin);
+				return EXIT_FAILURE;
 			}
 
-			ip += 5;
-			prefix = strchr(ip, '/')+1;
-			*strchr(ip, '/') = '\0';
-			*strchr(prefix, ' ') = '\0';
-
-			/* add a new IP */
-			if (ips->count == 0) {
-				ips->ip = malloc(sizeof(char*));
-				ips->prefix_or_mac = malloc(sizeof(char*));
-				ips->origin = malloc(sizeof(char*));
-			} else {
-				ips->ip = realloc(ips->ip, (ips->count+1)*sizeof(char*));
-				ips->prefix_or_mac = realloc(ips->prefix_or_mac, (ips->count+1)*sizeof(char*));
-				ips->origin = realloc(ips->origin, (ips->count+1)*sizeof(char*));
-			}
+			while (getline(&line, &len, output) != -1) {
+				if ((ip = strstr(line, "inet")) == NULL) {
+					continue;
+				}
 
-			ips->ip[ips->count] = strdup(ip);
-			ips->prefix_or_mac[ips->count] = strdup(prefix);
-			ips->origin[ips->count] = NULL;
+				ip += 5;
+				prefix = strchr(ip, '/')+1;
+				*strchr(ip, '/') = '\0';
+				*strchr(prefix, ' ') = '\0';
 
-			for (i = 0; i < static_ips.count; ++i) {
-				if (strcmp(ip, static_ips.ip[i]) == 0 && strcmp(prefix, static_ips.prefix_or_mac[i]) == 0) {
-					ips->origin[ips->count] = strdup("static");
-					break;
-				}
+				add_dynamic_ipv4(ips, &static_ips, ip, prefix, origin);
 			}
 
-			if (ips->origin[ips->count] == NULL) {
-				if (strncmp(ip, "169.254", 7) == 0) {
-					ips->origin[ips->count] = strdup("random");
-				} else if (strcmp(ip, "127.0.0.1") == 0) {
-					ips->origin[ips->count] = strdup("static");
-				} else {
-					ips->origin[ips->count] = strdup(origin);
-				}
+			pclose(output);
+			free(line);
+		} else if (ret == 0) {
+			for (j = 0; j < nl_count; ++j) {
+				sprintf(str_prefix, "%d", nl_addrs[j].prefix);
+				add_dynamic_ipv4(ips, &static_ips, nl_addrs[j].ip, str_prefix, origin);
 			}
-			++ips->count;
+			free(nl_addrs);
+		} else {
+			asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
 		}
 
 		for (i = 0; i < static_ips.count; ++i) {
@@ -3416,10 +3545,11 @@ int iface_get_ipv4_ipaddrs(unsigned char config, const char* if_name, struct ip_
 		}
 		free(static_ips.ip);
 		free(static_ips.prefix_or_mac);
-
-		pclose(output);
-		free(line);
 		free(origin);
+
+		if (ret > 0) {
+			return EXIT_FAILURE;
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -3496,8 +3626,10 @@ char* iface_get_ipv6_mtu(unsigned char config, const char* if_name, char** msg)
 }
 
 int iface_get_ipv6_ipaddrs(unsigned char config, const char* if_name, struct ip_addrs* ips, char** msg) {
-	int i;
-	char* cmd, *line = NULL, *origin, *ip, *prefix, *rest;
+	int i, ret;
+	unsigned int j, nl_count, flags;
+	struct nl_addr* nl_addrs;
+	char* cmd, *line = NULL, *origin, *ip, *prefix, *rest, str_prefix[4];
 	FILE* output;
 	struct ip_addrs static_ips;
 	size_t len = 0;
@@ -3663,6 +3795,19 @@ int iface_get_ipv6_ipaddrs(unsigned char config, const char* if_name, struct ip_
 			origin = strdup("other");
 		}
 
+		if ((ret = nl_get_addrs(AF_INET6, if_name, &nl_addrs, &nl_count)) != NL_UNAVAILABLE) {
+			if (ret == 0) {
+				for (j = 0; j < nl_count; ++j) {
+					sprintf(str_prefix, "%d", nl_addrs[j].prefix);
+					add_dynamic_ipv6(ips, &static_ips, nl_addrs[j].ip, str_prefix, nl_addrs[j].flags, origin);
+				}
+				free(nl_addrs);
+			} else {
+				asprintf(msg, "%s: interface %s fail: %s", __func__, if_name, strerror(ret));
+			}
+			goto free_static;
+		}
+
 		asprintf(&cmd, "ip -6 addr show dev %s 2>&1", if_name);
 		output = popen(cmd, "r");
 		free(cmd);
@@ -3683,64 +3828,31 @@ int iface_get_ipv6_ipaddrs(unsigned char config, const char* if_name, struct ip_
 			*strchr(ip, '/') = '\0';
 			*strchr(prefix, ' ') = '\0';
 
-			/* add a new IP */
-			if (ips->count == 0) {
-				ips->ip = malloc(sizeof(char*));
-				ips->prefix_or_mac = malloc(sizeof(char*));
-				ips->origin = malloc(sizeof(char*));
-				ips->status_or_state = malloc(sizeof(char*));
-			} else {
-				ips->ip = realloc(ips->ip, (ips->count+1)*sizeof(char*));
-				ips->prefix_or_mac = realloc(ips->prefix_or_mac, (ips->count+1)*sizeof(char*));
-				ips->origin = realloc(ips->origin, (ips->count+1)*sizeof(char*));
-				ips->status_or_state = realloc(ips->status_or_state, (ips->count+1)*sizeof(char*));
-			}
-
-			ips->ip[ips->count] = strdup(ip);
-			ips->prefix_or_mac[ips->count] = strdup(prefix);
-			ips->origin[ips->count] = NULL;
-
-			for (i = 0; i < static_ips.count; ++i) {
-				if (strcmp(ip, static_ips.ip[i]) == 0 && strcmp(prefix, static_ips.prefix_or_mac[i]) == 0) {
-					ips->origin[ips->count] = strdup("static");
-					break;
-				}
-			}
-
-			if (ips->origin[ips->count] == NULL) {
-				if (strncmp(ip, "fe80:", 5) == 0 && strstr(ip, "ff:fe") != NULL) {
-					ips->origin[ips->count] = strdup("link-layer");
-				} else if (strstr(rest, "temporary") != NULL || strstr(rest, "dynamic") != NULL) {
-					ips->origin[ips->count] = strdup("other");
-				} else {
-					ips->origin[ips->count] = strdup(origin);
-				}
-			}
+			/* the flags as printed by ip */
+			flags = (strstr(rest, "dynamic") != NULL ? 0 : IFA_F_PERMANENT);
+			flags |= (strstr(rest, "temporary") != NULL ? IFA_F_TEMPORARY : 0);
+			flags |= (strstr(rest, "deprecated") != NULL ? IFA_F_DEPRECATED : 0);
+			flags |= (strstr(rest, "tentative") != NULL ? IFA_F_TENTATIVE : 0);
+			flags |= (strstr(rest, "dadfailed") != NULL ? IFA_F_DADFAILED : 0);
 
-			if (strstr(rest, "deprecated") != NULL) {
-				ips->status_or_state[ips->count] = strdup("deprecated");
-			} else if (strstr(rest, "tentative") != NULL) {
-				ips->status_or_state[ips->count] = strdup("tentative");
-			} else if (strstr(rest, "dadfailed") != NULL) {
-				ips->status_or_state[ips->count] = strdup("invalid");
-			} else if (strstr(rest, "primary") != NULL) {
-				ips->status_or_state[ips->count] = strdup("preferred");
-			} else {
-				ips->status_or_state[ips->count] = strdup("unknown");
-			}
-			++ips->count;
+			add_dynamic_ipv6(ips, &static_ips, ip, prefix, flags, origin);
 		}
 
+		pclose(output);
+		free(line);
+
+free_static:
 		for (i = 0; i < static_ips.count; ++i) {
 			free(static_ips.ip[i]);
 			free(static_ips.prefix_or_mac[i]);
 		}
 		free(static_ips.ip);
 		free(static_ips.prefix_or_mac);
-
-		pclose(output);
-		free(line);
 		free(origin);
+
+		if (ret > 0) {
+			return EXIT_FAILURE;
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -3751,6 +3863,8 @@ int iface_get_ipv6_neighs(unsigned char config, const char* if_name, struct ip_a
 }
 
 char* iface_get_enabled(unsigned char config, const char* if_name, char** msg) {
+	int ret;
+	unsigned char operstate;
 	char* cmd, *line = NULL, *ptr = NULL;
 	FILE* output;
 	size_t len = 0;
@@ -3783,6 +3897,18 @@ char* iface_get_enabled(unsigned char config, const char* if_name, char** msg) {
 			ptr = strdup("false");
 		}
 #endif
+	} else if ((ret = nl_get_operstate(if_name, &operstate)) != NL_UNAVAILABLE) {
+		if (ret != 0) {
+			asprintf(msg, "%s: could not retrieve interface %s state (%s).", __func__, if_name, strerror(ret));
+		} else if (operstate == IF_OPER_UP) {
+			ptr = strdup("true");
+		} else if (operstate == IF_OPER_DOWN) {
+			ptr = strdup("false");
+		} else if (operstate == IF_OPER_UNKNOWN && strncmp(if_name, "lo", 2) == 0) {
+			ptr = strdup("true");
+		} else {
+			asprintf(msg, "%s: unknown interface %s state \"%d\".", __func__, if_name, operstate);
+		}
 	} else {
 		asprintf(&cmd, "ip link show %s 2>&1", if_name);
 		output = popen(cmd, "r");
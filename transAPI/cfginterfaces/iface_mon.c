@@ -0,0 +1,652 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <libnetconf_xml.h>
+
+#include "iface_mon.h"
+
+#define MON_BUFFER_SIZE 32768
+
+/* the events of thousands of interfaces going down at once must fit */
+#define MON_RCVBUF_SIZE (4*1024*1024)
+
+#define MON_HASH_SIZE 1024
+
+#define MON_NTF_NS "urn:cesnet:tmc:interfaces:1.0"
+
+struct mon_addr {
+	int family;
+	struct nl_addr addr;
+};
+
+struct mon_neigh {
+	int family;
+	struct nl_neigh neigh;
+};
+
+struct mon_iface {
+	unsigned int index;
+	char name[IFNAMSIZ];
+	unsigned char operstate;
+	time_t last_change;
+	unsigned int sync;			/* the last link dump it was in */
+
+	struct mon_addr* addrs;
+	unsigned int addr_count;
+	struct mon_neigh* neighs;
+	unsigned int neigh_count;
+
+	struct mon_iface* next;
+};
+
+struct mon_trap {
+	char* name;
+	int enabled;
+};
+
+/* the dumps of a (re)synchronization, one after another */
+enum mon_dump {
+	MON_DUMP_LINK,
+	MON_DUMP_ADDR,
+	MON_DUMP_NEIGH,
+	MON_DUMP_DONE
+};
+
+static pthread_mutex_t mon_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mon_iface* mon_hash[MON_HASH_SIZE];
+static struct mon_trap* mon_traps;
+static unsigned int mon_trap_count;
+static int mon_synced = 0;
+
+/* used only by the monitor thread */
+static int mon_fd = -1;
+static int mon_pipe[2] = {-1, -1};
+static pthread_t mon_thread;
+static unsigned int mon_seq = 0;
+static unsigned int mon_sync = 0;
+static enum mon_dump mon_dump;
+
+/* pending notifications, emitted without mon_lock */
+static char** mon_ntfs;
+static unsigned int mon_ntf_count;
+
+/* called with mon_lock */
+static struct mon_iface* mon_find(unsigned int index) {
+	struct mon_iface* cur;
+
+	for (cur = mon_hash[index % MON_HASH_SIZE]; cur != NULL && cur->index != index; cur = cur->next);
+
+	return cur;
+}
+
+/* called with mon_lock */
+static void mon_remove(unsigned int index) {
+	struct mon_iface** cur, *iface;
+
+	for (cur = &mon_hash[index % MON_HASH_SIZE]; *cur != NULL; cur = &(*cur)->next) {
+		if ((*cur)->index == index) {
+			iface = *cur;
+			*cur = iface->next;
+			free(iface->addrs);
+			free(iface->neighs);
+			free(iface);
+			return;
+		}
+	}
+}
+
+/* called with mon_lock */
+static int mon_trap_enabled(const char* if_name) {
+	unsigned int i;
+
+	for (i = 0; i < mon_trap_count; ++i) {
+		if (strcmp(mon_traps[i].name, if_name) == 0) {
+			return mon_traps[i].enabled;
+		}
+	}
+
+	return 1;
+}
+
+static const char* mon_operstate_str(unsigned char operstate) {
+	switch (operstate) {
+	case IF_OPER_UP:
+		return "up";
+	case IF_OPER_DOWN:
+		return "down";
+	case IF_OPER_TESTING:
+		return "testing";
+	case IF_OPER_DORMANT:
+		return "dormant";
+	case IF_OPER_NOTPRESENT:
+		return "not-present";
+	case IF_OPER_LOWERLAYERDOWN:
+		return "lower-layer-down";
+	default:
+		return "unknown";
+	}
+}
+
+/* called with mon_lock */
+static void mon_notify(struct mon_iface* iface) {
+	char** ntfs, *ntf, *datetime;
+
+	if (!mon_trap_enabled(iface->name)) {
+		return;
+	}
+
+	datetime = nc_time2datetime(iface->last_change, NULL);
+	if (asprintf(&ntf, "<%s xmlns=\"%s\"><name>%s</name><oper-status>%s</oper-status><last-change>%s</last-change></%s>",
+			(iface->operstate == IF_OPER_UP) ? "link-up" : "link-down", MON_NTF_NS, iface->name,
+			mon_operstate_str(iface->operstate), datetime, (iface->operstate == IF_OPER_UP) ? "link-up" : "link-down") == -1) {
+		free(datetime);
+		return;
+	}
+	free(datetime);
+
+	if ((ntfs = realloc(mon_ntfs, (mon_ntf_count + 1) * sizeof *mon_ntfs)) == NULL) {
+		free(ntf);
+		return;
+	}
+	mon_ntfs = ntfs;
+	mon_ntfs[mon_ntf_count] = ntf;
+	++mon_ntf_count;
+}
+
+/* called with mon_lock */
+static void mon_link(struct nlmsghdr* hdr) {
+	struct ifinfomsg* ifi = (struct ifinfomsg*)NLMSG_DATA(hdr);
+	struct rtattr* rta;
+	struct mon_iface* iface;
+	unsigned char operstate = IF_OPER_UNKNOWN, old_operstate;
+	const char* name = NULL;
+	int len;
+
+	if (hdr->nlmsg_type == RTM_DELLINK) {
+		mon_remove(ifi->ifi_index);
+		return;
+	}
+
+	for (rta = IFLA_RTA(ifi), len = IFLA_PAYLOAD(hdr); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_IFNAME) {
+			name = (char*)RTA_DATA(rta);
+		} else if (rta->rta_type == IFLA_OPERSTATE) {
+			operstate = *(unsigned char*)RTA_DATA(rta);
+		}
+	}
+
+	if ((iface = mon_find(ifi->ifi_index)) == NULL) {
+		if ((iface = calloc(1, sizeof *iface)) == NULL) {
+			return;
+		}
+		iface->index = ifi->ifi_index;
+		iface->operstate = operstate;
+		iface->next = mon_hash[iface->index % MON_HASH_SIZE];
+		mon_hash[iface->index % MON_HASH_SIZE] = iface;
+		if (name != NULL) {
+			strncpy(iface->name, name, IFNAMSIZ-1);
+		}
+	} else {
+		if (name != NULL) {
+			strncpy(iface->name, name, IFNAMSIZ-1);
+		}
+		if (iface->operstate != operstate) {
+			old_operstate = iface->operstate;
+			iface->operstate = operstate;
+			iface->last_change = time(NULL);
+			/* linkUp/linkDown of IF-MIB, entering or leaving the up state */
+			if (operstate == IF_OPER_UP || old_operstate == IF_OPER_UP) {
+				mon_notify(iface);
+			}
+		}
+	}
+
+	if (mon_dump == MON_DUMP_LINK) {
+		iface->sync = mon_sync;
+	}
+}
+
+/* called with mon_lock */
+static void mon_addr(struct nlmsghdr* hdr) {
+	struct ifaddrmsg* ifa = (struct ifaddrmsg*)NLMSG_DATA(hdr);
+	struct mon_iface* iface;
+	struct mon_addr* addrs;
+	struct nl_addr addr;
+	unsigned int i;
+
+	if ((iface = mon_find(ifa->ifa_index)) == NULL || nl_parse_addr(hdr, &addr) != EXIT_SUCCESS) {
+		return;
+	}
+
+	for (i = 0; i < iface->addr_count; ++i) {
+		if (iface->addrs[i].family == ifa->ifa_family && iface->addrs[i].addr.prefix == addr.prefix && strcmp(iface->addrs[i].addr.ip, addr.ip) == 0) {
+			break;
+		}
+	}
+
+	if (hdr->nlmsg_type == RTM_DELADDR) {
+		if (i < iface->addr_count) {
+			memmove(iface->addrs + i, iface->addrs + i + 1, (iface->addr_count - i - 1) * sizeof *iface->addrs);
+			--iface->addr_count;
+		}
+		return;
+	}
+
+	if (i == iface->addr_count) {
+		if ((addrs = realloc(iface->addrs, (iface->addr_count + 1) * sizeof *iface->addrs)) == NULL) {
+			return;
+		}
+		iface->addrs = addrs;
+		++iface->addr_count;
+	}
+	iface->addrs[i].family = ifa->ifa_family;
+	iface->addrs[i].addr = addr;
+}
+
+/* called with mon_lock */
+static void mon_neigh(struct nlmsghdr* hdr) {
+	struct ndmsg* nd = (struct ndmsg*)NLMSG_DATA(hdr);
+	struct mon_iface* iface;
+	struct mon_neigh* neighs;
+	struct nl_neigh neigh;
+	unsigned int i;
+
+	if ((nd->ndm_family != AF_INET && nd->ndm_family != AF_INET6) || (iface = mon_find(nd->ndm_ifindex)) == NULL
+			|| nl_parse_neigh(hdr, &neigh) != EXIT_SUCCESS) {
+		return;
+	}
+
+	for (i = 0; i < iface->neigh_count; ++i) {
+		if (iface->neighs[i].family == nd->ndm_family && strcmp(iface->neighs[i].neigh.ip, neigh.ip) == 0) {
+			break;
+		}
+	}
+
+	/* a neighbor without a link-layer address is not listed, as if removed */
+	if (hdr->nlmsg_type == RTM_DELNEIGH || neigh.mac[0] == '\0') {
+		if (i < iface->neigh_count) {
+			memmove(iface->neighs + i, iface->neighs + i + 1, (iface->neigh_count - i - 1) * sizeof *iface->neighs);
+			--iface->neigh_count;
+		}
+		return;
+	}
+
+	if (i == iface->neigh_count) {
+		if ((neighs = realloc(iface->neighs, (iface->neigh_count + 1) * sizeof *iface->neighs)) == NULL) {
+			return;
+		}
+		iface->neighs = neighs;
+		++iface->neigh_count;
+	}
+	iface->neighs[i].family = nd->ndm_family;
+	iface->neighs[i].neigh = neigh;
+}
+
+static int mon_request_dump(unsigned short type) {
+	struct {
+		struct nlmsghdr hdr;
+		struct rtgenmsg gen;
+	} req;
+	struct sockaddr_nl addr;
+
+	memset(&req, 0, sizeof req);
+	req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof req.gen);
+	req.hdr.nlmsg_type = type;
+	req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.hdr.nlmsg_seq = ++mon_seq;
+	req.gen.rtgen_family = AF_UNSPEC;
+
+	memset(&addr, 0, sizeof addr);
+	addr.nl_family = AF_NETLINK;
+	while (sendto(mon_fd, &req, req.hdr.nlmsg_len, 0, (struct sockaddr*)&addr, sizeof addr) == -1) {
+		if (errno != EINTR) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* rebuild the whole model, the events may have been lost */
+static int mon_resync(void) {
+	struct mon_iface* cur;
+	unsigned int i;
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	mon_synced = 0;
+	++mon_sync;
+	mon_dump = MON_DUMP_LINK;
+	for (i = 0; i < MON_HASH_SIZE; ++i) {
+		for (cur = mon_hash[i]; cur != NULL; cur = cur->next) {
+			cur->addr_count = 0;
+			cur->neigh_count = 0;
+		}
+	}
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+
+	return mon_request_dump(RTM_GETLINK);
+}
+
+/* called with mon_lock, a dump finished */
+static int mon_dump_done(void) {
+	struct mon_iface* cur, *next;
+	unsigned int i;
+
+	switch (mon_dump) {
+	case MON_DUMP_LINK:
+		/* forget the interfaces removed while the events were lost */
+		for (i = 0; i < MON_HASH_SIZE; ++i) {
+			for (cur = mon_hash[i]; cur != NULL; cur = next) {
+				next = cur->next;
+				if (cur->sync != mon_sync) {
+					mon_remove(cur->index);
+				}
+			}
+		}
+		mon_dump = MON_DUMP_ADDR;
+		return mon_request_dump(RTM_GETADDR);
+	case MON_DUMP_ADDR:
+		mon_dump = MON_DUMP_NEIGH;
+		return mon_request_dump(RTM_GETNEIGH);
+	default:
+		mon_dump = MON_DUMP_DONE;
+		mon_synced = 1;
+		return EXIT_SUCCESS;
+	}
+}
+
+static void* mon_run(void* arg) {
+	struct pollfd fds[2];
+	struct nlmsghdr* hdr;
+	char buf[MON_BUFFER_SIZE];
+	ssize_t len;
+	unsigned int i;
+	int failed;
+
+	fds[0].fd = mon_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = mon_pipe[0];
+	fds[1].events = POLLIN;
+
+	failed = mon_resync();
+	while (!failed) {
+		if (poll(fds, 2, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (fds[1].revents) {
+			/* mon_stop() */
+			break;
+		}
+
+		if ((len = recv(mon_fd, buf, sizeof buf, MSG_DONTWAIT)) == -1) {
+			if (errno == ENOBUFS) {
+				nc_verb_warning("Interface events were lost, rebuilding the interface state.");
+				failed = mon_resync();
+			} else if (errno != EINTR && errno != EAGAIN) {
+				nc_verb_error("Receiving the interface events failed (%s).", strerror(errno));
+				failed = 1;
+			}
+			continue;
+		}
+
+		/* MON LOCK */
+		pthread_mutex_lock(&mon_lock);
+		for (hdr = (struct nlmsghdr*)buf; NLMSG_OK(hdr, (unsigned int)len); hdr = NLMSG_NEXT(hdr, len)) {
+			switch (hdr->nlmsg_type) {
+			case NLMSG_DONE:
+				if (hdr->nlmsg_seq == mon_seq) {
+					failed = mon_dump_done();
+				}
+				break;
+			case NLMSG_ERROR:
+				/* a dump failed, start again */
+				if (hdr->nlmsg_seq == mon_seq) {
+					mon_synced = 0;
+					++mon_sync;
+					mon_dump = MON_DUMP_LINK;
+					failed = mon_request_dump(RTM_GETLINK);
+				}
+				break;
+			case RTM_NEWLINK:
+			case RTM_DELLINK:
+				mon_link(hdr);
+				break;
+			case RTM_NEWADDR:
+			case RTM_DELADDR:
+				mon_addr(hdr);
+				break;
+			case RTM_NEWNEIGH:
+			case RTM_DELNEIGH:
+				mon_neigh(hdr);
+				break;
+			}
+		}
+		/* MON UNLOCK */
+		pthread_mutex_unlock(&mon_lock);
+
+		for (i = 0; i < mon_ntf_count; ++i) {
+			ncntf_event_new(-1, NCNTF_GENERIC, mon_ntfs[i]);
+			free(mon_ntfs[i]);
+		}
+		mon_ntf_count = 0;
+	}
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	mon_synced = 0;
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+
+	if (failed) {
+		nc_verb_warning("The interface monitor stopped, the interface state is queried directly.");
+	}
+	return NULL;
+}
+
+int mon_start(void) {
+	struct sockaddr_nl addr;
+	int size = MON_RCVBUF_SIZE;
+
+	if (mon_fd != -1) {
+		return EXIT_SUCCESS;
+	}
+
+	if ((mon_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) == -1) {
+		nc_verb_warning("Interface monitor socket could not be created (%s).", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	/* a privileged process may exceed rmem_max */
+	if (setsockopt(mon_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof size) == -1) {
+		setsockopt(mon_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+	}
+
+	memset(&addr, 0, sizeof addr);
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_NEIGH;
+	if (bind(mon_fd, (struct sockaddr*)&addr, sizeof addr) == -1 || pipe(mon_pipe) == -1) {
+		nc_verb_warning("Interface monitor socket could not be bound (%s).", strerror(errno));
+		close(mon_fd);
+		mon_fd = -1;
+		return EXIT_FAILURE;
+	}
+
+	if ((errno = pthread_create(&mon_thread, NULL, mon_run, NULL)) != 0) {
+		nc_verb_warning("Interface monitor thread could not be created (%s).", strerror(errno));
+		close(mon_pipe[0]);
+		close(mon_pipe[1]);
+		close(mon_fd);
+		mon_fd = -1;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void mon_stop(void) {
+	unsigned int i;
+
+	if (mon_fd == -1) {
+		return;
+	}
+
+	if (write(mon_pipe[1], "", 1) == 1) {
+		pthread_join(mon_thread, NULL);
+	} else {
+		pthread_cancel(mon_thread);
+		pthread_join(mon_thread, NULL);
+	}
+	close(mon_pipe[0]);
+	close(mon_pipe[1]);
+	close(mon_fd);
+	mon_fd = -1;
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	for (i = 0; i < MON_HASH_SIZE; ++i) {
+		while (mon_hash[i] != NULL) {
+			mon_remove(mon_hash[i]->index);
+		}
+	}
+	for (i = 0; i < mon_trap_count; ++i) {
+		free(mon_traps[i].name);
+	}
+	free(mon_traps);
+	mon_traps = NULL;
+	mon_trap_count = 0;
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+
+	free(mon_ntfs);
+	mon_ntfs = NULL;
+	mon_ntf_count = 0;
+}
+
+void mon_set_trap(const char* if_name, int enabled) {
+	struct mon_trap* traps;
+	unsigned int i;
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	for (i = 0; i < mon_trap_count; ++i) {
+		if (strcmp(mon_traps[i].name, if_name) == 0) {
+			break;
+		}
+	}
+	if (i == mon_trap_count) {
+		if ((traps = realloc(mon_traps, (mon_trap_count + 1) * sizeof *mon_traps)) == NULL) {
+			/* MON UNLOCK */
+			pthread_mutex_unlock(&mon_lock);
+			return;
+		}
+		mon_traps = traps;
+		if ((mon_traps[i].name = strdup(if_name)) == NULL) {
+			/* MON UNLOCK */
+			pthread_mutex_unlock(&mon_lock);
+			return;
+		}
+		++mon_trap_count;
+	}
+	mon_traps[i].enabled = enabled;
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+}
+
+int mon_get_link(unsigned int index, unsigned char* operstate, time_t* last_change) {
+	struct mon_iface* iface;
+	int ret = NL_UNAVAILABLE;
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	if (mon_synced) {
+		if ((iface = mon_find(index)) == NULL) {
+			ret = ENODEV;
+		} else {
+			*operstate = iface->operstate;
+			*last_change = iface->last_change;
+			ret = 0;
+		}
+	}
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+
+	return ret;
+}
+
+int mon_get_addrs(int family, unsigned int index, struct nl_addr** addrs, unsigned int* count) {
+	struct mon_iface* iface;
+	unsigned int i;
+	int ret = NL_UNAVAILABLE;
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	if (mon_synced) {
+		if ((iface = mon_find(index)) == NULL) {
+			ret = ENODEV;
+		} else if (iface->addr_count > 0 && (*addrs = malloc(iface->addr_count * sizeof **addrs)) == NULL) {
+			ret = ENOMEM;
+		} else {
+			if (iface->addr_count == 0) {
+				*addrs = NULL;
+			}
+			*count = 0;
+			for (i = 0; i < iface->addr_count; ++i) {
+				if (iface->addrs[i].family == family) {
+					(*addrs)[(*count)++] = iface->addrs[i].addr;
+				}
+			}
+			ret = 0;
+		}
+	}
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+
+	return ret;
+}
+
+int mon_get_neighs(int family, unsigned int index, struct nl_neigh** neighs, unsigned int* count) {
+	struct mon_iface* iface;
+	unsigned int i;
+	int ret = NL_UNAVAILABLE;
+
+	/* MON LOCK */
+	pthread_mutex_lock(&mon_lock);
+	if (mon_synced) {
+		if ((iface = mon_find(index)) == NULL) {
+			ret = ENODEV;
+		} else if (iface->neigh_count > 0 && (*neighs = malloc(iface->neigh_count * sizeof **neighs)) == NULL) {
+			ret = ENOMEM;
+		} else {
+			if (iface->neigh_count == 0) {
+				*neighs = NULL;
+			}
+			*count = 0;
+			for (i = 0; i < iface->neigh_count; ++i) {
+				if (iface->neighs[i].family == family) {
+					(*neighs)[(*count)++] = iface->neighs[i].neigh;
+				}
+			}
+			ret = 0;
+		}
+	}
+	/* MON UNLOCK */
+	pthread_mutex_unlock(&mon_lock);
+
+	return ret;
+}
@@ -0,0 +1,32 @@
+#ifndef _IFACE_MON_H_
+#define _IFACE_MON_H_
+
+#include <time.h>
+
+#include "iface_nl.h"
+
+/*
+ * Interface monitor, a thread subscribed to the rtnetlink link, address and neighbor
+ * events keeping a model of the runtime state of all the interfaces. Until the model
+ * is complete (or after some events were lost and it is being rebuilt), the getters
+ * return NL_UNAVAILABLE and the state is to be queried directly.
+ */
+
+/* start the thread, nothing if it is already running */
+int mon_start(void);
+
+void mon_stop(void);
+
+/* link-up-down-trap-enable of an interface, enabled if not configured */
+void mon_set_trap(const char* if_name, int enabled);
+
+/* IF_OPER_* and the time of its last change, 0 if it has not changed since the start */
+int mon_get_link(unsigned int index, unsigned char* operstate, time_t* last_change);
+
+/* as nl_get_addrs(), *addrs to be freed */
+int mon_get_addrs(int family, unsigned int index, struct nl_addr** addrs, unsigned int* count);
+
+/* as nl_get_neighs(), *neighs to be freed */
+int mon_get_neighs(int family, unsigned int index, struct nl_neigh** neighs, unsigned int* count);
+
+#endif /* _IFACE_MON_H_ */
@@ -0,0 +1,619 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "iface_nl.h"
+#include "iface_mon.h"
+
+/* receive buffer, enough for any single dump message */
+#define NL_BUFFER_SIZE 32768
+
+/* a request with its attributes */
+struct nl_req {
+	struct nlmsghdr hdr;
+	union {
+		struct ifaddrmsg ifa;
+		struct ifinfomsg ifi;
+		struct ndmsg nd;
+	} body;
+	char attrs[64];
+};
+
+static int nl_fd = -1;
+static unsigned int nl_seq = 0;
+static pthread_mutex_t nl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* called with nl_lock */
+static int nl_socket(void) {
+	struct sockaddr_nl addr;
+
+	if (nl_fd != -1) {
+		return nl_fd;
+	}
+
+	if ((nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) == -1) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.nl_family = AF_NETLINK;
+	if (bind(nl_fd, (struct sockaddr*)&addr, sizeof addr) == -1) {
+		close(nl_fd);
+		nl_fd = -1;
+		return -1;
+	}
+
+	return nl_fd;
+}
+
+void nl_cleanup(void) {
+	/* NL LOCK */
+	pthread_mutex_lock(&nl_lock);
+	if (nl_fd != -1) {
+		close(nl_fd);
+		nl_fd = -1;
+	}
+	/* NL UNLOCK */
+	pthread_mutex_unlock(&nl_lock);
+}
+
+static void nl_req_init(struct nl_req* req, unsigned short type, unsigned short flags, size_t body_len) {
+	memset(req, 0, sizeof *req);
+	req->hdr.nlmsg_len = NLMSG_LENGTH(body_len);
+	req->hdr.nlmsg_type = type;
+	req->hdr.nlmsg_flags = NLM_F_REQUEST | flags;
+}
+
+static void nl_req_attr(struct nl_req* req, unsigned short type, const void* data, size_t len) {
+	struct rtattr* rta;
+
+	rta = (struct rtattr*)(((char*)&req->hdr) + NLMSG_ALIGN(req->hdr.nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	req->hdr.nlmsg_len = NLMSG_ALIGN(req->hdr.nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static int nl_send(const void* buf, size_t len) {
+	struct sockaddr_nl addr;
+
+	memset(&addr, 0, sizeof addr);
+	addr.nl_family = AF_NETLINK;
+	while (sendto(nl_fd, buf, len, 0, (struct sockaddr*)&addr, sizeof addr) == -1) {
+		if (errno != EINTR) {
+			return errno;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Send count requests laid out in buf with consecutive sequence numbers and
+ * wait for all their acks, errors gets their results. Called with nl_lock.
+ */
+static int nl_transact(char* buf, size_t len, unsigned int count, int* errors) {
+	char reply[NL_BUFFER_SIZE];
+	struct nlmsghdr* hdr;
+	struct nlmsgerr* err;
+	unsigned int first_seq, acked = 0, i;
+	ssize_t reply_len;
+	int ret;
+
+	first_seq = nl_seq + 1;
+	for (hdr = (struct nlmsghdr*)buf, i = 0; i < count; hdr = (struct nlmsghdr*)(((char*)hdr) + NLMSG_ALIGN(hdr->nlmsg_len)), ++i) {
+		hdr->nlmsg_seq = ++nl_seq;
+		hdr->nlmsg_flags |= NLM_F_ACK;
+		errors[i] = 0;
+	}
+	if ((ret = nl_send(buf, len)) != 0) {
+		return ret;
+	}
+
+	while (acked < count) {
+		if ((reply_len = recv(nl_fd, reply, sizeof reply, 0)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+
+		for (hdr = (struct nlmsghdr*)reply; NLMSG_OK(hdr, (unsigned int)reply_len); hdr = NLMSG_NEXT(hdr, reply_len)) {
+			/* stale replies of an earlier failed request are skipped */
+			if (hdr->nlmsg_type != NLMSG_ERROR || hdr->nlmsg_seq < first_seq || hdr->nlmsg_seq >= first_seq + count) {
+				continue;
+			}
+			err = (struct nlmsgerr*)NLMSG_DATA(hdr);
+			errors[hdr->nlmsg_seq - first_seq] = -err->error;
+			++acked;
+		}
+	}
+
+	return 0;
+}
+
+/* a single request, its ack is the result */
+static int nl_request(struct nl_req* req) {
+	int ret, error;
+
+	/* NL LOCK */
+	pthread_mutex_lock(&nl_lock);
+	if (nl_socket() == -1) {
+		ret = NL_UNAVAILABLE;
+	} else if ((ret = nl_transact((char*)&req->hdr, req->hdr.nlmsg_len, 1, &error)) == 0) {
+		ret = error;
+	}
+	/* NL UNLOCK */
+	pthread_mutex_unlock(&nl_lock);
+
+	return ret;
+}
+
+/* send the (dump) request and call clb for every object in the reply, until it returns an errno */
+static int nl_query(struct nl_req* req, int (*clb)(struct nlmsghdr* hdr, void* arg), void* arg) {
+	char reply[NL_BUFFER_SIZE];
+	struct nlmsghdr* hdr;
+	ssize_t reply_len;
+	int ret = 0, done = 0;
+
+	/* NL LOCK */
+	pthread_mutex_lock(&nl_lock);
+	if (nl_socket() == -1) {
+		/* NL UNLOCK */
+		pthread_mutex_unlock(&nl_lock);
+		return NL_UNAVAILABLE;
+	}
+
+	req->hdr.nlmsg_seq = ++nl_seq;
+	if ((ret = nl_send(&req->hdr, req->hdr.nlmsg_len)) != 0) {
+		/* NL UNLOCK */
+		pthread_mutex_unlock(&nl_lock);
+		return ret;
+	}
+
+	while (!done) {
+		if ((reply_len = recv(nl_fd, reply, sizeof reply, 0)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ret = errno;
+			break;
+		}
+
+		for (hdr = (struct nlmsghdr*)reply; NLMSG_OK(hdr, (unsigned int)reply_len); hdr = NLMSG_NEXT(hdr, reply_len)) {
+			if (hdr->nlmsg_seq != req->hdr.nlmsg_seq) {
+				continue;
+			}
+			if (hdr->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if (hdr->nlmsg_type == NLMSG_ERROR) {
+				ret = -((struct nlmsgerr*)NLMSG_DATA(hdr))->error;
+				done = 1;
+				break;
+			}
+			/* the rest of a dump is still read after the callback failed */
+			if (ret == 0) {
+				ret = clb(hdr, arg);
+			}
+			if (!(hdr->nlmsg_flags & NLM_F_MULTI)) {
+				done = 1;
+				break;
+			}
+		}
+	}
+	/* NL UNLOCK */
+	pthread_mutex_unlock(&nl_lock);
+
+	return ret;
+}
+
+static void nl_parse_attrs(struct rtattr** tb, int max, struct rtattr* rta, int len) {
+	memset(tb, 0, (max + 1) * sizeof *tb);
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type <= max) {
+			tb[rta->rta_type] = rta;
+		}
+	}
+}
+
+static int nl_ifindex(const char* if_name) {
+	return (int)if_nametoindex(if_name);
+}
+
+int nl_addr_change(int family, const char* if_name, const char* ip, unsigned char prefix, int add) {
+	struct nl_req req;
+	unsigned char addr[sizeof(struct in6_addr)];
+	int index;
+
+	if ((index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+	if (inet_pton(family, ip, addr) != 1) {
+		return EINVAL;
+	}
+
+	nl_req_init(&req, add ? RTM_NEWADDR : RTM_DELADDR, add ? NLM_F_CREATE | NLM_F_EXCL : 0, sizeof req.body.ifa);
+	req.body.ifa.ifa_family = family;
+	req.body.ifa.ifa_prefixlen = prefix;
+	req.body.ifa.ifa_index = index;
+	/* the same as ip does for the loopback addresses */
+	req.body.ifa.ifa_scope = (family == AF_INET && addr[0] == 127) ? RT_SCOPE_HOST : RT_SCOPE_UNIVERSE;
+	nl_req_attr(&req, IFA_LOCAL, addr, (family == AF_INET) ? sizeof(struct in_addr) : sizeof(struct in6_addr));
+	nl_req_attr(&req, IFA_ADDRESS, addr, (family == AF_INET) ? sizeof(struct in_addr) : sizeof(struct in6_addr));
+
+	return nl_request(&req);
+}
+
+/* the addresses of an interface being collected */
+struct nl_addr_dump {
+	int index;
+	struct nl_addr* addrs;
+	unsigned int count;
+
+	/* flush, the deletions of the matching addresses are collected instead */
+	int flush;
+	int scope;
+	unsigned int flags;
+	char* batch;
+	size_t batch_len;
+};
+
+static unsigned int nl_addr_flags(struct ifaddrmsg* ifa, struct rtattr** tb) {
+	/* the 8-bit ifa_flags are extended by the attribute */
+	if (tb[IFA_FLAGS] != NULL) {
+		return *(unsigned int*)RTA_DATA(tb[IFA_FLAGS]);
+	}
+	return ifa->ifa_flags;
+}
+
+int nl_parse_addr(struct nlmsghdr* hdr, struct nl_addr* addr) {
+	struct ifaddrmsg* ifa = (struct ifaddrmsg*)NLMSG_DATA(hdr);
+	struct rtattr* tb[IFA_MAX + 1];
+	struct rtattr* local;
+
+	nl_parse_attrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(hdr));
+
+	/* IFA_LOCAL is the address itself, IFA_ADDRESS the peer on point-to-point links */
+	if ((local = tb[IFA_LOCAL]) == NULL && (local = tb[IFA_ADDRESS]) == NULL) {
+		return EXIT_FAILURE;
+	}
+	inet_ntop(ifa->ifa_family, RTA_DATA(local), addr->ip, sizeof addr->ip);
+	addr->prefix = ifa->ifa_prefixlen;
+	addr->scope = ifa->ifa_scope;
+	addr->flags = nl_addr_flags(ifa, tb);
+
+	return EXIT_SUCCESS;
+}
+
+static int nl_addr_clb(struct nlmsghdr* hdr, void* arg) {
+	struct nl_addr_dump* dump = (struct nl_addr_dump*)arg;
+	struct ifaddrmsg* ifa = (struct ifaddrmsg*)NLMSG_DATA(hdr);
+	struct nl_addr addr;
+	struct nl_addr* new_addrs;
+	char* new_batch;
+
+	if (hdr->nlmsg_type != RTM_NEWADDR || (int)ifa->ifa_index != dump->index || nl_parse_addr(hdr, &addr) != EXIT_SUCCESS) {
+		return 0;
+	}
+
+	if (dump->flush) {
+		/* the dumped message deletes the address, as in ip */
+		if ((dump->scope != -1 && addr.scope != dump->scope) || (addr.flags & dump->flags) != dump->flags) {
+			return 0;
+		}
+		if ((new_batch = realloc(dump->batch, dump->batch_len + NLMSG_ALIGN(hdr->nlmsg_len))) == NULL) {
+			return ENOMEM;
+		}
+		dump->batch = new_batch;
+		memcpy(dump->batch + dump->batch_len, hdr, hdr->nlmsg_len);
+		((struct nlmsghdr*)(dump->batch + dump->batch_len))->nlmsg_type = RTM_DELADDR;
+		((struct nlmsghdr*)(dump->batch + dump->batch_len))->nlmsg_flags = NLM_F_REQUEST;
+		dump->batch_len += NLMSG_ALIGN(hdr->nlmsg_len);
+		++dump->count;
+		return 0;
+	}
+
+	if ((new_addrs = realloc(dump->addrs, (dump->count + 1) * sizeof *dump->addrs)) == NULL) {
+		return ENOMEM;
+	}
+	dump->addrs = new_addrs;
+	dump->addrs[dump->count] = addr;
+	++dump->count;
+
+	return 0;
+}
+
+static void nl_addr_dump_req(struct nl_req* req, int family) {
+	nl_req_init(req, RTM_GETADDR, NLM_F_DUMP, sizeof req->body.ifa);
+	req->body.ifa.ifa_family = family;
+}
+
+int nl_get_addrs(int family, const char* if_name, struct nl_addr** addrs, unsigned int* count) {
+	struct nl_addr_dump dump;
+	struct nl_req req;
+	int ret;
+
+	memset(&dump, 0, sizeof dump);
+	if ((dump.index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+	if ((ret = mon_get_addrs(family, dump.index, addrs, count)) != NL_UNAVAILABLE) {
+		return ret;
+	}
+
+	nl_addr_dump_req(&req, family);
+	if ((ret = nl_query(&req, nl_addr_clb, &dump)) != 0) {
+		free(dump.addrs);
+		return ret;
+	}
+
+	*addrs = dump.addrs;
+	*count = dump.count;
+	return 0;
+}
+
+int nl_addr_flush(int family, const char* if_name, int scope, unsigned int flags) {
+	struct nl_addr_dump dump;
+	struct nl_req req;
+	int ret, *errors;
+	unsigned int i;
+
+	memset(&dump, 0, sizeof dump);
+	if ((dump.index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+	dump.flush = 1;
+	dump.scope = scope;
+	dump.flags = flags;
+
+	nl_addr_dump_req(&req, family);
+	if ((ret = nl_query(&req, nl_addr_clb, &dump)) != 0) {
+		free(dump.batch);
+		return ret;
+	}
+	if (dump.count == 0) {
+		free(dump.batch);
+		return 0;
+	}
+
+	if ((errors = malloc(dump.count * sizeof *errors)) == NULL) {
+		free(dump.batch);
+		return ENOMEM;
+	}
+
+	/* all the deletions at once */
+	/* NL LOCK */
+	pthread_mutex_lock(&nl_lock);
+	if (nl_socket() == -1) {
+		ret = NL_UNAVAILABLE;
+	} else {
+		ret = nl_transact(dump.batch, dump.batch_len, dump.count, errors);
+	}
+	/* NL UNLOCK */
+	pthread_mutex_unlock(&nl_lock);
+
+	/* the secondary addresses may have been removed with their primary one */
+	for (i = 0; ret == 0 && i < dump.count; ++i) {
+		if (errors[i] != 0 && errors[i] != EADDRNOTAVAIL) {
+			ret = errors[i];
+		}
+	}
+
+	free(errors);
+	free(dump.batch);
+	return ret;
+}
+
+int nl_link_set_up(const char* if_name, int up) {
+	struct nl_req req;
+	int index;
+
+	if ((index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+
+	nl_req_init(&req, RTM_NEWLINK, 0, sizeof req.body.ifi);
+	req.body.ifi.ifi_family = AF_UNSPEC;
+	req.body.ifi.ifi_index = index;
+	req.body.ifi.ifi_change = IFF_UP;
+	req.body.ifi.ifi_flags = up ? IFF_UP : 0;
+
+	return nl_request(&req);
+}
+
+static int nl_link_clb(struct nlmsghdr* hdr, void* arg) {
+	struct ifinfomsg* ifi = (struct ifinfomsg*)NLMSG_DATA(hdr);
+	struct rtattr* tb[IFLA_MAX + 1];
+
+	if (hdr->nlmsg_type != RTM_NEWLINK) {
+		return 0;
+	}
+	nl_parse_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(hdr));
+	if (tb[IFLA_OPERSTATE] != NULL) {
+		*(unsigned char*)arg = *(unsigned char*)RTA_DATA(tb[IFLA_OPERSTATE]);
+	}
+
+	return 0;
+}
+
+int nl_get_operstate(const char* if_name, unsigned char* operstate) {
+	struct nl_req req;
+	time_t last_change;
+	int index, ret;
+
+	if ((index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+	if ((ret = mon_get_link(index, operstate, &last_change)) != NL_UNAVAILABLE) {
+		return ret;
+	}
+
+	nl_req_init(&req, RTM_GETLINK, 0, sizeof req.body.ifi);
+	req.body.ifi.ifi_family = AF_UNSPEC;
+	req.body.ifi.ifi_index = index;
+
+	*operstate = IF_OPER_UNKNOWN;
+	return nl_query(&req, nl_link_clb, operstate);
+}
+
+struct nl_stats_dump {
+	int (*clb)(unsigned int index, const char* if_name, const struct rtnl_link_stats64* stats, void* arg);
+	void* arg;
+};
+
+static int nl_stats_clb(struct nlmsghdr* hdr, void* arg) {
+	struct nl_stats_dump* dump = (struct nl_stats_dump*)arg;
+	struct ifinfomsg* ifi = (struct ifinfomsg*)NLMSG_DATA(hdr);
+	struct rtattr* tb[IFLA_MAX + 1];
+	struct rtnl_link_stats64 stats;
+
+	if (hdr->nlmsg_type != RTM_NEWLINK) {
+		return 0;
+	}
+	nl_parse_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(hdr));
+	if (tb[IFLA_IFNAME] == NULL || tb[IFLA_STATS64] == NULL) {
+		return 0;
+	}
+
+	/* the attribute may be unaligned for 64-bit access and older kernels send fewer counters */
+	memset(&stats, 0, sizeof stats);
+	memcpy(&stats, RTA_DATA(tb[IFLA_STATS64]), (RTA_PAYLOAD(tb[IFLA_STATS64]) < sizeof stats) ? RTA_PAYLOAD(tb[IFLA_STATS64]) : sizeof stats);
+
+	return dump->clb(ifi->ifi_index, (char*)RTA_DATA(tb[IFLA_IFNAME]), &stats, dump->arg);
+}
+
+int nl_get_link_stats(int (*clb)(unsigned int index, const char* if_name, const struct rtnl_link_stats64* stats, void* arg), void* arg) {
+	struct nl_stats_dump dump;
+	struct nl_req req;
+
+	dump.clb = clb;
+	dump.arg = arg;
+
+	nl_req_init(&req, RTM_GETLINK, NLM_F_DUMP, sizeof req.body.ifi);
+	req.body.ifi.ifi_family = AF_UNSPEC;
+
+	return nl_query(&req, nl_stats_clb, &dump);
+}
+
+static int nl_mac_parse(const char* mac, unsigned char* addr) {
+	unsigned int byte[6];
+	int i;
+
+	if (sscanf(mac, "%x:%x:%x:%x:%x:%x", &byte[0], &byte[1], &byte[2], &byte[3], &byte[4], &byte[5]) != 6) {
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < 6; ++i) {
+		addr[i] = byte[i];
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int nl_neigh_change(int family, const char* if_name, const char* ip, const char* mac, int add) {
+	struct nl_req req;
+	unsigned char addr[sizeof(struct in6_addr)], lladdr[6];
+	int index;
+
+	if ((index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+	if (inet_pton(family, ip, addr) != 1 || nl_mac_parse(mac, lladdr) != EXIT_SUCCESS) {
+		return EINVAL;
+	}
+
+	nl_req_init(&req, add ? RTM_NEWNEIGH : RTM_DELNEIGH, add ? NLM_F_CREATE | NLM_F_REPLACE : 0, sizeof req.body.nd);
+	req.body.nd.ndm_family = family;
+	req.body.nd.ndm_ifindex = index;
+	req.body.nd.ndm_state = NUD_PERMANENT;
+	nl_req_attr(&req, NDA_DST, addr, (family == AF_INET) ? sizeof(struct in_addr) : sizeof(struct in6_addr));
+	nl_req_attr(&req, NDA_LLADDR, lladdr, sizeof lladdr);
+
+	return nl_request(&req);
+}
+
+struct nl_neigh_dump {
+	int index;
+	struct nl_neigh* neighs;
+	unsigned int count;
+};
+
+int nl_parse_neigh(struct nlmsghdr* hdr, struct nl_neigh* neigh) {
+	struct ndmsg* nd = (struct ndmsg*)NLMSG_DATA(hdr);
+	struct rtattr* tb[NDA_MAX + 1];
+	unsigned char* lladdr;
+
+	nl_parse_attrs(tb, NDA_MAX, (struct rtattr*)(((char*)nd) + NLMSG_ALIGN(sizeof *nd)), hdr->nlmsg_len - NLMSG_LENGTH(sizeof *nd));
+	if (tb[NDA_DST] == NULL) {
+		return EXIT_FAILURE;
+	}
+	inet_ntop(nd->ndm_family, RTA_DATA(tb[NDA_DST]), neigh->ip, sizeof neigh->ip);
+
+	/* ip neigh show does not list the NOARP entries either */
+	if ((nd->ndm_state & NUD_NOARP) || tb[NDA_LLADDR] == NULL || RTA_PAYLOAD(tb[NDA_LLADDR]) != 6) {
+		neigh->mac[0] = '\0';
+	} else {
+		lladdr = RTA_DATA(tb[NDA_LLADDR]);
+		sprintf(neigh->mac, "%02x:%02x:%02x:%02x:%02x:%02x", lladdr[0], lladdr[1], lladdr[2], lladdr[3], lladdr[4], lladdr[5]);
+	}
+	neigh->state = nd->ndm_state;
+	neigh->flags = nd->ndm_flags;
+
+	return EXIT_SUCCESS;
+}
+
+static int nl_neigh_clb(struct nlmsghdr* hdr, void* arg) {
+	struct nl_neigh_dump* dump = (struct nl_neigh_dump*)arg;
+	struct ndmsg* nd = (struct ndmsg*)NLMSG_DATA(hdr);
+	struct nl_neigh neigh;
+	struct nl_neigh* new_neighs;
+
+	if (hdr->nlmsg_type != RTM_NEWNEIGH || nd->ndm_ifindex != dump->index || nl_parse_neigh(hdr, &neigh) != EXIT_SUCCESS || neigh.mac[0] == '\0') {
+		return 0;
+	}
+
+	if ((new_neighs = realloc(dump->neighs, (dump->count + 1) * sizeof *dump->neighs)) == NULL) {
+		return ENOMEM;
+	}
+	dump->neighs = new_neighs;
+	dump->neighs[dump->count] = neigh;
+	++dump->count;
+
+	return 0;
+}
+
+int nl_get_neighs(int family, const char* if_name, struct nl_neigh** neighs, unsigned int* count) {
+	struct nl_neigh_dump dump;
+	struct nl_req req;
+	int ret;
+
+	memset(&dump, 0, sizeof dump);
+	if ((dump.index = nl_ifindex(if_name)) == 0) {
+		return ENODEV;
+	}
+	if ((ret = mon_get_neighs(family, dump.index, neighs, count)) != NL_UNAVAILABLE) {
+		return ret;
+	}
+
+	nl_req_init(&req, RTM_GETNEIGH, NLM_F_DUMP, sizeof req.body.nd);
+	req.body.nd.ndm_family = family;
+	if ((ret = nl_query(&req, nl_neigh_clb, &dump)) != 0) {
+		free(dump.neighs);
+		return ret;
+	}
+
+	*neighs = dump.neighs;
+	*count = dump.count;
+	return 0;
+}
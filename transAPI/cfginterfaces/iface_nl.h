@@ -0,0 +1,65 @@
+#ifndef _IFACE_NL_H_
+#define _IFACE_NL_H_
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+
+/*
+ * rtnetlink replacements of the "ip" commands, all the requests share a single socket.
+ * The getters are answered from the model of the interface monitor when it is in sync.
+ * The functions return 0 on success, the errno of the kernel or the system call
+ * on failure, or NL_UNAVAILABLE if netlink cannot be used and the command should
+ * be executed instead.
+ */
+#define NL_UNAVAILABLE (-1)
+
+struct nl_addr {
+	char ip[INET6_ADDRSTRLEN];
+	unsigned char prefix;
+	unsigned char scope;
+	unsigned int flags;			/* IFA_F_* */
+};
+
+struct nl_neigh {
+	char ip[INET6_ADDRSTRLEN];
+	char mac[18];
+	unsigned short state;		/* NUD_* */
+	unsigned char flags;		/* NTF_* */
+};
+
+/* ip addr add|del <ip>/<prefix> dev <if_name> */
+int nl_addr_change(int family, const char* if_name, const char* ip, unsigned char prefix, int add);
+
+/* ip addr flush dev <if_name>, only the addresses of the scope (-1 any) and with all the flags (IFA_F_*), in one batch */
+int nl_addr_flush(int family, const char* if_name, int scope, unsigned int flags);
+
+/* ip addr show dev <if_name>, *addrs to be freed */
+int nl_get_addrs(int family, const char* if_name, struct nl_addr** addrs, unsigned int* count);
+
+/* ip link set dev <if_name> up|down */
+int nl_link_set_up(const char* if_name, int up);
+
+/* IF_OPER_* of the interface as in ip link show <if_name> */
+int nl_get_operstate(const char* if_name, unsigned char* operstate);
+
+/* ip neigh replace|del <ip> lladdr <mac> dev <if_name> */
+int nl_neigh_change(int family, const char* if_name, const char* ip, const char* mac, int add);
+
+/* ip neigh show dev <if_name>, only the neighbors with a link-layer address, *neighs to be freed */
+int nl_get_neighs(int family, const char* if_name, struct nl_neigh** neighs, unsigned int* count);
+
+/* ip -s link show, clb called for every interface in one dump, returning an errno stops it */
+int nl_get_link_stats(int (*clb)(unsigned int index, const char* if_name, const struct rtnl_link_stats64* stats, void* arg), void* arg);
+
+/* parse an RTM_NEWADDR/DELADDR message */
+int nl_parse_addr(struct nlmsghdr* hdr, struct nl_addr* addr);
+
+/* parse an RTM_NEWNEIGH/DELNEIGH message, mac is empty if ip neigh show would not list it */
+int nl_parse_neigh(struct nlmsghdr* hdr, struct nl_neigh* neigh);
+
+/* close the socket */
+void nl_cleanup(void);
+
+#endif /* _IFACE_NL_H_ */
@@ -92,12 +92,25 @@ static void clip_occurences_with(char *str, char sought, char replacement)
 	}
 }
 
+/* the files and their lenses */
+static const struct {
+	int flag;
+	const char* name;
+	const char* lens;
+	const char* file;
+} augeas_files[] = {
+	{AUGEAS_NTP, "Ntp", "Ntp.lns", AUGEAS_NTP_CONF},
+	{AUGEAS_DNS, "Resolv", "Resolv.lns", AUGEAS_DNS_CONF},
+	{AUGEAS_SSHD, "Sshd", "Sshd.lns", NETOPEER_SSHD_CONF},
+	{AUGEAS_LOGIN_DEFS, "Login_defs", "Login_defs.lns", AUGEAS_LOGIN_CONF}
+};
+
+/* AUGEAS_* loaded and modified since the last save */
+static int augeas_loaded = 0;
+static int augeas_modified = 0;
+
 int augeas_init(char** msg)
 {
-	char** matches;
-	char* path = NULL;
-	int c, i;
-
 	assert(msg);
 
 	if (sysaugeas != NULL) {
@@ -111,73 +124,128 @@ int augeas_init(char** msg)
 		return EXIT_FAILURE;
 	}
 
-	/*
-	 * check if we are able to load Login_defs lens, on augeas <1.1 it can fail,
-	 * but we can continue even without login.defs (default values will be used)
-	 */
-	aug_set(sysaugeas, "/augeas/load/Login_defs/lens", "Login_defs.lns");
-	aug_set(sysaugeas, "/augeas/load/Login_defs/incl", AUGEAS_LOGIN_CONF);
-	aug_load(sysaugeas);
-	if (aug_match(sysaugeas, "/augeas//error", NULL) != 0) {
-		/* continue without login.defs */
-		aug_rm(sysaugeas, "/augeas/load/Login_defs/");
-	}
-
-	/* NTP */
-	aug_set(sysaugeas, "/augeas/load/Ntp/lens", "Ntp.lns");
-	aug_set(sysaugeas, "/augeas/load/Ntp/incl", AUGEAS_NTP_CONF);
-	/* DNS resolver */
-	aug_set(sysaugeas, "/augeas/load/Resolv/lens", "Resolv.lns");
-	aug_set(sysaugeas, "/augeas/load/Resolv/incl", AUGEAS_DNS_CONF);
-	/* authentication */
 	strcpy(NETOPEER_SSHD_CONF, NETOPEER_DIR"/sshd_config");
 	clip_occurences_with(NETOPEER_SSHD_CONF, '/', '/');
-	aug_set(sysaugeas, "/augeas/load/Sshd/lens", "Sshd.lns");
-	aug_set(sysaugeas, "/augeas/load/Sshd/incl", NETOPEER_SSHD_CONF);
+
+	/* the lenses are loaded on the first use, by augeas_use() */
+	augeas_loaded = 0;
+	augeas_modified = 0;
+
+	return EXIT_SUCCESS;
+}
+
+static int augeas_load(int i, char** msg)
+{
+	char* path = NULL;
+	const char* value = NULL;
+
+	asprintf(&path, "/augeas/load/%s/lens", augeas_files[i].name);
+	aug_set(sysaugeas, path, augeas_files[i].lens);
+	free(path);
+	asprintf(&path, "/augeas/load/%s/incl", augeas_files[i].name);
+	aug_set(sysaugeas, path, augeas_files[i].file);
+	free(path);
+
+	/* the files loaded before are not read again unless they changed */
 	aug_load(sysaugeas);
 
-	if ((c = aug_match(sysaugeas, "/augeas//error", &matches)) != 0) {
-		aug_get(sysaugeas, matches[0], (const char**) msg);
-		asprintf(msg, "Initiating augeas failed (%s: %s)", matches[0], *msg);
-		augeas_close();
-		for (i = 0; i < c; ++i) {
-			free(matches[i]);
+	/* check only this file, the errors of the others were handled when they were loaded */
+	asprintf(&path, "/augeas/files%s/error", augeas_files[i].file);
+	if (aug_match(sysaugeas, path, NULL) != 0) {
+		if (augeas_files[i].flag == AUGEAS_LOGIN_DEFS) {
+			/*
+			 * the Login_defs lens can fail on augeas <1.1, but we can
+			 * continue even without login.defs (default values will be used)
+			 */
+			aug_rm(sysaugeas, path);
+			free(path);
+			aug_rm(sysaugeas, "/augeas/load/Login_defs/");
+			return EXIT_SUCCESS;
 		}
-		free(matches);
+
+		aug_get(sysaugeas, path, &value);
+		asprintf(msg, "Initiating augeas failed (%s: %s)", path, value);
+		free(path);
+		asprintf(&path, "/augeas/load/%s", augeas_files[i].name);
+		aug_rm(sysaugeas, path);
+		free(path);
 		return EXIT_FAILURE;
 	}
-
-	/* Switch off the PAM authentication in the sshd configuration.
-	 * The better way should be probably support PAM, but since we support only
-	 * local users, we don't need it. The only configuration we have to work
-	 * with is sshd_config. There, if the UsePAM is set to 'no', we have a full
-	 * control of the authentication via PasswordAuthentication value which
-	 * allows us to turn on/off 'local-users' user-authentication-order.
-	 *
-	 * If the PasswordAuthentication is 'no', pubkey authentication can still
-	 * works (but it is out of the ietf-netmod-system-mgmt). In this case the
-	 * user-authentication-order leaf-list with 'local-users' value is not
-	 * present.
-	 *
-	 * If the PasswordAuthentication is 'yes', the user-authentication-order
-	 * leaf-list with 'local-users' value is present. And since we don't support
-	 * radius authentication, it is the only user-authentication-order element.
-	 */
-	asprintf(&path, "/files/%s/UsePAM", NETOPEER_SSHD_CONF);
-	aug_set(sysaugeas, path, "no");
 	free(path);
-	augeas_save(msg);
-	free(*msg); *msg = NULL;
+
+	if (augeas_files[i].flag == AUGEAS_SSHD) {
+		/* Switch off the PAM authentication in the sshd configuration.
+		 * The better way should be probably support PAM, but since we support only
+		 * local users, we don't need it. The only configuration we have to work
+		 * with is sshd_config. There, if the UsePAM is set to 'no', we have a full
+		 * control of the authentication via PasswordAuthentication value which
+		 * allows us to turn on/off 'local-users' user-authentication-order.
+		 *
+		 * If the PasswordAuthentication is 'no', pubkey authentication can still
+		 * works (but it is out of the ietf-netmod-system-mgmt). In this case the
+		 * user-authentication-order leaf-list with 'local-users' value is not
+		 * present.
+		 *
+		 * If the PasswordAuthentication is 'yes', the user-authentication-order
+		 * leaf-list with 'local-users' value is present. And since we don't support
+		 * radius authentication, it is the only user-authentication-order element.
+		 */
+		asprintf(&path, "/files/%s/UsePAM", NETOPEER_SSHD_CONF);
+		if (aug_get(sysaugeas, path, &value) != 1 || value == NULL || strcmp(value, "no") != 0) {
+			aug_set(sysaugeas, path, "no");
+			augeas_modified |= AUGEAS_SSHD;
+			augeas_save(msg);
+			free(*msg); *msg = NULL;
+		}
+		free(path);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int augeas_use(int files, int modify, char** msg)
+{
+	unsigned int i;
+
+	assert(sysaugeas);
+	assert(msg);
+
+	if ((files & ~augeas_loaded) != 0 && augeas_modified != 0) {
+		/* aug_load() would discard the changes not saved yet */
+		if (augeas_save(msg) != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < sizeof augeas_files / sizeof augeas_files[0]; ++i) {
+		if (!(files & augeas_files[i].flag) || (augeas_loaded & augeas_files[i].flag)) {
+			continue;
+		}
+		if (augeas_load(i, msg) != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		augeas_loaded |= augeas_files[i].flag;
+	}
+
+	if (modify) {
+		augeas_modified |= files;
+	}
 
 	return EXIT_SUCCESS;
 }
 
 int augeas_save(char** msg)
 {
+	if (augeas_modified == 0) {
+		/* nothing to write */
+		return (EXIT_SUCCESS);
+	}
+
 	if (aug_save(sysaugeas) != 0) {
 		asprintf(msg, "Saving configuration failed (%s)", aug_error_message(sysaugeas));
 		return (EXIT_FAILURE);
 	}
+	augeas_modified = 0;
 
 	return (EXIT_SUCCESS);
 }
@@ -186,4 +254,6 @@ void augeas_close(void)
 {
 	aug_close(sysaugeas);
 	sysaugeas = NULL;
+	augeas_loaded = 0;
+	augeas_modified = 0;
 }
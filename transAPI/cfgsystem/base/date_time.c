@@ -272,7 +272,9 @@ xmlNodePtr ntp_getconfig(xmlNsPtr ns, char** errmsg)
 	char* path, *content = NULL;
 	xmlNodePtr ntp_node, server, aux_node;
 
-	assert(sysaugeas);
+	if (augeas_use(AUGEAS_NTP, 0, errmsg) != EXIT_SUCCESS) {
+		return (NULL);
+	}
 
 	/* ntp */
 	ntp_node = xmlNewNode(ns, BAD_CAST "ntp");
@@ -369,6 +371,10 @@ int ntp_add_server(const char* udp_address, const char* association_type, bool i
 	assert(udp_address);
 	assert(association_type);
 
+	if (augeas_use(AUGEAS_NTP, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	asprintf(&path, "/files/%s/%s", AUGEAS_NTP_CONF, association_type);
 	ret = aug_match(sysaugeas, path, NULL);
 	if (ret == -1) {
@@ -427,6 +433,10 @@ int ntp_rm_server(const char* udp_address, const char* association_type, bool ib
 	assert(udp_address);
 	assert(association_type);
 
+	if (augeas_use(AUGEAS_NTP, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	path = NULL;
 	asprintf(&path, "/files/%s/%s", AUGEAS_NTP_CONF, association_type);
 	ret = aug_match(sysaugeas, path, &matches);
@@ -474,55 +484,241 @@ int ntp_rm_server(const char* udp_address, const char* association_type, bool ib
 	return EXIT_SUCCESS;
 }
 
-char** ntp_resolve_server(const char* server_name, char** msg)
-{
-	struct sockaddr_in* addr4;
-	struct sockaddr_in6* addr6;
-	char buffer[INET6_ADDRSTRLEN + 1];
-	struct addrinfo* current;
-	struct addrinfo* addrs;
+/*
+ * Cache of the resolved NTP server names. getaddrinfo() does not provide the TTL
+ * of the records, so the addresses are kept for NTP_RESOLVE_TTL seconds. The
+ * requests are resolved concurrently by getaddrinfo_a(), an entry must not be
+ * freed while its request is in progress.
+ */
+#define NTP_RESOLVE_TTL 300
+#define NTP_RESOLVE_TIMEOUT 10
+
+struct ntp_resolve {
+	char* name;
 	struct addrinfo hints;
-	char** ret = NULL;
-	int r, i, count;
+	struct gaicb req;
+	int pending;
+	int error;
+	char** addrs;
+	time_t expires;
+	struct ntp_resolve* next;
+};
 
-	memset(&hints, 0, sizeof(struct addrinfo));
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_DGRAM;
-	hints.ai_protocol = IPPROTO_UDP;
+static struct ntp_resolve* ntp_resolve_cache = NULL;
 
-	if ((r = getaddrinfo(server_name, NULL, &hints, &addrs)) != 0) {
-		asprintf(msg, "getaddrinfo call failed: %s\n", gai_strerror(r));
-		return NULL;
+static void ntp_resolve_free(struct ntp_resolve* entry)
+{
+	int i;
+
+	if (entry->addrs != NULL) {
+		for (i = 0; entry->addrs[i] != NULL; i++) {
+			free(entry->addrs[i]);
+		}
+		free(entry->addrs);
 	}
+	free(entry->name);
+	free(entry);
+}
 
-	/* count returned addresses */
-	for (current = addrs, count = 0; current != NULL; current = current->ai_next, count++);
-	if (count == 0) {
-		*msg = strdup("\"%s\" cannot be resolved.");
-		return NULL;
+/* collect the result of a finished request */
+static void ntp_resolve_done(struct ntp_resolve* entry)
+{
+	char buffer[INET6_ADDRSTRLEN];
+	struct addrinfo* current;
+	void* addr;
+	int i, count;
+
+	entry->pending = 0;
+	entry->error = gai_error(&entry->req);
+	entry->expires = time(NULL) + NTP_RESOLVE_TTL;
+	if (entry->error != 0) {
+		/* report the failure once, try again the next time */
+		entry->expires = 0;
+		return;
 	}
 
-	/* get array for returning */
-	ret = malloc(count * sizeof(char*));
-	for (i = 0, current = addrs; i < count; i++, current = current->ai_next) {
+	for (current = entry->req.ar_result, count = 0; current != NULL; current = current->ai_next, count++);
+	entry->addrs = malloc((count + 1) * sizeof(char*));
+	for (i = 0, current = entry->req.ar_result; current != NULL; current = current->ai_next) {
 		switch (current->ai_addr->sa_family) {
 		case AF_INET:
-			addr4 = (struct sockaddr_in*) current->ai_addr;
-			ret[i] = strdup(inet_ntop(AF_INET, &addr4->sin_addr.s_addr, buffer, INET6_ADDRSTRLEN));
+			addr = &((struct sockaddr_in*) current->ai_addr)->sin_addr;
 			break;
-
 		case AF_INET6:
-			addr6 = (struct sockaddr_in6*) current->ai_addr;
-			ret[i] = strdup(inet_ntop(AF_INET6, &addr6->sin6_addr.s6_addr, buffer, INET6_ADDRSTRLEN));
+			addr = &((struct sockaddr_in6*) current->ai_addr)->sin6_addr;
 			break;
+		default:
+			continue;
+		}
+		entry->addrs[i++] = strdup(inet_ntop(current->ai_addr->sa_family, addr, buffer, INET6_ADDRSTRLEN));
+	}
+	entry->addrs[i] = NULL;
+	freeaddrinfo(entry->req.ar_result);
+	entry->req.ar_result = NULL;
+}
+
+/* get the cache entry, the expired ones are dropped */
+static struct ntp_resolve* ntp_resolve_find(const char* server_name)
+{
+	struct ntp_resolve *entry, *prev = NULL;
+	time_t now = time(NULL);
+
+	for (entry = ntp_resolve_cache; entry != NULL; prev = entry, entry = entry->next) {
+		if (strcmp(entry->name, server_name) != 0) {
+			continue;
+		}
+		if (entry->pending) {
+			if (gai_error(&entry->req) != EAI_INPROGRESS) {
+				/* a failure is still reported */
+				ntp_resolve_done(entry);
+			}
+			return entry;
+		}
+		if (entry->expires > now) {
+			return entry;
+		}
+
+		/* expired */
+		if (prev == NULL) {
+			ntp_resolve_cache = entry->next;
+		} else {
+			prev->next = entry->next;
 		}
+		ntp_resolve_free(entry);
+		return NULL;
 	}
-	ret[i] = NULL; /* terminating NULL byte */
-	freeaddrinfo(addrs);
+
+	return NULL;
+}
+
+void ntp_resolve_prefetch(const char** server_names, int count)
+{
+	struct ntp_resolve *entry, *first = NULL, *last = NULL;
+	struct gaicb** list;
+	int i, j, n = 0;
+
+	if (count == 0) {
+		return;
+	}
+	list = malloc(count * sizeof(struct gaicb*));
+
+	for (i = 0; i < count; i++) {
+		/* the entries of this batch are not submitted yet */
+		for (j = 0; j < n && strcmp(list[j]->ar_name, server_names[i]) != 0; j++);
+		if (j < n || ntp_resolve_find(server_names[i]) != NULL) {
+			continue;
+		}
+
+		entry = calloc(1, sizeof(struct ntp_resolve));
+		entry->name = strdup(server_names[i]);
+		entry->hints.ai_family = AF_UNSPEC;
+		entry->hints.ai_socktype = SOCK_DGRAM;
+		entry->hints.ai_protocol = IPPROTO_UDP;
+		entry->req.ar_name = entry->name;
+		entry->req.ar_request = &entry->hints;
+		entry->pending = 1;
+
+		entry->next = ntp_resolve_cache;
+		ntp_resolve_cache = entry;
+		if (last == NULL) {
+			last = entry;
+		}
+		first = entry;
+		list[n++] = &entry->req;
+	}
+
+	if (n != 0 && (i = getaddrinfo_a(GAI_NOWAIT, list, n, NULL)) != 0) {
+		nc_verb_warning("getaddrinfo_a call failed: %s", gai_strerror(i));
+		/* none of them was submitted, forget them */
+		ntp_resolve_cache = last->next;
+		last->next = NULL;
+		while (first != NULL) {
+			entry = first->next;
+			ntp_resolve_free(first);
+			first = entry;
+		}
+	}
+	free(list);
+}
+
+char** ntp_resolve_server(const char* server_name, char** msg)
+{
+	const struct gaicb* list[1];
+	struct ntp_resolve* entry;
+	struct timespec timeout;
+	time_t deadline;
+	char** ret;
+	int r, i;
+
+	if ((entry = ntp_resolve_find(server_name)) == NULL) {
+		ntp_resolve_prefetch(&server_name, 1);
+		if ((entry = ntp_resolve_find(server_name)) == NULL) {
+			asprintf(msg, "Unable to resolve \"%s\".", server_name);
+			return NULL;
+		}
+	}
+
+	/* wait for the request, the others continue meanwhile */
+	list[0] = &entry->req;
+	deadline = time(NULL) + NTP_RESOLVE_TIMEOUT;
+	while (entry->pending) {
+		if (gai_error(&entry->req) != EAI_INPROGRESS) {
+			ntp_resolve_done(entry);
+			break;
+		}
+		timeout.tv_sec = deadline - time(NULL);
+		timeout.tv_nsec = 0;
+		if (timeout.tv_sec <= 0 || gai_suspend(list, 1, &timeout) == EAI_AGAIN) {
+			/* not cancelled means still running, it is kept in the cache */
+			if (gai_cancel(&entry->req) == EAI_CANCELED) {
+				ntp_resolve_done(entry);
+			}
+			asprintf(msg, "Resolving \"%s\" timed out.", server_name);
+			return NULL;
+		}
+	}
+
+	if (entry->error != 0) {
+		asprintf(msg, "getaddrinfo call failed: %s", gai_strerror(entry->error));
+		return NULL;
+	}
+	if (entry->addrs[0] == NULL) {
+		asprintf(msg, "\"%s\" cannot be resolved.", server_name);
+		return NULL;
+	}
+
+	/* the caller gets its copy */
+	for (i = 0; entry->addrs[i] != NULL; i++);
+	ret = malloc((i + 1) * sizeof(char*));
+	for (r = 0; r < i; r++) {
+		ret[r] = strdup(entry->addrs[r]);
+	}
+	ret[r] = NULL;
 
 	return ret;
 }
 
+void ntp_resolve_cleanup(void)
+{
+	const struct gaicb* list[1];
+	struct ntp_resolve* entry;
+
+	while ((entry = ntp_resolve_cache) != NULL) {
+		ntp_resolve_cache = entry->next;
+		if (entry->pending && gai_cancel(&entry->req) == EAI_NOTCANCELED) {
+			/* the request still uses the entry */
+			list[0] = &entry->req;
+			while (gai_error(&entry->req) == EAI_INPROGRESS) {
+				gai_suspend(list, 1, NULL);
+			}
+		}
+		if (entry->pending) {
+			ntp_resolve_done(entry);
+		}
+		ntp_resolve_free(entry);
+	}
+}
+
 long tz_get_offset(void)
 {
 	tzset();
@@ -130,13 +130,26 @@ int ntp_add_server(const char* udp_address, const char* association_type, bool i
 int ntp_rm_server(const char* udp_address, const char* association_type, bool iburst, bool prefer, char** msg);
 
 /**
- * @brief resolve an URL in both IPv4 and IPv6
+ * @brief start resolving the server names in the background, the names already
+ * cached or being resolved are skipped
+ * @param server_names[in] URLs of the servers
+ * @param count[in] number of the URLs
+ */
+void ntp_resolve_prefetch(const char** server_names, int count);
+
+/**
+ * @brief resolve an URL in both IPv4 and IPv6, the result is cached
  * @param server_name[in] URL of a server
  * @param msg[out] error message in case of an error
  * @return NULL terminated list of IP addresses or NULL in case of error.
  */
 char** ntp_resolve_server(const char* server_name, char** msg);
 
+/**
+ * @brief drop the cache of the resolved URLs
+ */
+void ntp_resolve_cleanup(void);
+
 /**
  * @brief get the current timezone offset
  * @return timezone offset in minutes, cannot fail
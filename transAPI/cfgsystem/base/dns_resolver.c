@@ -55,6 +55,15 @@
 /* from common.c */
 extern augeas *sysaugeas;
 
+/* for the functions without an error message, a failure is then reported by the next use */
+static void dns_use(void)
+{
+	char* msg = NULL;
+
+	augeas_use(AUGEAS_DNS, 1, &msg);
+	free(msg);
+}
+
 xmlNodePtr dns_getconfig(xmlNsPtr ns, char** msg)
 {
 	int i, done;
@@ -62,7 +71,9 @@ xmlNodePtr dns_getconfig(xmlNsPtr ns, char** msg)
 	const char* value;
 	xmlNodePtr dns_node, server, aux_node;
 
-	assert(sysaugeas);
+	if (augeas_use(AUGEAS_DNS, 0, msg) != EXIT_SUCCESS) {
+		return (NULL);
+	}
 
 	/* dns-resolver */
 	dns_node = xmlNewNode(ns, BAD_CAST "dns-resolver");
@@ -173,6 +184,10 @@ int dns_add_search_domain(const char* domain, int index, char** msg)
 		return EXIT_FAILURE;
 	}
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	switch (ret = aug_match(sysaugeas, "/files/"AUGEAS_DNS_CONF"/search/domain", NULL)) {
 	case -1:
 		asprintf(msg, "Augeas match for \"%s\" failed: %s", "/files/"AUGEAS_DNS_CONF"/search/domain", aug_error_message(sysaugeas));
@@ -230,6 +245,10 @@ int dns_rm_search_domain(const char* domain, char** msg)
 
 	assert(domain);
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	if ((ret = aug_match(sysaugeas, path, &matches)) == -1) {
 		asprintf(msg, "Augeas match for \"%s\" failed: %s", path, aug_error_message(sysaugeas));
 		return EXIT_FAILURE;
@@ -260,6 +279,8 @@ int dns_rm_search_domain(const char* domain, char** msg)
 void dns_rm_search_domain_all(void)
 {
 	const char* path = "/files/"AUGEAS_DNS_CONF"/search";
+
+	dns_use();
 	aug_rm(sysaugeas, path);
 }
 
@@ -270,6 +291,10 @@ int dns_mod_nameserver(const char* address, int index, char** msg)
 	assert(address);
 	assert(index >= 1);
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	asprintf(&path, "/files/%s/nameserver[%d]", AUGEAS_DNS_CONF, index);
 	if (aug_set(sysaugeas, path, address) == -1) {
 		asprintf(msg, "Changing DNS server failed (%s)", aug_error_message(sysaugeas));
@@ -289,6 +314,10 @@ int dns_add_nameserver(const char* address, int index, char** msg)
 	assert(address);
 	assert(index >= 1);
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	switch (ret = aug_match(sysaugeas, "/files/"AUGEAS_DNS_CONF"/nameserver", NULL)) {
 	case -1:
 		asprintf(msg, "Augeas match for \"%s\" failed: %s", "/files/"AUGEAS_DNS_CONF"/nameserver", aug_error_message(sysaugeas));
@@ -343,6 +372,10 @@ int dns_rm_nameserver(const char* address, char** msg)
 	const char* value;
 	int i, ret;
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	for (i = 1;; ++i) {
 		asprintf(&path, "/files/%s/nameserver[%d]", AUGEAS_DNS_CONF, i);
 		ret = aug_get(sysaugeas, path, (const char**)&value);
@@ -375,6 +408,8 @@ int dns_rm_nameserver(const char* address, char** msg)
 void dns_rm_nameserver_all(void)
 {
 	const char* path = "/files/"AUGEAS_DNS_CONF"/nameserver";
+
+	dns_use();
 	aug_rm(sysaugeas, path);
 }
 
@@ -384,6 +419,10 @@ int dns_set_opt_timeout(const char* number, char** msg)
 
 	assert(number);
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	/* Create or set existing one */
 	if (aug_set(sysaugeas, path, number) == -1) {
 		asprintf(msg, "Setting DNS timeout option failed (%s)", aug_error_message(sysaugeas));
@@ -396,6 +435,8 @@ int dns_set_opt_timeout(const char* number, char** msg)
 int dns_rm_opt_timeout(void)
 {
 	const char* path = "/files/"AUGEAS_DNS_CONF"/options/timeout";
+
+	dns_use();
 	aug_rm(sysaugeas, path);
 
 	return EXIT_SUCCESS;
@@ -407,6 +448,10 @@ int dns_set_opt_attempts(const char* number, char** msg)
 
 	assert(number);
 
+	if (augeas_use(AUGEAS_DNS, 1, msg) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
 	/* Create or set existing one */
 	if (aug_set(sysaugeas, path, number) == -1) {
 		asprintf(msg, "Setting DNS attempts option failed (%s)", aug_error_message(sysaugeas));
@@ -419,6 +464,8 @@ int dns_set_opt_attempts(const char* number, char** msg)
 int dns_rm_opt_attempts(void)
 {
 	const char* path = "/files/"AUGEAS_DNS_CONF"/options/timeout";
+
+	dns_use();
 	aug_rm(sysaugeas, path);
 
 	return EXIT_SUCCESS;
@@ -64,6 +64,7 @@
 #include "encrypt.h"
 #include "common.h"
 
+#define PASSWD_ORIG "/etc/passwd"
 #define SHADOW_ORIG "/etc/shadow"
 #define SHADOW_COPY "/etc/shadow.cfgsystem"
 
@@ -82,6 +83,11 @@ static void get_login_defs(void)
 	const char *value;
 	char *endptr;
 	static char method[10] = {'\0','\0','\0','\0','\0','\0','\0','\0','\0','\0'};
+	char *msg = NULL;
+
+	/* without login.defs, the default values are used */
+	augeas_use(AUGEAS_LOGIN_DEFS, 0, &msg);
+	free(msg);
 
 	if (aug_get(sysaugeas, "/files/"AUGEAS_LOGIN_CONF"/SHA_CRYPT_MIN_ROUNDS", &value) == 1) {
 		sha_crypt_min_rounds = strtol(value, &endptr, 10);
@@ -211,6 +217,9 @@ static FILE* open_authfile(const char *username, const char *opentype, char **pa
 	const char *akf = NULL;
 
 	/* get AuthorizedKeysFile value from sshd_config */
+	if (augeas_use(AUGEAS_SSHD, 0, msg) != EXIT_SUCCESS) {
+		return (NULL);
+	}
 
 	asprintf(&filepath, "/files/%s/AuthorizedKeysFile", NETOPEER_SSHD_CONF);
 	aug_get(sysaugeas, filepath, &akf);
@@ -367,6 +376,7 @@ static xmlNodePtr authkey_getxml(const char* username, xmlNsPtr ns, char** msg)
 
 		if (id == NULL) {
 			free(line);
+			fclose(authfile);
 			xmlFreeNodeList(firstnode);
 			*msg = strdup("Invalid authorized key format.");
 			return (NULL);
@@ -397,48 +407,147 @@ static xmlNodePtr authkey_getxml(const char* username, xmlNsPtr ns, char** msg)
 		}
 	}
 	free(line);
+	fclose(authfile);
 
 	return(firstnode);
 }
 
-xmlNodePtr users_getxml(xmlNsPtr ns, char** msg)
+/*
+ * Cache of the authentication/user subtree. The users are read again only when
+ * passwd, shadow or the AuthorizedKeysFile option change, the authorized keys
+ * of a user only when its file changes. The nodes are kept without a namespace.
+ */
+struct user_cache {
+	char* name;
+	char* password;
+	char* keys_path;
+	struct stat keys_st;
+	xmlNodePtr keys;
+	struct user_cache* next;
+};
+
+static struct {
+	int valid;
+	struct stat passwd_st;
+	struct stat shadow_st;
+	char* akf;
+	struct user_cache* users;
+} users_cache = {0, {0}, {0}, NULL, NULL};
+
+static void cache_stat(const char* path, struct stat* st)
 {
-	xmlNodePtr auth_node, user, aux_node;
-	struct passwd *pwd;
-	struct spwd *spwd;
-	const char* value;
-	char *path = NULL;
+	if (path == NULL || stat(path, st) == -1) {
+		memset(st, 0, sizeof *st);
+	}
+}
 
-	if (!ncds_feature_isenabled("ietf-system", "local-users")) {
-		return (NULL);
+static int cache_stat_changed(const struct stat* st1, const struct stat* st2)
+{
+	return (st1->st_ino != st2->st_ino || st1->st_dev != st2->st_dev || st1->st_size != st2->st_size ||
+			st1->st_mtim.tv_sec != st2->st_mtim.tv_sec || st1->st_mtim.tv_nsec != st2->st_mtim.tv_nsec);
+}
+
+static void user_cache_free(struct user_cache* user)
+{
+	free(user->name);
+	free(user->password);
+	free(user->keys_path);
+	xmlFreeNode(user->keys);
+	free(user);
+}
+
+static void user_cache_keys(struct user_cache* user)
+{
+	xmlNodePtr keys;
+	char* msg = NULL;
+
+	xmlFreeNode(user->keys);
+	user->keys = xmlNewNode(NULL, BAD_CAST "user");
+	cache_stat(user->keys_path, &user->keys_st);
+
+	if (user->keys_path == NULL) {
+		return;
+	}
+	if ((keys = authkey_getxml(user->name, NULL, &msg)) != NULL) {
+		xmlAddChildList(user->keys, keys);
+	} else {
+		/* ignore failures in this case */
+		free(msg);
 	}
+}
 
-	/* authentication */
-	auth_node = xmlNewNode(ns, BAD_CAST "authentication");
+/* copy of a cached node in the namespace */
+static xmlNodePtr cache_copy(xmlNodePtr node, xmlNsPtr ns)
+{
+	xmlNodePtr copy, child;
+
+	copy = xmlNewNode(ns, node->name);
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			xmlAddChild(copy, cache_copy(child, ns));
+		} else if (child->type == XML_TEXT_NODE) {
+			xmlNodeAddContent(copy, child->content);
+		}
+	}
 
-	/* authentication/user-authentication-order */
-	asprintf(&path, "/files/%s/PasswordAuthentication", NETOPEER_SSHD_CONF);
-	aug_get(sysaugeas, path, &value);
-	free(path);
-	if (value != NULL && strcmp(value, "yes") == 0) {
-		xmlNewChild(auth_node, auth_node->ns, BAD_CAST "user-authentication-order", BAD_CAST "local-users");
+	return (copy);
+}
+
+static int users_cache_update(char** msg)
+{
+	struct user_cache *user, *old = NULL, **last, **prev;
+	struct stat passwd_st, shadow_st, keys_st;
+	struct passwd *pwd;
+	struct spwd *spwd;
+	const char* akf = NULL;
+	char *path = NULL;
+
+	asprintf(&path, "/files/%s/AuthorizedKeysFile", NETOPEER_SSHD_CONF);
+	aug_get(sysaugeas, path, &akf);
+	free(path); path = NULL;
+
+	cache_stat(PASSWD_ORIG, &passwd_st);
+	cache_stat(SHADOW_ORIG, &shadow_st);
+
+	if (users_cache.valid && !cache_stat_changed(&passwd_st, &users_cache.passwd_st) &&
+			!cache_stat_changed(&shadow_st, &users_cache.shadow_st) &&
+			((akf == NULL && users_cache.akf == NULL) ||
+			(akf != NULL && users_cache.akf != NULL && strcmp(akf, users_cache.akf) == 0))) {
+		/* the same users, only their authorized keys can differ */
+		for (user = users_cache.users; user != NULL; user = user->next) {
+			cache_stat(user->keys_path, &keys_st);
+			if (cache_stat_changed(&keys_st, &user->keys_st)) {
+				user_cache_keys(user);
+			}
+		}
+		return (EXIT_SUCCESS);
 	}
 
-	/* authentication/user[] */
 	if (lckpwdf() != 0) {
 		*msg = strdup("Failed to acquire shadow file lock.");
-		xmlFreeNode(auth_node);
-		return (NULL);
+		return (EXIT_FAILURE);
 	}
 
+	/* read the users again, the unchanged authorized keys are reused */
+	old = users_cache.users;
+	users_cache.users = NULL;
+	last = &users_cache.users;
+
 	setpwent();
 
 	while ((pwd = getpwent()) != NULL) {
-		/* authentication/user */
-		user = xmlNewChild(auth_node, auth_node->ns, BAD_CAST "user", NULL);
-
-		/* authentication/user/name */
-		xmlNewChild(user, user->ns, BAD_CAST "name", BAD_CAST pwd->pw_name);
+		for (prev = &old; *prev != NULL && strcmp((*prev)->name, pwd->pw_name) != 0; prev = &(*prev)->next);
+		if ((user = *prev) != NULL) {
+			*prev = user->next;
+			free(user->password);
+			user->password = NULL;
+		} else {
+			user = calloc(1, sizeof(struct user_cache));
+			user->name = strdup(pwd->pw_name);
+		}
+		user->next = NULL;
+		*last = user;
+		last = &user->next;
 
 		/* authentication/user/passwd */
 		if (pwd->pw_passwd[0] == 'x') {
@@ -448,20 +557,29 @@ xmlNodePtr users_getxml(xmlNsPtr ns, char** msg)
 			if (spwd != NULL && /* no record, wtf?!? */
 					spwd->sp_pwdp[0] != '!' && /* account not initiated or locked */
 					spwd->sp_pwdp[0] != '*') { /* login disabled */
-				xmlNewChild(user, user->ns, BAD_CAST "password", BAD_CAST spwd->sp_pwdp);
+				user->password = strdup(spwd->sp_pwdp);
 			}
 		} else if (pwd->pw_passwd[0] != '*') {
 			/* password is stored in /etc/passwd or refers to something else (e.g., NIS server) */
-			xmlNewChild(user, user->ns, BAD_CAST "password", BAD_CAST pwd->pw_passwd);
+			user->password = strdup(pwd->pw_passwd);
 		} /* else password is disabled */
 
 		/* authentication/user/authorized-key[] */
-		if ((aux_node = authkey_getxml(pwd->pw_name, user->ns, msg)) != NULL) {
-			xmlAddChildList(user, aux_node);
+		path = NULL;
+		if (akf != NULL && pwd->pw_dir != NULL) {
+			asprintf(&path, "%s/%s", pwd->pw_dir, akf);
+		}
+		if (user->keys != NULL && ((path == NULL && user->keys_path == NULL) ||
+				(path != NULL && user->keys_path != NULL && strcmp(path, user->keys_path) == 0))) {
+			free(path);
+			cache_stat(user->keys_path, &keys_st);
+			if (cache_stat_changed(&keys_st, &user->keys_st)) {
+				user_cache_keys(user);
+			}
 		} else {
-			/* ignore failures in this case */
-			free(*msg);
-			*msg = NULL;
+			free(user->keys_path);
+			user->keys_path = path;
+			user_cache_keys(user);
 		}
 	}
 
@@ -469,6 +587,87 @@ xmlNodePtr users_getxml(xmlNsPtr ns, char** msg)
 	endpwent();
 	ulckpwdf();
 
+	/* the removed users */
+	while ((user = old) != NULL) {
+		old = user->next;
+		user_cache_free(user);
+	}
+
+	free(users_cache.akf);
+	users_cache.akf = (akf == NULL) ? NULL : strdup(akf);
+	/* as before reading them, a change meanwhile is noticed the next time */
+	users_cache.passwd_st = passwd_st;
+	users_cache.shadow_st = shadow_st;
+	users_cache.valid = 1;
+
+	return (EXIT_SUCCESS);
+}
+
+void users_cleanup(void)
+{
+	struct user_cache* user;
+
+	while ((user = users_cache.users) != NULL) {
+		users_cache.users = user->next;
+		user_cache_free(user);
+	}
+	free(users_cache.akf);
+	users_cache.akf = NULL;
+	users_cache.valid = 0;
+}
+
+xmlNodePtr users_getxml(xmlNsPtr ns, char** msg)
+{
+	xmlNodePtr auth_node, user_node, key;
+	struct user_cache* user;
+	const char* value;
+	char *path = NULL;
+
+	if (!ncds_feature_isenabled("ietf-system", "local-users")) {
+		return (NULL);
+	}
+
+	if (augeas_use(AUGEAS_SSHD, 0, msg) != EXIT_SUCCESS) {
+		return (NULL);
+	}
+
+	/* authentication */
+	auth_node = xmlNewNode(ns, BAD_CAST "authentication");
+
+	/* authentication/user-authentication-order */
+	asprintf(&path, "/files/%s/PasswordAuthentication", NETOPEER_SSHD_CONF);
+	aug_get(sysaugeas, path, &value);
+	free(path);
+	if (value != NULL && strcmp(value, "yes") == 0) {
+		xmlNewChild(auth_node, auth_node->ns, BAD_CAST "user-authentication-order", BAD_CAST "local-users");
+	}
+
+	/* authentication/user[] */
+	if (users_cache_update(msg) != EXIT_SUCCESS) {
+		xmlFreeNode(auth_node);
+		return (NULL);
+	}
+
+	for (user = users_cache.users; user != NULL; user = user->next) {
+		/* authentication/user */
+		user_node = xmlNewChild(auth_node, auth_node->ns, BAD_CAST "user", NULL);
+
+		/* authentication/user/name */
+		xmlNewChild(user_node, user_node->ns, BAD_CAST "name", BAD_CAST user->name);
+
+		/* authentication/user/passwd */
+		if (user->password != NULL) {
+			xmlNewChild(user_node, user_node->ns, BAD_CAST "password", BAD_CAST user->password);
+		}
+
+		/* authentication/user/authorized-key[] */
+		for (key = user->keys->children; key != NULL; key = key->next) {
+			if (key->type == XML_ELEMENT_NODE) {
+				xmlAddChild(user_node, cache_copy(key, user_node->ns));
+			}
+		}
+	}
+
 	return (auth_node);
 }
 
@@ -567,6 +766,10 @@ static int switch_auth(const char *value, char **msg)
 	augeas *augeas_running;
 	char *path = NULL;
 
+	if (augeas_use(AUGEAS_SSHD, 1, msg) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
 	asprintf(&path, "/files/%s/PasswordAuthentication", NETOPEER_SSHD_CONF);
 	if (aug_set(sysaugeas, path, value) == -1) {
 		asprintf(msg, "Unable to set PasswordAuthentication to \"%s\" (%s).", value, aug_error_message(sysaugeas));
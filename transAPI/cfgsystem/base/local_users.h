@@ -53,6 +53,11 @@
  */
 xmlNodePtr users_getxml(xmlNsPtr ns, char** msg);
 
+/**
+ * @brief Drop the cache of the users read by users_getxml().
+ */
+void users_cleanup(void);
+
 /**
  * @brief Add new user.
  * @param name[in] username
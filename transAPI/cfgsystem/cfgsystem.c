@@ -181,6 +181,8 @@ PUBLIC int transapi_init(xmlDocPtr *running)
 PUBLIC void transapi_close(void)
 {
 	augeas_close();
+	ntp_resolve_cleanup();
+	users_cleanup();
 	return;
 }
 
@@ -358,7 +360,10 @@ PUBLIC int callback_systemns_system_systemns_ntp_systemns_enabled(void** data, X
 				return fail(error, msg, EXIT_FAILURE);
 			}
 		} else if (strcmp(get_node_content(new_node), "false") == 0) {
-			if (ntp_stop() != EXIT_SUCCESS) {
+			if (ntp_stop() == EXIT_SUCCESS) {
+				/* flag for parent callback, nothing to restart */
+				ntp_restart_flag = false;
+			} else {
 				asprintf(&msg, "Failed to stop NTP.");
 				return fail(error, msg, EXIT_FAILURE);
 			}
@@ -376,6 +381,47 @@ PUBLIC int callback_systemns_system_systemns_ntp_systemns_enabled(void** data, X
 	return EXIT_SUCCESS;
 }
 
+/* start resolving the addresses of all the pool servers in the ntp container at once */
+static void ntp_prefetch_pools(xmlNodePtr ntp)
+{
+	xmlNodePtr server, child, cur;
+	const char** names = NULL;
+	const char* address;
+	bool pool;
+	int count = 0;
+
+	for (server = ntp->children; server != NULL; server = server->next) {
+		if (server->type != XML_ELEMENT_NODE || xmlStrcmp(server->name, BAD_CAST "server") != 0) {
+			continue;
+		}
+
+		address = NULL;
+		pool = false;
+		for (child = server->children; child != NULL; child = child->next) {
+			if (child->type != XML_ELEMENT_NODE) {
+				continue;
+			}
+			if (xmlStrcmp(child->name, BAD_CAST "udp") == 0) {
+				for (cur = child->children; cur != NULL; cur = cur->next) {
+					if (cur->type == XML_ELEMENT_NODE && xmlStrcmp(cur->name, BAD_CAST "address") == 0) {
+						address = get_node_content(cur);
+					}
+				}
+			} else if (xmlStrcmp(child->name, BAD_CAST "association-type") == 0) {
+				pool = (get_node_content(child) != NULL && strcmp(get_node_content(child), "pool") == 0);
+			}
+		}
+
+		if (pool && address != NULL) {
+			names = realloc(names, (count + 1) * sizeof(char*));
+			names[count++] = address;
+		}
+	}
+
+	ntp_resolve_prefetch(names, count);
+	free(names);
+}
+
 /**
  * @brief This callback will be run when node in path /systemns:system/systemns:ntp/systemns:server changes
  *
@@ -443,7 +489,9 @@ PUBLIC int callback_systemns_system_systemns_ntp_systemns_server(void** data, XM
 		}
 
 		/* Manual address resolution if pool used */
-		if (strcmp(association_type, "pool") == 0) {
+		if (association_type != NULL && strcmp(association_type, "pool") == 0) {
+			/* the other pools of the transaction are resolved meanwhile */
+			ntp_prefetch_pools(node->parent);
 			resolved = ntp_resolve_server(udp_address, &msg);
 			if (resolved == NULL) {
 				goto error;
@@ -487,6 +535,9 @@ PUBLIC int callback_systemns_system_systemns_ntp_systemns_server(void** data, XM
 		}
 
 		if (resolved) {
+			for (i = 0; resolved[i] != NULL; i++) {
+				free(resolved[i]);
+			}
 			free(resolved);
 		}
 
@@ -812,16 +863,11 @@ PUBLIC int callback_systemns_system_systemns_dns_resolver_systemns_options_syste
 /* !DO NOT ALTER FUNCTION SIGNATURE! */
 PUBLIC int callback_systemns_system_systemns_dns_resolver(void** data, XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** error)
 {
-	char* msg = NULL;
-
 	/* Reset REORDER flags in order to process these changes in the next configuration change */
 	dns_search_reorder_done = false;
 	dns_server_reorder_done = false;
 
-	/* Save the changes made by children callbacks via augeas */
-	if (augeas_save(&msg) != 0) {
-		return fail(error, msg, EXIT_FAILURE);
-	}
+	/* the changes are saved in the system callback */
 
 	return EXIT_SUCCESS;
 }
@@ -1031,13 +1077,36 @@ PUBLIC int callback_systemns_system_systemns_authentication_systemns_auth_order(
 	return (EXIT_SUCCESS);
 }
 
+/**
+ * @brief This callback will be run when node in path /systemns:system changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+/* !DO NOT ALTER FUNCTION SIGNATURE! */
+PUBLIC int callback_systemns_system(void** data, XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err** error)
+{
+	char* msg = NULL;
+
+	/* Called after all the other callbacks, save the files still modified via augeas at once */
+	if (augeas_save(&msg) != 0) {
+		return fail(error, msg, EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
 /*
  * Structure transapi_config_callbacks provide mapping between callback and path in configuration datastore.
  * It is used by libnetconf library to decide which callbacks will be run.
  * DO NOT alter this structure
  */
 PUBLIC struct transapi_data_callbacks clbks = {
-	.callbacks_count = 14,
+	.callbacks_count = 15,
 	.data = NULL,
 	.callbacks = {
 		{.path = "/systemns:system/systemns:hostname",
@@ -1067,7 +1136,9 @@ PUBLIC struct transapi_data_callbacks clbks = {
 		{.path = "/systemns:system/systemns:authentication/systemns:user",
 			.func = callback_systemns_system_systemns_authentication_systemns_user},
 		{.path = "/systemns:system/systemns:authentication/systemns:user-authentication-order",
-			.func = callback_systemns_system_systemns_authentication_systemns_auth_order }
+			.func = callback_systemns_system_systemns_authentication_systemns_auth_order},
+		{.path = "/systemns:system",
+			.func = callback_systemns_system}
 	}
 };
 
@@ -6,6 +6,7 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -65,13 +66,44 @@ struct delta_rule {
 	struct delta_rule *next;
 };
 
+/* compiled delta rule, head_move 0 if there is no rule */
+struct delta_action {
+	state_index out_state;
+	tape_symbol out_symbol;
+	int8_t head_move;
+};
+
+#define TM_SYMBOLS 256
+#define TM_BATCH_STEPS 65536
+
+/* parameters of the run RPC */
+struct tm_run_params {
+	int batch;
+	uint64_t max_steps; /* 0 - unlimited */
+};
+
+#define TM_SEGMENT_BITS 12
+#define TM_SEGMENT_LEN (1 << TM_SEGMENT_BITS)
+
 /* internal data */
-static tape_symbol *tm_head = NULL;
-static tape_symbol *tm_tape = NULL;
-static cell_index tm_tape_len = 0;
+static cell_index tm_head = 0;
 static state_index tm_state = 0;
+static cell_index tm_tape_window = -1; /* -1 - the whole tape in the state data */
 static struct delta_rule *tm_delta = NULL;
 
+/*
+ * The tape grows in both directions by segments of TM_SEGMENT_LEN cells, tm_segs[0]
+ * starts at the cell tm_seg_first * TM_SEGMENT_LEN. A NULL segment is blank.
+ */
+static tape_symbol **tm_segs = NULL;
+static cell_index tm_seg_first = 0;
+static cell_index tm_seg_count = 0;
+
+/* delta rules indexed by [state][symbol], a row only for the states with a rule */
+static struct delta_action **tm_table = NULL;
+static unsigned int tm_table_states = 0;
+static int tm_table_valid = 0;
+
 /* mutexes */
 static pthread_mutex_t tm_data_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t tm_run_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -87,6 +119,142 @@ static void free_delta_rule(struct delta_rule *rule)
 	}
 }
 
+/**
+ * @brief Read a cell of the tape
+ */
+static tape_symbol tape_read(cell_index coord)
+{
+	cell_index seg = (coord >> TM_SEGMENT_BITS) - tm_seg_first;
+
+	if (seg < 0 || seg >= tm_seg_count || tm_segs[seg] == NULL) {
+		return '\0';
+	}
+	return tm_segs[seg][coord & (TM_SEGMENT_LEN - 1)];
+}
+
+/**
+ * @brief Get a cell of the tape for writing, the tape grows if needed
+ * @return The cell or NULL when out of memory, the tape is left unchanged then
+ */
+static tape_symbol* tape_cell(cell_index coord)
+{
+	cell_index seg = coord >> TM_SEGMENT_BITS, grow;
+	tape_symbol **segs;
+
+	if (tm_seg_count == 0) {
+		tm_seg_first = seg;
+	}
+
+	if (seg < tm_seg_first) {
+		/* at least double the tape not to grow it too often */
+		grow = tm_seg_first - seg;
+		if (grow < tm_seg_count) {
+			grow = tm_seg_count;
+		}
+		if ((segs = realloc(tm_segs, (tm_seg_count + grow) * sizeof(tape_symbol*))) == NULL) {
+			return NULL;
+		}
+		tm_segs = segs;
+		memmove(tm_segs + grow, tm_segs, tm_seg_count * sizeof(tape_symbol*));
+		memset(tm_segs, 0, grow * sizeof(tape_symbol*));
+		tm_seg_first -= grow;
+		tm_seg_count += grow;
+	} else if (seg >= tm_seg_first + tm_seg_count) {
+		grow = seg - (tm_seg_first + tm_seg_count) + 1;
+		if (grow < tm_seg_count) {
+			grow = tm_seg_count;
+		}
+		if ((segs = realloc(tm_segs, (tm_seg_count + grow) * sizeof(tape_symbol*))) == NULL) {
+			return NULL;
+		}
+		tm_segs = segs;
+		memset(tm_segs + tm_seg_count, 0, grow * sizeof(tape_symbol*));
+		tm_seg_count += grow;
+	}
+
+	seg -= tm_seg_first;
+	if (tm_segs[seg] == NULL) {
+		if ((tm_segs[seg] = calloc(TM_SEGMENT_LEN, sizeof(tape_symbol))) == NULL) {
+			return NULL;
+		}
+	}
+
+	return &tm_segs[seg][coord & (TM_SEGMENT_LEN - 1)];
+}
+
+/**
+ * @brief Free the tape
+ */
+static void free_tape(void)
+{
+	cell_index i;
+
+	for (i = 0; i < tm_seg_count; i++) {
+		free(tm_segs[i]);
+	}
+	free(tm_segs);
+	tm_segs = NULL;
+	tm_seg_first = 0;
+	tm_seg_count = 0;
+}
+
+/**
+ * @brief Free the compiled delta rules
+ */
+static void free_delta_table(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < tm_table_states; i++) {
+		free(tm_table[i]);
+	}
+	free(tm_table);
+	tm_table = NULL;
+	tm_table_states = 0;
+	tm_table_valid = 0;
+}
+
+/**
+ * @brief Compile the delta rules into tm_table, tm_data_lock must be held
+ * @return EXIT_SUCCESS or EXIT_FAILURE when out of memory, no table is left then
+ */
+static int compile_delta_table(void)
+{
+	struct delta_rule *rule;
+	struct delta_action *action, **table;
+
+	free_delta_table();
+
+	for (rule = tm_delta; rule != NULL; rule = rule->next) {
+		if (rule->in_state >= tm_table_states) {
+			if ((table = realloc(tm_table, (rule->in_state + 1) * sizeof(struct delta_action*))) == NULL) {
+				free_delta_table();
+				return EXIT_FAILURE;
+			}
+			tm_table = table;
+			memset(tm_table + tm_table_states, 0, (rule->in_state + 1 - tm_table_states) * sizeof(struct delta_action*));
+			tm_table_states = rule->in_state + 1;
+		}
+		if (tm_table[rule->in_state] == NULL) {
+			if ((tm_table[rule->in_state] = calloc(TM_SYMBOLS, sizeof(struct delta_action))) == NULL) {
+				free_delta_table();
+				return EXIT_FAILURE;
+			}
+		}
+
+		/* the first matching rule in the list is used, as when searching it */
+		action = &tm_table[rule->in_state][(unsigned char)rule->in_symbol];
+		if (action->head_move == 0) {
+			action->out_state = rule->out_state;
+			action->out_symbol = rule->out_symbol;
+			action->head_move = rule->head_move;
+		}
+	}
+
+	tm_table_valid = 1;
+	return EXIT_SUCCESS;
+}
+
 /**
  * @brief Initialize plugin after loaded and before any other functions are called.
  * @param[out] running	Current configuration of managed device.
@@ -105,13 +273,14 @@ void transapi_close(void)
 	struct delta_rule *rule;
 
 	/* free tape */
-	free(tm_tape);
+	free_tape();
 
 	/* free internal list of delta rules */
 	for (rule = tm_delta; rule != NULL; rule = tm_delta) {
 		tm_delta = rule->next;
 		free_delta_rule(rule);
 	}
+	free_delta_table();
 
 	return;
 }
@@ -126,11 +295,64 @@ void transapi_close(void)
  */
 xmlDocPtr get_state_data(xmlDocPtr model, xmlDocPtr running, struct nc_err **err)
 {
-	char *data = NULL, symbol[2];
+	char data[24], symbol[2];
 	xmlDocPtr doc = NULL;
 	xmlNodePtr root, tape, cell;
 	xmlNsPtr ns;
-	uint64_t i;
+	tape_symbol **segs = NULL;
+	cell_index i, seg, from, to, seg_from = 0, seg_to = -1, head;
+	state_index state;
+
+	/* lock internal structures only to take a snapshot of the tape */
+	pthread_mutex_lock(&tm_data_lock);
+
+	state = tm_state;
+	head = tm_head;
+
+	if (tm_seg_count != 0) {
+		from = tm_seg_first * TM_SEGMENT_LEN;
+		to = (tm_seg_first + tm_seg_count) * TM_SEGMENT_LEN - 1;
+		if (tm_tape_window != -1) {
+			/* only the cells around the head */
+			if (head - from > tm_tape_window) {
+				from = head - tm_tape_window;
+			}
+			if (to - head > tm_tape_window) {
+				to = head + tm_tape_window;
+			}
+		}
+
+		if (from <= to) {
+			seg_from = (from >> TM_SEGMENT_BITS) - tm_seg_first;
+			seg_to = (to >> TM_SEGMENT_BITS) - tm_seg_first;
+			if ((segs = calloc(seg_to - seg_from + 1, sizeof(tape_symbol*))) == NULL) {
+				pthread_mutex_unlock(&tm_data_lock);
+				*err = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(*err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+				return NULL;
+			}
+			for (seg = seg_from; seg <= seg_to; seg++) {
+				if (tm_segs[seg] != NULL) {
+					if ((segs[seg - seg_from] = malloc(TM_SEGMENT_LEN)) == NULL) {
+						pthread_mutex_unlock(&tm_data_lock);
+						for (seg = 0; seg <= seg_to - seg_from; seg++) {
+							free(segs[seg]);
+						}
+						free(segs);
+						*err = nc_err_new(NC_ERR_OP_FAILED);
+						nc_err_set(*err, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+						return NULL;
+					}
+					memcpy(segs[seg - seg_from], tm_segs[seg], TM_SEGMENT_LEN);
+				}
+			}
+			seg_from += tm_seg_first;
+			seg_to += tm_seg_first;
+		}
+	}
+
+	/* unlock internal structures */
+	pthread_mutex_unlock(&tm_data_lock);
 
 	/* create XML doc with <turing-machine/> root */
 	doc = xmlNewDoc(BAD_CAST "1.0");
@@ -138,49 +360,40 @@ xmlDocPtr get_state_data(xmlDocPtr model, xmlDocPtr running, struct nc_err **err
 	ns = xmlNewNs(root, BAD_CAST "http://example.net/turing-machine", NULL);
 	xmlSetNs(root, ns);
 
-	/* lock internal structures */
-	pthread_mutex_lock(&tm_data_lock);
-
 	/* add <state/> leaf */
-	asprintf(&data, "%d", tm_state);
+	snprintf(data, sizeof data, "%d", state);
 	xmlNewChild(root, root->ns, BAD_CAST "state", BAD_CAST data);
-	free(data);
-	data = NULL;
 
 	/* add <head-position/> leaf */
-	asprintf(&data, "%ld", tm_head - tm_tape);
+	snprintf(data, sizeof data, "%" PRId64, head);
 	xmlNewChild(root, root->ns, BAD_CAST "head-position", BAD_CAST data);
-	free(data);
-	data = NULL;
 
 	/* add <tape/> container */
 	tape = xmlNewChild(root, root->ns, BAD_CAST "tape", NULL);
-	if (tm_tape == NULL) {
-		/* unlock internal structures */
-		pthread_mutex_unlock(&tm_data_lock);
-		return doc;
-	}
 
-	for (i = 0, symbol[1] = '\0'; i < tm_tape_len; i++) {
-		/* skip cells with empty value */
-		if (tm_tape[i] == '\0') {
+	for (seg = seg_from, symbol[1] = '\0'; seg <= seg_to; seg++) {
+		if (segs[seg - seg_from] == NULL) {
 			continue;
 		}
 
-		/* add <cell/> list items */
-		cell = xmlNewChild(tape, tape->ns, BAD_CAST "cell", NULL);
+		for (i = 0; i < TM_SEGMENT_LEN; i++) {
+			/* skip cells with empty value and out of the window */
+			if (segs[seg - seg_from][i] == '\0' || seg * TM_SEGMENT_LEN + i < from || seg * TM_SEGMENT_LEN + i > to) {
+				continue;
+			}
 
-		asprintf(&data, "%ld", i);
-		xmlNewChild(cell, cell->ns, BAD_CAST "coord", BAD_CAST data);
-		free(data);
-		data = NULL;
+			/* add <cell/> list items */
+			cell = xmlNewChild(tape, tape->ns, BAD_CAST "cell", NULL);
 
-		symbol[0] = tm_tape[i];
-		xmlNewChild(cell, cell->ns, BAD_CAST "symbol", BAD_CAST symbol);
-	}
+			snprintf(data, sizeof data, "%" PRId64, seg * TM_SEGMENT_LEN + i);
+			xmlNewChild(cell, cell->ns, BAD_CAST "coord", BAD_CAST data);
 
-	/* unlock internal structures */
-	pthread_mutex_unlock(&tm_data_lock);
+			symbol[0] = segs[seg - seg_from][i];
+			xmlNewChild(cell, cell->ns, BAD_CAST "symbol", BAD_CAST symbol);
+		}
+		free(segs[seg - seg_from]);
+	}
+	free(segs);
 
 	/* return turing machine state information */
 	return doc;
@@ -225,6 +438,10 @@ int callback_tm_turing_machine_tm_transition_function_tm_delta(void **data, XMLD
 		op = XMLDIFF_REM | XMLDIFF_ADD;
 	}
 
+	/* the running machine compiles the rules again in its next batch */
+	pthread_mutex_lock(&tm_data_lock);
+	tm_table_valid = 0;
+
 	if (op & XMLDIFF_REM) {
 		/* Removing an existing rule */
 
@@ -316,9 +533,46 @@ int callback_tm_turing_machine_tm_transition_function_tm_delta(void **data, XMLD
 		/* add the rule into the internal list */
 		rule->prev = NULL;
 		rule->next = tm_delta;
+		if (tm_delta) {
+			tm_delta->prev = rule;
+		}
 		tm_delta = rule;
 	}
 
+	pthread_mutex_unlock(&tm_data_lock);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief This callback will be run when node in path /tm:turing-machine/tm:tape-window changes
+ *
+ * @param[in] data	Double pointer to void. Its passed to every callback. You can share data using it.
+ * @param[in] op	Observed change in path. XMLDIFF_OP type.
+ * @param[in] node	Modified node. if op == XMLDIFF_REM its copy of node removed.
+ * @param[out] error	If callback fails, it can return libnetconf error structure with a failure description.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int callback_tm_turing_machine_tm_tape_window(void **data, XMLDIFF_OP op, xmlNodePtr old_node, xmlNodePtr new_node, struct nc_err **error)
+{
+	char *content = NULL;
+	unsigned long long window;
+
+	if (op & (XMLDIFF_ADD | XMLDIFF_MOD)) {
+		content = (char*)xmlNodeGetContent(new_node);
+		window = (content != NULL) ? strtoull(content, NULL, 10) : 0;
+		free(content);
+	}
+
+	pthread_mutex_lock(&tm_data_lock);
+	if (op & XMLDIFF_REM) {
+		tm_tape_window = -1;
+	} else if (op & (XMLDIFF_ADD | XMLDIFF_MOD)) {
+		tm_tape_window = (window > INT64_MAX) ? INT64_MAX : (cell_index)window;
+	}
+	pthread_mutex_unlock(&tm_data_lock);
+
 	return EXIT_SUCCESS;
 }
 
@@ -327,9 +581,10 @@ int callback_tm_turing_machine_tm_transition_function_tm_delta(void **data, XMLD
  * It is used by libnetconf library to decide which callbacks will be run.
  */
 struct transapi_data_callbacks clbks =  {
-	.callbacks_count = 1,
+	.callbacks_count = 2,
 	.data = NULL,
 	.callbacks = {
+		{.path = "/tm:turing-machine/tm:tape-window", .func = callback_tm_turing_machine_tm_tape_window},
 		{.path = "/tm:turing-machine/tm:transition-function/tm:delta", .func = callback_tm_turing_machine_tm_transition_function_tm_delta}
 	}
 };
@@ -366,6 +621,9 @@ nc_reply *rpc_initialize(xmlNodePtr input)
 {
 	xmlNodePtr tape_content = get_rpc_node("tape-content", input);
 	struct nc_err* e = NULL;
+	char *content;
+	tape_symbol *cell;
+	cell_index i;
 
 	if (pthread_mutex_trylock(&tm_run_lock) != 0) {
 		/* turing machine is still running */
@@ -374,69 +632,102 @@ nc_reply *rpc_initialize(xmlNodePtr input)
 		return nc_reply_error(e);
 	}
 
-	free(tm_tape);
+	content = (char*)xmlNodeGetContent(tape_content);
 
-	tm_state = 0;
-	tm_tape = tm_head = (char*)xmlNodeGetContent(tape_content);
+	/* lock internal structures */
+	pthread_mutex_lock(&tm_data_lock);
 
-	if (tm_tape == NULL) {
-		/* tape is empty, the default value */
-		tm_tape = tm_head = strdup("");
+	free_tape();
+	tm_state = 0;
+	tm_head = 0;
+
+	/* empty tape is the default value */
+	for (i = 0; content != NULL && content[i] != '\0'; i++) {
+		if ((cell = tape_cell(i)) == NULL) {
+			/* do not leave a partial tape */
+			free_tape();
+			e = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(e, NC_ERR_PARAM_MSG, "Unable to allocate the tape.");
+			break;
+		}
+		*cell = content[i];
 	}
 
-	/* remember the length of the tape */
-	tm_tape_len = strlen(tm_tape) + 1;
+	/* unlock internal structures */
+	pthread_mutex_unlock(&tm_data_lock);
 	pthread_mutex_unlock(&tm_run_lock);
 
-	return nc_reply_ok();
+	free(content);
+
+	return (e != NULL) ? nc_reply_error(e) : nc_reply_ok();
 }
 
 static void* tm_run(void *arg)
 {
-	int changed = 1;
-	struct delta_rule *rule = NULL;
+	struct tm_run_params *params = (struct tm_run_params*)arg;
+	struct delta_action *action;
+	tape_symbol symbol, *cell;
+	uint64_t steps = 0, batch_end;
+	int halted = 0;
 	char *ntf = NULL;
 
 	pthread_mutex_lock(&tm_run_lock);
 
-	while(changed) {
-		changed = 0;
+	while (!halted && (params->max_steps == 0 || steps < params->max_steps)) {
+		/* one step at a time not to eat CPU, or many steps at once */
+		batch_end = steps + (params->batch ? TM_BATCH_STEPS : 1);
+		if (params->max_steps != 0 && batch_end > params->max_steps) {
+			batch_end = params->max_steps;
+		}
+
+		/* lock internal structures */
+		pthread_mutex_lock(&tm_data_lock);
 
-		/* check the head */
-		if (tm_head < tm_tape || (tm_head - tm_tape) >= tm_tape_len) {
+		if (!tm_table_valid && compile_delta_table() != EXIT_SUCCESS) {
+			/* the rules changed since the run was replied to */
+			pthread_mutex_unlock(&tm_data_lock);
+			nc_verb_error("Turing machine stopped, unable to compile the delta rules.");
 			break;
 		}
 
-		/* find rule */
-		for (rule = tm_delta; rule != NULL; rule = rule->next) {
-			if (rule->in_state == tm_state && rule->in_symbol == tm_head[0]) {
-				/* lock internal structures */
-				pthread_mutex_lock(&tm_data_lock);
+		for (; steps < batch_end; steps++) {
+			/* find rule, the tape is unbounded */
+			symbol = tape_read(tm_head);
+			if (tm_state >= tm_table_states || tm_table[tm_state] == NULL ||
+					(action = &tm_table[tm_state][(unsigned char)symbol])->head_move == 0) {
+				halted = 1;
+				break;
+			}
 
-				/* perform delta */
-				if (rule->out_state != 0xffff) {
-					tm_state = rule->out_state;
+			/* perform delta, blank cells are not allocated */
+			if (action->out_state != 0xffff) {
+				tm_state = action->out_state;
+			}
+			if (action->out_symbol != symbol) {
+				if ((cell = tape_cell(tm_head)) == NULL) {
+					/* the run has already been replied to, stop in the current configuration */
+					nc_verb_error("Turing machine stopped, unable to grow the tape.");
+					halted = 1;
+					break;
 				}
-				tm_head[0] = rule->out_symbol;
-				tm_head = tm_head + rule->head_move;
-
-				/* unlock internal structures */
-				pthread_mutex_unlock(&tm_data_lock);
-
-				/* remember that we did something */
-				changed = 1;
+				*cell = action->out_symbol;
+			}
+			tm_head = tm_head + action->head_move;
+		}
 
-				/* don't eat CPU */
-				usleep(100);
+		/* unlock internal structures */
+		pthread_mutex_unlock(&tm_data_lock);
 
-				break;
-			}
+		if (!params->batch && !halted) {
+			/* don't eat CPU */
+			usleep(100);
 		}
 	}
 
-	asprintf(&ntf, "<halted xmlns=\"http://example.net/turing-machine\"><state>%d</state></halted>", tm_state);
+	asprintf(&ntf, "<halted xmlns=\"http://example.net/turing-machine\"><state>%d</state><steps>%" PRIu64 "</steps></halted>", tm_state, steps);
 	ncntf_event_new(-1, NCNTF_GENERIC, ntf);
 	free(ntf);
+	free(params);
 
 	pthread_mutex_unlock(&tm_run_lock);
 
@@ -445,9 +736,12 @@ static void* tm_run(void *arg)
 
 nc_reply *rpc_run(xmlNodePtr input)
 {
+	xmlNodePtr mode = get_rpc_node("mode", input);
+	xmlNodePtr max_steps = get_rpc_node("max-steps", input);
+	struct tm_run_params *params;
 	pthread_t tm_run_thread;
 	struct nc_err *e;
-	char *emsg = NULL;
+	char *emsg = NULL, *content;
 	int r;
 
 	if (pthread_mutex_trylock(&tm_run_lock) != 0) {
@@ -457,7 +751,32 @@ nc_reply *rpc_run(xmlNodePtr input)
 		return nc_reply_error(e);
 	}
 
-	if ((r = pthread_create(&tm_run_thread, NULL, tm_run, NULL)) != 0) {
+	/* compile the rules now to report a failure in the reply */
+	pthread_mutex_lock(&tm_data_lock);
+	r = (tm_table_valid || compile_delta_table() == EXIT_SUCCESS);
+	pthread_mutex_unlock(&tm_data_lock);
+
+	if (!r || (params = calloc(1, sizeof(struct tm_run_params))) == NULL) {
+		pthread_mutex_unlock(&tm_run_lock);
+		e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "Memory allocation failed.");
+		return nc_reply_error(e);
+	}
+
+	if (mode) {
+		content = (char*)xmlNodeGetContent(mode);
+		params->batch = (content != NULL && strcmp(content, "batch") == 0);
+		free(content);
+	}
+	if (max_steps) {
+		content = (char*)xmlNodeGetContent(max_steps);
+		params->max_steps = (content != NULL) ? strtoull(content, NULL, 10) : 0;
+		free(content);
+	}
+
+	if ((r = pthread_create(&tm_run_thread, NULL, tm_run, params)) != 0) {
+		pthread_mutex_unlock(&tm_run_lock);
+		free(params);
 		e = nc_err_new(NC_ERR_OP_FAILED);
 		asprintf(&emsg, "Unable to start turing machine thread (%s)", strerror(r));
 		nc_err_set(e, NC_ERR_PARAM_MSG, emsg);